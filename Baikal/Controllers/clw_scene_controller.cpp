@@ -1,4 +1,5 @@
 #include "Controllers/clw_scene_controller.h"
+#include "Controllers/clw_virtual_texture_cache.h"
 #include "SceneGraph/scene1.h"
 #include "SceneGraph/camera.h"
 #include "SceneGraph/light.h"
@@ -10,22 +11,42 @@
 #include "SceneGraph/uberv2material.h"
 #include "SceneGraph/inputmaps.h"
 #include "Utils/distribution1d.h"
+#include "Utils/distribution2d.h"
+#include "Utils/light_bvh.h"
+#include "Utils/thread_pool.h"
 #include "Utils/log.h"
+#include "Utils/cl_inputmap_bytecode_generator.h"
 #include "Utils/cl_inputmap_generator.h"
 #include "Utils/cl_program_manager.h"
+#include "Utils/clw_profiler.h"
 #include "Utils/cl_uberv2_generator.h"
+#include "Utils/half.h"
+#include "math/mathutils.h"
 
 
 #include <chrono>
+#include <cmath>
+#include <future>
+#include <map>
 #include <memory>
 #include <stack>
 #include <vector>
 #include <array>
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
 
 using namespace RadeonRays;
 
 namespace Baikal
 {
+    // Replaces generated uberv2_generated.cl and inputmaps.cl in interpreter mode,
+    // enables bxdf_uberv2_interpreter.cl and inputmaps_interpreter.cl.
+    static char const* kInterpreterHeader =
+        "#ifndef BAIKAL_UBERV2_INTERPRETER\n"
+        "#define BAIKAL_UBERV2_INTERPRETER\n"
+        "#endif\n";
+
     static std::size_t align16(std::size_t value)
     {
         return (value + 0xF) / 0x10 * 0x10;
@@ -51,11 +72,15 @@ namespace Baikal
     }
 
 
-    ClwSceneController::ClwSceneController(CLWContext context, RadeonRays::IntersectionApi* api, const CLProgramManager *program_manager)
+    ClwSceneController::ClwSceneController(CLWContext context, RadeonRays::IntersectionApi* api, const CLProgramManager *program_manager,
+                                           MaterialCompilationMode material_compilation_mode)
     : m_context(context)
     , m_api(api)
     , m_default_material(UberV2Material::Create())
     , m_program_manager(program_manager)
+    , m_material_compilation_mode(material_compilation_mode)
+    , m_virtual_texture_cache_size(kDefaultVirtualTextureCacheSize)
+    , m_thread_pool(new ThreadPool())
     {
         auto acc_type = "fatbvh";
         auto builder_type = "sah";
@@ -79,89 +104,77 @@ namespace Baikal
     {
     }
 
-    static void SplitMeshesAndInstances(Iterator& shape_iter, std::set<Mesh::Ptr>& meshes, std::set<Instance::Ptr>& instances, std::set<Mesh::Ptr>& excluded_meshes)
+    void ClwSceneController::UpdateShapeRegistry(Scene1 const& scene, ClwScene& out) const
     {
-        // Clear all sets
-        meshes.clear();
-        instances.clear();
-        excluded_meshes.clear();
+        auto& registry = out.shape_registry;
 
-        // Prepare instance check lambda
-        auto is_instance = [](Shape::Ptr shape)
+        if (registry.valid && registry.revision == scene.GetShapeRevision())
         {
-            if (std::dynamic_pointer_cast<Instance>(shape))
+            // Instances might have got new base shapes without changing the shape list
+            auto bases_changed = false;
+
+            for (std::size_t i = 0; i < registry.instances.size() && !bases_changed; ++i)
             {
-                return true;
+                bases_changed = registry.instances[i]->GetBaseShape() != registry.instance_bases[i];
             }
-            else
+
+            if (!bases_changed)
             {
-                return false;
+                return;
             }
-        };
+        }
 
-        for (; shape_iter.IsValid(); shape_iter.Next())
+        registry.meshes.clear();
+        registry.num_excluded_meshes = 0;
+        registry.instances.clear();
+        registry.instance_bases.clear();
+        registry.indices.clear();
+
+        for (auto shape_iter = scene.CreateShapeIterator(); shape_iter->IsValid(); shape_iter->Next())
         {
-            auto shape = shape_iter.ItemAs<Shape>();
+            auto shape = shape_iter->ItemAs<Shape>();
+            auto instance = std::dynamic_pointer_cast<Instance>(shape);
 
-            if (!is_instance(shape))
+            if (instance)
             {
-                meshes.emplace(std::static_pointer_cast<Mesh>(shape));
+                registry.instances.push_back(instance);
             }
             else
             {
-                instances.emplace(std::static_pointer_cast<Instance>(shape));
-            }
-        }
-
-        for (auto& i : instances)
-        {
-            auto base_mesh = std::static_pointer_cast<Mesh>(i->GetBaseShape());
-            if (meshes.find(base_mesh) == meshes.cend())
-            {
-                excluded_meshes.emplace(base_mesh);
+                registry.meshes.push_back(std::static_pointer_cast<Mesh>(shape));
             }
         }
-    }
 
-    static std::size_t GetShapeIdx(Iterator& shape_iter, Shape::Ptr shape)
-    {
-        std::set<Mesh::Ptr> meshes;
-        std::set<Mesh::Ptr> excluded_meshes;
-        std::set<Instance::Ptr> instances;
-        SplitMeshesAndInstances(shape_iter, meshes, instances, excluded_meshes);
+        registry.indices.reserve(registry.meshes.size() + 2 * registry.instances.size());
 
-        std::size_t idx = 0;
-        for (auto& i : meshes)
+        int idx = 0;
+        for (auto const& mesh : registry.meshes)
         {
-            if (i == shape)
-            {
-                return idx;
-            }
-
-            ++idx;
+            registry.indices.emplace(mesh->GetId(), idx++);
         }
 
-        for (auto& i : excluded_meshes)
+        // Base meshes which are not in the scene go right after scene meshes
+        for (auto const& instance : registry.instances)
         {
-            if (i == shape)
+            auto base_mesh = std::static_pointer_cast<Mesh>(instance->GetBaseShape());
+            registry.instance_bases.push_back(base_mesh);
+
+            if (registry.indices.emplace(base_mesh->GetId(), idx).second)
             {
-                return idx;
+                registry.meshes.push_back(base_mesh);
+                ++registry.num_excluded_meshes;
+                ++idx;
             }
-
-            ++idx;
         }
 
-        for (auto& i : instances)
+        for (auto const& instance : registry.instances)
         {
-            if (i == shape)
-            {
-                return idx;
-            }
-
-            ++idx;
+            registry.indices.emplace(instance->GetId(), idx++);
         }
 
-        return -1;
+        registry.revision = scene.GetShapeRevision();
+        registry.valid = true;
+        ++registry.generation;
     }
 
     void ClwSceneController::UpdateIntersector(Scene1 const& scene, ClwScene& out) const
@@ -188,24 +201,19 @@ namespace Baikal
             throw std::runtime_error("No shapes in the scene");
         }
 
-        // Split all shapes into meshes and instances sets.
-        std::set<Mesh::Ptr> meshes;
-        // Excluded shapes are shapes which are not in the scene,
-        // but references by at least one instance.
-        std::set<Mesh::Ptr> excluded_meshes;
-        std::set<Instance::Ptr> instances;
-        SplitMeshesAndInstances(*shape_iter, meshes, instances, excluded_meshes);
+        UpdateShapeRegistry(scene, out);
+        auto const& registry = out.shape_registry;
 
-        // Keep shape->rr shape association for
-        // instance base shape lookup.
-        std::map<Shape::Ptr, RadeonRays::Shape*> rr_shapes;
+        // Meshes which are not in the scene (referenced by instances only)
+        // are not attached to the API.
+        auto num_visible_meshes = registry.meshes.size() - registry.num_excluded_meshes;
 
         // Start from ID 1
         // Handle meshes
         int id = 1;
-        for (auto& iter : meshes)
+        for (std::size_t i = 0; i < registry.meshes.size(); ++i)
         {
-            auto mesh = iter;
+            auto const& mesh = registry.meshes[i];
 
             auto shape = m_api->CreateMesh(
                                            // Vertices starting from the first one
@@ -230,44 +238,17 @@ namespace Baikal
             //shape->SetMask(iter->GetVisibilityMask());
 
             out.isect_shapes.push_back(shape);
-            out.visible_shapes.push_back(shape);
-            rr_shapes[mesh] = shape;
-        }
-
-        // Handle excluded meshes
-        for (auto& iter : excluded_meshes)
-        {
-            auto mesh = iter;
-
-            auto shape = m_api->CreateMesh(
-                                           // Vertices starting from the first one
-                                           (float*)mesh->GetVertices(),
-                                           // Number of vertices
-                                           static_cast<int>(mesh->GetNumVertices()),
-                                           // Stride
-                                           sizeof(float3),
-                                           // TODO: make API signature const
-                                           reinterpret_cast<int const*>(mesh->GetIndices()),
-                                           // Index stride
-                                           0,
-                                           // All triangles
-                                           nullptr,
-                                           // Number of primitives
-                                           static_cast<int>(mesh->GetNumIndices() / 3)
-                                           );
 
-            auto transform = mesh->GetTransform();
-            shape->SetTransform(transform, inverse(transform));
-            shape->SetId(id++);
-            out.isect_shapes.push_back(shape);
-            rr_shapes[mesh] = shape;
+            if (i < num_visible_meshes)
+            {
+                out.visible_shapes.push_back(shape);
+            }
         }
 
-        // Handle instances
-        for (auto& iter: instances)
+        // Handle instances, base meshes are looked up in the registry
+        for (auto const& instance : registry.instances)
         {
-            auto instance = iter;
-            auto rr_mesh = rr_shapes[instance->GetBaseShape()];
+            auto rr_mesh = out.isect_shapes[registry.GetIndex(*instance->GetBaseShape())];
             auto shape = m_api->CreateInstance(rr_mesh);
 
             auto transform = instance->GetTransform();
@@ -288,39 +269,22 @@ namespace Baikal
             throw std::runtime_error("No shapes in the scene");
         }
 
-        // Split all shapes into meshes and instances sets.
-        std::set<Mesh::Ptr> meshes;
-        // Excluded shapes are shapes which are not in the scene,
-        // but references by at least one instance.
-        std::set<Mesh::Ptr> excluded_meshes;
-        std::set<Instance::Ptr> instances;
-        SplitMeshesAndInstances(*shape_iter, meshes, instances, excluded_meshes);
+        UpdateShapeRegistry(scene, out);
+        auto const& registry = out.shape_registry;
 
         auto rr_iter = out.isect_shapes.begin();
 
-        // Start from ID 1
-        // Handle meshes
-        for (auto& iter : meshes)
-        {
-            auto mesh = iter;
-            auto transform = mesh->GetTransform();
-            (*rr_iter)->SetTransform(transform, inverse(transform));
-            ++rr_iter;
-        }
-
-        // Handle excluded meshes
-        for (auto& iter : excluded_meshes)
+        // Meshes (excluded ones as well) go first
+        for (auto const& mesh : registry.meshes)
         {
-            auto mesh = iter;
             auto transform = mesh->GetTransform();
             (*rr_iter)->SetTransform(transform, inverse(transform));
             ++rr_iter;
         }
 
         // Handle instances
-        for (auto& iter : instances)
+        for (auto const& instance : registry.instances)
         {
-            auto instance = iter;
             auto transform = instance->GetTransform();
             (*rr_iter)->SetTransform(transform, inverse(transform));
             ++rr_iter;
@@ -348,6 +312,7 @@ namespace Baikal
 
         // Map GPU camera buffer
         m_context.MapBuffer(0, out.camera, CL_MAP_WRITE, &data).Wait();
+        RecordUpload(sizeof(ClwScene::Camera));
 
         // Copy camera parameters
         data->forward = camera->GetForwardVector();
@@ -374,192 +339,433 @@ namespace Baikal
         out.camera_volume_index = GetVolumeIndex(vol_collector, camera->GetVolume());
     }
 
-    void ClwSceneController::UpdateShapes(Scene1 const& scene, Collector& mat_collector, Collector& tex_collector, Collector& vol_collector, ClwScene& out) const
+    static std::size_t GrowCapacity(std::size_t capacity, std::size_t required)
     {
-        std::size_t num_vertices = 0;
-        std::size_t num_normals = 0;
-        std::size_t num_uvs = 0;
-        std::size_t num_indices = 0;
-
-        std::size_t num_vertices_written = 0;
-        std::size_t num_normals_written = 0;
-        std::size_t num_uvs_written = 0;
-        std::size_t num_indices_written = 0;
-        std::size_t num_shapes_written = 0;
+        // Grow geometrically to amortize reallocations
+        return required > capacity ? std::max(required, 2 * capacity) : capacity;
+    }
 
-        auto shape_iter = scene.CreateShapeIterator();
+    // Compact geometry: 16-bit indices are used for meshes with less than 65536 vertices
+    static bool UseShortIndices(std::size_t num_vertices)
+    {
+#ifdef BAIKAL_COMPACT_GEOMETRY
+        return num_vertices <= 0x10000;
+#else
+        (void)num_vertices;
+        return false;
+#endif
+    }
+
+    // Number of index buffer elements occupied by mesh indices
+    static std::size_t GetIndexBufferSize(std::size_t num_indices, bool short_indices)
+    {
+#ifdef BAIKAL_COMPACT_GEOMETRY
+        // 32-bit indices take two elements
+        return short_indices ? num_indices : 2 * num_indices;
+#else
+        (void)short_indices;
+        return num_indices;
+#endif
+    }
 
-        // Sort shapes into meshes and instances sets.
-        std::set<Mesh::Ptr> meshes;
-        // Excluded meshes are meshes which are not in the scene,
-        // but are references by at least one instance.
-        std::set<Mesh::Ptr> excluded_meshes;
-        std::set<Instance::Ptr> instances;
-        SplitMeshesAndInstances(*shape_iter, meshes, instances, excluded_meshes);
+#ifdef BAIKAL_COMPACT_GEOMETRY
+    // Octahedral encoding of unit vector into 2 x snorm16, see DecodeOctahedralNormal in scene.cl
+    static std::uint32_t EncodeOctahedralNormal(float3 const& n)
+    {
+        auto l1 = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
 
-        // Calculate GPU array sizes. Do that only for meshes,
-        // since instances do not occupy space in vertex buffers.
-        // However instances still have their own material ids.
-        for (auto& iter : meshes)
+        if (l1 == 0.f)
         {
-            auto mesh = iter;
+            return 0;
+        }
+
+        auto x = n.x / l1;
+        auto y = n.y / l1;
 
-            num_vertices += mesh->GetNumVertices();
-            num_normals += mesh->GetNumNormals();
-            num_uvs += mesh->GetNumUVs();
-            num_indices += mesh->GetNumIndices();
+        // Fold lower hemisphere over the diagonals
+        if (n.z < 0.f)
+        {
+            auto fx = (1.f - std::abs(y)) * (x >= 0.f ? 1.f : -1.f);
+            auto fy = (1.f - std::abs(x)) * (y >= 0.f ? 1.f : -1.f);
+            x = fx;
+            y = fy;
         }
 
-        // Excluded meshes still occupy space in vertex buffers.
-        for (auto& iter : excluded_meshes)
+        auto qx = static_cast<std::int16_t>(std::round(std::min(std::max(x, -1.f), 1.f) * 32767.f));
+        auto qy = static_cast<std::int16_t>(std::round(std::min(std::max(y, -1.f), 1.f) * 32767.f));
+        return static_cast<std::uint16_t>(qx) | (static_cast<std::uint32_t>(static_cast<std::uint16_t>(qy)) << 16);
+    }
+
+    // Mesh geometry converted into compact layout for upload
+    struct CompactMeshData
+    {
+        std::vector<ClwGeometryPosition> positions;
+        std::vector<ClwGeometryNormal> normals;
+        std::vector<ClwGeometryUV> uvs;
+        std::vector<ClwGeometryIndex> indices;
+    };
+
+    static void EncodeCompactGeometry(Mesh const& mesh, std::size_t num_normals, std::size_t num_uvs, bool short_indices, CompactMeshData& out)
+    {
+        auto vertices = mesh.GetVertices();
+        out.positions.resize(mesh.GetNumVertices());
+        for (std::size_t i = 0; i < out.positions.size(); ++i)
         {
-            auto mesh = iter;
+            out.positions[i] = { vertices[i].x, vertices[i].y, vertices[i].z };
+        }
 
-            num_vertices += mesh->GetNumVertices();
-            num_normals += mesh->GetNumNormals();
-            num_uvs += mesh->GetNumUVs();
-            num_indices += mesh->GetNumIndices();
+        auto normals = mesh.GetNormals();
+        out.normals.resize(num_normals);
+        for (std::size_t i = 0; i < num_normals; ++i)
+        {
+            out.normals[i] = EncodeOctahedralNormal(normals[i]);
         }
 
-        // Instances only occupy material IDs space.
-        for (auto& iter : instances)
+        auto uvs = mesh.GetUVs();
+        out.uvs.resize(num_uvs);
+        for (std::size_t i = 0; i < num_uvs; ++i)
         {
-            auto instance = iter;
-            auto mesh = std::static_pointer_cast<Mesh>(instance->GetBaseShape());
+            out.uvs[i] = static_cast<std::uint32_t>(half(uvs[i].x).bits()) |
+                         (static_cast<std::uint32_t>(half(uvs[i].y).bits()) << 16);
         }
 
-        LogInfo("Creating vertex buffer...\n");
-        // Create CL arrays
-        out.vertices = m_context.CreateBuffer<float3>(num_vertices, CL_MEM_READ_ONLY);
+        auto indices = mesh.GetIndices();
+        auto num_indices = mesh.GetNumIndices();
+        out.indices.resize(GetIndexBufferSize(num_indices, short_indices));
+        for (std::size_t i = 0; i < num_indices; ++i)
+        {
+            if (short_indices)
+            {
+                out.indices[i] = static_cast<ClwGeometryIndex>(indices[i]);
+            }
+            else
+            {
+                // Low half goes first
+                out.indices[2 * i] = static_cast<ClwGeometryIndex>(indices[i] & 0xffff);
+                out.indices[2 * i + 1] = static_cast<ClwGeometryIndex>(indices[i] >> 16);
+            }
+        }
+    }
+#endif
 
-        LogInfo("Creating normal buffer...\n");
-        out.normals = m_context.CreateBuffer<float3>(num_normals, CL_MEM_READ_ONLY);
+    void ClwSceneController::ReallocateGeometry(std::size_t vtx_capacity, std::size_t idx_capacity, bool compact, ClwScene& out) const
+    {
+        auto vertices = m_context.CreateBuffer<ClwGeometryPosition>(std::max<std::size_t>(vtx_capacity, 1), CL_MEM_READ_ONLY);
+        auto normals = m_context.CreateBuffer<ClwGeometryNormal>(std::max<std::size_t>(vtx_capacity, 1), CL_MEM_READ_ONLY);
+        auto uvs = m_context.CreateBuffer<ClwGeometryUV>(std::max<std::size_t>(vtx_capacity, 1), CL_MEM_READ_ONLY);
+        auto indices = m_context.CreateBuffer<ClwGeometryIndex>(std::max<std::size_t>(idx_capacity, 1), CL_MEM_READ_ONLY);
 
-        LogInfo("Creating UV buffer...\n");
-        out.uvs = m_context.CreateBuffer<float2>(num_uvs, CL_MEM_READ_ONLY);
+        if (compact)
+        {
+            // Move live ranges one by one to the beginning of new buffers.
+            // Copies are device side, so nothing is uploaded here.
+            std::size_t num_vertices = 0;
+            std::size_t num_indices = 0;
 
-        LogInfo("Creating index buffer...\n");
-        out.indices = m_context.CreateBuffer<int>(num_indices, CL_MEM_READ_ONLY);
+            for (auto& iter : out.mesh_ranges)
+            {
+                auto& range = iter.second;
 
-        // Total number of entries in shapes GPU array
-        auto num_shapes = meshes.size() + excluded_meshes.size() + instances.size();
-        out.shapes = m_context.CreateBuffer<ClwScene::Shape>(num_shapes, CL_MEM_READ_ONLY);
-        out.shapes_additional = m_context.CreateBuffer<ClwScene::ShapeAdditionalData>(num_shapes, CL_MEM_READ_ONLY);
-
-        float3* vertices = nullptr;
-        float3* normals = nullptr;
-        float2* uvs = nullptr;
-        int* indices = nullptr;
-        ClwScene::Shape* shapes = nullptr;
-        ClwScene::ShapeAdditionalData* shapes_additional = nullptr;
+                if (range.vtx_capacity > 0)
+                {
+                    m_context.CopyBuffer(0, out.vertices, vertices, range.startvtx, num_vertices, range.vtx_capacity);
+                    m_context.CopyBuffer(0, out.normals, normals, range.startvtx, num_vertices, range.vtx_capacity);
+                    m_context.CopyBuffer(0, out.uvs, uvs, range.startvtx, num_vertices, range.vtx_capacity);
+                }
 
-        // Map arrays and prepare to write data
-        LogInfo("Mapping buffers...\n");
-        m_context.MapBuffer(0, out.vertices, CL_MAP_WRITE, &vertices);
-        m_context.MapBuffer(0, out.normals, CL_MAP_WRITE, &normals);
-        m_context.MapBuffer(0, out.uvs, CL_MAP_WRITE, &uvs);
-        m_context.MapBuffer(0, out.indices, CL_MAP_WRITE, &indices);
-        m_context.MapBuffer(0, out.shapes, CL_MAP_WRITE, &shapes).Wait();
-        m_context.MapBuffer(0, out.shapes_additional, CL_MAP_WRITE, &shapes_additional).Wait();
+                if (range.idx_capacity > 0)
+                {
+                    m_context.CopyBuffer(0, out.indices, indices, range.startidx, num_indices, range.idx_capacity);
+                }
 
-        // Keep associated shapes data for instance look up.
-        // We retrieve data from here while serializing instances,
-        // using base shape lookup.
-        std::map<Mesh::Ptr, ClwScene::Shape> shape_data;
+                range.startvtx = num_vertices;
+                range.startidx = num_indices;
+                num_vertices += range.vtx_capacity;
+                num_indices += range.idx_capacity;
+            }
 
-        // Handle meshes
-        //int shape_id = 0;
-        for (auto& iter : meshes)
+            out.num_vertices_allocated = num_vertices;
+            out.num_indices_allocated = num_indices;
+            out.num_vertices_wasted = 0;
+            out.num_indices_wasted = 0;
+        }
+        else
         {
-            auto mesh = iter;
+            // Keep the layout and copy allocated part of old buffers
+            auto num_vertices = std::min(out.num_vertices_allocated, out.vertices.GetElementCount());
+            auto num_indices = std::min(out.num_indices_allocated, out.indices.GetElementCount());
 
-            // Get pointers data
-            auto mesh_vertex_array = mesh->GetVertices();
-            auto mesh_num_vertices = mesh->GetNumVertices();
+            if (num_vertices > 0)
+            {
+                m_context.CopyBuffer(0, out.vertices, vertices, 0, 0, num_vertices);
+                m_context.CopyBuffer(0, out.normals, normals, 0, 0, num_vertices);
+                m_context.CopyBuffer(0, out.uvs, uvs, 0, 0, num_vertices);
+            }
 
-            auto mesh_normal_array = mesh->GetNormals();
-            auto mesh_num_normals = mesh->GetNumNormals();
+            if (num_indices > 0)
+            {
+                m_context.CopyBuffer(0, out.indices, indices, 0, 0, num_indices);
+            }
+        }
 
-            auto mesh_uv_array = mesh->GetUVs();
-            auto mesh_num_uvs = mesh->GetNumUVs();
+        // Old buffers might be released only after copies are done
+        m_context.Finish(0);
 
-            auto mesh_index_array = mesh->GetIndices();
-            auto mesh_num_indices = mesh->GetNumIndices();
+        out.vertices = vertices;
+        out.normals = normals;
+        out.uvs = uvs;
+        out.indices = indices;
+    }
 
-            // Prepare shape descriptor
-            ClwScene::Shape shape;
+    bool ClwSceneController::UpdateGeometry(std::vector<Mesh::Ptr> const& meshes, ClwScene& out) const
+    {
+        out.geometry_bytes_uploaded = 0;
 
-            shape.id = iter->GetId();
+        // Meshes which need their data to be uploaded
+        std::vector<Mesh::Ptr> dirty_meshes;
+        // Meshes which need a new range in the arena
+        std::vector<Mesh::Ptr> new_meshes;
+        std::size_t num_new_vertices = 0;
+        std::size_t num_new_indices = 0;
 
-            shape.startvtx = static_cast<int>(num_vertices_written);
-            shape.startidx = static_cast<int>(num_indices_written);
+        std::unordered_map<std::uint32_t, ClwMeshRange> live_ranges;
+        live_ranges.reserve(meshes.size());
 
-            auto transform = mesh->GetTransform();
-            shape.transform.m0 = { transform.m00, transform.m01, transform.m02, transform.m03 };
-            shape.transform.m1 = { transform.m10, transform.m11, transform.m12, transform.m13 };
-            shape.transform.m2 = { transform.m20, transform.m21, transform.m22, transform.m23 };
-            shape.transform.m3 = { transform.m30, transform.m31, transform.m32, transform.m33 };
+        for (auto& mesh : meshes)
+        {
+            auto iter = out.mesh_ranges.find(mesh->GetId());
 
-            shape.linearvelocity = float3(0.0f, 0.f, 0.f);
-            shape.angularvelocity = float3(0.f, 0.f, 0.f, 1.f);
-            shape.material.offset = GetMaterialIndex(mat_collector, mesh->GetMaterial());
-            shape.material.layers = GetMaterialLayers(mesh->GetMaterial());
+            // Mesh might have been processed already if it is referenced twice
+            if (live_ranges.find(mesh->GetId()) != live_ranges.cend())
+            {
+                continue;
+            }
 
-            shape.volume_idx = GetVolumeIndex(vol_collector, mesh->GetVolumeMaterial());
+            if (iter != out.mesh_ranges.cend() &&
+                mesh->GetNumVertices() <= iter->second.vtx_capacity &&
+                GetIndexBufferSize(mesh->GetNumIndices(), iter->second.short_indices) <= iter->second.idx_capacity)
+            {
+                // Mesh still fits into its range, upload only if it has been changed
+                if (iter->second.revision != mesh->GetGeometryRevision())
+                {
+                    dirty_meshes.push_back(mesh);
+                }
+
+                live_ranges.emplace(*iter);
+                out.mesh_ranges.erase(iter);
+            }
+            else
+            {
+                new_meshes.push_back(mesh);
+                dirty_meshes.push_back(mesh);
+                num_new_vertices += mesh->GetNumVertices();
+                num_new_indices += GetIndexBufferSize(mesh->GetNumIndices(), UseShortIndices(mesh->GetNumVertices()));
 
-            shape_data[mesh] = shape;
+                // Drop a placeholder to avoid processing the same mesh twice
+                live_ranges.emplace(mesh->GetId(), ClwMeshRange());
+            }
+        }
 
-            std::copy(mesh_vertex_array, mesh_vertex_array + mesh_num_vertices, vertices + num_vertices_written);
-            num_vertices_written += mesh_num_vertices;
+        // Everything left in the old map is either removed or moved, so it becomes a hole
+        for (auto& iter : out.mesh_ranges)
+        {
+            out.num_vertices_wasted += iter.second.vtx_capacity;
+            out.num_indices_wasted += iter.second.idx_capacity;
+        }
 
-            std::copy(mesh_normal_array, mesh_normal_array + mesh_num_normals, normals + num_normals_written);
-            num_normals_written += mesh_num_normals;
+        // Placeholders for new meshes are allocated below
+        for (auto& mesh : new_meshes)
+        {
+            live_ranges.erase(mesh->GetId());
+        }
 
-            std::copy(mesh_uv_array, mesh_uv_array + mesh_num_uvs, uvs + num_uvs_written);
-            num_uvs_written += mesh_num_uvs;
+        out.mesh_ranges = std::move(live_ranges);
 
-            std::copy(mesh_index_array, mesh_index_array + mesh_num_indices, indices + num_indices_written);
-            num_indices_written += mesh_num_indices;
+        auto num_live_vertices = out.num_vertices_allocated - out.num_vertices_wasted;
+        auto num_live_indices = out.num_indices_allocated - out.num_indices_wasted;
 
-            shapes[num_shapes_written] = shape;
+        // Compact the arena if holes occupy more space than live meshes,
+        // otherwise just make sure new meshes fit at the end.
+        bool compact = out.num_vertices_wasted > num_live_vertices ||
+                       out.num_indices_wasted > num_live_indices;
 
-            ClwScene::ShapeAdditionalData shape_additional;
-            shape_additional.group_id = mesh->GetGroupId();
-            shapes_additional[num_shapes_written++] = shape_additional;
+        auto vtx_capacity = out.vertices.GetElementCount();
+        auto idx_capacity = out.indices.GetElementCount();
+
+        if (compact)
+        {
+            LogInfo("Compacting geometry buffers...\n");
+            ReallocateGeometry(GrowCapacity(vtx_capacity, num_live_vertices + num_new_vertices),
+                               GrowCapacity(idx_capacity, num_live_indices + num_new_indices),
+                               true, out);
+        }
+        else if (out.num_vertices_allocated + num_new_vertices > vtx_capacity ||
+                 out.num_indices_allocated + num_new_indices > idx_capacity)
+        {
+            LogInfo("Growing geometry buffers...\n");
+            ReallocateGeometry(GrowCapacity(vtx_capacity, out.num_vertices_allocated + num_new_vertices),
+                               GrowCapacity(idx_capacity, out.num_indices_allocated + num_new_indices),
+                               false, out);
+        }
+
+        // Append new meshes to the end of the arena
+        for (auto& mesh : new_meshes)
+        {
+            ClwMeshRange range;
+            range.startvtx = out.num_vertices_allocated;
+            range.vtx_capacity = mesh->GetNumVertices();
+            range.startidx = out.num_indices_allocated;
+            // Index format is fixed for the range as mesh vertices never exceed its capacity
+            range.short_indices = UseShortIndices(range.vtx_capacity);
+            range.idx_capacity = GetIndexBufferSize(mesh->GetNumIndices(), range.short_indices);
+            range.revision = mesh->GetGeometryRevision();
+
+            out.num_vertices_allocated += range.vtx_capacity;
+            out.num_indices_allocated += range.idx_capacity;
+
+            out.mesh_ranges[mesh->GetId()] = range;
+        }
+
+#ifdef BAIKAL_COMPACT_GEOMETRY
+        // Encoded data has to live until writes are done
+        std::vector<CompactMeshData> compact_data(dirty_meshes.size());
+        auto compact_iter = compact_data.begin();
+#endif
+
+        // Upload dirty ranges only
+        for (auto& mesh : dirty_meshes)
+        {
+            auto& range = out.mesh_ranges[mesh->GetId()];
+
+            auto num_vertices = mesh->GetNumVertices();
+            auto num_normals = std::min(mesh->GetNumNormals(), range.vtx_capacity);
+            auto num_uvs = std::min(mesh->GetNumUVs(), range.vtx_capacity);
+            auto num_indices = GetIndexBufferSize(mesh->GetNumIndices(), range.short_indices);
+
+#ifdef BAIKAL_COMPACT_GEOMETRY
+            auto& data = *compact_iter++;
+            EncodeCompactGeometry(*mesh, num_normals, num_uvs, range.short_indices, data);
+            auto vertices = data.positions.data();
+            auto normals = data.normals.data();
+            auto uvs = data.uvs.data();
+            auto indices = data.indices.data();
+#else
+            auto vertices = mesh->GetVertices();
+            auto normals = mesh->GetNormals();
+            auto uvs = mesh->GetUVs();
+            auto indices = reinterpret_cast<int const*>(mesh->GetIndices());
+#endif
+
+            if (num_vertices > 0)
+            {
+                m_context.WriteBuffer(0, out.vertices, vertices, range.startvtx, num_vertices);
+            }
+
+            if (num_normals > 0)
+            {
+                m_context.WriteBuffer(0, out.normals, normals, range.startvtx, num_normals);
+            }
+
+            if (num_uvs > 0)
+            {
+                m_context.WriteBuffer(0, out.uvs, uvs, range.startvtx, num_uvs);
+            }
+
+            if (num_indices > 0)
+            {
+                m_context.WriteBuffer(0, out.indices, indices, range.startidx, num_indices);
+            }
+
+            range.revision = mesh->GetGeometryRevision();
+
+            out.geometry_bytes_uploaded += num_vertices * sizeof(ClwGeometryPosition) +
+                                           num_normals * sizeof(ClwGeometryNormal) +
+                                           num_uvs * sizeof(ClwGeometryUV) +
+                                           num_indices * sizeof(ClwGeometryIndex);
         }
 
-        // Excluded shapes are handled in almost the same way
-        // except materials.
-        for (auto& iter : excluded_meshes)
+        // Host data must stay valid until writes are done
+        m_context.Finish(0);
+
+        RecordUpload(out.geometry_bytes_uploaded);
+
+        return !dirty_meshes.empty();
+    }
+
+    // Write shape transform into GPU shape descriptor
+    static void WriteShapeTransform(RadeonRays::matrix const& transform, ClwScene::Shape& shape)
+    {
+        shape.transform.m0 = { transform.m00, transform.m01, transform.m02, transform.m03 };
+        shape.transform.m1 = { transform.m10, transform.m11, transform.m12, transform.m13 };
+        shape.transform.m2 = { transform.m20, transform.m21, transform.m22, transform.m23 };
+        shape.transform.m3 = { transform.m30, transform.m31, transform.m32, transform.m33 };
+    }
+
+    // Collect distinct material layer masks of shapes, used to specialize shading kernels
+    static void CollectMaterialLayers(ClwScene::Shape const* shapes, std::size_t num_shapes, std::vector<std::uint32_t>& layers)
+    {
+        layers.clear();
+
+        for (auto i = 0u; i < num_shapes; ++i)
         {
-            auto mesh = iter;
+            layers.push_back(static_cast<std::uint32_t>(shapes[i].material.layers));
+        }
+
+        std::sort(layers.begin(), layers.end());
+        layers.erase(std::unique(layers.begin(), layers.end()), layers.end());
+    }
+
+    void ClwSceneController::UpdateShapes(Scene1 const& scene, Collector& mat_collector, Collector& tex_collector, Collector& vol_collector, ClwScene& out) const
+    {
+        std::size_t num_shapes_written = 0;
+
+        // Shape list has changed, so the registry is rebuilt here
+        UpdateShapeRegistry(scene, out);
+        auto const& registry = out.shape_registry;
+
+        // Only meshes occupy space in vertex buffers (excluded ones as well),
+        // instances reference ranges of their base meshes.
+        auto const& geometry = registry.meshes;
+
+        LogInfo("Updating geometry buffers...\n");
+        UpdateGeometry(geometry, out);
+
+        // Total number of entries in shapes GPU array
+        auto num_shapes = registry.GetNumShapes();
+        out.shape_registry.shapes_generation = registry.generation;
 
-            // Get pointers data
-            auto mesh_vertex_array = mesh->GetVertices();
-            auto mesh_num_vertices = mesh->GetNumVertices();
+        if (num_shapes > out.shapes.GetElementCount())
+        {
+            out.shapes = m_context.CreateBuffer<ClwScene::Shape>(num_shapes, CL_MEM_READ_ONLY);
+            out.shapes_additional = m_context.CreateBuffer<ClwScene::ShapeAdditionalData>(num_shapes, CL_MEM_READ_ONLY);
+        }
 
-            auto mesh_normal_array = mesh->GetNormals();
-            auto mesh_num_normals = mesh->GetNumNormals();
+        ClwScene::Shape* shapes = nullptr;
+        ClwScene::ShapeAdditionalData* shapes_additional = nullptr;
 
-            auto mesh_uv_array = mesh->GetUVs();
-            auto mesh_num_uvs = mesh->GetNumUVs();
+        // Map arrays and prepare to write data
+        LogInfo("Mapping buffers...\n");
+        m_context.MapBuffer(0, out.shapes, CL_MAP_WRITE, &shapes).Wait();
+        m_context.MapBuffer(0, out.shapes_additional, CL_MAP_WRITE, &shapes_additional).Wait();
+        RecordUpload(out.shapes.GetElementCount() * sizeof(ClwScene::Shape) +
+            out.shapes_additional.GetElementCount() * sizeof(ClwScene::ShapeAdditionalData));
 
-            auto mesh_index_array = mesh->GetIndices();
-            auto mesh_num_indices = mesh->GetNumIndices();
+        // Meshes and excluded meshes are handled in the same way,
+        // geometry ranges are taken from the arena.
+        for (auto& mesh : geometry)
+        {
+            auto const& range = out.mesh_ranges[mesh->GetId()];
 
             // Prepare shape descriptor
             ClwScene::Shape shape;
 
             shape.id = mesh->GetId();
 
-            shape.startvtx = static_cast<int>(num_vertices_written);
-            shape.startidx = static_cast<int>(num_indices_written);
+            shape.startvtx = static_cast<int>(range.startvtx);
+            shape.startidx = static_cast<int>(range.startidx);
+            shape.short_indices = range.short_indices ? 1 : 0;
 
-            auto transform = mesh->GetTransform();
-            shape.transform.m0 = { transform.m00, transform.m01, transform.m02, transform.m03 };
-            shape.transform.m1 = { transform.m10, transform.m11, transform.m12, transform.m13 };
-            shape.transform.m2 = { transform.m20, transform.m21, transform.m22, transform.m23 };
-            shape.transform.m3 = { transform.m30, transform.m31, transform.m32, transform.m33 };
+            WriteShapeTransform(mesh->GetTransform(), shape);
 
             shape.linearvelocity = float3(0.0f, 0.f, 0.f);
             shape.angularvelocity = float3(0.f, 0.f, 0.f, 1.f);
@@ -568,20 +774,6 @@ namespace Baikal
 
             shape.volume_idx = GetVolumeIndex(vol_collector, mesh->GetVolumeMaterial());
 
-            shape_data[mesh] = shape;
-
-            std::copy(mesh_vertex_array, mesh_vertex_array + mesh_num_vertices, vertices + num_vertices_written);
-            num_vertices_written += mesh_num_vertices;
-
-            std::copy(mesh_normal_array, mesh_normal_array + mesh_num_normals, normals + num_normals_written);
-            num_normals_written += mesh_num_normals;
-
-            std::copy(mesh_uv_array, mesh_uv_array + mesh_num_uvs, uvs + num_uvs_written);
-            num_uvs_written += mesh_num_uvs;
-
-            std::copy(mesh_index_array, mesh_index_array + mesh_num_indices, indices + num_indices_written);
-            num_indices_written += mesh_num_indices;
-
             shapes[num_shapes_written] = shape;
 
             ClwScene::ShapeAdditionalData shape_additional;
@@ -590,44 +782,40 @@ namespace Baikal
         }
 
         // Handle instances
-        for (auto& iter : instances)
+        for (auto const& instance : registry.instances)
         {
-            auto instance = iter;
             auto base_shape = std::static_pointer_cast<Mesh>(instance->GetBaseShape());
-            auto transform = instance->GetTransform();
+            auto const& range = out.mesh_ranges[base_shape->GetId()];
 
-            // Here shape_data is guaranteed to contain
-            // info for base_shape since we have serialized it
-            // above in a different pass.
-            ClwScene::Shape shape = shape_data[base_shape];
+            ClwScene::Shape shape;
+
+            shape.id = instance->GetId();
 
-            shape.id = iter->GetId();
+            // Instance shares geometry with its base shape.
+            shape.startvtx = static_cast<int>(range.startvtx);
+            shape.startidx = static_cast<int>(range.startidx);
+            shape.short_indices = range.short_indices ? 1 : 0;
 
             // Instance has its own transform.
-            shape.transform.m0 = { transform.m00, transform.m01, transform.m02, transform.m03 };
-            shape.transform.m1 = { transform.m10, transform.m11, transform.m12, transform.m13 };
-            shape.transform.m2 = { transform.m20, transform.m21, transform.m22, transform.m23 };
-            shape.transform.m3 = { transform.m30, transform.m31, transform.m32, transform.m33 };
+            WriteShapeTransform(instance->GetTransform(), shape);
 
             shape.linearvelocity = float3(0.0f, 0.f, 0.f);
             shape.angularvelocity = float3(0.f, 0.f, 0.f, 1.f);
             shape.material.offset = GetMaterialIndex(mat_collector, instance->GetMaterial());
-            shape.material.layers = std::static_pointer_cast<UberV2Material>(instance->GetMaterial())->GetLayers();
+            shape.material.layers = GetMaterialLayers(instance->GetMaterial());
 
             shape.volume_idx = GetVolumeIndex(vol_collector, instance->GetVolumeMaterial());
 
             shapes[num_shapes_written] = shape;
 
             ClwScene::ShapeAdditionalData shape_additional;
-            shape_additional.group_id = iter->GetGroupId();
+            shape_additional.group_id = instance->GetGroupId();
             shapes_additional[num_shapes_written++] = shape_additional;
         }
 
+        CollectMaterialLayers(shapes, num_shapes_written, out.material_layers);
+
         LogInfo("Unmapping buffers...\n");
-        m_context.UnmapBuffer(0, out.vertices, vertices);
-        m_context.UnmapBuffer(0, out.normals, normals);
-        m_context.UnmapBuffer(0, out.uvs, uvs);
-        m_context.UnmapBuffer(0, out.indices, indices);
         m_context.UnmapBuffer(0, out.shapes, shapes).Wait();
         m_context.UnmapBuffer(0, out.shapes_additional, shapes_additional).Wait();
 
@@ -640,15 +828,22 @@ namespace Baikal
 
     void ClwSceneController::UpdateShapeProperties(Scene1 const& scene, Collector& mat_collector, Collector& tex_collector, Collector& volume_collector, ClwScene& out) const
     {
-        auto shape_iter = scene.CreateShapeIterator();
+        // Registry changes without shape list change only if instances have got new base shapes,
+        // shape buffer layout changes then, so all the shapes are rewritten.
+        UpdateShapeRegistry(scene, out);
+
+        if (out.shape_registry.generation != out.shape_registry.shapes_generation)
+        {
+            UpdateShapes(scene, mat_collector, tex_collector, volume_collector, out);
+            return;
+        }
 
-        // Sort shapes into meshes and instances sets.
-        std::set<Mesh::Ptr> meshes;
-        // Excluded meshes are meshes which are not in the scene,
-        // but are references by at least one instance.
-        std::set<Mesh::Ptr> excluded_meshes;
-        std::set<Instance::Ptr> instances;
-        SplitMeshesAndInstances(*shape_iter, meshes, instances, excluded_meshes);
+        auto const& registry = out.shape_registry;
+        auto const& geometry = registry.meshes;
+
+        // Shapes might have their geometry changed, upload changed meshes only.
+        // Meshes which have outgrown their ranges are moved, so ranges are rewritten below.
+        auto geometry_changed = UpdateGeometry(geometry, out);
 
         ClwScene::Shape* shapes = nullptr;
         ClwScene::ShapeAdditionalData* shapes_additional = nullptr;
@@ -656,78 +851,74 @@ namespace Baikal
         // Map arrays and prepare to write data
         m_context.MapBuffer(0, out.shapes, CL_MAP_READ | CL_MAP_WRITE, &shapes).Wait();
         m_context.MapBuffer(0, out.shapes_additional, CL_MAP_READ | CL_MAP_WRITE, &shapes_additional).Wait();
+        RecordUpload(out.shapes.GetElementCount() * sizeof(ClwScene::Shape) +
+            out.shapes_additional.GetElementCount() * sizeof(ClwScene::ShapeAdditionalData));
 
         auto current_shape = shapes;
         auto current_shape_additional = shapes_additional;
-        for (auto& iter : meshes)
-        {
-            auto mesh = iter;
-
-            auto transform = mesh->GetTransform();
-            current_shape->transform.m0 = { transform.m00, transform.m01, transform.m02, transform.m03 };
-            current_shape->transform.m1 = { transform.m10, transform.m11, transform.m12, transform.m13 };
-            current_shape->transform.m2 = { transform.m20, transform.m21, transform.m22, transform.m23 };
-            current_shape->transform.m3 = { transform.m30, transform.m31, transform.m32, transform.m33 };
-            current_shape->material.offset = GetMaterialIndex(mat_collector, mesh->GetMaterial());
-            current_shape->material.layers = GetMaterialLayers(mesh->GetMaterial());
-
-            current_shape->volume_idx = GetVolumeIndex(volume_collector, mesh->GetVolumeMaterial());
 
-            current_shape->id = iter->GetId();
-            current_shape_additional->group_id = iter->GetGroupId();
-
-            ++current_shape;
-            ++current_shape_additional;
-        }
-
-        // Excluded shapes are handled in almost the same way
-        // except materials.
-        for (auto& iter : excluded_meshes)
+        // Meshes and excluded meshes are handled in the same way
+        for (auto& mesh : geometry)
         {
-            auto mesh = iter;
+            auto const& range = out.mesh_ranges[mesh->GetId()];
 
-            auto transform = mesh->GetTransform();
-            current_shape->transform.m0 = { transform.m00, transform.m01, transform.m02, transform.m03 };
-            current_shape->transform.m1 = { transform.m10, transform.m11, transform.m12, transform.m13 };
-            current_shape->transform.m2 = { transform.m20, transform.m21, transform.m22, transform.m23 };
-            current_shape->transform.m3 = { transform.m30, transform.m31, transform.m32, transform.m33 };
+            current_shape->startvtx = static_cast<int>(range.startvtx);
+            current_shape->startidx = static_cast<int>(range.startidx);
+            current_shape->short_indices = range.short_indices ? 1 : 0;
+
+            WriteShapeTransform(mesh->GetTransform(), *current_shape);
             current_shape->material.offset = GetMaterialIndex(mat_collector, mesh->GetMaterial());
             current_shape->material.layers = GetMaterialLayers(mesh->GetMaterial());
 
             current_shape->volume_idx = GetVolumeIndex(volume_collector, mesh->GetVolumeMaterial());
 
-            current_shape->id = iter->GetId();
-            current_shape_additional->group_id = iter->GetGroupId();
+            current_shape->id = mesh->GetId();
+            current_shape_additional->group_id = mesh->GetGroupId();
 
             ++current_shape;
             ++current_shape_additional;
         }
 
         // Handle instances
-        for (auto& iter : instances)
+        for (auto const& instance : registry.instances)
         {
-            auto instance = iter;
             auto base_shape = std::static_pointer_cast<Mesh>(instance->GetBaseShape());
-            auto transform = instance->GetTransform();
+            auto const& range = out.mesh_ranges[base_shape->GetId()];
 
-            current_shape->transform.m0 = { transform.m00, transform.m01, transform.m02, transform.m03 };
-            current_shape->transform.m1 = { transform.m10, transform.m11, transform.m12, transform.m13 };
-            current_shape->transform.m2 = { transform.m20, transform.m21, transform.m22, transform.m23 };
-            current_shape->transform.m3 = { transform.m30, transform.m31, transform.m32, transform.m33 };
+            current_shape->startvtx = static_cast<int>(range.startvtx);
+            current_shape->startidx = static_cast<int>(range.startidx);
+            current_shape->short_indices = range.short_indices ? 1 : 0;
+
+            WriteShapeTransform(instance->GetTransform(), *current_shape);
             current_shape->material.offset = GetMaterialIndex(mat_collector, instance->GetMaterial());
-            current_shape->material.layers = GetMaterialLayers(std::static_pointer_cast<UberV2Material>(instance->GetMaterial()));
+            current_shape->material.layers = GetMaterialLayers(instance->GetMaterial());
 
             current_shape->volume_idx = GetVolumeIndex(volume_collector, instance->GetVolumeMaterial());
 
-            current_shape->id = iter->GetId();
-            current_shape_additional->group_id = iter->GetGroupId();
+            current_shape->id = instance->GetId();
+            current_shape_additional->group_id = instance->GetGroupId();
 
             ++current_shape;
             ++current_shape_additional;
         }
 
+        CollectMaterialLayers(shapes, current_shape - shapes, out.material_layers);
+
         m_context.UnmapBuffer(0, out.shapes, shapes).Wait();
         m_context.UnmapBuffer(0, out.shapes_additional, shapes_additional).Wait();
+
+        // Intersector keeps its own copy of geometry,
+        // so it has to be rebuilt if any mesh has been changed.
+        if (geometry_changed)
+        {
+            UpdateIntersector(scene, out);
+
+            ReloadIntersector(scene, out);
+        }
+        else
+        {
+            UpdateIntersectorTransforms(scene, out);
+        }
     }
 
     void ClwSceneController::UpdateCurrentScene(Scene1 const& scene, ClwScene& out) const
@@ -743,8 +934,10 @@ namespace Baikal
 
         // Cleanup material mapping
         m_materialid_to_offset.clear();
+        m_material_input_map_slots.clear();
 
         CLUberV2Generator uberv2_generator;
+        bool const use_interpreter = m_material_compilation_mode == MaterialCompilationMode::kInterpreter;
 
         // Serialize materials
         {
@@ -759,13 +952,24 @@ namespace Baikal
             {
                 WriteMaterial(*mat_iter->ItemAs<Material>(), mat_collector, tex_collector, mat_buffer);
 
-                uberv2_generator.AddMaterial(mat_iter->ItemAs<UberV2Material>());
+                if (!use_interpreter)
+                {
+                    uberv2_generator.AddMaterial(mat_iter->ItemAs<UberV2Material>());
+                }
             }
 
         }
 
-        std::string uberv2_source = uberv2_generator.BuildSource();
-        m_program_manager->AddHeader("uberv2_generated.cl", uberv2_source);
+        if (use_interpreter)
+        {
+            // Header content never changes, so programs are built only once
+            m_program_manager->AddHeader("uberv2_generated.cl", kInterpreterHeader);
+        }
+        else
+        {
+            std::string uberv2_source = uberv2_generator.BuildSource();
+            m_program_manager->AddHeader("uberv2_generated.cl", uberv2_source);
+        }
 
 
         // Recreate material buffer if it needs resize
@@ -775,21 +979,54 @@ namespace Baikal
             out.material_attributes = m_context.CreateBuffer<int32_t>(mat_buffer.size(), CL_MEM_READ_ONLY);
         }
 
+        if (use_interpreter)
+        {
+            // Input map ids are resolved into bytecode offsets on upload
+            m_material_data = std::move(mat_buffer);
+            UploadMaterialAttributes(out);
+            return;
+        }
+
         int32_t *materials = nullptr;
 
         // Map GPU materials buffer
         m_context.MapBuffer(0, out.material_attributes, CL_MAP_WRITE, &materials).Wait();
 
         memcpy(materials, mat_buffer.data(), mat_buffer.size() * sizeof(int32_t));
+        RecordUpload(mat_buffer.size() * sizeof(int32_t));
 
         // Unmap material buffer
         m_context.UnmapBuffer(0, out.material_attributes, materials);
     }
 
-    void ClwSceneController::UpdateVolumes(Scene1 const& scene, Collector& volume_collector, Collector& tex_collector, ClwScene& out) const
+    void ClwSceneController::RecordUpload(std::size_t num_bytes) const
     {
-        if (!volume_collector.GetNumItems())
-            return;
+        m_program_manager->GetProfiler().RecordUpload(num_bytes);
+    }
+
+    void ClwSceneController::UploadMaterialAttributes(ClwScene& out) const
+    {
+        if (m_material_data.empty())
+        {
+            return;
+        }
+
+        std::vector<std::int32_t> material_data(m_material_data);
+
+        for (auto slot : m_material_input_map_slots)
+        {
+            auto it = m_input_map_offsets.find(static_cast<std::uint32_t>(m_material_data[slot]));
+            material_data[slot] = (m_material_data[slot] >= 0 && it != m_input_map_offsets.end()) ? it->second : -1;
+        }
+
+        m_context.WriteBuffer(0, out.material_attributes, material_data.data(), material_data.size());
+        RecordUpload(material_data.size() * sizeof(std::int32_t));
+    }
+
+    void ClwSceneController::UpdateVolumes(Scene1 const& scene, Collector& volume_collector, Collector& tex_collector, ClwScene& out) const
+    {
+        if (!volume_collector.GetNumItems())
+            return;
 
         // Get new buffer size
         std::size_t vol_buffer_size = volume_collector.GetNumItems();
@@ -810,21 +1047,98 @@ namespace Baikal
         auto volume_iter = volume_collector.CreateIterator();
 
         out.volume_bundle.reset(volume_collector.CreateBundle());
+
+        // Density grids shared by several volumes are uploaded once
+        std::vector<ClwScene::VolumeGrid> grids;
+        std::vector<float> grid_data;
+        std::unordered_map<VolumeGrid const*, int> grid_indices;
+
         // Serialize
         size_t num_volumes_copied = 0;
         for (; volume_iter->IsValid(); volume_iter->Next())
         {
-            WriteVolume(*volume_iter->ItemAs<VolumeMaterial>(), tex_collector, volumes + num_volumes_copied);
+            auto volume = volume_iter->ItemAs<VolumeMaterial>();
+            auto clw_volume = volumes + num_volumes_copied;
+
+            WriteVolume(*volume, tex_collector, clw_volume);
+
+            if (auto grid = volume->GetDensityGrid())
+            {
+                auto iter = grid_indices.find(grid.get());
+
+                if (iter == grid_indices.cend())
+                {
+                    iter = grid_indices.emplace(grid.get(), static_cast<int>(grids.size())).first;
+                    grids.push_back(WriteVolumeGrid(*grid, grid_data));
+                }
+
+                clw_volume->type = ClwScene::VolumeType::kHeterogeneous;
+                clw_volume->data = iter->second;
+            }
+
             ++num_volumes_copied;
         }
 
         // Unmap serial buffer
         m_context.UnmapBuffer(0, out.volumes, volumes);
+        RecordUpload(num_volumes_copied * sizeof(ClwScene::Volume));
+
+        // Kernels take grid buffers even if all volumes are homogeneous
+        if (std::max<std::size_t>(grids.size(), 1) > out.volume_grids.GetElementCount())
+        {
+            out.volume_grids = m_context.CreateBuffer<ClwScene::VolumeGrid>(std::max<std::size_t>(grids.size(), 1), CL_MEM_READ_ONLY);
+        }
+
+        if (std::max<std::size_t>(grid_data.size(), 1) > out.volume_data.GetElementCount())
+        {
+            out.volume_data = m_context.CreateBuffer<float>(std::max<std::size_t>(grid_data.size(), 1), CL_MEM_READ_ONLY);
+        }
+
+        if (!grids.empty())
+        {
+            m_context.WriteBuffer(0, out.volume_grids, grids.data(), grids.size());
+            m_context.WriteBuffer(0, out.volume_data, grid_data.data(), grid_data.size()).Wait();
+            RecordUpload(grids.size() * sizeof(ClwScene::VolumeGrid) + grid_data.size() * sizeof(float));
+        }
 
         // Update number of volumes
         out.num_volumes = static_cast<int>(num_volumes_copied);
     }
 
+    ClwScene::VolumeGrid ClwSceneController::WriteVolumeGrid(VolumeGrid const& grid, std::vector<float>& data) const
+    {
+        ClwScene::VolumeGrid clw_grid = {};
+
+        auto resolution = grid.GetResolution();
+        auto brick_count = grid.GetBrickCount();
+
+        clw_grid.bbox_min = grid.GetBboxMin();
+        clw_grid.bbox_max = grid.GetBboxMax();
+        clw_grid.resolution[0] = resolution.x;
+        clw_grid.resolution[1] = resolution.y;
+        clw_grid.resolution[2] = resolution.z;
+        clw_grid.brick_count[0] = brick_count.x;
+        clw_grid.brick_count[1] = brick_count.y;
+        clw_grid.brick_count[2] = brick_count.z;
+        clw_grid.max_density = grid.GetMaxDensity();
+
+        auto const& majorants = grid.GetMajorants();
+        clw_grid.majorants = static_cast<int>(data.size());
+        data.insert(data.end(), majorants.cbegin(), majorants.cend());
+
+        // Brick table is stored bitwise, kernels read it with as_int
+        auto const& brick_table = grid.GetBrickTable();
+        clw_grid.brick_table = static_cast<int>(data.size());
+        data.resize(data.size() + brick_table.size());
+        std::memcpy(&data[clw_grid.brick_table], brick_table.data(), brick_table.size() * sizeof(std::int32_t));
+
+        auto const& bricks = grid.GetBricks();
+        clw_grid.bricks = static_cast<int>(data.size());
+        data.insert(data.end(), bricks.cbegin(), bricks.cend());
+
+        return clw_grid;
+    }
+
     void ClwSceneController::ReloadIntersector(Scene1 const& scene, ClwScene& inout) const
     {
         m_api->DetachAll();
@@ -847,6 +1161,7 @@ namespace Baikal
         {
             out.textures = m_context.CreateBuffer<ClwScene::Texture>(1, CL_MEM_READ_ONLY);
             out.texturedata = m_context.CreateBuffer<char>(1, CL_MEM_READ_ONLY);
+            out.virtual_textures.reset();
             return;
         }
 
@@ -857,60 +1172,113 @@ namespace Baikal
             out.textures = m_context.CreateBuffer<ClwScene::Texture>(tex_buffer_size, CL_MEM_READ_ONLY);
         }
 
+        // Update material bundle first to be able to track differences
+        out.texture_bundle.reset(tex_collector.CreateBundle());
+
+        // Create material iterator
+        std::unique_ptr<Iterator> tex_iter(tex_collector.CreateIterator());
+
+        // Resident textures go first, virtual ones are streamed into tile cache placed after them
+        std::shared_ptr<ClwVirtualTextureCache> virtual_textures;
+
+        for (; tex_iter->IsValid(); tex_iter->Next())
+        {
+            auto tex = tex_iter->ItemAs<Texture>();
+
+            if (tex->IsVirtual())
+            {
+                if (!virtual_textures)
+                {
+                    virtual_textures = std::make_shared<ClwVirtualTextureCache>(m_context, m_virtual_texture_cache_size);
+                }
+
+                virtual_textures->AddTexture(tex);
+            }
+            else
+            {
+                tex_data_buffer_size += align16(tex->GetMipChainSizeInBytes());
+            }
+        }
+
+        if (virtual_textures)
+        {
+            tex_data_buffer_size += virtual_textures->Allocate(tex_data_buffer_size);
+        }
+
         ClwScene::Texture* textures = nullptr;
         std::size_t num_textures_written = 0;
+        std::size_t num_bytes_written = 0;
 
         // Map GPU materials buffer
         m_context.MapBuffer(0, out.textures, CL_MAP_WRITE, &textures).Wait();
 
-        // Update material bundle first to be able to track differences
-        out.texture_bundle.reset(tex_collector.CreateBundle());
-
-        // Create material iterator
-        std::unique_ptr<Iterator> tex_iter(tex_collector.CreateIterator());
+        tex_iter->Reset();
 
         // Iterate and serialize
         for (; tex_iter->IsValid(); tex_iter->Next())
         {
             auto tex = tex_iter->ItemAs<Texture>();
 
-            WriteTexture(*tex, tex_data_buffer_size, textures + num_textures_written);
+            WriteTexture(*tex, num_bytes_written, textures + num_textures_written);
 
-            ++num_textures_written;
+            if (tex->IsVirtual())
+            {
+                virtual_textures->WriteTexture(*tex, textures[num_textures_written]);
+            }
+            else
+            {
+                num_bytes_written += align16(tex->GetMipChainSizeInBytes());
+            }
 
-            tex_data_buffer_size += align16(tex->GetSizeInBytes());
+            ++num_textures_written;
         }
 
         // Unmap material buffer
         m_context.UnmapBuffer(0, out.textures, textures);
+        RecordUpload(num_textures_written * sizeof(ClwScene::Texture));
 
-        // Recreate material buffer if it needs resize
-        if (tex_data_buffer_size > out.texturedata.GetElementCount())
+        // Recreate material buffer if it needs resize,
+        // kernels write tile requests into texture data if there are virtual textures
+        if (tex_data_buffer_size > out.texturedata.GetElementCount() || (virtual_textures && !out.virtual_textures))
         {
             // Create material buffer
-            out.texturedata = m_context.CreateBuffer<char>(tex_data_buffer_size, CL_MEM_READ_ONLY);
+            out.texturedata = m_context.CreateBuffer<char>(tex_data_buffer_size, virtual_textures ? CL_MEM_READ_WRITE : CL_MEM_READ_ONLY);
         }
 
         char* data = nullptr;
-        std::size_t num_bytes_written = 0;
+        num_bytes_written = 0;
 
         tex_iter->Reset();
 
         // Map GPU materials buffer
         m_context.MapBuffer(0, out.texturedata, CL_MAP_WRITE, &data).Wait();
 
-        // Write texture data for all textures
+        // Write texture data for all resident textures
         for (; tex_iter->IsValid(); tex_iter->Next())
         {
             auto tex = tex_iter->ItemAs<Texture>();
 
+            if (tex->IsVirtual())
+            {
+                continue;
+            }
+
             WriteTextureData(*tex, data + num_bytes_written);
 
-            num_bytes_written += align16(tex->GetSizeInBytes());
+            num_bytes_written += align16(tex->GetMipChainSizeInBytes());
+        }
+
+        // Page tables and pinned tiles of virtual textures
+        if (virtual_textures)
+        {
+            virtual_textures->WriteData(data);
         }
 
         // Unmap material buffer
         m_context.UnmapBuffer(0, out.texturedata, data);
+        RecordUpload(tex_data_buffer_size);
+
+        out.virtual_textures = virtual_textures;
     }
 
 #ifndef NDEBUG
@@ -1009,6 +1377,7 @@ namespace Baikal
                 {
                     auto value = material.GetInputValue(layer_param);
                     assert(value.type == Material::InputType::kInputMap);
+                    m_material_input_map_slots.push_back(material_data.size());
                     material_data.push_back(value.input_map_value ? value.input_map_value->GetId() : -1);
                 }
             }
@@ -1035,19 +1404,25 @@ namespace Baikal
         {
             return ClwScene::kIbl;
         }
+        else if (dynamic_cast<MeshLight const*>(&light))
+        {
+            return ClwScene::kMesh;
+        }
         else
         {
             return ClwScene::LightType::kArea;
         }
     }
 
-    void ClwSceneController::WriteLight(Scene1 const& scene, Light const& light, Collector& tex_collector, void* data) const
+    void ClwSceneController::WriteLight(Light const& light, ClwShapeRegistry const& shape_registry, Collector& tex_collector, void* data) const
     {
         auto clw_light = reinterpret_cast<ClwScene::Light*>(data);
 
         auto type = GetLightType(light);
 
         clw_light->type = type;
+        clw_light->env_distribution = -1;
+        clw_light->bvh_node = -1;
 
         switch (type)
         {
@@ -1097,16 +1472,23 @@ namespace Baikal
 
             case ClwScene::kArea:
             {
-                // TODO: optimize this linear search
                 auto shape = static_cast<AreaLight const&>(light).GetShape();
 
-                auto shape_iter = scene.CreateShapeIterator();
+                clw_light->id = shape->GetId();
+                clw_light->shapeidx = shape_registry.GetIndex(*shape);
+                clw_light->primidx = static_cast<int>(static_cast<AreaLight const&>(light).GetPrimitiveIdx());
+                break;
+            }
 
-                auto idx = GetShapeIdx(*shape_iter, shape);
+            case ClwScene::kMesh:
+            {
+                auto shape = static_cast<MeshLight const&>(light).GetShape();
 
                 clw_light->id = shape->GetId();
-                clw_light->shapeidx = static_cast<int>(idx);
-                clw_light->primidx = static_cast<int>(static_cast<AreaLight const&>(light).GetPrimitiveIdx());
+                clw_light->shapeidx = shape_registry.GetIndex(*shape);
+                clw_light->primidx = -1;
+                // Set by UpdateLights
+                clw_light->prim_distribution = -1;
                 break;
             }
 
@@ -1116,40 +1498,371 @@ namespace Baikal
         }
     }
 
+    // Relative luminance of linear RGB value
+    static float Luminance(RadeonRays::float3 const& value)
+    {
+        return 0.2126f * value.x + 0.7152f * value.y + 0.0722f * value.z;
+    }
+
+    // Fills light BVH emitter for bounded light, returns false for infinite lights
+    static bool GetLightEmitter(Scene1 const& scene, Light const& light, LightBvh::Emitter& emitter)
+    {
+        emitter.power = std::max(Luminance(light.GetPower(scene)), 0.f);
+
+        switch (GetLightType(light))
+        {
+            case ClwScene::kPoint:
+            {
+                emitter.bounds = RadeonRays::bbox(light.GetPosition());
+                emitter.axis = RadeonRays::float3(0.f, 0.f, 1.f);
+                emitter.cos_theta_o = -1.f;
+                emitter.cos_theta_e = 0.f;
+                return true;
+            }
+
+            case ClwScene::kSpot:
+            {
+                auto cone_shape = static_cast<SpotLight const&>(light).GetConeShape();
+                auto theta_i = std::acos(std::min(std::max(cone_shape.x, -1.f), 1.f));
+                auto theta_o = std::acos(std::min(std::max(cone_shape.y, -1.f), 1.f));
+                emitter.bounds = RadeonRays::bbox(light.GetPosition());
+                emitter.axis = normalize(light.GetDirection());
+                emitter.cos_theta_o = std::cos(theta_i);
+                emitter.cos_theta_e = std::cos(std::max(theta_o - theta_i, 0.f));
+                return true;
+            }
+
+            case ClwScene::kArea:
+            {
+                auto& area_light = static_cast<AreaLight const&>(light);
+                auto mesh = std::static_pointer_cast<Mesh>(area_light.GetShape());
+                auto transform = mesh->GetTransform();
+                auto indices = mesh->GetIndices() + area_light.GetPrimitiveIdx() * 3;
+
+                emitter.bounds = RadeonRays::bbox();
+                for (auto i = 0; i < 3; ++i)
+                {
+                    emitter.bounds.grow(transform_point(mesh->GetVertices()[indices[i]], transform));
+                }
+
+                // Emission is one sided with respect to interpolated normal,
+                // so cone has to contain all vertex normals
+                RadeonRays::float3 normals[3];
+                RadeonRays::float3 axis(0.f, 0.f, 0.f);
+                if (mesh->GetNumNormals() > 0)
+                {
+                    for (auto i = 0; i < 3; ++i)
+                    {
+                        normals[i] = normalize(transform_vector(mesh->GetNormals()[indices[i]], transform));
+                        axis += normals[i];
+                    }
+                }
+
+                emitter.cos_theta_e = 0.f;
+                if (axis.sqnorm() > 0.f)
+                {
+                    emitter.axis = normalize(axis);
+                    emitter.cos_theta_o = 1.f;
+                    for (auto i = 0; i < 3; ++i)
+                    {
+                        emitter.cos_theta_o = std::min(emitter.cos_theta_o, dot(emitter.axis, normals[i]));
+                    }
+                }
+                else
+                {
+                    emitter.axis = RadeonRays::float3(0.f, 0.f, 1.f);
+                    emitter.cos_theta_o = -1.f;
+                }
+                return true;
+            }
+
+            default:
+                return false;
+        }
+    }
+
+    // Serializes 1D distribution as number of segments, num_segments + 1 CDF values
+    // and num_segments PDF values, returns pointer past written data
+    static int* WriteDistribution1D(Distribution1D const& distribution, int* data)
+    {
+        *data++ = (int)distribution.m_num_segments;
+
+        auto values = reinterpret_cast<float*>(data);
+        for (auto i = 0u; i < distribution.m_num_segments + 1; ++i)
+        {
+            *values++ = distribution.m_cdf[i];
+        }
+
+        for (auto i = 0u; i < distribution.m_num_segments; ++i)
+        {
+            *values++ = distribution.m_func_values[i] / distribution.m_func_sum;
+        }
+
+        return reinterpret_cast<int*>(values);
+    }
+
+    // Builds luminance distribution of lat-long environment map over its (phi, theta)
+    // domain and serializes it in the layout expected by Distribution2D_Sample.
+    // Returns empty vector if texture can't be sampled on host or is black.
+    static std::vector<int> BuildEnvironmentDistribution(Texture const& texture, ThreadPool& pool)
+    {
+        auto size = texture.GetSize();
+        if (texture.IsVirtual() || Texture::IsBlockCompressed(texture.GetFormat()) || size.z > 1)
+        {
+            return std::vector<int>();
+        }
+
+        // Large maps are downsampled, each cell averages its texels
+        auto width = std::min(size.x, static_cast<int>(ClwSceneController::kMaxEnvironmentDistributionWidth));
+        auto height = std::min(size.y, static_cast<int>(ClwSceneController::kMaxEnvironmentDistributionWidth / 2));
+
+        std::vector<float> values(width * height);
+
+        auto fill_rows = [&](int begin, int end)
+        {
+            for (auto y = begin; y < end; ++y)
+            {
+                // Rows are ordered by theta the same way as in Texture_SampleEnvMap.
+                // Cell also covers the next texel row and column since kernels filter bilinearly,
+                // so cells with nonzero radiance always have nonzero pdf
+                auto y0 = y * size.y / height;
+                auto y1 = std::min((y + 1) * size.y / height, size.y - 1);
+                auto sin_theta = std::sin(PI * (y + 0.5f) / height);
+
+                for (auto x = 0; x < width; ++x)
+                {
+                    auto x0 = x * size.x / width;
+                    auto x1 = std::min((x + 1) * size.x / width, size.x - 1);
+
+                    float sum = 0.f;
+                    for (auto ty = y0; ty <= y1; ++ty)
+                    {
+                        for (auto tx = x0; tx <= x1; ++tx)
+                        {
+                            sum += std::max(Luminance(texture.GetTexel(tx, ty)), 0.f);
+                        }
+                    }
+
+                    values[y * width + x] = sin_theta * sum / ((y1 - y0 + 1) * (x1 - x0 + 1));
+                }
+            }
+        };
+
+        int const kRowsPerTask = 8;
+        std::vector<std::future<void>> tasks;
+        for (auto y = 0; y < height; y += kRowsPerTask)
+        {
+            auto end = std::min(y + kRowsPerTask, height);
+            tasks.push_back(pool.Submit([&fill_rows, y, end]() { fill_rows(y, end); }));
+        }
+
+        for (auto& task : tasks)
+        {
+            task.get();
+        }
+
+        Distribution2D distribution(values.data(), width, height, &pool);
+        if (!(distribution.m_marginal.m_func_sum > 0.f))
+        {
+            return std::vector<int>();
+        }
+
+        std::vector<int> data(2 + (2 * height + 2) + height * (2 * width + 2));
+        data[0] = width;
+        data[1] = height;
+
+        auto current = WriteDistribution1D(distribution.m_marginal, &data[2]);
+        for (auto const& row : distribution.m_conditional)
+        {
+            current = WriteDistribution1D(row, current);
+        }
+
+        return data;
+    }
+
+    // Builds distribution of mesh primitives proportional to their world space area
+    // and fills emitter bounds and emission cone (power is left to the caller).
+    // Returns empty vector if mesh has no area.
+    static std::vector<int> BuildMeshLightDistribution(Mesh const& mesh, LightBvh::Emitter& emitter)
+    {
+        auto transform = mesh.GetTransform();
+        auto vertices = mesh.GetVertices();
+        auto indices = mesh.GetIndices();
+        auto num_prims = mesh.GetNumIndices() / 3;
+
+        emitter.bounds = RadeonRays::bbox();
+        for (std::size_t i = 0; i < mesh.GetNumVertices(); ++i)
+        {
+            emitter.bounds.grow(transform_point(vertices[i], transform));
+        }
+
+        // Emission is one sided with respect to interpolated normal,
+        // so cone has to contain all vertex normals
+        std::vector<RadeonRays::float3> normals(mesh.GetNumNormals());
+        RadeonRays::float3 axis(0.f, 0.f, 0.f);
+        for (std::size_t i = 0; i < normals.size(); ++i)
+        {
+            normals[i] = normalize(transform_vector(mesh.GetNormals()[i], transform));
+            axis += normals[i];
+        }
+
+        emitter.cos_theta_e = 0.f;
+        if (axis.sqnorm() > 0.f)
+        {
+            emitter.axis = normalize(axis);
+            emitter.cos_theta_o = 1.f;
+            for (auto const& n : normals)
+            {
+                emitter.cos_theta_o = std::min(emitter.cos_theta_o, dot(emitter.axis, n));
+            }
+        }
+        else
+        {
+            emitter.axis = RadeonRays::float3(0.f, 0.f, 1.f);
+            emitter.cos_theta_o = -1.f;
+        }
+
+        std::vector<float> areas(num_prims);
+        float total_area = 0.f;
+        for (std::size_t i = 0; i < num_prims; ++i)
+        {
+            auto v0 = transform_point(vertices[indices[i * 3]], transform);
+            auto v1 = transform_point(vertices[indices[i * 3 + 1]], transform);
+            auto v2 = transform_point(vertices[indices[i * 3 + 2]], transform);
+
+            areas[i] = 0.5f * std::sqrt(cross(v2 - v0, v1 - v0).sqnorm());
+            total_area += areas[i];
+        }
+
+        if (!(total_area > 0.f))
+        {
+            return std::vector<int>();
+        }
+
+        Distribution1D distribution(areas.data(), static_cast<std::uint32_t>(num_prims));
+        std::vector<int> data(1 + 2 * num_prims + 1);
+        WriteDistribution1D(distribution, data.data());
+        return data;
+    }
+
     void ClwSceneController::UpdateLights(Scene1 const& scene, Collector& mat_collector, Collector& tex_collector, ClwScene& out) const
     {
         std::size_t num_lights_written = 0;
 
-        auto env_override = scene.GetEnvironmentOverride();
-
         auto num_lights = scene.GetNumLights();
-        auto distribution_buffer_size = (1 + 1 + num_lights + num_lights);
 
-        // Create light buffer if needed
+        // Light selection distribution goes first, followed by distributions
+        // of environment maps and mesh light primitives referenced from lights.
+        // Selection distribution has extra segment for lights sampled through light BVH.
+        std::size_t distribution_buffer_size = (1 + 1 + (num_lights + 1) + (num_lights + 1));
+
+        // Build distributions of environment maps, these are cached until texture is changed
+        std::unordered_map<std::uint32_t, std::vector<int>> env_distributions;
+        std::unordered_map<std::uint32_t, int> env_distribution_offsets;
+        std::unique_ptr<Iterator> light_iter(scene.CreateLightIterator());
+
+        for (; light_iter->IsValid(); light_iter->Next())
+        {
+            auto ibl = std::dynamic_pointer_cast<ImageBasedLight>(light_iter->ItemAs<Light>());
+            auto texture = ibl ? ibl->GetTexture() : nullptr;
+            if (!texture || env_distribution_offsets.count(texture->GetId()))
+            {
+                continue;
+            }
+
+            auto iter = m_env_distributions.find(texture->GetId());
+            if (iter == m_env_distributions.cend() || texture->IsDirty())
+            {
+                auto start = std::chrono::high_resolution_clock::now();
+                env_distributions[texture->GetId()] = BuildEnvironmentDistribution(*texture, *m_thread_pool);
+                auto delta = std::chrono::high_resolution_clock::now() - start;
+                LogInfo("Environment distribution built in ", std::chrono::duration_cast<std::chrono::milliseconds>(delta).count(), " ms\n");
+            }
+            else
+            {
+                env_distributions[texture->GetId()] = std::move(iter->second);
+            }
+
+            auto const& data = env_distributions[texture->GetId()];
+            env_distribution_offsets[texture->GetId()] = data.empty() ? -1 : static_cast<int>(distribution_buffer_size);
+            distribution_buffer_size += data.size();
+        }
+
+        // Drop distributions of textures which are not used anymore
+        m_env_distributions = std::move(env_distributions);
+
+        // Build primitive distributions of mesh lights, these are cached until mesh is changed
+        std::unordered_map<std::uint32_t, MeshLightData> mesh_lights;
+        std::unordered_map<std::uint32_t, int> mesh_distribution_offsets;
+
+        for (light_iter->Reset(); light_iter->IsValid(); light_iter->Next())
+        {
+            auto mesh_light = std::dynamic_pointer_cast<MeshLight>(light_iter->ItemAs<Light>());
+            auto mesh = mesh_light ? std::static_pointer_cast<Mesh>(mesh_light->GetShape()) : nullptr;
+            if (!mesh || mesh_distribution_offsets.count(mesh->GetId()))
+            {
+                continue;
+            }
+
+            auto transform = mesh->GetTransform();
+            auto iter = m_mesh_lights.find(mesh->GetId());
+            if (iter == m_mesh_lights.cend() ||
+                iter->second.revision != mesh->GetGeometryRevision() ||
+                !std::equal(&transform.m[0][0], &transform.m[0][0] + 16, &iter->second.transform.m[0][0]))
+            {
+                auto& mesh_light_data = mesh_lights[mesh->GetId()];
+                mesh_light_data.distribution = BuildMeshLightDistribution(*mesh, mesh_light_data.emitter);
+                mesh_light_data.revision = mesh->GetGeometryRevision();
+                mesh_light_data.transform = transform;
+            }
+            else
+            {
+                mesh_lights[mesh->GetId()] = std::move(iter->second);
+            }
+
+            auto const& data = mesh_lights[mesh->GetId()].distribution;
+            mesh_distribution_offsets[mesh->GetId()] = data.empty() ? -1 : static_cast<int>(distribution_buffer_size);
+            distribution_buffer_size += data.size();
+        }
+
+        // Drop data of meshes which are not lights anymore
+        m_mesh_lights = std::move(mesh_lights);
+
+        // Create light buffers if needed
         if (num_lights > out.lights.GetElementCount())
         {
             out.lights = m_context.CreateBuffer<ClwScene::Light>(num_lights, CL_MEM_READ_ONLY);
+        }
+
+        if (distribution_buffer_size > out.light_distributions.GetElementCount())
+        {
             out.light_distributions = m_context.CreateBuffer<int>(distribution_buffer_size, CL_MEM_READ_ONLY);
         }
 
         ClwScene::Light* lights = nullptr;
 
         m_context.MapBuffer(0, out.lights, CL_MAP_WRITE, &lights).Wait();
-        std::unique_ptr<Iterator> light_iter(scene.CreateLightIterator());
+        light_iter->Reset();
 
         // Disable IBL by default
         out.envmapidx = -1;
 
-        // Allocate intermediate storage for lights power distribution
-        std::vector<float> light_power(num_lights);
+        // Allocate intermediate storage for lights power distribution,
+        // last segment accumulates power of lights in light BVH
+        std::vector<float> light_power(num_lights + 1);
+        std::vector<LightBvh::Emitter> emitters;
         std::uint32_t k = 0;
 
+        // Area and mesh lights reference shapes by their indices in shape buffer
+        UpdateShapeRegistry(scene, out);
+        auto const& shape_registry = out.shape_registry;
+
         // Serialize
         {
             for (; light_iter->IsValid(); light_iter->Next())
             {
                 auto light = light_iter->ItemAs<Light>();
-                WriteLight(scene, *light, tex_collector, lights + num_lights_written);
+                WriteLight(*light, shape_registry, tex_collector, lights + num_lights_written);
 
 
                 // Find and update IBL idx
@@ -1157,18 +1870,143 @@ namespace Baikal
                 if (ibl)
                 {
                     out.envmapidx = static_cast<int>(num_lights_written);
+
+                    if (ibl->GetTexture())
+                    {
+                        lights[num_lights_written].env_distribution = env_distribution_offsets[ibl->GetTexture()->GetId()];
+                    }
                 }
 
-                ++num_lights_written;
+                // Bounded lights are sampled through light BVH, infinite ones by power
+                LightBvh::Emitter emitter;
+                auto mesh_light = std::dynamic_pointer_cast<MeshLight>(light);
+                auto bounded = false;
+                if (mesh_light)
+                {
+                    auto id = mesh_light->GetShape()->GetId();
+                    lights[num_lights_written].prim_distribution = mesh_distribution_offsets[id];
+                    emitter = m_mesh_lights[id].emitter;
+                    emitter.power = std::max(Luminance(light->GetPower(scene)), 0.f);
+                    bounded = true;
+                }
+                else
+                {
+                    bounded = GetLightEmitter(scene, *light, emitter);
+                }
 
-                auto power = light->GetPower(scene);
+                if (bounded)
+                {
+                    emitter.light_idx = static_cast<int>(num_lights_written);
+                    emitters.push_back(emitter);
+                    light_power[num_lights] += emitter.power;
+                    light_power[k++] = 0.f;
+                }
+                else
+                {
+                    light_power[k++] = Luminance(light->GetPower(scene));
+                }
 
-                // TODO: move luminance calculation into utility function
-                light_power[k++] = 0.2126f * power.x + 0.7152f * power.y + 0.0722f * power.z;
+                ++num_lights_written;
             }
         }
 
+        LightBvh light_bvh;
+        light_bvh.Build(emitters);
+
+        for (std::size_t i = 0; i < emitters.size(); ++i)
+        {
+            lights[emitters[i].light_idx].bvh_node = light_bvh.GetLeafIndices()[i];
+        }
+
         m_context.UnmapBuffer(0, out.lights, lights);
+        RecordUpload(num_lights_written * sizeof(ClwScene::Light));
+
+        // Write light BVH nodes, buffer always holds at least one node
+        auto const& nodes = light_bvh.GetNodes();
+        if (std::max<std::size_t>(nodes.size(), 1) > out.light_bvh.GetElementCount())
+        {
+            out.light_bvh = m_context.CreateBuffer<ClwScene::LightBvhNode>(std::max<std::size_t>(nodes.size(), 1), CL_MEM_READ_ONLY);
+        }
+
+        if (!nodes.empty())
+        {
+            ClwScene::LightBvhNode* bvh_nodes = nullptr;
+            m_context.MapBuffer(0, out.light_bvh, CL_MAP_WRITE, &bvh_nodes).Wait();
+
+            for (std::size_t i = 0; i < nodes.size(); ++i)
+            {
+                auto& node = bvh_nodes[i];
+                node.bbox_min = nodes[i].bounds.pmin;
+                node.bbox_max = nodes[i].bounds.pmax;
+                node.axis = nodes[i].axis;
+                node.cos_theta_o = nodes[i].cos_theta_o;
+                node.cos_theta_e = nodes[i].cos_theta_e;
+                node.power = nodes[i].power;
+                node.parent = nodes[i].parent;
+                node.left = nodes[i].left;
+                node.right = nodes[i].right;
+                node.light_idx = nodes[i].light_idx;
+            }
+
+            m_context.UnmapBuffer(0, out.light_bvh, bvh_nodes);
+            RecordUpload(nodes.size() * sizeof(ClwScene::LightBvhNode));
+        }
+
+        // Map emissive primitives to area lights for MIS at emissive hits.
+        // Table starts with offset of each shape primitive range, -1 or
+        // -(light_idx + 2) for shapes emitting through mesh light.
+        std::vector<int> emissive_lights(shape_registry.GetNumShapes(), -1);
+        {
+            std::unique_ptr<Iterator> iter(scene.CreateLightIterator());
+            for (int light_idx = 0; iter->IsValid(); iter->Next(), ++light_idx)
+            {
+                auto mesh_light = std::dynamic_pointer_cast<MeshLight>(iter->ItemAs<Light>());
+                auto mesh_shape_idx = mesh_light ? shape_registry.GetIndex(*mesh_light->GetShape()) : -1;
+                if (mesh_shape_idx >= 0)
+                {
+                    if (emissive_lights[mesh_shape_idx] == -1)
+                    {
+                        emissive_lights[mesh_shape_idx] = -(light_idx + 2);
+                    }
+
+                    continue;
+                }
+
+                auto area_light = std::dynamic_pointer_cast<AreaLight>(iter->ItemAs<Light>());
+                auto shape_idx = area_light ? shape_registry.GetIndex(*area_light->GetShape()) : -1;
+                if (shape_idx < 0)
+                {
+                    continue;
+                }
+
+                if (emissive_lights[shape_idx] < -1)
+                {
+                    continue;
+                }
+
+                if (emissive_lights[shape_idx] == -1)
+                {
+                    auto mesh = std::static_pointer_cast<Mesh>(area_light->GetShape());
+                    emissive_lights[shape_idx] = static_cast<int>(emissive_lights.size());
+                    emissive_lights.resize(emissive_lights.size() + mesh->GetNumIndices() / 3, -1);
+                }
+
+                emissive_lights[emissive_lights[shape_idx] + area_light->GetPrimitiveIdx()] = light_idx;
+            }
+        }
+
+        if (emissive_lights.empty())
+        {
+            emissive_lights.push_back(-1);
+        }
+
+        if (emissive_lights.size() > out.emissive_lights.GetElementCount())
+        {
+            out.emissive_lights = m_context.CreateBuffer<int>(emissive_lights.size(), CL_MEM_READ_ONLY);
+        }
+
+        m_context.WriteBuffer(0, out.emissive_lights, emissive_lights.data(), emissive_lights.size()).Wait();
+        RecordUpload(emissive_lights.size() * sizeof(int));
 
         // Create distribution over light sources based on their power
         Distribution1D light_distribution(&light_power[0], (std::uint32_t)light_power.size());
@@ -1176,27 +2014,30 @@ namespace Baikal
         // Write distribution data
         int* distribution_ptr = nullptr;
         m_context.MapBuffer(0, out.light_distributions, CL_MAP_WRITE, &distribution_ptr).Wait();
-        auto current = distribution_ptr;
 
-        // Write the number of segments first
-        *current++ = (int)light_distribution.m_num_segments;
+        WriteDistribution1D(light_distribution, distribution_ptr);
 
-        // Then write num_segments  + 1 CDF values
-        auto values = reinterpret_cast<float*>(current);
-        for (auto i = 0u; i < light_distribution.m_num_segments + 1; ++i)
+        // Then write environment map and mesh light distributions at their offsets
+        for (auto const& offset : env_distribution_offsets)
         {
-            values[i] = light_distribution.m_cdf[i];
+            if (offset.second != -1)
+            {
+                auto const& data = m_env_distributions[offset.first];
+                std::copy(data.cbegin(), data.cend(), distribution_ptr + offset.second);
+            }
         }
 
-        // Then write num_segments PDF values
-        values += light_distribution.m_num_segments + 1;
-
-        for (auto i = 0u; i < light_distribution.m_num_segments; ++i)
+        for (auto const& offset : mesh_distribution_offsets)
         {
-            values[i] = light_distribution.m_func_values[i] / light_distribution.m_func_sum;
+            if (offset.second != -1)
+            {
+                auto const& data = m_mesh_lights[offset.first].distribution;
+                std::copy(data.cbegin(), data.cend(), distribution_ptr + offset.second);
+            }
         }
 
         m_context.UnmapBuffer(0, out.light_distributions, distribution_ptr);
+        RecordUpload(distribution_buffer_size * sizeof(int));
 
         out.num_lights = static_cast<int>(num_lights_written);
     }
@@ -1210,6 +2051,16 @@ namespace Baikal
             case Texture::Format::kRgba8: return ClwScene::TextureFormat::RGBA8;
             case Texture::Format::kRgba16: return ClwScene::TextureFormat::RGBA16;
             case Texture::Format::kRgba32: return ClwScene::TextureFormat::RGBA32;
+            case Texture::Format::kR8: return ClwScene::TextureFormat::R8;
+            case Texture::Format::kRg8: return ClwScene::TextureFormat::RG8;
+            case Texture::Format::kR16: return ClwScene::TextureFormat::R16;
+            case Texture::Format::kRg16: return ClwScene::TextureFormat::RG16;
+            case Texture::Format::kR32: return ClwScene::TextureFormat::R32;
+            case Texture::Format::kRg32: return ClwScene::TextureFormat::RG32;
+            case Texture::Format::kBc1: return ClwScene::TextureFormat::BC1;
+            case Texture::Format::kBc3: return ClwScene::TextureFormat::BC3;
+            case Texture::Format::kBc4: return ClwScene::TextureFormat::BC4;
+            case Texture::Format::kBc5: return ClwScene::TextureFormat::BC5;
             default: return ClwScene::TextureFormat::RGBA8;
         }
     }
@@ -1225,12 +2076,24 @@ namespace Baikal
         clw_texture->d = dim.z;
         clw_texture->fmt = GetTextureFormat(texture);
         clw_texture->dataoffset = static_cast<int>(data_offset);
+        clw_texture->mip_count = static_cast<int>(texture.GetMipLevelCount());
+        clw_texture->vt_page_table = TEXTURE_VT_INVALID;
+        clw_texture->vt_feedback = 0;
+        clw_texture->vt_id = 0;
+        clw_texture->padding = 0;
+
+        static_assert(Texture::kMaxMipLevels == TEXTURE_MAX_MIP_LEVELS, "Mip level limits should match");
+
+        for (auto i = 0u; i < Texture::kMaxMipLevels; ++i)
+        {
+            clw_texture->mip_offsets[i] = i < texture.GetMipLevelCount() ? static_cast<int>(texture.GetMipLevelOffset(i)) : 0;
+        }
     }
 
     void ClwSceneController::WriteTextureData(Texture const& texture, void* data) const
     {
         auto begin = texture.GetData();
-        auto end = begin + texture.GetSizeInBytes();
+        auto end = begin + texture.GetMipChainSizeInBytes();
         std::copy(begin, end, static_cast<char*>(data));
     }
 
@@ -1292,6 +2155,52 @@ namespace Baikal
 
     void Baikal::ClwSceneController::UpdateInputMaps(const Baikal::Scene1& scene, Baikal::Collector& input_map_collector, Collector& input_map_leafs_collector, ClwScene& out) const
     {
+        if (m_material_compilation_mode == MaterialCompilationMode::kInterpreter)
+        {
+            m_program_manager->AddHeader("inputmaps.cl", kInterpreterHeader);
+
+            // Bytecode is placed right after leafs written by UpdateLeafsData.
+            // Leaf changes always dirty input maps, so it is regenerated after leafs update.
+            std::size_t num_leafs = input_map_leafs_collector.GetNumItems();
+
+            CLInputMapBytecodeGenerator generator;
+            generator.Generate(input_map_collector, input_map_leafs_collector, static_cast<std::uint32_t>(num_leafs));
+            auto const& bytecode = generator.GetBytecode();
+
+            std::size_t buffer_size = num_leafs + bytecode.size();
+
+            if (buffer_size > out.input_map_data.GetElementCount())
+            {
+                auto input_map_data = m_context.CreateBuffer<ClwScene::InputMapData>(buffer_size, CL_MEM_READ_ONLY);
+
+                if (num_leafs > 0)
+                {
+                    m_context.CopyBuffer(0, out.input_map_data, input_map_data, 0, 0, num_leafs);
+                }
+
+                out.input_map_data = input_map_data;
+            }
+
+            if (!bytecode.empty())
+            {
+                m_context.WriteBuffer(0, out.input_map_data, bytecode.data(), num_leafs, bytecode.size());
+                RecordUpload(bytecode.size() * sizeof(ClwScene::InputMapData));
+            }
+
+            m_input_map_offsets.clear();
+            auto input_map_iter = input_map_collector.CreateIterator();
+            for (; input_map_iter->IsValid(); input_map_iter->Next())
+            {
+                auto id = input_map_iter->ItemAs<InputMap>()->GetId();
+                m_input_map_offsets[id] = generator.GetOffset(id);
+            }
+
+            UploadMaterialAttributes(out);
+
+            out.input_map_bundle.reset(input_map_collector.CreateBundle());
+            return;
+        }
+
         CLInputMapGenerator generator;
         generator.Generate(input_map_collector, input_map_leafs_collector);
         std::string source = generator.GetGeneratedSource();
@@ -1333,6 +2242,7 @@ namespace Baikal
 
             //Unmap buffer
             m_context.UnmapBuffer(0, out.input_map_data, input_map_data);
+            RecordUpload(num_inputmap_leafs_written * sizeof(ClwScene::InputMapData));
         }
     }
 
@@ -32,6 +32,7 @@
 #include "CLW.h"
 
 #include "SceneGraph/clwscene.h"
+#include "Utils/light_bvh.h"
 
 #include "radeon_rays_cl.h"
 
@@ -43,7 +44,23 @@ namespace Baikal
     class Material;
     class Light;
     class Texture;
+    class Shape;
     class CLProgramManager;
+    class ThreadPool;
+
+    /**
+     \brief Defines how UberV2 materials and input maps are turned into device code.
+     */
+    enum class MaterialCompilationMode
+    {
+        // Source is generated for used layer combinations and input maps,
+        // programs are recompiled whenever generated source changes.
+        kCodegen,
+        // Precompiled interpreter evaluates layers at runtime and input maps
+        // from bytecode stored in input map data buffer, no recompilation
+        // is required on material edits.
+        kInterpreter
+    };
 
 
     /**
@@ -57,14 +74,25 @@ namespace Baikal
     class ClwSceneController : public SceneController<ClwScene>
     {
     public:
+        // Default size of GPU tile cache for virtual textures
+        static std::size_t constexpr kDefaultVirtualTextureCacheSize = 256 * 1024 * 1024;
+        // Maximum width of environment map importance sampling distribution,
+        // larger maps are downsampled
+        static std::uint32_t constexpr kMaxEnvironmentDistributionWidth = 2048;
+
         // Constructor
-        ClwSceneController(CLWContext context, RadeonRays::IntersectionApi* api, const CLProgramManager *program_manager);
+        ClwSceneController(CLWContext context, RadeonRays::IntersectionApi* api, const CLProgramManager *program_manager,
+                           MaterialCompilationMode material_compilation_mode = MaterialCompilationMode::kCodegen);
         // Destructor
         virtual ~ClwSceneController();
 
         // Get underlying intersection API.
         RadeonRays::IntersectionApi* GetIntersectionApi() { return  m_api; }
 
+        // Set size of GPU tile cache for virtual textures, applied on next texture update
+        void SetVirtualTextureCacheSize(std::size_t size_in_bytes) { m_virtual_texture_cache_size = size_in_bytes; }
+        std::size_t GetVirtualTextureCacheSize() const { return m_virtual_texture_cache_size; }
+
     protected:
         // Clear intersector and load meshes into it.
         void ReloadIntersector(Scene1 const& scene, ClwScene& inout) const;
@@ -95,6 +123,8 @@ namespace Baikal
         // If scene attributes changed
         void UpdateSceneAttributes(Scene1 const& scene, Collector& tex_collector, ClwScene& out) const override;
 
+        // Rebuild shape registry if the scene shape list has changed
+        void UpdateShapeRegistry(Scene1 const& scene, ClwScene& out) const;
         // Update intersection API
         void UpdateIntersector(Scene1 const& scene, ClwScene& out) const;
         void UpdateIntersectorTransforms(Scene1 const& scene, ClwScene& out) const;
@@ -102,8 +132,9 @@ namespace Baikal
         // Collectors are required to convert texture and material pointers into indices.
         void WriteMaterial(Material const& material, Collector& mat_collector, Collector& tex_collector, std::vector<std::int32_t> &material_data) const;
         // Write out single light at data pointer.
-        // Collector is required to convert texture pointers into indices.
-        void WriteLight(Scene1 const& scene, Light const& light, Collector& tex_collector, void* data) const;
+        // Collector is required to convert texture pointers into indices,
+        // shape indices are required to reference area light shapes.
+        void WriteLight(Light const& light, ClwShapeRegistry const& shape_registry, Collector& tex_collector, void* data) const;
         // Write out single texture header at data pointer.
         // Header requires texture data offset, so it is passed in.
         void WriteTexture(Texture const& texture, std::size_t data_offset, void* data) const;
@@ -111,6 +142,8 @@ namespace Baikal
         void WriteTextureData(Texture const& texture, void* data) const;
         // Write single volume at data pointer
         void WriteVolume(VolumeMaterial const& volume, Collector& tex_collector, void* data) const;
+        // Append majorants, brick table and bricks of density grid to data and return grid header
+        ClwScene::VolumeGrid WriteVolumeGrid(VolumeGrid const& grid, std::vector<float>& data) const;
         // Write single input map leaf at data pointer
         // Collectore is required to convert texture pointers into indices.
         void WriteInputMapLeaf(InputMap const& leaf, Collector& tex_collector, void* data) const;
@@ -119,6 +152,21 @@ namespace Baikal
         std::int32_t ResolveMaterialPtr(Material::Ptr material) const;
 
     private:
+        // Place meshes into geometry buffers reusing their previous ranges and
+        // upload data of new and changed meshes only. Buffers grow geometrically.
+        // Returns true if any geometry data has been uploaded.
+        bool UpdateGeometry(std::vector<Mesh::Ptr> const& meshes, ClwScene& out) const;
+        // Reallocate geometry buffers preserving contents of live mesh ranges.
+        // If compact is true live ranges are packed to the beginning of the new buffers.
+        void ReallocateGeometry(std::size_t vtx_capacity, std::size_t idx_capacity, bool compact, ClwScene& out) const;
+
+        // Replace input map ids in material data with bytecode offsets and upload it.
+        // Used in interpreter mode only.
+        void UploadMaterialAttributes(ClwScene& out) const;
+
+        // Account host to device transfer in profiler statistics
+        void RecordUpload(std::size_t num_bytes) const;
+
         int GetMaterialIndex(Collector const& collector, Material::Ptr material) const;
         int GetTextureIndex(Collector const& collector, Texture::Ptr material) const;
         int GetVolumeIndex(Collector const& collector, VolumeMaterial::Ptr volume) const;
@@ -134,5 +182,28 @@ namespace Baikal
         const CLProgramManager *m_program_manager;
         // Material to device material map
         mutable std::unordered_map<std::uint32_t, std::int32_t> m_materialid_to_offset;
+        // Material code generation mode
+        MaterialCompilationMode m_material_compilation_mode;
+        // Interpreter mode: material data with input map ids and positions of these ids
+        mutable std::vector<std::int32_t> m_material_data;
+        mutable std::vector<std::size_t> m_material_input_map_slots;
+        // Interpreter mode: input map id to bytecode offset map
+        mutable std::unordered_map<std::uint32_t, std::int32_t> m_input_map_offsets;
+        // Size of GPU tile cache for virtual textures
+        std::size_t m_virtual_texture_cache_size;
+        // Worker threads for host side preprocessing of scene data
+        std::unique_ptr<ThreadPool> m_thread_pool;
+        // Serialized environment map distributions by texture id
+        mutable std::unordered_map<std::uint32_t, std::vector<int>> m_env_distributions;
+        // Serialized primitive distribution and emitter bounds of mesh lights by mesh id,
+        // rebuilt when mesh geometry revision or transform changes
+        struct MeshLightData
+        {
+            std::vector<int> distribution;
+            LightBvh::Emitter emitter;
+            std::uint32_t revision;
+            RadeonRays::matrix transform;
+        };
+        mutable std::unordered_map<std::uint32_t, MeshLightData> m_mesh_lights;
     };
 }
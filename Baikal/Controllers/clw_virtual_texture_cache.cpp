@@ -0,0 +1,360 @@
+/**********************************************************************
+ Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ********************************************************************/
+
+#include "Controllers/clw_virtual_texture_cache.h"
+
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <stdexcept>
+
+namespace Baikal
+{
+    namespace
+    {
+        std::uint32_t constexpr kInvalidKey = 0xFFFFFFFFu;
+
+        std::size_t Align16(std::size_t value)
+        {
+            return (value + 0xF) / 16 * 16;
+        }
+
+        // Should match Texture_RequestTile in texture.cl
+        std::uint32_t MakeKey(std::uint32_t id, std::uint32_t level, std::uint32_t tile_x, std::uint32_t tile_y)
+        {
+            return (id << 20) | (level << 16) | (tile_y << 8) | tile_x;
+        }
+
+        std::uint32_t GetKeyTexture(std::uint32_t key) { return key >> 20; }
+        std::uint32_t GetKeyLevel(std::uint32_t key) { return (key >> 16) & 0xF; }
+        std::uint32_t GetKeyTileY(std::uint32_t key) { return (key >> 8) & 0xFF; }
+        std::uint32_t GetKeyTileX(std::uint32_t key) { return key & 0xFF; }
+
+        // Levels which fit into a single tile are pinned
+        bool IsPinnedLevel(Texture const& texture, std::uint32_t level)
+        {
+            auto tiles = texture.GetMipLevelTileCount(level);
+            return tiles.x == 1 && tiles.y == 1;
+        }
+    }
+
+    ClwVirtualTextureCache::ClwVirtualTextureCache(CLWContext context, std::size_t capacity_in_bytes, std::size_t num_loader_threads)
+        : m_context(context)
+        , m_capacity_in_bytes(capacity_in_bytes)
+        , m_feedback_offset(0)
+        , m_tile_pool_offset(0)
+        , m_slot_size(0)
+        , m_num_slots(0)
+        , m_feedback(TEXTURE_VT_FEEDBACK_SIZE, kInvalidKey)
+        , m_empty_feedback(TEXTURE_VT_FEEDBACK_SIZE, kInvalidKey)
+        , m_bytes_uploaded(0)
+        , m_loader(std::max<std::size_t>(num_loader_threads, 1))
+    {
+    }
+
+    void ClwVirtualTextureCache::AddTexture(Texture::Ptr texture)
+    {
+        if (m_texture_ids.count(texture.get()))
+        {
+            return;
+        }
+
+        if (m_textures.size() >= kMaxTextures)
+        {
+            throw std::runtime_error("ClwVirtualTextureCache: too many virtual textures");
+        }
+
+        // Tile coordinates are encoded with 8 bits in feedback requests
+        auto tiles = texture->GetMipLevelTileCount(0);
+        if (tiles.x > 256 || tiles.y > 256)
+        {
+            throw std::runtime_error("ClwVirtualTextureCache: virtual texture " + texture->GetName() + " is too large");
+        }
+
+        VirtualTexture vt = {};
+        vt.texture = texture;
+        m_texture_ids[texture.get()] = static_cast<std::uint32_t>(m_textures.size());
+        m_textures.push_back(vt);
+    }
+
+    std::size_t ClwVirtualTextureCache::Allocate(std::size_t base_offset)
+    {
+        auto offset = Align16(base_offset);
+
+        std::uint32_t num_pinned = 0;
+        m_slot_size = 0;
+
+        for (auto& vt : m_textures)
+        {
+            vt.page_table_offset = offset;
+            vt.num_pages = 0;
+
+            for (auto level = 0u; level < vt.texture->GetMipLevelCount(); ++level)
+            {
+                auto tiles = vt.texture->GetMipLevelTileCount(level);
+                vt.level_offsets[level] = vt.num_pages;
+                vt.num_pages += tiles.x * tiles.y;
+
+                if (IsPinnedLevel(*vt.texture, level))
+                {
+                    ++num_pinned;
+                }
+            }
+
+            offset += Align16(vt.num_pages * sizeof(std::int32_t));
+            m_slot_size = std::max(m_slot_size, Align16(vt.texture->GetTileSizeInBytes()));
+        }
+
+        m_feedback_offset = offset;
+        offset += Align16(TEXTURE_VT_FEEDBACK_SIZE * sizeof(std::uint32_t));
+
+        auto num_slots = m_slot_size > 0 ? m_capacity_in_bytes / m_slot_size : 0;
+        m_num_slots = static_cast<std::uint32_t>(std::max<std::size_t>(num_slots, num_pinned + kMinStreamingTiles));
+
+        m_tile_pool_offset = offset;
+        offset += m_num_slots * m_slot_size;
+
+        // Kernels address texture data with 32 bit offsets
+        if (offset > static_cast<std::size_t>(std::numeric_limits<std::int32_t>::max()))
+        {
+            throw std::runtime_error("ClwVirtualTextureCache: texture data exceeds 2GB, reduce tile cache capacity");
+        }
+
+        return offset - base_offset;
+    }
+
+    void ClwVirtualTextureCache::WriteTexture(Texture const& texture, ClwScene::Texture& clw_texture) const
+    {
+        auto& vt = m_textures[m_texture_ids.at(&texture)];
+
+        clw_texture.dataoffset = 0;
+        clw_texture.vt_page_table = static_cast<int>(vt.page_table_offset);
+        clw_texture.vt_feedback = static_cast<int>(m_feedback_offset);
+        clw_texture.vt_id = static_cast<int>(m_texture_ids.at(&texture));
+
+        for (auto i = 0u; i < Texture::kMaxMipLevels; ++i)
+        {
+            clw_texture.mip_offsets[i] = i < texture.GetMipLevelCount() ? static_cast<int>(vt.level_offsets[i]) : 0;
+        }
+    }
+
+    std::size_t ClwVirtualTextureCache::GetPageOffset(std::uint32_t key) const
+    {
+        auto& vt = m_textures[GetKeyTexture(key)];
+        auto tiles = vt.texture->GetMipLevelTileCount(GetKeyLevel(key));
+        auto entry = vt.level_offsets[GetKeyLevel(key)] + GetKeyTileY(key) * tiles.x + GetKeyTileX(key);
+        return vt.page_table_offset + entry * sizeof(std::int32_t);
+    }
+
+    std::size_t ClwVirtualTextureCache::GetSlotOffset(std::uint32_t slot) const
+    {
+        return m_tile_pool_offset + slot * m_slot_size;
+    }
+
+    void ClwVirtualTextureCache::WriteData(char* texturedata)
+    {
+        m_slot_keys.assign(m_num_slots, kInvalidKey);
+        m_resident.clear();
+        m_load_order.clear();
+        m_free_slots.clear();
+        m_pending.clear();
+        m_bytes_uploaded = 0;
+
+        for (auto& vt : m_textures)
+        {
+            auto page_table = reinterpret_cast<std::int32_t*>(texturedata + vt.page_table_offset);
+            std::fill(page_table, page_table + vt.num_pages, TEXTURE_VT_INVALID);
+        }
+
+        std::copy(m_empty_feedback.begin(), m_empty_feedback.end(), reinterpret_cast<std::uint32_t*>(texturedata + m_feedback_offset));
+
+        // Load pinned levels on loader threads and wait for them
+        std::vector<std::pair<std::uint32_t, std::future<void>>> loads;
+        std::uint32_t slot = 0;
+
+        for (auto id = 0u; id < m_textures.size(); ++id)
+        {
+            auto& vt = m_textures[id];
+
+            for (auto level = 0u; level < vt.texture->GetMipLevelCount(); ++level)
+            {
+                if (!IsPinnedLevel(*vt.texture, level))
+                {
+                    continue;
+                }
+
+                auto key = MakeKey(id, level, 0, 0);
+                auto source = vt.texture->GetTileSource();
+                auto dst = texturedata + GetSlotOffset(slot);
+
+                loads.emplace_back(key, m_loader.Submit([source, level, dst]()
+                {
+                    source->LoadTile(level, 0, 0, dst);
+                }));
+
+                *reinterpret_cast<std::int32_t*>(texturedata + GetPageOffset(key)) = static_cast<std::int32_t>(GetSlotOffset(slot));
+                m_slot_keys[slot] = key;
+                m_resident[key] = slot;
+                ++slot;
+            }
+        }
+
+        for (auto& load : loads)
+        {
+            load.second.get();
+        }
+
+        // Remaining slots are used for streaming, lowest are taken first
+        for (auto i = m_num_slots; i > slot; --i)
+        {
+            m_free_slots.push_back(i - 1);
+        }
+    }
+
+    void ClwVirtualTextureCache::RequestTile(std::uint32_t key)
+    {
+        auto id = GetKeyTexture(key);
+        auto level = GetKeyLevel(key);
+
+        // Ignore corrupted requests
+        if (id >= m_textures.size() || level >= m_textures[id].texture->GetMipLevelCount())
+        {
+            return;
+        }
+
+        auto tiles = m_textures[id].texture->GetMipLevelTileCount(level);
+        auto tile_x = GetKeyTileX(key);
+        auto tile_y = GetKeyTileY(key);
+
+        if (tile_x >= static_cast<std::uint32_t>(tiles.x) || tile_y >= static_cast<std::uint32_t>(tiles.y))
+        {
+            return;
+        }
+
+        auto source = m_textures[id].texture->GetTileSource();
+        auto size = m_textures[id].texture->GetTileSizeInBytes();
+
+        m_pending[key] = m_loader.Submit([source, level, tile_x, tile_y, size]()
+        {
+            std::vector<char> data(size);
+            source->LoadTile(level, tile_x, tile_y, data.data());
+            return data;
+        });
+    }
+
+    std::uint32_t ClwVirtualTextureCache::Update(CLWBuffer<char> texturedata)
+    {
+        if (m_textures.empty())
+        {
+            return 0;
+        }
+
+        // Read requests and clear feedback buffer for next iterations
+        auto feedback_size = TEXTURE_VT_FEEDBACK_SIZE * sizeof(std::uint32_t);
+        m_context.ReadBuffer(0, texturedata, reinterpret_cast<char*>(m_feedback.data()), m_feedback_offset, feedback_size).Wait();
+        m_context.WriteBuffer(0, texturedata, reinterpret_cast<char const*>(m_empty_feedback.data()), m_feedback_offset, feedback_size);
+
+        for (auto key : m_feedback)
+        {
+            if (m_pending.size() >= kMaxPendingTiles)
+            {
+                break;
+            }
+
+            if (key != kInvalidKey && !m_resident.count(key) && !m_pending.count(key))
+            {
+                RequestTile(key);
+            }
+        }
+
+        return UploadTiles(texturedata, kMaxUploadsPerUpdate, false);
+    }
+
+    std::uint32_t ClwVirtualTextureCache::Flush(CLWBuffer<char> texturedata)
+    {
+        return UploadTiles(texturedata, std::numeric_limits<std::uint32_t>::max(), true);
+    }
+
+    std::uint32_t ClwVirtualTextureCache::UploadTiles(CLWBuffer<char> texturedata, std::uint32_t max_uploads, bool wait)
+    {
+        // Writes are asynchronous, so uploaded data is kept alive until they complete
+        std::vector<std::vector<char>> tiles;
+        std::deque<std::int32_t> page_entries;
+        std::vector<CLWEvent> events;
+
+        std::uint32_t num_uploads = 0;
+
+        for (auto iter = m_pending.begin(); iter != m_pending.end() && num_uploads < max_uploads;)
+        {
+            if (!wait && iter->second.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+            {
+                ++iter;
+                continue;
+            }
+
+            auto key = iter->first;
+            auto load = std::move(iter->second);
+            iter = m_pending.erase(iter);
+
+            tiles.push_back(load.get());
+
+            // Take free slot or evict the tile loaded first
+            std::uint32_t slot;
+            if (!m_free_slots.empty())
+            {
+                slot = m_free_slots.back();
+                m_free_slots.pop_back();
+            }
+            else
+            {
+                slot = m_load_order.front();
+                m_load_order.pop_front();
+
+                auto evicted_key = m_slot_keys[slot];
+                m_resident.erase(evicted_key);
+
+                page_entries.push_back(TEXTURE_VT_INVALID);
+                events.push_back(m_context.WriteBuffer(0, texturedata, reinterpret_cast<char const*>(&page_entries.back()),
+                    GetPageOffset(evicted_key), sizeof(std::int32_t)));
+            }
+
+            events.push_back(m_context.WriteBuffer(0, texturedata, tiles.back().data(), GetSlotOffset(slot), tiles.back().size()));
+
+            page_entries.push_back(static_cast<std::int32_t>(GetSlotOffset(slot)));
+            events.push_back(m_context.WriteBuffer(0, texturedata, reinterpret_cast<char const*>(&page_entries.back()),
+                GetPageOffset(key), sizeof(std::int32_t)));
+
+            m_slot_keys[slot] = key;
+            m_resident[key] = slot;
+            m_load_order.push_back(slot);
+            m_bytes_uploaded += tiles.back().size();
+            ++num_uploads;
+        }
+
+        for (auto& event : events)
+        {
+            event.Wait();
+        }
+
+        return num_uploads;
+    }
+}
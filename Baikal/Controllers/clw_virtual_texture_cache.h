@@ -0,0 +1,157 @@
+/**********************************************************************
+ Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ********************************************************************/
+
+
+/**
+ \file clw_virtual_texture_cache.h
+ \author Dmitry Kozlov
+ \version 1.0
+ \brief Contains ClwVirtualTextureCache class declaration.
+ */
+#pragma once
+
+#include "CLW.h"
+
+#include "SceneGraph/clwscene.h"
+#include "SceneGraph/texture.h"
+#include "Utils/thread_pool.h"
+
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+namespace Baikal
+{
+    /**
+     \brief Streams tiles of virtual textures into fixed capacity GPU tile cache.
+
+     Page tables, feedback buffer and tile cache are placed into texture data buffer
+     after resident textures. Kernels write requests for missing tiles into feedback buffer
+     and fall back to coarser resident levels. Update() reads the requests, loads tiles
+     on background threads and uploads loaded tiles replacing least recently loaded ones.
+     Mip levels fitting into a single tile are loaded upfront and never evicted.
+     */
+    class ClwVirtualTextureCache
+    {
+    public:
+        // Minimal number of streamed tiles in addition to pinned ones
+        static std::uint32_t constexpr kMinStreamingTiles = 16;
+        // Maximum number of tiles being loaded at once
+        static std::uint32_t constexpr kMaxPendingTiles = 256;
+        // Maximum number of tiles uploaded by single Update() call
+        static std::uint32_t constexpr kMaxUploadsPerUpdate = 64;
+        // Maximum number of virtual textures, limited by feedback request encoding
+        static std::uint32_t constexpr kMaxTextures = 4095;
+
+        // Constructor, capacity is the size of tile cache in GPU memory
+        ClwVirtualTextureCache(CLWContext context, std::size_t capacity_in_bytes, std::size_t num_loader_threads = 2);
+        // Destructor, waits for tiles being loaded
+        ~ClwVirtualTextureCache() = default;
+
+        // Register virtual texture, should be called before Allocate()
+        void AddTexture(Texture::Ptr texture);
+
+        // Place page tables, feedback buffer and tile cache into texture data buffer
+        // starting at base_offset. Returns size of the region in bytes.
+        std::size_t Allocate(std::size_t base_offset);
+
+        // Fill virtual texture fields of texture header
+        void WriteTexture(Texture const& texture, ClwScene::Texture& clw_texture) const;
+
+        // Write page tables, empty feedback buffer and pinned tiles into mapped texture data
+        void WriteData(char* texturedata);
+
+        // Process tile requests from previous iterations and upload tiles loaded so far.
+        // Returns number of tiles uploaded.
+        std::uint32_t Update(CLWBuffer<char> texturedata);
+
+        // Wait for all requested tiles and upload them. Returns number of tiles uploaded.
+        std::uint32_t Flush(CLWBuffer<char> texturedata);
+
+        // Number of tiles which fit into the cache
+        std::uint32_t GetCapacityInTiles() const { return m_num_slots; }
+        // Number of tiles currently resident, including pinned ones
+        std::uint32_t GetNumResidentTiles() const { return static_cast<std::uint32_t>(m_resident.size()); }
+        // Number of tiles being loaded
+        std::uint32_t GetNumPendingTiles() const { return static_cast<std::uint32_t>(m_pending.size()); }
+        // Total number of tile bytes uploaded after WriteData()
+        std::size_t GetNumBytesUploaded() const { return m_bytes_uploaded; }
+
+        ClwVirtualTextureCache(ClwVirtualTextureCache const&) = delete;
+        ClwVirtualTextureCache& operator = (ClwVirtualTextureCache const&) = delete;
+
+    private:
+        struct VirtualTexture
+        {
+            Texture::Ptr texture;
+            // Byte offset of page table in texture data
+            std::size_t page_table_offset;
+            // Offsets of level page tables in entries
+            std::uint32_t level_offsets[Texture::kMaxMipLevels];
+            std::uint32_t num_pages;
+        };
+
+        // Byte offset of page table entry for the tile
+        std::size_t GetPageOffset(std::uint32_t key) const;
+        // Byte offset of tile cache slot
+        std::size_t GetSlotOffset(std::uint32_t slot) const;
+        // Start loading of the tile on loader threads
+        void RequestTile(std::uint32_t key);
+        // Upload up to max_uploads loaded tiles, optionally waiting for loads in flight
+        std::uint32_t UploadTiles(CLWBuffer<char> texturedata, std::uint32_t max_uploads, bool wait);
+
+        CLWContext m_context;
+        std::size_t m_capacity_in_bytes;
+
+        std::vector<VirtualTexture> m_textures;
+        std::unordered_map<Texture const*, std::uint32_t> m_texture_ids;
+
+        // Layout in texture data buffer
+        std::size_t m_feedback_offset;
+        std::size_t m_tile_pool_offset;
+        std::size_t m_slot_size;
+        std::uint32_t m_num_slots;
+
+        // Key of the tile in each slot
+        std::vector<std::uint32_t> m_slot_keys;
+        // Resident tile key to slot map
+        std::unordered_map<std::uint32_t, std::uint32_t> m_resident;
+        // Streamed slots in load order, front is evicted first
+        std::list<std::uint32_t> m_load_order;
+        std::vector<std::uint32_t> m_free_slots;
+
+        // Tiles being loaded
+        std::unordered_map<std::uint32_t, std::future<std::vector<char>>> m_pending;
+
+        // Host copy of feedback buffer and data to clear it
+        std::vector<std::uint32_t> m_feedback;
+        std::vector<std::uint32_t> m_empty_feedback;
+
+        std::size_t m_bytes_uploaded;
+
+        // Declared last, so loader threads are joined before the rest is destroyed
+        ThreadPool m_loader;
+    };
+}
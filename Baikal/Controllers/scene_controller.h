@@ -34,6 +34,8 @@
 
 #include <memory>
 #include <map>
+#include <unordered_map>
+#include <vector>
 
 namespace Baikal
 {
@@ -56,7 +58,7 @@ namespace Baikal
         // Constructor
         SceneController();
         // Destructor
-        virtual ~SceneController() = default;
+        virtual ~SceneController();
 
         // Given a scene this method produces (or loads from cache) corresponding GPU representation.
         CompiledScene& CompileScene(Scene1::Ptr scene) const;
@@ -72,6 +74,14 @@ namespace Baikal
                            Collector& vol_collector, Collector& input_maps_collector,
                            Collector& input_map_leafs_collector, CompiledScene& out) const;
 
+        // Apply changes recorded in the change log to the current scene without recollecting
+        // objects. Returns false if changes might alter collected sets, nothing is updated then.
+        bool CompileChanges(Scene1 const& scene, CompiledScene& out) const;
+        // Remember objects of the current scene, so the change log can be resolved into objects
+        void TrackObjects(Scene1 const& scene) const;
+        // Check if all direct dependencies of the object have been collected
+        bool HasCollectedDependencies(SceneObject::Ptr object, std::uint32_t kinds) const;
+
         // set dirty flag to false for camera object
         void DropCameraDirty(Scene1 const& scene) const;
         // set dirty flag to false for iterator
@@ -104,6 +114,25 @@ namespace Baikal
 
 
     private:
+        // Kinds of objects tracked by the controller, an object might be of several kinds
+        enum ObjectKind
+        {
+            kShapeObject = 0x1,
+            kLightObject = 0x2,
+            kCameraObject = 0x4,
+            kMaterialObject = 0x8,
+            kVolumeObject = 0x10,
+            kTextureObject = 0x20,
+            kInputMapObject = 0x40,
+            kInputMapLeafObject = 0x80
+        };
+
+        struct TrackedObject
+        {
+            SceneObject::Ptr object;
+            std::uint32_t kinds;
+        };
+
         mutable Scene1::Ptr m_current_scene;
         // Scene cache map (CPU scene -> GPU scene mapping)
         mutable std::map<Scene1::Ptr, CompiledScene> m_scene_cache;
@@ -114,6 +143,11 @@ namespace Baikal
         mutable Collector m_input_maps_collector;
         mutable Collector m_input_map_leafs_collector;
 
+        // Objects of the current scene by id
+        mutable std::unordered_map<std::uint32_t, TrackedObject> m_tracked_objects;
+        // Ids fetched from the change log
+        mutable std::vector<std::uint32_t> m_changes;
+
         // Scene controller id
         std::uint32_t m_id;
     };
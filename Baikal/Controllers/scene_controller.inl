@@ -8,6 +8,7 @@
 #include "SceneGraph/iterator.h"
 #include "SceneGraph/uberv2material.h"
 
+#include <algorithm>
 #include <chrono>
 #include <memory>
 #include <stack>
@@ -24,6 +25,13 @@ namespace Baikal
     SceneController<CompiledScene>::SceneController()
         : m_id(GetNextControllerId())
     {
+        SceneObject::EnableChangeLog(m_id);
+    }
+
+    template <typename CompiledScene>
+    SceneController<CompiledScene>::~SceneController()
+    {
+        SceneObject::DisableChangeLog(m_id);
     }
 
     template <typename CompiledScene>
@@ -53,6 +61,22 @@ namespace Baikal
 
         scene->Acquire(m_id);
 
+        // Objects put their ids into the change log as soon as they are set dirty.
+        // If the scene is the one compiled last time, collectors are still valid
+        // and only changed objects need to be visited.
+        auto changes_complete = SceneObject::FetchChanges(m_id, m_changes);
+
+        if (changes_complete && m_current_scene == scene)
+        {
+            auto& out = m_scene_cache.at(scene);
+
+            if (CompileChanges(*scene, out))
+            {
+                scene->Release();
+                return out;
+            }
+        }
+
         // The overall approach is:
         // 1) Check if materials have changed, update collector if yes
         // 2) Check if textures have changed, update collector if yes
@@ -305,6 +329,12 @@ namespace Baikal
                 material->SetDirty(false);
             });
 
+            m_texture_collector.Finalize([](SceneObject::Ptr item)
+            {
+                auto tex = std::static_pointer_cast<Texture>(item);
+                tex->SetDirty(false);
+            });
+
             m_volume_collector.Finalize([](SceneObject::Ptr item)
             {
                 auto volume = std::static_pointer_cast<VolumeMaterial>(item);
@@ -318,6 +348,8 @@ namespace Baikal
                 input_map->SetDirty(false);
             });
 
+            TrackObjects(*scene);
+
             // Return the scene
             scene->Release();
             return res.first->second;
@@ -415,8 +447,8 @@ namespace Baikal
                 }
 
 
-                // Update lights if needed
-                if (dirty & Scene1::kLights || lights_changed ||
+                // Update lights if needed, area and mesh lights reference shape indices
+                if (dirty & Scene1::kLights || dirty & Scene1::kShapes || lights_changed ||
                     should_update_textures || should_update_materials)
                 {
                     UpdateLights(*scene, m_material_collector, m_texture_collector, out);
@@ -458,6 +490,8 @@ namespace Baikal
                 else if (shapes_changed)
                 {
                     UpdateShapeProperties(*scene, m_material_collector, m_texture_collector, m_volume_collector, out);
+                    shape_iter->Reset();
+                    DropDirty(*shape_iter);
                 }
             }
 
@@ -526,6 +560,8 @@ namespace Baikal
                 input_map->SetDirty(false);
             });
 
+            TrackObjects(*scene);
+
             // Return the scene
             scene->Release();
             return out;
@@ -563,6 +599,280 @@ namespace Baikal
         UpdateSceneAttributes(scene, m_texture_collector, out);
     }
 
+    template <typename CompiledScene>
+    inline
+    bool SceneController<CompiledScene>::CompileChanges(Scene1 const& scene, CompiledScene& out) const
+    {
+        auto dirty = scene.GetDirtyFlags();
+
+        // Nothing has been changed since the last compile
+        if (m_changes.empty() && dirty == Scene1::kNone)
+        {
+            return true;
+        }
+
+        // Attached or detached objects change collected sets
+        if ((dirty != Scene1::kNone && dirty != Scene1::kCamera) || !scene.GetCamera())
+        {
+            return false;
+        }
+
+        // The log keeps an entry per SetDirty call
+        std::sort(m_changes.begin(), m_changes.end());
+        m_changes.erase(std::unique(m_changes.begin(), m_changes.end()), m_changes.end());
+
+        std::uint32_t changed_kinds = 0;
+
+        for (auto id : m_changes)
+        {
+            auto iter = m_tracked_objects.find(id);
+
+            // The object is either not in the scene or not tracked (inner nodes of input maps),
+            // we can't tell if the scene depends on it.
+            if (iter == m_tracked_objects.cend())
+            {
+                return false;
+            }
+
+            // The object references something which has not been collected
+            if (!HasCollectedDependencies(iter->second.object, iter->second.kinds))
+            {
+                return false;
+            }
+
+            changed_kinds |= iter->second.kinds;
+        }
+
+        // Collected sets are still valid (they might keep objects which are not referenced anymore),
+        // so only the parts depending on changed objects are updated.
+        bool camera_changed = (dirty & Scene1::kCamera) || (changed_kinds & kCameraObject);
+        bool materials_changed = (changed_kinds & kMaterialObject) != 0;
+        bool volumes_changed = (changed_kinds & kVolumeObject) != 0;
+        bool textures_changed = (changed_kinds & kTextureObject) != 0;
+        bool leafs_changed = (changed_kinds & kInputMapLeafObject) != 0;
+        // Roots of input maps report changes of their leafs
+        bool input_maps_changed = (changed_kinds & (kInputMapObject | kInputMapLeafObject)) != 0;
+        bool shapes_changed = (changed_kinds & kShapeObject) != 0;
+
+        if (camera_changed)
+        {
+            UpdateCamera(scene, m_material_collector, m_texture_collector, m_volume_collector, out);
+            DropCameraDirty(scene);
+        }
+
+        if (materials_changed)
+        {
+            UpdateMaterials(scene, m_material_collector, m_texture_collector, out);
+        }
+
+        {
+            // Mesh lights are dirty if their shapes are
+            bool lights_changed = false;
+
+            if (changed_kinds & (kLightObject | kShapeObject))
+            {
+                for (auto light_iter = scene.CreateLightIterator(); light_iter->IsValid(); light_iter->Next())
+                {
+                    if (light_iter->ItemAs<Light>()->IsDirty())
+                    {
+                        lights_changed = true;
+                        break;
+                    }
+                }
+            }
+
+            if (lights_changed || textures_changed || materials_changed)
+            {
+                UpdateLights(scene, m_material_collector, m_texture_collector, out);
+                auto light_iter = scene.CreateLightIterator();
+                DropDirty(*light_iter);
+            }
+        }
+
+        if (shapes_changed)
+        {
+            UpdateShapeProperties(scene, m_material_collector, m_texture_collector, m_volume_collector, out);
+        }
+
+        if (textures_changed)
+        {
+            UpdateTextures(scene, m_material_collector, m_texture_collector, out);
+        }
+
+        if (volumes_changed)
+        {
+            UpdateVolumes(scene, m_volume_collector, m_texture_collector, out);
+        }
+
+        if (leafs_changed)
+        {
+            UpdateLeafsData(scene, m_input_map_leafs_collector, m_texture_collector, out);
+        }
+
+        if (input_maps_changed)
+        {
+            UpdateInputMaps(scene, m_input_maps_collector, m_input_map_leafs_collector, out);
+        }
+
+        // Changed objects are the only ones which might be dirty
+        for (auto id : m_changes)
+        {
+            m_tracked_objects[id].object->SetDirty(false);
+        }
+
+        scene.ClearDirtyFlags();
+        return true;
+    }
+
+    template <typename CompiledScene>
+    inline
+    bool SceneController<CompiledScene>::HasCollectedDependencies(SceneObject::Ptr object, std::uint32_t kinds) const
+    {
+        auto all_collected = [](Iterator& iter, Collector const& collector)
+        {
+            for (; iter.IsValid(); iter.Next())
+            {
+                if (!collector.HasItem(iter.Item()))
+                {
+                    return false;
+                }
+            }
+
+            return true;
+        };
+
+        if (kinds & kShapeObject)
+        {
+            auto shape = std::static_pointer_cast<Shape>(object);
+            auto material = shape->GetMaterial();
+
+            if (!m_material_collector.HasItem(material ? material : GetDefaultMaterial()))
+            {
+                return false;
+            }
+
+            auto volume = shape->GetVolumeMaterial();
+
+            if (volume && !m_volume_collector.HasItem(volume))
+            {
+                return false;
+            }
+
+            // Instance might have got a new base shape
+            auto instance = std::dynamic_pointer_cast<Instance>(shape);
+
+            if (instance && !m_tracked_objects.count(instance->GetBaseShape()->GetId()))
+            {
+                return false;
+            }
+        }
+
+        if (kinds & kMaterialObject)
+        {
+            auto material = std::static_pointer_cast<Material>(object);
+
+            if (!all_collected(*material->CreateMaterialIterator(), m_material_collector) ||
+                !all_collected(*material->CreateTextureIterator(), m_texture_collector) ||
+                !all_collected(*material->CreateInputMapsIterator(), m_input_maps_collector) ||
+                !all_collected(*material->CreateInputMapLeafsIterator(), m_input_map_leafs_collector))
+            {
+                return false;
+            }
+        }
+
+        if (kinds & kVolumeObject)
+        {
+            auto volume = std::static_pointer_cast<VolumeMaterial>(object);
+
+            if (!all_collected(*volume->CreateTextureIterator(), m_texture_collector))
+            {
+                return false;
+            }
+        }
+
+        if (kinds & kLightObject)
+        {
+            auto light = std::static_pointer_cast<Light>(object);
+
+            if (!all_collected(*light->CreateTextureIterator(), m_texture_collector))
+            {
+                return false;
+            }
+        }
+
+        if (kinds & (kInputMapObject | kInputMapLeafObject))
+        {
+            auto input_map = std::static_pointer_cast<InputMap>(object);
+
+            std::set<Texture::Ptr> textures;
+            input_map->CollectTextures(textures);
+
+            for (auto const& texture : textures)
+            {
+                if (!m_texture_collector.HasItem(texture))
+                {
+                    return false;
+                }
+            }
+
+            std::set<InputMap::Ptr> leafs;
+            input_map->GetLeafs(leafs);
+
+            for (auto const& leaf : leafs)
+            {
+                if (!m_input_map_leafs_collector.HasItem(leaf))
+                {
+                    return false;
+                }
+            }
+        }
+
+        return true;
+    }
+
+    template <typename CompiledScene>
+    inline
+    void SceneController<CompiledScene>::TrackObjects(Scene1 const& scene) const
+    {
+        m_tracked_objects.clear();
+
+        auto track = [this](SceneObject::Ptr object, std::uint32_t kind)
+        {
+            auto iter = m_tracked_objects.emplace(object->GetId(), TrackedObject{ object, 0u }).first;
+            iter->second.kinds |= kind;
+        };
+
+        auto track_all = [&track](Iterator& iter, std::uint32_t kind)
+        {
+            for (; iter.IsValid(); iter.Next())
+            {
+                track(iter.Item(), kind);
+            }
+        };
+
+        for (auto shape_iter = scene.CreateShapeIterator(); shape_iter->IsValid(); shape_iter->Next())
+        {
+            auto shape = shape_iter->ItemAs<Shape>();
+            track(shape, kShapeObject);
+
+            // Base shapes of instances are uploaded even if they are not in the scene
+            auto instance = std::dynamic_pointer_cast<Instance>(shape);
+
+            if (instance)
+            {
+                track(instance->GetBaseShape(), kShapeObject);
+            }
+        }
+
+        track_all(*scene.CreateLightIterator(), kLightObject);
+        track(scene.GetCamera(), kCameraObject);
+        track_all(*m_material_collector.CreateIterator(), kMaterialObject);
+        track_all(*m_volume_collector.CreateIterator(), kVolumeObject);
+        track_all(*m_texture_collector.CreateIterator(), kTextureObject);
+        track_all(*m_input_maps_collector.CreateIterator(), kInputMapObject);
+        track_all(*m_input_map_leafs_collector.CreateIterator(), kInputMapLeafObject);
+    }
+
     template <typename CompiledScene>
     inline
     void SceneController<CompiledScene>::DropCameraDirty(Scene1 const& scene) const
@@ -78,6 +78,8 @@ namespace Baikal
             : m_intersector(api)
             , m_max_bounces(5u)
             , m_max_shadow_ray_transmission_steps(2u)
+            , m_material_sorting(false)
+            , m_path_regeneration(false)
         {
         }
 
@@ -289,6 +291,47 @@ namespace Baikal
             return m_max_shadow_ray_transmission_steps;
         }
 
+        /**
+        \brief Enable sorting of hits by material before shading.
+
+        Estimators supporting it group hits into queues of the same material layers
+        and shade each queue with a kernel specialized for these layers. This reduces
+        divergence in scenes with many different materials at the cost of sorting.
+
+        \param enable
+        */
+        void SetMaterialSorting(bool enable) {
+            m_material_sorting = enable;
+        }
+
+        /**
+        \brief Check if sorting of hits by material is enabled.
+        */
+        bool GetMaterialSorting() const {
+            return m_material_sorting;
+        }
+
+        /**
+        \brief Enable restarting of terminated paths between bounces.
+
+        Estimators supporting it refill slots of terminated paths with new camera samples
+        of the same pixels, so the batch stays full for all bounces. A single estimate then
+        adds several samples into a pixel (output w counts them), so clients relying on a
+        single sample per pixel and estimate should leave it disabled.
+
+        \param enable
+        */
+        void SetPathRegeneration(bool enable) {
+            m_path_regeneration = enable;
+        }
+
+        /**
+        \brief Check if restarting of terminated paths is enabled.
+        */
+        bool GetPathRegeneration() const {
+            return m_path_regeneration;
+        }
+
         Estimator(Estimator const&) = delete;
         Estimator& operator = (Estimator const&) = delete;
 
@@ -296,6 +339,8 @@ namespace Baikal
         std::shared_ptr<RadeonRays::IntersectionApi> m_intersector;
         std::uint32_t m_max_bounces;
         std::uint32_t m_max_shadow_ray_transmission_steps;
+        bool m_material_sorting;
+        bool m_path_regeneration;
         std::array<CLWBuffer<float3>, 
             static_cast<size_t>(IntermediateValue::kMax)> m_intermediate_value;
     };
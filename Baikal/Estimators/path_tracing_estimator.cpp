@@ -7,6 +7,9 @@
 #include <cstdint>
 #include <random>
 #include <algorithm>
+#include <string>
+#include <utility>
+#include <vector>
 
 #include "Utils/sobol.h"
 
@@ -16,13 +19,19 @@
 
 namespace Baikal
 {
+    // Max number of specialized shading queues, hits of scenes with more
+    // distinct material layer masks are shaded unsorted
+    static std::size_t const kMaxMaterialQueues = 32;
+
     struct PathTracingEstimator::PathState
     {
         float4 throughput;
         int volume;
         int flags;
         int extra0;
-        int extra1;
+        float cone_spread;
+        int start_pass;
+        int padding[3];
     };
 
     struct PathTracingEstimator::RenderData
@@ -47,6 +56,27 @@ namespace Baikal
         CLWBuffer<int> hitcount;
         CLWParallelPrimitives pp;
 
+        // Material queues
+        CLWBuffer<int> queues;
+        CLWBuffer<int> sorted_indices;
+        CLWBuffer<int> sorted_pixelindices;
+        CLWBuffer<int> queue_layers;
+        CLWBuffer<int> queue_counts;
+        CLWBuffer<int> queue_offsets;
+        // Layer masks currently residing in queue_layers
+        std::vector<std::uint32_t> uploaded_queue_layers;
+
+        // Path regeneration
+        CLWBuffer<ray> camera_rays;
+        CLWBuffer<int> regen_pixels;
+        CLWBuffer<int> regen_candidate_count;
+        CLWBuffer<int> regen_count;
+        CLWBuffer<int> has_ray;
+
+        // Ray counts read back after each pass
+        std::vector<int> ray_counts;
+        std::vector<CLWEvent> ray_count_events;
+
         // RadeonRays stuff
         Buffer* fr_rays[2];
         Buffer* fr_shadowrays;
@@ -92,10 +122,21 @@ namespace Baikal
         // Create parallel primitives
         m_render_data->pp = CLWParallelPrimitives(context, GetFullBuildOpts().c_str());
         m_render_data->sobolmat = context.CreateBuffer<unsigned int>(1024 * 52, CL_MEM_READ_ONLY, &g_SobolMatrices[0]);
+
+        // Extra queue holds hits with layers missing in the scene list
+        m_render_data->queue_layers = context.CreateBuffer<int>(kMaxMaterialQueues, CL_MEM_READ_ONLY);
+        m_render_data->queue_counts = context.CreateBuffer<int>(kMaxMaterialQueues + 1, CL_MEM_READ_WRITE);
+        m_render_data->queue_offsets = context.CreateBuffer<int>(kMaxMaterialQueues + 2, CL_MEM_READ_WRITE);
     }
 
     PathTracingEstimator::~PathTracingEstimator()
     {
+        // Ray count reads write into host memory
+        for (auto& e : m_render_data->ray_count_events)
+        {
+            e.Wait();
+        }
+
         // Recreate FR buffers
         GetIntersector()->DeleteBuffer(m_render_data->fr_rays[0]);
         GetIntersector()->DeleteBuffer(m_render_data->fr_rays[1]);
@@ -136,6 +177,14 @@ namespace Baikal
         m_render_data->pixelindices[1] = GetContext().CreateBuffer<int>(size, CL_MEM_READ_WRITE);
         m_render_data->output_indices = GetContext().CreateBuffer<int>(size, CL_MEM_READ_WRITE);
         m_render_data->hitcount = GetContext().CreateBuffer<int>(1, CL_MEM_READ_WRITE);
+        m_render_data->queues = GetContext().CreateBuffer<int>(size, CL_MEM_READ_WRITE);
+        m_render_data->sorted_indices = GetContext().CreateBuffer<int>(size, CL_MEM_READ_WRITE);
+        m_render_data->sorted_pixelindices = GetContext().CreateBuffer<int>(size, CL_MEM_READ_WRITE);
+
+        // Regeneration buffers are allocated on first use
+        m_render_data->camera_rays = CLWBuffer<ray>();
+        m_render_data->regen_pixels = CLWBuffer<int>();
+        m_render_data->has_ray = CLWBuffer<int>();
 
         // Recreate FR buffers
         GetIntersector()->DeleteBuffer(m_render_data->fr_rays[0]);
@@ -192,14 +241,74 @@ namespace Baikal
         auto has_opacity_buffer = HasIntermediateValueBuffer(IntermediateValue::kOpacity);
         auto opacity_buffer = GetIntermediateValueBuffer(IntermediateValue::kOpacity);
 
+        auto& profiler = GetProfiler();
+        bool const profiling = profiler.IsEnabled();
+
+        // Rays traced in the first pass, clients might set less of them than num_estimates
+        int num_primary_rays = static_cast<int>(num_estimates);
+        if (profiling)
+        {
+            GetContext().ReadBuffer(0, m_render_data->hitcount, &num_primary_rays, 1).Wait();
+        }
+
         InitPathData(num_estimates, scene.camera_volume_index);
 
         GetContext().CopyBuffer(0u, m_render_data->iota, m_render_data->pixelindices[0], 0, 0, num_estimates);
         GetContext().CopyBuffer(0u, m_render_data->iota, m_render_data->pixelindices[1], 0, 0, num_estimates);
 
+        // Opacity is gathered once per path at the end of the estimate, so it needs a single path per pixel
+        bool regenerate_paths = GetPathRegeneration() && !has_opacity_buffer;
+
+        // Regenerated paths are started till the pass of max bounce, the rest of passes completes them
+        auto num_passes = regenerate_paths ? 2 * GetMaxBounces() : GetMaxBounces();
+
+        if (regenerate_paths)
+        {
+            PrepareRegeneration(num_estimates);
+        }
+
+        // Ray counts are read back asynchronously, so launches of the pass are
+        // sized by the latest count which has already arrived. Without regeneration
+        // the counts are only needed for profiling.
+        bool const read_ray_counts = regenerate_paths || profiling;
+
+        for (auto& e : m_render_data->ray_count_events)
+        {
+            e.Wait();
+        }
+
+        m_render_data->ray_count_events.clear();
+        m_render_data->ray_counts.resize(num_passes);
+
+        auto size = num_estimates;
+        auto last_regeneration = 0u;
+        auto num_traced_passes = 0u;
+
         // Initialize first pass
-        for (auto pass = 0u; pass < GetMaxBounces(); ++pass)
+        for (auto pass = 0u; pass < num_passes; ++pass)
         {
+            if (pass > 0 && read_ray_counts)
+            {
+                // Count after regeneration is the bound for the following passes
+                for (auto i = pass; i-- > last_regeneration;)
+                {
+                    if (m_render_data->ray_count_events[i].GetCommandExecutionStatus() == CL_COMPLETE)
+                    {
+                        size = std::min(size, static_cast<std::size_t>(std::max(m_render_data->ray_counts[i], 0)));
+                        break;
+                    }
+                }
+
+                // All paths have terminated
+                if (size == 0)
+                {
+                    break;
+                }
+            }
+
+            profiler.SetPass(static_cast<int>(pass));
+            ++num_traced_passes;
+
             // Clear ray hits buffer
             // TODO: make it a kernel
             GetContext().FillBuffer(
@@ -210,13 +319,16 @@ namespace Baikal
             );
 
             // Intersect ray batch
-            GetIntersector()->QueryIntersection(
-                m_render_data->fr_rays[pass & 0x1],
-                m_render_data->fr_hitcount, (std::uint32_t)num_estimates,
-                m_render_data->fr_intersections,
-                nullptr,
-                nullptr
-            );
+            {
+                ClwProfiler::Section section(profiler, GetContext(), "QueryIntersection");
+                GetIntersector()->QueryIntersection(
+                    m_render_data->fr_rays[pass & 0x1],
+                    m_render_data->fr_hitcount, (std::uint32_t)size,
+                    m_render_data->fr_intersections,
+                    nullptr,
+                    nullptr
+                );
+            }
 
 
             // Apply scattering only if we have volumes
@@ -224,23 +336,23 @@ namespace Baikal
 
             if (has_some_volume)
             {
-                SampleVolume(scene, pass, num_estimates, output, use_output_indices);
+                SampleVolume(scene, pass, size, output, use_output_indices);
             }
 
             bool has_some_environment = scene.envmapidx > -1;
 
             if ((pass > 0) && has_some_environment)
             {
-                ShadeMiss(scene, pass, num_estimates, output, use_output_indices);
+                ShadeMiss(scene, pass, size, output, use_output_indices);
             }
 
             // Convert intersections to predicates
-            FilterPathStream(pass, num_estimates);
+            FilterPathStream(pass, size);
             
             // Gather opacity if we have opacity buffer
             if ((pass > 0) && has_opacity_buffer)
             {
-                GatherOpacity(scene, pass, num_estimates, opacity_buffer, use_output_indices);
+                GatherOpacity(scene, pass, size, opacity_buffer, use_output_indices);
             }
 
             // Compact batch
@@ -249,12 +361,12 @@ namespace Baikal
                 m_render_data->hits,
                 m_render_data->iota,
                 m_render_data->compacted_indices,
-                (std::uint32_t)num_estimates,
+                (std::uint32_t)size,
                 m_render_data->hitcount
             );
 
             // Advance indices to keep pixel indices up to date
-            RestorePixelIndices(pass, num_estimates);
+            RestorePixelIndices(pass, size);
 
             // Shade missing rays
             if (pass == 0)
@@ -270,16 +382,26 @@ namespace Baikal
                     ShadeBackground(scene, 0, num_estimates, output, use_output_indices);
                 else
                     AdvanceIterationCount(0, num_estimates, output, use_output_indices);
+
+                if (regenerate_paths)
+                {
+                    // Pixels with primary hits are the ones to be restarted
+                    GetContext().CopyBuffer(0u, m_render_data->pixelindices[0], m_render_data->regen_pixels, 0, 0, num_estimates);
+                    GetContext().CopyBuffer(0u, m_render_data->hitcount, m_render_data->regen_candidate_count, 0, 0, 1);
+                }
             }
 
+            // Group hits by material to reduce divergence of shading
+            bool sorted_by_material = GetMaterialSorting() && SortHitsByMaterial(scene, pass, size);
+
             if (has_some_volume)
             {
                 // Shade hits
-                ShadeVolume(scene, pass, num_estimates, output, use_output_indices);
+                ShadeVolume(scene, pass, size, output, use_output_indices);
             }
 
             // Shade hits
-            ShadeSurface(scene, pass, num_estimates, output, use_output_indices);
+            ShadeSurface(scene, pass, size, output, use_output_indices, sorted_by_material);
 
 
             if (has_some_volume && GetMaxShadowRayTransmissionSteps() > 0)
@@ -287,44 +409,86 @@ namespace Baikal
                 for (auto i = 0u; i < GetMaxShadowRayTransmissionSteps(); ++i)
                 {
                     // Intersect ray batch
-                    GetIntersector()->QueryIntersection(m_render_data->fr_shadowrays,
-                                                        m_render_data->fr_hitcount,
-                                                        (std::uint32_t)num_estimates,
-                                                        m_render_data->fr_intersections,
-                                                        nullptr,
-                                                        nullptr);
-
-                    ApplyVolumeTransmission(scene, pass, num_estimates, output, use_output_indices);
+                    {
+                        ClwProfiler::Section section(profiler, GetContext(), "QueryShadowIntersection");
+                        GetIntersector()->QueryIntersection(m_render_data->fr_shadowrays,
+                                                            m_render_data->fr_hitcount,
+                                                            (std::uint32_t)size,
+                                                            m_render_data->fr_intersections,
+                                                            nullptr,
+                                                            nullptr);
+                    }
+
+                    ApplyVolumeTransmission(scene, pass, size, output, use_output_indices);
                 }
             }
 
             // Intersect shadow rays
-            GetIntersector()->QueryOcclusion(
-                m_render_data->fr_shadowrays,
-                m_render_data->fr_hitcount,
-                (std::uint32_t)num_estimates,
-                m_render_data->fr_shadowhits,
-                nullptr,
-                nullptr
-            );
+            {
+                ClwProfiler::Section section(profiler, GetContext(), "QueryOcclusion");
+                GetIntersector()->QueryOcclusion(
+                    m_render_data->fr_shadowrays,
+                    m_render_data->fr_hitcount,
+                    (std::uint32_t)size,
+                    m_render_data->fr_shadowhits,
+                    nullptr,
+                    nullptr
+                );
+            }
 
             // Gather light samples and account for visibility
-            GatherLightSamples(scene, pass, num_estimates, output, use_output_indices);
+            GatherLightSamples(scene, pass, size, output, use_output_indices);
 
             if (pass == 0 && has_visibility_buffer)
             {
                 // Run visibility resolve kernel
-                GatherVisibility(scene, pass, num_estimates, visibility_buffer, use_output_indices);
+                GatherVisibility(scene, pass, size, visibility_buffer, use_output_indices);
+            }
+
+            if (regenerate_paths && pass + 1 < num_passes)
+            {
+                bool restart = pass < GetMaxBounces();
+                RegeneratePaths(scene, pass, size, num_estimates, restart, output, use_output_indices);
+
+                if (restart)
+                {
+                    size = num_estimates;
+                    last_regeneration = pass;
+                }
+            }
+
+            if (read_ray_counts)
+            {
+                m_render_data->ray_count_events.push_back(
+                    GetContext().ReadBuffer(0, m_render_data->hitcount, &m_render_data->ray_counts[pass], 1));
             }
 
             GetContext().Flush(0);
         }
+
+        profiler.SetPass(-1);
+
+        if (profiling)
+        {
+            // Rays of a pass are the ones left after the previous pass
+            for (auto pass = 0u; pass < num_traced_passes; ++pass)
+            {
+                if (pass > 0)
+                {
+                    m_render_data->ray_count_events[pass - 1].Wait();
+                }
+
+                auto num_rays = pass > 0 ? m_render_data->ray_counts[pass - 1] : num_primary_rays;
+                profiler.RecordRayCount(static_cast<int>(pass), static_cast<std::uint64_t>(std::max(num_rays, 0)));
+            }
+        }
+
         // Gather opacity if we have opacity buffer
         if (has_opacity_buffer)
         {
             // Convert intersections to predicates
-            FilterPathStream(GetMaxBounces(), num_estimates);
-            GatherOpacity(scene, GetMaxBounces(), num_estimates, opacity_buffer, use_output_indices);
+            FilterPathStream(GetMaxBounces(), size);
+            GatherOpacity(scene, GetMaxBounces(), size, opacity_buffer, use_output_indices);
             GetContext().Flush(0);
         }
         ++m_sample_counter;
@@ -342,60 +506,298 @@ namespace Baikal
         init_kernel.SetArg(argc++, m_render_data->paths);
 
         {
-            GetContext().Launch1D(0, ((size + 63) / 64) * 64, 64, init_kernel);
+            Launch1D(((size + 63) / 64) * 64, 64, init_kernel);
         }
     }
 
-    void PathTracingEstimator::ShadeSurface(
+    void PathTracingEstimator::PrepareRegeneration(std::size_t size)
+    {
+        if (m_render_data->camera_rays.GetElementCount() < size)
+        {
+            auto buffer_size = m_render_data->rays[0].GetElementCount();
+            m_render_data->camera_rays = GetContext().CreateBuffer<ray>(buffer_size, CL_MEM_READ_WRITE);
+            m_render_data->regen_pixels = GetContext().CreateBuffer<int>(buffer_size, CL_MEM_READ_WRITE);
+            m_render_data->has_ray = GetContext().CreateBuffer<int>(buffer_size, CL_MEM_READ_WRITE);
+        }
+
+        if (m_render_data->regen_count.GetElementCount() == 0)
+        {
+            m_render_data->regen_candidate_count = GetContext().CreateBuffer<int>(1, CL_MEM_READ_WRITE);
+            m_render_data->regen_count = GetContext().CreateBuffer<int>(1, CL_MEM_READ_WRITE);
+        }
+
+        // Camera rays are overwritten by extension rays of the second pass
+        GetContext().CopyBuffer(0u, m_render_data->rays[0], m_render_data->camera_rays, 0, 0, size);
+    }
+
+    void PathTracingEstimator::RegeneratePaths(
         ClwScene const& scene,
         int pass,
         std::size_t size,
+        std::size_t num_estimates,
+        bool restart,
         CLWBuffer<RadeonRays::float3> output,
         bool use_output_indices
     )
     {
-        // Fetch kernel
-        auto shadekernel = m_uberv2_kernels.GetKernel("ShadeSurfaceUberV2");
+        auto output_indices = use_output_indices ? m_render_data->output_indices : m_render_data->iota;
+        auto next_rays = m_render_data->rays[(pass + 1) & 0x1];
+        auto max_bounces = static_cast<int>(GetMaxBounces());
+        auto max_rays = static_cast<int>(num_estimates);
+
+        if (restart)
+        {
+            GetContext().FillBuffer(0, m_render_data->has_ray, 0, num_estimates);
+        }
+
+        // Terminate paths at max bounce and restart dead ones in place
+        {
+            auto restartkernel = GetKernel("TerminateAndRestartPaths");
+
+            int argc = 0;
+            restartkernel.SetArg(argc++, m_render_data->camera_rays);
+            restartkernel.SetArg(argc++, m_render_data->pixelindices[pass & 0x1]);
+            restartkernel.SetArg(argc++, output_indices);
+            restartkernel.SetArg(argc++, m_render_data->hitcount);
+            restartkernel.SetArg(argc++, pass);
+            restartkernel.SetArg(argc++, max_bounces);
+            restartkernel.SetArg(argc++, restart ? 1 : 0);
+            restartkernel.SetArg(argc++, scene.camera_volume_index);
+            restartkernel.SetArg(argc++, m_render_data->paths);
+            restartkernel.SetArg(argc++, next_rays);
+            restartkernel.SetArg(argc++, m_render_data->has_ray);
+            restartkernel.SetArg(argc++, output);
+
+            Launch1D(((size + 63) / 64) * 64, 64, restartkernel);
+        }
+
+        if (!restart)
+        {
+            return;
+        }
+
+        // Find pixels which have no slot in the batch
+        {
+            auto filterkernel = GetKernel("FilterPathsToRegenerate");
+
+            int argc = 0;
+            filterkernel.SetArg(argc++, m_render_data->regen_pixels);
+            filterkernel.SetArg(argc++, m_render_data->regen_candidate_count);
+            filterkernel.SetArg(argc++, m_render_data->has_ray);
+            filterkernel.SetArg(argc++, max_rays);
+            filterkernel.SetArg(argc++, m_render_data->hits);
 
+            Launch1D(((num_estimates + 63) / 64) * 64, 64, filterkernel);
+        }
+
+        m_render_data->pp.Compact(
+            0,
+            m_render_data->hits,
+            m_render_data->iota,
+            m_render_data->compacted_indices,
+            (std::uint32_t)num_estimates,
+            m_render_data->regen_count
+        );
+
+        // Append them after the slots of the batch
+        {
+            auto appendkernel = GetKernel("AppendRegeneratedPaths");
+
+            int argc = 0;
+            appendkernel.SetArg(argc++, m_render_data->camera_rays);
+            appendkernel.SetArg(argc++, m_render_data->regen_pixels);
+            appendkernel.SetArg(argc++, m_render_data->compacted_indices);
+            appendkernel.SetArg(argc++, m_render_data->regen_count);
+            appendkernel.SetArg(argc++, output_indices);
+            appendkernel.SetArg(argc++, m_render_data->hitcount);
+            appendkernel.SetArg(argc++, max_rays);
+            appendkernel.SetArg(argc++, pass);
+            appendkernel.SetArg(argc++, scene.camera_volume_index);
+            appendkernel.SetArg(argc++, m_render_data->paths);
+            appendkernel.SetArg(argc++, m_render_data->pixelindices[pass & 0x1]);
+            appendkernel.SetArg(argc++, next_rays);
+            appendkernel.SetArg(argc++, output);
+
+            Launch1D(((num_estimates + 63) / 64) * 64, 64, appendkernel);
+        }
+
+        {
+            auto addkernel = GetKernel("AddRegeneratedRays");
+
+            int argc = 0;
+            addkernel.SetArg(argc++, m_render_data->regen_count);
+            addkernel.SetArg(argc++, max_rays);
+            addkernel.SetArg(argc++, m_render_data->hitcount);
+
+            Launch1D(1, 1, addkernel);
+        }
+    }
+
+    void PathTracingEstimator::ShadeSurface(
+        ClwScene const& scene,
+        int pass,
+        std::size_t size,
+        CLWBuffer<RadeonRays::float3> output,
+        bool use_output_indices,
+        bool sorted_by_material
+    )
+    {
         auto output_indices = use_output_indices ? m_render_data->output_indices : m_render_data->iota;
 
-        // Set kernel parameters
-        int argc = 0;
-        shadekernel.SetArg(argc++, m_render_data->rays[pass & 0x1]);
-        shadekernel.SetArg(argc++, m_render_data->intersections);
-        shadekernel.SetArg(argc++, m_render_data->compacted_indices);
-        shadekernel.SetArg(argc++, m_render_data->pixelindices[pass & 0x1]);
-        shadekernel.SetArg(argc++, output_indices);
-        shadekernel.SetArg(argc++, m_render_data->hitcount);
-        shadekernel.SetArg(argc++, scene.vertices);
-        shadekernel.SetArg(argc++, scene.normals);
-        shadekernel.SetArg(argc++, scene.uvs);
-        shadekernel.SetArg(argc++, scene.indices);
-        shadekernel.SetArg(argc++, scene.shapes);
-        shadekernel.SetArg(argc++, scene.material_attributes);
-        shadekernel.SetArg(argc++, scene.textures);
-        shadekernel.SetArg(argc++, scene.texturedata);
-        shadekernel.SetArg(argc++, scene.envmapidx);
-        shadekernel.SetArg(argc++, scene.lights);
-        shadekernel.SetArg(argc++, scene.light_distributions);
-        shadekernel.SetArg(argc++, scene.num_lights);
-        shadekernel.SetArg(argc++, rand_uint());
-        shadekernel.SetArg(argc++, m_render_data->random);
-        shadekernel.SetArg(argc++, m_render_data->sobolmat);
-        shadekernel.SetArg(argc++, pass);
-        shadekernel.SetArg(argc++, m_sample_counter);
-        shadekernel.SetArg(argc++, scene.volumes);
-        shadekernel.SetArg(argc++, m_render_data->shadowrays);
-        shadekernel.SetArg(argc++, m_render_data->lightsamples);
-        shadekernel.SetArg(argc++, m_render_data->paths);
-        shadekernel.SetArg(argc++, m_render_data->rays[(pass + 1) & 0x1]);
-        shadekernel.SetArg(argc++, output);
-        shadekernel.SetArg(argc++, scene.input_map_data);
+        // Same seed for all queues, so sorting doesn't affect sampling
+        auto rng_seed = rand_uint();
 
-        // Run shading kernel
+        auto const& layers = scene.material_layers;
+        auto num_queues = static_cast<int>(layers.size());
+
+        // Unsorted hits are shaded by a single launch (queue -1). Sorted ones are shaded
+        // queue by queue, the last queue holds hits with unknown layers.
+        int first_queue = sorted_by_material ? 0 : -1;
+        int last_queue = sorted_by_material ? num_queues : -1;
+
+        for (auto queue = first_queue; queue <= last_queue; ++queue)
+        {
+            // Fetch kernel specialized for material layers if they are known
+            std::int32_t queue_layers = -1;
+
+            if (queue >= 0 && queue < num_queues)
+            {
+                queue_layers = static_cast<std::int32_t>(layers[queue]);
+            }
+            else if (queue == -1 && GetMaterialSorting() && num_queues == 1)
+            {
+                // All hits share layers, no need to sort them
+                queue_layers = static_cast<std::int32_t>(layers[0]);
+            }
+
+            auto shadekernel = queue_layers < 0 ?
+                m_uberv2_kernels.GetKernel("ShadeSurfaceUberV2") :
+                m_uberv2_kernels.GetKernel("ShadeSurfaceUberV2",
+                    m_uberv2_kernels.GetDefaultBuildOpts() + " -D UBERV2_LAYERS=" + std::to_string(queue_layers));
+
+            // Set kernel parameters
+            int argc = 0;
+            shadekernel.SetArg(argc++, m_render_data->rays[pass & 0x1]);
+            shadekernel.SetArg(argc++, m_render_data->intersections);
+            shadekernel.SetArg(argc++, m_render_data->compacted_indices);
+            shadekernel.SetArg(argc++, m_render_data->pixelindices[pass & 0x1]);
+            shadekernel.SetArg(argc++, output_indices);
+            shadekernel.SetArg(argc++, m_render_data->hitcount);
+            shadekernel.SetArg(argc++, m_render_data->queue_offsets);
+            shadekernel.SetArg(argc++, queue);
+            shadekernel.SetArg(argc++, scene.vertices);
+            shadekernel.SetArg(argc++, scene.normals);
+            shadekernel.SetArg(argc++, scene.uvs);
+            shadekernel.SetArg(argc++, scene.indices);
+            shadekernel.SetArg(argc++, scene.shapes);
+            shadekernel.SetArg(argc++, scene.material_attributes);
+            shadekernel.SetArg(argc++, scene.textures);
+            shadekernel.SetArg(argc++, scene.texturedata);
+            shadekernel.SetArg(argc++, scene.envmapidx);
+            shadekernel.SetArg(argc++, scene.lights);
+            shadekernel.SetArg(argc++, scene.light_distributions);
+            shadekernel.SetArg(argc++, scene.light_bvh);
+            shadekernel.SetArg(argc++, scene.emissive_lights);
+            shadekernel.SetArg(argc++, scene.num_lights);
+            shadekernel.SetArg(argc++, rng_seed);
+            shadekernel.SetArg(argc++, m_render_data->random);
+            shadekernel.SetArg(argc++, m_render_data->sobolmat);
+            shadekernel.SetArg(argc++, pass);
+            shadekernel.SetArg(argc++, m_sample_counter);
+            shadekernel.SetArg(argc++, scene.volumes);
+            shadekernel.SetArg(argc++, m_render_data->shadowrays);
+            shadekernel.SetArg(argc++, m_render_data->lightsamples);
+            shadekernel.SetArg(argc++, m_render_data->paths);
+            shadekernel.SetArg(argc++, m_render_data->rays[(pass + 1) & 0x1]);
+            shadekernel.SetArg(argc++, output);
+            shadekernel.SetArg(argc++, scene.input_map_data);
+
+            // Run shading kernel. Queue sizes live on the device, so each
+            // launch covers the whole batch and threads outside the queue exit early.
+            {
+                Launch1D(((size + 63) / 64) * 64, 64, shadekernel);
+            }
+        }
+    }
+
+    bool PathTracingEstimator::SortHitsByMaterial(
+        ClwScene const& scene,
+        int pass,
+        std::size_t size
+    )
+    {
+        auto const& layers = scene.material_layers;
+
+        // Sorting pays off only if there are several materials
+        // and each of them gets its own queue
+        if (layers.size() < 2 || layers.size() > kMaxMaterialQueues)
+        {
+            return false;
+        }
+
+        auto num_queues = static_cast<int>(layers.size());
+
+        if (layers != m_render_data->uploaded_queue_layers)
+        {
+            std::vector<std::int32_t> layer_data(layers.cbegin(), layers.cend());
+            GetContext().WriteBuffer(0, m_render_data->queue_layers, layer_data.data(), 0, layer_data.size()).Wait();
+            m_render_data->uploaded_queue_layers = layers;
+        }
+
+        GetContext().FillBuffer(0, m_render_data->queue_counts, 0, num_queues + 1);
+
+        // Find queue of each hit
+        {
+            auto binkernel = GetKernel("BinHitsByMaterial");
+
+            int argc = 0;
+            binkernel.SetArg(argc++, m_render_data->intersections);
+            binkernel.SetArg(argc++, m_render_data->compacted_indices);
+            binkernel.SetArg(argc++, m_render_data->hitcount);
+            binkernel.SetArg(argc++, scene.shapes);
+            binkernel.SetArg(argc++, m_render_data->queue_layers);
+            binkernel.SetArg(argc++, num_queues);
+            binkernel.SetArg(argc++, m_render_data->queues);
+            binkernel.SetArg(argc++, m_render_data->queue_counts);
+
+            Launch1D(((size + 63) / 64) * 64, 64, binkernel);
+        }
+
+        // Calculate queue offsets
+        {
+            auto scankernel = GetKernel("ScanMaterialQueues");
+
+            int argc = 0;
+            scankernel.SetArg(argc++, m_render_data->queue_counts);
+            scankernel.SetArg(argc++, num_queues + 1);
+            scankernel.SetArg(argc++, m_render_data->queue_offsets);
+
+            Launch1D(1, 1, scankernel);
+        }
+
+        // Move hits into queues
         {
-            GetContext().Launch1D(0, ((size + 63) / 64) * 64, 64, shadekernel);
+            auto scatterkernel = GetKernel("ScatterHitsByMaterial");
+
+            int argc = 0;
+            scatterkernel.SetArg(argc++, m_render_data->compacted_indices);
+            scatterkernel.SetArg(argc++, m_render_data->pixelindices[pass & 0x1]);
+            scatterkernel.SetArg(argc++, m_render_data->hitcount);
+            scatterkernel.SetArg(argc++, m_render_data->queues);
+            scatterkernel.SetArg(argc++, m_render_data->queue_offsets);
+            scatterkernel.SetArg(argc++, m_render_data->queue_counts);
+            scatterkernel.SetArg(argc++, m_render_data->sorted_indices);
+            scatterkernel.SetArg(argc++, m_render_data->sorted_pixelindices);
+
+            Launch1D(((size + 63) / 64) * 64, 64, scatterkernel);
         }
+
+        // Hit and pixel indices are permuted together, so all
+        // following kernels see consistent hit -> pixel mapping
+        std::swap(m_render_data->compacted_indices, m_render_data->sorted_indices);
+        std::swap(m_render_data->pixelindices[pass & 0x1], m_render_data->sorted_pixelindices);
+
+        return true;
     }
 
     void PathTracingEstimator::ShadeVolume(
@@ -430,6 +832,8 @@ namespace Baikal
         shadekernel.SetArg(argc++, scene.envmapidx);
         shadekernel.SetArg(argc++, scene.lights);
         shadekernel.SetArg(argc++, scene.light_distributions);
+        shadekernel.SetArg(argc++, scene.light_bvh);
+        shadekernel.SetArg(argc++, scene.emissive_lights);
         shadekernel.SetArg(argc++, scene.num_lights);
         shadekernel.SetArg(argc++, rand_uint());
         shadekernel.SetArg(argc++, m_render_data->random);
@@ -446,7 +850,7 @@ namespace Baikal
 
         // Run shading kernel
         {
-            GetContext().Launch1D(0, ((size + 63) / 64) * 64, 64, shadekernel);
+            Launch1D(((size + 63) / 64) * 64, 64, shadekernel);
         }
     }
 
@@ -470,6 +874,8 @@ namespace Baikal
         sample_kernel.SetArg(argc++, output_indices);
         sample_kernel.SetArg(argc++, m_render_data->hitcount);
         sample_kernel.SetArg(argc++, scene.volumes);
+        sample_kernel.SetArg(argc++, scene.volume_grids);
+        sample_kernel.SetArg(argc++, scene.volume_data);
         sample_kernel.SetArg(argc++, scene.textures);
         sample_kernel.SetArg(argc++, scene.texturedata);
         sample_kernel.SetArg(argc++, rand_uint());
@@ -483,7 +889,7 @@ namespace Baikal
 
         // Run shading kernel
         {
-            GetContext().Launch1D(0, ((size + 63) / 64) * 64, 64, sample_kernel);
+            Launch1D(((size + 63) / 64) * 64, 64, sample_kernel);
         }
     }
 
@@ -516,7 +922,7 @@ namespace Baikal
         misskernel.SetArg(argc++, output);
 
         {
-            GetContext().Launch1D(0, ((size + 63) / 64) * 64, 64, misskernel);
+            Launch1D(((size + 63) / 64) * 64, 64, misskernel);
         }
     }
 
@@ -545,7 +951,7 @@ namespace Baikal
 
         // Run shading kernel
         {
-            GetContext().Launch1D(0, ((size + 63) / 64) * 64, 64, gatherkernel);
+            Launch1D(((size + 63) / 64) * 64, 64, gatherkernel);
         }
     }
 
@@ -577,6 +983,9 @@ namespace Baikal
         volumekernel.SetArg(argc++, scene.shapes);
         volumekernel.SetArg(argc++, scene.material_attributes);
         volumekernel.SetArg(argc++, scene.volumes);
+        volumekernel.SetArg(argc++, scene.volume_grids);
+        volumekernel.SetArg(argc++, scene.volume_data);
+        volumekernel.SetArg(argc++, rand_uint());
         volumekernel.SetArg(argc++, m_render_data->lightsamples);
         volumekernel.SetArg(argc++, m_render_data->shadowhits);
         volumekernel.SetArg(argc++, output);
@@ -584,7 +993,7 @@ namespace Baikal
 
         // Run shading kernel
         {
-            GetContext().Launch1D(0, ((size + 63) / 64) * 64, 64, volumekernel);
+            Launch1D(((size + 63) / 64) * 64, 64, volumekernel);
         }
     }
 
@@ -611,7 +1020,7 @@ namespace Baikal
 
         // Run shading kernel
         {
-            GetContext().Launch1D(0, ((size + 63) / 64) * 64, 64, gatherkernel);
+            Launch1D(((size + 63) / 64) * 64, 64, gatherkernel);
         }
     }
 
@@ -638,7 +1047,7 @@ namespace Baikal
 
         // Run shading kernel
         {
-            GetContext().Launch1D(0, ((size + 63) / 64) * 64, 64, gatherkernel);
+            Launch1D(((size + 63) / 64) * 64, 64, gatherkernel);
         }
     }
 
@@ -656,7 +1065,7 @@ namespace Baikal
 
         // Run shading kernel
         {
-            GetContext().Launch1D(0, ((size + 63) / 64) * 64, 64, restorekernel);
+            Launch1D(((size + 63) / 64) * 64, 64, restorekernel);
         }
     }
 
@@ -672,7 +1081,7 @@ namespace Baikal
         restorekernel.SetArg(argc++, m_render_data->hits);
 
         {
-            GetContext().Launch1D(0, ((size + 63) / 64) * 64, 64, restorekernel);
+            Launch1D(((size + 63) / 64) * 64, 64, restorekernel);
         }
     }
 
@@ -705,7 +1114,7 @@ namespace Baikal
         misskernel.SetArg(argc++, output);
 
         {
-            GetContext().Launch1D(0, ((size + 63) / 64) * 64, 64, misskernel);
+            Launch1D(((size + 63) / 64) * 64, 64, misskernel);
         }
     }
 
@@ -912,7 +1321,7 @@ namespace Baikal
         misskernel.SetArg(argc++, output);
 
         {
-            GetContext().Launch1D(0, ((size + 63) / 64) * 64, 64, misskernel);
+            Launch1D(((size + 63) / 64) * 64, 64, misskernel);
         }
     }
 }
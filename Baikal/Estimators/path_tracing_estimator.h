@@ -188,14 +188,40 @@ namespace Baikal
     private:
         void InitPathData(std::size_t size, int volume_idx);
 
-        void ShadeSurface(
+        // Allocate regeneration buffers and keep camera rays of the batch
+        void PrepareRegeneration(std::size_t size);
+
+        // Terminate paths at max bounce. If restart is set, pixels whose paths
+        // have terminated get new paths from their camera rays for the next pass.
+        void RegeneratePaths(
             ClwScene const& scene,
             int pass,
             std::size_t size,
+            std::size_t num_estimates,
+            bool restart,
             CLWBuffer<RadeonRays::float3> output,
             bool use_output_indices
         );
 
+        // Shades hits. If hits have been sorted into material queues,
+        // each queue is shaded by a kernel specialized for its material layers.
+        void ShadeSurface(
+            ClwScene const& scene,
+            int pass,
+            std::size_t size,
+            CLWBuffer<RadeonRays::float3> output,
+            bool use_output_indices,
+            bool sorted_by_material = false
+        );
+
+        // Groups compacted hits into queues by material layers.
+        // Returns false if hits haven't been sorted.
+        bool SortHitsByMaterial(
+            ClwScene const& scene,
+            int pass,
+            std::size_t size
+        );
+
         void SampleVolume(
             ClwScene const& scene,
             int pass,
@@ -91,5 +91,6 @@ bool Bxdf_IsRefraction(DifferentialGeometry const* dg)
 }
 
 #include <uberv2_generated.cl>
+#include <../Baikal/Kernels/CL/bxdf_uberv2_interpreter.cl>
 
 #endif // BXDF_CL
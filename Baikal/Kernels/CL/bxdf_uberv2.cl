@@ -2,6 +2,7 @@
 #define BXDF_UBERV2_CL
 
 #include <inputmaps.cl>
+#include <../Baikal/Kernels/CL/inputmaps_interpreter.cl>
 
 typedef struct _UberV2ShaderData
 {
@@ -0,0 +1,312 @@
+/**********************************************************************
+Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#ifndef BXDF_UBERV2_INTERPRETER_CL
+#define BXDF_UBERV2_INTERPRETER_CL
+
+// Generic UberV2 implementation used by scene controller in interpreter mode
+// instead of per layer combination functions produced by CLUberV2Generator.
+// Layers are checked at runtime, so material edits never change program source.
+// Blending and layer selection follow CLUberV2Generator exactly.
+#ifdef BAIKAL_UBERV2_INTERPRETER
+
+#define UBERV2_HAS_LAYER(layers, layer) (((layers) & (layer)) == (layer))
+
+void UberV2PrepareInputs(
+    DifferentialGeometry const* dg, GLOBAL InputMapData const* restrict input_map_values,
+    GLOBAL int const* restrict material_attributes, TEXTURE_ARG_LIST, UberV2ShaderData *data)
+{
+    const int layers = dg->mat.layers;
+    int offset = dg->mat.offset + 1;
+
+    // Should have same order as in ClwSceneController::WriteMaterial
+    if (UBERV2_HAS_LAYER(layers, kEmissionLayer))
+    {
+        data->emission_color = GetInputMapFloat4(material_attributes[offset++], dg, input_map_values, TEXTURE_ARGS);
+    }
+    if (UBERV2_HAS_LAYER(layers, kCoatingLayer))
+    {
+        data->coating_color = GetInputMapFloat4(material_attributes[offset++], dg, input_map_values, TEXTURE_ARGS);
+        data->coating_ior = GetInputMapFloat(material_attributes[offset++], dg, input_map_values, TEXTURE_ARGS);
+    }
+    if (UBERV2_HAS_LAYER(layers, kReflectionLayer))
+    {
+        data->reflection_color = GetInputMapFloat4(material_attributes[offset++], dg, input_map_values, TEXTURE_ARGS);
+        data->reflection_roughness = GetInputMapFloat(material_attributes[offset++], dg, input_map_values, TEXTURE_ARGS);
+        data->reflection_anisotropy = GetInputMapFloat(material_attributes[offset++], dg, input_map_values, TEXTURE_ARGS);
+        data->reflection_anisotropy_rotation = GetInputMapFloat(material_attributes[offset++], dg, input_map_values, TEXTURE_ARGS);
+        data->reflection_ior = GetInputMapFloat(material_attributes[offset++], dg, input_map_values, TEXTURE_ARGS);
+        data->reflection_metalness = GetInputMapFloat(material_attributes[offset++], dg, input_map_values, TEXTURE_ARGS);
+    }
+    if (UBERV2_HAS_LAYER(layers, kDiffuseLayer))
+    {
+        data->diffuse_color = GetInputMapFloat4(material_attributes[offset++], dg, input_map_values, TEXTURE_ARGS);
+    }
+    if (UBERV2_HAS_LAYER(layers, kRefractionLayer))
+    {
+        data->refraction_color = GetInputMapFloat4(material_attributes[offset++], dg, input_map_values, TEXTURE_ARGS);
+        data->refraction_roughness = GetInputMapFloat(material_attributes[offset++], dg, input_map_values, TEXTURE_ARGS);
+        data->refraction_ior = GetInputMapFloat(material_attributes[offset++], dg, input_map_values, TEXTURE_ARGS);
+    }
+    if (UBERV2_HAS_LAYER(layers, kTransparencyLayer))
+    {
+        data->transparency = GetInputMapFloat(material_attributes[offset++], dg, input_map_values, TEXTURE_ARGS);
+    }
+    if (UBERV2_HAS_LAYER(layers, kShadingNormalLayer))
+    {
+        data->shading_normal = GetInputMapFloat4(material_attributes[offset++], dg, input_map_values, TEXTURE_ARGS);
+    }
+    if (UBERV2_HAS_LAYER(layers, kSSSLayer))
+    {
+        data->sss_absorption_color = GetInputMapFloat4(material_attributes[offset++], dg, input_map_values, TEXTURE_ARGS);
+        data->sss_scatter_color = GetInputMapFloat4(material_attributes[offset++], dg, input_map_values, TEXTURE_ARGS);
+        data->sss_subsurface_color = GetInputMapFloat4(material_attributes[offset++], dg, input_map_values, TEXTURE_ARGS);
+        data->sss_absorption_distance = GetInputMapFloat(material_attributes[offset++], dg, input_map_values, TEXTURE_ARGS);
+        data->sss_scatter_distance = GetInputMapFloat(material_attributes[offset++], dg, input_map_values, TEXTURE_ARGS);
+        data->sss_scatter_direction = GetInputMapFloat(material_attributes[offset++], dg, input_map_values, TEXTURE_ARGS);
+    }
+}
+
+// Evaluates material in tangent space
+float3 UberV2_EvaluateLayers(int layers, float3 wi, float3 wo, TEXTURE_ARG_LIST, UberV2ShaderData const* shader_data)
+{
+    const bool has_brdf = (layers & (kCoatingLayer | kReflectionLayer | kDiffuseLayer)) != 0;
+    const bool has_bxdf = has_brdf || UBERV2_HAS_LAYER(layers, kRefractionLayer);
+
+    // BRDF layers are Fresnel blended bottom up: diffuse, reflection, coating
+    float3 brdf = 0.0f;
+    if (UBERV2_HAS_LAYER(layers, kDiffuseLayer))
+    {
+        brdf = UberV2_Lambert_Evaluate(shader_data, wi, wo, TEXTURE_ARGS);
+    }
+    if (UBERV2_HAS_LAYER(layers, kReflectionLayer))
+    {
+        const float3 value = UberV2_Reflection_Evaluate(shader_data, wi, wo, TEXTURE_ARGS);
+        const float top_ior = UBERV2_HAS_LAYER(layers, kCoatingLayer) ? shader_data->coating_ior : 1.0f;
+        brdf = UBERV2_HAS_LAYER(layers, kDiffuseLayer) ?
+            Fresnel_Blend(top_ior, shader_data->reflection_ior, value, brdf, wi) : value;
+    }
+    if (UBERV2_HAS_LAYER(layers, kCoatingLayer))
+    {
+        const float3 value = UberV2_IdealReflect_Evaluate(shader_data, wi, wo, TEXTURE_ARGS);
+        brdf = (layers & (kReflectionLayer | kDiffuseLayer)) != 0 ?
+            Fresnel_Blend(1.0f, shader_data->coating_ior, value, brdf, wi) : value;
+    }
+
+    float3 bxdf = brdf;
+    if (UBERV2_HAS_LAYER(layers, kRefractionLayer))
+    {
+        const float3 value = UberV2_Refraction_Evaluate(shader_data, wi, wo, TEXTURE_ARGS);
+        bxdf = has_brdf ? Fresnel_Blend(1.0f, shader_data->refraction_ior, brdf, value, wi) : value;
+    }
+
+    if (UBERV2_HAS_LAYER(layers, kTransparencyLayer))
+    {
+        return has_bxdf ? mix(bxdf, 0.f, shader_data->transparency) : 0.f;
+    }
+
+    return bxdf;
+}
+
+// Calculates PDF in tangent space
+float UberV2_GetPdfLayers(int layers, float3 wi, float3 wo, TEXTURE_ARG_LIST, UberV2ShaderData const* shader_data)
+{
+    const bool has_brdf = (layers & (kCoatingLayer | kReflectionLayer | kDiffuseLayer)) != 0;
+    const bool has_bxdf = has_brdf || UBERV2_HAS_LAYER(layers, kRefractionLayer);
+
+    float brdf = 0.0f;
+    if (UBERV2_HAS_LAYER(layers, kDiffuseLayer))
+    {
+        brdf = UberV2_Lambert_GetPdf(shader_data, wi, wo, TEXTURE_ARGS);
+    }
+    if (UBERV2_HAS_LAYER(layers, kReflectionLayer))
+    {
+        const float value = UberV2_Reflection_GetPdf(shader_data, wi, wo, TEXTURE_ARGS);
+        const float top_ior = UBERV2_HAS_LAYER(layers, kCoatingLayer) ? shader_data->coating_ior : 1.0f;
+        brdf = UBERV2_HAS_LAYER(layers, kDiffuseLayer) ?
+            Fresnel_Blend_F(top_ior, shader_data->reflection_ior, value, brdf, wi) : value;
+    }
+    if (UBERV2_HAS_LAYER(layers, kCoatingLayer))
+    {
+        const float value = UberV2_IdealReflect_GetPdf(shader_data, wi, wo, TEXTURE_ARGS);
+        brdf = (layers & (kReflectionLayer | kDiffuseLayer)) != 0 ?
+            Fresnel_Blend_F(1.0f, shader_data->coating_ior, value, brdf, wi) : value;
+    }
+
+    float bxdf = brdf;
+    if (UBERV2_HAS_LAYER(layers, kRefractionLayer))
+    {
+        const float value = UberV2_Refraction_GetPdf(shader_data, wi, wo, TEXTURE_ARGS);
+        bxdf = has_brdf ? Fresnel_Blend_F(1.0f, shader_data->refraction_ior, brdf, value, wi) : value;
+    }
+
+    if (UBERV2_HAS_LAYER(layers, kTransparencyLayer))
+    {
+        return has_bxdf ? mix(bxdf, 0.f, shader_data->transparency) : 0.f;
+    }
+
+    return bxdf;
+}
+
+void GetMaterialBxDFType(
+    float3 wi, Sampler* sampler, SAMPLER_ARG_LIST, DifferentialGeometry* dg, UberV2ShaderData const* shader_data)
+{
+    const int layers = dg->mat.layers;
+    const float ndotwi = dot(dg->n, wi);
+    int bxdf_flags = 0;
+
+    if (UBERV2_HAS_LAYER(layers, kEmissionLayer))
+    {
+        bxdf_flags |= kBxdfFlagsEmissive;
+    }
+
+    // Random numbers are only drawn when blended layer has something underneath,
+    // so sample sequences match generated code.
+    if (UBERV2_HAS_LAYER(layers, kTransparencyLayer))
+    {
+        const bool has_underlying_layer =
+            (layers & (kRefractionLayer | kCoatingLayer | kReflectionLayer | kDiffuseLayer)) != 0;
+
+        if (!has_underlying_layer || Sampler_Sample1D(sampler, SAMPLER_ARGS) < shader_data->transparency)
+        {
+            bxdf_flags |= (kBxdfFlagsTransparency | kBxdfFlagsSingular);
+            Bxdf_SetFlags(dg, bxdf_flags);
+            Bxdf_UberV2_SetSampledComponent(dg, kBxdfUberV2SampleTransparency);
+            return;
+        }
+    }
+
+    if (UBERV2_HAS_LAYER(layers, kRefractionLayer))
+    {
+        const bool has_underlying_layer =
+            (layers & (kCoatingLayer | kReflectionLayer | kDiffuseLayer)) != 0;
+
+        if (!has_underlying_layer ||
+            Sampler_Sample1D(sampler, SAMPLER_ARGS) >= CalculateFresnel(1.0f, shader_data->refraction_ior, ndotwi))
+        {
+            Bxdf_UberV2_SetSampledComponent(dg, kBxdfUberV2SampleRefraction);
+            if (shader_data->refraction_roughness < ROUGHNESS_EPS)
+            {
+                bxdf_flags |= kBxdfFlagsSingular;
+            }
+            Bxdf_SetFlags(dg, bxdf_flags);
+            return;
+        }
+    }
+
+    float top_ior = 1.0f;
+    if ((layers & (kReflectionLayer | kRefractionLayer | kCoatingLayer)) != 0)
+    {
+        bxdf_flags |= kBxdfFlagsBrdf;
+    }
+
+    if (UBERV2_HAS_LAYER(layers, kCoatingLayer))
+    {
+        const bool has_underlying_layer = (layers & (kReflectionLayer | kDiffuseLayer)) != 0;
+
+        if (!has_underlying_layer ||
+            Sampler_Sample1D(sampler, SAMPLER_ARGS) < CalculateFresnel(top_ior, shader_data->coating_ior, ndotwi))
+        {
+            bxdf_flags |= kBxdfFlagsSingular;
+            Bxdf_SetFlags(dg, bxdf_flags);
+            Bxdf_UberV2_SetSampledComponent(dg, kBxdfUberV2SampleCoating);
+            return;
+        }
+
+        top_ior = shader_data->coating_ior;
+    }
+
+    if (UBERV2_HAS_LAYER(layers, kReflectionLayer))
+    {
+        const bool has_underlying_layer = UBERV2_HAS_LAYER(layers, kDiffuseLayer);
+
+        if (!has_underlying_layer ||
+            Sampler_Sample1D(sampler, SAMPLER_ARGS) < CalculateFresnel(top_ior, shader_data->reflection_ior, ndotwi))
+        {
+            if (shader_data->reflection_roughness < ROUGHNESS_EPS)
+            {
+                bxdf_flags |= kBxdfFlagsSingular;
+            }
+            Bxdf_UberV2_SetSampledComponent(dg, kBxdfUberV2SampleReflection);
+            Bxdf_SetFlags(dg, bxdf_flags);
+            return;
+        }
+    }
+
+    if (UBERV2_HAS_LAYER(layers, kDiffuseLayer))
+    {
+        Bxdf_UberV2_SetSampledComponent(dg, kBxdfUberV2SampleDiffuse);
+        bxdf_flags |= kBxdfFlagsBrdf;
+    }
+
+    Bxdf_SetFlags(dg, bxdf_flags);
+}
+
+float3 UberV2_Evaluate(DifferentialGeometry const* dg, float3 wi, float3 wo, TEXTURE_ARG_LIST, UberV2ShaderData const* shader_data)
+{
+    float3 wi_t = matrix_mul_vector3(dg->world_to_tangent, wi);
+    float3 wo_t = matrix_mul_vector3(dg->world_to_tangent, wo);
+    return UberV2_EvaluateLayers(dg->mat.layers, wi_t, wo_t, TEXTURE_ARGS, shader_data);
+}
+
+float UberV2_GetPdf(DifferentialGeometry const* dg, float3 wi, float3 wo, TEXTURE_ARG_LIST, UberV2ShaderData const* shader_data)
+{
+    float3 wi_t = matrix_mul_vector3(dg->world_to_tangent, wi);
+    float3 wo_t = matrix_mul_vector3(dg->world_to_tangent, wo);
+    return UberV2_GetPdfLayers(dg->mat.layers, wi_t, wo_t, TEXTURE_ARGS, shader_data);
+}
+
+float3 UberV2_Sample(DifferentialGeometry const* dg, float3 wi, TEXTURE_ARG_LIST, float2 sample,
+    float3 *wo, float *pdf, UberV2ShaderData const* shader_data)
+{
+    float3 wi_t = matrix_mul_vector3(dg->world_to_tangent, wi);
+    float3 wo_t = 0.f;
+    float3 res = 0.f;
+
+    // Sampled component is only set for layers present in material
+    switch (Bxdf_UberV2_GetSampledComponent(dg))
+    {
+        case kBxdfUberV2SampleTransparency:
+            res = UberV2_Passthrough_Sample(shader_data, wi_t, TEXTURE_ARGS, sample, &wo_t, pdf);
+            break;
+        case kBxdfUberV2SampleCoating:
+            res = UberV2_Coating_Sample(shader_data, wi_t, TEXTURE_ARGS, &wo_t, pdf);
+            break;
+        case kBxdfUberV2SampleReflection:
+            res = UberV2_Reflection_Sample(shader_data, wi_t, TEXTURE_ARGS, sample, &wo_t, pdf);
+            break;
+        case kBxdfUberV2SampleRefraction:
+            res = UberV2_Refraction_Sample(shader_data, wi_t, TEXTURE_ARGS, sample, &wo_t, pdf);
+            break;
+        case kBxdfUberV2SampleDiffuse:
+            res = UberV2_Lambert_Sample(shader_data, wi_t, TEXTURE_ARGS, sample, &wo_t, pdf);
+            break;
+    }
+
+    *wo = matrix_mul_vector3(dg->tangent_to_world, wo_t);
+    return res;
+}
+
+#undef UBERV2_HAS_LAYER
+
+#endif // BAIKAL_UBERV2_INTERPRETER
+
+#endif // BXDF_UBERV2_INTERPRETER_CL
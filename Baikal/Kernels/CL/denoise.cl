@@ -157,7 +157,7 @@ void CopyInterleaved(GLOBAL float4* restrict dst,
     int x = global_id % dst_width;
     int y = global_id / dst_width;
 
-    if ((x > dst_width) || (global_id > dst_width * dst_height))
+    if ((x >= dst_width) || (global_id >= dst_width * dst_height))
     {
         return;
     }
@@ -42,6 +42,104 @@ THE SOFTWARE.
     }\
 }
 
+// AOV flags are 0 for disabled outputs and 1 + Output::Format otherwise
+#define AOV_FORMAT_RGBA32F 1
+#define AOV_FORMAT_R32F 2
+#define AOV_FORMAT_RG16F 3
+#define AOV_FORMAT_RGBA16F 4
+#define AOV_FORMAT_R32UI 5
+
+// Running mean of samples, num_samples is number of samples already in the mean
+INLINE float4 Aov_Mean(float4 mean, float4 value, int num_samples)
+{
+    return num_samples == 0 ? value : mean + (value - mean) / (float)(num_samples + 1);
+}
+
+// Add sample to AOV. RGBA32F AOVs hold sum of samples and sample count in w,
+// packed AOVs hold mean of num_samples previous samples of the pixel.
+INLINE void Aov_Accumulate(GLOBAL float4* restrict aov, int format, int idx, float3 value, int num_samples)
+{
+    if (format == AOV_FORMAT_RGBA32F)
+    {
+        aov[idx].xyz += value;
+        aov[idx].w += 1.f;
+        CORRECT_VALUE(aov[idx])
+        return;
+    }
+
+    if (any(isnan(value)))
+    {
+        return;
+    }
+
+    float4 sample = make_float4(value.x, value.y, value.z, 1.f);
+
+    switch (format)
+    {
+    case AOV_FORMAT_R32F:
+    {
+        GLOBAL float* data = (GLOBAL float*)aov;
+        data[idx] = Aov_Mean(make_float4(data[idx], 0.f, 0.f, 1.f), sample, num_samples).x;
+        break;
+    }
+    case AOV_FORMAT_RG16F:
+    {
+        GLOBAL half* data = (GLOBAL half*)aov;
+        float2 mean = vload_half2(idx, data);
+        vstore_half2(Aov_Mean(make_float4(mean.x, mean.y, 0.f, 1.f), sample, num_samples).xy, idx, data);
+        break;
+    }
+    case AOV_FORMAT_RGBA16F:
+    {
+        GLOBAL half* data = (GLOBAL half*)aov;
+        vstore_half4(Aov_Mean(vload_half4(idx, data), sample, num_samples), idx, data);
+        break;
+    }
+    case AOV_FORMAT_R32UI:
+    {
+        GLOBAL uint* data = (GLOBAL uint*)aov;
+        data[idx] = (uint)value.x;
+        break;
+    }
+    }
+}
+
+// Add id sample to AOV, integer AOVs get the id itself and other formats its color
+INLINE void Aov_AccumulateId(GLOBAL float4* restrict aov, int format, int idx, int id, int num_samples)
+{
+    if (format == AOV_FORMAT_R32UI)
+    {
+        GLOBAL uint* data = (GLOBAL uint*)aov;
+        data[idx] = (uint)id;
+        return;
+    }
+
+    Sampler id_sampler;
+    id_sampler.index = id;
+    float3 color = clamp(make_float3(UniformSampler_Sample1D(&id_sampler),
+        UniformSampler_Sample1D(&id_sampler),
+        UniformSampler_Sample1D(&id_sampler)), 0.0f, 1.0f);
+
+    Aov_Accumulate(aov, format, idx, color, num_samples);
+}
+
+// Overwrite id in AOV, -1 means no id
+INLINE void Aov_WriteId(GLOBAL float4* restrict aov, int format, int idx, int id)
+{
+    switch (format)
+    {
+    case AOV_FORMAT_RGBA32F:
+        aov[idx].x = id;
+        break;
+    case AOV_FORMAT_R32F:
+        ((GLOBAL float*)aov)[idx] = id;
+        break;
+    case AOV_FORMAT_R32UI:
+        ((GLOBAL uint*)aov)[idx] = (uint)id;
+        break;
+    }
+}
+
 // Fill AOVs
 KERNEL void FillAOVsUberV2(
     // Ray batch
@@ -53,13 +151,13 @@ KERNEL void FillAOVsUberV2(
     // Number of pixels
     GLOBAL int const* restrict num_items,
     // Vertices
-    GLOBAL float3 const*restrict  vertices,
+    GLOBAL GeometryPosition const* restrict vertices,
     // Normals
-    GLOBAL float3 const* restrict normals,
+    GLOBAL GeometryNormal const* restrict normals,
     // UVs
-    GLOBAL float2 const* restrict uvs,
+    GLOBAL GeometryUV const* restrict uvs,
     // Indices
-    GLOBAL int const* restrict indices,
+    GLOBAL GeometryIndex const* restrict indices,
     // Shapes
     GLOBAL Shape const* restrict shapes,
     GLOBAL ShapeAdditionalData const* restrict shapes_additional,
@@ -86,8 +184,14 @@ KERNEL void FillAOVsUberV2(
     GLOBAL uint* restrict random,
     // Sobol matrices
     GLOBAL uint const* restrict sobol_mat, 
-    // Frame
+    // Frame, number of frames accumulated since last clear
     int frame,
+    // Color accumulator flag, the accumulator has the same size as AOVs if set
+    int color_enabled,
+    // Color accumulator, w holds number of samples of the pixel including the current one.
+    // Pixels may skip frames (adaptive sampling), so packed AOV means use it instead of frame.
+    GLOBAL float4 const* restrict color,
+    // AOV flags below are 0 for disabled AOVs and AOV_FORMAT_* otherwise
     // World position flag
     int world_position_enabled, 
     // World position AOV
@@ -173,18 +277,20 @@ KERNEL void FillAOVsUberV2(
     {
         Intersection isect = isects[global_id];
         int idx = pixel_idx[global_id];
+        int num_samples = color_enabled ? max((int)color[idx].w - 1, 0) : frame;
 
         if (shape_ids_enabled)
-            aov_shape_ids[idx].x = -1;
+            Aov_WriteId(aov_shape_ids, shape_ids_enabled, idx, -1);
 
         if (background_enabled)
         {
+            float3 background = 0.f;
             if (background_idx != -1)
             {
                 float x = (float)(idx % width) / (float)width;
                 float y = (float)(idx / width) / (float)height;
                 float2 uv = make_float2(x, y);
-                aov_background[idx].xyz += Texture_Sample2D(uv, TEXTURE_ARGS_IDX(background_idx)).xyz;
+                background = Texture_Sample2D(uv, TEXTURE_ARGS_IDX(background_idx)).xyz;
             }
             else if (env_light_idx != -1)
             {
@@ -192,11 +298,10 @@ KERNEL void FillAOVsUberV2(
                 int tex = EnvironmentLight_GetBackgroundTexture(&light);
                 if (tex != -1)
                 {
-                    aov_background[idx].xyz += light.multiplier * Texture_SampleEnvMap(rays[global_id].d.xyz, TEXTURE_ARGS_IDX(tex), light.ibl_mirror_x);
+                    background = light.multiplier * Texture_SampleEnvMap(rays[global_id].d.xyz, TEXTURE_ARGS_IDX(tex), light.ibl_mirror_x);
                 }
             }
-            aov_background[idx].w += 1.0f;
-            CORRECT_VALUE(aov_background[idx])
+            Aov_Accumulate(aov_background, background_enabled, idx, background, num_samples);
         }
 
 
@@ -224,9 +329,7 @@ KERNEL void FillAOVsUberV2(
 
             if (world_position_enabled)
             {
-                aov_world_position[idx].xyz += diffgeo.p;
-                aov_world_position[idx].w += 1.f;
-                CORRECT_VALUE(aov_world_position[idx])
+                Aov_Accumulate(aov_world_position, world_position_enabled, idx, diffgeo.p, num_samples);
             }
 
             if (world_shading_normal_enabled)
@@ -253,32 +356,24 @@ KERNEL void FillAOVsUberV2(
                 UberV2_ApplyShadingNormal(&diffgeo, &uber_shader_data);
                 DifferentialGeometry_CalculateTangentTransforms(&diffgeo);
 
-                aov_world_shading_normal[idx].xyz += diffgeo.n;
-                aov_world_shading_normal[idx].w += 1.f;
-                CORRECT_VALUE(aov_world_shading_normal[idx])
+                Aov_Accumulate(aov_world_shading_normal, world_shading_normal_enabled, idx, diffgeo.n, num_samples);
             }
 
             if (world_geometric_normal_enabled)
             {
-                aov_world_geometric_normal[idx].xyz += diffgeo.ng;
-                aov_world_geometric_normal[idx].w += 1.f;
-                CORRECT_VALUE(aov_world_geometric_normal[idx])
+                Aov_Accumulate(aov_world_geometric_normal, world_geometric_normal_enabled, idx, diffgeo.ng, num_samples);
             }
 
             if (wireframe_enabled)
             {
                 bool hit = (isect.uvwt.x < 1e-3) || (isect.uvwt.y < 1e-3) || (1.f - isect.uvwt.x - isect.uvwt.y < 1e-3);
                 float3 value = hit ? make_float3(1.f, 1.f, 1.f) : make_float3(0.f, 0.f, 0.f);
-                aov_wireframe[idx].xyz += value;
-                aov_wireframe[idx].w += 1.f;
-                CORRECT_VALUE(aov_wireframe[idx])
+                Aov_Accumulate(aov_wireframe, wireframe_enabled, idx, value, num_samples);
             }
 
             if (uv_enabled)
             {
-                aov_uv[idx].xy += diffgeo.uv.xy;
-                aov_uv[idx].w += 1.f;
-                CORRECT_VALUE(aov_uv[idx])
+                Aov_Accumulate(aov_uv, uv_enabled, idx, make_float3(diffgeo.uv.x, diffgeo.uv.y, 0.f), num_samples);
             }
 
             if (albedo_enabled)
@@ -293,9 +388,7 @@ KERNEL void FillAOVsUberV2(
                 const float3 kd = ((diffgeo.mat.layers & kDiffuseLayer) == kDiffuseLayer) ?
                     uber_shader_data.diffuse_color.xyz : (float3)(0.0f);
 
-                aov_albedo[idx].xyz += kd;
-                aov_albedo[idx].w += 1.f;
-                CORRECT_VALUE(aov_albedo[idx])
+                Aov_Accumulate(aov_albedo, albedo_enabled, idx, kd, num_samples);
             }
 
             if (world_tangent_enabled)
@@ -323,9 +416,7 @@ KERNEL void FillAOVsUberV2(
                 UberV2_ApplyShadingNormal(&diffgeo, &uber_shader_data);
                 DifferentialGeometry_CalculateTangentTransforms(&diffgeo);
 
-                aov_world_tangent[idx].xyz += diffgeo.dpdu;
-                aov_world_tangent[idx].w += 1.f;
-                CORRECT_VALUE(aov_world_tangent[idx])
+                Aov_Accumulate(aov_world_tangent, world_tangent_enabled, idx, diffgeo.dpdu, num_samples);
             }
 
             if (world_bitangent_enabled)
@@ -353,9 +444,7 @@ KERNEL void FillAOVsUberV2(
                 UberV2_ApplyShadingNormal(&diffgeo, &uber_shader_data);
                 DifferentialGeometry_CalculateTangentTransforms(&diffgeo);
 
-                aov_world_bitangent[idx].xyz += diffgeo.dpdv;
-                aov_world_bitangent[idx].w += 1.f;
-                CORRECT_VALUE(aov_world_bitangent[idx])
+                Aov_Accumulate(aov_world_bitangent, world_bitangent_enabled, idx, diffgeo.dpdv, num_samples);
             }
 
             if (gloss_enabled)
@@ -384,52 +473,36 @@ KERNEL void FillAOVsUberV2(
                     gloss = 1.0f - uber_shader_data.refraction_roughness;
                 }
 
-                aov_gloss[idx].xyz += gloss;
-                aov_gloss[idx].w += 1.f;
-                CORRECT_VALUE(aov_gloss[idx])
+                Aov_Accumulate(aov_gloss, gloss_enabled, idx, make_float3(gloss, gloss, gloss), num_samples);
             }
             
             if (mesh_id_enabled)
             {
-                Sampler shapeid_sampler;
-                shapeid_sampler.index = shapes[isect.shapeid - 1].id;
-                mesh_id[idx].xyz += clamp(make_float3(UniformSampler_Sample1D(&shapeid_sampler),
-                    UniformSampler_Sample1D(&shapeid_sampler),
-                    UniformSampler_Sample1D(&shapeid_sampler)), 0.0f, 1.0f);
-                mesh_id[idx].w += 1.0f;
-                CORRECT_VALUE(mesh_id[idx])
+                Aov_AccumulateId(mesh_id, mesh_id_enabled, idx, shapes[isect.shapeid - 1].id, num_samples);
             }
 
             if (group_id_enabled)
             {
-                Sampler groupid_sampler;
-                groupid_sampler.index = shapes_additional[isect.shapeid - 1].group_id;
-                group_id[idx].xyz += clamp(make_float3(UniformSampler_Sample1D(&groupid_sampler),
-                    UniformSampler_Sample1D(&groupid_sampler),
-                    UniformSampler_Sample1D(&groupid_sampler)), 0.0f, 1.0f);
-                group_id[idx].w += 1.0f;
-                CORRECT_VALUE(group_id[idx])
+                Aov_AccumulateId(group_id, group_id_enabled, idx, shapes_additional[isect.shapeid - 1].group_id, num_samples);
             }
 
             if (depth_enabled)
             {
-                float w = aov_depth[idx].w;
-                if (w == 0.f)
+                if (depth_enabled == AOV_FORMAT_RGBA32F && aov_depth[idx].w == 0.f)
                 {
                     aov_depth[idx].xyz = isect.uvwt.w;
                     aov_depth[idx].w = 1.f;
+                    CORRECT_VALUE(aov_depth[idx])
                 }
                 else
                 {
-                    aov_depth[idx].xyz += isect.uvwt.w;
-                    aov_depth[idx].w += 1.f;
+                    Aov_Accumulate(aov_depth, depth_enabled, idx, make_float3(isect.uvwt.w, isect.uvwt.w, isect.uvwt.w), num_samples);
                 }
-                CORRECT_VALUE(aov_depth[idx])
             }
 
             if (shape_ids_enabled)
             {
-                aov_shape_ids[idx].x = shapes[isect.shapeid - 1].id;
+                Aov_WriteId(aov_shape_ids, shape_ids_enabled, idx, shapes[isect.shapeid - 1].id);
             }
 
             if (view_shading_normal_enabled)
@@ -439,10 +512,7 @@ KERNEL void FillAOVsUberV2(
                                         dot(camera->forward, diffgeo.n));
                 res = normalize(res);
 
-                aov_view_shading_normal[idx].xyz += res;
-                aov_view_shading_normal[idx].w += 1.f;
-
-                CORRECT_VALUE(aov_view_shading_normal[idx])
+                Aov_Accumulate(aov_view_shading_normal, view_shading_normal_enabled, idx, res, num_samples);
             }
         }
     }
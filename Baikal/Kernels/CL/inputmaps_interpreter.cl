@@ -0,0 +1,185 @@
+/**********************************************************************
+Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#ifndef INPUTMAPS_INTERPRETER_CL
+#define INPUTMAPS_INTERPRETER_CL
+
+// Enabled by scene controller in interpreter mode instead of generated input maps.
+// Input map trees are stored as postfix bytecode in input_map_values buffer
+// right after leaf values, input_id is an offset of the first instruction.
+#ifdef BAIKAL_UBERV2_INTERPRETER
+
+// Should match CLInputMapBytecodeGenerator::kMaxStackDepth
+#define INPUT_MAP_STACK_SIZE 8
+
+float4 GetInputMapFloat4(uint input_id, DifferentialGeometry const* dg, GLOBAL InputMapData const* restrict input_map_values, TEXTURE_ARG_LIST)
+{
+    if ((int)input_id < 0)
+    {
+        return 0.0f;
+    }
+
+    float4 stack[INPUT_MAP_STACK_SIZE];
+    int sp = 0;
+    uint pc = input_id;
+
+    while (true)
+    {
+        const int op = input_map_values[pc].int_values.idx;
+        const int arg = input_map_values[pc].int_values.placeholder[0];
+        ++pc;
+
+        switch (op)
+        {
+        case kInputMapOpReturn:
+            return sp > 0 ? stack[sp - 1] : 0.0f;
+
+        // Leafs
+        case kInputMapOpConstant:
+            stack[sp++] = (float4)(input_map_values[arg].float_value.value, 0.0f);
+            break;
+        case kInputMapOpSampler:
+            stack[sp++] = Texture_Sample2DGrad(dg->uv, dg->duvdx, dg->duvdy, TEXTURE_ARGS_IDX(input_map_values[arg].int_values.idx));
+            break;
+        case kInputMapOpSamplerBumpmap:
+            stack[sp++] = (float4)(Texture_SampleBump(dg->uv, TEXTURE_ARGS_IDX(input_map_values[arg].int_values.idx)), 1.0f);
+            break;
+
+        // Two inputs
+        case kInputMapOpAdd:
+            --sp; stack[sp - 1] = stack[sp - 1] + stack[sp];
+            break;
+        case kInputMapOpSub:
+            --sp; stack[sp - 1] = stack[sp - 1] - stack[sp];
+            break;
+        case kInputMapOpMul:
+            --sp; stack[sp - 1] = stack[sp - 1] * stack[sp];
+            break;
+        case kInputMapOpDiv:
+            --sp; stack[sp - 1] = stack[sp - 1] / stack[sp];
+            break;
+        case kInputMapOpMin:
+            --sp; stack[sp - 1] = min(stack[sp - 1], stack[sp]);
+            break;
+        case kInputMapOpMax:
+            --sp; stack[sp - 1] = max(stack[sp - 1], stack[sp]);
+            break;
+        case kInputMapOpDot3:
+            --sp; stack[sp - 1] = (float4)(dot(stack[sp - 1].xyz, stack[sp].xyz), 0.0f, 0.0f, 0.0f);
+            break;
+        case kInputMapOpDot4:
+            --sp; stack[sp - 1] = (float4)(dot(stack[sp - 1], stack[sp]), 0.0f, 0.0f, 0.0f);
+            break;
+        case kInputMapOpCross3:
+            --sp; stack[sp - 1] = (float4)(cross(stack[sp - 1].xyz, stack[sp].xyz), 0.0f);
+            break;
+        case kInputMapOpCross4:
+            --sp; stack[sp - 1] = cross(stack[sp - 1], stack[sp]);
+            break;
+        case kInputMapOpPow:
+            --sp; stack[sp - 1] = pow(stack[sp - 1], (float4)(stack[sp].x));
+            break;
+        case kInputMapOpMod:
+            --sp; stack[sp - 1] = fmod(stack[sp - 1], stack[sp]);
+            break;
+        case kInputMapOpShuffle2:
+            --sp; stack[sp - 1] = shuffle2(stack[sp - 1], stack[sp],
+                (uint4)(arg & 0xf, (arg >> 4) & 0xf, (arg >> 8) & 0xf, (arg >> 12) & 0xf));
+            break;
+
+        // Single input
+        case kInputMapOpSin:
+            stack[sp - 1] = sin(stack[sp - 1]);
+            break;
+        case kInputMapOpCos:
+            stack[sp - 1] = cos(stack[sp - 1]);
+            break;
+        case kInputMapOpTan:
+            stack[sp - 1] = tan(stack[sp - 1]);
+            break;
+        case kInputMapOpAsin:
+            stack[sp - 1] = asin(stack[sp - 1]);
+            break;
+        case kInputMapOpAcos:
+            stack[sp - 1] = acos(stack[sp - 1]);
+            break;
+        case kInputMapOpAtan:
+            stack[sp - 1] = atan(stack[sp - 1]);
+            break;
+        case kInputMapOpLength3:
+            stack[sp - 1] = (float4)(length(stack[sp - 1].xyz), 0.0f, 0.0f, 0.0f);
+            break;
+        case kInputMapOpNormalize3:
+            stack[sp - 1] = (float4)(normalize(stack[sp - 1].xyz), 0.0f);
+            break;
+        case kInputMapOpFloor:
+            stack[sp - 1] = floor(stack[sp - 1]);
+            break;
+        case kInputMapOpAbs:
+            stack[sp - 1] = fabs(stack[sp - 1]);
+            break;
+        case kInputMapOpSelect:
+        {
+            const float4 v = stack[sp - 1];
+            stack[sp - 1] = (float4)(arg == 0 ? v.x : (arg == 1 ? v.y : (arg == 2 ? v.z : v.w)));
+            break;
+        }
+        case kInputMapOpShuffle:
+            stack[sp - 1] = shuffle(stack[sp - 1],
+                (uint4)(arg & 0xf, (arg >> 4) & 0xf, (arg >> 8) & 0xf, (arg >> 12) & 0xf));
+            break;
+        case kInputMapOpMatMul:
+        {
+            GLOBAL float const* rows = (GLOBAL float const*)(input_map_values + pc);
+            const matrix4x4 m = matrix_from_rows(vload4(0, rows), vload4(1, rows), vload4(2, rows), vload4(3, rows));
+            stack[sp - 1] = matrix_mul_vector4(m, stack[sp - 1]);
+            pc += 4;
+            break;
+        }
+
+        // Specials
+        case kInputMapOpLerp:
+            sp -= 2;
+            stack[sp - 1] = mix(stack[sp - 1], stack[sp], stack[sp + 1]);
+            break;
+        case kInputMapOpRemap:
+        {
+            sp -= 2;
+            const float4 src = stack[sp];
+            const float4 dst = stack[sp + 1];
+            stack[sp - 1] = mix((float4)(dst.x), (float4)(dst.y), (stack[sp - 1] - src.x) / (src.y - src.x));
+            break;
+        }
+
+        default:
+            return 0.0f;
+        }
+    }
+}
+
+float GetInputMapFloat(uint input_id, DifferentialGeometry const* dg, GLOBAL InputMapData const* restrict input_map_values, TEXTURE_ARG_LIST)
+{
+    return GetInputMapFloat4(input_id, dg, input_map_values, TEXTURE_ARGS).x;
+}
+
+#endif // BAIKAL_UBERV2_INTERPRETER
+
+#endif // INPUTMAPS_INTERPRETER_CL
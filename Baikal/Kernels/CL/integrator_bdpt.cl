@@ -134,8 +134,10 @@ KERNEL void GenerateLightVertices(
         float2 sample0 = Sampler_Sample2D(&sampler, SAMPLER_ARGS);
         float2 sample1 = Sampler_Sample2D(&sampler, SAMPLER_ARGS);
 
+        // Light subpaths have no reference point, light BVH is traversed towards the origin.
+        // Selection pdf is computed for the same point, so the estimate stays unbiased.
         float selection_pdf;
-        int idx = Scene_SampleLight(&scene, Sampler_Sample1D(&sampler, SAMPLER_ARGS), &selection_pdf);
+        int idx = Scene_SampleLight(&scene, make_float3(0.f, 0.f, 0.f), Sampler_Sample1D(&sampler, SAMPLER_ARGS), &selection_pdf);
 
         float3 p, n, wo;
         float light_pdf;
@@ -174,6 +176,7 @@ KERNEL void GenerateLightVertices(
         my_path->volume = -1;
         my_path->flags = 0;
         my_path->active = 0xFF;
+        my_path->start_pass = 0;
     }
 }
 
@@ -488,7 +491,7 @@ KERNEL void SampleSurface(
 #endif
 
             float selection_pdf;
-            int light_idx = Scene_SampleLight(&scene, Sampler_Sample1D(&sampler, SAMPLER_ARGS), &selection_pdf);
+            int light_idx = Scene_SampleLight(&scene, diffgeo.p, Sampler_Sample1D(&sampler, SAMPLER_ARGS), &selection_pdf);
 
             // Sample light
             float lightpdf = 0.f;
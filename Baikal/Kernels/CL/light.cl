@@ -85,6 +85,65 @@ INLINE int EnvironmentLight_GetBackgroundTexture(Light const* light)
 /*
  Environment light
  */
+/// Check if direction is sampled from luminance distribution of light texture.
+/// Distribution is built for main texture only, overrides are sampled uniformly.
+INLINE bool EnvironmentLight_UseDistribution(Light const* light, int bxdf_flags)
+{
+    return light->env_distribution != -1 && EnvironmentLight_GetTexture(light, bxdf_flags) == light->tex;
+}
+
+/// Map point of distribution domain to direction, inverse of Texture_SampleEnvMap mapping
+INLINE float3 EnvironmentLight_UvToDirection(Light const* light, float2 uv)
+{
+    float phi = 2.f * PI * (light->ibl_mirror_x ? 1.f - uv.x : uv.x);
+    float theta = PI * uv.y;
+    float sin_theta = sin(theta);
+    return make_float3(sin_theta * sin(phi), cos(theta), sin_theta * cos(phi));
+}
+
+/// Map direction to point of distribution domain
+INLINE float2 EnvironmentLight_DirectionToUv(Light const* light, float3 d)
+{
+    float r, phi, theta;
+    CartesianToSpherical(d, &r, &phi, &theta);
+
+    float2 uv;
+    uv.x = light->ibl_mirror_x ? (1.f - phi / (2.f * PI)) : phi / (2.f * PI);
+    uv.y = theta / PI;
+    return uv;
+}
+
+/// Get PDF for a given direction, light distribution is passed explicitly
+/// so it can be used outside of shading kernels
+float EnvironmentLight_GetDistributionPdf(
+                              // Light
+                              Light const* light,
+                              // Light distribution data
+                              GLOBAL int const* light_distribution,
+                              // Path flags
+                              int bxdf_flags,
+                              // Light inteaction type
+                              int interaction_type,
+                              // Direction to light source
+                              float3 wo
+                              )
+{
+    if (EnvironmentLight_UseDistribution(light, bxdf_flags))
+    {
+        float2 uv = EnvironmentLight_DirectionToUv(light, normalize(wo));
+        float sin_theta = sin(uv.y * PI);
+        return sin_theta > 0.f ? Distribution2D_GetPdf(uv, light_distribution + light->env_distribution) / (2.f * PI * PI * sin_theta) : 0.f;
+    }
+    else if (interaction_type != kLightInteractionVolume)
+    {
+        return 1.f / (2.f * PI);
+    }
+    else
+    {
+        return 1.f / (4.f * PI);
+    }
+}
+
 /// Get intensity for a given direction
 float3 EnvironmentLight_GetLe(// Light
                               Light const* light,
@@ -138,7 +197,15 @@ float3 EnvironmentLight_Sample(// Light
 {
     float3 d;
 
-    if (interaction_type != kLightInteractionVolume)
+    if (EnvironmentLight_UseDistribution(light, bxdf_flags))
+    {
+        float2 uv = Distribution2D_Sample(sample, scene->light_distribution + light->env_distribution, pdf);
+        d = EnvironmentLight_UvToDirection(light, uv);
+
+        float sin_theta = sin(uv.y * PI);
+        *pdf = sin_theta > 0.f ? *pdf / (2.f * PI * PI * sin_theta) : 0.f;
+    }
+    else if (interaction_type != kLightInteractionVolume)
     {
         d = Sample_MapToHemisphere(sample, dg->n, 0.f);
         *pdf = 1.f / (2.f * PI);
@@ -182,14 +249,7 @@ float EnvironmentLight_GetPdf(
                               TEXTURE_ARG_LIST
                               )
 {
-    if (interaction_type != kLightInteractionVolume)
-    {
-        return 1.f / (2.f * PI);
-    }
-    else
-    {
-        return 1.f / (4.f * PI);
-    }
+    return EnvironmentLight_GetDistributionPdf(light, scene->light_distribution, bxdf_flags, interaction_type, wo);
 }
 
 
@@ -389,6 +449,49 @@ float3 AreaLight_SampleVertex(
     return ke;
 }
 
+/*
+Mesh light
+*/
+/// Sample direction to the light: primitive is picked proportionally to its area
+/// and then sampled as area light. Emission of mesh lights is evaluated at emissive
+/// hits (see Scene_GetEmissivePdf), so there is no GetLe and GetPdf for them.
+float3 MeshLight_Sample(// Emissive object
+                        Light const* light,
+                        // Scene
+                        Scene const* scene,
+                        // Geometry
+                        DifferentialGeometry const* dg,
+                        // Textures
+                        TEXTURE_ARG_LIST,
+                        // Sample
+                        float2 sample,
+                        // Direction to light source
+                        float3* wo,
+                        // PDF
+                        float* pdf)
+{
+    if (light->prim_distribution == -1)
+    {
+        *pdf = 0.f;
+        return 0.f;
+    }
+
+    GLOBAL int const* distribution = scene->light_distribution + light->prim_distribution;
+
+    float prim_pdf = 0.f;
+    Light prim_light = *light;
+    prim_light.primidx = Distribution1D_SampleDiscrete(sample.x, distribution, &prim_pdf);
+
+    // Reuse the sample rescaled to the selected primitive
+    GLOBAL float const* cdf = (GLOBAL float const*)&distribution[1];
+    float width = cdf[prim_light.primidx + 1] - cdf[prim_light.primidx];
+    sample.x = width > 0.f ? clamp((sample.x - cdf[prim_light.primidx]) / width, 0.f, 0.99999994f) : 0.f;
+
+    float3 le = AreaLight_Sample(&prim_light, scene, dg, TEXTURE_ARGS, sample, wo, pdf);
+    *pdf *= prim_pdf;
+    return le;
+}
+
 /*
 Directional light
 */
@@ -662,6 +765,8 @@ float3 Light_Sample(// Light index
             return EnvironmentLight_Sample(&light, scene, dg, TEXTURE_ARGS, sample, bxdf_flags, interaction_type, wo, pdf);
         case kArea:
             return AreaLight_Sample(&light, scene, dg, TEXTURE_ARGS, sample, wo, pdf);
+        case kMesh:
+            return MeshLight_Sample(&light, scene, dg, TEXTURE_ARGS, sample, wo, pdf);
         case kDirectional:
             return DirectionalLight_Sample(&light, scene, dg, TEXTURE_ARGS, sample, wo, pdf);
         case kPoint:
@@ -0,0 +1,144 @@
+/**********************************************************************
+Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#ifndef LIGHT_BVH_CL
+#define LIGHT_BVH_CL
+
+#include <../Baikal/Kernels/CL/common.cl>
+#include <../Baikal/Kernels/CL/payload.cl>
+
+/// cos(a - b) clamped to 1 if a < b, angles are passed as sines and cosines
+INLINE float LightBvh_CosSubClamped(float sin_a, float cos_a, float sin_b, float cos_b)
+{
+    return cos_a > cos_b ? 1.f : cos_a * cos_b + sin_a * sin_b;
+}
+
+/// Estimated contribution of node lights to point p, matches LightBvh::Importance
+float LightBvh_Importance(GLOBAL LightBvhNode const* restrict node, float3 p)
+{
+    if (node->power <= 0.f)
+    {
+        return 0.f;
+    }
+
+    float3 center = 0.5f * (node->bbox_min + node->bbox_max);
+    float3 extents = node->bbox_max - node->bbox_min;
+    float3 d = p - center;
+    float dist2 = dot(d, d);
+    float d2 = max(max(dist2, 0.5f * length(extents)), 1e-6f);
+
+    // Angle between cone axis and direction to p
+    float cos_theta_w = dist2 > 0.f ? dot(node->axis, d) / sqrt(dist2) : 1.f;
+    float sin_theta_w = sqrt(max(1.f - cos_theta_w * cos_theta_w, 0.f));
+
+    // Angle subtended by bounds as seen from p
+    float radius2 = 0.25f * dot(extents, extents);
+    float cos_theta_b = dist2 > radius2 ? sqrt(max(1.f - radius2 / dist2, 0.f)) : -1.f;
+    float sin_theta_b = sqrt(max(1.f - cos_theta_b * cos_theta_b, 0.f));
+
+    // Minimal angle between emission directions and direction to p
+    float sin_theta_o = sqrt(max(1.f - node->cos_theta_o * node->cos_theta_o, 0.f));
+    float cos_theta_x = LightBvh_CosSubClamped(sin_theta_w, cos_theta_w, sin_theta_o, node->cos_theta_o);
+    float sin_theta_x = sqrt(max(1.f - cos_theta_x * cos_theta_x, 0.f));
+    float cos_theta_p = LightBvh_CosSubClamped(sin_theta_x, cos_theta_x, sin_theta_b, cos_theta_b);
+
+    if (cos_theta_p <= node->cos_theta_e)
+    {
+        return 0.f;
+    }
+
+    return node->power * cos_theta_p / d2;
+}
+
+/// Picks light for point p descending from the root and choosing children proportionally
+/// to their importance. Returns -1 if no light contributes to p.
+int LightBvh_Sample(GLOBAL LightBvhNode const* restrict nodes, float3 p, float s, float* pdf)
+{
+    *pdf = 0.f;
+
+    // Single light is picked if it contributes to p, matching LightBvh_GetPdf
+    if (nodes[0].light_idx != -1 && LightBvh_Importance(nodes, p) <= 0.f)
+    {
+        return -1;
+    }
+
+    int node_idx = 0;
+    float node_pdf = 1.f;
+
+    while (nodes[node_idx].light_idx == -1)
+    {
+        int left = nodes[node_idx].left;
+        int right = nodes[node_idx].right;
+        float importance_left = LightBvh_Importance(nodes + left, p);
+        float importance_right = LightBvh_Importance(nodes + right, p);
+
+        if (importance_left + importance_right <= 0.f)
+        {
+            return -1;
+        }
+
+        float p_left = importance_left / (importance_left + importance_right);
+        if (s < p_left)
+        {
+            s = min(s / p_left, 0.99999994f);
+            node_pdf *= p_left;
+            node_idx = left;
+        }
+        else
+        {
+            s = min((s - p_left) / (1.f - p_left), 0.99999994f);
+            node_pdf *= 1.f - p_left;
+            node_idx = right;
+        }
+    }
+
+    *pdf = node_pdf;
+    return nodes[node_idx].light_idx;
+}
+
+/// Probability of picking leaf node for point p
+float LightBvh_GetPdf(GLOBAL LightBvhNode const* restrict nodes, int leaf, float3 p)
+{
+    float importance = LightBvh_Importance(nodes + leaf, p);
+    if (importance <= 0.f)
+    {
+        return 0.f;
+    }
+
+    float pdf = 1.f;
+    int node_idx = leaf;
+
+    while (nodes[node_idx].parent != -1)
+    {
+        int parent = nodes[node_idx].parent;
+        int sibling = nodes[parent].left == node_idx ? nodes[parent].right : nodes[parent].left;
+        float importance_sibling = LightBvh_Importance(nodes + sibling, p);
+
+        pdf *= importance / (importance + importance_sibling);
+
+        node_idx = parent;
+        importance = LightBvh_Importance(nodes + node_idx, p);
+    }
+
+    return pdf;
+}
+
+#endif // LIGHT_BVH_CL
@@ -118,7 +118,8 @@ void PerspectiveCamera_GeneratePaths(
         // Set ray max
         my_ray->extra.x = 0xFFFFFFFF;
         my_ray->extra.y = 0xFFFFFFFF;
-        Ray_SetExtra(my_ray, 1.f);
+        // Pixel spread angle for texture filtering
+        Ray_SetExtra(my_ray, make_float2(1.f, camera->dim.y / (camera->focal_length * output_height)));
         Ray_SetMask(my_ray, VISIBILITY_MASK_PRIMARY);
     }
 }
@@ -214,7 +215,8 @@ KERNEL void PerspectiveCameraDof_GeneratePaths(
         // Set ray max
         my_ray->extra.x = 0xFFFFFFFF;
         my_ray->extra.y = 0xFFFFFFFF;
-        Ray_SetExtra(my_ray, 1.f);
+        // Pixel spread angle for texture filtering
+        Ray_SetExtra(my_ray, make_float2(1.f, camera->dim.y / (camera->focal_length * output_height)));
         Ray_SetMask(my_ray, VISIBILITY_MASK_PRIMARY);
     }
 }
@@ -331,6 +333,7 @@ void PerspectiveCamera_GenerateVertices(
         my_path->volume = -1;
         my_path->flags = 0;
         my_path->active = 0xFF;
+        my_path->start_pass = 0;
     }
 }
 
@@ -452,6 +455,7 @@ void PerspectiveCameraDof_GenerateVertices(
         my_path->volume = -1;
         my_path->flags = 0;
         my_path->active = 0xFF;
+        my_path->start_pass = 0;
     }
 }
 
@@ -620,6 +624,47 @@ KERNEL void AccumulateData(
     }
 }
 
+// Move accumulated data of a tile into packed tile buffer and clear it
+KERNEL void ResolveTile(
+    GLOBAL float4* restrict data,
+    int output_width,
+    int offset_x,
+    int offset_y,
+    int width,
+    int height,
+    GLOBAL float4* restrict tile_data
+)
+{
+    int global_id = get_global_id(0);
+
+    if (global_id < width * height)
+    {
+        int idx = (offset_y + global_id / width) * output_width + offset_x + global_id % width;
+        tile_data[global_id] = data[idx];
+        data[idx] = 0.f;
+    }
+}
+
+// Add packed tile buffer into accumulated data
+KERNEL void AccumulateTile(
+    GLOBAL float4 const* restrict tile_data,
+    int output_width,
+    int offset_x,
+    int offset_y,
+    int width,
+    int height,
+    GLOBAL float4* restrict data
+)
+{
+    int global_id = get_global_id(0);
+
+    if (global_id < width * height)
+    {
+        int idx = (offset_y + global_id / width) * output_width + offset_x + global_id % width;
+        data[idx] += tile_data[global_id];
+    }
+}
+
 //#define ADAPTIVITY_DEBUG
 // Copy data to interop texture if supported
 KERNEL void ApplyGammaAndCopyData(
@@ -810,6 +855,98 @@ KERNEL void EstimateVariance(
     }
 }
 
+// Offset to the mean in relative error, keeps dark pixels from never converging
+#define CONVERGENCE_LUMINANCE_EPS 1e-3f
+
+// Write tile pixel indices and mark pixels which have not converged yet,
+// marked pixels are compacted into the list of pixels to sample this iteration
+KERNEL void MarkActivePixels(
+    int output_width,
+    int offset_x,
+    int offset_y,
+    int width,
+    int height,
+    // Per pixel luminance mean, sum of squared deviations, relative error, number of samples
+    GLOBAL float4 const* restrict moments,
+    float threshold,
+    int min_samples,
+    GLOBAL int* restrict indices,
+    GLOBAL int* restrict predicates,
+    GLOBAL int* restrict num_active
+)
+{
+    __local int lds_count;
+
+    int global_id = get_global_id(0);
+
+    if (get_local_id(0) == 0)
+    {
+        lds_count = 0;
+    }
+
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    if (global_id < width * height)
+    {
+        int idx = (offset_y + global_id / width) * output_width + offset_x + global_id % width;
+        float4 m = moments[idx];
+        int active = (m.w < (float)min_samples || m.z > threshold) ? 1 : 0;
+
+        indices[global_id] = idx;
+        predicates[global_id] = active;
+
+        if (active)
+        {
+            atomic_inc(&lds_count);
+        }
+    }
+
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    if (get_local_id(0) == 0 && lds_count > 0)
+    {
+        atomic_add(num_active, lds_count);
+    }
+}
+
+// Accumulate single sample per active pixel and update its running
+// luminance statistics (Welford), optionally writing relative error AOV
+KERNEL void AccumulateSampleMoments(
+    GLOBAL float4 const* restrict src_sample_data,
+    GLOBAL float4* restrict dst_accumulation_data,
+    GLOBAL float4* restrict moments,
+    GLOBAL int const* restrict scatter_indices,
+    GLOBAL int const* restrict num_elements,
+    int write_error,
+    GLOBAL float4* restrict error_data
+)
+{
+    int global_id = get_global_id(0);
+
+    if (global_id < *num_elements)
+    {
+        int idx = scatter_indices[global_id];
+        float4 sample = src_sample_data[global_id];
+        dst_accumulation_data[idx].xyz += sample.xyz;
+        dst_accumulation_data[idx].w += 1.f;
+
+        float value = luminance(sample.xyz);
+        float4 m = moments[idx];
+        m.w += 1.f;
+        float delta = value - m.x;
+        m.x += delta / m.w;
+        m.y += delta * (value - m.x);
+        // Standard error of the mean relative to the mean
+        m.z = m.w > 1.f ? native_sqrt(m.y / (m.w * (m.w - 1.f))) / (fabs(m.x) + CONVERGENCE_LUMINANCE_EPS) : MAXFLOAT;
+        moments[idx] = m;
+
+        if (write_error)
+        {
+            error_data[idx] = make_float4(m.z, m.z, m.z, 1.f);
+        }
+    }
+}
+
 KERNEL
 void  OrthographicCamera_GeneratePaths(
                                      // Camera
@@ -892,7 +1029,7 @@ void  OrthographicCamera_GeneratePaths(
         // Set ray max
         my_ray->extra.x = 0xFFFFFFFF;
         my_ray->extra.y = 0xFFFFFFFF;
-        Ray_SetExtra(my_ray, 1.f);
+        Ray_SetExtra(my_ray, make_float2(1.f, 0.f));
         Ray_SetMask(my_ray, VISIBILITY_MASK_PRIMARY);
     }
 }
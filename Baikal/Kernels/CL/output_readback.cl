@@ -0,0 +1,121 @@
+/**********************************************************************
+Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#ifndef OUTPUT_READBACK_CL
+#define OUTPUT_READBACK_CL
+
+#include <../Baikal/Kernels/CL/common.cl>
+
+// Output formats, see Output::Format
+#define OUTPUT_FORMAT_RGBA32F 0
+#define OUTPUT_FORMAT_R32F 1
+#define OUTPUT_FORMAT_RG16F 2
+#define OUTPUT_FORMAT_RGBA16F 3
+#define OUTPUT_FORMAT_R32UI 4
+
+// Load pixel of output as float4, packed formats get w of 1
+INLINE float4 Output_Load(GLOBAL void const* restrict data, int format, int idx)
+{
+    switch (format)
+    {
+    case OUTPUT_FORMAT_R32F:
+    {
+        float value = ((GLOBAL float const*)data)[idx];
+        return make_float4(value, value, value, 1.f);
+    }
+    case OUTPUT_FORMAT_RG16F:
+    {
+        float2 value = vload_half2(idx, (GLOBAL half const*)data);
+        return make_float4(value.x, value.y, 0.f, 1.f);
+    }
+    case OUTPUT_FORMAT_RGBA16F:
+    {
+        float4 value = vload_half4(idx, (GLOBAL half const*)data);
+        value.w = 1.f;
+        return value;
+    }
+    case OUTPUT_FORMAT_R32UI:
+    {
+        uint id = ((GLOBAL uint const*)data)[idx];
+        float value = id == 0xffffffffu ? -1.f : (float)id;
+        return make_float4(value, value, value, 1.f);
+    }
+    default:
+        return ((GLOBAL float4 const*)data)[idx];
+    }
+}
+
+// Resolve output into tightly packed image for readback:
+// normalize by sample count, apply gamma, flip rows and keep first channels
+KERNEL void ResolveOutput(
+    // Output data
+    GLOBAL void const* restrict src,
+    // Output format
+    int format,
+    // Output size
+    int width,
+    int height,
+    // Number of channels to keep (1 - 4)
+    int channels,
+    // Divide by sample count stored in w
+    int normalize,
+    // 1 / gamma, 1 keeps values linear
+    float inv_gamma,
+    // Store rows bottom to top
+    int flip_y,
+    // Packed image
+    GLOBAL float* restrict dst
+)
+{
+    int global_id = get_global_id(0);
+
+    if (global_id >= width * height)
+    {
+        return;
+    }
+
+    int x = global_id % width;
+    int y = global_id / width;
+
+    float4 value = Output_Load(src, format, global_id);
+
+    if (normalize)
+    {
+        value = value.w > 0.f ? value / value.w : make_float4(0.f, 0.f, 0.f, 0.f);
+    }
+
+    if (inv_gamma != 1.f)
+    {
+        value.xyz = native_powr(max(value.xyz, 0.f), inv_gamma);
+    }
+
+    float components[4] = { value.x, value.y, value.z, value.w };
+
+    int dst_y = flip_y ? height - 1 - y : y;
+    GLOBAL float* pixel = dst + (dst_y * width + x) * channels;
+
+    for (int i = 0; i < channels; ++i)
+    {
+        pixel[i] = components[i];
+    }
+}
+
+#endif // OUTPUT_READBACK_CL
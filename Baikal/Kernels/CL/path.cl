@@ -32,7 +32,11 @@ typedef struct _Path
     int volume;
     int flags;
     int active;
-    int extra1;
+    // Spread angle of the ray cone used for texture filtering
+    float cone_spread;
+    // Pass of the estimator the path has been started at (non-zero for regenerated paths)
+    int start_pass;
+    int padding[3];
 } Path;
 
 typedef enum _PathFlags
@@ -103,6 +107,39 @@ INLINE void Path_SetVolumeIdx(__global Path* path, int volume_idx)
     path->volume = volume_idx;
 }
 
+INLINE float Path_GetConeSpread(__global Path const* path)
+{
+    return path->cone_spread;
+}
+
+INLINE void Path_SetConeSpread(__global Path* path, float cone_spread)
+{
+    path->cone_spread = cone_spread;
+}
+
+// Bounce of the path at given pass, regenerated paths count bounces from their start
+INLINE int Path_GetBounce(__global Path const* path, int pass)
+{
+    return pass - path->start_pass;
+}
+
+// Sampler scramble of the path, so regenerated paths of a pixel don't repeat its first sample
+INLINE uint Path_GetScramble(__global Path const* path, uint scramble)
+{
+    return scramble ^ ((uint)path->start_pass * 0x9e3779b9u);
+}
+
+// Start new path at given pass
+INLINE void Path_Init(__global Path* path, int volume_idx, int pass)
+{
+    path->throughput = make_float3(1.f, 1.f, 1.f);
+    path->volume = volume_idx;
+    path->flags = 0;
+    path->active = 0xFF;
+    path->cone_spread = 0.f;
+    path->start_pass = pass;
+}
+
 INLINE float3 Path_GetThroughput(__global Path const* path)
 {
     float3 t = path->throughput;
@@ -53,10 +53,7 @@ void InitPathData(
         dst_index[global_id] = src_index[global_id];
 
         // Initalize path data
-        my_path->throughput = make_float3(1.f, 1.f, 1.f);
-        my_path->volume = world_volume_idx;
-        my_path->flags = 0;
-        my_path->active = 0xFF;
+        Path_Init(my_path, world_volume_idx, 0);
     }
 }
 
@@ -251,6 +248,115 @@ KERNEL void RestorePixelIndices(
     }
 }
 
+///< Find material queue of each hit and count hits in queues
+KERNEL void BinHitsByMaterial(
+    // Intersections
+    GLOBAL Intersection const* restrict isects,
+    // Hit indices
+    GLOBAL int const* restrict hit_indices,
+    // Number of hits
+    GLOBAL int const* restrict num_hits,
+    // Shapes
+    GLOBAL Shape const* restrict shapes,
+    // Sorted material layer masks of queues
+    GLOBAL int const* restrict queue_layers,
+    // Number of specialized queues, hits with unknown layers go to queue num_queues
+    int num_queues,
+    // Queue of each hit
+    GLOBAL int* restrict queues,
+    // Number of hits in each queue
+    GLOBAL int* restrict queue_counts
+)
+{
+    int global_id = get_global_id(0);
+
+    // Handle only working subset
+    if (global_id < *num_hits)
+    {
+        int hit_idx = hit_indices[global_id];
+        int layers = shapes[isects[hit_idx].shapeid - 1].material.layers;
+
+        // Binary search for layer mask
+        int lo = 0;
+        int hi = num_queues;
+        while (lo < hi)
+        {
+            int mid = (lo + hi) >> 1;
+
+            if (queue_layers[mid] < layers)
+            {
+                lo = mid + 1;
+            }
+            else
+            {
+                hi = mid;
+            }
+        }
+
+        int queue = (lo < num_queues && queue_layers[lo] == layers) ? lo : num_queues;
+        queues[global_id] = queue;
+        atomic_inc(&queue_counts[queue]);
+    }
+}
+
+///< Calculate queue offsets from queue counts, counts are reset to be used as cursors
+KERNEL void ScanMaterialQueues(
+    // Number of hits in each queue
+    GLOBAL int* restrict queue_counts,
+    // Number of queues
+    int num_queues,
+    // Queue offsets (num_queues + 1 entries)
+    GLOBAL int* restrict queue_offsets
+)
+{
+    // Number of queues is small, so single work item is enough
+    if (get_global_id(0) == 0)
+    {
+        int sum = 0;
+        for (int i = 0; i < num_queues; ++i)
+        {
+            queue_offsets[i] = sum;
+            sum += queue_counts[i];
+            queue_counts[i] = 0;
+        }
+
+        queue_offsets[num_queues] = sum;
+    }
+}
+
+///< Scatter hit and pixel indices into material queues
+KERNEL void ScatterHitsByMaterial(
+    // Hit indices
+    GLOBAL int const* restrict hit_indices,
+    // Pixel indices
+    GLOBAL int const* restrict pixel_indices,
+    // Number of hits
+    GLOBAL int const* restrict num_hits,
+    // Queue of each hit
+    GLOBAL int const* restrict queues,
+    // Queue offsets
+    GLOBAL int const* restrict queue_offsets,
+    // Queue cursors
+    GLOBAL int* restrict queue_cursors,
+    // Sorted hit indices
+    GLOBAL int* restrict sorted_hit_indices,
+    // Sorted pixel indices
+    GLOBAL int* restrict sorted_pixel_indices
+)
+{
+    int global_id = get_global_id(0);
+
+    // Handle only working subset
+    if (global_id < *num_hits)
+    {
+        int queue = queues[global_id];
+        int idx = queue_offsets[queue] + atomic_inc(&queue_cursors[queue]);
+
+        sorted_hit_indices[idx] = hit_indices[global_id];
+        sorted_pixel_indices[idx] = pixel_indices[global_id];
+    }
+}
+
 ///< Restore pixel indices after compaction
 KERNEL void FilterPathStream(
     // Intersections
@@ -338,7 +444,7 @@ KERNEL void ShadeMiss(
             // Apply MIS
             int bxdf_flags = Path_GetBxdfFlags(path);
             float selection_pdf = Distribution1D_GetPdfDiscreet(env_light_idx, light_distribution);
-            float light_pdf = EnvironmentLight_GetPdf(&light, 0, 0, bxdf_flags, kLightInteractionSurface, rays[global_id].d.xyz, TEXTURE_ARGS);
+            float light_pdf = EnvironmentLight_GetDistributionPdf(&light, light_distribution, bxdf_flags, kLightInteractionSurface, rays[global_id].d.xyz);
             float2 extra = Ray_GetExtra(&rays[global_id]);
             float weight = extra.x > 0.f ? BalanceHeuristic(1, extra.x, 1, light_pdf * selection_pdf) : 1.f;
 
@@ -380,5 +486,144 @@ KERNEL void AdvanceIterationCount(
     }
 }
 
-#endif
+///< Terminate paths which reached max number of bounces and restart dead ones from camera rays
+KERNEL void TerminateAndRestartPaths(
+    // Camera rays of the batch
+    GLOBAL ray const* restrict camera_rays,
+    // Pixel indices
+    GLOBAL int const* restrict pixel_indices,
+    // Output indices
+    GLOBAL int const* restrict output_indices,
+    // Number of rays
+    GLOBAL int const* restrict num_rays,
+    // Current pass
+    int pass,
+    // Max number of bounces
+    int max_bounces,
+    // 1 if dead paths should be restarted
+    int restart,
+    // Camera volume
+    int camera_volume_idx,
+    // Paths
+    GLOBAL Path* restrict paths,
+    // Rays of the next pass
+    GLOBAL ray* restrict rays,
+    // Set for pixels having a ray in the next pass
+    GLOBAL int* restrict has_ray,
+    // Output values
+    GLOBAL float4* restrict output
+)
+{
+    int global_id = get_global_id(0);
 
+    // Handle only working subset
+    if (global_id < *num_rays)
+    {
+        int pixel_idx = pixel_indices[global_id];
+        GLOBAL Path* path = paths + pixel_idx;
+
+        if (Path_IsAlive(path) && Path_GetBounce(path, pass) + 1 >= max_bounces)
+        {
+            Path_Kill(path);
+            Ray_SetInactive(rays + global_id);
+        }
+
+        if (restart && !Path_IsAlive(path))
+        {
+            // New sample for the pixel
+            rays[global_id] = camera_rays[pixel_idx];
+            Path_Init(path, camera_volume_idx, pass + 1);
+
+            float4 v = make_float4(0.f, 0.f, 0.f, 1.f);
+            ADD_FLOAT4(&output[output_indices[pixel_idx]], v);
+        }
+
+        has_ray[pixel_idx] = 1;
+    }
+}
+
+///< Find pixels to be restarted which don't have a ray in the next pass
+KERNEL void FilterPathsToRegenerate(
+    // Pixels which can be restarted
+    GLOBAL int const* restrict candidates,
+    // Number of candidates
+    GLOBAL int const* restrict num_candidates,
+    // Set for pixels having a ray in the next pass
+    GLOBAL int const* restrict has_ray,
+    // Number of pixels
+    int num_pixels,
+    // Predicate
+    GLOBAL int* restrict predicate
+)
+{
+    int global_id = get_global_id(0);
+
+    if (global_id < num_pixels)
+    {
+        predicate[global_id] = (global_id < *num_candidates) && !has_ray[candidates[global_id]];
+    }
+}
+
+///< Append restarted paths after rays of the next pass
+KERNEL void AppendRegeneratedPaths(
+    // Camera rays of the batch
+    GLOBAL ray const* restrict camera_rays,
+    // Pixels which can be restarted
+    GLOBAL int const* restrict candidates,
+    // Indices of candidates to restart
+    GLOBAL int const* restrict compacted_indices,
+    // Number of paths to restart
+    GLOBAL int const* restrict num_regenerated,
+    // Output indices
+    GLOBAL int const* restrict output_indices,
+    // Number of rays
+    GLOBAL int const* restrict num_rays,
+    // Max number of rays
+    int max_rays,
+    // Current pass
+    int pass,
+    // Camera volume
+    int camera_volume_idx,
+    // Paths
+    GLOBAL Path* restrict paths,
+    // Pixel indices
+    GLOBAL int* restrict pixel_indices,
+    // Rays of the next pass
+    GLOBAL ray* restrict rays,
+    // Output values
+    GLOBAL float4* restrict output
+)
+{
+    int global_id = get_global_id(0);
+    int idx = *num_rays + global_id;
+
+    if (global_id < *num_regenerated && idx < max_rays)
+    {
+        int pixel_idx = candidates[compacted_indices[global_id]];
+
+        rays[idx] = camera_rays[pixel_idx];
+        pixel_indices[idx] = pixel_idx;
+        Path_Init(paths + pixel_idx, camera_volume_idx, pass + 1);
+
+        float4 v = make_float4(0.f, 0.f, 0.f, 1.f);
+        ADD_FLOAT4(&output[output_indices[pixel_idx]], v);
+    }
+}
+
+///< Account for appended paths in ray count
+KERNEL void AddRegeneratedRays(
+    // Number of appended paths
+    GLOBAL int const* restrict num_regenerated,
+    // Max number of rays
+    int max_rays,
+    // Number of rays
+    GLOBAL int* restrict num_rays
+)
+{
+    if (get_global_id(0) == 0)
+    {
+        *num_rays = min(*num_rays + *num_regenerated, max_rays);
+    }
+}
+
+#endif
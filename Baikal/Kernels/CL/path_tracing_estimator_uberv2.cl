@@ -52,13 +52,13 @@ KERNEL void ShadeVolumeUberV2(
     // Number of rays
     GLOBAL int const*  restrict num_hits,
     // Vertices
-    GLOBAL float3 const* restrict vertices,
+    GLOBAL GeometryPosition const* restrict vertices,
     // Normals
-    GLOBAL float3 const* restrict normals,
+    GLOBAL GeometryNormal const* restrict normals,
     // UVs
-    GLOBAL float2 const* restrict uvs,
+    GLOBAL GeometryUV const* restrict uvs,
     // Indices
-    GLOBAL int const* restrict indices,
+    GLOBAL GeometryIndex const* restrict indices,
     // Shapes
     GLOBAL Shape const* restrict shapes,
     // Material parameters
@@ -71,6 +71,10 @@ KERNEL void ShadeVolumeUberV2(
     GLOBAL Light const* restrict lights,
     // Light distribution
     GLOBAL int const* restrict light_distribution,
+    // Light BVH
+    GLOBAL LightBvhNode const* restrict light_bvh,
+    // Light indices of emissive primitives
+    GLOBAL int const* restrict emissive_lights,
     // Number of emissive objects
     int num_lights,
     // RNG seed
@@ -112,7 +116,9 @@ KERNEL void ShadeVolumeUberV2(
         lights,
         env_light_idx,
         num_lights,
-        light_distribution
+        light_distribution,
+        light_bvh,
+        emissive_lights
     };
 
     if (global_id < *num_hits)
@@ -134,16 +140,18 @@ KERNEL void ShadeVolumeUberV2(
         float3 o = rays[hit_idx].o.xyz;
         float3 wi = -rays[hit_idx].d.xyz;
 
+        bounce = Path_GetBounce(path, bounce);
+
         Sampler sampler;
 #if SAMPLER == SOBOL
-        uint scramble = random[pixel_idx] * 0x1fe3434f;
+        uint scramble = Path_GetScramble(path, random[pixel_idx] * 0x1fe3434f);
         Sampler_Init(&sampler, frame, SAMPLE_DIM_SURFACE_OFFSET + bounce * SAMPLE_DIMS_PER_BOUNCE + SAMPLE_DIM_VOLUME_EVALUATE_OFFSET, scramble);
 #elif SAMPLER == RANDOM
         uint scramble = pixel_idx * rng_seed;
         Sampler_Init(&sampler, scramble);
 #elif SAMPLER == CMJ
         uint rnd = random[pixel_idx];
-        uint scramble = rnd * 0x1fe3434f * ((frame + 13 * rnd) / (CMJ_DIM * CMJ_DIM));
+        uint scramble = Path_GetScramble(path, rnd * 0x1fe3434f * ((frame + 13 * rnd) / (CMJ_DIM * CMJ_DIM)));
         Sampler_Init(&sampler, frame % (CMJ_DIM * CMJ_DIM), SAMPLE_DIM_SURFACE_OFFSET + bounce * SAMPLE_DIMS_PER_BOUNCE + SAMPLE_DIM_VOLUME_EVALUATE_OFFSET, scramble);
 #endif
 
@@ -157,16 +165,23 @@ KERNEL void ShadeVolumeUberV2(
         float selection_pdf = 0.f;
         float3 wo;
 
-        int light_idx = Scene_SampleLight(&scene, Sampler_Sample1D(&sampler, SAMPLER_ARGS), &selection_pdf);
-
         // Here we need fake differential geometry for light sampling procedure
         DifferentialGeometry dg;
         // put scattering position in there (it is along the current ray at isect.distance
         // since EvaluateVolume has put it there
         dg.p = o - wi * Intersection_GetDistance(isects + hit_idx);
+
+        int light_idx = Scene_SampleLight(&scene, dg.p, Sampler_Sample1D(&sampler, SAMPLER_ARGS), &selection_pdf);
+
         // Get light sample intencity
         int bxdf_flags = Path_GetBxdfFlags(path); 
-        float3 le = Light_Sample(light_idx, &scene, &dg, TEXTURE_ARGS, Sampler_Sample2D(&sampler, SAMPLER_ARGS), bxdf_flags, kLightInteractionVolume, &wo, &pdf);
+        float2 light_sample = Sampler_Sample2D(&sampler, SAMPLER_ARGS);
+        float3 le = 0.f;
+        wo = make_float3(0.f, 1.f, 0.f);
+        if (light_idx > -1)
+        {
+            le = Light_Sample(light_idx, &scene, &dg, TEXTURE_ARGS, light_sample, bxdf_flags, kLightInteractionVolume, &wo, &pdf);
+        }
 
         // Generate shadow ray
         float shadow_ray_length = length(wo); 
@@ -176,7 +191,7 @@ KERNEL void ShadeVolumeUberV2(
         // Evaluate volume transmittion along the shadow ray (it is incorrect if the light source is outside of the
         // current volume, but in this case it will be discarded anyway since the intersection at the outer bound
         // of a current volume), so the result is fully correct.
-        float3 tr = 1.f;// Volume_Transmittance(&volumes[volume_idx], &shadow_rays[global_id], shadow_ray_length);
+        float3 tr = 1.f;// Volume_Transmittance(&volumes[volume_idx], &shadow_rays[global_id], shadow_ray_length, VOLUME_ARGS, &sampler);
         float3 emission = 0.f;// Volume_Emission(&volumes[volume_idx], &shadow_rays[global_id], shadow_ray_length);
 
         // Volume emission is applied only if the light source is in the current volume(this is incorrect since the light source might be
@@ -186,7 +201,10 @@ KERNEL void ShadeVolumeUberV2(
         float g = volumes[volume_idx].g;
         // This is the estimate coming from a light source
         // TODO: remove hardcoded phase func and sigma 
-        r += tr * le  * PhaseFunctionHG(wi, normalize(wo), g) / pdf / selection_pdf; 
+        if (pdf > 0.f && selection_pdf > 0.f)
+        {
+            r += tr * le  * PhaseFunctionHG(wi, normalize(wo), g) / pdf / selection_pdf; 
+        }
         r += tr * emission;
 
         // Only if we have some radiance compute the visibility ray  
@@ -224,7 +242,8 @@ KERNEL void ShadeVolumeUberV2(
 
 
 // Handle ray-surface interaction possibly generating path continuation.
-// This is only applied to non-scattered paths.
+// This is only applied to non-scattered paths. If hits are sorted by material
+// kernel is launched once per queue, optionally specialized with UBERV2_LAYERS.
 KERNEL void ShadeSurfaceUberV2(
     // Ray batch
     GLOBAL ray const* restrict rays,
@@ -238,14 +257,18 @@ KERNEL void ShadeSurfaceUberV2(
     GLOBAL int const*  restrict output_indices,
     // Number of rays
     GLOBAL int const* restrict num_hits,
+    // Offsets of material queues
+    GLOBAL int const* restrict queue_offsets,
+    // Material queue to shade or -1 to shade all hits
+    int queue,
     // Vertices
-    GLOBAL float3 const* restrict vertices,
+    GLOBAL GeometryPosition const* restrict vertices,
     // Normals
-    GLOBAL float3 const* restrict normals,
+    GLOBAL GeometryNormal const* restrict normals,
     // UVs
-    GLOBAL float2 const* restrict uvs,
+    GLOBAL GeometryUV const* restrict uvs,
     // Indices
-    GLOBAL int const* restrict indices,
+    GLOBAL GeometryIndex const* restrict indices,
     // Shapes
     GLOBAL Shape const* restrict shapes,
     // Materials
@@ -258,6 +281,10 @@ KERNEL void ShadeSurfaceUberV2(
     GLOBAL Light const* restrict lights,
     // Light distribution
     GLOBAL int const* restrict light_distribution,
+    // Light BVH
+    GLOBAL LightBvhNode const* restrict light_bvh,
+    // Light indices of emissive primitives
+    GLOBAL int const* restrict emissive_lights,
     // Number of emissive objects
     int num_lights,
     // RNG seed
@@ -286,6 +313,14 @@ KERNEL void ShadeSurfaceUberV2(
 )
 {
     int global_id = get_global_id(0);
+    int num_items = *num_hits;
+
+    // Hits are sorted by material, shade only the range of one queue
+    if (queue >= 0)
+    {
+        global_id += queue_offsets[queue];
+        num_items = queue_offsets[queue + 1];
+    }
 
     Scene scene =
     {
@@ -299,11 +334,13 @@ KERNEL void ShadeSurfaceUberV2(
         lights,
         env_light_idx,
         num_lights,
-        light_distribution
+        light_distribution,
+        light_bvh,
+        emissive_lights
     };
 
     // Only applied to active rays after compaction
-    if (global_id < *num_hits)
+    if (global_id < num_items)
     {
         // Fetch index
         int hit_idx = hit_indices[global_id];
@@ -321,22 +358,40 @@ KERNEL void ShadeSurfaceUberV2(
         // Fetch incoming ray direction
         float3 wi = -normalize(rays[hit_idx].d.xyz);
 
+        bounce = Path_GetBounce(path, bounce);
+
         Sampler sampler;
 #if SAMPLER == SOBOL
-        uint scramble = random[pixel_idx] * 0x1fe3434f;
+        uint scramble = Path_GetScramble(path, random[pixel_idx] * 0x1fe3434f);
         Sampler_Init(&sampler, frame, SAMPLE_DIM_SURFACE_OFFSET + bounce * SAMPLE_DIMS_PER_BOUNCE, scramble);
 #elif SAMPLER == RANDOM
         uint scramble = pixel_idx * rng_seed;
         Sampler_Init(&sampler, scramble);
 #elif SAMPLER == CMJ
         uint rnd = random[pixel_idx];
-        uint scramble = rnd * 0x1fe3434f * ((frame + 331 * rnd) / (CMJ_DIM * CMJ_DIM));
+        uint scramble = Path_GetScramble(path, rnd * 0x1fe3434f * ((frame + 331 * rnd) / (CMJ_DIM * CMJ_DIM)));
         Sampler_Init(&sampler, frame % (CMJ_DIM * CMJ_DIM), SAMPLE_DIM_SURFACE_OFFSET + bounce * SAMPLE_DIMS_PER_BOUNCE, scramble);
 #endif
 
         // Fill surface data
         DifferentialGeometry diffgeo;
         Scene_FillDifferentialGeometry(&scene, &isect, &diffgeo);
+#ifdef UBERV2_LAYERS
+        // All hits of the queue share material layers, make them
+        // compile time constant to drop unused BxDF branches
+        diffgeo.mat.layers = UBERV2_LAYERS;
+#endif
+
+        // Propagate ray cone to the hit point to get texture footprint.
+        // Primary rays start with zero width and carry camera spread angle instead.
+        float2 ray_extra = Ray_GetExtra(&rays[hit_idx]);
+        if (bounce == 0)
+        {
+            Path_SetConeSpread(path, ray_extra.y);
+        }
+        float cone_spread = Path_GetConeSpread(path);
+        float cone_width = (bounce == 0 ? 0.f : ray_extra.y) + cone_spread * isect.uvwt.w;
+        Scene_CalculateTextureFootprint(&scene, &isect, wi, cone_width, &diffgeo);
 
         // Check if we are hitting from the inside
         float ngdotwi = dot(diffgeo.ng, wi);
@@ -372,8 +427,9 @@ KERNEL void ShadeSurfaceUberV2(
                     float2 extra = Ray_GetExtra(&rays[hit_idx]);
                     float ld = isect.uvwt.w;
                     float denom = fabs(dot(diffgeo.n, wi)) * diffgeo.area;
-                    // TODO: num_lights should be num_emissies instead, presence of analytical lights breaks this code
-                    float bxdf_light_pdf = denom > 0.f ? (ld * ld / denom / num_lights) : 0.f;
+                    // Light selection pdf depends on the previous vertex, which is the ray origin
+                    float selection_pdf = Scene_GetEmissivePdf(&scene, isect.shapeid - 1, isect.primid, rays[hit_idx].o.xyz);
+                    float bxdf_light_pdf = denom > 0.f ? (ld * ld / denom * selection_pdf) : 0.f;
                     weight = extra.x > 0.f ? BalanceHeuristic(1, extra.x, 1, bxdf_light_pdf) : 1.f;
                 }
 
@@ -420,7 +476,7 @@ KERNEL void ShadeSurfaceUberV2(
         float bxdf_weight = 1.f;
         float light_weight = 1.f;
 
-        int light_idx = Scene_SampleLight(&scene, Sampler_Sample1D(&sampler, SAMPLER_ARGS), &selection_pdf);
+        int light_idx = Scene_SampleLight(&scene, diffgeo.p, Sampler_Sample1D(&sampler, SAMPLER_ARGS), &selection_pdf);
 
         float3 throughput = Path_GetThroughput(path);
 
@@ -496,7 +552,15 @@ KERNEL void ShadeSurfaceUberV2(
             int indirect_ray_mask = VISIBILITY_MASK_BOUNCE(bounce + 1);
 
             Ray_Init(indirect_rays + global_id, indirect_ray_o, indirect_ray_dir, CRAZY_HIGH_DISTANCE, 0.f, indirect_ray_mask);
-            Ray_SetExtra(indirect_rays + global_id, make_float2(Bxdf_IsSingular(&diffgeo) ? 0.f : bxdf_pdf, 0.f));
+            Ray_SetExtra(indirect_rays + global_id, make_float2(Bxdf_IsSingular(&diffgeo) ? 0.f : bxdf_pdf, cone_width));
+
+            // Widen the cone after glossy and diffuse bounces:
+            // lobe solid angle is roughly 1 / pdf, so half angle is sqrt(1 / (pi * pdf))
+            if (!Bxdf_IsSingular(&diffgeo))
+            {
+                float lobe_spread = 2.f * native_sqrt(1.f / (PI * bxdf_pdf));
+                Path_SetConeSpread(path, clamp(lobe_spread, cone_spread, PI));
+            }
 
             if (Bxdf_IsBtdf(&diffgeo))
             {
@@ -534,19 +598,23 @@ KERNEL void ApplyVolumeTransmissionUberV2(
     // throughput
     GLOBAL Path const* restrict paths,
     // Vertices
-    GLOBAL float3 const* restrict vertices,
+    GLOBAL GeometryPosition const* restrict vertices,
     // Normals
-    GLOBAL float3 const* restrict normals,
+    GLOBAL GeometryNormal const* restrict normals,
     // UVs
-    GLOBAL float2 const* restrict uvs,
+    GLOBAL GeometryUV const* restrict uvs,
     // Indices
-    GLOBAL int const* restrict indices,
+    GLOBAL GeometryIndex const* restrict indices,
     // Shapes
     GLOBAL Shape const* restrict shapes,
     // Materials
     GLOBAL int const* restrict material_attributes,
     // Volumes
     GLOBAL Volume const* restrict volumes,
+    // Density grids
+    VOLUME_ARG_LIST,
+    // RNG seed
+    uint rngseed,
     // Light samples
     GLOBAL float3* restrict light_samples,
     // Shadow predicates
@@ -635,8 +703,12 @@ KERNEL void ApplyVolumeTransmissionUberV2(
                 // This is new ray origin after media boundary intersection
                 float3 p = shadow_ray.o.xyz + (t + CRAZY_LOW_DISTANCE) * shadow_ray.d.xyz;
 
+                // Random numbers for ratio tracking in heterogeneous volumes
+                Sampler tracker;
+                tracker.index = WangHash(rngseed ^ WangHash(global_id));
+
                 // Calculate volume transmittance up to this point
-                float3 tr = Volume_Transmittance(&volumes[volume_idx], &shadow_rays[global_id], t);
+                float3 tr = Volume_Transmittance(&volumes[volume_idx], &shadow_rays[global_id], t, VOLUME_ARGS, &tracker);
                 // Calculat volume emission up to this point
                 float3 emission = Volume_Emission(&volumes[volume_idx], &shadow_rays[global_id], t);
 
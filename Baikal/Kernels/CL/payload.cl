@@ -88,6 +88,9 @@ typedef struct
     int volume_idx;
     // unique shape id
     int id;
+    // Compact geometry: 1 if shape indices are 16-bit, 0 if 32-bit
+    int short_indices;
+    int padding[3];
     // Linear motion vector
     float3 linearvelocity;
     // Angular velocity
@@ -128,6 +131,53 @@ typedef struct _InputMapData
     };
 } InputMapData;
 
+// Input map bytecode instructions (see inputmaps_interpreter.cl)
+// Instruction is stored in InputMapData: int_values.idx holds opcode,
+// int_values.placeholder[0] holds argument.
+enum InputMapOpcode
+{
+    kInputMapOpReturn = 0,
+    // Push leaf value, argument is leaf index
+    kInputMapOpConstant,
+    kInputMapOpSampler,
+    kInputMapOpSamplerBumpmap,
+    // Pop b, a; push op(a, b)
+    kInputMapOpAdd,
+    kInputMapOpSub,
+    kInputMapOpMul,
+    kInputMapOpDiv,
+    kInputMapOpMin,
+    kInputMapOpMax,
+    kInputMapOpDot3,
+    kInputMapOpDot4,
+    kInputMapOpCross3,
+    kInputMapOpCross4,
+    kInputMapOpPow,
+    kInputMapOpMod,
+    // Pop arg; push op(arg)
+    kInputMapOpSin,
+    kInputMapOpCos,
+    kInputMapOpTan,
+    kInputMapOpAsin,
+    kInputMapOpAcos,
+    kInputMapOpAtan,
+    kInputMapOpLength3,
+    kInputMapOpNormalize3,
+    kInputMapOpFloor,
+    kInputMapOpAbs,
+    // Argument is component index
+    kInputMapOpSelect,
+    // Argument is shuffle mask packed as 4 bits per component
+    kInputMapOpShuffle,
+    kInputMapOpShuffle2,
+    // Pop a, b, control; push mix(a, b, control)
+    kInputMapOpLerp,
+    // Matrix rows are stored in 4 following instructions
+    kInputMapOpMatMul,
+    // Pop data, source range, destination range
+    kInputMapOpRemap
+};
+
 enum Bxdf
 {
     kZero,
@@ -140,20 +190,22 @@ enum LightType
     kDirectional,
     kSpot,
     kArea,
-    kIbl
+    kIbl,
+    kMesh
 };
 
 typedef struct
 {
     union
     {
-        // Area light
+        // Area and mesh light
         struct
         {
             int id;
             int shapeidx;
             int primidx;
-            int padding0;
+            // Mesh light: offset of primitive distribution in light distribution data or -1
+            int prim_distribution;
         };
 
         // IBL
@@ -182,8 +234,32 @@ typedef struct
     float multiplier;
     int tex_background;
     bool ibl_mirror_x;
+    // IBL: offset of 2D distribution of tex in light distribution data or -1
+    int env_distribution;
+    // Leaf node in light BVH or -1 for lights sampled by power distribution
+    int bvh_node;
+    int padding2[2];
 } Light;
 
+// Node of light BVH
+typedef struct
+{
+    float3 bbox_min;
+    float3 bbox_max;
+    // Cone bounding emission directions: axis, cosines of spread and emission angles
+    float3 axis;
+    float cos_theta_o;
+    float cos_theta_e;
+    // Total power of lights below the node
+    float power;
+    int parent;
+    int left;
+    int right;
+    // Light index for leafs, -1 for inner nodes
+    int light_idx;
+    int padding;
+} LightBvhNode;
+
 typedef enum
     {
         kEmpty,
@@ -197,7 +273,7 @@ typedef struct _Volume
     VolumeType type;
     float g;
 
-    // Id of volume data if present
+    // Heterogeneous: index of density grid, -1 otherwise
     int data;
     int extra;
 
@@ -209,15 +285,62 @@ typedef struct _Volume
     TEXTURED_INPUT(sigma_e);
 } Volume;
 
+/// Brick size of density grids in voxels
+#define VOLUME_BRICK_SIZE 8
+#define VOLUME_EMPTY_BRICK -1
+
+/// Sparse density grid of heterogeneous volume, see VolumeGrid
+typedef struct _VolumeGrid
+{
+    // World space bounds
+    float3 bbox_min;
+    float3 bbox_max;
+    // Number of voxels along each axis
+    int resolution[3];
+    // Maximum density in the grid
+    float max_density;
+    // Number of bricks along each axis
+    int brick_count[3];
+    // Offset of majorant grid (one float per brick) in volume data
+    int majorants;
+    // Offset of brick table (one int per brick, index of brick or VOLUME_EMPTY_BRICK) in volume data
+    int brick_table;
+    // Offset of brick voxels in volume data
+    int bricks;
+    int padding[2];
+} VolumeGrid;
+
 /// Supported formats
 enum TextureFormat
 {
     UNKNOWN,
     RGBA8,
     RGBA16,
-    RGBA32
+    RGBA32,
+    // Single channel formats are sampled as (r, r, r, r), two channel as (r, g, 0, 0)
+    R8,
+    RG8,
+    R16,
+    RG16,
+    R32,
+    RG32,
+    // Block compressed formats, data is stored in 4x4 texel blocks
+    BC1,
+    BC3,
+    BC4,
+    BC5
 };
 
+/// Maximum number of mip levels including level 0
+#define TEXTURE_MAX_MIP_LEVELS 16
+/// Tile size of virtual textures in texels
+#define TEXTURE_VT_TILE_SIZE 128
+/// Number of entries in virtual texture feedback buffer (power of 2)
+#define TEXTURE_VT_FEEDBACK_SIZE_LOG2 12
+#define TEXTURE_VT_FEEDBACK_SIZE (1 << TEXTURE_VT_FEEDBACK_SIZE_LOG2)
+/// Empty entry of page table and feedback buffer
+#define TEXTURE_VT_INVALID -1
+
 /// Texture description
 typedef
 struct _Texture
@@ -230,7 +353,19 @@ struct _Texture
     int dataoffset;
     // Format
     int fmt;
-    int extra;
+    // Number of mip levels, 1 if texture has no mips
+    int mip_count;
+    // Offsets of mip levels relative to dataoffset,
+    // for virtual textures offsets of level page tables in entries
+    int mip_offsets[TEXTURE_MAX_MIP_LEVELS];
+    // Virtual textures: byte offset of page table in texture data or -1 for resident
+    // textures. Page table entries hold byte offsets of resident tiles or -1.
+    int vt_page_table;
+    // Byte offset of feedback buffer in texture data
+    int vt_feedback;
+    // Index of the texture in feedback requests
+    int vt_id;
+    int padding;
 } Texture;
 
 // Hit data
@@ -244,6 +379,9 @@ typedef struct _DifferentialGeometry
     float3 ng;
     // UVs
     float2 uv;
+    // Texture footprint: UV derivatives along major and minor axes
+    float2 duvdx;
+    float2 duvdy;
     // Derivatives
     float3 dpdu;
     float3 dpdv;
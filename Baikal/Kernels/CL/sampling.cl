@@ -381,8 +381,9 @@ float Distribution1D_Sample(float s, GLOBAL int const* data, float* pdf)
 
     int segment_idx = max(lower_bound(cdf_data, num_segments + 1, s), 1);
 
-    // Find lerp coefficient
-    float du = (s - cdf_data[segment_idx - 1]) / (cdf_data[segment_idx] - cdf_data[segment_idx - 1]);
+    // Find lerp coefficient, segment might be empty if s is 0
+    float segment_width = cdf_data[segment_idx] - cdf_data[segment_idx - 1];
+    float du = segment_width > 0.f ? (s - cdf_data[segment_idx - 1]) / segment_width : 0.f;
 
     // Calc pdf
     *pdf = pdf_data[segment_idx - 1];
@@ -434,5 +435,43 @@ float Distribution1D_GetPdfDiscreet(int d, GLOBAL int const* data)
 }
 
 
+/// Sample 2D distribution, data layout is width, height, marginal distribution
+/// of rows followed by conditional distributions of rows (1D distribution layout).
+/// Returns point in [0,1]x[0,1], y selects row.
+float2 Distribution2D_Sample(float2 s, GLOBAL int const* data, float* pdf)
+{
+    int width = data[0];
+    int height = data[1];
+    GLOBAL int const* marginal = data + 2;
+
+    float marginal_pdf = 0.f;
+    float y = Distribution1D_Sample(s.y, marginal, &marginal_pdf);
+
+    int row = clamp((int)(y * height), 0, height - 1);
+    GLOBAL int const* conditional = marginal + 2 * height + 2 + row * (2 * width + 2);
+
+    float conditional_pdf = 0.f;
+    float x = Distribution1D_Sample(s.x, conditional, &conditional_pdf);
+
+    *pdf = marginal_pdf * conditional_pdf;
+    return make_float2(x, y);
+}
+
+/// PDF of 2D distribution at a given point
+float Distribution2D_GetPdf(float2 p, GLOBAL int const* data)
+{
+    int width = data[0];
+    int height = data[1];
+    GLOBAL int const* marginal = data + 2;
+
+    int row = clamp((int)(p.y * height), 0, height - 1);
+    int column = clamp((int)(p.x * width), 0, width - 1);
+    GLOBAL int const* conditional = marginal + 2 * height + 2 + row * (2 * width + 2);
+
+    GLOBAL float const* marginal_pdf = (GLOBAL float const*)&marginal[1] + height + 1;
+    GLOBAL float const* conditional_pdf = (GLOBAL float const*)&conditional[1] + width + 1;
+
+    return marginal_pdf[row] * conditional_pdf[column];
+}
 
 #endif // SAMPLING_CL
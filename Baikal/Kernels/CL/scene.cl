@@ -25,17 +25,34 @@ THE SOFTWARE.
 #include <../Baikal/Kernels/CL/common.cl>
 #include <../Baikal/Kernels/CL/utils.cl>
 #include <../Baikal/Kernels/CL/payload.cl>
+#include <../Baikal/Kernels/CL/light_bvh.cl>
+
+// Element types of geometry buffers (see ClwScene).
+// Compact layout stores positions as packed floats (3 per vertex), normals
+// octahedral encoded into 2 x snorm16, UVs as 2 x half and indices as 16-bit
+// values. Meshes with 65536 vertices or more keep 32-bit indices in pairs of 16-bit ones.
+#ifdef BAIKAL_COMPACT_GEOMETRY
+typedef float GeometryPosition;
+typedef uint GeometryNormal;
+typedef uint GeometryUV;
+typedef ushort GeometryIndex;
+#else
+typedef float3 GeometryPosition;
+typedef float3 GeometryNormal;
+typedef float2 GeometryUV;
+typedef int GeometryIndex;
+#endif
 
 typedef struct
 {
     // Vertices
-    GLOBAL float3 const* restrict vertices;
+    GLOBAL GeometryPosition const* restrict vertices;
     // Normals
-    GLOBAL float3 const* restrict normals;
+    GLOBAL GeometryNormal const* restrict normals;
     // UVs
-    GLOBAL float2 const* restrict uvs;
+    GLOBAL GeometryUV const* restrict uvs;
     // Indices
-    GLOBAL int const* restrict indices;
+    GLOBAL GeometryIndex const* restrict indices;
     // Shapes
     GLOBAL Shape const* restrict shapes;
     // Material attributes
@@ -50,8 +67,82 @@ typedef struct
     int num_lights;
     // Light distribution 
     GLOBAL int const* restrict light_distribution;
+    // Light BVH
+    GLOBAL LightBvhNode const* restrict light_bvh;
+    // Light indices of emissive primitives: per shape offset of its
+    // primitive table, -1 or -(light_idx + 2) for mesh lights, followed by primitive tables
+    GLOBAL int const* restrict emissive_lights;
 } Scene;
 
+// Decode unit vector from octahedral encoding, x and y are stored as snorm16 in low and high halves
+INLINE float3 DecodeOctahedralNormal(uint packed)
+{
+    float2 e = make_float2((float)(short)(packed & 0xffff), (float)(short)(packed >> 16)) / 32767.f;
+    float3 n = make_float3(e.x, e.y, 1.f - fabs(e.x) - fabs(e.y));
+    // Lower hemisphere is folded over the diagonals
+    float t = max(-n.z, 0.f);
+    n.x += n.x >= 0.f ? -t : t;
+    n.y += n.y >= 0.f ? -t : t;
+    return normalize(n);
+}
+
+// Get vertex position in object space
+INLINE float3 Scene_GetPosition(Scene const* scene, int idx)
+{
+#ifdef BAIKAL_COMPACT_GEOMETRY
+    return vload3(idx, scene->vertices);
+#else
+    return scene->vertices[idx];
+#endif
+}
+
+// Get vertex normal in object space
+INLINE float3 Scene_GetNormal(Scene const* scene, int idx)
+{
+#ifdef BAIKAL_COMPACT_GEOMETRY
+    return DecodeOctahedralNormal(scene->normals[idx]);
+#else
+    return scene->normals[idx];
+#endif
+}
+
+// Get vertex UV
+INLINE float2 Scene_GetUV(Scene const* scene, int idx)
+{
+#ifdef BAIKAL_COMPACT_GEOMETRY
+    return vload_half2(idx, (GLOBAL half const*)scene->uvs);
+#else
+    return scene->uvs[idx];
+#endif
+}
+
+// Get vertex indices of a triangle (offset by shape start vertex)
+INLINE int3 Scene_GetTriangleIndices(Scene const* scene, Shape const* shape, int prim_idx)
+{
+#ifdef BAIKAL_COMPACT_GEOMETRY
+    GLOBAL ushort const* indices = scene->indices + shape->startidx;
+    int3 idx;
+
+    if (shape->short_indices)
+    {
+        idx = make_int3(indices[3 * prim_idx], indices[3 * prim_idx + 1], indices[3 * prim_idx + 2]);
+    }
+    else
+    {
+        // 32-bit indices are read by halves as the range is not necessarily 4-byte aligned
+        indices += 6 * prim_idx;
+        idx = make_int3(indices[0] | (indices[1] << 16),
+                        indices[2] | (indices[3] << 16),
+                        indices[4] | (indices[5] << 16));
+    }
+#else
+    int3 idx = make_int3(scene->indices[shape->startidx + 3 * prim_idx],
+                         scene->indices[shape->startidx + 3 * prim_idx + 1],
+                         scene->indices[shape->startidx + 3 * prim_idx + 2]);
+#endif
+    return idx + shape->startvtx;
+}
+
 // Get triangle vertices given scene, shape index and prim index
 INLINE void Scene_GetTriangleVertices(Scene const* scene, int shape_idx, int prim_idx, float3* v0, float3* v1, float3* v2)
 {
@@ -59,14 +150,12 @@ INLINE void Scene_GetTriangleVertices(Scene const* scene, int shape_idx, int pri
     Shape shape = scene->shapes[shape_idx];
 
     // Fetch indices starting from startidx and offset by prim_idx
-    int i0 = scene->indices[shape.startidx + 3 * prim_idx];
-    int i1 = scene->indices[shape.startidx + 3 * prim_idx + 1];
-    int i2 = scene->indices[shape.startidx + 3 * prim_idx + 2];
+    int3 i = Scene_GetTriangleIndices(scene, &shape, prim_idx);
 
     // Fetch positions and transform to world space
-    *v0 = matrix_mul_point3(shape.transform, scene->vertices[shape.startvtx + i0]);
-    *v1 = matrix_mul_point3(shape.transform, scene->vertices[shape.startvtx + i1]);
-    *v2 = matrix_mul_point3(shape.transform, scene->vertices[shape.startvtx + i2]);
+    *v0 = matrix_mul_point3(shape.transform, Scene_GetPosition(scene, i.x));
+    *v1 = matrix_mul_point3(shape.transform, Scene_GetPosition(scene, i.y));
+    *v2 = matrix_mul_point3(shape.transform, Scene_GetPosition(scene, i.z));
 }
 
 // Get triangle uvs given scene, shape index and prim index
@@ -76,14 +165,12 @@ INLINE void Scene_GetTriangleUVs(Scene const* scene, int shape_idx, int prim_idx
     Shape shape = scene->shapes[shape_idx];
 
     // Fetch indices starting from startidx and offset by prim_idx
-    int i0 = scene->indices[shape.startidx + 3 * prim_idx];
-    int i1 = scene->indices[shape.startidx + 3 * prim_idx + 1];
-    int i2 = scene->indices[shape.startidx + 3 * prim_idx + 2];
+    int3 i = Scene_GetTriangleIndices(scene, &shape, prim_idx);
 
     // Fetch positions and transform to world space
-    *uv0 = scene->uvs[shape.startvtx + i0];
-    *uv1 = scene->uvs[shape.startvtx + i1];
-    *uv2 = scene->uvs[shape.startvtx + i2];
+    *uv0 = Scene_GetUV(scene, i.x);
+    *uv1 = Scene_GetUV(scene, i.y);
+    *uv2 = Scene_GetUV(scene, i.z);
 }
 
 
@@ -94,24 +181,22 @@ INLINE void Scene_InterpolateAttributes(Scene const* scene, int shape_idx, int p
     Shape shape = scene->shapes[shape_idx];
 
     // Fetch indices starting from startidx and offset by prim_idx
-    int i0 = scene->indices[shape.startidx + 3 * prim_idx];
-    int i1 = scene->indices[shape.startidx + 3 * prim_idx + 1];
-    int i2 = scene->indices[shape.startidx + 3 * prim_idx + 2];
+    int3 i = Scene_GetTriangleIndices(scene, &shape, prim_idx);
 
     // Fetch normals
-    float3 n0 = scene->normals[shape.startvtx + i0];
-    float3 n1 = scene->normals[shape.startvtx + i1];
-    float3 n2 = scene->normals[shape.startvtx + i2];
+    float3 n0 = Scene_GetNormal(scene, i.x);
+    float3 n1 = Scene_GetNormal(scene, i.y);
+    float3 n2 = Scene_GetNormal(scene, i.z);
 
     // Fetch positions and transform to world space
-    float3 v0 = matrix_mul_point3(shape.transform, scene->vertices[shape.startvtx + i0]);
-    float3 v1 = matrix_mul_point3(shape.transform, scene->vertices[shape.startvtx + i1]);
-    float3 v2 = matrix_mul_point3(shape.transform, scene->vertices[shape.startvtx + i2]);
+    float3 v0 = matrix_mul_point3(shape.transform, Scene_GetPosition(scene, i.x));
+    float3 v1 = matrix_mul_point3(shape.transform, Scene_GetPosition(scene, i.y));
+    float3 v2 = matrix_mul_point3(shape.transform, Scene_GetPosition(scene, i.z));
 
     // Fetch UVs
-    float2 uv0 = scene->uvs[shape.startvtx + i0];
-    float2 uv1 = scene->uvs[shape.startvtx + i1];
-    float2 uv2 = scene->uvs[shape.startvtx + i2];
+    float2 uv0 = Scene_GetUV(scene, i.x);
+    float2 uv1 = Scene_GetUV(scene, i.y);
+    float2 uv2 = Scene_GetUV(scene, i.z);
 
     // Calculate barycentric position and normal
     *p = (1.f - barycentrics.x - barycentrics.y) * v0 + barycentrics.x * v1 + barycentrics.y * v2;
@@ -127,14 +212,12 @@ INLINE void Scene_InterpolateVertices(Scene const* scene, int shape_idx, int pri
     Shape shape = scene->shapes[shape_idx];
 
     // Fetch indices starting from startidx and offset by prim_idx
-    int i0 = scene->indices[shape.startidx + 3 * prim_idx];
-    int i1 = scene->indices[shape.startidx + 3 * prim_idx + 1];
-    int i2 = scene->indices[shape.startidx + 3 * prim_idx + 2];
+    int3 i = Scene_GetTriangleIndices(scene, &shape, prim_idx);
 
     // Fetch positions and transform to world space
-    float3 v0 = matrix_mul_point3(shape.transform, scene->vertices[shape.startvtx + i0]);
-    float3 v1 = matrix_mul_point3(shape.transform, scene->vertices[shape.startvtx + i1]);
-    float3 v2 = matrix_mul_point3(shape.transform, scene->vertices[shape.startvtx + i2]);
+    float3 v0 = matrix_mul_point3(shape.transform, Scene_GetPosition(scene, i.x));
+    float3 v1 = matrix_mul_point3(shape.transform, Scene_GetPosition(scene, i.y));
+    float3 v2 = matrix_mul_point3(shape.transform, Scene_GetPosition(scene, i.z));
 
     // Calculate barycentric position and normal
     *p = (1.f - barycentrics.x - barycentrics.y) * v0 + barycentrics.x * v1 + barycentrics.y * v2;
@@ -151,14 +234,12 @@ INLINE void Scene_InterpolateVerticesFromIntersection(Scene const* scene, Inters
     Shape shape = scene->shapes[shape_idx];
 
     // Fetch indices starting from startidx and offset by prim_idx
-    int i0 = scene->indices[shape.startidx + 3 * prim_idx];
-    int i1 = scene->indices[shape.startidx + 3 * prim_idx + 1];
-    int i2 = scene->indices[shape.startidx + 3 * prim_idx + 2];
+    int3 i = Scene_GetTriangleIndices(scene, &shape, prim_idx);
 
     // Fetch positions and transform to world space
-    float3 v0 = matrix_mul_point3(shape.transform, scene->vertices[shape.startvtx + i0]);
-    float3 v1 = matrix_mul_point3(shape.transform, scene->vertices[shape.startvtx + i1]);
-    float3 v2 = matrix_mul_point3(shape.transform, scene->vertices[shape.startvtx + i2]);
+    float3 v0 = matrix_mul_point3(shape.transform, Scene_GetPosition(scene, i.x));
+    float3 v1 = matrix_mul_point3(shape.transform, Scene_GetPosition(scene, i.y));
+    float3 v2 = matrix_mul_point3(shape.transform, Scene_GetPosition(scene, i.z));
 
     // Calculate barycentric position and normal
     *p = (1.f - barycentrics.x - barycentrics.y) * v0 + barycentrics.x * v1 + barycentrics.y * v2;
@@ -175,14 +256,12 @@ INLINE void Scene_InterpolateNormalsFromIntersection(Scene const* scene, Interse
     Shape shape = scene->shapes[shape_idx];
 
     // Fetch indices starting from startidx and offset by prim_idx
-    int i0 = scene->indices[shape.startidx + 3 * prim_idx];
-    int i1 = scene->indices[shape.startidx + 3 * prim_idx + 1];
-    int i2 = scene->indices[shape.startidx + 3 * prim_idx + 2];
+    int3 i = Scene_GetTriangleIndices(scene, &shape, prim_idx);
 
     // Fetch normals
-    float3 n0 = scene->normals[shape.startvtx + i0];
-    float3 n1 = scene->normals[shape.startvtx + i1];
-    float3 n2 = scene->normals[shape.startvtx + i2];
+    float3 n0 = Scene_GetNormal(scene, i.x);
+    float3 n1 = Scene_GetNormal(scene, i.y);
+    float3 n2 = Scene_GetNormal(scene, i.z);
 
     // Calculate barycentric position and normal
     *n = normalize(matrix_mul_vector3(shape.transform, (1.f - barycentrics.x - barycentrics.y) * n0 + barycentrics.x * n1 + barycentrics.y * n2));
@@ -226,6 +305,9 @@ void Scene_FillDifferentialGeometry(// Scene
     diffgeo->n = n;
     diffgeo->p = p;
     diffgeo->uv = uv;
+    // No footprint by default, textures are sampled at level 0
+    diffgeo->duvdx = 0.f;
+    diffgeo->duvdy = 0.f;
 
     // Get vertices
     float3 v0, v1, v2;
@@ -276,6 +358,68 @@ void Scene_FillDifferentialGeometry(// Scene
     }
 }
 
+/// Calculate texture footprint of a ray cone hitting the surface.
+/// Footprint is an ellipse with minor axis equal to cone width and major axis
+/// stretched by 1 / cos(theta) along incoming direction projected onto the surface.
+/// Axes are converted into UV space using triangle UV gradients.
+void Scene_CalculateTextureFootprint(// Scene
+                              Scene const* scene,
+                              // RadeonRays intersection
+                              Intersection const* isect,
+                              // Incoming direction
+                              float3 wi,
+                              // Width of the ray cone at intersection point
+                              float cone_width,
+                              // Differential geometry
+                              DifferentialGeometry* diffgeo
+                              )
+{
+    diffgeo->duvdx = 0.f;
+    diffgeo->duvdy = 0.f;
+
+    if (cone_width <= 0.f)
+    {
+        return;
+    }
+
+    int shape_idx = isect->shapeid - 1;
+    int prim_idx = isect->primid;
+
+    float3 v0, v1, v2;
+    Scene_GetTriangleVertices(scene, shape_idx, prim_idx, &v0, &v1, &v2);
+
+    float2 uv0, uv1, uv2;
+    Scene_GetTriangleUVs(scene, shape_idx, prim_idx, &uv0, &uv1, &uv2);
+
+    float3 e1 = v0 - v2;
+    float3 e2 = v1 - v2;
+    float3 ng = cross(e1, e2);
+    float area2 = dot(ng, ng);
+
+    if (area2 <= 0.f)
+    {
+        return;
+    }
+
+    // Dual basis of triangle edges gives world space gradients of u and v
+    float3 b1 = cross(e2, ng) / area2;
+    float3 b2 = cross(ng, e1) / area2;
+    float3 grad_u = (uv0.x - uv2.x) * b1 + (uv1.x - uv2.x) * b2;
+    float3 grad_v = (uv0.y - uv2.y) * b1 + (uv1.y - uv2.y) * b2;
+
+    ng = normalize(ng);
+    float cos_theta = fabs(dot(ng, wi));
+
+    float3 major_axis = wi - dot(wi, ng) * ng;
+    major_axis = dot(major_axis, major_axis) > 1e-8f ? normalize(major_axis) : normalize(GetOrthoVector(ng));
+    float3 minor_axis = cross(ng, major_axis);
+
+    major_axis *= cone_width / max(cos_theta, 0.01f);
+    minor_axis *= cone_width;
+
+    diffgeo->duvdx = make_float2(dot(grad_u, major_axis), dot(grad_v, major_axis));
+    diffgeo->duvdy = make_float2(dot(grad_u, minor_axis), dot(grad_v, minor_axis));
+}
 
 // Calculate tangent transform matrices inside differential geometry
 INLINE void DifferentialGeometry_CalculateTangentTransforms(DifferentialGeometry* diffgeo)
@@ -294,21 +438,66 @@ INLINE void DifferentialGeometry_CalculateTangentTransforms(DifferentialGeometry
     diffgeo->tangent_to_world.m2.w = diffgeo->p.z;
 }
 
-#define POWER_SAMPLING
-
-// Sample light index
-INLINE int Scene_SampleLight(Scene const* scene, float sample, float* pdf)
+// Sample light index.
+// Light distribution holds one segment per light plus the last one for all lights
+// stored in light BVH, which are picked proportionally to their contribution at p.
+INLINE int Scene_SampleLight(Scene const* scene, float3 p, float sample, float* pdf)
 {
-#ifndef POWER_SAMPLING
-    int num_lights = scene->num_lights;
-    int light_idx = clamp((int)(sample * num_lights), 0, num_lights - 1);
-    *pdf = 1.f / num_lights;
-    return light_idx;
-#else
     int num_lights = scene->num_lights;
     int light_idx = Distribution1D_SampleDiscrete(sample, scene->light_distribution, pdf);
+
+    if (light_idx == num_lights)
+    {
+        // Reuse the sample rescaled to the selected segment
+        GLOBAL float const* cdf = (GLOBAL float const*)&scene->light_distribution[1];
+        float s = clamp((sample - cdf[num_lights]) / (cdf[num_lights + 1] - cdf[num_lights]), 0.f, 0.99999994f);
+
+        float bvh_pdf = 0.f;
+        light_idx = LightBvh_Sample(scene->light_bvh, p, s, &bvh_pdf);
+        *pdf *= bvh_pdf;
+    }
+
     return light_idx;
-#endif
+}
+
+// Probability of Scene_SampleLight picking light for point p
+INLINE float Scene_GetLightPdf(Scene const* scene, int light_idx, float3 p)
+{
+    int bvh_node = scene->lights[light_idx].bvh_node;
+
+    if (bvh_node == -1)
+    {
+        return Distribution1D_GetPdfDiscreet(light_idx, scene->light_distribution);
+    }
+
+    return Distribution1D_GetPdfDiscreet(scene->num_lights, scene->light_distribution) *
+        LightBvh_GetPdf(scene->light_bvh, bvh_node, p);
+}
+
+// Probability of sampling emissive primitive from point p through light sampling.
+// Emissive lights table holds for each shape either offset of light indices of its
+// primitives, -1 if shape is not emissive or -(light_idx + 2) for mesh lights.
+INLINE float Scene_GetEmissivePdf(Scene const* scene, int shape_idx, int prim_idx, float3 p)
+{
+    int entry = scene->emissive_lights[shape_idx];
+
+    if (entry == -1)
+    {
+        return 0.f;
+    }
+
+    if (entry < -1)
+    {
+        int light_idx = -entry - 2;
+        int prim_distribution = scene->lights[light_idx].prim_distribution;
+
+        return prim_distribution == -1 ? 0.f :
+            Scene_GetLightPdf(scene, light_idx, p) *
+            Distribution1D_GetPdfDiscreet(prim_idx, scene->light_distribution + prim_distribution);
+    }
+
+    int light_idx = scene->emissive_lights[entry + prim_idx];
+    return light_idx == -1 ? 0.f : Scene_GetLightPdf(scene, light_idx, p);
 }
 
 #endif
@@ -33,16 +33,233 @@ THE SOFTWARE.
 #define TEXTURE_ARGS textures, texturedata
 #define TEXTURE_ARGS_IDX(x) x, textures, texturedata
 
-/// Sample 2D texture
+/// Maximum number of samples along the major axis of anisotropic footprint
+#define TEXTURE_MAX_ANISOTROPY 8
+
+/// Decode 8 bytes of BC4 block (also used for BC3 alpha and BC5 channels), i is texel index in block
 inline
-float4 Texture_Sample2D(float2 uv, TEXTURE_ARG_LIST_IDX(texidx))
+float Texture_DecodeBc4(__global uchar const* block, int i)
 {
-    // Get width and height
-    int width = textures[texidx].w;
-    int height = textures[texidx].h;
+    int r0 = block[0];
+    int r1 = block[1];
+
+    // 3 bit indices are packed in the following 6 bytes
+    int bit = 3 * i;
+    int byte = 2 + (bit >> 3);
+    int shift = bit & 7;
+    int bits = block[byte] | (byte < 7 ? (block[byte + 1] << 8) : 0);
+    int code = (bits >> shift) & 0x7;
+
+    float value;
+    if (code == 0)
+    {
+        value = (float)r0;
+    }
+    else if (code == 1)
+    {
+        value = (float)r1;
+    }
+    else if (r0 > r1)
+    {
+        value = ((8 - code) * r0 + (code - 1) * r1) / 7.f;
+    }
+    else if (code < 6)
+    {
+        value = ((6 - code) * r0 + (code - 1) * r1) / 5.f;
+    }
+    else
+    {
+        value = code == 6 ? 0.f : 255.f;
+    }
+
+    return value / 255.f;
+}
+
+/// Decode 8 bytes of BC1 block, i is texel index in block.
+/// Three color mode (c0 <= c1) is only allowed if punch-through alpha is enabled.
+inline
+float4 Texture_DecodeBc1(__global uchar const* block, int i, bool allow_alpha)
+{
+    int c0 = block[0] | (block[1] << 8);
+    int c1 = block[2] | (block[3] << 8);
+    int code = (block[4 + (i >> 2)] >> (2 * (i & 3))) & 0x3;
+
+    float3 e0 = make_float3((float)((c0 >> 11) & 0x1F) / 31.f, (float)((c0 >> 5) & 0x3F) / 63.f, (float)(c0 & 0x1F) / 31.f);
+    float3 e1 = make_float3((float)((c1 >> 11) & 0x1F) / 31.f, (float)((c1 >> 5) & 0x3F) / 63.f, (float)(c1 & 0x1F) / 31.f);
+
+    switch (code)
+    {
+    case 0:
+        return make_float4(e0.x, e0.y, e0.z, 1.f);
+    case 1:
+        return make_float4(e1.x, e1.y, e1.z, 1.f);
+    case 2:
+    {
+        float3 c = (c0 > c1 || !allow_alpha) ? (2.f * e0 + e1) / 3.f : 0.5f * (e0 + e1);
+        return make_float4(c.x, c.y, c.z, 1.f);
+    }
+    default:
+    {
+        if (c0 > c1 || !allow_alpha)
+        {
+            float3 c = (e0 + 2.f * e1) / 3.f;
+            return make_float4(c.x, c.y, c.z, 1.f);
+        }
+
+        return make_float4(0.f, 0.f, 0.f, 0.f);
+    }
+    }
+}
+
+/// Fetch single texel of any supported format without filtering
+inline
+float4 Texture_FetchTexel(__global char const* mydata, int fmt, int width, int x, int y)
+{
+    switch (fmt)
+    {
+    case RGBA32:
+        return *((__global float4 const*)mydata + width * y + x);
+    case RGBA16:
+        return vload_half4(width * y + x, (__global half const*)mydata);
+    case RGBA8:
+    {
+        uchar4 val = *((__global uchar4 const*)mydata + width * y + x);
+        return make_float4((float)val.x / 255.f, (float)val.y / 255.f, (float)val.z / 255.f, (float)val.w / 255.f);
+    }
+    case R32:
+    {
+        float val = *((__global float const*)mydata + width * y + x);
+        return make_float4(val, val, val, val);
+    }
+    case R16:
+    {
+        float val = vload_half(width * y + x, (__global half const*)mydata);
+        return make_float4(val, val, val, val);
+    }
+    case R8:
+    {
+        float val = (float)*((__global uchar const*)mydata + width * y + x) / 255.f;
+        return make_float4(val, val, val, val);
+    }
+    case RG32:
+    {
+        float2 val = *((__global float2 const*)mydata + width * y + x);
+        return make_float4(val.x, val.y, 0.f, 0.f);
+    }
+    case RG16:
+    {
+        float2 val = vload_half2(width * y + x, (__global half const*)mydata);
+        return make_float4(val.x, val.y, 0.f, 0.f);
+    }
+    case RG8:
+    {
+        uchar2 val = *((__global uchar2 const*)mydata + width * y + x);
+        return make_float4((float)val.x / 255.f, (float)val.y / 255.f, 0.f, 0.f);
+    }
+    default:
+        break;
+    }
+
+    // Block compressed formats
+    int blocks_per_row = (width + 3) >> 2;
+    int block_idx = blocks_per_row * (y >> 2) + (x >> 2);
+    int i = ((y & 3) << 2) + (x & 3);
+    __global uchar const* mydatab = (__global uchar const*)mydata;
+
+    switch (fmt)
+    {
+    case BC1:
+        return Texture_DecodeBc1(mydatab + 8 * block_idx, i, true);
+    case BC3:
+    {
+        __global uchar const* block = mydatab + 16 * block_idx;
+        float4 val = Texture_DecodeBc1(block + 8, i, false);
+        val.w = Texture_DecodeBc4(block, i);
+        return val;
+    }
+    case BC4:
+    {
+        float val = Texture_DecodeBc4(mydatab + 8 * block_idx, i);
+        return make_float4(val, val, val, val);
+    }
+    case BC5:
+    {
+        __global uchar const* block = mydatab + 16 * block_idx;
+        return make_float4(Texture_DecodeBc4(block, i), Texture_DecodeBc4(block + 8, i), 0.f, 0.f);
+    }
+    default:
+        return make_float4(0.f, 0.f, 0.f, 0.f);
+    }
+}
+
+/// Request streaming of virtual texture tile. Feedback buffer is the only
+/// part of texture data written by kernels, requests are packed as
+/// texture id (12 bits), level (4 bits), tile y (8 bits) and tile x (8 bits).
+inline
+void Texture_RequestTile(__global Texture const* texture, __global char const* texturedata, int level, int tile_x, int tile_y)
+{
+    __global uint* feedback = (__global uint*)(texturedata + texture->vt_feedback);
+    uint key = ((uint)texture->vt_id << 20) | ((uint)level << 16) | ((uint)tile_y << 8) | (uint)tile_x;
+
+    // Duplicate requests hash to the same entry, collisions just postpone requests
+    feedback[(key * 2654435761u) >> (32 - TEXTURE_VT_FEEDBACK_SIZE_LOG2)] = key;
+}
+
+/// Fetch texel of virtual texture. If the tile is not resident it is requested
+/// and texel is taken from the finest coarser level which is resident.
+inline
+float4 Texture_FetchVirtualTexel(__global Texture const* texture, __global char const* texturedata, int level, int x, int y)
+{
+    __global int const* page_table = (__global int const*)(texturedata + texture->vt_page_table);
+
+    for (int l = level; l < texture->mip_count; ++l)
+    {
+        int lx = x >> (l - level);
+        int ly = y >> (l - level);
+        int tile_x = lx / TEXTURE_VT_TILE_SIZE;
+        int tile_y = ly / TEXTURE_VT_TILE_SIZE;
+        int tiles_per_row = (max(texture->w >> l, 1) + TEXTURE_VT_TILE_SIZE - 1) / TEXTURE_VT_TILE_SIZE;
+
+        int tile = page_table[texture->mip_offsets[l] + tile_y * tiles_per_row + tile_x];
+
+        if (tile != TEXTURE_VT_INVALID)
+        {
+            return Texture_FetchTexel(texturedata + tile, texture->fmt, TEXTURE_VT_TILE_SIZE,
+                lx - tile_x * TEXTURE_VT_TILE_SIZE, ly - tile_y * TEXTURE_VT_TILE_SIZE);
+        }
+
+        if (l == level)
+        {
+            Texture_RequestTile(texture, texturedata, l, tile_x, tile_y);
+        }
+    }
+
+    return make_float4(0.f, 0.f, 0.f, 0.f);
+}
+
+/// Fetch texel of mip level for both resident and virtual textures
+inline
+float4 Texture_FetchLevelTexel(__global Texture const* texture, __global char const* texturedata, int level, int x, int y)
+{
+    if (texture->vt_page_table != TEXTURE_VT_INVALID)
+    {
+        return Texture_FetchVirtualTexel(texture, texturedata, level, x, y);
+    }
+
+    int width = max(texture->w >> level, 1);
+    return Texture_FetchTexel(texturedata + texture->dataoffset + texture->mip_offsets[level], texture->fmt, width, x, y);
+}
+
+/// Sample mip level of 2D texture with bilinear filtering
+inline
+float4 Texture_SampleLevel(float2 uv, int level, TEXTURE_ARG_LIST_IDX(texidx))
+{
+    // Get width and height of the level
+    int width = max(textures[texidx].w >> level, 1);
+    int height = max(textures[texidx].h >> level, 1);
 
     // Find the origin of the data in the pool
-    __global char const* mydata = texturedata + textures[texidx].dataoffset;
+    __global char const* mydata = texturedata + textures[texidx].dataoffset + textures[texidx].mip_offsets[level];
 
     // Handle UV wrap
     // TODO: need UV mode support
@@ -65,6 +282,18 @@ float4 Texture_Sample2D(float2 uv, TEXTURE_ARG_LIST_IDX(texidx))
     float wx = uv.x * width - floor(uv.x * width);
     float wy = uv.y * height - floor(uv.y * height);
 
+    if (textures[texidx].vt_page_table != TEXTURE_VT_INVALID)
+    {
+        __global Texture const* texture = textures + texidx;
+        float4 val00 = Texture_FetchVirtualTexel(texture, texturedata, level, x0, y0);
+        float4 val01 = Texture_FetchVirtualTexel(texture, texturedata, level, x1, y0);
+        float4 val10 = Texture_FetchVirtualTexel(texture, texturedata, level, x0, y1);
+        float4 val11 = Texture_FetchVirtualTexel(texture, texturedata, level, x1, y1);
+
+        // Filter and return the result
+        return lerp(lerp(val00, val01, wx), lerp(val10, val11, wx), wy);
+    }
+
     switch (textures[texidx].fmt)
     {
         case RGBA32:
@@ -116,11 +345,67 @@ float4 Texture_Sample2D(float2 uv, TEXTURE_ARG_LIST_IDX(texidx))
 
         default:
         {
-            return make_float4(0.f, 0.f, 0.f, 0.f);
+            // Single and two channel and block compressed formats
+            int fmt = textures[texidx].fmt;
+            float4 val00 = Texture_FetchTexel(mydata, fmt, width, x0, y0);
+            float4 val01 = Texture_FetchTexel(mydata, fmt, width, x1, y0);
+            float4 val10 = Texture_FetchTexel(mydata, fmt, width, x0, y1);
+            float4 val11 = Texture_FetchTexel(mydata, fmt, width, x1, y1);
+
+            // Filter and return the result
+            return lerp(lerp(val00, val01, wx), lerp(val10, val11, wx), wy);
         }
     }
 }
 
+/// Sample 2D texture
+inline
+float4 Texture_Sample2D(float2 uv, TEXTURE_ARG_LIST_IDX(texidx))
+{
+    return Texture_SampleLevel(uv, 0, TEXTURE_ARGS_IDX(texidx));
+}
+
+/// Sample 2D texture with footprint given by UV derivatives along its major and minor axes.
+/// Uses trilinear filtering between mip levels and takes up to TEXTURE_MAX_ANISOTROPY
+/// samples along the major axis for anisotropic footprints.
+inline
+float4 Texture_Sample2DGrad(float2 uv, float2 duvdx, float2 duvdy, TEXTURE_ARG_LIST_IDX(texidx))
+{
+    int mip_count = textures[texidx].mip_count;
+
+    // Footprint lengths in texels of level 0
+    float2 size = make_float2((float)textures[texidx].w, (float)textures[texidx].h);
+    float lx = length(duvdx * size);
+    float ly = length(duvdy * size);
+    float major = max(lx, ly);
+    float minor = min(lx, ly);
+
+    if (mip_count <= 1 || major <= 1.f)
+    {
+        return Texture_SampleLevel(uv, 0, TEXTURE_ARGS_IDX(texidx));
+    }
+
+    float2 major_axis = lx > ly ? duvdx : duvdy;
+    int num_samples = clamp((int)ceil(major / max(minor, 1e-6f)), 1, TEXTURE_MAX_ANISOTROPY);
+
+    // Each sample covers major / num_samples texels
+    float lod = clamp(log2(major / num_samples), 0.f, (float)(mip_count - 1));
+    int level0 = (int)floor(lod);
+    int level1 = min(level0 + 1, mip_count - 1);
+    float t = lod - level0;
+
+    float4 result = 0.f;
+    for (int i = 0; i < num_samples; ++i)
+    {
+        float2 sample_uv = uv + ((i + 0.5f) / num_samples - 0.5f) * major_axis;
+        float4 val0 = Texture_SampleLevel(sample_uv, level0, TEXTURE_ARGS_IDX(texidx));
+        float4 val1 = Texture_SampleLevel(sample_uv, level1, TEXTURE_ARGS_IDX(texidx));
+        result += lerp(val0, val1, t);
+    }
+
+    return result / num_samples;
+}
+
 /// Sample lattitue-longitude environment map using 3d vector
 inline
 float3 Texture_SampleEnvMap(float3 d, TEXTURE_ARG_LIST_IDX(texidx), bool mirror_x)
@@ -290,6 +575,45 @@ inline float3 TextureData_SampleNormalFromBump_float4(__global float4 const* myd
 	return n;
 }
 
+inline float3 TextureData_SampleNormalFromBump(__global Texture const* texture, __global char const* texturedata, int width, int height, int t0, int s0)
+{
+    int t0minus = clamp(t0 - 1, 0, height - 1);
+    int t0plus = clamp(t0 + 1, 0, height - 1);
+    int s0minus = clamp(s0 - 1, 0, width - 1);
+    int s0plus = clamp(s0 + 1, 0, width - 1);
+
+    const float tex00 = Texture_FetchLevelTexel(texture, texturedata, 0, s0minus, t0minus).x;
+    const float tex10 = Texture_FetchLevelTexel(texture, texturedata, 0, s0, t0minus).x;
+    const float tex20 = Texture_FetchLevelTexel(texture, texturedata, 0, s0plus, t0minus).x;
+
+    const float tex01 = Texture_FetchLevelTexel(texture, texturedata, 0, s0minus, t0).x;
+    const float tex21 = Texture_FetchLevelTexel(texture, texturedata, 0, s0plus, t0).x;
+
+    const float tex02 = Texture_FetchLevelTexel(texture, texturedata, 0, s0minus, t0plus).x;
+    const float tex12 = Texture_FetchLevelTexel(texture, texturedata, 0, s0, t0plus).x;
+    const float tex22 = Texture_FetchLevelTexel(texture, texturedata, 0, s0plus, t0plus).x;
+
+    const float Gx = tex00 - tex20 + 2.0f * tex01 - 2.0f * tex21 + tex02 - tex22;
+    const float Gy = tex00 + 2.0f * tex10 + tex20 - tex02 - 2.0f * tex12 - tex22;
+    const float3 n = make_float3(Gx, Gy, 1.f);
+
+    return n;
+}
+
+/// Bump sampling for single and two channel, block compressed and virtual textures
+inline
+float3 Texture_SampleBumpGeneric(__global Texture const* texture, __global char const* texturedata, int width, int height, int s0, int t0, int s1, int t1, float wx, float wy)
+{
+    float3 n00 = TextureData_SampleNormalFromBump(texture, texturedata, width, height, t0, s0);
+    float3 n01 = TextureData_SampleNormalFromBump(texture, texturedata, width, height, t0, s1);
+    float3 n10 = TextureData_SampleNormalFromBump(texture, texturedata, width, height, t1, s0);
+    float3 n11 = TextureData_SampleNormalFromBump(texture, texturedata, width, height, t1, s1);
+
+    float3 n = lerp3(lerp3(n00, n01, wx), lerp3(n10, n11, wx), wy);
+
+    return 0.5f * normalize(n) + make_float3(0.5f, 0.5f, 0.5f);
+}
+
 /// Sample 2D texture
 inline
 float3 Texture_SampleBump(float2 uv, TEXTURE_ARG_LIST_IDX(texidx))
@@ -321,6 +645,11 @@ float3 Texture_SampleBump(float2 uv, TEXTURE_ARG_LIST_IDX(texidx))
 	float wx = uv.x * width - floor(uv.x * width);
 	float wy = uv.y * height - floor(uv.y * height);
 
+    if (textures[texidx].vt_page_table != TEXTURE_VT_INVALID)
+    {
+        return Texture_SampleBumpGeneric(textures + texidx, texturedata, width, height, s0, t0, s1, t1, wx, wy);
+    }
+
     switch (textures[texidx].fmt)
     {
     case RGBA32:
@@ -367,7 +696,7 @@ float3 Texture_SampleBump(float2 uv, TEXTURE_ARG_LIST_IDX(texidx))
 
     default:
     {
-        return make_float3(0.f, 0.f, 0.f);
+        return Texture_SampleBumpGeneric(textures + texidx, texturedata, width, height, s0, t0, s1, t1, wx, wy);
     }
     }
 }
@@ -58,8 +58,264 @@ float PhaseFunctionHG_Sample(float3 wi, float g, float2 sample, float3* wo)
     return PhaseFunctionHG(wi, *wo, g);
 }
 
+#define VOLUME_ARG_LIST GLOBAL VolumeGrid const* restrict volume_grids, GLOBAL float const* restrict volume_data
+#define VOLUME_ARGS volume_grids, volume_data
+
+// Ratio tracking terminates paths with transmittance below this value using russian roulette
+#define VOLUME_RR_THRESHOLD 0.1f
+
+// Density of voxel, zero outside of the grid or in empty bricks
+INLINE float VolumeGrid_GetVoxel(GLOBAL VolumeGrid const* grid, GLOBAL float const* restrict volume_data, int x, int y, int z)
+{
+    if (x < 0 || y < 0 || z < 0 ||
+        x >= grid->resolution[0] || y >= grid->resolution[1] || z >= grid->resolution[2])
+    {
+        return 0.f;
+    }
+
+    int brick_idx = ((z / VOLUME_BRICK_SIZE) * grid->brick_count[1] + y / VOLUME_BRICK_SIZE) * grid->brick_count[0] + x / VOLUME_BRICK_SIZE;
+    int brick = as_int(volume_data[grid->brick_table + brick_idx]);
+
+    if (brick == VOLUME_EMPTY_BRICK)
+    {
+        return 0.f;
+    }
+
+    int voxel = ((z % VOLUME_BRICK_SIZE) * VOLUME_BRICK_SIZE + y % VOLUME_BRICK_SIZE) * VOLUME_BRICK_SIZE + x % VOLUME_BRICK_SIZE;
+    return volume_data[grid->bricks + brick * VOLUME_BRICK_SIZE * VOLUME_BRICK_SIZE * VOLUME_BRICK_SIZE + voxel];
+}
+
+// Trilinearly interpolated density at world space point
+float VolumeGrid_GetDensity(GLOBAL VolumeGrid const* grid, GLOBAL float const* restrict volume_data, float3 p)
+{
+    float3 resolution = make_float3((float)grid->resolution[0], (float)grid->resolution[1], (float)grid->resolution[2]);
+    // Voxel values are defined at voxel centers
+    float3 v = (p - grid->bbox_min) / (grid->bbox_max - grid->bbox_min) * resolution - 0.5f;
+    float3 v0 = floor(v);
+    float3 f = v - v0;
+
+    int x = (int)v0.x;
+    int y = (int)v0.y;
+    int z = (int)v0.z;
+
+    float d00 = mix(VolumeGrid_GetVoxel(grid, volume_data, x, y, z), VolumeGrid_GetVoxel(grid, volume_data, x + 1, y, z), f.x);
+    float d10 = mix(VolumeGrid_GetVoxel(grid, volume_data, x, y + 1, z), VolumeGrid_GetVoxel(grid, volume_data, x + 1, y + 1, z), f.x);
+    float d01 = mix(VolumeGrid_GetVoxel(grid, volume_data, x, y, z + 1), VolumeGrid_GetVoxel(grid, volume_data, x + 1, y, z + 1), f.x);
+    float d11 = mix(VolumeGrid_GetVoxel(grid, volume_data, x, y + 1, z + 1), VolumeGrid_GetVoxel(grid, volume_data, x + 1, y + 1, z + 1), f.x);
+
+    return mix(mix(d00, d10, f.y), mix(d01, d11, f.y), f.z);
+}
+
+// 3D DDA over majorant grid (one cell per brick)
+typedef struct
+{
+    int3 cell;
+    int3 step;
+    int3 count;
+    float3 t_next;
+    float3 t_delta;
+    // Start of current segment and end of traversal
+    float t;
+    float t_end;
+} MajorantIterator;
+
+// Clip the ray to the grid bounds and [0, maxdist], returns false if nothing is left
+bool MajorantIterator_Init(MajorantIterator* it, GLOBAL VolumeGrid const* grid, float3 o, float3 d, float maxdist)
+{
+    float3 inv_d = native_recip(d);
+    float3 t0 = (grid->bbox_min - o) * inv_d;
+    float3 t1 = (grid->bbox_max - o) * inv_d;
+    float3 t_min = fmin(t0, t1);
+    float3 t_max = fmax(t0, t1);
+
+    float t_enter = max(max(t_min.x, t_min.y), max(t_min.z, 0.f));
+    float t_exit = min(min(t_max.x, t_max.y), min(t_max.z, maxdist));
+
+    if (!(t_enter < t_exit))
+    {
+        return false;
+    }
+
+    it->count = make_int3(grid->brick_count[0], grid->brick_count[1], grid->brick_count[2]);
+
+    float3 cell_size = (grid->bbox_max - grid->bbox_min) / convert_float3(it->count);
+    float3 p = (o + t_enter * d - grid->bbox_min) / cell_size;
+    it->cell = clamp(convert_int3(floor(p)), make_int3(0, 0, 0), it->count - 1);
+
+    float3 cell_min = grid->bbox_min + convert_float3(it->cell) * cell_size;
+    float3 cell_max = cell_min + cell_size;
+
+    it->step = make_int3(d.x > 0.f ? 1 : -1, d.y > 0.f ? 1 : -1, d.z > 0.f ? 1 : -1);
+    it->t_next = make_float3(
+        d.x != 0.f ? ((d.x > 0.f ? cell_max.x : cell_min.x) - o.x) * inv_d.x : INFINITY,
+        d.y != 0.f ? ((d.y > 0.f ? cell_max.y : cell_min.y) - o.y) * inv_d.y : INFINITY,
+        d.z != 0.f ? ((d.z > 0.f ? cell_max.z : cell_min.z) - o.z) * inv_d.z : INFINITY);
+    it->t_delta = make_float3(
+        d.x != 0.f ? cell_size.x * fabs(inv_d.x) : INFINITY,
+        d.y != 0.f ? cell_size.y * fabs(inv_d.y) : INFINITY,
+        d.z != 0.f ? cell_size.z * fabs(inv_d.z) : INFINITY);
+
+    it->t = t_enter;
+    it->t_end = t_exit;
+    return true;
+}
+
+// Get next segment [t_begin, t_end] of the ray with constant majorant
+bool MajorantIterator_Next(MajorantIterator* it, GLOBAL VolumeGrid const* grid, GLOBAL float const* restrict volume_data,
+    float* t_begin, float* t_end, float* majorant)
+{
+    if (it->t >= it->t_end ||
+        any(it->cell < 0) || any(it->cell >= it->count))
+    {
+        return false;
+    }
+
+    float t_exit = min(min(it->t_next.x, it->t_next.y), min(it->t_next.z, it->t_end));
+
+    *majorant = volume_data[grid->majorants + (it->cell.z * it->count.y + it->cell.y) * it->count.x + it->cell.x];
+    *t_begin = it->t;
+    *t_end = t_exit;
+
+    if (it->t_next.x <= it->t_next.y && it->t_next.x <= it->t_next.z)
+    {
+        it->cell.x += it->step.x;
+        it->t_next.x += it->t_delta.x;
+    }
+    else if (it->t_next.y <= it->t_next.z)
+    {
+        it->cell.y += it->step.y;
+        it->t_next.y += it->t_delta.y;
+    }
+    else
+    {
+        it->cell.z += it->step.z;
+        it->t_next.z += it->t_delta.z;
+    }
+
+    it->t = t_exit;
+    return true;
+}
+
+// Estimate transmittance of heterogeneous volume along the ray [0, dist] segment with ratio tracking.
+// Extinction is sigma_a + sigma_s scaled by density, majorant is taken from majorant grid
+// scaled by maximum component of extinction.
+float3 Volume_RatioTracking(GLOBAL Volume const* volume, GLOBAL ray const* ray, float dist, VOLUME_ARG_LIST, Sampler* sampler)
+{
+    GLOBAL VolumeGrid const* grid = volume_grids + volume->data;
+    float3 sigma_t = TEXTURED_INPUT_GET_COLOR(volume->sigma_a) +
+                     TEXTURED_INPUT_GET_COLOR(volume->sigma_s);
+    float mu = max(sigma_t.x, max(sigma_t.y, sigma_t.z));
+
+    float3 o = ray->o.xyz;
+    float3 d = ray->d.xyz;
+
+    MajorantIterator it;
+    if (mu <= 0.f || !MajorantIterator_Init(&it, grid, o, d, dist))
+    {
+        return 1.f;
+    }
+
+    float3 tr = 1.f;
+    float t_begin, t_end, majorant;
+    while (MajorantIterator_Next(&it, grid, volume_data, &t_begin, &t_end, &majorant))
+    {
+        // Empty regions are skipped in a single step
+        if (majorant <= 0.f)
+            continue;
+
+        float m = majorant * mu;
+        float t = t_begin;
+        for (;;)
+        {
+            t -= native_log(1.f - UniformSampler_Sample1D(sampler)) / m;
+
+            if (t >= t_end)
+                break;
+
+            float density = VolumeGrid_GetDensity(grid, volume_data, o + t * d);
+            tr *= 1.f - density * sigma_t / m;
+
+            float tr_max = max(tr.x, max(tr.y, tr.z));
+            if (tr_max < VOLUME_RR_THRESHOLD)
+            {
+                if (UniformSampler_Sample1D(sampler) >= tr_max)
+                    return 0.f;
+
+                tr /= tr_max;
+            }
+        }
+    }
+
+    return tr;
+}
+
+// Sample free flight distance in heterogeneous volume with delta tracking.
+// Returns distance to a real collision or -1 if the ray has passed [0, maxdist] segment.
+// Chromatic extinction is handled with spectral tracking: collision type is chosen
+// by maximum over channels of real and null collision coefficients and weight compensates
+// for the difference. Emission collected along the way is weighted by tracking weights.
+float Volume_DeltaTracking(GLOBAL Volume const* volume, GLOBAL ray const* ray, float maxdist, VOLUME_ARG_LIST, Sampler* sampler,
+    float3* weight, float3* emission)
+{
+    GLOBAL VolumeGrid const* grid = volume_grids + volume->data;
+    float3 sigma_s = TEXTURED_INPUT_GET_COLOR(volume->sigma_s);
+    float3 sigma_e = TEXTURED_INPUT_GET_COLOR(volume->sigma_e);
+    float3 sigma_t = TEXTURED_INPUT_GET_COLOR(volume->sigma_a) + sigma_s;
+    float mu = max(sigma_t.x, max(sigma_t.y, sigma_t.z));
+
+    float3 o = ray->o.xyz;
+    float3 d = ray->d.xyz;
+
+    *weight = 1.f;
+    *emission = 0.f;
+
+    MajorantIterator it;
+    if (mu <= 0.f || !MajorantIterator_Init(&it, grid, o, d, maxdist))
+    {
+        return -1.f;
+    }
+
+    float t_begin, t_end, majorant;
+    while (MajorantIterator_Next(&it, grid, volume_data, &t_begin, &t_end, &majorant))
+    {
+        // Empty regions are skipped in a single step
+        if (majorant <= 0.f)
+            continue;
+
+        float m = majorant * mu;
+        float t = t_begin;
+        for (;;)
+        {
+            t -= native_log(1.f - UniformSampler_Sample1D(sampler)) / m;
+
+            if (t >= t_end)
+                break;
+
+            float density = VolumeGrid_GetDensity(grid, volume_data, o + t * d);
+            *emission += *weight * density * sigma_e / m;
+
+            float3 sigma_n = m - density * sigma_t;
+            float p_real = density * mu;
+            float p_null = max(sigma_n.x, max(sigma_n.y, sigma_n.z));
+            float p = p_real / (p_real + p_null);
+
+            // Real collision
+            if (UniformSampler_Sample1D(sampler) < p)
+            {
+                *weight *= density * sigma_s / (m * p);
+                return t;
+            }
+
+            // Null collision
+            *weight *= sigma_n / (m * (1.f - p));
+        }
+    }
+
+    return -1.f;
+}
+
 // Evaluate volume transmittance along the ray [0, dist] segment
-float3 Volume_Transmittance(GLOBAL Volume const* volume, GLOBAL ray const* ray, float dist)
+float3 Volume_Transmittance(GLOBAL Volume const* volume, GLOBAL ray const* ray, float dist, VOLUME_ARG_LIST, Sampler* sampler)
 {
     switch (volume->type)
     {
@@ -70,12 +326,17 @@ float3 Volume_Transmittance(GLOBAL Volume const* volume, GLOBAL ray const* ray,
                              TEXTURED_INPUT_GET_COLOR(volume->sigma_s);
             return native_exp(-sigma_t * dist);
         }
+        case kHeterogeneous:
+        {
+            return Volume_RatioTracking(volume, ray, dist, VOLUME_ARGS, sampler);
+        }
     }
     
     return 1.f;
 }
 
-// Evaluate volume selfemission along the ray [0, dist] segment
+// Evaluate volume selfemission along the ray [0, dist] segment.
+// Emission of heterogeneous volumes is collected by delta tracking.
 float3 Volume_Emission(GLOBAL Volume const* volume, GLOBAL ray const* ray, float dist)
 {
     switch (volume->type)
@@ -149,6 +410,8 @@ KERNEL void SampleVolume(
     GLOBAL int const* numrays,
     // Volumes
     GLOBAL Volume const* volumes,
+    // Density grids
+    VOLUME_ARG_LIST,
     // Textures
     TEXTURE_ARG_LIST,
     // RNG seed
@@ -188,22 +451,59 @@ KERNEL void SampleVolume(
         // Check if we are inside some volume
         if (volidx != -1)
         {
+            bounce = Path_GetBounce(path, bounce);
+
             Sampler sampler;
 #if SAMPLER == SOBOL
-            uint scramble = random[pixelidx] * 0x1fe3434f;
+            uint scramble = Path_GetScramble(path, random[pixelidx] * 0x1fe3434f);
             Sampler_Init(&sampler, frame, SAMPLE_DIM_SURFACE_OFFSET + bounce * SAMPLE_DIMS_PER_BOUNCE + SAMPLE_DIM_VOLUME_APPLY_OFFSET, scramble);
 #elif SAMPLER == RANDOM
             uint scramble = pixelidx * rngseed;
             Sampler_Init(&sampler, scramble);
 #elif SAMPLER == CMJ
             uint rnd = random[pixelidx];
-            uint scramble = rnd * 0x1fe3434f * ((frame + 71 * rnd) / (CMJ_DIM * CMJ_DIM));
+            uint scramble = Path_GetScramble(path, rnd * 0x1fe3434f * ((frame + 71 * rnd) / (CMJ_DIM * CMJ_DIM)));
             Sampler_Init(&sampler, frame % (CMJ_DIM * CMJ_DIM), SAMPLE_DIM_SURFACE_OFFSET + bounce * SAMPLE_DIMS_PER_BOUNCE + SAMPLE_DIM_VOLUME_APPLY_OFFSET, scramble);
 #endif
 
+            float maxdist = Intersection_GetDistance(isects + globalid);
+
+            // Random numbers for tracking, their count is not bounded
+            Sampler tracker;
+            tracker.index = WangHash(rngseed ^ WangHash(pixelidx));
+
+            if (volumes[volidx].type == kHeterogeneous)
+            {
+                float3 weight;
+                float3 emission;
+                float d = Volume_DeltaTracking(&volumes[volidx], &rays[globalid], maxdist, VOLUME_ARGS, &tracker, &weight, &emission);
+
+                // Emission contribution accounting for a throughput we have so far
+                Path_AddContribution(path, output, output_indices[pixelidx], emission);
+                Path_MulThroughput(path, weight);
+
+                if (d < 0.f)
+                {
+                    Path_ClearScatterFlag(path);
+                }
+                else if (!NON_BLACK(weight))
+                {
+                    // Absorbed
+                    Path_ClearScatterFlag(path);
+                    Path_Kill(path);
+                }
+                else
+                {
+                    Path_SetScatterFlag(path);
+                    isects[globalid].shapeid = FAKE_SHAPE_SENTINEL;
+                    isects[globalid].uvwt.w = d;
+                }
+
+                return;
+            }
+
             // Try sampling volume for a next scattering event
             float pdf = 0.f;
-            float maxdist = Intersection_GetDistance(isects + globalid);
             float2 sample = Sampler_Sample2D(&sampler, SAMPLER_ARGS);
             float2 sample1 = Sampler_Sample2D(&sampler, SAMPLER_ARGS);
             float d = Volume_SampleDistance(&volumes[volidx], &rays[globalid], maxdist, make_float2(sample.x, sample1.y), &pdf);
@@ -217,7 +517,7 @@ KERNEL void SampleVolume(
                 // and clear scatter flag
                 Path_ClearScatterFlag(path);
                 // And finally update the throughput
-                Path_MulThroughput(path, Volume_Transmittance(&volumes[volidx], &rays[globalid], maxdist) * Volume_GetDistancePdf(&volumes[volidx], maxdist));
+                Path_MulThroughput(path, Volume_Transmittance(&volumes[volidx], &rays[globalid], maxdist, VOLUME_ARGS, &tracker) * Volume_GetDistancePdf(&volumes[volidx], maxdist));
                 // Emission contribution accounting for a throughput we have so far
                 Path_AddContribution(path, output, output_indices[pixelidx], Volume_Emission(&volumes[volidx], &rays[globalid], maxdist));
             }
@@ -227,7 +527,7 @@ KERNEL void SampleVolume(
                 Path_SetScatterFlag(path);
                 // Update the throughput
                 float3 sigma_s = TEXTURED_INPUT_GET_COLOR(volumes[volidx].sigma_s);
-                Path_MulThroughput(path, sigma_s * (Volume_Transmittance(&volumes[volidx], &rays[globalid], d) / pdf));
+                Path_MulThroughput(path, sigma_s * (Volume_Transmittance(&volumes[volidx], &rays[globalid], d, VOLUME_ARGS, &tracker) / pdf));
                 // Emission contribution accounting for a throughput we have so far
                 Path_AddContribution(path, output, output_indices[pixelidx], Volume_Emission(&volumes[volidx], &rays[globalid], d) / pdf);
                 // Put fake shape to prevent from being compacted away
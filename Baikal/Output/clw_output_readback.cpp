@@ -0,0 +1,168 @@
+/**********************************************************************
+Copyright (c) 2018 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#include "Output/clw_output_readback.h"
+
+#ifdef BAIKAL_EMBED_KERNELS
+#include "embed_kernels.h"
+#endif
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace Baikal
+{
+    bool ClwOutputReadback::Request::IsReady() const
+    {
+        return valid() && m_event.GetCommandExecutionStatus() == CL_COMPLETE;
+    }
+
+    float const* ClwOutputReadback::Request::Get() const
+    {
+        if (!valid() || m_owner->m_buffers[m_slot].generation != m_generation)
+        {
+            throw std::runtime_error("ClwOutputReadback: request data is not available");
+        }
+
+        m_event.Wait();
+        return m_data;
+    }
+
+    ClwOutputReadback::ClwOutputReadback(CLWContext context, const CLProgramManager *program_manager, std::uint32_t num_buffers)
+#ifdef BAIKAL_EMBED_KERNELS
+        : ClwClass(context, program_manager, "output_readback", g_output_readback_opencl, g_output_readback_opencl_headers, "")
+#else
+        : ClwClass(context, program_manager, "../Baikal/Kernels/CL/output_readback.cl", "")
+#endif
+        , m_buffers(std::max(num_buffers, 1u))
+    {
+    }
+
+    ClwOutputReadback::~ClwOutputReadback()
+    {
+        for (auto& buffer : m_buffers)
+        {
+            Release(buffer);
+        }
+    }
+
+    void ClwOutputReadback::Reserve(StagingBuffer& buffer, std::size_t size)
+    {
+        if (buffer.size >= size)
+        {
+            return;
+        }
+
+        Release(buffer);
+
+        auto context = GetContext();
+        buffer.device = context.CreateBuffer<float>(size, CL_MEM_READ_WRITE);
+        // Allocated by the driver in page locked memory, copies to it run at full bus speed
+        buffer.pinned = context.CreateBuffer<float>(size, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR);
+        context.MapBuffer(0, buffer.pinned, CL_MAP_READ | CL_MAP_WRITE, &buffer.host).Wait();
+        buffer.size = size;
+    }
+
+    void ClwOutputReadback::Release(StagingBuffer& buffer)
+    {
+        if (buffer.pending)
+        {
+            buffer.event.Wait();
+            buffer.pending = false;
+        }
+
+        if (buffer.host)
+        {
+            GetContext().UnmapBuffer(0, buffer.pinned, buffer.host).Wait();
+            buffer.host = nullptr;
+        }
+
+        buffer.size = 0;
+    }
+
+    ClwOutputReadback::Request ClwOutputReadback::Read(ClwOutput const& output, Settings const& settings)
+    {
+        if (settings.channels < 1 || settings.channels > 4)
+        {
+            throw std::runtime_error("ClwOutputReadback: number of channels should be 1 - 4");
+        }
+
+        auto slot = m_next_buffer;
+        m_next_buffer = (m_next_buffer + 1) % m_buffers.size();
+
+        auto& buffer = m_buffers[slot];
+
+        // Only blocks if the host is num_buffers reads ahead of the device
+        if (buffer.pending)
+        {
+            buffer.event.Wait();
+            buffer.pending = false;
+        }
+
+        auto width = output.width();
+        auto height = output.height();
+        auto size = static_cast<std::size_t>(width) * height * settings.channels;
+
+        Reserve(buffer, size);
+
+        auto kernel = GetKernel("ResolveOutput");
+
+        int argc = 0;
+        if (output.format() == Output::Format::kRGBA32F)
+        {
+            kernel.SetArg(argc++, output.data());
+        }
+        else
+        {
+            kernel.SetArg(argc++, output.packed_data());
+        }
+        kernel.SetArg(argc++, static_cast<int>(output.format()));
+        kernel.SetArg(argc++, static_cast<int>(width));
+        kernel.SetArg(argc++, static_cast<int>(height));
+        kernel.SetArg(argc++, static_cast<int>(settings.channels));
+        kernel.SetArg(argc++, settings.normalize ? 1 : 0);
+        kernel.SetArg(argc++, 1.f / settings.gamma);
+        kernel.SetArg(argc++, settings.flip_y ? 1 : 0);
+        kernel.SetArg(argc++, buffer.device);
+
+        auto context = GetContext();
+        auto num_pixels = static_cast<std::size_t>(width) * height;
+        context.Launch1D(0, ((num_pixels + 63) / 64) * 64, 64, kernel);
+
+        buffer.event = context.ReadBuffer(0, buffer.device, buffer.host, size);
+        buffer.pending = true;
+        ++buffer.generation;
+
+        // Submit without waiting so the device starts while the host goes on
+        context.Flush(0);
+
+        Request request;
+        request.m_owner = this;
+        request.m_slot = slot;
+        request.m_generation = buffer.generation;
+        request.m_event = buffer.event;
+        request.m_data = buffer.host;
+        request.m_width = width;
+        request.m_height = height;
+        request.m_channels = settings.channels;
+        return request;
+    }
+}
@@ -0,0 +1,119 @@
+/**********************************************************************
+Copyright (c) 2018 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#pragma once
+
+#include "Output/clwoutput.h"
+#include "Utils/clw_class.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace Baikal
+{
+    /**
+     \brief Asynchronous readback of outputs.
+
+     Read resolves an output on the device (normalization by sample count, gamma,
+     row flip and channel packing) and enqueues a copy into a pinned staging buffer
+     without waiting for it. The host keeps enqueueing work while the copy is in
+     flight and picks the image up from the returned request later.
+
+     Staging buffers form a ring: data of a request stays valid until the
+     num_buffers-th following Read, which waits for the copy if it is still pending.
+     */
+    class ClwOutputReadback : public ClwClass
+    {
+    public:
+        struct Settings
+        {
+            // Number of channels in resulting image (1 - 4)
+            std::uint32_t channels = 4;
+            // Gamma applied to rgb, 1 keeps values linear
+            float gamma = 1.f;
+            // Divide by sample count in w
+            bool normalize = true;
+            // Store rows bottom to top, as image files expect
+            bool flip_y = false;
+        };
+
+        class Request
+        {
+        public:
+            Request() = default;
+
+            // Check if the copy has finished without blocking
+            bool IsReady() const;
+            // Wait for the copy and return width * height * channels floats,
+            // throws if the staging buffer has already been reused
+            float const* Get() const;
+
+            bool valid() const { return m_owner != nullptr; }
+            std::uint32_t width() const { return m_width; }
+            std::uint32_t height() const { return m_height; }
+            std::uint32_t channels() const { return m_channels; }
+
+        private:
+            friend class ClwOutputReadback;
+
+            ClwOutputReadback const* m_owner = nullptr;
+            std::size_t m_slot = 0;
+            std::uint64_t m_generation = 0;
+            mutable CLWEvent m_event;
+            float const* m_data = nullptr;
+            std::uint32_t m_width = 0;
+            std::uint32_t m_height = 0;
+            std::uint32_t m_channels = 0;
+        };
+
+        ClwOutputReadback(CLWContext context, const CLProgramManager *program_manager, std::uint32_t num_buffers = 3);
+        ~ClwOutputReadback() override;
+
+        ClwOutputReadback(ClwOutputReadback const&) = delete;
+        ClwOutputReadback& operator=(ClwOutputReadback const&) = delete;
+
+        // Enqueue readback of the output
+        Request Read(ClwOutput const& output, Settings const& settings);
+        Request Read(ClwOutput const& output) { return Read(output, Settings()); }
+
+    private:
+        struct StagingBuffer
+        {
+            // Resolved image on the device
+            CLWBuffer<float> device;
+            // Pinned host memory, mapped for the lifetime of the buffer
+            CLWBuffer<float> pinned;
+            float* host = nullptr;
+            std::size_t size = 0;
+            // Last copy into host memory
+            CLWEvent event;
+            bool pending = false;
+            // Incremented on every reuse to detect stale requests
+            std::uint64_t generation = 0;
+        };
+
+        void Reserve(StagingBuffer& buffer, std::size_t size);
+        void Release(StagingBuffer& buffer);
+
+        std::vector<StagingBuffer> m_buffers;
+        std::size_t m_next_buffer = 0;
+    };
+}
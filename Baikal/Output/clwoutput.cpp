@@ -0,0 +1,141 @@
+/**********************************************************************
+Copyright (c) 2018 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#include "Output/clwoutput.h"
+#include "Utils/half.h"
+
+#include <cstring>
+#include <vector>
+
+namespace Baikal
+{
+    namespace
+    {
+        inline float HalfToFloat(cl_uint bits)
+        {
+            half h;
+            h.setBits(static_cast<unsigned short>(bits & 0xffff));
+            return h;
+        }
+
+        inline cl_uint FloatToHalf(float value)
+        {
+            return half(value).bits();
+        }
+
+        inline float BitsToFloat(cl_uint bits)
+        {
+            float value;
+            std::memcpy(&value, &bits, sizeof(float));
+            return value;
+        }
+
+        inline cl_uint FloatToBits(float value)
+        {
+            cl_uint bits;
+            std::memcpy(&bits, &value, sizeof(float));
+            return bits;
+        }
+    }
+
+    void ClwOutput::GetData(RadeonRays::float3* data, size_t offset, size_t elems_count) const
+    {
+        if (format() == Format::kRGBA32F)
+        {
+            m_context.ReadBuffer(
+                0,
+                m_data,
+                data,
+                offset,
+                elems_count).Wait();
+            return;
+        }
+
+        // Read packed pixels and expand them on the host
+        auto pixel_size = GetPixelSize(format()) / sizeof(cl_uint);
+        std::vector<cl_uint> packed(elems_count * pixel_size);
+
+        m_context.ReadBuffer(
+            0,
+            m_packed_data,
+            packed.data(),
+            offset * pixel_size,
+            packed.size()).Wait();
+
+        for (size_t i = 0; i < elems_count; ++i)
+        {
+            auto pixel = &packed[i * pixel_size];
+            auto& value = data[i];
+
+            switch (format())
+            {
+            case Format::kR32F:
+                value.x = value.y = value.z = BitsToFloat(pixel[0]);
+                break;
+            case Format::kRG16F:
+                value.x = HalfToFloat(pixel[0]);
+                value.y = HalfToFloat(pixel[0] >> 16);
+                value.z = 0.f;
+                break;
+            case Format::kRGBA16F:
+                value.x = HalfToFloat(pixel[0]);
+                value.y = HalfToFloat(pixel[0] >> 16);
+                value.z = HalfToFloat(pixel[1]);
+                break;
+            case Format::kR32UI:
+                value.x = value.y = value.z = (pixel[0] == ~0u) ? -1.f : static_cast<float>(pixel[0]);
+                break;
+            default:
+                break;
+            }
+
+            value.w = 1.f;
+        }
+    }
+
+    void ClwOutput::Clear(RadeonRays::float3 const& val)
+    {
+        switch (format())
+        {
+        case Format::kRGBA32F:
+            m_context.FillBuffer(0, m_data, val, m_data.GetElementCount()).Wait();
+            break;
+        case Format::kR32F:
+            m_context.FillBuffer(0, m_packed_data, FloatToBits(val.x), m_packed_data.GetElementCount()).Wait();
+            break;
+        case Format::kRG16F:
+            m_context.FillBuffer(0, m_packed_data, FloatToHalf(val.x) | (FloatToHalf(val.y) << 16), m_packed_data.GetElementCount()).Wait();
+            break;
+        case Format::kRGBA16F:
+        {
+            cl_uint2 pattern;
+            pattern.s[0] = FloatToHalf(val.x) | (FloatToHalf(val.y) << 16);
+            pattern.s[1] = FloatToHalf(val.z) | (FloatToHalf(1.f) << 16);
+            auto buffer = CLWBuffer<cl_uint2>::CreateFromClBuffer(m_packed_data);
+            m_context.FillBuffer(0, buffer, pattern, buffer.GetElementCount()).Wait();
+            break;
+        }
+        case Format::kR32UI:
+            m_context.FillBuffer(0, m_packed_data, val.x < 0.f ? ~0u : static_cast<cl_uint>(val.x), m_packed_data.GetElementCount()).Wait();
+            break;
+        }
+    }
+}
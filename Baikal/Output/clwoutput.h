@@ -3,42 +3,59 @@
 #include "output.h"
 #include "CLW.h"
 
+#include <stdexcept>
+
 namespace Baikal
 {
     class ClwOutput : public Output
     {
     public:
-        ClwOutput(CLWContext context, std::uint32_t w, std::uint32_t h)
-        : Output(w, h)
+        ClwOutput(CLWContext context, std::uint32_t w, std::uint32_t h, Format format = Format::kRGBA32F)
+        : Output(w, h, format)
         , m_context(context)
-        , m_data(context.CreateBuffer<RadeonRays::float3>(w*h, CL_MEM_READ_WRITE))
         {
+            if (format == Format::kRGBA32F)
+            {
+                m_data = context.CreateBuffer<RadeonRays::float3>(w*h, CL_MEM_READ_WRITE);
+            }
+            else
+            {
+                m_packed_data = context.CreateBuffer<cl_uint>(w * h * GetPixelSize(format) / sizeof(cl_uint), CL_MEM_READ_WRITE);
+            }
         }
 
         void GetData(RadeonRays::float3* data) const override
         {
-            m_context.ReadBuffer(0, m_data, data, m_data.GetElementCount()).Wait();
+            GetData(data, 0, width() * height());
         }
 
-        void GetData(RadeonRays::float3* data, /* offset in elems */ size_t offset, /* read elems */size_t elems_count) const override
+        void GetData(RadeonRays::float3* data, /* offset in elems */ size_t offset, /* read elems */size_t elems_count) const override;
+
+        void Clear(RadeonRays::float3 const& val) override;
+
+        // Device buffer of kRGBA32F output
+        CLWBuffer<RadeonRays::float3> data() const
         {
-            m_context.ReadBuffer(
-                0,
-                m_data,
-                data,
-                offset,
-                elems_count).Wait();
+            if (format() != Format::kRGBA32F)
+            {
+                throw std::runtime_error("ClwOutput: packed output has no float3 data");
+            }
+            return m_data;
         }
 
-        void Clear(RadeonRays::float3 const& val) override
+        // Device buffer of packed output, pixels are 1 or 2 elements depending on format
+        CLWBuffer<cl_uint> packed_data() const
         {
-            m_context.FillBuffer(0, m_data, val, m_data.GetElementCount()).Wait();
+            if (format() == Format::kRGBA32F)
+            {
+                throw std::runtime_error("ClwOutput: output is not packed");
+            }
+            return m_packed_data;
         }
 
-        CLWBuffer<RadeonRays::float3> data() const { return m_data; }
-
     private:
         CLWContext m_context;
         CLWBuffer<RadeonRays::float3> m_data;
+        CLWBuffer<cl_uint> m_packed_data;
     };
 }
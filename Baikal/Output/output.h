@@ -44,15 +44,38 @@ namespace Baikal
     class Output
     {
     public:
+        /**
+         \brief Pixel format of output surface.
+
+         kRGBA32F outputs accumulate sum of samples with sample count in w.
+         Packed formats hold the mean of samples accumulated since last clear
+         and can only be used for outputs rendered in AOV pass, GetData converts
+         them to float3 with w of 1.
+         */
+        enum class Format
+        {
+            kRGBA32F = 0,
+            // Single channel, e.g. depth or gloss, returned in xyz
+            kR32F,
+            // Two channels, e.g. UV
+            kRG16F,
+            // Three channels, e.g. normals or albedo
+            kRGBA16F,
+            // Integer ids, returned in xyz as float, -1 for no id
+            kR32UI
+        };
+
         /**
          \brief Create output of a given size
          
          \param w Output surface width
          \param h Output surface height
+         \param format Pixel format
          */
-        Output(std::uint32_t w, std::uint32_t h)
+        Output(std::uint32_t w, std::uint32_t h, Format format = Format::kRGBA32F)
         : m_width(w)
         , m_height(h)
+        , m_format(format)
         {
         }
 
@@ -72,14 +95,37 @@ namespace Baikal
         std::uint32_t width() const;
         // Get surface height
         std::uint32_t height() const;
+        // Get pixel format
+        Format format() const;
+
+        // Size of pixel in bytes
+        static std::uint32_t GetPixelSize(Format format);
 
     private:
         // Surface width
         std::uint32_t m_width;
         // Surface height
         std::uint32_t m_height;
+        // Pixel format
+        Format m_format;
     };
     
     inline std::uint32_t Output::width() const { return m_width; }
     inline std::uint32_t Output::height() const { return m_height; }
+    inline Output::Format Output::format() const { return m_format; }
+
+    inline std::uint32_t Output::GetPixelSize(Format format)
+    {
+        switch (format)
+        {
+        case Format::kR32F:
+        case Format::kRG16F:
+        case Format::kR32UI:
+            return 4;
+        case Format::kRGBA16F:
+            return 8;
+        default:
+            return 16;
+        }
+    }
 }
@@ -63,7 +63,9 @@ namespace Baikal
                     float gpu_memory_fraction,
                     std::string const &visible_devices,
                     std::size_t width,
-                    std::size_t height) {
+                    std::size_t height,
+                    std::size_t tile_size,
+                    std::size_t tile_overlap) {
                 std::string model_path;
                 std::size_t input_channels;
                 switch (inputs) {
@@ -86,7 +88,9 @@ namespace Baikal
                                                        visible_devices,
                                                        width,
                                                        height,
-                                                       input_channels);
+                                                       input_channels,
+                                                       tile_size,
+                                                       tile_overlap);
             }
         }
 
@@ -101,6 +105,9 @@ namespace Baikal
             RegisterParameter("gpu_memory_fraction", .1f);
             RegisterParameter("start_spp", 8u);
             RegisterParameter("visible_devices", std::string());
+            // Inference tile size in pixels (0 to infer whole frames) and overlap of neighbour tiles
+            RegisterParameter("tile_size", 512u);
+            RegisterParameter("tile_overlap", 32u);
 
             m_context = std::make_unique<CLWContext>(context);
             m_primitives = std::make_unique<CLWParallelPrimitives>(context);
@@ -131,25 +138,33 @@ namespace Baikal
                     m_context->CreateBuffer<float>(1, CL_MEM_READ_WRITE));
         }
 
+        MLDenoiser::~MLDenoiser()
+        {
+            DropPendingInput();
+        }
+
         void MLDenoiser::InitInference()
         {
             auto gpu_memory_fraction = GetParameter("gpu_memory_fraction").GetFloat();
             auto visible_devices = GetParameter("visible_devices").GetString();
+            auto tile_size = GetParameter("tile_size").GetUint();
+            auto tile_overlap = GetParameter("tile_overlap").GetUint();
+
+            // Pending tensor belongs to the pool of previous inference
+            DropPendingInput();
 
             m_inference = CreateInference(m_inputs,
                                           gpu_memory_fraction,
                                           visible_devices,
-                                          m_width, m_height);
+                                          m_width, m_height,
+                                          tile_size, tile_overlap);
 
             // Realloc cache if needed
             auto shape = m_inference->GetInputShape();
 
-            size_t bytes_count = sizeof(Tensor::ValueType) * shape.width * shape.height * shape.channels;
-
-            if (m_host_cache.size() != bytes_count)
+            if (!m_device_tensor ||
+                m_device_tensor->GetElementCount() != shape.channels * shape.width * shape.height)
             {
-                m_host_cache.resize(shape.width * shape.height);
-
                 m_device_cache.reset();
                 m_device_cache = std::make_unique<CLWBuffer<float3>>(
                         CLWBuffer<float3>::Create(*m_context, CL_MEM_READ_WRITE, shape.width * shape.height));
@@ -159,15 +174,54 @@ namespace Baikal
                         CLWBuffer<float3>::Create(*m_context, CL_MEM_READ_WRITE, shape.width * shape.height));
                 m_has_denoised_image = false;
 
+                // Only rgb is copied from inference output, alpha stays 1
+                m_context->FillBuffer(0,
+                                      *m_last_denoised_image,
+                                      float3(0.f, 0.f, 0.f, 1.f),
+                                      m_last_denoised_image->GetElementCount());
+
                 m_device_tensor = std::make_unique<CLWBuffer<float>>(
                         CLWBuffer<float>::Create(*m_context,
                                                  CL_MEM_READ_WRITE,
                                                  shape.channels * shape.width * shape.height));
 
-                m_host_cache.resize(shape.width * shape.height);
+                auto output_shape = m_inference->GetOutputShape();
+                m_device_output_tensor = std::make_unique<CLWBuffer<float>>(
+                        CLWBuffer<float>::Create(*m_context,
+                                                 CL_MEM_READ_ONLY,
+                                                 output_shape.channels * output_shape.width * output_shape.height));
             }
         }
 
+        void MLDenoiser::PushPendingInput()
+        {
+            if (m_pending_input.empty())
+            {
+                return;
+            }
+
+            m_pending_event.Wait();
+
+#ifdef ML_DENOISER_IMAGES_DIR
+            static unsigned input_index = 0;
+            SaveImage("input", m_pending_input.data(), m_pending_input.size(), input_index++);
+#endif
+
+            m_inference->PushInput(std::move(m_pending_input));
+            m_pending_input = Tensor();
+        }
+
+        void MLDenoiser::DropPendingInput()
+        {
+            if (m_pending_input.empty())
+            {
+                return;
+            }
+
+            m_pending_event.Wait();
+            m_pending_input = Tensor();
+        }
+
         PostEffect::InputTypes MLDenoiser::GetInputTypes() const
         {
             switch (m_inputs) {
@@ -230,15 +284,32 @@ namespace Baikal
         {
             auto shape = m_inference->GetInputShape();
 
+            CopyInterleaved(*m_device_tensor,
+                            dst_channels_offset,
+                            static_cast<int>(shape.channels),
+                            CLWBuffer<float>::CreateFromClBuffer(src_buffer),
+                            src_channels_offset,
+                            src_channels_num,
+                            channels_to_copy);
+        }
+
+        void MLDenoiser::CopyInterleaved(CLWBuffer<float> dst,
+                                         int dst_channels_offset,
+                                         int dst_channels_num,
+                                         CLWBuffer<float> src,
+                                         int src_channels_offset,
+                                         int src_channels_num,
+                                         int channels_to_copy)
+        {
             auto copy_kernel = GetKernel("CopyInterleaved");
 
             int argc = 0;
-            copy_kernel.SetArg(argc++, *m_device_tensor);
-            copy_kernel.SetArg(argc++, src_buffer);
+            copy_kernel.SetArg(argc++, dst);
+            copy_kernel.SetArg(argc++, src);
             copy_kernel.SetArg(argc++, m_width);
             copy_kernel.SetArg(argc++, m_height);
             copy_kernel.SetArg(argc++, dst_channels_offset);
-            copy_kernel.SetArg(argc++, static_cast<int>(shape.channels));
+            copy_kernel.SetArg(argc++, dst_channels_num);
             // input and output buffers have the same width in pixels
             copy_kernel.SetArg(argc++, m_width);
             // input and output buffers have the same height in pixels
@@ -254,8 +325,6 @@ namespace Baikal
                                 thread_num,
                                 64,
                                 copy_kernel);
-
-
         }
 
         void MLDenoiser::Apply(InputSet const& input_set, Output& output)
@@ -276,8 +345,10 @@ namespace Baikal
                 m_is_dirty = false;
             }
 
-            auto shape = m_inference->GetInputShape();
+            // Input read back during previous frame is inferred while this one is prepared
+            PushPendingInput();
 
+            auto shape = m_inference->GetInputShape();
 
             unsigned sample_count = 0;
             unsigned channels_count = 0u;
@@ -357,27 +428,11 @@ namespace Baikal
                 }
             }
 
-#ifdef ML_DENOISER_IMAGES_DIR
-            static unsigned input_index = 0;
-            SaveImage("input", tensor.data(), tensor.size(), input_index++);
-#endif
-
             if (too_few_samples)
             {
                 m_start_seq_num = m_last_seq_num + 1;
                 m_has_denoised_image = false;
-            }
-            else
-            {
-                auto tensor = m_inference->GetInputTensor();
-
-                m_context->ReadBuffer<float>(0,
-                                             *m_device_tensor,
-                                             tensor.data(),
-                                             m_device_tensor->GetElementCount()).Wait();
-
-                tensor.tag = ++m_last_seq_num;
-                m_inference->PushInput(std::move(tensor));
+                DropPendingInput();
             }
 
             auto clw_inference_output = dynamic_cast<ClwOutput*>(&output);
@@ -394,24 +449,22 @@ namespace Baikal
 #ifdef ML_DENOISER_IMAGES_DIR
                 //SaveImage("output", inference_res.data(), inference_res.size(), inference_res.tag);
 #endif
-                auto dest = m_host_cache.data();
-                auto source = inference_res.data();
-                for (auto i = 0u; i < shape.width * shape.height; ++i)
-                {
-                    dest->x = *source++;
-                    dest->y = *source++;
-                    dest->z = *source++;
-                    dest->w = 1;
-                    ++dest;
-                }
-
-                m_context->WriteBuffer<float3>(0,
-                                               *m_last_denoised_image,
-                                               m_host_cache.data(),
-                                               inference_res.size() / 3);
+                // Output tensor is rgb, expand it to float3 on the device
+                m_context->WriteBuffer<float>(0,
+                                              *m_device_output_tensor,
+                                              inference_res.data(),
+                                              inference_res.size());
+
+                CopyInterleaved(CLWBuffer<float>::CreateFromClBuffer(*m_last_denoised_image),
+                                0,
+                                4,
+                                *m_device_output_tensor,
+                                0,
+                                3,
+                                3);
                 m_has_denoised_image = true;
 
-
+                // Waiting for the copy also completes the write, so the tensor can be released
                 m_context->CopyBuffer<float3>(0,
                                               *m_last_denoised_image,
                                               clw_inference_output->data(),
@@ -437,6 +490,24 @@ namespace Baikal
                                               0 /* destOffset */,
                                               shape.width * shape.height).Wait();
             }
+
+            if (!too_few_samples)
+            {
+                // Read back without waiting, the tensor is pushed on next Apply.
+                // If all tensors are in flight inference is behind and the frame is skipped.
+                auto tensor = m_inference->GetInputTensor();
+
+                if (!tensor.empty())
+                {
+                    m_pending_event = m_context->ReadBuffer<float>(0,
+                                                                   *m_device_tensor,
+                                                                   tensor.data(),
+                                                                   m_device_tensor->GetElementCount());
+
+                    tensor.tag = ++m_last_seq_num;
+                    m_pending_input = std::move(tensor);
+                }
+            }
         }
 
         void MLDenoiser::SetParameter(std::string const& name, Param value)
@@ -55,6 +55,8 @@ namespace Baikal
 
             MLDenoiser(const CLWContext& context, const CLProgramManager *program_manager);
 
+            ~MLDenoiser() override;
+
             InputTypes GetInputTypes() const override;
 
             void Apply(InputSet const& input_set, Output& output) override;
@@ -66,6 +68,11 @@ namespace Baikal
 
             void InitInference();
 
+            // Hand input read back on previous Apply over to inference
+            void PushPendingInput();
+            // Wait for pending readback and return its tensor to the pool
+            void DropPendingInput();
+
             void DivideBySampleCount(CLWBuffer<RadeonRays::float3> dst,
                                        CLWBuffer<RadeonRays::float3> src);
 
@@ -75,6 +82,14 @@ namespace Baikal
                                int src_channels_num,
                                int channels_to_copy);
 
+            void CopyInterleaved(CLWBuffer<float> dst,
+                                 int dst_channels_offset,
+                                 int dst_channels_num,
+                                 CLWBuffer<float> src,
+                                 int src_channels_offset,
+                                 int src_channels_num,
+                                 int channels_to_copy);
+
             MLDenoiserInputs m_inputs;
             Inference::Ptr m_inference;
             MemoryLayout m_layout;
@@ -84,9 +99,11 @@ namespace Baikal
             std::unique_ptr<CLWBuffer<float>> m_inputs_cache;
             std::unique_ptr<CLWBuffer<RadeonRays::float3>> m_device_cache;
             std::unique_ptr<CLWBuffer<float>> m_device_tensor;
-            // CPU cache
-            std::vector<RadeonRays::float3> m_host_cache;
+            std::unique_ptr<CLWBuffer<float>> m_device_output_tensor;
             std::unique_ptr<CLWBuffer<RadeonRays::float3>> m_last_denoised_image;
+            // Input tensor being read back from the device
+            Tensor m_pending_input;
+            CLWEvent m_pending_event;
             bool m_has_denoised_image = false;
             std::uint32_t m_start_seq_num = 0;
             std::uint32_t m_last_seq_num = 0;
@@ -1,5 +1,7 @@
 #include "PostEffects/ML/inference_impl.h"
 
+#include <algorithm>
+#include <cstring>
 #include <functional>
 #include <numeric>
 #include <cassert>
@@ -8,18 +10,58 @@ namespace Baikal
 {
     namespace PostEffects
     {
+        namespace
+        {
+            // Blending weight along one axis for tile covering [begin, end) of [0, size),
+            // weights ramp from 0 to 1 over 2 * band pixels centered on shared tile edges
+            float EdgeWeight(std::size_t x, std::size_t begin, std::size_t end, std::size_t size, std::size_t band)
+            {
+                if (band == 0)
+                {
+                    return 1.f;
+                }
+
+                auto weight = 1.f;
+                auto pos = static_cast<float>(x) + 0.5f;
+
+                if (begin > 0)
+                {
+                    auto w = (pos - static_cast<float>(begin - band)) / (2 * band);
+                    weight = std::min(weight, std::max(w, 0.f));
+                }
+
+                if (end < size)
+                {
+                    auto w = (static_cast<float>(end + band) - pos) / (2 * band);
+                    weight = std::min(weight, std::max(w, 0.f));
+                }
+
+                return weight;
+            }
+        }
+
         InferenceImpl::InferenceImpl(std::string const& model_path,
                                      float gpu_memory_fraction,
                                      std::string const& visible_devices,
                                      std::size_t width,
                                      std::size_t height,
-                                     std::size_t input_channels)
+                                     std::size_t input_channels,
+                                     std::size_t tile_size,
+                                     std::size_t tile_overlap)
         : m_model(model_path, gpu_memory_fraction, visible_devices)
         , m_width(width)
         , m_height(height)
         , m_input_channels(input_channels)
-        , m_worker(&InferenceImpl::DoInference, this)
+        , m_tile_size(tile_size)
+        , m_tile_overlap(std::min(tile_overlap, tile_size))
         {
+            BuildTiles();
+
+            m_input_pool = CreatePool(kNumInputTensors, m_input_channels);
+            m_output_pool = CreatePool(kNumOutputTensors, m_output_channels);
+
+            // Start worker once everything it uses is initialized
+            m_worker = std::thread(&InferenceImpl::DoInference, this);
         }
 
         InferenceImpl::~InferenceImpl()
@@ -39,7 +81,7 @@ namespace Baikal
 
         Tensor InferenceImpl::GetInputTensor()
         {
-            return AllocTensor(m_input_channels);
+            return AcquireTensor(m_input_pool, m_input_channels);
         }
 
         void InferenceImpl::PushInput(Tensor&& tensor)
@@ -50,20 +92,145 @@ namespace Baikal
 
         Tensor InferenceImpl::PopOutput()
         {
+            // Only the latest output is of interest, older ones go back to the pool
             Tensor output_tensor;
-            m_output_queue.try_pop(output_tensor);
+            Tensor newer_tensor;
+            while (m_output_queue.try_pop(newer_tensor))
+            {
+                output_tensor = std::move(newer_tensor);
+            }
             return output_tensor;
         }
 
-        Tensor InferenceImpl::AllocTensor(std::size_t channels)
+        std::shared_ptr<InferenceImpl::TensorPool> InferenceImpl::CreatePool(std::size_t num_tensors,
+                                                                             std::size_t channels) const
         {
-            auto deleter = [](Tensor::ValueType* data)
+            auto pool = std::make_shared<TensorPool>();
+            auto size = m_width * m_height * channels;
+
+            for (std::size_t i = 0; i < num_tensors; ++i)
+            {
+                pool->storage.emplace_back(new Tensor::ValueType[size]);
+                pool->free.push_back(pool->storage.back().get());
+            }
+
+            return pool;
+        }
+
+        Tensor InferenceImpl::AcquireTensor(std::shared_ptr<TensorPool> const& pool, std::size_t channels) const
+        {
+            Tensor::ValueType* data = nullptr;
+            {
+                std::lock_guard<std::mutex> lock(pool->mutex);
+                if (pool->free.empty())
+                {
+                    return Tensor();
+                }
+                data = pool->free.back();
+                pool->free.pop_back();
+            }
+
+            // Deleter keeps the pool alive for tensors outliving the inference
+            auto deleter = [pool](Tensor::ValueType* data)
             {
-                delete[] data;
+                std::lock_guard<std::mutex> lock(pool->mutex);
+                pool->free.push_back(data);
             };
-            size_t size = m_width * m_height * channels;
-            return Tensor(Tensor::Data(new Tensor::ValueType[size], deleter),
-                          { m_width, m_height, channels });
+
+            return Tensor(Tensor::Data(data, deleter), { m_width, m_height, channels });
+        }
+
+        Tensor InferenceImpl::AcquireOutputTensor()
+        {
+            auto output_tensor = AcquireTensor(m_output_pool, m_output_channels);
+            if (output_tensor.empty())
+            {
+                // Nobody picked previous output up, recycle it
+                Tensor stale_tensor;
+                if (m_output_queue.try_pop(stale_tensor))
+                {
+                    stale_tensor = Tensor();
+                    output_tensor = AcquireTensor(m_output_pool, m_output_channels);
+                }
+            }
+            return output_tensor;
+        }
+
+        void InferenceImpl::BuildTiles()
+        {
+            auto tile_size = m_tile_size;
+            if (tile_size == 0 || (tile_size >= m_width && tile_size >= m_height))
+            {
+                m_tiles.push_back({ 0, 0, m_width, m_height, 0, 0, m_width, m_height });
+                return;
+            }
+
+            auto overlap = m_tile_overlap;
+
+            for (std::size_t y = 0; y < m_height; y += tile_size)
+            {
+                for (std::size_t x = 0; x < m_width; x += tile_size)
+                {
+                    Tile tile;
+                    tile.x0 = x;
+                    tile.y0 = y;
+                    tile.x1 = std::min(x + tile_size, m_width);
+                    tile.y1 = std::min(y + tile_size, m_height);
+                    tile.ex0 = tile.x0 > overlap ? tile.x0 - overlap : 0;
+                    tile.ey0 = tile.y0 > overlap ? tile.y0 - overlap : 0;
+                    tile.ex1 = std::min(tile.x1 + overlap, m_width);
+                    tile.ey1 = std::min(tile.y1 + overlap, m_height);
+                    m_tiles.push_back(tile);
+                }
+            }
+
+            auto max_tile_size = std::min(tile_size + 2 * overlap, std::max(m_width, m_height));
+            m_tile_input.resize(max_tile_size * max_tile_size * m_input_channels);
+            m_tile_output.resize(max_tile_size * max_tile_size * m_output_channels);
+        }
+
+        void InferenceImpl::InferTile(Tile const& tile, Tensor const& input, Tensor const& output)
+        {
+            auto tile_width = tile.ex1 - tile.ex0;
+            auto tile_height = tile.ey1 - tile.ey0;
+
+            // Gather tile with its context
+            for (auto y = tile.ey0; y < tile.ey1; ++y)
+            {
+                std::memcpy(&m_tile_input[(y - tile.ey0) * tile_width * m_input_channels],
+                            input.data() + (y * m_width + tile.ex0) * m_input_channels,
+                            tile_width * m_input_channels * sizeof(Tensor::ValueType));
+            }
+
+            m_model->infer(
+                m_tile_input.data(),
+                tile_width,
+                tile_height,
+                m_input_channels,
+                m_tile_output.data());
+
+            // Blend into the output, context pixels beyond the band are dropped
+            auto band = m_tile_overlap / 2;
+            auto bx0 = tile.x0 > band ? tile.x0 - band : 0;
+            auto by0 = tile.y0 > band ? tile.y0 - band : 0;
+            auto bx1 = std::min(tile.x1 + band, m_width);
+            auto by1 = std::min(tile.y1 + band, m_height);
+
+            for (auto y = by0; y < by1; ++y)
+            {
+                auto wy = EdgeWeight(y, tile.y0, tile.y1, m_height, band);
+                auto dst = output.data() + (y * m_width + bx0) * m_output_channels;
+                auto src = &m_tile_output[((y - tile.ey0) * tile_width + bx0 - tile.ex0) * m_output_channels];
+
+                for (auto x = bx0; x < bx1; ++x)
+                {
+                    auto w = wy * EdgeWeight(x, tile.x0, tile.x1, m_width, band);
+                    for (std::size_t c = 0; c < m_output_channels; ++c)
+                    {
+                        *dst++ += w * *src++;
+                    }
+                }
+            }
         }
 
         void InferenceImpl::DoInference()
@@ -82,13 +249,29 @@ namespace Baikal
                     continue;
                 }
 
-                Tensor output_tensor = AllocTensor(m_output_channels);
-                m_model->infer(
-                    input_tensor.data(),
-                    m_width,
-                    m_height,
-                    m_input_channels,
-                    output_tensor.data());
+                Tensor output_tensor = AcquireOutputTensor();
+                if (output_tensor.empty())
+                {
+                    continue;
+                }
+
+                if (m_tiles.size() == 1)
+                {
+                    m_model->infer(
+                        input_tensor.data(),
+                        m_width,
+                        m_height,
+                        m_input_channels,
+                        output_tensor.data());
+                }
+                else
+                {
+                    std::fill(output_tensor.data(), output_tensor.data() + output_tensor.size(), 0.f);
+                    for (auto const& tile : m_tiles)
+                    {
+                        InferTile(tile, input_tensor, output_tensor);
+                    }
+                }
 
                 output_tensor.tag = input_tensor.tag;
                 m_output_queue.push(std::move(output_tensor));
@@ -3,22 +3,43 @@
 #include "../RadeonRays/RadeonRays/src/async/thread_pool.h"
 
 #include <cstddef>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <thread>
+#include <vector>
 
 namespace Baikal
 {
     namespace PostEffects
     {
+        /**
+        \brief Asynchronous model inference
+
+        Frames are inferred on a worker thread in tiles of tile_size x tile_size
+        pixels. Each tile is extended by tile_overlap pixels of context on every side,
+        half of the overlap is blended with the neighbour tiles using linear weights
+        and the other half is only seen by the model. Tile size 0 infers whole frames.
+
+        Input and output tensors come from fixed pools and return there once
+        released, GetInputTensor returns an empty tensor if all inputs are in flight.
+        */
         class InferenceImpl : public Inference
         {
         public:
+            // Number of input tensors: one being filled, one queued and one inferred
+            static std::size_t constexpr kNumInputTensors = 3;
+            // Number of output tensors: one being written and one ready
+            static std::size_t constexpr kNumOutputTensors = 2;
+
             InferenceImpl(std::string const& model_path,
                           float gpu_memory_fraction,
                           std::string const& visible_devices,
                           std::size_t width,
                           std::size_t height,
-                          std::size_t input_channels);
+                          std::size_t input_channels,
+                          std::size_t tile_size = 0,
+                          std::size_t tile_overlap = 0);
             ~InferenceImpl() override;
 
             Tensor::Shape GetInputShape() const override;
@@ -28,8 +49,29 @@ namespace Baikal
             Tensor PopOutput() override;
 
         private:
+            // Fixed set of buffers of the same size shared by tensors
+            struct TensorPool
+            {
+                std::mutex mutex;
+                std::vector<std::unique_ptr<Tensor::ValueType[]>> storage;
+                std::vector<Tensor::ValueType*> free;
+            };
+
+            // Region of the frame inferred at once
+            struct Tile
+            {
+                // Blended region
+                std::size_t x0, y0, x1, y1;
+                // Region passed to the model
+                std::size_t ex0, ey0, ex1, ey1;
+            };
+
             void Shutdown();
-            Tensor AllocTensor(std::size_t channels);
+            std::shared_ptr<TensorPool> CreatePool(std::size_t num_tensors, std::size_t channels) const;
+            Tensor AcquireTensor(std::shared_ptr<TensorPool> const& pool, std::size_t channels) const;
+            Tensor AcquireOutputTensor();
+            void BuildTiles();
+            void InferTile(Tile const& tile, Tensor const& input, Tensor const& output);
             void DoInference();
 
             RadeonRays::thread_safe_queue<Tensor> m_input_queue;
@@ -44,6 +86,17 @@ namespace Baikal
 
             const std::size_t m_output_channels = 3;
 
+            std::size_t m_tile_size;
+            std::size_t m_tile_overlap;
+            std::vector<Tile> m_tiles;
+
+            std::shared_ptr<TensorPool> m_input_pool;
+            std::shared_ptr<TensorPool> m_output_pool;
+
+            // Tile sized buffers, used by worker thread only
+            std::vector<Tensor::ValueType> m_tile_input;
+            std::vector<Tensor::ValueType> m_tile_output;
+
             std::thread m_worker;
         };
     }
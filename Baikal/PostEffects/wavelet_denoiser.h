@@ -379,7 +379,7 @@ namespace Baikal
                 size_t gs[] = { static_cast<size_t>((output.width() + 7) / 8 * 8), static_cast<size_t>((output.height() + 7) / 8 * 8) };
                 size_t ls[] = { 8, 8 };
 
-                GetContext().Launch2D(0, gs, ls, copy_buffers_kernel);
+                Launch2D(gs, ls, copy_buffers_kernel);
             }
         }
 
@@ -402,7 +402,7 @@ namespace Baikal
                 size_t gs[] = { static_cast<size_t>((output.width() + 7) / 8 * 8), static_cast<size_t>((output.height() + 7) / 8 * 8) };
                 size_t ls[] = { 8, 8 };
 
-                GetContext().Launch2D(0, gs, ls, generate_motion_kernel);
+                Launch2D(gs, ls, generate_motion_kernel);
             }
         }
 
@@ -432,7 +432,7 @@ namespace Baikal
                 size_t gs[] = { static_cast<size_t>((output.width() + 7) / 8 * 8), static_cast<size_t>((output.height() + 7) / 8 * 8) };
                 size_t ls[] = { 8, 8 };
 
-                GetContext().Launch2D(0, gs, ls, accumulation_kernel);
+                Launch2D(gs, ls, accumulation_kernel);
             }
         }
 
@@ -452,7 +452,7 @@ namespace Baikal
                 size_t gs[] = { static_cast<size_t>((output.width() + 7) / 8 * 8), static_cast<size_t>((output.height() + 7) / 8 * 8) };
                 size_t ls[] = { 8, 8 };
 
-                GetContext().Launch2D(0, gs, ls, copy_buffer_kernel);
+                Launch2D(gs, ls, copy_buffer_kernel);
             }
         }
 
@@ -504,7 +504,7 @@ namespace Baikal
                     size_t gs[] = { static_cast<size_t>((output.width() + 7) / 8 * 8), static_cast<size_t>((output.height() + 7) / 8 * 8) };
                     size_t ls[] = { 8, 8 };
 
-                    GetContext().Launch2D(0, gs, ls, filter_kernel);
+                    Launch2D(gs, ls, filter_kernel);
                 }
 
                 argc = 0;
@@ -521,7 +521,7 @@ namespace Baikal
                     size_t gs[] = { static_cast<size_t>((output.width() + 7) / 8 * 8), static_cast<size_t>((output.height() + 7) / 8 * 8) };
                     size_t ls[] = { 8, 8 };
 
-                    GetContext().Launch2D(0, gs, ls, update_variance_kernel);
+                    Launch2D(gs, ls, update_variance_kernel);
                 }
             }
 
@@ -539,7 +539,7 @@ namespace Baikal
                 size_t gs[] = { static_cast<size_t>((output.width() + 7) / 8 * 8), static_cast<size_t>((output.height() + 7) / 8 * 8) };
                 size_t ls[] = { 8, 8 };
 
-                GetContext().Launch2D(0, gs, ls, edge_detection_kernel);
+                Launch2D(gs, ls, edge_detection_kernel);
             }
 
             argc = 0;
@@ -556,7 +556,7 @@ namespace Baikal
                 size_t gs[] = { static_cast<size_t>((output.width() + 7) / 8 * 8), static_cast<size_t>((output.height() + 7) / 8 * 8) };
                 size_t ls[] = { 8, 8 };
 
-                GetContext().Launch2D(0, gs, ls, blending_weight_calclulation_kernel);
+                Launch2D(gs, ls, blending_weight_calclulation_kernel);
             }
 
             argc = 0;
@@ -573,7 +573,7 @@ namespace Baikal
                 size_t gs[] = { static_cast<size_t>((output.width() + 7) / 8 * 8), static_cast<size_t>((output.height() + 7) / 8 * 8) };
                 size_t ls[] = { 8, 8 };
 
-                GetContext().Launch2D(0, gs, ls, neighborhood_blending_kernel);
+                Launch2D(gs, ls, neighborhood_blending_kernel);
             }
         }
     }
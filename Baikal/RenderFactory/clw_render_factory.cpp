@@ -15,10 +15,12 @@
 
 namespace Baikal
 {
-    ClwRenderFactory::ClwRenderFactory(CLWContext context, std::string const& cache_path)
+    ClwRenderFactory::ClwRenderFactory(CLWContext context, std::string const& cache_path,
+                                       MaterialCompilationMode material_compilation_mode)
     : m_context(context)
     , m_cache_path(cache_path)
     , m_program_manager(cache_path)
+    , m_material_compilation_mode(material_compilation_mode)
     , m_intersector(
         CreateFromOpenClContext(
             context, 
@@ -43,16 +45,30 @@ namespace Baikal
                         &m_program_manager,
                         std::make_unique<PathTracingEstimator>(m_context, m_intersector, &m_program_manager)
                         ));
+            case RendererType::kAdaptivePathTracer:
+                return std::unique_ptr<Renderer>(
+                    new AdaptiveRenderer(
+                        m_context,
+                        &m_program_manager,
+                        std::make_unique<PathTracingEstimator>(m_context, m_intersector, &m_program_manager)
+                        ));
             default:
                 throw std::runtime_error("Renderer not supported");
         }
     }
 
     std::unique_ptr<Output> ClwRenderFactory::CreateOutput(std::uint32_t w,
-                                                           std::uint32_t h)
+                                                           std::uint32_t h,
+                                                           Output::Format format)
                                                            const
     {
-        return std::unique_ptr<Output>(new ClwOutput(m_context, w, h));
+        return std::unique_ptr<Output>(new ClwOutput(m_context, w, h, format));
+    }
+
+    std::unique_ptr<ClwOutputReadback> ClwRenderFactory::CreateOutputReadback(std::uint32_t num_buffers) const
+    {
+        return std::unique_ptr<ClwOutputReadback>(
+            new ClwOutputReadback(m_context, &m_program_manager, num_buffers));
     }
 
     std::unique_ptr<PostEffect> ClwRenderFactory::CreatePostEffect(PostEffectType type) const
@@ -72,6 +88,6 @@ namespace Baikal
 
     std::unique_ptr<SceneController<ClwScene>> ClwRenderFactory::CreateSceneController() const
     {
-        return std::make_unique<ClwSceneController>(m_context, m_intersector.get(), &m_program_manager);
+        return std::make_unique<ClwSceneController>(m_context, m_intersector.get(), &m_program_manager, m_material_compilation_mode);
     }
 }
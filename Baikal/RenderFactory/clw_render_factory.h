@@ -23,8 +23,10 @@
 #pragma once
 
 #include "RenderFactory/render_factory.h"
+#include "Controllers/clw_scene_controller.h"
 #include "Utils/cl_program_manager.h"
 #include "SceneGraph/clwscene.h"
+#include "Output/clw_output_readback.h"
 
 #include "radeon_rays_cl.h"
 #include "CLW.h"
@@ -45,14 +47,21 @@ namespace Baikal
     class ClwRenderFactory : public RenderFactory<ClwScene>
     {
     public:
-        ClwRenderFactory(CLWContext context, std::string const& cache_path="");
+        // material_compilation_mode selects how scene controllers created by
+        // this factory compile UberV2 materials and input maps.
+        ClwRenderFactory(CLWContext context, std::string const& cache_path="",
+                         MaterialCompilationMode material_compilation_mode = MaterialCompilationMode::kCodegen);
 
         // Create a renderer of specified type
         std::unique_ptr<Renderer> 
             CreateRenderer(RendererType type) const override;
         // Create an output of specified type
         std::unique_ptr<Output> 
-            CreateOutput(std::uint32_t w, std::uint32_t h) const override;
+            CreateOutput(std::uint32_t w, std::uint32_t h,
+                         Output::Format format = Output::Format::kRGBA32F) const override;
+        // Create asynchronous readback for outputs created by this factory
+        std::unique_ptr<ClwOutputReadback>
+            CreateOutputReadback(std::uint32_t num_buffers = 3) const;
         // Create post effect of specified type
         std::unique_ptr<PostEffect>  CreatePostEffect(PostEffectType type) const override;
 
@@ -63,6 +72,7 @@ namespace Baikal
         CLWContext m_context;
         std::string m_cache_path;
         CLProgramManager m_program_manager;
+        MaterialCompilationMode m_material_compilation_mode;
 
         using RadeonRaysInstanceDelete = decltype(RadeonRays::IntersectionApi::Delete);
 
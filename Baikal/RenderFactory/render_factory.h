@@ -21,6 +21,8 @@
  ********************************************************************/
 #pragma once
 
+#include "Output/output.h"
+
 #include <memory>
 
 
@@ -53,7 +55,8 @@ namespace Baikal
     public:
         enum class RendererType
         {
-            kUnidirectionalPathTracer
+            kUnidirectionalPathTracer,
+            kAdaptivePathTracer
         };
 
         RenderFactory() = default;
@@ -62,8 +65,10 @@ namespace Baikal
         virtual 
         std::unique_ptr<Renderer> CreateRenderer(RendererType type) const = 0;
 
+        // Packed formats save memory and readback time of AOVs, see Output::Format
         virtual 
-        std::unique_ptr<Output> CreateOutput(std::uint32_t w, std::uint32_t h) const = 0;
+        std::unique_ptr<Output> CreateOutput(std::uint32_t w, std::uint32_t h,
+                                             Output::Format format = Output::Format::kRGBA32F) const = 0;
 
         virtual 
         std::unique_ptr<PostEffect> CreatePostEffect(PostEffectType type) const = 0;
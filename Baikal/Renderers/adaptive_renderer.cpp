@@ -1,6 +1,9 @@
 #include "adaptive_renderer.h"
 #include "Output/clwoutput.h"
 
+#include <algorithm>
+#include <vector>
+
 namespace Baikal
 {
     
@@ -9,17 +12,46 @@ namespace Baikal
         const CLProgramManager *program_manager,
         std::unique_ptr<Estimator> estimator
     ) : MonteCarloRenderer(context, program_manager, std::move(estimator))
+        , m_convergence_threshold(0.f)
+        , m_min_samples(16u)
+        , m_pp(context)
     {
         auto samples_buffer_size = GetEstimator().GetWorkBufferSize();
         m_sample_buffer = GetContext().CreateBuffer<float3>(samples_buffer_size, CL_MEM_READ_WRITE);
     }
 
+    void AdaptiveRenderer::SetConvergenceThreshold(float threshold)
+    {
+        m_convergence_threshold = threshold;
+
+        // Compaction buffers are only needed in convergence mode
+        if (threshold > 0.f && m_tile_indices.GetElementCount() == 0)
+        {
+            auto work_buffer_size = GetEstimator().GetWorkBufferSize();
+            m_tile_indices = GetContext().CreateBuffer<int>(work_buffer_size, CL_MEM_READ_WRITE);
+            m_active_predicates = GetContext().CreateBuffer<int>(work_buffer_size, CL_MEM_READ_WRITE);
+            m_tile_active_count = GetContext().CreateBuffer<int>(1, CL_MEM_READ_WRITE);
+            m_active_count = GetContext().CreateBuffer<int>(1, CL_MEM_READ_WRITE);
+        }
+    }
+
+    void AdaptiveRenderer::SetMinSamples(std::uint32_t min_samples)
+    {
+        // Variance estimate needs at least two samples
+        m_min_samples = std::max(min_samples, 2u);
+    }
+
     void AdaptiveRenderer::Clear(RadeonRays::float3 const& val,
         Output& output) const
     {
         MonteCarloRenderer::Clear(val, output);
 
         GetContext().FillBuffer(0u, m_variance_buffer, 0.f, m_variance_buffer.GetElementCount()).Wait();
+
+        if (m_moments_buffer.GetElementCount() > 0)
+        {
+            GetContext().FillBuffer(0u, m_moments_buffer, float3(), m_moments_buffer.GetElementCount()).Wait();
+        }
     }
 
     // Render single tile
@@ -27,6 +59,15 @@ namespace Baikal
         RadeonRays::int2 const& tile_origin,
         RadeonRays::int2 const& tile_size)
     {
+        // Tile variance and sample moments rely on a single sample per pixel and estimate
+        m_estimator->SetPathRegeneration(false);
+
+        if (m_convergence_threshold > 0.f)
+        {
+            RenderTileConvergence(scene, tile_origin, tile_size);
+            return;
+        }
+
         // Number of rays to generate
         auto output = static_cast<ClwOutput*>(GetOutput(OutputType::kColor));
         auto width = output->width();
@@ -86,6 +127,156 @@ namespace Baikal
         }
     }
 
+    void AdaptiveRenderer::RenderTileConvergence(ClwScene const& scene,
+        RadeonRays::int2 const& tile_origin,
+        RadeonRays::int2 const& tile_size)
+    {
+        auto output = static_cast<ClwOutput*>(GetOutput(OutputType::kColor));
+
+        if (!output)
+        {
+            throw std::runtime_error("Convergence based sampling requires color output");
+        }
+
+        auto num_pixels = static_cast<std::uint32_t>(output->width() * output->height());
+
+        if (m_moments_buffer.GetElementCount() != num_pixels)
+        {
+            m_moments_buffer = GetContext().CreateBuffer<float3>(num_pixels, CL_MEM_READ_WRITE);
+            GetContext().FillBuffer(0u, m_moments_buffer, float3(), num_pixels);
+        }
+
+        // Active pixel count is summed over all tiles of the iteration
+        if (tile_origin.x == 0 && tile_origin.y == 0)
+        {
+            GetContext().FillBuffer(0u, m_active_count, 0, 1);
+        }
+
+        GetContext().FillBuffer(0u, m_sample_buffer, float3(), m_sample_buffer.GetElementCount());
+
+        auto num_rays = static_cast<std::uint32_t>(tile_size.x * tile_size.y);
+
+        // Mark pixels above threshold
+        {
+            auto mark_kernel = GetKernel("MarkActivePixels");
+
+            int argc = 0;
+            mark_kernel.SetArg(argc++, output->width());
+            mark_kernel.SetArg(argc++, tile_origin.x);
+            mark_kernel.SetArg(argc++, tile_origin.y);
+            mark_kernel.SetArg(argc++, tile_size.x);
+            mark_kernel.SetArg(argc++, tile_size.y);
+            mark_kernel.SetArg(argc++, m_moments_buffer);
+            mark_kernel.SetArg(argc++, m_convergence_threshold);
+            mark_kernel.SetArg(argc++, m_min_samples);
+            mark_kernel.SetArg(argc++, m_tile_indices);
+            mark_kernel.SetArg(argc++, m_active_predicates);
+            mark_kernel.SetArg(argc++, m_active_count);
+
+            Launch1D(((num_rays + 63) / 64) * 64, 64, mark_kernel);
+        }
+
+        // Compact active pixels into output indices, ray count stays on device
+        m_pp.Compact(
+            0,
+            m_active_predicates,
+            m_tile_indices,
+            m_estimator->GetOutputIndexBuffer(),
+            num_rays,
+            m_tile_active_count
+        );
+
+        GetContext().CopyBuffer(0u, m_tile_active_count, m_estimator->GetRayCountBuffer(), 0, 0, 1);
+
+        GeneratePrimaryRays(scene, *output, tile_size);
+
+        m_estimator->Estimate(
+            scene,
+            num_rays,
+            Estimator::QualityLevel::kStandard,
+            m_sample_buffer,
+            false,
+            true
+        );
+
+        AccumulateSampleMoments(output->data(), num_rays);
+
+        bool aov_pass_needed = (FindFirstNonZeroOutput(false) != nullptr);
+        if (aov_pass_needed)
+        {
+            FillAOVs(scene, tile_origin, tile_size);
+            GetContext().Flush(0);
+        }
+    }
+
+    void AdaptiveRenderer::AccumulateSampleMoments(
+        CLWBuffer<float3> accumulation_buffer,
+        std::uint32_t num_elements
+    )
+    {
+        auto accumulate_kernel = GetKernel("AccumulateSampleMoments");
+        auto error_output = static_cast<ClwOutput*>(GetOutput(OutputType::kConvergenceError));
+
+        int argc = 0;
+        accumulate_kernel.SetArg(argc++, m_sample_buffer);
+        accumulate_kernel.SetArg(argc++, accumulation_buffer);
+        accumulate_kernel.SetArg(argc++, m_moments_buffer);
+        accumulate_kernel.SetArg(argc++, m_estimator->GetOutputIndexBuffer());
+        // Estimator overwrites its ray count while tracing
+        accumulate_kernel.SetArg(argc++, m_tile_active_count);
+        accumulate_kernel.SetArg(argc++, error_output ? 1 : 0);
+        // Moments are passed as a dummy buffer if there is no error output
+        accumulate_kernel.SetArg(argc++, error_output ? error_output->data() : m_moments_buffer);
+
+        {
+            Launch1D(((num_elements + 63) / 64) * 64, 64, accumulate_kernel);
+        }
+    }
+
+    bool AdaptiveRenderer::IsConverged() const
+    {
+        if (m_convergence_threshold <= 0.f || m_sample_counter <= m_min_samples)
+        {
+            return false;
+        }
+
+        // Count of pixels marked active by the last iteration
+        int num_active = 0;
+        GetContext().ReadBuffer(0u, m_active_count, &num_active, 1).Wait();
+        return num_active == 0;
+    }
+
+    AdaptiveRenderer::ConvergenceStats AdaptiveRenderer::GetConvergenceStats() const
+    {
+        ConvergenceStats stats = { 0u, 0u, 0u, 0u };
+
+        auto num_pixels = m_moments_buffer.GetElementCount();
+
+        if (num_pixels == 0)
+        {
+            return stats;
+        }
+
+        std::vector<float3> moments(num_pixels);
+        GetContext().ReadBuffer(0u, m_moments_buffer, &moments[0], num_pixels).Wait();
+
+        stats.num_pixels = num_pixels;
+        stats.num_uniform_samples = static_cast<std::uint64_t>(num_pixels) * m_sample_counter;
+
+        for (auto const& m : moments)
+        {
+            auto num_samples = static_cast<std::uint64_t>(m.w);
+            stats.num_samples += num_samples;
+
+            if (num_samples >= m_min_samples && m.z <= m_convergence_threshold)
+            {
+                ++stats.num_converged;
+            }
+        }
+
+        return stats;
+    }
+
     void AdaptiveRenderer::AccumulateSamples(
         CLWBuffer<float3> sample_buffer,
         CLWBuffer<float3> accumulation_buffer,
@@ -101,7 +292,7 @@ namespace Baikal
         accumulate_kernel.SetArg(argc++, num_elements);
 
         {
-            GetContext().Launch1D(0, ((num_elements + 63) / 64) * 64, 64, accumulate_kernel);
+            Launch1D(((num_elements + 63) / 64) * 64, 64, accumulate_kernel);
         }
     }
 
@@ -124,7 +315,7 @@ namespace Baikal
             size_t gs[] = { static_cast<size_t>((width + 15) / 16 * 16), static_cast<size_t>((width + 15) / 16 * 16) };
             size_t ls[] = { 16, 16 };
 
-            GetContext().Launch2D(0, gs, ls, estimate_kernel);
+            Launch2D(gs, ls, estimate_kernel);
         }
     }
 
@@ -213,7 +404,7 @@ namespace Baikal
             size_t gs[] = { static_cast<size_t>((tile_size.x + 15) / 16 * 16), static_cast<size_t>((tile_size.y + 15) / 16 * 16) };
             size_t ls[] = { 16, 16 };
 
-            GetContext().Launch2D(0, gs, ls, generate_kernel);
+            Launch2D(gs, ls, generate_kernel);
         }
     }
     
@@ -26,6 +26,7 @@ THE SOFTWARE.
 #include "CLW.h"
 #include "Utils/distribution1d.h"
 
+#include <cstdint>
 #include <memory>
 
 
@@ -35,10 +36,30 @@ namespace Baikal
     class ClwOutput;
     struct ClwScene;
     
-    ///< Renderer implementation
+    /**
+    \brief Renderer distributing samples where the image is noisy.
+
+    By default tiles are sampled proportionally to estimated variance. If convergence threshold
+    is set, every pixel keeps running mean and variance of its luminance and stops taking samples
+    once relative standard error of the mean drops below the threshold. Pixels which are still
+    active are compacted on device each iteration, so converged pixels cost no rays.
+    */
     class AdaptiveRenderer : public MonteCarloRenderer
     {
     public:
+        // Statistics of convergence based sampling
+        struct ConvergenceStats
+        {
+            // Number of pixels in color output
+            std::uint64_t num_pixels;
+            // Number of pixels below convergence threshold
+            std::uint64_t num_converged;
+            // Samples (camera rays) taken since last clear
+            std::uint64_t num_samples;
+            // Samples uniform sampling would take for the same number of iterations
+            std::uint64_t num_uniform_samples;
+        };
+
         AdaptiveRenderer(
             CLWContext context, 
             const CLProgramManager *program_manager,
@@ -59,9 +80,30 @@ namespace Baikal
         // Set output
         void SetOutput(OutputType type, Output* output) override;
 
+        // Set relative error threshold for per pixel convergence, 0 disables convergence based sampling
+        void SetConvergenceThreshold(float threshold);
+
+        // Set number of samples each pixel takes before it can converge
+        void SetMinSamples(std::uint32_t min_samples);
+
+        // Read convergence statistics back from device
+        ConvergenceStats GetConvergenceStats() const;
+
         // DEBUG STUFF
         CLWBuffer<float> GetVarianceBuffer() const { return m_variance_buffer; }
     protected:
+        bool IsConverged() const override;
+
+        // Render single tile sampling only pixels above convergence threshold
+        void RenderTileConvergence(ClwScene const& scene,
+            RadeonRays::int2 const& tile_origin,
+            RadeonRays::int2 const& tile_size);
+
+        void AccumulateSampleMoments(
+            CLWBuffer<float3> accumulation_buffer,
+            std::uint32_t num_elements
+        );
+
         void AccumulateSamples(
             CLWBuffer<float3> sample_buffer,
             CLWBuffer<float3> accumulation_buffer,
@@ -87,6 +129,18 @@ namespace Baikal
         mutable CLWBuffer<float3> m_sample_buffer;
         CLWBuffer<int> m_tile_distribution_buffer;
         Distribution1D m_tile_distribution;
+
+        // Convergence based sampling
+        float m_convergence_threshold;
+        std::uint32_t m_min_samples;
+        // Per pixel luminance mean, sum of squared deviations, relative error and number of samples
+        mutable CLWBuffer<float3> m_moments_buffer;
+        CLWBuffer<int> m_tile_indices;
+        CLWBuffer<int> m_active_predicates;
+        // Number of active pixels in current tile and in current iteration
+        CLWBuffer<int> m_tile_active_count;
+        CLWBuffer<int> m_active_count;
+        CLWParallelPrimitives m_pp;
     };
     
 }
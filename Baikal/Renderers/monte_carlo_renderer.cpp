@@ -20,6 +20,7 @@
  THE SOFTWARE.
  ********************************************************************/
 #include "monte_carlo_renderer.h"
+#include "Controllers/clw_virtual_texture_cache.h"
 #include "Output/clwoutput.h"
 #include "Estimators/estimator.h"
 
@@ -46,6 +47,11 @@ namespace Baikal
     int constexpr kTileSizeX = 1920;
     int constexpr kTileSizeY = 1080;
 
+    // Progressive rendering: target time between progress reports in seconds
+    // and max number of iterations enqueued without waiting for device
+    double constexpr kProgressInterval = 0.25;
+    std::uint32_t constexpr kMaxBatchSize = 256u;
+
     // Constructor
     MonteCarloRenderer::MonteCarloRenderer(
         CLWContext context,
@@ -76,6 +82,104 @@ namespace Baikal
 
     void MonteCarloRenderer::Render(ClwScene const& scene)
     {
+        UpdateVirtualTextures(scene);
+        RenderIteration(scene);
+    }
+
+    void MonteCarloRenderer::UpdateVirtualTextures(ClwScene const& scene)
+    {
+        if (!scene.virtual_textures)
+        {
+            return;
+        }
+
+        auto num_bytes_uploaded = scene.virtual_textures->GetNumBytesUploaded();
+        scene.virtual_textures->Update(scene.texturedata);
+        GetProfiler().RecordUpload(scene.virtual_textures->GetNumBytesUploaded() - num_bytes_uploaded);
+    }
+
+    Renderer::Progress MonteCarloRenderer::RenderProgressive(ClwScene const& scene,
+        std::uint32_t max_iterations, std::chrono::duration<double> time_budget, ProgressCallback const& callback)
+    {
+        using clock = std::chrono::high_resolution_clock;
+        auto const zero = std::chrono::duration<double>::zero();
+        bool const has_time_budget = time_budget > zero;
+
+        if (max_iterations == 0 && !has_time_budget && !callback)
+        {
+            throw std::runtime_error("Progressive rendering requires iteration or time budget");
+        }
+
+        auto start = clock::now();
+
+        Progress progress = { 0u, m_sample_counter, zero, false };
+        std::uint32_t batch_size = 1u;
+
+        for (;;)
+        {
+            if (max_iterations > 0)
+            {
+                batch_size = std::min(batch_size, max_iterations - progress.num_iterations);
+            }
+
+            // Virtual texture feedback is read back to host, so tiles are streamed once per batch
+            UpdateVirtualTextures(scene);
+
+            for (auto i = 0u; i < batch_size; ++i)
+            {
+                RenderIteration(scene);
+            }
+
+            GetContext().Finish(0);
+
+            progress.num_iterations += batch_size;
+            progress.num_accumulated = m_sample_counter;
+            progress.elapsed = clock::now() - start;
+            progress.converged = IsConverged();
+
+            if (callback && !callback(progress))
+            {
+                break;
+            }
+
+            if (progress.converged)
+            {
+                break;
+            }
+
+            if (max_iterations > 0 && progress.num_iterations >= max_iterations)
+            {
+                break;
+            }
+
+            // Size the next batch to report progress about every kProgressInterval
+            // and stop before the iteration which would exceed time budget
+            auto iteration_time = progress.elapsed.count() / progress.num_iterations;
+            auto batch_time = kProgressInterval;
+
+            if (has_time_budget)
+            {
+                auto remaining_time = (time_budget - progress.elapsed).count();
+
+                if (remaining_time < iteration_time)
+                {
+                    break;
+                }
+
+                batch_time = std::min(batch_time, remaining_time);
+            }
+
+            auto iterations = iteration_time > 0.0 ? batch_time / iteration_time : static_cast<double>(kMaxBatchSize);
+            batch_size = static_cast<std::uint32_t>(std::max(1.0, std::min(iterations, static_cast<double>(kMaxBatchSize))));
+        }
+
+        return progress;
+    }
+
+    void MonteCarloRenderer::RenderIteration(ClwScene const& scene)
+    {
+        GetProfiler().BeginFrame();
+
         auto output = FindFirstNonZeroOutput(true, true);
         if (!output)
         {
@@ -192,7 +296,38 @@ namespace Baikal
             size_t gs[] = { static_cast<size_t>((tile_size.x + 15) / 16 * 16), static_cast<size_t>((tile_size.y + 15) / 16 * 16) };
             size_t ls[] = { 16, 16 };
 
-            GetContext().Launch2D(0, gs, ls, generate_kernel);
+            Launch2D(gs, ls, generate_kernel);
+        }
+    }
+
+    bool MonteCarloRenderer::IsConverged() const
+    {
+        return false;
+    }
+
+    bool MonteCarloRenderer::IsFormatSupported(OutputType type, Output::Format format)
+    {
+        using Format = Output::Format;
+
+        // Estimator accumulates sums with sample count
+        if (format == Format::kRGBA32F)
+        {
+            return true;
+        }
+        else if (type < OutputType::kMaxMultiPassOutput)
+        {
+            return false;
+        }
+
+        switch (type)
+        {
+        case OutputType::kShapeId:
+            return format == Format::kR32F || format == Format::kR32UI;
+        case OutputType::kMeshID:
+        case OutputType::kGroupID:
+            return format == Format::kRGBA16F || format == Format::kR32UI;
+        default:
+            return format != Format::kR32UI;
         }
     }
 
@@ -221,6 +356,11 @@ namespace Baikal
 
     void MonteCarloRenderer::SetOutput(OutputType type, Output* output)
     {
+        if (output && !IsFormatSupported(type, output->format()))
+        {
+            throw std::runtime_error("Output format is not supported for this output type");
+        }
+
         static const std::map<OutputType, Estimator::IntermediateValue> kOutputTypeToIntermediateValue = 
         {
             { OutputType::kOpacity, Estimator::IntermediateValue::kOpacity },
@@ -295,13 +435,37 @@ namespace Baikal
         fill_kernel.SetArg(argc++, m_estimator->GetRandomBuffer(Estimator::RandomBufferType::kRandomSeed));
         fill_kernel.SetArg(argc++, m_estimator->GetRandomBuffer(Estimator::RandomBufferType::kSobolLUT));
         fill_kernel.SetArg(argc++, m_sample_counter);
+
+        // Color accumulator keeps per pixel sample counts, which differ from frame count
+        // if pixels are sampled adaptively
+        auto color_output = static_cast<ClwOutput*>(GetOutput(OutputType::kColor));
+        if (color_output && color_output->width() == output_size.x && color_output->height() == output_size.y)
+        {
+            fill_kernel.SetArg(argc++, 1);
+            fill_kernel.SetArg(argc++, color_output->data());
+        }
+        else
+        {
+            fill_kernel.SetArg(argc++, 0);
+            // This is simply a dummy buffer
+            fill_kernel.SetArg(argc++, m_estimator->GetRayCountBuffer());
+        }
+
         for (auto i = static_cast<std::uint32_t>(Renderer::OutputType::kMaxMultiPassOutput) + 1;
             i < static_cast<std::uint32_t>(Renderer::OutputType::kMax); ++i)
         {
             if (auto aov = static_cast<ClwOutput*>(GetOutput(static_cast<Renderer::OutputType>(i))))
             {
-                fill_kernel.SetArg(argc++, 1);
-                fill_kernel.SetArg(argc++, aov->data());
+                // Flag tells the kernel how pixels are stored
+                fill_kernel.SetArg(argc++, 1 + static_cast<int>(aov->format()));
+                if (aov->format() == Output::Format::kRGBA32F)
+                {
+                    fill_kernel.SetArg(argc++, aov->data());
+                }
+                else
+                {
+                    fill_kernel.SetArg(argc++, aov->packed_data());
+                }
             }
             else
             {
@@ -315,7 +479,7 @@ namespace Baikal
         // Run AOV kernel
         {
             int globalsize = tile_size.x * tile_size.y;
-            GetContext().Launch1D(0, ((globalsize + 63) / 64) * 64, 64, fill_kernel);
+            Launch1D(((globalsize + 63) / 64) * 64, 64, fill_kernel);
         }
     }
     
@@ -360,7 +524,7 @@ namespace Baikal
 
         {
             int globalsize = tile_size.x * tile_size.y;
-            GetContext().Launch1D(0, ((globalsize + 63) / 64) * 64, 64, genkernel);
+            Launch1D(((globalsize + 63) / 64) * 64, 64, genkernel);
         }
     }
 
@@ -379,11 +543,26 @@ namespace Baikal
         return GetKernel("AccumulateData");
     }
 
+    CLWKernel MonteCarloRenderer::GetResolveTileKernel()
+    {
+        return GetKernel("ResolveTile");
+    }
+
+    CLWKernel MonteCarloRenderer::GetAccumulateTileKernel()
+    {
+        return GetKernel("AccumulateTile");
+    }
+
     void MonteCarloRenderer::SetRandomSeed(std::uint32_t seed)
     {
         m_estimator->SetRandomSeed(seed);
     }
 
+    void MonteCarloRenderer::SetSampleCounter(std::uint32_t sample_counter)
+    {
+        m_sample_counter = sample_counter;
+    }
+
     void MonteCarloRenderer::Benchmark(ClwScene const& scene, Estimator::RayTracingStats& stats)
     {
         auto output = static_cast<ClwOutput*>(GetOutput(OutputType::kColor));
@@ -402,6 +581,32 @@ namespace Baikal
         m_estimator->SetMaxBounces(max_bounces);
     }
 
+    void MonteCarloRenderer::SetMaterialSorting(bool enable)
+    {
+        m_estimator->SetMaterialSorting(enable);
+    }
+
+    void MonteCarloRenderer::SetPathRegeneration(bool enable)
+    {
+        m_estimator->SetPathRegeneration(enable);
+    }
+
+    void MonteCarloRenderer::SetProfilingEnabled(bool enable)
+    {
+        GetProfiler().SetEnabled(enable);
+    }
+
+    bool MonteCarloRenderer::GetStatistics(RenderStatistics& stats) const
+    {
+        stats = GetProfiler().GetStatistics();
+        return true;
+    }
+
+    void MonteCarloRenderer::SaveProfilingTrace(std::string const& file_name) const
+    {
+        GetProfiler().SaveTrace(file_name);
+    }
+
     void MonteCarloRenderer::HandleMissedRays(const ClwScene &scene , uint32_t w, uint32_t h,
         CLWBuffer<ray> rays, CLWBuffer<Intersection> intersections, CLWBuffer<int> pixel_indices,
         CLWBuffer<int> output_indices, std::size_t size, CLWBuffer<RadeonRays::float3> output)
@@ -424,7 +629,7 @@ namespace Baikal
         misskernel.SetArg(argc++, output);
 
         {
-            GetContext().Launch1D(0, ((size + 63) / 64) * 64, 64, misskernel);
+            Launch1D(((size + 63) / 64) * 64, 64, misskernel);
         }
     }
 
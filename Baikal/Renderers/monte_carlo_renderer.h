@@ -28,6 +28,7 @@ THE SOFTWARE.
 #include "Controllers/clw_scene_controller.h"
 #include "Utils/clw_class.h"
 #include "Estimators/estimator.h"
+#include "Output/output.h"
 
 #include "CLW.h"
 
@@ -60,15 +61,30 @@ namespace Baikal
         // Render the scene into the output
         void Render(ClwScene const& scene) override;
 
+        // Render iterations in batches until the budget is met
+        Progress RenderProgressive(ClwScene const& scene,
+                                   std::uint32_t max_iterations,
+                                   std::chrono::duration<double> time_budget = std::chrono::duration<double>::zero(),
+                                   ProgressCallback const& callback = ProgressCallback()) override;
+
         // Render single tile
         void RenderTile(ClwScene const& scene,
                         RadeonRays::int2 const& tile_origin,
                         RadeonRays::int2 const& tile_size) override;
 
-        // Set output
+        // Stream tiles of virtual textures requested by previous iterations
+        void UpdateVirtualTextures(ClwScene const& scene);
+
+        // Set output, throws if output format is not supported for the type
         void SetOutput(OutputType type, Output* output) override;
 
+        // Multi-pass outputs require kRGBA32F, packed formats are accepted for
+        // AOV pass outputs: kR32UI for ids and kR32F, kRG16F, kRGBA16F for the rest
+        static bool IsFormatSupported(OutputType type, Output::Format format);
+
         void SetRandomSeed(std::uint32_t seed) override;
+        // Set index of the next sample, keeps sample sequences of several renderers in sync
+        void SetSampleCounter(std::uint32_t sample_counter);
 
         // Interop functions
         CLWKernel GetCopyKernel();
@@ -76,11 +92,26 @@ namespace Baikal
 
         // Add function
         CLWKernel GetAccumulateKernel();
+        // Tile functions used to move tiles between devices
+        CLWKernel GetResolveTileKernel();
+        CLWKernel GetAccumulateTileKernel();
         // Run render benchmark
         void Benchmark(ClwScene const& scene, Estimator::RayTracingStats& stats);
 
         // Set max number of light bounces
         void SetMaxBounces(std::uint32_t max_bounces);
+
+        // Enable shading of hits in queues sorted by material
+        void SetMaterialSorting(bool enable);
+
+        // Enable restarting of terminated paths between bounces (ignored by adaptive renderer)
+        void SetPathRegeneration(bool enable);
+
+        // Profiling is shared by all objects created with the same program manager
+        void SetProfilingEnabled(bool enable) override;
+        bool GetStatistics(RenderStatistics& stats) const override;
+        // Save profiling data in Chrome trace event format
+        void SaveProfilingTrace(std::string const& file_name) const;
         
     protected:
         void GeneratePrimaryRays(
@@ -104,6 +135,9 @@ namespace Baikal
 
         Estimator& GetEstimator() { return *m_estimator;  }
 
+        // Check if further iterations can't improve the image, called once per progressive batch
+        virtual bool IsConverged() const;
+
         // Find non-zero AOV
         Output* FindFirstNonZeroOutput(bool include_multipass = true, bool include_singlepass = true) const;
 
@@ -117,6 +151,9 @@ namespace Baikal
         mutable std::uint32_t m_sample_counter;
 
     private:
+        // Render all tiles of single iteration without host synchronization
+        void RenderIteration(ClwScene const& scene);
+
         ClwClass m_uberv2_kernels;
     };
 
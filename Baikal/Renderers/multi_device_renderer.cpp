@@ -0,0 +1,410 @@
+/**********************************************************************
+ Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ********************************************************************/
+#include "multi_device_renderer.h"
+#include "monte_carlo_renderer.h"
+#include "RenderFactory/clw_render_factory.h"
+#include "Controllers/clw_virtual_texture_cache.h"
+#include "Output/clwoutput.h"
+
+#include <algorithm>
+#include <future>
+#include <stdexcept>
+
+namespace Baikal
+{
+    using namespace RadeonRays;
+
+    struct MultiDeviceRenderer::Device
+    {
+        CLWContext context;
+        std::unique_ptr<ClwRenderFactory> factory;
+        std::unique_ptr<SceneController<ClwScene>> controller;
+        std::unique_ptr<MonteCarloRenderer> renderer;
+        // Accumulation output of secondary device
+        std::unique_ptr<Output> output;
+        // Packed tile data: resolved tile on secondary device, tile being merged on primary
+        CLWBuffer<float3> tile_buffer;
+    };
+
+    MultiDeviceRenderer::MultiDeviceRenderer(std::vector<CLWContext> const& contexts, std::string const& cache_path)
+        : m_output(nullptr)
+        , m_tile_size(256, 256)
+        , m_samples_per_tile(8u)
+        , m_frame(0u)
+        , m_num_tiles(0u)
+        , m_num_tiles_x(0u)
+        , m_next_tile(0u)
+        , m_num_active_secondaries(0u)
+    {
+        if (contexts.empty())
+        {
+            throw std::runtime_error("MultiDeviceRenderer requires at least one context");
+        }
+
+        for (auto const& context : contexts)
+        {
+            auto device = std::make_unique<Device>();
+            device->context = context;
+            device->factory = std::make_unique<ClwRenderFactory>(context, cache_path);
+            device->controller = device->factory->CreateSceneController();
+            device->renderer.reset(static_cast<MonteCarloRenderer*>(
+                device->factory->CreateRenderer(ClwRenderFactory::RendererType::kUnidirectionalPathTracer).release()));
+            device->tile_buffer = context.CreateBuffer<float3>(m_tile_size.x * m_tile_size.y, CL_MEM_READ_WRITE);
+            m_devices.push_back(std::move(device));
+        }
+
+        // Calling thread drives primary device
+        if (m_devices.size() > 1)
+        {
+            m_thread_pool = std::make_unique<ThreadPool>(m_devices.size() - 1);
+        }
+    }
+
+    MultiDeviceRenderer::~MultiDeviceRenderer() = default;
+
+    std::unique_ptr<Output> MultiDeviceRenderer::CreateOutput(std::uint32_t w, std::uint32_t h) const
+    {
+        return m_devices[0]->factory->CreateOutput(w, h);
+    }
+
+    void MultiDeviceRenderer::SetOutput(Output* output)
+    {
+        m_output = output;
+        m_devices[0]->renderer->SetOutput(Renderer::OutputType::kColor, output);
+
+        for (std::size_t i = 1; i < m_devices.size(); ++i)
+        {
+            auto& device = *m_devices[i];
+
+            if (output)
+            {
+                device.output = device.factory->CreateOutput(output->width(), output->height());
+                device.output->Clear(float3());
+            }
+            else
+            {
+                device.output.reset();
+            }
+
+            device.renderer->SetOutput(Renderer::OutputType::kColor, device.output.get());
+        }
+    }
+
+    void MultiDeviceRenderer::Clear(float3 const& val)
+    {
+        if (!m_output)
+        {
+            throw std::runtime_error("No output set");
+        }
+
+        m_devices[0]->renderer->Clear(val, *m_output);
+
+        for (std::size_t i = 1; i < m_devices.size(); ++i)
+        {
+            m_devices[i]->renderer->Clear(float3(), *m_devices[i]->output);
+        }
+
+        m_frame = 0u;
+    }
+
+    void MultiDeviceRenderer::CompileScene(Scene1::Ptr scene)
+    {
+        for (auto& device : m_devices)
+        {
+            device->controller->CompileScene(scene);
+        }
+
+        m_scene = scene;
+    }
+
+    void MultiDeviceRenderer::SetTileSize(int2 const& tile_size)
+    {
+        if (tile_size.x <= 0 || tile_size.y <= 0)
+        {
+            throw std::runtime_error("Invalid tile size");
+        }
+
+        m_tile_size = tile_size;
+
+        for (auto& device : m_devices)
+        {
+            device->tile_buffer = device->context.CreateBuffer<float3>(m_tile_size.x * m_tile_size.y, CL_MEM_READ_WRITE);
+        }
+    }
+
+    void MultiDeviceRenderer::SetSamplesPerTile(std::uint32_t num_samples)
+    {
+        m_samples_per_tile = std::max(num_samples, 1u);
+    }
+
+    void MultiDeviceRenderer::SetRandomSeed(std::uint32_t seed)
+    {
+        for (auto& device : m_devices)
+        {
+            device->renderer->SetRandomSeed(seed);
+        }
+    }
+
+    void MultiDeviceRenderer::SetMaxBounces(std::uint32_t max_bounces)
+    {
+        for (auto& device : m_devices)
+        {
+            device->renderer->SetMaxBounces(max_bounces);
+        }
+    }
+
+    MultiDeviceRenderer::FrameStats MultiDeviceRenderer::Render()
+    {
+        if (!m_output)
+        {
+            throw std::runtime_error("No output set");
+        }
+
+        if (!m_scene)
+        {
+            throw std::runtime_error("No scene compiled");
+        }
+
+        auto start = std::chrono::high_resolution_clock::now();
+
+        m_num_tiles_x = (m_output->width() + m_tile_size.x - 1) / m_tile_size.x;
+        m_num_tiles = m_num_tiles_x * ((m_output->height() + m_tile_size.y - 1) / m_tile_size.y);
+        m_next_tile.store(0u);
+        m_num_active_secondaries = m_devices.size() - 1;
+
+        std::vector<std::future<std::uint32_t>> secondaries;
+        for (std::size_t i = 1; i < m_devices.size(); ++i)
+        {
+            secondaries.push_back(m_thread_pool->Submit([this, i]()
+            {
+                try
+                {
+                    auto num_tiles = RenderTiles(i);
+
+                    {
+                        std::lock_guard<std::mutex> lock(m_finished_mutex);
+                        --m_num_active_secondaries;
+                    }
+
+                    m_finished_condition.notify_one();
+                    return num_tiles;
+                }
+                catch (...)
+                {
+                    {
+                        std::lock_guard<std::mutex> lock(m_finished_mutex);
+                        --m_num_active_secondaries;
+                    }
+
+                    m_finished_condition.notify_one();
+                    throw;
+                }
+            }));
+        }
+
+        FrameStats stats;
+        stats.num_tiles.resize(m_devices.size());
+
+        try
+        {
+            stats.num_tiles[0] = RenderTiles(0);
+            MergeFinishedTiles(true);
+        }
+        catch (...)
+        {
+            // Secondaries reference this object, stop handing out tiles and wait for them
+            m_next_tile.store(m_num_tiles);
+
+            for (auto& secondary : secondaries)
+            {
+                secondary.wait();
+            }
+
+            m_finished_tiles.clear();
+            throw;
+        }
+
+        for (std::size_t i = 1; i < m_devices.size(); ++i)
+        {
+            stats.num_tiles[i] = secondaries[i - 1].get();
+        }
+
+        m_devices[0]->context.Finish(0);
+        ++m_frame;
+
+        // Keep sample counter in sync for clients reading it from primary renderer
+        m_devices[0]->renderer->SetSampleCounter(m_frame * m_samples_per_tile);
+
+        stats.elapsed = std::chrono::high_resolution_clock::now() - start;
+        return stats;
+    }
+
+    std::uint32_t MultiDeviceRenderer::RenderTiles(std::size_t device_idx)
+    {
+        auto& device = *m_devices[device_idx];
+        auto& scene = device.controller->GetCachedScene(m_scene);
+        bool const primary = device_idx == 0;
+
+        device.renderer->UpdateVirtualTextures(scene);
+
+        std::uint32_t num_tiles = 0u;
+
+        for (;;)
+        {
+            if (primary)
+            {
+                MergeFinishedTiles(false);
+            }
+
+            auto tile = m_next_tile.fetch_add(1u);
+
+            if (tile >= m_num_tiles)
+            {
+                break;
+            }
+
+            RenderTile(device, tile);
+
+            if (primary)
+            {
+                // Take next tile only when this one is done, otherwise primary
+                // would enqueue most of the frame before secondaries start
+                device.context.Finish(0);
+            }
+            else
+            {
+                ResolveTile(device, tile);
+            }
+
+            ++num_tiles;
+        }
+
+        return num_tiles;
+    }
+
+    void MultiDeviceRenderer::RenderTile(Device& device, std::uint32_t tile)
+    {
+        auto& scene = device.controller->GetCachedScene(m_scene);
+
+        int2 origin, size;
+        GetTile(tile, origin, size);
+
+        for (auto i = 0u; i < m_samples_per_tile; ++i)
+        {
+            // Sample index only depends on frame, so tiles match whichever device renders them
+            device.renderer->SetSampleCounter(m_frame * m_samples_per_tile + i);
+            device.renderer->RenderTile(scene, origin, size);
+        }
+    }
+
+    void MultiDeviceRenderer::ResolveTile(Device& device, std::uint32_t tile)
+    {
+        int2 origin, size;
+        GetTile(tile, origin, size);
+
+        auto num_elements = static_cast<std::uint32_t>(size.x * size.y);
+        auto resolve_kernel = device.renderer->GetResolveTileKernel();
+
+        int argc = 0;
+        resolve_kernel.SetArg(argc++, static_cast<ClwOutput*>(device.output.get())->data());
+        resolve_kernel.SetArg(argc++, static_cast<int>(device.output->width()));
+        resolve_kernel.SetArg(argc++, origin.x);
+        resolve_kernel.SetArg(argc++, origin.y);
+        resolve_kernel.SetArg(argc++, size.x);
+        resolve_kernel.SetArg(argc++, size.y);
+        resolve_kernel.SetArg(argc++, device.tile_buffer);
+
+        device.context.Launch1D(0, ((num_elements + 63) / 64) * 64, 64, resolve_kernel);
+
+        FinishedTile finished;
+        finished.index = tile;
+        finished.data.resize(num_elements);
+        device.context.ReadBuffer(0, device.tile_buffer, &finished.data[0], num_elements).Wait();
+
+        {
+            std::lock_guard<std::mutex> lock(m_finished_mutex);
+            m_finished_tiles.push_back(std::move(finished));
+        }
+
+        m_finished_condition.notify_one();
+    }
+
+    void MultiDeviceRenderer::MergeFinishedTiles(bool wait_all)
+    {
+        auto& primary = *m_devices[0];
+
+        for (;;)
+        {
+            FinishedTile finished;
+
+            {
+                std::unique_lock<std::mutex> lock(m_finished_mutex);
+
+                if (wait_all)
+                {
+                    m_finished_condition.wait(lock, [this]()
+                    {
+                        return !m_finished_tiles.empty() || m_num_active_secondaries == 0;
+                    });
+                }
+
+                if (m_finished_tiles.empty())
+                {
+                    return;
+                }
+
+                finished = std::move(m_finished_tiles.front());
+                m_finished_tiles.pop_front();
+            }
+
+            int2 origin, size;
+            GetTile(finished.index, origin, size);
+
+            auto num_elements = static_cast<std::uint32_t>(size.x * size.y);
+
+            // Primary queue is idle between its tiles, so blocking write doesn't stall rendering,
+            // and the queue is in order, so staging buffer can be reused by the next merge
+            primary.context.WriteBuffer(0, primary.tile_buffer, &finished.data[0], num_elements).Wait();
+
+            auto accumulate_kernel = primary.renderer->GetAccumulateTileKernel();
+
+            int argc = 0;
+            accumulate_kernel.SetArg(argc++, primary.tile_buffer);
+            accumulate_kernel.SetArg(argc++, static_cast<int>(m_output->width()));
+            accumulate_kernel.SetArg(argc++, origin.x);
+            accumulate_kernel.SetArg(argc++, origin.y);
+            accumulate_kernel.SetArg(argc++, size.x);
+            accumulate_kernel.SetArg(argc++, size.y);
+            accumulate_kernel.SetArg(argc++, static_cast<ClwOutput*>(m_output)->data());
+
+            primary.context.Launch1D(0, ((num_elements + 63) / 64) * 64, 64, accumulate_kernel);
+        }
+    }
+
+    void MultiDeviceRenderer::GetTile(std::uint32_t tile, int2& origin, int2& size) const
+    {
+        origin = int2(static_cast<int>(tile % m_num_tiles_x) * m_tile_size.x,
+            static_cast<int>(tile / m_num_tiles_x) * m_tile_size.y);
+        size = int2(std::min(m_tile_size.x, static_cast<int>(m_output->width()) - origin.x),
+            std::min(m_tile_size.y, static_cast<int>(m_output->height()) - origin.y));
+    }
+}
@@ -0,0 +1,138 @@
+/**********************************************************************
+Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#pragma once
+
+#include "math/int2.h"
+#include "math/float3.h"
+#include "SceneGraph/scene1.h"
+#include "Utils/thread_pool.h"
+
+#include "CLW.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace Baikal
+{
+    class Output;
+
+    /**
+    \brief Renders single image on several OpenCL devices.
+
+    Image is split into tiles. Every device takes next unrendered tile from a shared
+    lock-free counter until all tiles of the frame are taken, so faster devices take
+    more tiles. First device is primary: it owns the output and renders its tiles directly
+    into it. Other devices render tiles into their own accumulation buffers, read back only
+    finished tiles, and the primary adds them into the output in between its own tiles.
+
+    Only color output is supported. Every tile gets the same number of samples per frame,
+    sample indices depend on the frame, not on the device, so any device mix converges
+    to the same image.
+    */
+    class MultiDeviceRenderer
+    {
+    public:
+        struct FrameStats
+        {
+            // Number of tiles rendered by each device
+            std::vector<std::uint32_t> num_tiles;
+            // Wall clock time of the frame
+            std::chrono::duration<double> elapsed;
+        };
+
+        // Creates renderer and scene controller for every context, first context is primary
+        explicit MultiDeviceRenderer(std::vector<CLWContext> const& contexts, std::string const& cache_path = "cache");
+        ~MultiDeviceRenderer();
+
+        std::size_t GetDeviceCount() const { return m_devices.size(); }
+
+        // Create an output on primary device
+        std::unique_ptr<Output> CreateOutput(std::uint32_t w, std::uint32_t h) const;
+
+        // Set color output, has to be created by CreateOutput
+        void SetOutput(Output* output);
+
+        // Clear output and per device accumulation
+        void Clear(RadeonRays::float3 const& val);
+
+        // Compile scene on all devices, has to be called after scene changes
+        void CompileScene(Scene1::Ptr scene);
+
+        // Render single frame: samples_per_tile samples in every pixel
+        FrameStats Render();
+
+        // Set tile size, smaller tiles balance better but add merge overhead
+        void SetTileSize(RadeonRays::int2 const& tile_size);
+
+        // Set number of samples every tile gets before it is merged
+        void SetSamplesPerTile(std::uint32_t num_samples);
+
+        void SetRandomSeed(std::uint32_t seed);
+        void SetMaxBounces(std::uint32_t max_bounces);
+
+        MultiDeviceRenderer(MultiDeviceRenderer const&) = delete;
+        MultiDeviceRenderer& operator = (MultiDeviceRenderer const&) = delete;
+
+    private:
+        struct Device;
+
+        // Tile rendered by secondary device waiting to be merged into output
+        struct FinishedTile
+        {
+            std::uint32_t index;
+            std::vector<RadeonRays::float3> data;
+        };
+
+        // Take tiles until there are none left, returns number of tiles rendered
+        std::uint32_t RenderTiles(std::size_t device_idx);
+        void RenderTile(Device& device, std::uint32_t tile);
+        void ResolveTile(Device& device, std::uint32_t tile);
+        // Merge tiles finished by secondary devices, optionally waiting for all of them
+        void MergeFinishedTiles(bool wait_all);
+        void GetTile(std::uint32_t tile, RadeonRays::int2& origin, RadeonRays::int2& size) const;
+
+        std::vector<std::unique_ptr<Device>> m_devices;
+        std::unique_ptr<ThreadPool> m_thread_pool;
+
+        Output* m_output;
+        Scene1::Ptr m_scene;
+        RadeonRays::int2 m_tile_size;
+        std::uint32_t m_samples_per_tile;
+        std::uint32_t m_frame;
+
+        // Work distribution state of current frame
+        std::uint32_t m_num_tiles;
+        std::uint32_t m_num_tiles_x;
+        std::atomic<std::uint32_t> m_next_tile;
+        std::size_t m_num_active_secondaries;
+        std::deque<FinishedTile> m_finished_tiles;
+        std::mutex m_finished_mutex;
+        std::condition_variable m_finished_condition;
+    };
+}
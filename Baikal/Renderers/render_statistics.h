@@ -0,0 +1,75 @@
+/**********************************************************************
+Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace Baikal
+{
+    /**
+    \brief Statistics collected by renderers while profiling is enabled.
+
+    Times are device times measured with OpenCL profiling events, except for intersector
+    queries, which are measured on host around a finished queue. All values are totals
+    since profiling has been enabled or statistics have been reset.
+    */
+    struct RenderStatistics
+    {
+        // Launches of a single kernel or intersector query
+        struct Kernel
+        {
+            std::string name;
+            std::uint32_t num_launches = 0;
+            double time_ms = 0.0;
+        };
+
+        // Work done in a single pass (bounce) of the estimator
+        struct Pass
+        {
+            // Number of rays traced in the pass (live paths)
+            std::uint64_t num_rays = 0;
+            double time_ms = 0.0;
+        };
+
+        // Compilation of OpenCL program
+        struct Compilation
+        {
+            std::string program_name;
+            std::string options;
+            double time_ms = 0.0;
+        };
+
+        // Number of rendered iterations
+        std::uint32_t num_frames = 0;
+        // Total time of kernels and queries
+        double time_ms = 0.0;
+        // Kernels sorted by time, most expensive first
+        std::vector<Kernel> kernels;
+        // Passes indexed by pass number
+        std::vector<Pass> passes;
+        std::vector<Compilation> compilations;
+        // Bytes of geometry uploaded by scene controller
+        std::uint64_t bytes_uploaded = 0;
+    };
+}
@@ -31,8 +31,11 @@ THE SOFTWARE.
 
 #include "math/float3.h"
 #include "math/int2.h"
+#include "render_statistics.h"
 #include <cstdint>
 #include <array>
+#include <chrono>
+#include <functional>
 #include <stdexcept>
 
 namespace Baikal
@@ -56,6 +59,9 @@ namespace Baikal
             kColor = 0,
             kOpacity,
             kVisibility,
+            // Relative error of color estimate, produced
+            // by renderers with convergence based sampling
+            kConvergenceError,
             kMaxMultiPassOutput,
             // Single-pass outputs that will
             // be rendered in AOV kernel
@@ -77,6 +83,22 @@ namespace Baikal
             kMax
         };
 
+        // Progress of RenderProgressive call
+        struct Progress
+        {
+            // Iterations rendered by this call
+            std::uint32_t num_iterations;
+            // Iterations accumulated in outputs since last clear
+            std::uint32_t num_accumulated;
+            // Wall clock time spent in this call including device time
+            std::chrono::duration<double> elapsed;
+            // Set if rendering has stopped because all pixels have converged
+            bool converged;
+        };
+
+        // Called after each batch of iterations, returning false stops rendering
+        using ProgressCallback = std::function<bool(Progress const&)>;
+
         Renderer();
         virtual ~Renderer() = default;
 
@@ -97,6 +119,25 @@ namespace Baikal
         virtual
         void Render(ClwScene const& scene) = 0;
 
+        /**
+         \brief Render iterations until the budget is met.
+
+         Iterations are enqueued in batches back to back, host waits for the device
+         only once per batch to report progress and check the time budget. Renderers
+         with convergence based sampling also stop once the image has converged.
+
+         \param scene Scene to render
+         \param max_iterations Number of iterations to render, 0 means no limit
+         \param time_budget Wall clock time budget, zero means no limit
+         \param callback Progress callback, optional if any budget is set
+         \return Progress at the moment rendering has stopped
+         */
+        virtual
+        Progress RenderProgressive(ClwScene const& scene,
+            std::uint32_t max_iterations,
+            std::chrono::duration<double> time_budget = std::chrono::duration<double>::zero(),
+            ProgressCallback const& callback = ProgressCallback()) = 0;
+
         /**
         \brief Render single iteration.
 
@@ -129,6 +170,23 @@ namespace Baikal
         */
         virtual void SetRandomSeed(std::uint32_t seed) = 0;
 
+        /**
+        \brief Enable collection of render statistics.
+
+        Profiling adds synchronization points, so it slows rendering down.
+
+        \param enable Enable or disable profiling
+        */
+        virtual void SetProfilingEnabled(bool enable) {}
+
+        /**
+        \brief Get statistics collected while profiling is enabled.
+
+        \param stats Statistics
+        \return False if renderer doesn't collect statistics
+        */
+        virtual bool GetStatistics(RenderStatistics& stats) const { return false; }
+
         /**
             Disallow copies and moves.
          */
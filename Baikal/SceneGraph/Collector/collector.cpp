@@ -149,6 +149,11 @@ namespace Baikal
         
         return iter->second;
     }
+
+    bool Collector::HasItem(SceneObject::Ptr item) const
+    {
+        return m_impl->m_set.find(item) != m_impl->m_set.cend();
+    }
     
     
 }
@@ -89,6 +89,8 @@ namespace Baikal
         Bundle* CreateBundle() const;
         // Get item index within a collection
         std::uint32_t GetItemIndex(SceneObject::Ptr item) const;
+        // Check if the item has been collected
+        bool HasItem(SceneObject::Ptr item) const;
         // Finalization function
         void Finalize(FinalizeFunc finalize_func);
 
@@ -6,11 +6,17 @@
 #include "radeon_rays.h"
 #include "SceneGraph/Collector/collector.h"
 
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
 
 namespace Baikal
 {
     using namespace RadeonRays;
 
+    class ClwVirtualTextureCache;
+
     enum class CameraType
     {
         kPerspective,
@@ -20,14 +26,85 @@ namespace Baikal
         kOrthographic
     };
 
+    // Element types of ClwScene geometry buffers (see scene.cl).
+    // Compact layout stores positions as packed floats, normals octahedral encoded
+    // into 2 x snorm16, UVs as 2 x half and indices as 16-bit values. Meshes which
+    // don't fit 16-bit indices keep 32-bit ones as pairs of index buffer elements.
+#ifdef BAIKAL_COMPACT_GEOMETRY
+    struct ClwPackedPosition
+    {
+        float x, y, z;
+    };
+
+    using ClwGeometryPosition = ClwPackedPosition;
+    using ClwGeometryNormal = std::uint32_t;
+    using ClwGeometryUV = std::uint32_t;
+    using ClwGeometryIndex = std::uint16_t;
+#else
+    using ClwGeometryPosition = RadeonRays::float3;
+    using ClwGeometryNormal = RadeonRays::float3;
+    using ClwGeometryUV = RadeonRays::float2;
+    using ClwGeometryIndex = int;
+#endif
+
+    // Placement of a single mesh inside of ClwScene geometry buffers
+    struct ClwMeshRange
+    {
+        // First vertex (normal, uv) and number of reserved vertices
+        std::size_t startvtx;
+        std::size_t vtx_capacity;
+        // First index and number of reserved index buffer elements
+        std::size_t startidx;
+        std::size_t idx_capacity;
+        // Compact geometry: indices are stored as 16-bit values
+        bool short_indices;
+        // Mesh geometry revision currently residing in GPU memory
+        std::uint32_t revision;
+    };
+
+    // Order of shapes in ClwScene shape buffer and intersector: scene meshes,
+    // meshes which are not in the scene but referenced by instances, then instances.
+    // It is built once per change of the scene shape list, so shape indices stay the same
+    // between updates and can be looked up by shape id.
+    struct ClwShapeRegistry
+    {
+        // Scene meshes followed by excluded ones
+        std::vector<Mesh::Ptr> meshes;
+        std::size_t num_excluded_meshes = 0;
+        std::vector<Instance::Ptr> instances;
+        // Shape id -> index in shape buffer
+        std::unordered_map<std::uint32_t, int> indices;
+        // Base shapes of instances at the time the registry has been built
+        std::vector<Shape::Ptr> instance_bases;
+        // Scene shape revision the registry has been built for
+        std::uint32_t revision = 0;
+        bool valid = false;
+        // Incremented on each rebuild
+        std::uint32_t generation = 0;
+        // Generation shape buffer has been written for
+        std::uint32_t shapes_generation = 0;
+
+        // Get index of the shape in shape buffer or -1 if the shape is not registered
+        int GetIndex(Shape const& shape) const
+        {
+            auto iter = indices.find(shape.GetId());
+            return iter != indices.cend() ? iter->second : -1;
+        }
+
+        std::size_t GetNumShapes() const
+        {
+            return meshes.size() + instances.size();
+        }
+    };
+
     struct ClwScene
     {
         #include "Kernels/CL/payload.cl"
 
-        CLWBuffer<RadeonRays::float3> vertices;
-        CLWBuffer<RadeonRays::float3> normals;
-        CLWBuffer<RadeonRays::float2> uvs;
-        CLWBuffer<int> indices;
+        CLWBuffer<ClwGeometryPosition> vertices;
+        CLWBuffer<ClwGeometryNormal> normals;
+        CLWBuffer<ClwGeometryUV> uvs;
+        CLWBuffer<ClwGeometryIndex> indices;
 
         CLWBuffer<Shape> shapes;
         CLWBuffer<ShapeAdditionalData> shapes_additional;
@@ -35,11 +112,21 @@ namespace Baikal
         CLWBuffer<std::int32_t> material_attributes;
         CLWBuffer<Light> lights;
         CLWBuffer<Volume> volumes;
+        // Density grids of heterogeneous volumes, their majorants,
+        // brick tables and bricks are packed into volume_data
+        CLWBuffer<VolumeGrid> volume_grids;
+        CLWBuffer<float> volume_data;
         CLWBuffer<Texture> textures;
         CLWBuffer<char> texturedata;
+        // Streams tiles of virtual textures into texturedata, nullptr if scene has none
+        std::shared_ptr<ClwVirtualTextureCache> virtual_textures;
 
         CLWBuffer<Camera> camera;
         CLWBuffer<int> light_distributions;
+        CLWBuffer<LightBvhNode> light_bvh;
+        // Per shape offset into the same buffer (or -1, or -(light_idx + 2) for mesh lights),
+        // followed by light index of each primitive (or -1)
+        CLWBuffer<int> emissive_lights;
         CLWBuffer<InputMapData> input_map_data;
 
         std::unique_ptr<Bundle> material_bundle;
@@ -55,7 +142,26 @@ namespace Baikal
         int camera_volume_index;
         CameraType camera_type;
 
+        // Distinct material layer masks of scene shapes (sorted)
+        std::vector<std::uint32_t> material_layers;
+
         std::vector<RadeonRays::Shape*> isect_shapes;
         std::vector<RadeonRays::Shape*> visible_shapes;
+
+        // Shape buffer order shared by shape, intersector and light updates
+        ClwShapeRegistry shape_registry;
+
+        // Geometry buffers are used as an arena: meshes keep their ranges
+        // between updates and only changed meshes are uploaded.
+        // Mesh id -> range in vertices/normals/uvs and indices buffers.
+        std::unordered_map<std::uint32_t, ClwMeshRange> mesh_ranges;
+        // Number of vertices and indices allocated in the arena (including holes)
+        std::size_t num_vertices_allocated = 0;
+        std::size_t num_indices_allocated = 0;
+        // Number of vertices and indices occupied by holes left from removed or moved meshes
+        std::size_t num_vertices_wasted = 0;
+        std::size_t num_indices_wasted = 0;
+        // Number of bytes uploaded to geometry buffers during last update
+        std::size_t geometry_bytes_uploaded = 0;
     };
 }
@@ -245,4 +245,33 @@ namespace Baikal
         // Parent primitive index
         std::size_t m_prim_idx;
     };
+
+    /**
+     \brief Emissive mesh light source.
+
+     Represents all primitives of a mesh with emissive material as a single light,
+     primitives are sampled proportionally to their area. Emission is defined by
+     mesh material.
+     */
+    class MeshLight: public Light
+    {
+    public:
+        using Ptr = std::shared_ptr<MeshLight>;
+        static Ptr Create(Shape::Ptr shape);
+
+        // Get parent shape, it has to be a mesh
+        Shape::Ptr GetShape() const;
+
+        // Light is also dirty while its mesh is
+        bool IsDirty() const override;
+
+        RadeonRays::float3 GetPower(Scene1 const& scene) const override;
+
+    protected:
+        MeshLight(Shape::Ptr shape);
+
+    private:
+        // Parent shape
+        Shape::Ptr m_shape;
+    };
 }
@@ -253,6 +253,17 @@ namespace Baikal
         return (GetInputValue("emission").float_value.sqnorm() != 0);
     }
 
+    void VolumeMaterial::SetDensityGrid(VolumeGrid::Ptr grid)
+    {
+        m_density_grid = grid;
+        SetDirty(true);
+    }
+
+    VolumeGrid::Ptr VolumeMaterial::GetDensityGrid() const
+    {
+        return m_density_grid;
+    }
+
     namespace {
         struct VolumeMaterialConcrete : public VolumeMaterial {
         };
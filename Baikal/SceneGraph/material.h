@@ -37,6 +37,7 @@
 
 #include "scene_object.h"
 #include "texture.h"
+#include "volume_grid.h"
 #include "inputmap.h"
 
 namespace Baikal
@@ -188,7 +189,15 @@ namespace Baikal
         // Check if material has emissive components
         bool HasEmission() const override;
 
+        // Set density grid making volume heterogeneous, nullptr makes it homogeneous.
+        // Absorption, scattering and emission of heterogeneous volume are given per unit of density.
+        void SetDensityGrid(VolumeGrid::Ptr grid);
+        VolumeGrid::Ptr GetDensityGrid() const;
+
     protected:
         VolumeMaterial();
+
+    private:
+        VolumeGrid::Ptr m_density_grid;
     };
 }
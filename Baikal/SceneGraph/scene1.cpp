@@ -25,6 +25,8 @@ namespace Baikal
         EnvironmentOverride m_environment_override;
 
         DirtyFlags m_dirty_flags;
+        // Incremented each time the list of shapes changes
+        std::uint32_t m_shape_revision = 0;
         std::mutex m_scene_mutex;
     };
 
@@ -121,6 +123,7 @@ namespace Baikal
         if (citer == m_impl->m_shapes.cend())
         {
             m_impl->m_shapes.push_back(shape);
+            ++m_impl->m_shape_revision;
             
             SetDirtyFlag(kShapes);
         }
@@ -139,6 +142,7 @@ namespace Baikal
         if (citer != m_impl->m_shapes.cend())
         {
             m_impl->m_shapes.erase(citer);
+            ++m_impl->m_shape_revision;
             
             SetDirtyFlag(kShapes);
         }
@@ -148,6 +152,11 @@ namespace Baikal
     {
         return m_impl->m_shapes.size();
     }
+
+    std::uint32_t Scene1::GetShapeRevision() const
+    {
+        return m_impl->m_shape_revision;
+    }
     
     std::unique_ptr<Iterator> Scene1::CreateLightIterator() const
     {
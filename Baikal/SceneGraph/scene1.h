@@ -93,6 +93,8 @@ namespace Baikal
         
         // Get number of shapes in the scene
         std::size_t GetNumShapes() const;
+        // Get revision of shape list, it is incremented each time a shape is attached or detached
+        std::uint32_t GetShapeRevision() const;
         // Get shape iterator
         std::unique_ptr<Iterator> CreateShapeIterator() const;
 
@@ -1,11 +1,30 @@
 #include "scene_object.h"
+#include <atomic>
 #include <cassert>
+#include <mutex>
 
 namespace Baikal
 {
     static std::uint32_t g_next_id = 0;
     static int g_scene_controller_id = -1;
 
+    namespace
+    {
+        // Log is dropped once it grows beyond this size, controller recompiles the scene then
+        std::size_t const kMaxChangeLogSize = 1u << 20;
+
+        struct ChangeLog
+        {
+            std::vector<std::uint32_t> ids;
+            bool overflow = false;
+        };
+
+        // One log per dirty bit, i.e. per scene controller
+        ChangeLog g_change_logs[32];
+        std::atomic<std::uint32_t> g_change_log_mask(0u);
+        std::mutex g_change_log_mutex;
+    }
+
     SceneObject::SceneObject()
         : m_dirty(), m_id(g_next_id++)
     {
@@ -23,8 +42,41 @@ namespace Baikal
     {
         if (dirty)
         {
+            // Object is logged once it becomes dirty for a controller. Controllers reset
+            // the bit when they compile the object, so repeated changes skip the logs.
+            auto mask = g_change_log_mask.load() & static_cast<std::uint32_t>((~m_dirty).to_ulong());
+
             // Set all bits to 1
             m_dirty.set();
+
+            if (!mask)
+            {
+                return;
+            }
+
+            std::lock_guard<std::mutex> lock(g_change_log_mutex);
+            mask &= g_change_log_mask.load();
+
+            for (auto i = 0; i < kMaxDirtyBits; ++i)
+            {
+                auto& log = g_change_logs[i];
+
+                if (!(mask & (1u << i)) || log.overflow)
+                {
+                    continue;
+                }
+
+                if (log.ids.size() < kMaxChangeLogSize)
+                {
+                    log.ids.push_back(m_id);
+                }
+                else
+                {
+                    log.ids.clear();
+                    log.ids.shrink_to_fit();
+                    log.overflow = true;
+                }
+            }
         }
         else
         {
@@ -50,4 +102,37 @@ namespace Baikal
         g_scene_controller_id = -1;
     }
 
+    void SceneObject::EnableChangeLog(std::uint32_t controller_id)
+    {
+        assert(controller_id < kMaxDirtyBits);
+        std::lock_guard<std::mutex> lock(g_change_log_mutex);
+
+        g_change_logs[controller_id] = ChangeLog();
+        g_change_log_mask |= 1u << controller_id;
+    }
+
+    void SceneObject::DisableChangeLog(std::uint32_t controller_id)
+    {
+        assert(controller_id < kMaxDirtyBits);
+        std::lock_guard<std::mutex> lock(g_change_log_mutex);
+
+        g_change_logs[controller_id] = ChangeLog();
+        g_change_log_mask &= ~(1u << controller_id);
+    }
+
+    bool SceneObject::FetchChanges(std::uint32_t controller_id, std::vector<std::uint32_t>& changes)
+    {
+        assert(controller_id < kMaxDirtyBits);
+        std::lock_guard<std::mutex> lock(g_change_log_mutex);
+
+        auto& log = g_change_logs[controller_id];
+        auto complete = !log.overflow;
+
+        changes.clear();
+        changes.swap(log.ids);
+        log.overflow = false;
+
+        return complete;
+    }
+
 }
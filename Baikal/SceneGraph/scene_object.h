@@ -62,6 +62,14 @@ namespace Baikal
         static void SetSceneControllerId(std::uint32_t controller_id);
         static void ResetSceneControllerId();
 
+        // Change log of a scene controller: ids of objects which have been set dirty
+        // since the last fetch. Objects are recorded only while the log is enabled.
+        static void EnableChangeLog(std::uint32_t controller_id);
+        static void DisableChangeLog(std::uint32_t controller_id);
+        // Moves recorded ids (possibly with duplicates) into changes and clears the log.
+        // Returns false if the log has overflowed and some changes were not recorded.
+        static bool FetchChanges(std::uint32_t controller_id, std::vector<std::uint32_t>& changes);
+
     protected:
         // Constructor
         SceneObject();
@@ -4,6 +4,7 @@
 namespace Baikal
 {
     Mesh::Mesh() :
+    m_geometry_revision(0),
     m_aabb_cached(false)
     {
     }
@@ -18,12 +19,16 @@ namespace Baikal
         
         std::copy(indices, indices + num_indices, &m_indices[0]);
         
+        ++m_geometry_revision;
         SetDirty(true);
     }
 
     void Mesh::SetIndices(std::vector<std::uint32_t>&& indices)
     {
         m_indices = std::move(indices);
+
+        ++m_geometry_revision;
+        SetDirty(true);
     }
 
     std::size_t Mesh::GetNumIndices() const
@@ -46,6 +51,7 @@ namespace Baikal
 
         std::copy(vertices, vertices + num_vertices, &m_vertices[0]);
 
+        ++m_geometry_revision;
         SetDirty(true);
     }
     
@@ -65,12 +71,16 @@ namespace Baikal
             m_vertices[i].w = 1;
         }
 
+        ++m_geometry_revision;
         SetDirty(true);
     }
 
     void Mesh::SetVertices(std::vector<RadeonRays::float3>&& vertices)
     {
         m_vertices = std::move(vertices);
+
+        ++m_geometry_revision;
+        SetDirty(true);
     }
 
     
@@ -94,6 +104,7 @@ namespace Baikal
 
         std::copy(normals, normals + num_normals, &m_normals[0]);
 
+        ++m_geometry_revision;
         SetDirty(true);
     }
     
@@ -113,12 +124,16 @@ namespace Baikal
             m_normals[i].w = 0;
         }
 
+        ++m_geometry_revision;
         SetDirty(true);
     }
 
     void Mesh::SetNormals(std::vector<RadeonRays::float3>&& normals)
     {
         m_normals = std::move(normals);
+
+        ++m_geometry_revision;
+        SetDirty(true);
     }
 
     
@@ -142,6 +157,7 @@ namespace Baikal
 
         std::copy(uvs, uvs + num_uvs, &m_uvs[0]);
 
+        ++m_geometry_revision;
         SetDirty(true);
     }
     
@@ -159,12 +175,16 @@ namespace Baikal
             m_uvs[i].y = uvs[2 * i + 1];
         }
 
+        ++m_geometry_revision;
         SetDirty(true);
     }
 
     void Mesh::SetUVs(std::vector<RadeonRays::float2>&& uvs)
     {
         m_uvs = std::move(uvs);
+
+        ++m_geometry_revision;
+        SetDirty(true);
     }
 
     std::size_t Mesh::GetNumUVs() const
@@ -177,6 +197,11 @@ namespace Baikal
         return &m_uvs[0];
     }
 
+    std::uint32_t Mesh::GetGeometryRevision() const
+    {
+        return m_geometry_revision;
+    }
+
     RadeonRays::bbox Shape::GetWorldAABB() const
     {
         RadeonRays::bbox result;
@@ -161,6 +161,10 @@ namespace Baikal
         std::size_t GetNumUVs() const;
         RadeonRays::float2 const* GetUVs() const;
 
+        // Get geometry revision, it is incremented each time
+        // vertex, normal, uv or index data is changed
+        std::uint32_t GetGeometryRevision() const;
+
         // Local space AABB
         RadeonRays::bbox GetLocalAABB() const override;
 
@@ -181,6 +185,8 @@ namespace Baikal
         std::vector<RadeonRays::float2> m_uvs;
         std::vector<std::uint32_t> m_indices;
 
+        std::uint32_t m_geometry_revision;
+
         mutable RadeonRays::bbox m_aabb;
         mutable bool m_aabb_cached;
     };
@@ -1,82 +1,375 @@
 #include "texture.h"
 
 #include "Utils/half.h"
+#include "Utils/thread_pool.h"
+
+#include <cmath>
+#include <future>
+#include <stdexcept>
+#include <vector>
 
 namespace Baikal
 {
-    RadeonRays::float3 Texture::ComputeAverageValue() const
+    namespace
     {
-        auto avg = RadeonRays::float3();
+        // Component conversions for box filter
+        inline float ToFloat(std::uint8_t value) { return value / 255.f; }
+        inline float ToFloat(std::uint16_t value) { half h; h.setBits(value); return h; }
+        inline float ToFloat(float value) { return value; }
 
-        switch (m_format) {
-        case Format::kRgba8:
+        template <typename T>
+        T FromFloat(float value);
+
+        template <>
+        inline std::uint8_t FromFloat<std::uint8_t>(float value)
+        {
+            return static_cast<std::uint8_t>(std::min(std::max(value * 255.f + 0.5f, 0.f), 255.f));
+        }
+
+        template <>
+        inline std::uint16_t FromFloat<std::uint16_t>(float value)
+        {
+            return half(value).bits();
+        }
+
+        template <>
+        inline float FromFloat<float>(float value)
         {
-            auto data = reinterpret_cast<std::uint8_t*>(m_data.get());
-            auto num_elements = m_size.x * m_size.y * m_size.z;
+            return value;
+        }
+
+        // Computes rows [y_begin, y_end) of the next mip level averaging 2x2 blocks of source level
+        template <typename T>
+        void DownsampleRows(T const* src, int src_width, int src_height, T* dst, int dst_width, int channels, int y_begin, int y_end)
+        {
+            for (auto y = y_begin; y < y_end; ++y)
+            {
+                auto y0 = std::min(2 * y, src_height - 1);
+                auto y1 = std::min(2 * y + 1, src_height - 1);
 
+                for (auto x = 0; x < dst_width; ++x)
+                {
+                    auto x0 = std::min(2 * x, src_width - 1);
+                    auto x1 = std::min(2 * x + 1, src_width - 1);
+
+                    for (auto c = 0; c < channels; ++c)
+                    {
+                        float sum = ToFloat(src[channels * (y0 * src_width + x0) + c]) +
+                            ToFloat(src[channels * (y0 * src_width + x1) + c]) +
+                            ToFloat(src[channels * (y1 * src_width + x0) + c]) +
+                            ToFloat(src[channels * (y1 * src_width + x1) + c]);
+
+                        dst[channels * (y * dst_width + x) + c] = FromFloat<T>(0.25f * sum);
+                    }
+                }
+            }
+        }
+
+        // Converts texel to RGB the same way as kernels do
+        template <typename T>
+        RadeonRays::float3 TexelToRgb(T const* texel, std::uint32_t channels)
+        {
+            float r = ToFloat(texel[0]);
+
+            switch (channels)
+            {
+            case 1:
+                return RadeonRays::float3(r, r, r);
+            case 2:
+                return RadeonRays::float3(r, ToFloat(texel[1]), 0.f);
+            default:
+                return RadeonRays::float3(r, ToFloat(texel[1]), ToFloat(texel[2]));
+            }
+        }
+
+        // Average of texels converted to RGB
+        template <typename T>
+        RadeonRays::float3 AverageTexels(T const* data, RadeonRays::int3 size, std::uint32_t channels)
+        {
+            auto avg = RadeonRays::float3();
+            auto num_elements = size.x * size.y * size.z;
 
             for (auto i = 0; i < num_elements; ++i)
             {
-                float r = data[4 * i] / 255.f;
-                float g = data[4 * i + 1] / 255.f;
-                float b = data[4 * i + 2] / 255.f;
-                avg += RadeonRays::float3(r, g, b);
+                avg += TexelToRgb(data + channels * i, channels);
             }
 
             avg *= (1.f / num_elements);
-            break;
+            return avg;
         }
-        case Format::kRgba16:
+
+        // Unpacks RGB565 endpoint of BC1 color block
+        inline RadeonRays::float3 Unpack565(std::uint16_t value)
         {
-            auto data = reinterpret_cast<std::uint16_t*>(m_data.get());
-            auto num_elements = m_size.x * m_size.y * m_size.z;
+            return RadeonRays::float3(
+                ((value >> 11) & 0x1F) / 31.f,
+                ((value >> 5) & 0x3F) / 63.f,
+                (value & 0x1F) / 31.f);
+        }
 
-            for (auto i = 0; i < num_elements; ++i)
+        // Approximate average of block compressed data using block endpoints
+        RadeonRays::float3 AverageBlockEndpoints(Texture::Format format, char const* data, RadeonRays::int3 size)
+        {
+            auto avg = RadeonRays::float3();
+            auto num_blocks = ((size.x + 3) / 4) * ((size.y + 3) / 4) * size.z;
+            auto bytes = reinterpret_cast<std::uint8_t const*>(data);
+
+            for (auto i = 0; i < num_blocks; ++i)
             {
-                auto r = data[4 * i];
-                auto g = data[4 * i + 1];
-                auto b = data[4 * i + 2];
+                switch (format)
+                {
+                case Texture::Format::kBc1:
+                case Texture::Format::kBc3:
+                {
+                    // BC3 color block follows 8 bytes of alpha block
+                    auto block = format == Texture::Format::kBc1 ? bytes + 8 * i : bytes + 16 * i + 8;
+                    auto c0 = static_cast<std::uint16_t>(block[0] | (block[1] << 8));
+                    auto c1 = static_cast<std::uint16_t>(block[2] | (block[3] << 8));
+                    avg += 0.5f * (Unpack565(c0) + Unpack565(c1));
+                    break;
+                }
+                case Texture::Format::kBc4:
+                {
+                    auto block = bytes + 8 * i;
+                    float r = 0.5f * (block[0] + block[1]) / 255.f;
+                    avg += RadeonRays::float3(r, r, r);
+                    break;
+                }
+                case Texture::Format::kBc5:
+                {
+                    auto block = bytes + 16 * i;
+                    float r = 0.5f * (block[0] + block[1]) / 255.f;
+                    float g = 0.5f * (block[8] + block[9]) / 255.f;
+                    avg += RadeonRays::float3(r, g, 0.f);
+                    break;
+                }
+                default:
+                    break;
+                }
+            }
 
-                half hr, hg, hb;
-                hr.setBits(r);
-                hg.setBits(g);
-                hb.setBits(b);
+            if (num_blocks > 0)
+            {
+                avg *= (1.f / num_blocks);
+            }
 
-                avg += RadeonRays::float3(hr, hg, hb);
+            return avg;
+        }
+
+        template <typename T>
+        void DownsampleLevel(ThreadPool* pool, char const* src, RadeonRays::int3 src_size, char* dst, RadeonRays::int3 dst_size, int channels)
+        {
+            if (!pool)
+            {
+                DownsampleRows(reinterpret_cast<T const*>(src), src_size.x, src_size.y,
+                    reinterpret_cast<T*>(dst), dst_size.x, channels, 0, dst_size.y);
+                return;
             }
 
-            avg *= (1.f / num_elements);
-            break;
+            // Split level into row ranges, several per thread to balance the load
+            int num_tasks = std::min(dst_size.y, static_cast<int>(4 * std::max(1u, std::thread::hardware_concurrency())));
+            int rows_per_task = (dst_size.y + num_tasks - 1) / num_tasks;
+
+            std::vector<std::future<void>> tasks;
+            for (auto y = 0; y < dst_size.y; y += rows_per_task)
+            {
+                auto y_end = std::min(y + rows_per_task, dst_size.y);
+                tasks.push_back(pool->Submit([=]()
+                {
+                    DownsampleRows(reinterpret_cast<T const*>(src), src_size.x, src_size.y,
+                        reinterpret_cast<T*>(dst), dst_size.x, channels, y, y_end);
+                }));
+            }
+
+            for (auto& task : tasks)
+            {
+                task.get();
+            }
         }
-        case Format::kRgba32:
+    }
+
+    void Texture::GenerateMipmaps(ThreadPool* pool)
+    {
+        // Block compressed and virtual textures are expected to come with their mip chain
+        if (m_size.z > 1 || IsBlockCompressed(m_format) || IsVirtual())
         {
-            auto data = reinterpret_cast<float*>(m_data.get());
-            auto num_elements = m_size.x * m_size.y * m_size.z;
+            return;
+        }
 
-            for (auto i = 0; i < num_elements; ++i)
+        auto mip_count = GetFullMipChainLength(m_size);
+
+        std::unique_ptr<char[]> data(new char[GetMipLevelOffset(mip_count)]);
+        std::copy(m_data.get(), m_data.get() + GetSizeInBytes(), data.get());
+
+        for (auto level = 1u; level < mip_count; ++level)
+        {
+            auto src = data.get() + GetMipLevelOffset(level - 1);
+            auto dst = data.get() + GetMipLevelOffset(level);
+            auto src_size = GetMipLevelSize(level - 1);
+            auto dst_size = GetMipLevelSize(level);
+
+            auto channels = static_cast<int>(GetChannelCount(m_format));
+
+            switch (m_format)
             {
-                auto r = data[4 * i];
-                auto g = data[4 * i + 1];
-                auto b = data[4 * i + 2];
+            case Format::kRgba8:
+            case Format::kR8:
+            case Format::kRg8:
+                DownsampleLevel<std::uint8_t>(pool, src, src_size, dst, dst_size, channels);
+                break;
+            case Format::kRgba16:
+            case Format::kR16:
+            case Format::kRg16:
+                DownsampleLevel<std::uint16_t>(pool, src, src_size, dst, dst_size, channels);
+                break;
+            case Format::kRgba32:
+            case Format::kR32:
+            case Format::kRg32:
+                DownsampleLevel<float>(pool, src, src_size, dst, dst_size, channels);
+                break;
+            default:
+                break;
+            }
+        }
+
+        m_data = std::move(data);
+        m_mip_count = mip_count;
+        SetDirty(true);
+    }
 
-                avg += RadeonRays::float3(r, g, b);
+    RadeonRays::float3 Texture::ComputeAverageValue() const
+    {
+        if (IsVirtual())
+        {
+            // Use the coarsest level if it fits into a single tile
+            auto level = m_mip_count - 1;
+            auto size = GetMipLevelSize(level);
+            if (size.x > static_cast<int>(kTileSize) || size.y > static_cast<int>(kTileSize))
+            {
+                return RadeonRays::float3();
             }
 
-            avg *= (1.f / num_elements);
-            break;
+            std::unique_ptr<char[]> tile(new char[GetTileSizeInBytes()]);
+            m_tile_source->LoadTile(level, 0, 0, tile.get());
+
+            // Repack tile rows into a temporary texture
+            auto row_height = IsBlockCompressed(m_format) ? 4 : 1;
+            auto tile_row_size = GetImageSizeInBytes(m_format, RadeonRays::int3(kTileSize, row_height, 1));
+            auto row_size = GetImageSizeInBytes(m_format, RadeonRays::int3(size.x, row_height, 1));
+            auto num_rows = (size.y + row_height - 1) / row_height;
+
+            auto data = new char[row_size * num_rows];
+            for (auto row = 0; row < num_rows; ++row)
+            {
+                std::copy(tile.get() + row * tile_row_size, tile.get() + row * tile_row_size + row_size, data + row * row_size);
+            }
+
+            return Create(data, size, m_format)->ComputeAverageValue();
         }
+
+        auto avg = RadeonRays::float3();
+
+        switch (m_format) {
+        case Format::kRgba8:
+        case Format::kR8:
+        case Format::kRg8:
+            avg = AverageTexels(reinterpret_cast<std::uint8_t const*>(m_data.get()), m_size, GetChannelCount(m_format));
+            break;
+        case Format::kRgba16:
+        case Format::kR16:
+        case Format::kRg16:
+            avg = AverageTexels(reinterpret_cast<std::uint16_t const*>(m_data.get()), m_size, GetChannelCount(m_format));
+            break;
+        case Format::kRgba32:
+        case Format::kR32:
+        case Format::kRg32:
+            avg = AverageTexels(reinterpret_cast<float const*>(m_data.get()), m_size, GetChannelCount(m_format));
+            break;
         default:
+            // Block compressed: average of block endpoints
+            avg = AverageBlockEndpoints(m_format, m_data.get(), m_size);
             break;
         }
 
         return avg;
     }
 
+    RadeonRays::float3 Texture::GetTexel(int x, int y, std::uint32_t level) const
+    {
+        if (IsVirtual() || IsBlockCompressed(m_format))
+        {
+            throw std::runtime_error("Texture::GetTexel(...): texel access is not supported for this texture");
+        }
+
+        auto size = GetMipLevelSize(level);
+        auto channels = GetChannelCount(m_format);
+        auto index = static_cast<std::size_t>(y) * size.x + x;
+        auto data = m_data.get() + GetMipLevelOffset(level);
+
+        switch (m_format)
+        {
+        case Format::kRgba8:
+        case Format::kR8:
+        case Format::kRg8:
+            return TexelToRgb(reinterpret_cast<std::uint8_t const*>(data) + channels * index, channels);
+        case Format::kRgba16:
+        case Format::kR16:
+        case Format::kRg16:
+            return TexelToRgb(reinterpret_cast<std::uint16_t const*>(data) + channels * index, channels);
+        default:
+            return TexelToRgb(reinterpret_cast<float const*>(data) + channels * index, channels);
+        }
+    }
+
     namespace {
+        // Streams tiles of virtual texture from resident one
+        class MemoryTileSource : public TextureTileSource
+        {
+        public:
+            explicit MemoryTileSource(Texture::Ptr texture)
+                : m_texture(texture)
+            {
+            }
+
+            void LoadTile(std::uint32_t level, std::uint32_t tile_x, std::uint32_t tile_y, char* dst) const override
+            {
+                auto format = m_texture->GetFormat();
+                auto size = m_texture->GetMipLevelSize(level);
+                auto tile_size = static_cast<int>(Texture::kTileSize);
+                auto x = static_cast<int>(tile_x) * tile_size;
+                auto y = static_cast<int>(tile_y) * tile_size;
+
+                if (x >= size.x || y >= size.y)
+                {
+                    throw std::runtime_error("MemoryTileSource: tile is out of range");
+                }
+
+                // Copy rows of texels or rows of 4x4 blocks for block compressed formats
+                auto row_height = Texture::IsBlockCompressed(format) ? 4 : 1;
+                auto src_row_size = Texture::GetImageSizeInBytes(format, RadeonRays::int3(size.x, row_height, 1));
+                auto dst_row_size = Texture::GetImageSizeInBytes(format, RadeonRays::int3(tile_size, row_height, 1));
+                auto x_offset = Texture::GetImageSizeInBytes(format, RadeonRays::int3(x, row_height, 1));
+                auto copy_size = Texture::GetImageSizeInBytes(format, RadeonRays::int3(std::min(tile_size, size.x - x), row_height, 1));
+                auto num_rows = (std::min(tile_size, size.y - y) + row_height - 1) / row_height;
+
+                auto src = m_texture->GetData() + m_texture->GetMipLevelOffset(level) + src_row_size * (y / row_height) + x_offset;
+
+                for (auto row = 0; row < num_rows; ++row)
+                {
+                    std::copy(src + row * src_row_size, src + row * src_row_size + copy_size, dst + row * dst_row_size);
+                }
+            }
+
+        private:
+            Texture::Ptr m_texture;
+        };
+
         struct TextureConcrete : public Texture {
             TextureConcrete() = default;
-            TextureConcrete(char* data, RadeonRays::int3 size, Format format) :
-                Texture(data, size, format) {}
+            TextureConcrete(char* data, RadeonRays::int3 size, Format format, std::uint32_t mip_count) :
+                Texture(data, size, format, mip_count) {}
+            TextureConcrete(RadeonRays::int3 size, Format format, std::uint32_t mip_count, std::shared_ptr<TextureTileSource> source) :
+                Texture(size, format, mip_count, source) {}
         };
     }
 
@@ -84,7 +377,29 @@ namespace Baikal
         return std::make_shared<TextureConcrete>();
     }
 
-    Texture::Ptr Texture::Create(char* data, RadeonRays::int3 size, Format format) {
-        return std::make_shared<TextureConcrete>(data, size, format);
+    Texture::Ptr Texture::Create(char* data, RadeonRays::int3 size, Format format, std::uint32_t mip_count) {
+        return std::make_shared<TextureConcrete>(data, size, format, mip_count);
+    }
+
+    Texture::Ptr Texture::CreateVirtual(RadeonRays::int3 size, Format format, std::uint32_t mip_count, std::shared_ptr<TextureTileSource> source) {
+        if (size.z > 1)
+        {
+            throw std::runtime_error("Texture: virtual 3D textures are not supported");
+        }
+
+        std::uint32_t num_levels = mip_count < kMaxMipLevels ? mip_count : kMaxMipLevels;
+        return std::make_shared<TextureConcrete>(size, format, num_levels, source);
+    }
+
+    Texture::Ptr Texture::CreateVirtual(Texture::Ptr texture) {
+        if (texture->IsVirtual())
+        {
+            return texture;
+        }
+
+        auto result = CreateVirtual(texture->GetSize(), texture->GetFormat(), texture->GetMipLevelCount(),
+            std::make_shared<MemoryTileSource>(texture));
+        result->SetName(texture->GetName());
+        return result;
     }
 }
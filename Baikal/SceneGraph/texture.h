@@ -30,7 +30,10 @@
 
 #include "math/float3.h"
 #include "math/float2.h"
+#include "math/int2.h"
 #include "math/int3.h"
+#include <algorithm>
+#include <cstdint>
 #include <memory>
 #include <string>
 
@@ -39,6 +42,24 @@
 namespace Baikal
 {
     class Material;
+    class ThreadPool;
+
+    /**
+     \brief Source of tile data for virtual textures.
+
+     Virtual textures keep no image data in memory, the renderer requests
+     tiles of Texture::kTileSize x Texture::kTileSize texels when it needs them.
+     LoadTile might be called from several threads concurrently.
+     */
+    class TextureTileSource
+    {
+    public:
+        virtual ~TextureTileSource() = default;
+
+        // Write tile of mip level to dst. Tile rows are kTileSize texels wide (kTileSize / 4 blocks
+        // for block compressed formats), texels outside of the level are left undefined.
+        virtual void LoadTile(std::uint32_t level, std::uint32_t tile_x, std::uint32_t tile_y, char* dst) const = 0;
+    };
 
     /**
      \brief Texture class.
@@ -52,18 +73,53 @@ namespace Baikal
         {
             kRgba8,
             kRgba16,
-            kRgba32
+            kRgba32,
+            // Single and two channel formats, 8 bit unorm, half and float.
+            // Single channel textures are sampled as (r, r, r, r), two channel as (r, g, 0, 0).
+            kR8,
+            kRg8,
+            kR16,
+            kRg16,
+            kR32,
+            kRg32,
+            // Block compressed formats, data is stored in 4x4 blocks:
+            // BC1 - RGB 8 bytes per block, BC3 - RGBA 16 bytes per block,
+            // BC4 - R 8 bytes per block, BC5 - RG 16 bytes per block.
+            kBc1,
+            kBc3,
+            kBc4,
+            kBc5
         };
 
+        // Maximum number of mip levels including level 0, should match TEXTURE_MAX_MIP_LEVELS in payload.cl
+        static std::uint32_t constexpr kMaxMipLevels = 16;
+        // Tile size of virtual textures in texels, should match TEXTURE_VT_TILE_SIZE in payload.cl
+        static std::uint32_t constexpr kTileSize = 128;
+
         using Ptr = std::shared_ptr<Texture>;
-        static Ptr Create(char* data, RadeonRays::int3 size, Format format);
+        static Ptr Create(char* data, RadeonRays::int3 size, Format format, std::uint32_t mip_count = 1);
         static Ptr Create();
 
+        /**
+         \brief Create virtual texture.
+
+         Virtual texture does not host its data, tiles are streamed from the source
+         on demand by the renderer.
+
+         \param size Dimensions of level 0, only 2D textures are supported.
+         \param format Format of tile data.
+         \param mip_count Number of mip levels provided by the source.
+         \param source Tile source.
+         */
+        static Ptr CreateVirtual(RadeonRays::int3 size, Format format, std::uint32_t mip_count, std::shared_ptr<TextureTileSource> source);
+        // Create virtual texture streaming tiles from CPU memory of resident texture
+        static Ptr CreateVirtual(Ptr texture);
+
         // Destructor (the data is destroyed as well)
         virtual ~Texture() = default;
 
-        // Set data
-        void SetData(char* data, RadeonRays::int3 size, Format format);
+        // Set data, mip levels (if any) should follow level 0 in data array
+        void SetData(char* data, RadeonRays::int3 size, Format format, std::uint32_t mip_count = 1);
 
         // Get texture dimensions
         RadeonRays::int3 GetSize() const;
@@ -71,11 +127,49 @@ namespace Baikal
         char const* GetData() const;
         // Get texture format
         Format GetFormat() const;
-        // Get data size in bytes
+        // Get data size in bytes (level 0 only)
         std::size_t GetSizeInBytes() const;
 
+        /**
+         \brief Generate mip chain using box filter.
+
+         Levels are stored contiguously after level 0 in texture data array.
+         If pool is given, rows of each level are computed on its threads.
+         Only 2D textures are supported, for 3D textures the call is ignored.
+         */
+        void GenerateMipmaps(ThreadPool* pool = nullptr);
+        // Get number of mip levels, 1 if texture has no mips
+        std::uint32_t GetMipLevelCount() const;
+        // Get number of levels in full mip chain for given dimensions
+        static std::uint32_t GetFullMipChainLength(RadeonRays::int3 size);
+        // Get dimensions of mip level
+        RadeonRays::int3 GetMipLevelSize(std::uint32_t level) const;
+        // Get offset of mip level in bytes from the start of data array
+        std::size_t GetMipLevelOffset(std::uint32_t level) const;
+        // Get size of data including all mip levels in bytes
+        std::size_t GetMipChainSizeInBytes() const;
+
         // Average normalized value
         RadeonRays::float3 ComputeAverageValue() const;
+        // Texel of 2D mip level converted to RGB the same way as kernels do.
+        // Throws for block compressed and virtual textures.
+        RadeonRays::float3 GetTexel(int x, int y, std::uint32_t level = 0) const;
+
+        // Check if texture is virtual, GetData returns nullptr for virtual textures
+        bool IsVirtual() const;
+        // Get tile source of virtual texture
+        std::shared_ptr<TextureTileSource> GetTileSource() const;
+        // Get number of tiles covering mip level
+        RadeonRays::int2 GetMipLevelTileCount(std::uint32_t level) const;
+        // Get size of single tile in bytes
+        std::size_t GetTileSizeInBytes() const;
+
+        // Check if format stores data in 4x4 blocks
+        static bool IsBlockCompressed(Format format);
+        // Get number of channels stored by format
+        static std::uint32_t GetChannelCount(Format format);
+        // Get size of single image (or mip level) of given dimensions in bytes
+        static std::size_t GetImageSizeInBytes(Format format, RadeonRays::int3 size);
 
         // Disallow copying
         Texture(Texture const&) = delete;
@@ -85,21 +179,28 @@ namespace Baikal
         // Constructor
         Texture();
         // Note, that texture takes ownership of its data array
-        Texture(char* data, RadeonRays::int3 size, Format format);
+        Texture(char* data, RadeonRays::int3 size, Format format, std::uint32_t mip_count = 1);
+        // Virtual texture
+        Texture(RadeonRays::int3 size, Format format, std::uint32_t mip_count, std::shared_ptr<TextureTileSource> source);
 
     private:
-        // Image data
+        // Image data, mip levels follow level 0
         std::unique_ptr<char[]> m_data;
         // Image dimensions
         RadeonRays::int3 m_size;
         // Format
         Format m_format;
+        // Number of mip levels
+        std::uint32_t m_mip_count;
+        // Tile source, nullptr for resident textures
+        std::shared_ptr<TextureTileSource> m_tile_source;
     };
 
     inline Texture::Texture()
         : m_data(new char[16])
         , m_size(2, 2, 1)
         , m_format(Format::kRgba8)
+        , m_mip_count(1)
     {
         // Create checkerboard by default
         m_data[0] = m_data[1] = m_data[2] = m_data[3] = (char)0xFF;
@@ -108,10 +209,11 @@ namespace Baikal
         m_data[12] = m_data[13] = m_data[14] = m_data[15] = (char)0x00;
     }
 
-    inline Texture::Texture(char* data, RadeonRays::int3 size, Format format)
+    inline Texture::Texture(char* data, RadeonRays::int3 size, Format format, std::uint32_t mip_count)
         : m_data(data)
         , m_size(size)
         , m_format(format)
+        , m_mip_count(mip_count)
     {
         if (size.z == 0)
         {
@@ -119,7 +221,15 @@ namespace Baikal
         }
     }
 
-    inline void Texture::SetData(char* data, RadeonRays::int3 size, Format format)
+    inline Texture::Texture(RadeonRays::int3 size, Format format, std::uint32_t mip_count, std::shared_ptr<TextureTileSource> source)
+        : m_size(size.x, size.y, 1)
+        , m_format(format)
+        , m_mip_count(mip_count)
+        , m_tile_source(source)
+    {
+    }
+
+    inline void Texture::SetData(char* data, RadeonRays::int3 size, Format format, std::uint32_t mip_count)
     {
         m_data.reset(data);
         m_size = size;
@@ -130,6 +240,8 @@ namespace Baikal
         }
 
         m_format = format;
+        m_mip_count = mip_count;
+        m_tile_source.reset();
         SetDirty(true);
     }
 
@@ -148,24 +260,138 @@ namespace Baikal
         return m_format;
     }
 
-    inline std::size_t Texture::GetSizeInBytes() const
+    inline bool Texture::IsVirtual() const
     {
-        std::uint32_t component_size = 1;
+        return m_tile_source != nullptr;
+    }
 
-        switch (m_format) {
-        case Format::kRgba8:
-            component_size = 1;
-            break;
+    inline std::shared_ptr<TextureTileSource> Texture::GetTileSource() const
+    {
+        return m_tile_source;
+    }
+
+    inline RadeonRays::int2 Texture::GetMipLevelTileCount(std::uint32_t level) const
+    {
+        auto size = GetMipLevelSize(level);
+        int tile_size = static_cast<int>(kTileSize);
+        return RadeonRays::int2((size.x + tile_size - 1) / tile_size, (size.y + tile_size - 1) / tile_size);
+    }
+
+    inline std::size_t Texture::GetTileSizeInBytes() const
+    {
+        return GetImageSizeInBytes(m_format, RadeonRays::int3(kTileSize, kTileSize, 1));
+    }
+
+    inline std::uint32_t Texture::GetFullMipChainLength(RadeonRays::int3 size)
+    {
+        std::uint32_t mip_count = 1;
+        while (mip_count < kMaxMipLevels && ((size.x >> (mip_count - 1)) > 1 || (size.y >> (mip_count - 1)) > 1))
+        {
+            ++mip_count;
+        }
+        return mip_count;
+    }
+
+    inline bool Texture::IsBlockCompressed(Format format)
+    {
+        switch (format)
+        {
+        case Format::kBc1:
+        case Format::kBc3:
+        case Format::kBc4:
+        case Format::kBc5:
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    inline std::uint32_t Texture::GetChannelCount(Format format)
+    {
+        switch (format)
+        {
+        case Format::kR8:
+        case Format::kR16:
+        case Format::kR32:
+        case Format::kBc4:
+            return 1;
+        case Format::kRg8:
+        case Format::kRg16:
+        case Format::kRg32:
+        case Format::kBc5:
+            return 2;
+        case Format::kBc1:
+            return 3;
+        default:
+            return 4;
+        }
+    }
+
+    inline std::size_t Texture::GetImageSizeInBytes(Format format, RadeonRays::int3 size)
+    {
+        std::size_t depth = std::max(size.z, 1);
+
+        if (IsBlockCompressed(format))
+        {
+            std::size_t block_size = (format == Format::kBc1 || format == Format::kBc4) ? 8 : 16;
+            std::size_t blocks_x = (size.x + 3) / 4;
+            std::size_t blocks_y = (size.y + 3) / 4;
+            return block_size * blocks_x * blocks_y * depth;
+        }
+
+        std::size_t component_size = 1;
+
+        switch (format)
+        {
         case Format::kRgba16:
+        case Format::kR16:
+        case Format::kRg16:
             component_size = 2;
             break;
         case Format::kRgba32:
+        case Format::kR32:
+        case Format::kRg32:
             component_size = 4;
             break;
         default:
             break;
         }
 
-        return 4 * component_size * m_size.x * m_size.y * m_size.z;
+        return GetChannelCount(format) * component_size * size.x * size.y * depth;
+    }
+
+    inline std::size_t Texture::GetSizeInBytes() const
+    {
+        return GetImageSizeInBytes(m_format, m_size);
+    }
+
+    inline std::uint32_t Texture::GetMipLevelCount() const
+    {
+        return m_mip_count;
+    }
+
+    inline RadeonRays::int3 Texture::GetMipLevelSize(std::uint32_t level) const
+    {
+        return RadeonRays::int3(
+            std::max(m_size.x >> level, 1),
+            std::max(m_size.y >> level, 1),
+            m_size.z);
+    }
+
+    inline std::size_t Texture::GetMipLevelOffset(std::uint32_t level) const
+    {
+        std::size_t offset = 0;
+
+        for (auto i = 0u; i < level; ++i)
+        {
+            offset += GetImageSizeInBytes(m_format, GetMipLevelSize(i));
+        }
+
+        return offset;
+    }
+
+    inline std::size_t Texture::GetMipChainSizeInBytes() const
+    {
+        return GetMipLevelOffset(m_mip_count);
     }
 }
@@ -0,0 +1,217 @@
+/**********************************************************************
+ Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ********************************************************************/
+#include "volume_grid.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace Baikal
+{
+    namespace
+    {
+        RadeonRays::int3 GetBrickCountForResolution(RadeonRays::int3 resolution)
+        {
+            auto const brick_size = static_cast<int>(VolumeGrid::kBrickSize);
+            return RadeonRays::int3(
+                (resolution.x + brick_size - 1) / brick_size,
+                (resolution.y + brick_size - 1) / brick_size,
+                (resolution.z + brick_size - 1) / brick_size);
+        }
+    }
+
+    VolumeGrid::VolumeGrid(RadeonRays::int3 resolution,
+                           std::vector<std::int32_t> brick_table, std::vector<float> bricks,
+                           RadeonRays::float3 const& bbox_min, RadeonRays::float3 const& bbox_max)
+        : m_resolution(resolution)
+        , m_brick_count(GetBrickCountForResolution(resolution))
+        , m_bbox_min(bbox_min)
+        , m_bbox_max(bbox_max)
+        , m_brick_table(std::move(brick_table))
+        , m_bricks(std::move(bricks))
+        , m_max_density(0.f)
+    {
+        if (resolution.x <= 0 || resolution.y <= 0 || resolution.z <= 0)
+        {
+            throw std::runtime_error("VolumeGrid: invalid resolution");
+        }
+
+        if (!(bbox_min.x < bbox_max.x && bbox_min.y < bbox_max.y && bbox_min.z < bbox_max.z))
+        {
+            throw std::runtime_error("VolumeGrid: invalid bounds");
+        }
+
+        auto num_bricks = static_cast<std::size_t>(m_brick_count.x) * m_brick_count.y * m_brick_count.z;
+        auto num_stored = static_cast<std::int32_t>(m_bricks.size() / kBrickVoxels);
+
+        if (m_brick_table.size() != num_bricks || m_bricks.size() % kBrickVoxels)
+        {
+            throw std::runtime_error("VolumeGrid: brick data does not match resolution");
+        }
+
+        for (auto index : m_brick_table)
+        {
+            if (index != kEmptyBrick && (index < 0 || index >= num_stored))
+            {
+                throw std::runtime_error("VolumeGrid: invalid brick index");
+            }
+        }
+
+        BuildMajorants();
+    }
+
+    float VolumeGrid::GetVoxel(int x, int y, int z) const
+    {
+        if (x < 0 || y < 0 || z < 0 ||
+            x >= m_resolution.x || y >= m_resolution.y || z >= m_resolution.z)
+        {
+            return 0.f;
+        }
+
+        auto const brick_size = static_cast<int>(kBrickSize);
+        auto brick = m_brick_table[((z / brick_size) * m_brick_count.y + y / brick_size) * m_brick_count.x + x / brick_size];
+
+        if (brick == kEmptyBrick)
+        {
+            return 0.f;
+        }
+
+        auto voxel = ((z % brick_size) * brick_size + y % brick_size) * brick_size + x % brick_size;
+        return m_bricks[brick * kBrickVoxels + voxel];
+    }
+
+    void VolumeGrid::BuildMajorants()
+    {
+        auto const brick_size = static_cast<int>(kBrickSize);
+
+        m_majorants.resize(m_brick_table.size());
+        m_max_density = 0.f;
+
+        for (auto bz = 0; bz < m_brick_count.z; ++bz)
+        {
+            for (auto by = 0; by < m_brick_count.y; ++by)
+            {
+                for (auto bx = 0; bx < m_brick_count.x; ++bx)
+                {
+                    // Trilinear interpolation inside of a brick touches one voxel
+                    // of every neighbour, so majorant covers them as well
+                    float majorant = 0.f;
+                    for (auto z = bz * brick_size - 1; z <= (bz + 1) * brick_size; ++z)
+                    {
+                        for (auto y = by * brick_size - 1; y <= (by + 1) * brick_size; ++y)
+                        {
+                            for (auto x = bx * brick_size - 1; x <= (bx + 1) * brick_size; ++x)
+                            {
+                                majorant = std::max(majorant, GetVoxel(x, y, z));
+                            }
+                        }
+                    }
+
+                    m_majorants[(bz * m_brick_count.y + by) * m_brick_count.x + bx] = majorant;
+                    m_max_density = std::max(m_max_density, majorant);
+                }
+            }
+        }
+    }
+
+    namespace
+    {
+        struct VolumeGridConcrete : public VolumeGrid
+        {
+            VolumeGridConcrete(RadeonRays::int3 resolution,
+                               std::vector<std::int32_t> brick_table, std::vector<float> bricks,
+                               RadeonRays::float3 const& bbox_min, RadeonRays::float3 const& bbox_max)
+                : VolumeGrid(resolution, std::move(brick_table), std::move(bricks), bbox_min, bbox_max)
+            {}
+        };
+    }
+
+    VolumeGrid::Ptr VolumeGrid::Create(RadeonRays::int3 resolution, float const* density,
+                                       RadeonRays::float3 const& bbox_min, RadeonRays::float3 const& bbox_max)
+    {
+        if (resolution.x <= 0 || resolution.y <= 0 || resolution.z <= 0)
+        {
+            throw std::runtime_error("VolumeGrid: invalid resolution");
+        }
+
+        auto const brick_size = static_cast<int>(kBrickSize);
+        auto brick_count = GetBrickCountForResolution(resolution);
+
+        std::vector<std::int32_t> brick_table;
+        std::vector<float> bricks;
+        std::vector<float> brick(kBrickVoxels);
+
+        brick_table.reserve(static_cast<std::size_t>(brick_count.x) * brick_count.y * brick_count.z);
+
+        for (auto bz = 0; bz < brick_count.z; ++bz)
+        {
+            for (auto by = 0; by < brick_count.y; ++by)
+            {
+                for (auto bx = 0; bx < brick_count.x; ++bx)
+                {
+                    bool empty = true;
+
+                    for (auto z = 0; z < brick_size; ++z)
+                    {
+                        for (auto y = 0; y < brick_size; ++y)
+                        {
+                            for (auto x = 0; x < brick_size; ++x)
+                            {
+                                auto vx = bx * brick_size + x;
+                                auto vy = by * brick_size + y;
+                                auto vz = bz * brick_size + z;
+
+                                float value = 0.f;
+                                if (vx < resolution.x && vy < resolution.y && vz < resolution.z)
+                                {
+                                    auto idx = (static_cast<std::size_t>(vz) * resolution.y + vy) * resolution.x + vx;
+                                    value = std::max(density[idx], 0.f);
+                                }
+
+                                brick[(z * brick_size + y) * brick_size + x] = value;
+                                empty = empty && value == 0.f;
+                            }
+                        }
+                    }
+
+                    if (empty)
+                    {
+                        brick_table.push_back(kEmptyBrick);
+                    }
+                    else
+                    {
+                        brick_table.push_back(static_cast<std::int32_t>(bricks.size() / kBrickVoxels));
+                        bricks.insert(bricks.end(), brick.cbegin(), brick.cend());
+                    }
+                }
+            }
+        }
+
+        return std::make_shared<VolumeGridConcrete>(resolution, std::move(brick_table), std::move(bricks), bbox_min, bbox_max);
+    }
+
+    VolumeGrid::Ptr VolumeGrid::Create(RadeonRays::int3 resolution,
+                                       std::vector<std::int32_t> brick_table, std::vector<float> bricks,
+                                       RadeonRays::float3 const& bbox_min, RadeonRays::float3 const& bbox_max)
+    {
+        return std::make_shared<VolumeGridConcrete>(resolution, std::move(brick_table), std::move(bricks), bbox_min, bbox_max);
+    }
+}
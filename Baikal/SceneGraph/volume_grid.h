@@ -0,0 +1,129 @@
+/**********************************************************************
+ Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ********************************************************************/
+ /**
+  \file volume_grid.h
+  \version 1.0
+  \brief Contains declaration of sparse density grid for heterogeneous volumes.
+  */
+#pragma once
+
+#include "math/float3.h"
+#include "math/int3.h"
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "scene_object.h"
+
+namespace Baikal
+{
+    /**
+     \brief Sparse voxel grid of volume density.
+
+     Grid covers axis aligned box in world space with resolution voxels along each axis,
+     voxel values are defined at voxel centers and interpolated trilinearly.
+     Voxels are grouped into bricks of kBrickSize^3, only bricks with non-zero
+     density are stored. Grid also keeps coarse majorant grid with maximum
+     interpolated density for every brick, which is used by tracking kernels to
+     take large steps through empty and thin regions.
+
+     Grid data is immutable, create another grid to change it.
+     */
+    class VolumeGrid : public SceneObject
+    {
+    public:
+        // Brick size in voxels, should match VOLUME_BRICK_SIZE in payload.cl
+        static std::uint32_t constexpr kBrickSize = 8;
+        // Number of voxels in a brick
+        static std::uint32_t constexpr kBrickVoxels = kBrickSize * kBrickSize * kBrickSize;
+        // Empty entry in brick table
+        static std::int32_t constexpr kEmptyBrick = -1;
+
+        using Ptr = std::shared_ptr<VolumeGrid>;
+
+        /**
+         \brief Create grid from dense density array.
+
+         \param resolution Number of voxels along each axis.
+         \param density resolution.x * resolution.y * resolution.z values, x changes fastest.
+         \param bbox_min Minimum corner of the grid in world space.
+         \param bbox_max Maximum corner of the grid in world space.
+         */
+        static Ptr Create(RadeonRays::int3 resolution, float const* density,
+                          RadeonRays::float3 const& bbox_min, RadeonRays::float3 const& bbox_max);
+
+        /**
+         \brief Create grid from bricks.
+
+         \param resolution Number of voxels along each axis.
+         \param brick_table Index of every brick in bricks array or kEmptyBrick, x changes fastest.
+         \param bricks kBrickVoxels values for every stored brick, x changes fastest.
+         \param bbox_min Minimum corner of the grid in world space.
+         \param bbox_max Maximum corner of the grid in world space.
+         */
+        static Ptr Create(RadeonRays::int3 resolution,
+                          std::vector<std::int32_t> brick_table, std::vector<float> bricks,
+                          RadeonRays::float3 const& bbox_min, RadeonRays::float3 const& bbox_max);
+
+        // Number of voxels along each axis
+        RadeonRays::int3 GetResolution() const { return m_resolution; }
+        // Number of bricks along each axis
+        RadeonRays::int3 GetBrickCount() const { return m_brick_count; }
+        // World space bounds
+        RadeonRays::float3 GetBboxMin() const { return m_bbox_min; }
+        RadeonRays::float3 GetBboxMax() const { return m_bbox_max; }
+
+        // Brick table and brick data, see Create
+        std::vector<std::int32_t> const& GetBrickTable() const { return m_brick_table; }
+        std::vector<float> const& GetBricks() const { return m_bricks; }
+        // Maximum density in the region of every brick
+        std::vector<float> const& GetMajorants() const { return m_majorants; }
+        // Maximum density in the grid
+        float GetMaxDensity() const { return m_max_density; }
+
+        // Density of voxel, zero outside of the grid
+        float GetVoxel(int x, int y, int z) const;
+        // Number of stored (non-empty) bricks
+        std::size_t GetStoredBrickCount() const { return m_bricks.size() / kBrickVoxels; }
+
+        // Disallow copying
+        VolumeGrid(VolumeGrid const&) = delete;
+        VolumeGrid& operator = (VolumeGrid const&) = delete;
+
+    protected:
+        VolumeGrid(RadeonRays::int3 resolution,
+                   std::vector<std::int32_t> brick_table, std::vector<float> bricks,
+                   RadeonRays::float3 const& bbox_min, RadeonRays::float3 const& bbox_max);
+
+    private:
+        void BuildMajorants();
+
+        RadeonRays::int3 m_resolution;
+        RadeonRays::int3 m_brick_count;
+        RadeonRays::float3 m_bbox_min;
+        RadeonRays::float3 m_bbox_max;
+        std::vector<std::int32_t> m_brick_table;
+        std::vector<float> m_bricks;
+        std::vector<float> m_majorants;
+        float m_max_density;
+    };
+}
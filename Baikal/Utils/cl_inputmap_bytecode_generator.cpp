@@ -0,0 +1,248 @@
+/**********************************************************************
+Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+
+#include <assert.h>
+
+#include <algorithm>
+#include <array>
+#include <map>
+#include <stdexcept>
+
+#include "cl_inputmap_bytecode_generator.h"
+#include "SceneGraph/inputmaps.h"
+
+
+using namespace Baikal;
+
+void CLInputMapBytecodeGenerator::Generate(const Collector& input_map_collector, const Collector& input_map_leaf_collector, std::uint32_t base_offset)
+{
+    m_bytecode.clear();
+    m_offsets.clear();
+
+    // We need to guarantee order. So sort it by id using map
+    std::map <uint32_t, InputMap::Ptr> inputs;
+
+    auto input_iter = input_map_collector.CreateIterator();
+    for (; input_iter->IsValid(); input_iter->Next())
+    {
+        auto input = input_iter->ItemAs<InputMap>();
+        inputs.insert(std::make_pair(input->GetId(), input));
+    }
+
+    for (auto &input : inputs)
+    {
+        auto offset = static_cast<std::int32_t>(base_offset + m_bytecode.size());
+
+        if (GenerateInputBytecode(input.second, input_map_leaf_collector) > kMaxStackDepth)
+        {
+            throw std::runtime_error("CLInputMapBytecodeGenerator: input map is too deep to be interpreted");
+        }
+
+        Emit(ClwScene::kInputMapOpReturn);
+        m_offsets[input.first] = offset;
+    }
+}
+
+std::int32_t CLInputMapBytecodeGenerator::GetOffset(std::uint32_t input_map_id) const
+{
+    auto it = m_offsets.find(input_map_id);
+    return it != m_offsets.end() ? it->second : -1;
+}
+
+void CLInputMapBytecodeGenerator::Emit(ClwScene::InputMapOpcode op, std::int32_t arg)
+{
+    ClwScene::InputMapData instruction = {};
+    instruction.int_values.idx = op;
+    instruction.int_values.placeholder[0] = arg;
+    m_bytecode.push_back(instruction);
+}
+
+static std::int32_t PackShuffleMask(std::array<uint32_t, 4> const& mask)
+{
+    return static_cast<std::int32_t>(mask[0] | (mask[1] << 4) | (mask[2] << 8) | (mask[3] << 12));
+}
+
+template <class T>
+std::uint32_t CLInputMapBytecodeGenerator::GenerateOneArg(std::shared_ptr<Baikal::InputMap> input, ClwScene::InputMapOpcode op, const Collector& input_map_leaf_collector)
+{
+    T *i = static_cast<T*>(input.get());
+    auto depth = GenerateInputBytecode(i->GetArg(), input_map_leaf_collector);
+    Emit(op);
+    return depth;
+}
+
+template <class T>
+std::uint32_t CLInputMapBytecodeGenerator::GenerateTwoArg(std::shared_ptr<Baikal::InputMap> input, ClwScene::InputMapOpcode op, const Collector& input_map_leaf_collector)
+{
+    T *i = static_cast<T*>(input.get());
+    // b is evaluated while a occupies a stack slot
+    auto depth = std::max(GenerateInputBytecode(i->GetA(), input_map_leaf_collector),
+                          GenerateInputBytecode(i->GetB(), input_map_leaf_collector) + 1);
+    Emit(op);
+    return depth;
+}
+
+std::uint32_t CLInputMapBytecodeGenerator::GenerateInputBytecode(std::shared_ptr<Baikal::InputMap> input, const Collector& input_map_leaf_collector)
+{
+    // Arguments are evaluated left to right, each one occupies a stack slot
+    // while the following ones are being evaluated.
+    auto generate_args = [&](std::initializer_list<InputMap::Ptr> args)
+    {
+        std::uint32_t depth = 0;
+        std::uint32_t slot = 0;
+        for (auto const& arg : args)
+        {
+            depth = std::max(depth, slot + GenerateInputBytecode(arg, input_map_leaf_collector));
+            ++slot;
+        }
+        return depth;
+    };
+
+    switch (input->m_type)
+    {
+        case InputMap::InputMapType::kConstantFloat:
+        case InputMap::InputMapType::kConstantFloat3:
+        {
+            Emit(ClwScene::kInputMapOpConstant, input_map_leaf_collector.GetItemIndex(input));
+            return 1;
+        }
+        case InputMap::InputMapType::kSampler:
+        {
+            Emit(ClwScene::kInputMapOpSampler, input_map_leaf_collector.GetItemIndex(input));
+            return 1;
+        }
+        case InputMap::InputMapType::kSamplerBumpmap:
+        {
+            Emit(ClwScene::kInputMapOpSamplerBumpmap, input_map_leaf_collector.GetItemIndex(input));
+            return 1;
+        }
+        // Two inputs
+        case InputMap::InputMapType::kAdd:
+            return GenerateTwoArg<InputMap_Add>(input, ClwScene::kInputMapOpAdd, input_map_leaf_collector);
+        case InputMap::InputMapType::kSub:
+            return GenerateTwoArg<InputMap_Sub>(input, ClwScene::kInputMapOpSub, input_map_leaf_collector);
+        case InputMap::InputMapType::kMul:
+            return GenerateTwoArg<InputMap_Mul>(input, ClwScene::kInputMapOpMul, input_map_leaf_collector);
+        case InputMap::InputMapType::kDiv:
+            return GenerateTwoArg<InputMap_Div>(input, ClwScene::kInputMapOpDiv, input_map_leaf_collector);
+        case InputMap::InputMapType::kMin:
+            return GenerateTwoArg<InputMap_Min>(input, ClwScene::kInputMapOpMin, input_map_leaf_collector);
+        case InputMap::InputMapType::kMax:
+            return GenerateTwoArg<InputMap_Max>(input, ClwScene::kInputMapOpMax, input_map_leaf_collector);
+        case InputMap::InputMapType::kDot3:
+            return GenerateTwoArg<InputMap_Dot3>(input, ClwScene::kInputMapOpDot3, input_map_leaf_collector);
+        case InputMap::InputMapType::kDot4:
+            return GenerateTwoArg<InputMap_Dot4>(input, ClwScene::kInputMapOpDot4, input_map_leaf_collector);
+        case InputMap::InputMapType::kCross3:
+            return GenerateTwoArg<InputMap_Cross3>(input, ClwScene::kInputMapOpCross3, input_map_leaf_collector);
+        case InputMap::InputMapType::kCross4:
+            return GenerateTwoArg<InputMap_Cross4>(input, ClwScene::kInputMapOpCross4, input_map_leaf_collector);
+        case InputMap::InputMapType::kPow:
+            return GenerateTwoArg<InputMap_Pow>(input, ClwScene::kInputMapOpPow, input_map_leaf_collector);
+        case InputMap::InputMapType::kMod:
+            return GenerateTwoArg<InputMap_Mod>(input, ClwScene::kInputMapOpMod, input_map_leaf_collector);
+        // Single input
+        case InputMap::InputMapType::kSin:
+            return GenerateOneArg<InputMap_Sin>(input, ClwScene::kInputMapOpSin, input_map_leaf_collector);
+        case InputMap::InputMapType::kCos:
+            return GenerateOneArg<InputMap_Cos>(input, ClwScene::kInputMapOpCos, input_map_leaf_collector);
+        case InputMap::InputMapType::kTan:
+            return GenerateOneArg<InputMap_Tan>(input, ClwScene::kInputMapOpTan, input_map_leaf_collector);
+        case InputMap::InputMapType::kAsin:
+            return GenerateOneArg<InputMap_Asin>(input, ClwScene::kInputMapOpAsin, input_map_leaf_collector);
+        case InputMap::InputMapType::kAcos:
+            return GenerateOneArg<InputMap_Acos>(input, ClwScene::kInputMapOpAcos, input_map_leaf_collector);
+        case InputMap::InputMapType::kAtan:
+            return GenerateOneArg<InputMap_Atan>(input, ClwScene::kInputMapOpAtan, input_map_leaf_collector);
+        case InputMap::InputMapType::kLength3:
+            return GenerateOneArg<InputMap_Length3>(input, ClwScene::kInputMapOpLength3, input_map_leaf_collector);
+        case InputMap::InputMapType::kNormalize3:
+            return GenerateOneArg<InputMap_Normalize3>(input, ClwScene::kInputMapOpNormalize3, input_map_leaf_collector);
+        case InputMap::InputMapType::kFloor:
+            return GenerateOneArg<InputMap_Floor>(input, ClwScene::kInputMapOpFloor, input_map_leaf_collector);
+        case InputMap::InputMapType::kAbs:
+            return GenerateOneArg<InputMap_Abs>(input, ClwScene::kInputMapOpAbs, input_map_leaf_collector);
+        // Specials
+        case InputMap::InputMapType::kLerp:
+        {
+            InputMap_Lerp *i = static_cast<InputMap_Lerp*>(input.get());
+            auto depth = generate_args({ i->GetA(), i->GetB(), i->GetControl() });
+            Emit(ClwScene::kInputMapOpLerp);
+            return depth;
+        }
+        case InputMap::InputMapType::kSelect:
+        {
+            InputMap_Select *i = static_cast<InputMap_Select*>(input.get());
+            assert(static_cast<uint32_t>(i->GetSelection()) < 4);
+            auto depth = GenerateInputBytecode(i->GetArg(), input_map_leaf_collector);
+            Emit(ClwScene::kInputMapOpSelect, static_cast<std::int32_t>(i->GetSelection()));
+            return depth;
+        }
+        case InputMap::InputMapType::kShuffle:
+        {
+            InputMap_Shuffle *i = static_cast<InputMap_Shuffle*>(input.get());
+            auto depth = GenerateInputBytecode(i->GetArg(), input_map_leaf_collector);
+            Emit(ClwScene::kInputMapOpShuffle, PackShuffleMask(i->GetMask()));
+            return depth;
+        }
+        case InputMap::InputMapType::kShuffle2:
+        {
+            InputMap_Shuffle2 *i = static_cast<InputMap_Shuffle2*>(input.get());
+            auto depth = generate_args({ i->GetA(), i->GetB() });
+            Emit(ClwScene::kInputMapOpShuffle2, PackShuffleMask(i->GetMask()));
+            return depth;
+        }
+        case InputMap::InputMapType::kMatMul:
+        {
+            InputMap_MatMul *i = static_cast<InputMap_MatMul*>(input.get());
+            auto depth = GenerateInputBytecode(i->GetArg(), input_map_leaf_collector);
+            Emit(ClwScene::kInputMapOpMatMul);
+
+            // Matrix rows follow the instruction
+            auto mat4 = i->GetMatrix();
+            const std::array<RadeonRays::float3, 4> rows =
+            {{
+                RadeonRays::float3(mat4.m00, mat4.m01, mat4.m02, mat4.m03),
+                RadeonRays::float3(mat4.m10, mat4.m11, mat4.m12, mat4.m13),
+                RadeonRays::float3(mat4.m20, mat4.m21, mat4.m22, mat4.m23),
+                RadeonRays::float3(mat4.m30, mat4.m31, mat4.m32, mat4.m33)
+            }};
+            for (auto const& row : rows)
+            {
+                ClwScene::InputMapData data = {};
+                data.float_value.value = row;
+                m_bytecode.push_back(data);
+            }
+            return depth;
+        }
+        case InputMap::InputMapType::kRemap:
+        {
+            InputMap_Remap *i = static_cast<InputMap_Remap*>(input.get());
+            auto depth = generate_args({ i->GetData(), i->GetSourceRange(), i->GetDestinationRange() });
+            Emit(ClwScene::kInputMapOpRemap);
+            return depth;
+        }
+    }
+
+    assert(!"Unsupported input map type");
+    return 0;
+}
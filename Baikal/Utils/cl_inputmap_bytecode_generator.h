@@ -0,0 +1,80 @@
+/**********************************************************************
+Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+
+
+#pragma once
+
+#include <unordered_map>
+#include <vector>
+
+#include "SceneGraph/scene1.h"
+#include "SceneGraph/Collector/collector.h"
+#include "SceneGraph/clwscene.h"
+
+namespace Baikal
+{
+    class InputMap;
+    class CLInputMapBytecodeGenerator
+    {
+    public:
+        // Maximum evaluation stack depth, should match INPUT_MAP_STACK_SIZE in inputmaps_interpreter.cl
+        static std::uint32_t constexpr kMaxStackDepth = 8;
+
+        /**
+        * @brief Generates bytecode for input maps.
+        *
+        * Bytecode is interpreted by inputmaps_interpreter.cl, so changes of input maps
+        * do not require program recompilation. Each input map is written as postfix
+        * program terminated by kInputMapOpReturn. Leafs are referenced by their indices
+        * in leaf collector. Throws if input map requires more than kMaxStackDepth stack slots.
+        *
+        * @param input_map_collector set of input maps for generation
+        * @param input_map_leaf_collector list of leaf nodes that holds values
+        * @param base_offset offset of bytecode in input map data buffer
+        */
+        void Generate(const Collector& input_map_collector, const Collector& input_map_leaf_collector, std::uint32_t base_offset);
+
+        // Returns generated bytecode
+        const std::vector<ClwScene::InputMapData>& GetBytecode() const
+        {
+            return m_bytecode;
+        }
+
+        // Returns input map offset in input map data buffer or -1 if input map wasn't generated
+        std::int32_t GetOffset(std::uint32_t input_map_id) const;
+
+    private:
+        // Writes bytecode for single input map. Called recursively.
+        // Returns number of stack slots required to evaluate input map.
+        std::uint32_t GenerateInputBytecode(std::shared_ptr<Baikal::InputMap> input, const Collector& input_map_leaf_collector);
+        // Writes bytecode for input maps with single (GetArg) and two (GetA, GetB) arguments
+        template <class T>
+        std::uint32_t GenerateOneArg(std::shared_ptr<Baikal::InputMap> input, ClwScene::InputMapOpcode op, const Collector& input_map_leaf_collector);
+        template <class T>
+        std::uint32_t GenerateTwoArg(std::shared_ptr<Baikal::InputMap> input, ClwScene::InputMapOpcode op, const Collector& input_map_leaf_collector);
+        // Appends single instruction
+        void Emit(ClwScene::InputMapOpcode op, std::int32_t arg = 0);
+
+        std::vector<ClwScene::InputMapData> m_bytecode;
+        std::unordered_map<std::uint32_t, std::int32_t> m_offsets;
+    };
+}
@@ -117,7 +117,7 @@ void CLInputMapGenerator::GenerateInputSource(std::shared_ptr<Baikal::InputMap>
         {
             int32_t index = input_map_leaf_collector.GetItemIndex(input);
 
-            m_read_functions += "Texture_Sample2D(dg->uv, TEXTURE_ARGS_IDX(input_map_values[" + std::to_string(index) + "].int_values.idx))\n";
+            m_read_functions += "Texture_Sample2DGrad(dg->uv, dg->duvdx, dg->duvdy, TEXTURE_ARGS_IDX(input_map_values[" + std::to_string(index) + "].int_values.idx))\n";
             break;
         }
         case InputMap::InputMapType::kSamplerBumpmap:
@@ -24,84 +24,310 @@ THE SOFTWARE.
 
 #include <assert.h>
 #include <chrono>
+#include <cstdio>
 #include <iostream>
 #include <algorithm>
 #include <fstream>
+#include <random>
 #include <sstream>
-#include <regex>
+#include <thread>
+
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 #include "cl_program_manager.h"
 #include "version.h"
 #include "Utils/mkpath.h"
+#include "Utils/sha256.h"
+#include "Utils/thread_pool.h"
+#include "Utils/clw_profiler.h"
+#include "Utils/log.h"
 
 //#define DUMP_PROGRAM_SOURCE 1
 
 using namespace Baikal;
 
-inline std::uint32_t jenkins_one_at_a_time_hash(char const *key, size_t len)
+namespace
 {
-    std::uint32_t hash, i;
-    for (hash = i = 0; i < len; ++i)
+    // Time to wait for other process holding cache entry lock before treating lock as stale
+    auto const kCacheLockTimeout = std::chrono::minutes(2);
+    auto const kCacheLockPollInterval = std::chrono::milliseconds(50);
+
+    // Everything compilation task needs, copied so task doesn't depend on CLProgram lifetime
+    struct CompileTask
+    {
+        std::string program_name;
+        std::string cache_path;
+        std::shared_ptr<const std::string> source;
+        std::string opts;
+        CLWContext context;
+        ClwProfiler* profiler;
+    };
+
+    bool LoadBinaries(std::string const& name, std::vector<std::uint8_t>& data)
     {
-        hash += key[i];
-        hash += (hash << 10);
-        hash ^= (hash >> 6);
+        std::ifstream in(name, std::ios::in | std::ios::binary);
+        if (in)
+        {
+            data.clear();
+            std::streamoff beg = in.tellg();
+            in.seekg(0, std::ios::end);
+            std::streamoff fileSize = in.tellg() - beg;
+            in.seekg(0, std::ios::beg);
+            if (fileSize <= 0)
+            {
+                return false;
+            }
+            data.resize(static_cast<unsigned>(fileSize));
+            in.read((char*)&data[0], fileSize);
+            return static_cast<bool>(in);
+        }
+        else
+        {
+            return false;
+        }
     }
-    hash += (hash << 3);
-    hash ^= (hash >> 11);
-    hash += (hash << 15);
-    return hash;
-}
 
-// Computting check sum algo
-// Copy from here: https://codereview.stackexchange.com/questions/104948/32-bit-checksum-of-a-file
-inline std::uint32_t CheckSum(const std::string &source)
-{
-    std::uint32_t check_sum = 0;
-    unsigned shift = 0;
-    for (uint32_t ch : source)
+    // Writes binaries into temporary file and renames it, so readers never observe partially written entry
+    void SaveBinaries(std::string const& name, std::vector<std::uint8_t> const& data)
     {
-        check_sum += (ch << shift);
-        shift += 8;
-        if (shift == 32) {
-            shift = 0;
+        if (data.empty())
+        {
+            return;
+        }
+
+        std::random_device random;
+        std::ostringstream tmp_name;
+        tmp_name << name << ".tmp" << std::hash<std::thread::id>()(std::this_thread::get_id()) << "_" << random();
+
+        {
+            std::ofstream out(tmp_name.str(), std::ios::out | std::ios::binary);
+            if (!out)
+            {
+                return;
+            }
+
+            out.write((char*)&data[0], data.size());
+            if (!out)
+            {
+                out.close();
+                std::remove(tmp_name.str().c_str());
+                return;
+            }
+        }
+
+        // On Windows rename fails if entry already exists.
+        // Existing entry has the same content, so just drop ours.
+        if (std::rename(tmp_name.str().c_str(), name.c_str()) != 0)
+        {
+            std::remove(tmp_name.str().c_str());
         }
     }
-    return check_sum;
-}
 
-inline bool LoadBinaries(std::string const& name, std::vector<std::uint8_t>& data)
-{
-    std::ifstream in(name, std::ios::in | std::ios::binary);
-    if (in)
+    // Atomically creates lock file, returns false if it already exists
+    bool TryCreateLockFile(std::string const& name)
     {
-        data.clear();
-        std::streamoff beg = in.tellg();
-        in.seekg(0, std::ios::end);
-        std::streamoff fileSize = in.tellg() - beg;
-        in.seekg(0, std::ios::beg);
-        data.resize(static_cast<unsigned>(fileSize));
-        in.read((char*)&data[0], fileSize);
+#ifdef _WIN32
+        int fd = _open(name.c_str(), _O_CREAT | _O_EXCL | _O_WRONLY, _S_IREAD | _S_IWRITE);
+        if (fd == -1)
+        {
+            return false;
+        }
+        _close(fd);
+#else
+        int fd = open(name.c_str(), O_CREAT | O_EXCL | O_WRONLY, 0644);
+        if (fd == -1)
+        {
+            return false;
+        }
+        close(fd);
+#endif
         return true;
     }
-    else
+
+    std::string GetDriverVersion(CLWDevice const& device)
     {
-        return false;
+        std::size_t size = 0;
+        if (clGetDeviceInfo(device.GetID(), CL_DRIVER_VERSION, 0, nullptr, &size) != CL_SUCCESS || size == 0)
+        {
+            return "";
+        }
+
+        std::vector<char> version(size);
+        if (clGetDeviceInfo(device.GetID(), CL_DRIVER_VERSION, size, &version[0], nullptr) != CL_SUCCESS)
+        {
+            return "";
+        }
+
+        return std::string(&version[0]);
     }
-}
 
-inline void SaveBinaries(std::string const& name, std::vector<std::uint8_t>& data)
-{
-    mkfilepath(name);
+    // Returns cache file name: program name followed by strong hash of everything affecting binary
+    std::string GetCacheFileName(CompileTask const& task)
+    {
+        auto device = task.context.GetDevice(0);
+        char const separator = '\0';
+
+        Sha256 hash;
+        hash.Update(*task.source);
+        hash.Update(&separator, 1);
+        hash.Update(task.opts);
+        hash.Update(&separator, 1);
+        hash.Update(device.GetName());
+        hash.Update(&separator, 1);
+        hash.Update(device.GetVersion());
+        hash.Update(&separator, 1);
+        hash.Update(GetDriverVersion(device));
+        hash.Update(&separator, 1);
+        hash.Update(BAIKAL_VERSION);
+
+        return task.program_name + "_" + hash.GetHexDigest();
+    }
 
-    std::ofstream out(name, std::ios::out | std::ios::binary);
+    CLWProgram CompileSource(CompileTask const& task)
+    {
+        std::chrono::time_point<std::chrono::steady_clock> start, end;
+        start = std::chrono::steady_clock::now();
 
-    if (out)
+        auto const& source = *task.source;
+        CLWProgram compiled_program;
+        try
+        {
+            compiled_program = CLWProgram::CreateFromSource(source.c_str(), source.size(), task.opts.c_str(), task.context);
+            /*
+             * Code below usable for cache debugging
+             */
+#ifdef DUMP_PROGRAM_SOURCE
+            auto e = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::high_resolution_clock::now().time_since_epoch()).count();
+            std::ofstream file(task.program_name + std::to_string(e) + ".cl");
+            file << source;
+            file.close();
+#endif
+        }
+        catch (CLWException& )
+        {
+            std::ostringstream message;
+            message << "Compilation failed!" << std::endl;
+            message << "Dumping source to file:" << task.program_name << ".cl.failed" << std::endl;
+            std::cerr << message.str();
+            std::string fname = task.program_name + ".cl.failed";
+            std::ofstream file(fname);
+            file << source;
+            file.close();
+            throw;
+        }
+
+        end = std::chrono::steady_clock::now();
+        task.profiler->RecordCompilation(task.program_name, task.opts, start, end);
+
+        if (task.profiler->IsEnabled())
+        {
+            auto elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
+            LogInfo("Program ", task.program_name, " compilation time: ", elapsed_ms, " ms\n");
+        }
+
+        return compiled_program;
+    }
+
+    bool LoadCachedProgram(std::string const& path, CLWContext context, CLWProgram& program)
     {
-        out.write((char*)&data[0], data.size());
+        std::vector<std::uint8_t> binary;
+        if (!LoadBinaries(path, binary))
+        {
+            return false;
+        }
+
+        try
+        {
+            std::size_t size = binary.size();
+            auto binaries = &binary[0];
+            program = CLWProgram::CreateFromBinary(&binaries, &size, context);
+            return true;
+        }
+        catch (CLWException&)
+        {
+            // Entry is unusable for this device, rebuild it
+            return false;
+        }
+    }
+
+    CLWProgram CompileAndSave(CompileTask const& task, std::string const& path)
+    {
+        auto result = CompileSource(task);
+
+        std::vector<std::uint8_t> binary;
+        result.GetBinaries(0, binary);
+        SaveBinaries(path, binary);
+
+        return result;
     }
-}
 
+    // Runs on thread pool worker
+    CLWProgram CompileOrLoad(CompileTask const& task)
+    {
+        if (task.cache_path.empty())
+        {
+            return CompileSource(task);
+        }
+
+        auto cached_program_path = task.cache_path;
+        cached_program_path.append("/");
+        cached_program_path.append(GetCacheFileName(task));
+        cached_program_path.append(".bin");
+
+        CLWProgram result;
+        if (LoadCachedProgram(cached_program_path, task.context, result))
+        {
+            return result;
+        }
+
+        mkfilepath(cached_program_path);
+
+        auto lock_path = cached_program_path + ".lock";
+        auto wait_start = std::chrono::steady_clock::now();
+
+        while (!TryCreateLockFile(lock_path))
+        {
+            // Entry is being built by other process or thread, wait for it
+            std::this_thread::sleep_for(kCacheLockPollInterval);
+
+            if (LoadCachedProgram(cached_program_path, task.context, result))
+            {
+                return result;
+            }
+
+            if (std::chrono::steady_clock::now() - wait_start > kCacheLockTimeout)
+            {
+                // Lock owner most likely died, build without lock
+                std::remove(lock_path.c_str());
+                return CompileAndSave(task, cached_program_path);
+            }
+        }
+
+        try
+        {
+            // Entry might have been finished between first check and taking the lock
+            if (!LoadCachedProgram(cached_program_path, task.context, result))
+            {
+                result = CompileAndSave(task, cached_program_path);
+            }
+        }
+        catch (...)
+        {
+            std::remove(lock_path.c_str());
+            throw;
+        }
+
+        std::remove(lock_path.c_str());
+        return result;
+    }
+}
 
 CLProgram::CLProgram(const CLProgramManager *program_manager, uint32_t id, CLWContext context,
                      const std::string &program_name, const std::string &cache_path) :
@@ -115,7 +341,6 @@ CLProgram::CLProgram(const CLProgramManager *program_manager, uint32_t id, CLWCo
 
 void CLProgram::SetSource(const std::string &source)
 {
-    m_compiled_source.reserve(1024 * 1024); //Just reserve 1M for now
     m_program_source = source;
     ParseSource(m_program_source);
 }
@@ -176,40 +401,13 @@ void CLProgram::BuildSource(const std::string &source)
 
 CLWProgram CLProgram::Compile(const std::string &opts)
 {
-    std::chrono::time_point<std::chrono::high_resolution_clock> start, end;
-    start = std::chrono::high_resolution_clock::now();
-
-    CLWProgram compiled_program;
-    try
-    {
-        compiled_program = CLWProgram::CreateFromSource(m_compiled_source.c_str(), m_compiled_source.size(), opts.c_str(), m_context);
-        /*
-         * Code below usable for cache debugging
-         */
-#ifdef DUMP_PROGRAM_SOURCE
-        auto e = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::high_resolution_clock::now().time_since_epoch()).count();
-        std::ofstream file(m_program_name + std::to_string(e) + ".cl");
-        file << m_compiled_source;
-        file.close();
-#endif
-    }
-    catch (CLWException& )
+    if (m_is_dirty)
     {
-        std::cerr << "Compilation failed!" << std::endl;
-        std::cerr << "Dumping source to file:" << m_program_name << ".cl.failed" << std::endl;
-        std::string fname = m_program_name + ".cl.failed";
-        std::ofstream file(fname);
-        file << m_compiled_source;
-        file.close();
-        throw;
+        Rebuild();
     }
 
-    end = std::chrono::high_resolution_clock::now();
-    int elapsed_ms = (int)std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
-    std::cerr << "Program compilation time: " << elapsed_ms << " ms" << std::endl;
-
-    m_is_dirty = false;
-    return compiled_program;
+    CompileTask task = { m_program_name, "", m_source_snapshot, opts, m_context, &m_program_manager->GetProfiler() };
+    return CompileSource(task);
 }
 
 bool CLProgram::IsHeaderNeeded(const std::string &header_name) const
@@ -217,89 +415,84 @@ bool CLProgram::IsHeaderNeeded(const std::string &header_name) const
     return (m_required_headers.find(header_name) != m_required_headers.end());
 }
 
-CLWProgram CLProgram::GetCLWProgram(const std::string &opts)
+void CLProgram::Rebuild()
+{
+    m_programs.clear();
+    m_compiled_source.clear();
+    m_compiled_source.reserve(1024 * 1024); //Just reserve 1M for now
+    m_included_headers.clear();
+    BuildSource(m_program_source);
+    m_source_snapshot = std::make_shared<const std::string>(std::move(m_compiled_source));
+    m_compiled_source.clear();
+    m_is_dirty = false;
+}
+
+std::shared_future<CLWProgram> CLProgram::GetCLWProgramAsync(const std::string &opts, ThreadPool &thread_pool)
 {
     // global dirty flag
     if (m_is_dirty)
     {
-        m_programs.clear();
-        m_compiled_source.clear();
-        m_included_headers.clear();
-        BuildSource(m_program_source);
+        Rebuild();
     }
 
+    m_requested_opts.insert(opts);
+    return ScheduleCompilation(opts, thread_pool);
+}
+
+std::shared_future<CLWProgram> CLProgram::ScheduleCompilation(const std::string &opts, ThreadPool &thread_pool)
+{
     auto it = m_programs.find(opts);
     if (it != m_programs.end())
     {
-        return it->second;
-    }
-
-    CLWProgram result;
-    //check if we can get it from cache
-    if (!m_cache_path.empty())
-    {
-        std::string filename = GetFilenameHash(opts);
+        auto const& program = it->second;
+        bool failed = false;
 
-        auto cached_program_path = m_cache_path;
-        cached_program_path.append("/");
-        cached_program_path.append(filename);
-        cached_program_path.append(".bin");
-
-        std::vector<std::uint8_t> binary;
-        if (LoadBinaries(cached_program_path, binary))
+        // Failed compilation is scheduled again, headers or source might have been fixed since
+        if (program.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
         {
-            // Create from binary
-            std::size_t size = binary.size();
-            auto binaries = &binary[0];
-            result = CLWProgram::CreateFromBinary(&binaries, &size, m_context);
-            m_programs[opts] = result;
+            try
+            {
+                program.get();
+            }
+            catch (...)
+            {
+                failed = true;
+            }
         }
-        else
-        {
-            result = Compile(opts);
-            m_programs[opts] = result;
 
-            // Save binaries
-            result.GetBinaries(0, binary);
-            SaveBinaries(cached_program_path, binary);
+        if (!failed)
+        {
+            return program;
         }
     }
 
-    m_is_dirty = false;
+    CompileTask task = { m_program_name, m_cache_path, m_source_snapshot, opts, m_context, &m_program_manager->GetProfiler() };
+    std::shared_future<CLWProgram> result = thread_pool.Submit([task]() { return CompileOrLoad(task); });
+    m_programs[opts] = result;
     return result;
 }
 
-std::string CLProgram::GetFilenameHash(std::string const& opts) const
+CLWProgram CLProgram::GetCLWProgram(const std::string &opts, ThreadPool &thread_pool)
 {
-    auto name = m_program_name;
-    auto device_name = m_context.GetDevice(0).GetName();
-
-    std::regex forbidden("(\\\\)|[\\./:<>\\\"\\|\\?\\*]");
-
-    device_name = std::regex_replace(device_name, forbidden, "_");
-    device_name.erase(
-        std::remove_if(device_name.begin(), device_name.end(), isspace),
-                      device_name.end());
-
-    name.append("_");
-    name.append(device_name);
-
-    auto extra = m_context.GetDevice(0).GetVersion();
-    extra.append(opts);
-
-    std::ostringstream oss;
-    oss << jenkins_one_at_a_time_hash(extra.c_str(), extra.size());
-
-    name.append("_");
-    name.append(oss.str());
-
+    return GetCLWProgramAsync(opts, thread_pool).get();
+}
 
-    std::uint32_t file_hash = CheckSum(m_compiled_source);
+void CLProgram::CompileAsync(ThreadPool &thread_pool)
+{
+    if (!m_is_dirty || (m_requested_opts.empty() && m_precompile_opts.empty()))
+    {
+        return;
+    }
 
-    name.append("_");
-    name.append(std::to_string(file_hash));
+    Rebuild();
 
-    name.append(BAIKAL_VERSION);
+    for (auto const& opts : m_requested_opts)
+    {
+        ScheduleCompilation(opts, thread_pool);
+    }
 
-    return name;
+    if (!m_precompile_opts.empty())
+    {
+        ScheduleCompilation(m_precompile_opts, thread_pool);
+    }
 }
@@ -25,6 +25,8 @@ THE SOFTWARE.
 #include <string>
 #include <vector>
 #include <set>
+#include <memory>
+#include <future>
 #include <unordered_map>
 #include <unordered_set>
 #include "CLWProgram.h"
@@ -33,6 +35,7 @@ THE SOFTWARE.
 namespace Baikal
 {
     class CLProgramManager;
+    class ThreadPool;
     class CLProgram
     {
     public:
@@ -54,19 +57,37 @@ namespace Baikal
          */
         void SetSource(const std::string &source);
         /**
-         * @brief returns CLWProgram object
-         * 
-         * This function will build program and compile it if it's durty.
-         * This function respronsible for shader cache handling. If required program
-         * already exists in disk or in-memory cache returns it.
-         * For caching uses simple uint32 crc of source code.
+         * @brief returns future for CLWProgram object
+         *
+         * This function will rebuild program source if it's dirty and schedule
+         * compilation on thread pool unless program with the same options is already
+         * compiled or being compiled. Waiting for result is up to the caller.
+         * Compilation task is responsible for shader cache handling: binaries are
+         * stored on disk under SHA-256 of full program source, options, device and
+         * driver version. Cache entries are written atomically and guarded with lock
+         * file, so processes sharing cache folder don't build the same entry twice.
          */
-        CLWProgram GetCLWProgram(const std::string &opts);
+        std::shared_future<CLWProgram> GetCLWProgramAsync(const std::string &opts, ThreadPool &thread_pool);
+
+        // Same as GetCLWProgramAsync but waits for compilation to finish
+        CLWProgram GetCLWProgram(const std::string &opts, ThreadPool &thread_pool);
+
+        /**
+         * @brief Schedules compilation of dirty program
+         *
+         * Program is compiled with all options it was requested with before
+         * and with options set by SetPrecompileOptions. Does nothing if there are
+         * no such options or program isn't dirty.
+         */
+        void CompileAsync(ThreadPool &thread_pool);
+
+        // Sets options program is expected to be requested with
+        void SetPrecompileOptions(const std::string &opts) { m_precompile_opts = opts; }
 
         // Checks if specified header required by program
         bool IsHeaderNeeded(const std::string &header_name) const;
 
-        // Compiles program. In case of error dumps source into current folder
+        // Compiles program bypassing caches. In case of error dumps source into current folder
         CLWProgram Compile(const std::string &opts);
 
     private:
@@ -78,8 +99,10 @@ namespace Baikal
          * Duplicate includes removed.
          */
         void BuildSource(const std::string &source);
-        // Returns hash for file name
-        std::string GetFilenameHash(std::string const& opts) const;
+        // Rebuilds source of dirty program and drops compiled programs
+        void Rebuild();
+        // Returns in-memory cached program or submits compilation task
+        std::shared_future<CLWProgram> ScheduleCompilation(const std::string &opts, ThreadPool &thread_pool);
 
         const CLProgramManager *m_program_manager;
         std::string m_program_name;    ///< Program name
@@ -88,7 +111,10 @@ namespace Baikal
         std::string m_program_source;  ///< Program source code without modifications
         std::unordered_set<std::string> m_required_headers; ///< Set of required headers
 
-        std::unordered_map<std::string, CLWProgram> m_programs; ///< In-memory cache for compiled programs
+        std::shared_ptr<const std::string> m_source_snapshot; ///< Built source shared with compilation tasks
+        std::unordered_map<std::string, std::shared_future<CLWProgram>> m_programs; ///< In-memory cache for compiled programs
+        std::set<std::string> m_requested_opts; ///< Options program was requested with
+        std::string m_precompile_opts; ///< Options program is expected to be requested with
 
         bool m_is_dirty = true;
         uint32_t m_id;
@@ -21,6 +21,8 @@ THE SOFTWARE.
 ********************************************************************/
 
 #include "cl_program_manager.h"
+#include "Utils/thread_pool.h"
+#include "Utils/clw_profiler.h"
 
 #include <fstream>
 #include <regex>
@@ -47,11 +49,15 @@ std::string ReadFile(const std::string &fname)
     return str;
 }
 CLProgramManager::CLProgramManager(const std::string &cache_path) :
-    m_cache_path(cache_path)
+    m_cache_path(cache_path),
+    m_profiler(new ClwProfiler()),
+    m_thread_pool(new ThreadPool())
 {
 
 }
 
+CLProgramManager::~CLProgramManager() = default;
+
 uint32_t CLProgramManager::CreateProgramFromFile(CLWContext context, const std::string &fname) const
 {
     std::regex delimiter("\\\\");
@@ -111,9 +117,28 @@ const std::string& CLProgramManager::ReadHeader(const std::string &header) const
 }
 
 CLWProgram CLProgramManager::GetProgram(uint32_t id, const std::string &opts) const
+{
+    return GetProgramAsync(id, opts).get();
+}
+
+std::shared_future<CLWProgram> CLProgramManager::GetProgramAsync(uint32_t id, const std::string &opts) const
 {
     CLProgram &program = m_programs[id];
-    return program.GetCLWProgram(opts);
+    auto result = program.GetCLWProgramAsync(opts, *m_thread_pool);
+
+    // Headers are up to date by the time program is requested,
+    // so start building the rest of dirty programs too
+    for (auto &other : m_programs)
+    {
+        other.second.CompileAsync(*m_thread_pool);
+    }
+
+    return result;
+}
+
+void CLProgramManager::SetPrecompileOptions(uint32_t id, const std::string &opts) const
+{
+    m_programs[id].SetPrecompileOptions(opts);
 }
 
 void CLProgramManager::CompileProgram(uint32_t id, const std::string &opts) const
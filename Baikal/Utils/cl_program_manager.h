@@ -25,6 +25,8 @@ THE SOFTWARE.
 #include <string>
 #include <stdint.h>
 #include <map>
+#include <memory>
+#include <future>
 #include <vector>
 
 #include "CLWProgram.h"
@@ -34,11 +36,24 @@ THE SOFTWARE.
 
 namespace Baikal
 {
+    class ThreadPool;
+    class ClwProfiler;
+
+    /**
+    * @brief Owns OpenCL programs and compiles them on background threads.
+    *
+    * Programs are compiled on internal thread pool. Requesting any program
+    * also schedules recompilation of other dirty programs, so independent
+    * programs are built concurrently while caller waits for the one it needs.
+    * Manager itself should be used from single thread.
+    */
     class CLProgramManager
     {
     public:
         // Constructor
         explicit CLProgramManager(const std::string &cache_path);
+        // Waits for running compilation tasks
+        ~CLProgramManager();
         // Creates program from file and returns its id
         uint32_t CreateProgramFromFile(CLWContext context, const std::string &fname) const;
         // Creates program from source and returns its id
@@ -49,15 +64,23 @@ namespace Baikal
         void AddHeader(const std::string &header, const std::string &source) const;
         // Reads header from disk and returns its source
         const std::string& ReadHeader(const std::string &header) const;
-        // Returns compiled program
+        // Returns compiled program, waits for compilation if needed
         CLWProgram GetProgram(uint32_t id, const std::string &opts) const;
+        // Returns future for compiled program without waiting
+        std::shared_future<CLWProgram> GetProgramAsync(uint32_t id, const std::string &opts) const;
+        // Sets options program is expected to be requested with, so it can be compiled ahead of time
+        void SetPrecompileOptions(uint32_t id, const std::string &opts) const;
         // Compiles program
         void CompileProgram(uint32_t id, const std::string &opts) const;
+        // Returns profiler shared by all objects using the manager
+        ClwProfiler& GetProfiler() const { return *m_profiler; }
 
     private:
         mutable std::string m_cache_path; ///< Path to cache folder
         mutable std::map<uint32_t, CLProgram> m_programs; ///< Cache of programs by id
         mutable std::map<std::string, std::string> m_headers; ///< Headers map
+        std::unique_ptr<ClwProfiler> m_profiler; ///< Profiler, outlives compilation threads
+        std::unique_ptr<ThreadPool> m_thread_pool; ///< Compilation threads
         static uint32_t m_next_program_id;
     };
 }
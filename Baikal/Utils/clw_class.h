@@ -11,6 +11,7 @@
 #include "CLW.h"
 #include "version.h"
 #include "cl_program_manager.h"
+#include "clw_profiler.h"
 
 namespace Baikal
 {
@@ -41,6 +42,12 @@ namespace Baikal
         std::string GetDefaultBuildOpts() const { return m_default_opts; }
         std::string GetFullBuildOpts() const;
 
+        // Launch kernel on the first device, launches are recorded by profiler if it is enabled
+        CLWEvent Launch1D(std::size_t global_size, std::size_t local_size, CLWKernel kernel) const;
+        CLWEvent Launch2D(std::size_t const* global_size, std::size_t const* local_size, CLWKernel kernel) const;
+        // Profiler shared by all objects of the program manager
+        ClwProfiler& GetProfiler() const { return m_program_manager->GetProfiler(); }
+
     private:
         void AddCommonOptions(std::string& opts) const;
 
@@ -73,6 +80,9 @@ namespace Baikal
         {
             m_program_manager->AddHeader(header.first, header.second);
         }
+
+        m_default_opts = opts;
+        m_program_manager->SetPrecompileOptions(m_program_id, options);
     }
 #else
     inline ClwClass::ClwClass(
@@ -87,6 +97,9 @@ namespace Baikal
         AddCommonOptions(options);
 
         m_program_id = m_program_manager->CreateProgramFromFile(context, cl_file);
+
+        m_default_opts = opts;
+        m_program_manager->SetPrecompileOptions(m_program_id, options);
     }
 #endif
 
@@ -114,6 +127,10 @@ namespace Baikal
             ""
 #endif
         );
+
+#ifdef BAIKAL_COMPACT_GEOMETRY
+        opts.append("-D BAIKAL_COMPACT_GEOMETRY ");
+#endif
     }
 
     inline std::string ClwClass::GetFullBuildOpts() const
@@ -123,8 +140,23 @@ namespace Baikal
         return options;
     }
 
+    inline CLWEvent ClwClass::Launch1D(std::size_t global_size, std::size_t local_size, CLWKernel kernel) const
+    {
+        auto event = m_context.Launch1D(0, global_size, local_size, kernel);
+        GetProfiler().RecordLaunch(kernel, event);
+        return event;
+    }
+
+    inline CLWEvent ClwClass::Launch2D(std::size_t const* global_size, std::size_t const* local_size, CLWKernel kernel) const
+    {
+        auto event = m_context.Launch2D(0, global_size, local_size, kernel);
+        GetProfiler().RecordLaunch(kernel, event);
+        return event;
+    }
+
     inline void ClwClass::SetDefaultBuildOptions(std::string const& opts)
     {
         m_default_opts = opts;
+        m_program_manager->SetPrecompileOptions(m_program_id, GetFullBuildOpts());
     }
 }
@@ -0,0 +1,394 @@
+/**********************************************************************
+Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#include "clw_profiler.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <stdexcept>
+
+namespace Baikal
+{
+    namespace
+    {
+        // Pending events are resolved once there are more of them
+        std::size_t const kMaxPendingLaunches = 4096;
+        // Records kept for trace, statistics are collected past the limit
+        std::size_t const kMaxRecords = 1 << 20;
+
+        std::string GetKernelName(CLWKernel const& kernel)
+        {
+            cl_kernel handle = kernel;
+            std::size_t size = 0;
+
+            if (clGetKernelInfo(handle, CL_KERNEL_FUNCTION_NAME, 0, nullptr, &size) != CL_SUCCESS || size == 0)
+            {
+                return "Unknown";
+            }
+
+            std::vector<char> name(size);
+            if (clGetKernelInfo(handle, CL_KERNEL_FUNCTION_NAME, size, name.data(), nullptr) != CL_SUCCESS)
+            {
+                return "Unknown";
+            }
+
+            return std::string(name.data());
+        }
+
+        std::string Escape(std::string const& str)
+        {
+            std::string result;
+            result.reserve(str.size());
+
+            for (auto c : str)
+            {
+                switch (c)
+                {
+                case '"': result += "\\\""; break;
+                case '\\': result += "\\\\"; break;
+                case '\n': result += "\\n"; break;
+                case '\t': result += "\\t"; break;
+                default: result += c; break;
+                }
+            }
+
+            return result;
+        }
+
+        void WriteStatistics(std::ostream& out, RenderStatistics const& stats)
+        {
+            out << "{\"num_frames\":" << stats.num_frames
+                << ",\"time_ms\":" << stats.time_ms
+                << ",\"bytes_uploaded\":" << stats.bytes_uploaded
+                << ",\"kernels\":[";
+
+            for (std::size_t i = 0; i < stats.kernels.size(); ++i)
+            {
+                auto const& kernel = stats.kernels[i];
+                out << (i ? "," : "") << "\n{\"name\":\"" << Escape(kernel.name)
+                    << "\",\"num_launches\":" << kernel.num_launches
+                    << ",\"time_ms\":" << kernel.time_ms << "}";
+            }
+
+            out << "],\"passes\":[";
+
+            for (std::size_t i = 0; i < stats.passes.size(); ++i)
+            {
+                auto const& pass = stats.passes[i];
+                out << (i ? "," : "") << "\n{\"pass\":" << i
+                    << ",\"num_rays\":" << pass.num_rays
+                    << ",\"time_ms\":" << pass.time_ms << "}";
+            }
+
+            out << "],\"compilations\":[";
+
+            for (std::size_t i = 0; i < stats.compilations.size(); ++i)
+            {
+                auto const& compilation = stats.compilations[i];
+                out << (i ? "," : "") << "\n{\"program\":\"" << Escape(compilation.program_name)
+                    << "\",\"options\":\"" << Escape(compilation.options)
+                    << "\",\"time_ms\":" << compilation.time_ms << "}";
+            }
+
+            out << "]}";
+        }
+    }
+
+    ClwProfiler::Section::Section(ClwProfiler& profiler, CLWContext context, char const* name)
+        : m_profiler(profiler.IsEnabled() ? &profiler : nullptr)
+        , m_context(context)
+        , m_name(name)
+    {
+        if (m_profiler)
+        {
+            // Don't account work enqueued before the section
+            m_context.Finish(0);
+            m_start = std::chrono::steady_clock::now();
+        }
+    }
+
+    ClwProfiler::Section::~Section()
+    {
+        if (m_profiler)
+        {
+            m_context.Finish(0);
+            auto end = std::chrono::steady_clock::now();
+
+            std::lock_guard<std::mutex> lock(m_profiler->m_mutex);
+
+            auto start = m_profiler->GetHostTime(m_start);
+            Record record = { m_name, Track::kHost, m_profiler->m_frame, m_profiler->m_pass,
+                start, m_profiler->GetHostTime(end) - start };
+            m_profiler->AddRecord(record);
+        }
+    }
+
+    ClwProfiler::ClwProfiler()
+        : m_enabled(false)
+        , m_origin(std::chrono::steady_clock::now())
+        , m_device_origin(0)
+        , m_device_offset(0.0)
+        , m_has_device_offset(false)
+        , m_frame(0)
+        , m_pass(-1)
+    {
+    }
+
+    ClwProfiler::~ClwProfiler() = default;
+
+    void ClwProfiler::SetEnabled(bool enable)
+    {
+        m_enabled = enable;
+    }
+
+    void ClwProfiler::Reset()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        // Compilations happen once, so they are kept
+        auto compilations = std::move(m_statistics.compilations);
+
+        m_pending.clear();
+        m_records.erase(std::remove_if(m_records.begin(), m_records.end(),
+            [](Record const& record) { return record.track != Track::kCompiler; }), m_records.end());
+
+        m_statistics = RenderStatistics();
+        m_statistics.compilations = std::move(compilations);
+        m_frame = 0;
+    }
+
+    void ClwProfiler::BeginFrame()
+    {
+        if (!m_enabled)
+        {
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_frame = ++m_statistics.num_frames;
+    }
+
+    void ClwProfiler::SetPass(int pass)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_pass = pass;
+    }
+
+    void ClwProfiler::RecordLaunch(CLWKernel const& kernel, CLWEvent const& event)
+    {
+        if (!m_enabled)
+        {
+            return;
+        }
+
+        auto name = GetKernelName(kernel);
+        auto now = std::chrono::steady_clock::now();
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        PendingLaunch launch = { std::move(name), m_frame, m_pass, GetHostTime(now), event };
+        m_pending.push_back(std::move(launch));
+
+        if (m_pending.size() > kMaxPendingLaunches)
+        {
+            ResolvePendingLaunches();
+        }
+    }
+
+    void ClwProfiler::RecordRayCount(int pass, std::uint64_t num_rays)
+    {
+        if (!m_enabled || pass < 0)
+        {
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        auto& passes = m_statistics.passes;
+        if (passes.size() <= static_cast<std::size_t>(pass))
+        {
+            passes.resize(pass + 1);
+        }
+
+        passes[pass].num_rays += num_rays;
+    }
+
+    void ClwProfiler::RecordUpload(std::uint64_t num_bytes)
+    {
+        if (!m_enabled)
+        {
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_statistics.bytes_uploaded += num_bytes;
+    }
+
+    void ClwProfiler::RecordCompilation(std::string const& program_name, std::string const& options,
+        std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        RenderStatistics::Compilation compilation;
+        compilation.program_name = program_name;
+        compilation.options = options;
+        compilation.time_ms = std::chrono::duration<double, std::milli>(end - start).count();
+        m_statistics.compilations.push_back(compilation);
+
+        if (m_records.size() < kMaxRecords)
+        {
+            auto start_time = GetHostTime(start);
+            Record record = { program_name, Track::kCompiler, m_frame, -1, start_time, GetHostTime(end) - start_time };
+            m_records.push_back(record);
+        }
+    }
+
+    RenderStatistics ClwProfiler::GetStatistics()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        ResolvePendingLaunches();
+
+        auto stats = m_statistics;
+        std::sort(stats.kernels.begin(), stats.kernels.end(),
+            [](RenderStatistics::Kernel const& lhs, RenderStatistics::Kernel const& rhs) { return lhs.time_ms > rhs.time_ms; });
+
+        return stats;
+    }
+
+    void ClwProfiler::SaveTrace(std::string const& file_name)
+    {
+        auto stats = GetStatistics();
+
+        std::ofstream out(file_name);
+        if (!out)
+        {
+            throw std::runtime_error("ClwProfiler: cannot open file " + file_name);
+        }
+
+        out << std::fixed << std::setprecision(3);
+        out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+
+        char const* const track_names[] = { "Host", "Device", "Compiler" };
+        for (auto i = 0; i < 3; ++i)
+        {
+            out << (i ? "," : "") << "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << i
+                << ",\"args\":{\"name\":\"" << track_names[i] << "\"}}";
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+
+            for (auto const& record : m_records)
+            {
+                out << ",\n{\"name\":\"" << Escape(record.name)
+                    << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << static_cast<int>(record.track)
+                    << ",\"ts\":" << record.start
+                    << ",\"dur\":" << record.duration
+                    << ",\"args\":{\"frame\":" << record.frame << ",\"pass\":" << record.pass << "}}";
+            }
+        }
+
+        out << "],\n\"statistics\":";
+        WriteStatistics(out, stats);
+        out << "}\n";
+    }
+
+    double ClwProfiler::GetHostTime(std::chrono::steady_clock::time_point time) const
+    {
+        return std::chrono::duration<double, std::micro>(time - m_origin).count();
+    }
+
+    void ClwProfiler::AddRecord(Record const& record)
+    {
+        auto time_ms = record.duration * 1e-3;
+
+        auto& kernels = m_statistics.kernels;
+        auto it = std::find_if(kernels.begin(), kernels.end(),
+            [&record](RenderStatistics::Kernel const& kernel) { return kernel.name == record.name; });
+
+        if (it == kernels.end())
+        {
+            RenderStatistics::Kernel kernel;
+            kernel.name = record.name;
+            it = kernels.insert(kernels.end(), kernel);
+        }
+
+        ++it->num_launches;
+        it->time_ms += time_ms;
+        m_statistics.time_ms += time_ms;
+
+        if (record.pass >= 0)
+        {
+            auto& passes = m_statistics.passes;
+            if (passes.size() <= static_cast<std::size_t>(record.pass))
+            {
+                passes.resize(record.pass + 1);
+            }
+
+            passes[record.pass].time_ms += time_ms;
+        }
+
+        if (m_records.size() < kMaxRecords)
+        {
+            m_records.push_back(record);
+        }
+    }
+
+    void ClwProfiler::ResolvePendingLaunches()
+    {
+        for (auto& launch : m_pending)
+        {
+            launch.event.Wait();
+
+            cl_event event = launch.event;
+            cl_ulong queued = 0;
+            cl_ulong start = 0;
+            cl_ulong end = 0;
+
+            bool has_profiling_info =
+                clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_QUEUED, sizeof(cl_ulong), &queued, nullptr) == CL_SUCCESS &&
+                clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &start, nullptr) == CL_SUCCESS &&
+                clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &end, nullptr) == CL_SUCCESS;
+
+            Record record = { std::move(launch.name), Track::kDevice, launch.frame, launch.pass, launch.host_time, 0.0 };
+
+            if (has_profiling_info)
+            {
+                // Device clock is aligned to host time by queue time of the first launch
+                if (!m_has_device_offset)
+                {
+                    m_device_origin = queued;
+                    m_device_offset = launch.host_time;
+                    m_has_device_offset = true;
+                }
+
+                record.start = static_cast<std::int64_t>(start - m_device_origin) * 1e-3 + m_device_offset;
+                record.duration = end > start ? (end - start) * 1e-3 : 0.0;
+            }
+
+            AddRecord(record);
+        }
+
+        m_pending.clear();
+    }
+}
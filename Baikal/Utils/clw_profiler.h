@@ -0,0 +1,159 @@
+/**********************************************************************
+Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#pragma once
+
+#include "CLW.h"
+#include "Renderers/render_statistics.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace Baikal
+{
+    /**
+    \brief Collects timings of OpenCL work.
+
+    Profiling is disabled by default and recording calls do nothing then. Kernel launches
+    are timed with profiling info of their events, so command queue should be created with
+    profiling enabled, otherwise launches are counted with zero time. Events are resolved
+    when statistics are requested or too many of them are pending.
+
+    Intersector queries don't expose their events, so they are timed on host in sections
+    which finish the queue before and after the query.
+
+    Programs are compiled on worker threads, so all methods are thread safe.
+    */
+    class ClwProfiler
+    {
+    public:
+        // Section of host code timed with the queue finished at both ends
+        class Section
+        {
+        public:
+            Section(ClwProfiler& profiler, CLWContext context, char const* name);
+            ~Section();
+
+            Section(Section const&) = delete;
+            Section& operator = (Section const&) = delete;
+
+        private:
+            ClwProfiler* m_profiler;
+            CLWContext m_context;
+            char const* m_name;
+            std::chrono::steady_clock::time_point m_start;
+        };
+
+        ClwProfiler();
+        ~ClwProfiler();
+
+        // Enable or disable recording
+        void SetEnabled(bool enable);
+        bool IsEnabled() const { return m_enabled; }
+
+        // Drop collected data
+        void Reset();
+
+        // Start new frame
+        void BeginFrame();
+        // Set pass of the estimator following records belong to, -1 for work outside of passes
+        void SetPass(int pass);
+
+        // Record kernel launch, kernel time is read from the event later
+        void RecordLaunch(CLWKernel const& kernel, CLWEvent const& event);
+        // Record number of rays traced in the pass
+        void RecordRayCount(int pass, std::uint64_t num_rays);
+        // Record bytes uploaded to device
+        void RecordUpload(std::uint64_t num_bytes);
+        // Record program compilation, recorded even if profiling is disabled
+        void RecordCompilation(std::string const& program_name, std::string const& options,
+            std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end);
+
+        // Get statistics, waits for pending launches
+        RenderStatistics GetStatistics();
+
+        /**
+        \brief Save collected data as trace in Chrome trace event format.
+
+        File can be opened in chrome://tracing or Perfetto. Device work, host sections and
+        compilations are written as separate threads, statistics are stored in "statistics"
+        object next to trace events.
+
+        \param file_name Name of the file
+        */
+        void SaveTrace(std::string const& file_name);
+
+        ClwProfiler(ClwProfiler const&) = delete;
+        ClwProfiler& operator = (ClwProfiler const&) = delete;
+
+    private:
+        enum class Track
+        {
+            kHost,
+            kDevice,
+            kCompiler
+        };
+
+        struct Record
+        {
+            std::string name;
+            Track track;
+            std::uint32_t frame;
+            int pass;
+            // Microseconds since profiling start
+            double start;
+            double duration;
+        };
+
+        struct PendingLaunch
+        {
+            std::string name;
+            std::uint32_t frame;
+            int pass;
+            double host_time;
+            CLWEvent event;
+        };
+
+        double GetHostTime(std::chrono::steady_clock::time_point time) const;
+        void AddRecord(Record const& record);
+        void ResolvePendingLaunches();
+
+        std::atomic<bool> m_enabled;
+        std::mutex m_mutex;
+
+        std::chrono::steady_clock::time_point m_origin;
+        // Device time of the first resolved launch and its host time
+        std::uint64_t m_device_origin;
+        double m_device_offset;
+        bool m_has_device_offset;
+
+        std::uint32_t m_frame;
+        int m_pass;
+
+        std::vector<PendingLaunch> m_pending;
+        std::vector<Record> m_records;
+        RenderStatistics m_statistics;
+    };
+}
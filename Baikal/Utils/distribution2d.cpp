@@ -0,0 +1,121 @@
+/**********************************************************************
+Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#include "distribution2d.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace Baikal
+{
+    Distribution2D::Distribution2D()
+    {
+    }
+
+    Distribution2D::Distribution2D(float const* values, std::uint32_t width, std::uint32_t height, ThreadPool* pool)
+    {
+        Set(values, width, height, pool);
+    }
+
+    void Distribution2D::Set(float const* values, std::uint32_t width, std::uint32_t height, ThreadPool* pool)
+    {
+        assert(width > 0 && height > 0);
+        m_conditional.resize(height);
+
+        std::vector<float> row_integrals(height);
+
+        auto build_rows = [&](std::uint32_t begin, std::uint32_t end)
+        {
+            for (auto y = begin; y < end; ++y)
+            {
+                auto row = values + static_cast<std::size_t>(y) * width;
+                float sum = 0.f;
+                for (auto x = 0u; x < width; ++x)
+                {
+                    sum += row[x];
+                }
+
+                if (sum > 0.f)
+                {
+                    m_conditional[y].Set(row, width);
+                }
+                else
+                {
+                    // Row is never picked by marginal distribution,
+                    // use uniform one to keep pdf finite
+                    std::vector<float> uniform(width, 1.f);
+                    m_conditional[y].Set(uniform.data(), width);
+                }
+
+                row_integrals[y] = sum / width;
+            }
+        };
+
+        if (pool)
+        {
+            std::uint32_t const kRowsPerTask = 16;
+            std::vector<std::future<void>> tasks;
+            for (auto y = 0u; y < height; y += kRowsPerTask)
+            {
+                auto end = std::min(y + kRowsPerTask, height);
+                tasks.push_back(pool->Submit([&build_rows, y, end]() { build_rows(y, end); }));
+            }
+
+            for (auto& task : tasks)
+            {
+                task.get();
+            }
+        }
+        else
+        {
+            build_rows(0, height);
+        }
+
+        m_marginal.Set(row_integrals.data(), height);
+    }
+
+    void Distribution2D::Sample2D(float u, float v, float& x, float& y, float& pdf) const
+    {
+        float marginal_pdf = 0.f;
+        y = m_marginal.Sample1D(v, marginal_pdf);
+
+        auto row = std::min(static_cast<std::uint32_t>(y * m_marginal.m_num_segments), m_marginal.m_num_segments - 1);
+
+        float conditional_pdf = 0.f;
+        x = m_conditional[row].Sample1D(u, conditional_pdf);
+
+        pdf = marginal_pdf * conditional_pdf;
+    }
+
+    float Distribution2D::pdf(float x, float y) const
+    {
+        auto height = m_marginal.m_num_segments;
+        auto row = std::min(static_cast<std::uint32_t>(std::max(y, 0.f) * height), height - 1);
+
+        auto const& conditional = m_conditional[row];
+        auto width = conditional.m_num_segments;
+        auto column = std::min(static_cast<std::uint32_t>(std::max(x, 0.f) * width), width - 1);
+
+        return m_marginal.m_func_values[row] / m_marginal.m_func_sum *
+            conditional.m_func_values[column] / conditional.m_func_sum;
+    }
+}
@@ -0,0 +1,427 @@
+/**********************************************************************
+Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#include "light_bvh.h"
+#include "math/mathutils.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace Baikal
+{
+    namespace
+    {
+        std::uint32_t const kNumBins = 12;
+
+        inline float SafeAcos(float value)
+        {
+            return std::acos(std::min(std::max(value, -1.f), 1.f));
+        }
+
+        inline float SafeSqrt(float value)
+        {
+            return std::sqrt(std::max(value, 0.f));
+        }
+
+        // cos(a - b) clamped to 1 if a < b, angles are passed as sines and cosines
+        inline float CosSubClamped(float sin_a, float cos_a, float sin_b, float cos_b)
+        {
+            return cos_a > cos_b ? 1.f : cos_a * cos_b + sin_a * sin_b;
+        }
+
+        // Rotates v around unit axis k by angle (Rodrigues formula)
+        inline RadeonRays::float3 Rotate(RadeonRays::float3 const& v, RadeonRays::float3 const& k, float angle)
+        {
+            auto cos_angle = std::cos(angle);
+            auto sin_angle = std::sin(angle);
+            return v * cos_angle + RadeonRays::cross(k, v) * sin_angle + k * (RadeonRays::dot(k, v) * (1.f - cos_angle));
+        }
+
+        // Smallest cone containing both cones
+        void UnionCone(RadeonRays::float3 const& axis_a, float cos_a, RadeonRays::float3 const& axis_b, float cos_b,
+            RadeonRays::float3& axis, float& cos_theta)
+        {
+            auto theta_a = SafeAcos(cos_a);
+            auto theta_b = SafeAcos(cos_b);
+            auto theta_d = SafeAcos(RadeonRays::dot(axis_a, axis_b));
+
+            if (std::min(theta_d + theta_b, PI) <= theta_a)
+            {
+                axis = axis_a;
+                cos_theta = cos_a;
+                return;
+            }
+
+            if (std::min(theta_d + theta_a, PI) <= theta_b)
+            {
+                axis = axis_b;
+                cos_theta = cos_b;
+                return;
+            }
+
+            auto theta_o = 0.5f * (theta_a + theta_d + theta_b);
+            auto rotation_axis = RadeonRays::cross(axis_a, axis_b);
+            if (theta_o >= PI || rotation_axis.sqnorm() == 0.f)
+            {
+                axis = axis_a;
+                cos_theta = -1.f;
+                return;
+            }
+
+            rotation_axis.normalize();
+            axis = Rotate(axis_a, rotation_axis, theta_o - theta_a);
+            axis.normalize();
+            cos_theta = std::cos(theta_o);
+        }
+
+        // Grows bounds of node a by bounds of node b
+        void Merge(LightBvh::Node& a, LightBvh::Node const& b)
+        {
+            if (b.power <= 0.f && a.power > 0.f)
+            {
+                a.bounds.grow(b.bounds);
+                return;
+            }
+
+            if (a.power <= 0.f && b.power > 0.f)
+            {
+                auto bounds = a.bounds;
+                a.bounds = b.bounds;
+                a.bounds.grow(bounds);
+                a.axis = b.axis;
+                a.cos_theta_o = b.cos_theta_o;
+                a.cos_theta_e = b.cos_theta_e;
+                a.power = b.power;
+                return;
+            }
+
+            a.bounds.grow(b.bounds);
+            UnionCone(a.axis, a.cos_theta_o, b.axis, b.cos_theta_o, a.axis, a.cos_theta_o);
+            a.cos_theta_e = std::min(a.cos_theta_e, b.cos_theta_e);
+            a.power += b.power;
+        }
+
+        LightBvh::Node MakeNode(LightBvh::Emitter const& emitter)
+        {
+            LightBvh::Node node;
+            node.bounds = emitter.bounds;
+            node.axis = emitter.axis;
+            node.cos_theta_o = emitter.cos_theta_o;
+            node.cos_theta_e = emitter.cos_theta_e;
+            node.power = emitter.power;
+            node.parent = -1;
+            node.left = -1;
+            node.right = -1;
+            node.light_idx = emitter.light_idx;
+            return node;
+        }
+
+        // Solid angle measure of emission directions of the node
+        float OrientationMeasure(float cos_theta_o, float cos_theta_e)
+        {
+            auto theta_o = SafeAcos(cos_theta_o);
+            auto theta_e = SafeAcos(cos_theta_e);
+            auto theta_w = std::min(theta_o + theta_e, PI);
+            auto sin_theta_o = SafeSqrt(1.f - cos_theta_o * cos_theta_o);
+
+            return 2.f * PI * (1.f - cos_theta_o) +
+                0.5f * PI * (2.f * theta_w * sin_theta_o - std::cos(theta_o - 2.f * theta_w) - 2.f * theta_o * sin_theta_o + cos_theta_o);
+        }
+
+        float Cost(LightBvh::Node const& node)
+        {
+            return node.power * OrientationMeasure(node.cos_theta_o, node.cos_theta_e) * node.bounds.surface_area();
+        }
+
+        inline float Component(RadeonRays::float3 const& v, int axis)
+        {
+            return axis == 0 ? v.x : (axis == 1 ? v.y : v.z);
+        }
+    }
+
+    void LightBvh::Build(std::vector<Emitter> const& emitters)
+    {
+        m_nodes.clear();
+        m_leaf_indices.assign(emitters.size(), -1);
+
+        if (emitters.empty())
+        {
+            return;
+        }
+
+        m_nodes.reserve(2 * emitters.size() - 1);
+
+        std::vector<int> indices(emitters.size());
+        for (auto i = 0u; i < indices.size(); ++i)
+        {
+            indices[i] = static_cast<int>(i);
+        }
+
+        BuildNode(emitters, indices, 0, indices.size(), -1);
+    }
+
+    int LightBvh::BuildNode(std::vector<Emitter> const& emitters, std::vector<int>& indices, std::size_t begin, std::size_t end, int parent)
+    {
+        auto node_idx = static_cast<int>(m_nodes.size());
+
+        if (end - begin == 1)
+        {
+            auto node = MakeNode(emitters[indices[begin]]);
+            node.parent = parent;
+            m_nodes.push_back(node);
+            m_leaf_indices[indices[begin]] = node_idx;
+            return node_idx;
+        }
+
+        // Bounds of the node and of emitter centroids
+        auto node = MakeNode(emitters[indices[begin]]);
+        RadeonRays::bbox centroid_bounds(emitters[indices[begin]].bounds.center());
+        for (auto i = begin + 1; i < end; ++i)
+        {
+            Merge(node, MakeNode(emitters[indices[i]]));
+            centroid_bounds.grow(emitters[indices[i]].bounds.center());
+        }
+
+        node.parent = parent;
+        node.light_idx = -1;
+        m_nodes.push_back(node);
+
+        // Find the best binned split over all axes
+        auto extents = node.bounds.extents();
+        auto max_extent = std::max(extents.x, std::max(extents.y, extents.z));
+        auto centroid_extents = centroid_bounds.extents();
+
+        auto best_cost = std::numeric_limits<float>::max();
+        auto best_axis = -1;
+        auto best_bin = 0u;
+
+        for (auto axis = 0; axis < 3; ++axis)
+        {
+            auto axis_extent = Component(centroid_extents, axis);
+            if (axis_extent <= 0.f)
+            {
+                continue;
+            }
+
+            auto axis_min = Component(centroid_bounds.pmin, axis);
+            auto bin_of = [&](int emitter) {
+                auto t = (Component(emitters[emitter].bounds.center(), axis) - axis_min) / axis_extent;
+                return std::min(static_cast<std::uint32_t>(t * kNumBins), kNumBins - 1);
+            };
+
+            Node bins[kNumBins] = {};
+            bool bin_used[kNumBins] = {};
+            for (auto i = begin; i < end; ++i)
+            {
+                auto bin = bin_of(indices[i]);
+                if (bin_used[bin])
+                {
+                    Merge(bins[bin], MakeNode(emitters[indices[i]]));
+                }
+                else
+                {
+                    bins[bin] = MakeNode(emitters[indices[i]]);
+                    bin_used[bin] = true;
+                }
+            }
+
+            // Costs of splits after each bin, accumulated from the right
+            float right_costs[kNumBins] = {};
+            Node right = {};
+            bool right_used = false;
+            for (auto bin = kNumBins - 1; bin > 0; --bin)
+            {
+                if (bin_used[bin] && right_used)
+                {
+                    Merge(right, bins[bin]);
+                }
+                else if (bin_used[bin])
+                {
+                    right = bins[bin];
+                    right_used = true;
+                }
+                right_costs[bin - 1] = right_used ? Cost(right) : -1.f;
+            }
+
+            // Regularization favours splits along longer axes
+            auto kr = max_extent / std::max(Component(extents, axis), 1e-6f);
+
+            Node left = {};
+            bool left_used = false;
+            for (auto bin = 0u; bin < kNumBins - 1; ++bin)
+            {
+                if (bin_used[bin] && left_used)
+                {
+                    Merge(left, bins[bin]);
+                }
+                else if (bin_used[bin])
+                {
+                    left = bins[bin];
+                    left_used = true;
+                }
+
+                if (!left_used || right_costs[bin] < 0.f)
+                {
+                    continue;
+                }
+
+                auto cost = kr * (Cost(left) + right_costs[bin]);
+                if (cost < best_cost)
+                {
+                    best_cost = cost;
+                    best_axis = axis;
+                    best_bin = bin;
+                }
+            }
+        }
+
+        auto middle = begin + (end - begin) / 2;
+
+        if (best_axis != -1)
+        {
+            auto axis_min = Component(centroid_bounds.pmin, best_axis);
+            auto axis_extent = Component(centroid_extents, best_axis);
+            auto iter = std::partition(indices.begin() + begin, indices.begin() + end, [&](int emitter) {
+                auto t = (Component(emitters[emitter].bounds.center(), best_axis) - axis_min) / axis_extent;
+                return std::min(static_cast<std::uint32_t>(t * kNumBins), kNumBins - 1) <= best_bin;
+            });
+
+            auto split = static_cast<std::size_t>(iter - indices.begin());
+            if (split > begin && split < end)
+            {
+                middle = split;
+            }
+        }
+
+        // Children are appended after the node, so its reference can't be kept
+        auto left = BuildNode(emitters, indices, begin, middle, node_idx);
+        auto right = BuildNode(emitters, indices, middle, end, node_idx);
+        m_nodes[node_idx].left = left;
+        m_nodes[node_idx].right = right;
+
+        return node_idx;
+    }
+
+    float LightBvh::Importance(Node const& node, RadeonRays::float3 const& p)
+    {
+        if (node.power <= 0.f)
+        {
+            return 0.f;
+        }
+
+        auto center = node.bounds.center();
+        auto d = p - center;
+        auto d2 = std::max(d.sqnorm(), 0.5f * std::sqrt(node.bounds.extents().sqnorm()));
+        d2 = std::max(d2, 1e-6f);
+
+        // Angle between cone axis and direction to p
+        auto cos_theta_w = d.sqnorm() > 0.f ? RadeonRays::dot(node.axis, d) / std::sqrt(d.sqnorm()) : 1.f;
+        auto sin_theta_w = SafeSqrt(1.f - cos_theta_w * cos_theta_w);
+
+        // Angle subtended by bounds as seen from p
+        auto radius2 = 0.25f * node.bounds.extents().sqnorm();
+        auto cos_theta_b = d.sqnorm() > radius2 ? SafeSqrt(1.f - radius2 / d.sqnorm()) : -1.f;
+        auto sin_theta_b = SafeSqrt(1.f - cos_theta_b * cos_theta_b);
+
+        // Minimal angle between emission directions and direction to p
+        auto sin_theta_o = SafeSqrt(1.f - node.cos_theta_o * node.cos_theta_o);
+        auto cos_theta_x = CosSubClamped(sin_theta_w, cos_theta_w, sin_theta_o, node.cos_theta_o);
+        auto sin_theta_x = SafeSqrt(1.f - cos_theta_x * cos_theta_x);
+        auto cos_theta_p = CosSubClamped(sin_theta_x, cos_theta_x, sin_theta_b, cos_theta_b);
+
+        if (cos_theta_p <= node.cos_theta_e)
+        {
+            return 0.f;
+        }
+
+        return node.power * cos_theta_p / d2;
+    }
+
+    int LightBvh::Sample(RadeonRays::float3 const& p, float u, float& pdf) const
+    {
+        pdf = 0.f;
+
+        // Single emitter is picked if it contributes to p, matching GetPdf
+        if (m_nodes.empty() || (m_nodes[0].light_idx != -1 && Importance(m_nodes[0], p) <= 0.f))
+        {
+            return -1;
+        }
+
+        auto node_idx = 0;
+        pdf = 1.f;
+
+        while (m_nodes[node_idx].light_idx == -1)
+        {
+            auto const& node = m_nodes[node_idx];
+            auto importance_left = Importance(m_nodes[node.left], p);
+            auto importance_right = Importance(m_nodes[node.right], p);
+
+            if (importance_left + importance_right <= 0.f)
+            {
+                pdf = 0.f;
+                return -1;
+            }
+
+            auto p_left = importance_left / (importance_left + importance_right);
+            if (u < p_left)
+            {
+                u = std::min(u / p_left, 0.99999994f);
+                pdf *= p_left;
+                node_idx = node.left;
+            }
+            else
+            {
+                u = std::min((u - p_left) / (1.f - p_left), 0.99999994f);
+                pdf *= 1.f - p_left;
+                node_idx = node.right;
+            }
+        }
+
+        return m_nodes[node_idx].light_idx;
+    }
+
+    float LightBvh::GetPdf(int leaf, RadeonRays::float3 const& p) const
+    {
+        auto importance = Importance(m_nodes[leaf], p);
+        if (importance <= 0.f)
+        {
+            return 0.f;
+        }
+
+        float pdf = 1.f;
+        auto node_idx = leaf;
+
+        while (m_nodes[node_idx].parent != -1)
+        {
+            auto const& parent = m_nodes[m_nodes[node_idx].parent];
+            auto sibling = parent.left == node_idx ? parent.right : parent.left;
+            auto importance_sibling = Importance(m_nodes[sibling], p);
+
+            pdf *= importance / (importance + importance_sibling);
+
+            node_idx = m_nodes[node_idx].parent;
+            importance = Importance(m_nodes[node_idx], p);
+        }
+
+        return pdf;
+    }
+}
@@ -0,0 +1,92 @@
+/**********************************************************************
+Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#pragma once
+
+#include "math/bbox.h"
+#include "math/float3.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace Baikal
+{
+    /**
+    \brief Bounding volume hierarchy over emitters used to sample lights proportionally
+    to their estimated contribution at a shading point.
+
+    Each node stores spatial bounds, cone bounding emission directions (axis and
+    spread angle theta_o plus emission angle theta_e) and total power of its emitters.
+    Nodes are split with binned surface area orientation heuristic, leafs hold single
+    emitter. Sampling descends from the root choosing children proportionally to
+    their importance, device traversal is implemented in light_bvh.cl and matches
+    Sample and GetPdf.
+    */
+    class LightBvh
+    {
+    public:
+        // Bounded emitter, light_idx is passed through to leaf
+        struct Emitter
+        {
+            RadeonRays::bbox bounds;
+            RadeonRays::float3 axis;
+            float cos_theta_o;
+            float cos_theta_e;
+            float power;
+            int light_idx;
+        };
+
+        struct Node
+        {
+            RadeonRays::bbox bounds;
+            RadeonRays::float3 axis;
+            float cos_theta_o;
+            float cos_theta_e;
+            float power;
+            // Parent and children node indices, -1 if absent
+            int parent;
+            int left;
+            int right;
+            // Light index for leafs, -1 for inner nodes
+            int light_idx;
+        };
+
+        // Builds hierarchy, root is node 0
+        void Build(std::vector<Emitter> const& emitters);
+
+        std::vector<Node> const& GetNodes() const { return m_nodes; }
+        // Leaf node index of each emitter in the order passed to Build
+        std::vector<int> const& GetLeafIndices() const { return m_leaf_indices; }
+
+        // Estimated contribution of node emitters to point p
+        static float Importance(Node const& node, RadeonRays::float3 const& p);
+        // Picks light for point p, returns -1 if no emitter contributes to p
+        int Sample(RadeonRays::float3 const& p, float u, float& pdf) const;
+        // Probability of picking leaf node for point p
+        float GetPdf(int leaf, RadeonRays::float3 const& p) const;
+
+    private:
+        int BuildNode(std::vector<Emitter> const& emitters, std::vector<int>& indices, std::size_t begin, std::size_t end, int parent);
+
+        std::vector<Node> m_nodes;
+        std::vector<int> m_leaf_indices;
+    };
+}
@@ -0,0 +1,168 @@
+/**********************************************************************
+Copyright (c) 2017 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+
+#include "Utils/sha256.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace Baikal
+{
+    namespace
+    {
+        std::uint32_t const kRoundConstants[64] =
+        {
+            0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+            0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+            0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+            0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+            0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+            0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+            0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+            0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+        };
+
+        inline std::uint32_t RotateRight(std::uint32_t x, std::uint32_t n)
+        {
+            return (x >> n) | (x << (32 - n));
+        }
+    }
+
+    Sha256::Sha256()
+        : m_block_size(0)
+        , m_total_size(0)
+    {
+        m_state[0] = 0x6a09e667;
+        m_state[1] = 0xbb67ae85;
+        m_state[2] = 0x3c6ef372;
+        m_state[3] = 0xa54ff53a;
+        m_state[4] = 0x510e527f;
+        m_state[5] = 0x9b05688c;
+        m_state[6] = 0x1f83d9ab;
+        m_state[7] = 0x5be0cd19;
+    }
+
+    void Sha256::Update(const std::string& data)
+    {
+        Update(data.data(), data.size());
+    }
+
+    void Sha256::Update(const void* data, std::size_t size)
+    {
+        auto bytes = static_cast<const std::uint8_t*>(data);
+        m_total_size += size;
+
+        while (size > 0)
+        {
+            auto count = std::min(size, sizeof(m_block) - m_block_size);
+            std::memcpy(m_block + m_block_size, bytes, count);
+            m_block_size += count;
+            bytes += count;
+            size -= count;
+
+            if (m_block_size == sizeof(m_block))
+            {
+                Transform(m_block);
+                m_block_size = 0;
+            }
+        }
+    }
+
+    std::string Sha256::GetHexDigest()
+    {
+        std::uint64_t bit_size = m_total_size * 8;
+
+        // Padding: single 1 bit, zeros, 64-bit big endian message length
+        std::uint8_t padding[72] = { 0x80 };
+        auto padding_size = (m_block_size < 56) ? (56 - m_block_size) : (120 - m_block_size);
+        for (int i = 0; i < 8; ++i)
+        {
+            padding[padding_size + i] = static_cast<std::uint8_t>(bit_size >> (56 - 8 * i));
+        }
+        Update(padding, padding_size + 8);
+
+        static char const kHexDigits[] = "0123456789abcdef";
+        std::string result;
+        result.reserve(64);
+        for (auto word : m_state)
+        {
+            for (int shift = 28; shift >= 0; shift -= 4)
+            {
+                result.push_back(kHexDigits[(word >> shift) & 0xf]);
+            }
+        }
+        return result;
+    }
+
+    void Sha256::Transform(const std::uint8_t* block)
+    {
+        std::uint32_t w[64];
+        for (int i = 0; i < 16; ++i)
+        {
+            w[i] = (std::uint32_t(block[i * 4]) << 24) | (std::uint32_t(block[i * 4 + 1]) << 16) |
+                (std::uint32_t(block[i * 4 + 2]) << 8) | std::uint32_t(block[i * 4 + 3]);
+        }
+        for (int i = 16; i < 64; ++i)
+        {
+            auto s0 = RotateRight(w[i - 15], 7) ^ RotateRight(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            auto s1 = RotateRight(w[i - 2], 17) ^ RotateRight(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+
+        auto a = m_state[0];
+        auto b = m_state[1];
+        auto c = m_state[2];
+        auto d = m_state[3];
+        auto e = m_state[4];
+        auto f = m_state[5];
+        auto g = m_state[6];
+        auto h = m_state[7];
+
+        for (int i = 0; i < 64; ++i)
+        {
+            auto s1 = RotateRight(e, 6) ^ RotateRight(e, 11) ^ RotateRight(e, 25);
+            auto ch = (e & f) ^ (~e & g);
+            auto t1 = h + s1 + ch + kRoundConstants[i] + w[i];
+            auto s0 = RotateRight(a, 2) ^ RotateRight(a, 13) ^ RotateRight(a, 22);
+            auto maj = (a & b) ^ (a & c) ^ (b & c);
+            auto t2 = s0 + maj;
+
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+
+        m_state[0] += a;
+        m_state[1] += b;
+        m_state[2] += c;
+        m_state[3] += d;
+        m_state[4] += e;
+        m_state[5] += f;
+        m_state[6] += g;
+        m_state[7] += h;
+    }
+}
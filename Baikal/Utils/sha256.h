@@ -0,0 +1,56 @@
+/**********************************************************************
+Copyright (c) 2017 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+namespace Baikal
+{
+    /**
+    * @brief Incremental SHA-256 hash.
+    *
+    * Used as content hash for on-disk caches where collisions of weak
+    * checksums would silently return stale data.
+    */
+    class Sha256
+    {
+    public:
+        Sha256();
+        // Appends data to hashed message
+        void Update(const void* data, std::size_t size);
+        void Update(const std::string& data);
+        // Finalizes hash and returns digest as lowercase hex string.
+        // Object should not be updated after this call.
+        std::string GetHexDigest();
+
+    private:
+        void Transform(const std::uint8_t* block);
+
+        std::uint32_t m_state[8];
+        std::uint8_t m_block[64];
+        std::size_t m_block_size;
+        std::uint64_t m_total_size;
+    };
+}
@@ -0,0 +1,135 @@
+/**********************************************************************
+Copyright (c) 2017 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+namespace Baikal
+{
+    /**
+    * @brief Fixed size pool of worker threads.
+    *
+    * Tasks are executed in submission order by the first free worker.
+    * Tasks which were not started by the time pool is destroyed are dropped,
+    * their futures report broken promise.
+    */
+    class ThreadPool
+    {
+    public:
+        // Creates pool with num_threads workers, 0 means number of hardware threads
+        explicit ThreadPool(std::size_t num_threads = 0);
+        ~ThreadPool();
+
+        ThreadPool(ThreadPool const&) = delete;
+        ThreadPool& operator = (ThreadPool const&) = delete;
+
+        // Queues task for execution and returns future for its result
+        template <typename F>
+        auto Submit(F&& f) -> std::future<decltype(f())>;
+
+    private:
+        void Run();
+
+        std::vector<std::thread> m_threads;
+        std::queue<std::function<void()>> m_tasks;
+        std::mutex m_mutex;
+        std::condition_variable m_condition;
+        bool m_stop;
+    };
+
+    inline ThreadPool::ThreadPool(std::size_t num_threads)
+        : m_stop(false)
+    {
+        if (num_threads == 0)
+        {
+            num_threads = std::max(1u, std::thread::hardware_concurrency());
+        }
+
+        for (std::size_t i = 0; i < num_threads; ++i)
+        {
+            m_threads.emplace_back(&ThreadPool::Run, this);
+        }
+    }
+
+    inline ThreadPool::~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+
+        m_condition.notify_all();
+
+        for (auto& thread : m_threads)
+        {
+            thread.join();
+        }
+    }
+
+    template <typename F>
+    inline auto ThreadPool::Submit(F&& f) -> std::future<decltype(f())>
+    {
+        // std::function requires copyable target, so wrap task into shared_ptr
+        auto task = std::make_shared<std::packaged_task<decltype(f())()>>(std::forward<F>(f));
+        auto result = task->get_future();
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_tasks.emplace([task]() { (*task)(); });
+        }
+
+        m_condition.notify_one();
+        return result;
+    }
+
+    inline void ThreadPool::Run()
+    {
+        for (;;)
+        {
+            std::function<void()> task;
+
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_condition.wait(lock, [this]() { return m_stop || !m_tasks.empty(); });
+
+                if (m_stop)
+                {
+                    return;
+                }
+
+                task = std::move(m_tasks.front());
+                m_tasks.pop();
+            }
+
+            task();
+        }
+    }
+}
@@ -34,7 +34,8 @@ THE SOFTWARE.
 #include "material_io.h"
 #include "SceneGraph/light.h"
 #include "Output/clwoutput.h"
-#include "BaikalIO/image_io.h"
+#include "Output/clw_output_readback.h"
+#include "BaikalIO/texture_cache.h"
 
 #include "OpenImageIO/imageio.h"
 
@@ -92,6 +93,12 @@ const std::vector<OutputInfo> kSingleIteratedOutputs =
     }
 };
 
+struct Render::PendingOutput
+{
+    Baikal::ClwOutputReadback::Request request;
+    std::filesystem::path file_name;
+};
+
 Render::Render(const std::filesystem::path& scene_file,
     std::uint32_t output_width,
     std::uint32_t output_height)
@@ -129,6 +136,11 @@ Render::Render(const std::filesystem::path& scene_file,
     m_renderer = m_factory->CreateRenderer(Baikal::ClwRenderFactory::RendererType::kUnidirectionalPathTracer);
     m_controller = m_factory->CreateSceneController();
 
+    // enough staging buffers to keep readbacks of all outputs in flight
+    auto num_readback_buffers = static_cast<std::uint32_t>(
+        kMultipleIteratedOutputs.size() + kSingleIteratedOutputs.size());
+    m_readback = m_factory->CreateOutputReadback(num_readback_buffers);
+
     for (auto& output_info : kMultipleIteratedOutputs)
     {
         m_outputs.push_back(m_factory->CreateOutput(output_width, output_height));
@@ -218,73 +230,47 @@ void Render::SaveOutput(const OutputInfo& info,
 
     assert(output);
 
-    auto buffer = static_cast<Baikal::ClwOutput*>(output)->data();
-
-    std::vector<RadeonRays::float3> output_data(buffer.GetElementCount());
-
-    output->GetData(output_data.data());
-
-    std::vector<float> image_data(info.channels_num * m_width * m_height);
+    // staging buffer is about to be reused, write out what it holds
+    if (m_pending_outputs.size() >= kMultipleIteratedOutputs.size() + kSingleIteratedOutputs.size())
+    {
+        WritePendingOutputs();
+    }
 
-    float* dst_row = image_data.data();
+    // The 4-th pixel component is a count of accumulated samples.
+    // It can be different for every pixel in case of adaptive sampling,
+    // so pixel values are normalized on device along with inverting the image
+    Baikal::ClwOutputReadback::Settings settings;
+    settings.channels = static_cast<std::uint32_t>(info.channels_num);
+    settings.flip_y = true;
 
     if (gamma_correction_enabled &&
        (info.type == Renderer::OutputType::kColor) &&
        (info.channels_num == 3))
     {
-        for (auto y = 0u; y < m_height; ++y)
-        {
-            for (auto x = 0u; x < m_width; ++x)
-            {
-                float3 val = output_data[(m_height - 1 - y) * m_width + x];
-                // "The 4-th pixel component is a count of accumulated samples.
-                // It can be different for every pixel in case of adaptive sampling.
-                // So, we need to normalize pixel values here".
-                val *= (1.f / val.w);
-                // gamma corection
-                dst_row[info.channels_num * x] = std::pow(val.x, 1.f / 2.2f);
-                dst_row[info.channels_num * x + 1] = std::pow(val.y, 1.f / 2.2f);
-                dst_row[info.channels_num * x + 2] = std::pow(val.z, 1.f / 2.2f);
-            }
-            dst_row += info.channels_num * m_width;
-        }
-    }
-    else
-    {
-        for (auto y = 0u; y < m_height; ++y)
-        {
-            for (auto x = 0u; x < m_width; ++x)
-            {
-                float3 val = output_data[(m_height - 1 - y) * m_width + x];
-                // "The 4-th pixel component is a count of accumulated samples.
-                // It can be different for every pixel in case of adaptive sampling.
-                // So, we need to normalize pixel values here".
-                val *= (1.f / val.w);
-
-                if (info.channels_num == 3)
-                {
-                    // invert the image
-                    dst_row[info.channels_num * x] = val.x;
-                    dst_row[info.channels_num * x + 1] = val.y;
-                    dst_row[info.channels_num * x + 2] = val.z;
-                }
-                else // info.channels_num = 1
-                {
-                    // invert the image 
-                    dst_row[x] = val.x;
-                }
-            }
-            dst_row += info.channels_num * m_width;
-        }
+        settings.gamma = 2.2f;
     }
 
     std::filesystem::path file_name = output_dir;
     file_name.append(name);
 
-    std::ofstream f (file_name.string(), std::ofstream::binary);
+    m_pending_outputs.push_back(
+        { m_readback->Read(*static_cast<Baikal::ClwOutput*>(output), settings), file_name });
+}
 
-    f.write(reinterpret_cast<const char*>(image_data.data()),
-            sizeof(float) * image_data.size());
+void Render::WritePendingOutputs()
+{
+    for (auto const& pending : m_pending_outputs)
+    {
+        auto const& request = pending.request;
+        auto size = static_cast<std::size_t>(request.width()) * request.height() * request.channels();
+
+        std::ofstream f (pending.file_name.string(), std::ofstream::binary);
+
+        f.write(reinterpret_cast<const char*>(request.Get()),
+                sizeof(float) * size);
+    }
+
+    m_pending_outputs.clear();
 }
 
 void Render::SetLightConfig(LightsIterator begin, LightsIterator end)
@@ -314,7 +300,6 @@ void Render::SetLightConfig(LightsIterator begin, LightsIterator end)
             ImageBasedLight::Ptr ibl = std::dynamic_pointer_cast<
                 ImageBasedLight>(light_instance);
 
-            auto image_io(ImageIo::CreateImageIo());
             // check that texture file is exist
             auto texure_path = std::filesystem::path(light->texture);
 
@@ -323,7 +308,8 @@ void Render::SetLightConfig(LightsIterator begin, LightsIterator end)
                 THROW_EX("textrue image doesn't exist on specified path")
             }
 
-            Texture::Ptr tex = image_io->LoadImage(light->texture);
+            // Lights of all generated scenes share decoded image
+            Texture::Ptr tex = TextureCache::GetDefault().Load(light->texture);
             ibl->SetTexture(tex);
             ibl->SetMultiplier(light->mul);
         }
@@ -404,48 +390,58 @@ void Render::GenerateDataset(CameraIterator cam_begin, CameraIterator cam_end,
         m_controller->CompileScene(m_scene);
         auto& scene = m_controller->GetCachedScene(m_scene);
 
-        auto spp_iter = sorted_spp.begin();
-
-        for (auto i = 1; i <= sorted_spp.back(); i++)
+        // Iterations between checkpoints are enqueued in batches,
+        // device is synchronized only when outputs are saved
+        std::uint32_t num_iterations = 0;
+        auto render_until = [this, &scene, &num_iterations](std::uint32_t target)
         {
-            m_renderer->Render(scene);
-
-            if (i == 1)
+            if (target > num_iterations)
             {
-                for (const auto& output : kSingleIteratedOutputs)
-                {
-                    std::stringstream ss;
-
-                    ss << "cam_" << cam_index << "_"
-                        << output.name << ".bin";
-
-                    SaveOutput(output,
-                               ss.str(),
-                               gamma_correction_enabled,
-                               output_dir);
-                }
+                m_renderer->RenderProgressive(scene, target - num_iterations);
+                num_iterations = target;
             }
+        };
+
+        render_until(1);
+
+        for (const auto& output : kSingleIteratedOutputs)
+        {
+            std::stringstream ss;
+
+            ss << "cam_" << cam_index << "_"
+                << output.name << ".bin";
+
+            SaveOutput(output,
+                       ss.str(),
+                       gamma_correction_enabled,
+                       output_dir);
+        }
+
+        for (auto spp : sorted_spp)
+        {
+            render_until(static_cast<std::uint32_t>(spp));
+
+            // previous outputs are written while the device renders
+            WritePendingOutputs();
 
-            if (*spp_iter == i)
+            for (const auto& output : kMultipleIteratedOutputs)
             {
-                for (const auto& output : kMultipleIteratedOutputs)
-                {
-                    std::stringstream ss;
-
-                    ss << "cam_" << cam_index << "_"
-                        << output.name << "_spp_" << i << ".bin";
-
-                    SaveOutput(output,
-                                ss.str(),
-                                gamma_correction_enabled,
-                                output_dir);
-                }
-                ++spp_iter;
+                std::stringstream ss;
+
+                ss << "cam_" << cam_index << "_"
+                    << output.name << "_spp_" << spp << ".bin";
+
+                SaveOutput(output,
+                            ss.str(),
+                            gamma_correction_enabled,
+                            output_dir);
             }
         }
 
         cam_index++;
     }
+
+    WritePendingOutputs();
 }
 
 Render::~Render() = default;
@@ -38,6 +38,7 @@ namespace Baikal
     class Renderer;
     class ClwRenderFactory;
     class Output;
+    class ClwOutputReadback;
     class Scene1;
     class PerspectiveCamera;
 
@@ -79,16 +80,24 @@ private:
 
     void SetLightConfig(LightsIterator begin, LightsIterator end);
 
+    // Enqueues readback of the output, file is written by WritePendingOutputs
     void SaveOutput(const OutputInfo& info,
                     const std::string& name,
                     bool gamma_correction_enabled,
                     const std::filesystem::path& output_dir);
 
+    // Waits for enqueued readbacks and writes them on disk
+    void WritePendingOutputs();
+
+    struct PendingOutput;
+
     std::uint32_t m_width, m_height;
     std::unique_ptr<Baikal::Renderer> m_renderer;
     std::unique_ptr<Baikal::ClwRenderFactory> m_factory;
     std::unique_ptr<Baikal::SceneController<Baikal::ClwScene>> m_controller;
     std::vector<std::unique_ptr<Baikal::Output>> m_outputs;
+    std::unique_ptr<Baikal::ClwOutputReadback> m_readback;
+    std::vector<PendingOutput> m_pending_outputs;
     std::shared_ptr<Baikal::Scene1> m_scene;
     std::shared_ptr<Baikal::PerspectiveCamera> m_camera;
     std::unique_ptr<CLWContext> m_context;
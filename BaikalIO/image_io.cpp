@@ -2,6 +2,9 @@
 #include "SceneGraph/texture.h"
 
 #include "OpenImageIO/imageio.h"
+#include "OpenImageIO/imagecache.h"
+
+#include <cstring>
 
 namespace Baikal
 {
@@ -9,6 +12,7 @@ namespace Baikal
     {
     public:
         Texture::Ptr LoadImage(std::string const& filename) const override;
+        Texture::Ptr LoadVirtualImage(std::string const& filename) const override;
         void SaveImage(std::string const& filename, Texture::Ptr texture) const override;
     };
 
@@ -16,24 +20,44 @@ namespace Baikal
     {
         OIIO_NAMESPACE_USING
 
+        // Two channel images are stored natively, single channel
+        // only for 8 bit data where it was replicated into RGBA anyway
         if (spec.format.basetype == TypeDesc::UINT8)
-            return Texture::Format::kRgba8;
+        {
+            if (spec.nchannels == 1)
+                return Texture::Format::kR8;
+            else if (spec.nchannels == 2)
+                return Texture::Format::kRg8;
+            else
+                return Texture::Format::kRgba8;
+        }
         else if (spec.format.basetype == TypeDesc::HALF)
-            return Texture::Format::kRgba16;
+            return spec.nchannels == 2 ? Texture::Format::kRg16 : Texture::Format::kRgba16;
         else
-            return Texture::Format::kRgba32;
+            return spec.nchannels == 2 ? Texture::Format::kRg32 : Texture::Format::kRgba32;
     }
 
     static OIIO_NAMESPACE::TypeDesc GetTextureFormat(Texture::Format fmt)
     {
         OIIO_NAMESPACE_USING
 
-        if (fmt == Texture::Format::kRgba8)
-            return  TypeDesc::UINT8;
-        else if (fmt == Texture::Format::kRgba16)
+        switch (fmt)
+        {
+        case Texture::Format::kRgba8:
+        case Texture::Format::kR8:
+        case Texture::Format::kRg8:
+            return TypeDesc::UINT8;
+        case Texture::Format::kRgba16:
+        case Texture::Format::kR16:
+        case Texture::Format::kRg16:
             return TypeDesc::HALF;
-        else
+        case Texture::Format::kRgba32:
+        case Texture::Format::kR32:
+        case Texture::Format::kRg32:
             return TypeDesc::FLOAT;
+        default:
+            throw std::runtime_error("Block compressed textures can't be saved");
+        }
     }
 
     Texture::Ptr Oiio::LoadImage(const std::string &filename) const
@@ -59,20 +83,23 @@ namespace Baikal
             texturedata = new char[size];
             memset(texturedata, 0, size);
 
-            // Read data to storage
+            // Read data to storage, single channel images are loaded as kR8
             input->read_image(TypeDesc::UINT8, texturedata, sizeof(char) * 4);
 
-            if (spec.nchannels == 1)
-            {
-                // set B, G and A components to 
-                for (auto i = 0; i < size; i += 4)
-                {
-                    texturedata[i + 1] = texturedata[i];
-                    texturedata[i + 2] = texturedata[i];
-                    texturedata[i + 3] = texturedata[i];
-                }
+            // Close handle
+            input->close();
+        }
+        else if (fmt == Texture::Format::kR8 || fmt == Texture::Format::kRg8 ||
+                 fmt == Texture::Format::kRg16 || fmt == Texture::Format::kRg32)
+        {
+            auto type = GetTextureFormat(fmt);
+            auto pixel_size = type.size() * spec.nchannels;
+            auto size = spec.width * spec.height * spec.depth * pixel_size;
 
-            }
+            texturedata = new char[size];
+
+            // Read data to storage
+            input->read_image(type, texturedata, pixel_size);
 
             // Close handle
             input->close();
@@ -111,10 +138,102 @@ namespace Baikal
         return tex;
     }
 
+    // Image cache shared by virtual textures, emulates mip levels for files which do not have them
+    static OIIO_NAMESPACE::ImageCache* GetImageCache()
+    {
+        static OIIO_NAMESPACE::ImageCache* cache = []()
+        {
+            auto cache = OIIO_NAMESPACE::ImageCache::create(true);
+            cache->attribute("automip", 1);
+            return cache;
+        }();
+
+        return cache;
+    }
+
+    // Streams tiles of virtual texture through OIIO image cache
+    class OiioTileSource : public TextureTileSource
+    {
+    public:
+        OiioTileSource(std::string const& filename, RadeonRays::int3 size, Texture::Format format, int num_channels)
+            : m_filename(filename)
+            , m_size(size)
+            , m_format(format)
+            , m_num_channels(num_channels)
+        {
+        }
+
+        void LoadTile(std::uint32_t level, std::uint32_t tile_x, std::uint32_t tile_y, char* dst) const override
+        {
+            OIIO_NAMESPACE_USING
+
+            int tile_size = static_cast<int>(Texture::kTileSize);
+            int width = std::max(m_size.x >> level, 1);
+            int height = std::max(m_size.y >> level, 1);
+            int x = static_cast<int>(tile_x) * tile_size;
+            int y = static_cast<int>(tile_y) * tile_size;
+
+            auto type = GetTextureFormat(m_format);
+            stride_t pixel_size = type.size() * Texture::GetChannelCount(m_format);
+
+            // Channels missing in the file are zero as in LoadImage
+            std::memset(dst, 0, Texture::GetImageSizeInBytes(m_format, RadeonRays::int3(tile_size, tile_size, 1)));
+
+            auto cache = GetImageCache();
+            if (!cache->get_pixels(ustring(m_filename), 0, static_cast<int>(level),
+                x, std::min(x + tile_size, width), y, std::min(y + tile_size, height), 0, 1,
+                0, m_num_channels, type, dst, pixel_size, pixel_size * tile_size))
+            {
+                throw std::runtime_error("Can't load tile of " + m_filename + " image: " + cache->geterror());
+            }
+        }
+
+    private:
+        std::string m_filename;
+        RadeonRays::int3 m_size;
+        Texture::Format m_format;
+        int m_num_channels;
+    };
+
+    Texture::Ptr Oiio::LoadVirtualImage(std::string const& filename) const
+    {
+        OIIO_NAMESPACE_USING
+
+        auto cache = GetImageCache();
+        ustring name(filename);
+
+        ImageSpec const* spec = cache->imagespec(name);
+        if (!spec)
+        {
+            throw std::runtime_error("Can't load " + filename + " image");
+        }
+
+        auto fmt = GetTextureFormat(*spec);
+        auto size = RadeonRays::int3(spec->width, spec->height, 1);
+        auto num_channels = std::min(spec->nchannels, static_cast<int>(Texture::GetChannelCount(fmt)));
+
+        // Count levels available in the file or emulated by the cache
+        std::uint32_t mip_count = 1;
+        while (mip_count < Texture::GetFullMipChainLength(size) && cache->imagespec(name, 0, static_cast<int>(mip_count)))
+        {
+            ++mip_count;
+        }
+
+        auto source = std::make_shared<OiioTileSource>(filename, size, fmt, num_channels);
+        auto tex = Texture::CreateVirtual(size, fmt, mip_count, source);
+        tex->SetName(filename);
+        return tex;
+    }
+
     void Oiio::SaveImage(std::string const& filename, Texture::Ptr texture) const
     {
         OIIO_NAMESPACE_USING;
 
+        if (texture->IsVirtual())
+        {
+            throw std::runtime_error("Virtual textures can't be saved");
+        }
+
         std::unique_ptr<ImageOutput> out{ImageOutput::create(filename)};
 
         if (!out)
@@ -125,7 +244,7 @@ namespace Baikal
         auto dim = texture->GetSize();
         auto fmt = GetTextureFormat(texture->GetFormat());
 
-        ImageSpec spec(dim.x, dim.y, 4, fmt);
+        ImageSpec spec(dim.x, dim.y, Texture::GetChannelCount(texture->GetFormat()), fmt);
 
         out->open(filename, spec);
 
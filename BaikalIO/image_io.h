@@ -65,6 +65,9 @@ namespace Baikal
         
         // Load texture from file
         virtual Texture::Ptr LoadImage(std::string const& filename) const = 0;
+        // Create virtual texture which streams tiles from file on demand,
+        // missing mip levels are generated on the fly
+        virtual Texture::Ptr LoadVirtualImage(std::string const& filename) const = 0;
         virtual void SaveImage(std::string const& filename, Texture::Ptr texture) const = 0;
         
         // Disallow copying
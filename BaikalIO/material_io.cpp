@@ -9,6 +9,7 @@
 #include "SceneGraph/inputmaps.h"
 
 #include "image_io.h"
+#include "texture_cache.h"
 
 #include "XML/tinyxml2.h"
 
@@ -48,7 +49,6 @@ namespace Baikal
         // Texture to name map
         std::map<Texture::Ptr, std::string> m_tex2name;
 
-        std::map<std::string, Texture::Ptr> m_name2tex;
         std::map<std::uint64_t, Material::Ptr> m_id2mat;
         std::set<InputMap::Ptr> m_saved_inputs;
 
@@ -257,7 +257,6 @@ namespace Baikal
     std::unique_ptr<Iterator> MaterialIoXML::LoadMaterials(std::string const& file_name)
     {
         m_id2mat.clear();
-        m_name2tex.clear();
         m_resolve_requests.clear();
 
         auto slash = file_name.find_last_of('/');
@@ -278,6 +277,14 @@ namespace Baikal
         {
             uint32_t id = element->UnsignedAttribute("id");
             input_map_cache.insert(std::make_pair(id, element));
+
+            // Start decoding of all textures, they are picked up by LoadInputMap
+            auto type = static_cast<InputMap::InputMapType>(element->UnsignedAttribute("type"));
+            if (type == InputMap::InputMapType::kSampler || type == InputMap::InputMapType::kSamplerBumpmap)
+            {
+                TextureCache::GetDefault().LoadAsync(m_base_path + element->Attribute("value"),
+                    type == InputMap::InputMapType::kSampler);
+            }
         }
 
         std::map<uint32_t, InputMap::Ptr> loaded_elements;
@@ -651,18 +658,7 @@ namespace Baikal
             {
                 std::string filename(element->Attribute("value"));
 
-                auto iter = m_name2tex.find(filename);
-                Texture::Ptr texture;
-
-                if (iter != m_name2tex.cend())
-                {
-                    texture = iter->second;
-                }
-                else
-                {
-                    texture = io.LoadImage(m_base_path + filename);
-                    m_name2tex[name] = texture;
-                }
+                auto texture = TextureCache::GetDefault().Load(m_base_path + filename, true);
 
                 result = InputMap_Sampler::Create(texture);
 
@@ -672,18 +668,7 @@ namespace Baikal
             {
                 std::string filename(element->Attribute("value"));
 
-                auto iter = m_name2tex.find(filename);
-                Texture::Ptr texture;
-
-                if (iter != m_name2tex.cend())
-                {
-                    texture = iter->second;
-                }
-                else
-                {
-                    texture = io.LoadImage(m_base_path + filename);
-                    m_name2tex[name] = texture;
-                }
+                auto texture = TextureCache::GetDefault().Load(m_base_path + filename, false);
 
                 result = InputMap_SamplerBumpMap::Create(texture);
                 break;
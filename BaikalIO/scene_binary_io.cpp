@@ -6,238 +6,1214 @@
 #include "SceneGraph/light.h"
 #include "SceneGraph/texture.h"
 #include "SceneGraph/uberv2material.h"
+#include "SceneGraph/inputmaps.h"
 #include "image_io.h"
 #include "math/mathutils.h"
 #include "Utils/log.h"
 
+#include <algorithm>
+#include <array>
+#include <cstring>
 #include <fstream>
+#include <iterator>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+
+#ifdef WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 namespace Baikal
 {
     // Create static object to register loader. This object will be used as loader
     static SceneBinaryIo scene_binary_io_loader;
 
-    Scene1::Ptr SceneBinaryIo::LoadScene(std::string const& filename, std::string const& basepath) const
+    namespace
     {
-        auto scene = Scene1::Create();
-        auto image_io(ImageIo::CreateImageIo());
+        char const kMagic[8] = { 'B', 'A', 'I', 'K', 'A', 'L', 'S', 'C' };
+        // Alignment of sections and mesh arrays
+        std::size_t const kAlignment = 64;
+
+        enum SectionType : std::uint32_t
+        {
+            kStringsSection = 1,
+            kTexturesSection,
+            kInputMapsSection,
+            kMaterialsSection,
+            kMaterialInputsSection,
+            kMeshesSection,
+            kInstancesSection,
+            kLightsSection
+        };
 
-        std::map<std::string, Material*> mats;
+        enum LightType : std::uint32_t
+        {
+            kPointLight = 1,
+            kDirectionalLight,
+            kSpotLight,
+            kImageBasedLight,
+            kAreaLight,
+            kMeshLight
+        };
 
-        struct less
+        enum ShapeFlags : std::uint32_t
         {
-            bool operator ()(RadeonRays::float3 const& v1, RadeonRays::float3 const& v2) const {
-                return v1.x < v2.x;
-            }
+            // Shape is attached to the scene (base meshes of instances might be not)
+            kShapeAttached = 0x1
+        };
+
+        enum MaterialFlags : std::uint32_t
+        {
+            kMaterialThin = 0x1,
+            kMaterialDoubleSided = 0x2,
+            kMaterialLinkRefractionIor = 0x4,
+            kMaterialMultiscatter = 0x8
+        };
+
+        struct FileHeader
+        {
+            char magic[8];
+            std::uint32_t version;
+            std::uint32_t num_sections;
+            std::uint64_t section_table;
+            std::uint64_t file_size;
+            std::uint8_t reserved[32];
+        };
+
+        struct SectionEntry
+        {
+            std::uint32_t type;
+            std::uint32_t count;
+            std::uint64_t offset;
+            std::uint64_t size;
+            std::uint64_t reserved;
+        };
+
+        // Reference into strings section
+        struct StringRef
+        {
+            std::uint32_t offset;
+            std::uint32_t length;
+        };
+
+        struct TextureRecord
+        {
+            StringRef name;
+            std::uint32_t reserved[2];
+        };
+
+        // Arguments reference previous input map records (or texture records for samplers)
+        struct InputMapRecord
+        {
+            std::uint32_t type;
+            StringRef name;
+            std::int32_t args[3];
+            std::uint32_t mask[4];
+            // Constant value or matrix
+            float values[16];
+            std::uint32_t reserved[6];
+        };
+
+        struct MaterialRecord
+        {
+            StringRef name;
+            std::uint32_t layers;
+            std::uint32_t flags;
+            std::uint32_t first_input;
+            std::uint32_t num_inputs;
+            std::uint32_t reserved[2];
+        };
+
+        struct MaterialInputRecord
+        {
+            StringRef name;
+            std::int32_t input_map;
+            std::uint32_t reserved;
+        };
+
+        // Meshes and instances. Array offsets are absolute file offsets.
+        struct ShapeRecord
+        {
+            std::uint64_t indices;
+            std::uint64_t vertices;
+            std::uint64_t normals;
+            std::uint64_t uvs;
+            std::uint32_t num_indices;
+            std::uint32_t num_vertices;
+            std::uint32_t num_normals;
+            std::uint32_t num_uvs;
+            StringRef name;
+            std::int32_t material;
+            std::int32_t base_mesh;
+            std::uint32_t group_id;
+            std::uint32_t visibility_mask;
+            std::uint32_t flags;
+            float transform[16];
+            std::uint32_t reserved[13];
+        };
+
+        struct LightRecord
+        {
+            std::uint32_t type;
+            StringRef name;
+            // Shape index for area and mesh lights, meshes go before instances
+            std::int32_t shape;
+            std::uint32_t primitive;
+            float multiplier;
+            std::uint32_t mirror_x;
+            std::uint32_t reserved0;
+            float position[4];
+            float direction[4];
+            float radiance[4];
+            float cone[2];
+            // IBL textures: illuminant, reflection, refraction, transparency, background
+            std::int32_t textures[5];
+            std::uint32_t reserved[5];
+        };
+
+        static_assert(sizeof(FileHeader) == 64, "Unexpected header size");
+        static_assert(sizeof(SectionEntry) == 32, "Unexpected section entry size");
+        static_assert(sizeof(InputMapRecord) == 128, "Unexpected input map record size");
+        static_assert(sizeof(ShapeRecord) == 192, "Unexpected shape record size");
+        static_assert(sizeof(LightRecord) == 128, "Unexpected light record size");
+
+        // Read-only memory mapping of a whole file
+        class MappedFile
+        {
+        public:
+            explicit MappedFile(std::string const& filename);
+            ~MappedFile();
+
+            char const* GetData() const { return m_data; }
+            std::size_t GetSize() const { return m_size; }
+
+            MappedFile(MappedFile const&) = delete;
+            MappedFile& operator = (MappedFile const&) = delete;
+
+        private:
+#ifdef WIN32
+            HANDLE m_file = INVALID_HANDLE_VALUE;
+            HANDLE m_mapping = nullptr;
+#endif
+            char const* m_data = nullptr;
+            std::size_t m_size = 0;
         };
 
-        std::map<RadeonRays::float3, Material::Ptr, less> c2mats;
+#ifdef WIN32
+        MappedFile::MappedFile(std::string const& filename)
+        {
+            m_file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+            LARGE_INTEGER size;
+            if (m_file == INVALID_HANDLE_VALUE || !GetFileSizeEx(m_file, &size))
+            {
+                if (m_file != INVALID_HANDLE_VALUE) CloseHandle(m_file);
+                throw std::runtime_error("Cannot open file for reading: " + filename);
+            }
+
+            m_size = static_cast<std::size_t>(size.QuadPart);
 
-        std::string full_path = filename;
+            if (m_size > 0)
+            {
+                m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+                m_data = m_mapping ? static_cast<char const*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0)) : nullptr;
 
-        std::ifstream in(full_path, std::ios::binary | std::ios::in);
+                if (!m_data)
+                {
+                    if (m_mapping) CloseHandle(m_mapping);
+                    CloseHandle(m_file);
+                    throw std::runtime_error("Cannot map file: " + filename);
+                }
+            }
+        }
 
-        if (!in)
+        MappedFile::~MappedFile()
         {
-            throw std::runtime_error("Cannot open file for reading");
+            if (m_data) UnmapViewOfFile(m_data);
+            if (m_mapping) CloseHandle(m_mapping);
+            CloseHandle(m_file);
         }
+#else
+        MappedFile::MappedFile(std::string const& filename)
+        {
+            int fd = open(filename.c_str(), O_RDONLY);
 
-        std::uint32_t num_meshes = 0;
-        in.read((char*)&num_meshes, sizeof(std::uint32_t));
+            struct stat st;
+            if (fd < 0 || fstat(fd, &st) != 0)
+            {
+                if (fd >= 0) close(fd);
+                throw std::runtime_error("Cannot open file for reading: " + filename);
+            }
 
-        LogInfo("Number of objects: ", num_meshes, "\n");
+            m_size = static_cast<std::size_t>(st.st_size);
 
-        for (auto i = 0U; i < num_meshes; ++i)
+            if (m_size > 0)
+            {
+                void* data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+                if (data == MAP_FAILED)
+                {
+                    close(fd);
+                    throw std::runtime_error("Cannot map file: " + filename);
+                }
+
+                m_data = static_cast<char const*>(data);
+            }
+
+            // Mapping stays valid after descriptor is closed
+            close(fd);
+        }
+
+        MappedFile::~MappedFile()
         {
-            auto mesh = Mesh::Create();
+            if (m_data) munmap(const_cast<char*>(m_data), m_size);
+        }
+#endif
+
+        // Bounds checked access to mapped scene file
+        class SceneReader
+        {
+        public:
+            explicit SceneReader(std::string const& filename)
+                : m_file(filename)
+            {
+                if (m_file.GetSize() < sizeof(FileHeader))
+                {
+                    throw std::runtime_error("Binary scene is truncated: " + filename);
+                }
+
+                auto header = reinterpret_cast<FileHeader const*>(m_file.GetData());
 
-            std::uint32_t num_indices = 0;
-            in.read((char*)&num_indices, sizeof(std::uint32_t));
+                if (std::memcmp(header->magic, kMagic, sizeof(kMagic)) != 0)
+                {
+                    throw std::runtime_error("Unsupported binary scene format (re-export the scene): " + filename);
+                }
 
-            std::uint32_t num_vertices = 0;
-            in.read((char*)&num_vertices, sizeof(std::uint32_t));
+                if (header->version > SceneBinaryIo::kVersion)
+                {
+                    throw std::runtime_error("Binary scene version is not supported: " + filename);
+                }
 
+                if (header->file_size != m_file.GetSize())
+                {
+                    throw std::runtime_error("Binary scene is truncated: " + filename);
+                }
 
-            std::uint32_t num_normals = 0;
-            in.read((char*)&num_normals, sizeof(std::uint32_t));
+                auto sections = GetArray<SectionEntry>(header->section_table, header->num_sections);
 
+                for (auto i = 0u; i < header->num_sections; ++i)
+                {
+                    m_sections[sections[i].type] = sections[i];
+                }
 
-            std::uint32_t num_uvs = 0;
-            in.read((char*)&num_uvs, sizeof(std::uint32_t));
+                m_strings = GetRecords<char>(kStringsSection, m_num_strings);
+            }
 
+            template <typename T>
+            T const* GetArray(std::uint64_t offset, std::uint64_t count) const
             {
-                std::vector<std::uint32_t> indices(num_indices);
-                in.read((char*)&indices[0], num_indices * sizeof(std::uint32_t));
+                if (count == 0)
+                {
+                    return nullptr;
+                }
 
-                mesh->SetIndices(&indices[0], num_indices);
+                if (offset % alignof(T) != 0 || offset > m_file.GetSize() ||
+                    count > (m_file.GetSize() - offset) / sizeof(T))
+                {
+                    throw std::runtime_error("Binary scene is corrupted");
+                }
+
+                return reinterpret_cast<T const*>(m_file.GetData() + offset);
             }
 
+            // Returns records of a section, missing sections are empty
+            template <typename T>
+            T const* GetRecords(std::uint32_t type, std::uint32_t& count) const
             {
-                std::vector<RadeonRays::float3> vertices(num_vertices);
-                in.read((char*)&vertices[0], num_vertices * sizeof(RadeonRays::float3));
+                auto iter = m_sections.find(type);
+
+                if (iter == m_sections.cend())
+                {
+                    count = 0;
+                    return nullptr;
+                }
 
-                mesh->SetVertices(&vertices[0], num_vertices);
+                count = iter->second.count;
+
+                if (iter->second.size < static_cast<std::uint64_t>(count) * sizeof(T))
+                {
+                    throw std::runtime_error("Binary scene is corrupted");
+                }
+
+                return GetArray<T>(iter->second.offset, count);
             }
 
+            std::string GetString(StringRef const& ref) const
             {
-                std::vector<RadeonRays::float3> normals(num_normals);
-                in.read((char*)&normals[0], num_normals * sizeof(RadeonRays::float3));
+                if (ref.offset > m_num_strings || ref.length > m_num_strings - ref.offset)
+                {
+                    throw std::runtime_error("Binary scene is corrupted");
+                }
 
-                mesh->SetNormals(&normals[0], num_normals);
+                return ref.length ? std::string(m_strings + ref.offset, ref.length) : std::string();
             }
 
+        private:
+            MappedFile m_file;
+            std::map<std::uint32_t, SectionEntry> m_sections;
+            char const* m_strings = nullptr;
+            std::uint32_t m_num_strings = 0;
+        };
+
+        // Sequential writer keeping track of file position
+        class SceneWriter
+        {
+        public:
+            explicit SceneWriter(std::string const& filename)
+                : m_out(filename, std::ios::binary | std::ios::out)
             {
-                std::vector<RadeonRays::float2> uvs(num_uvs);
-                in.read((char*)&uvs[0], num_uvs * sizeof(RadeonRays::float2));
+                if (!m_out)
+                {
+                    throw std::runtime_error("Cannot open file for writing");
+                }
+            }
 
-                mesh->SetUVs(&uvs[0], num_uvs);
+            void Write(void const* data, std::size_t size)
+            {
+                m_out.write(static_cast<char const*>(data), size);
+                m_position += size;
             }
 
+            template <typename T>
+            void Write(std::vector<T> const& data)
+            {
+                Write(data.data(), data.size() * sizeof(T));
+            }
 
+            // Pads file with zeros up to kAlignment
+            void Align()
             {
-                std::uint32_t flag = 0;
-                in.read(reinterpret_cast<char*>(&flag), sizeof(flag));
+                static char const zeros[kAlignment] = {};
+                Write(zeros, (kAlignment - m_position % kAlignment) % kAlignment);
+            }
 
-                if (!flag)
+            template <typename T>
+            void AddSection(std::uint32_t type, std::vector<T> const& records)
+            {
+                Align();
+
+                SectionEntry entry = {};
+                entry.type = type;
+                entry.count = static_cast<std::uint32_t>(records.size());
+                entry.offset = m_position;
+                entry.size = records.size() * sizeof(T);
+                m_sections.push_back(entry);
+
+                Write(records);
+            }
+
+            std::uint64_t GetPosition() const { return m_position; }
+
+            // Writes section table and patches header
+            void Finish()
+            {
+                Align();
+
+                FileHeader header = {};
+                std::memcpy(header.magic, kMagic, sizeof(kMagic));
+                header.version = SceneBinaryIo::kVersion;
+                header.num_sections = static_cast<std::uint32_t>(m_sections.size());
+                header.section_table = m_position;
+                header.file_size = m_position + m_sections.size() * sizeof(SectionEntry);
+
+                Write(m_sections);
+
+                m_out.seekp(0);
+                m_out.write(reinterpret_cast<char const*>(&header), sizeof(header));
+
+                if (!m_out)
                 {
-                    RadeonRays::float3 albedo;
-                    in.read(reinterpret_cast<char*>(&albedo.x), sizeof(RadeonRays::float3));
+                    throw std::runtime_error("Failed to write binary scene");
+                }
+            }
 
-                    /*auto iter = c2mats.find(albedo);
+        private:
+            std::ofstream m_out;
+            std::uint64_t m_position = 0;
+            std::vector<SectionEntry> m_sections;
+        };
 
-                    if (iter != c2mats.cend())
+        void WriteMatrix(RadeonRays::matrix const& m, float* data)
+        {
+            for (int i = 0; i < 4; ++i)
+            {
+                for (int j = 0; j < 4; ++j)
+                {
+                    data[i * 4 + j] = m.m[i][j];
+                }
+            }
+        }
+
+        RadeonRays::matrix ReadMatrix(float const* data)
+        {
+            RadeonRays::matrix m;
+            for (int i = 0; i < 4; ++i)
+            {
+                for (int j = 0; j < 4; ++j)
+                {
+                    m.m[i][j] = data[i * 4 + j];
+                }
+            }
+            return m;
+        }
+
+        void WriteFloat3(RadeonRays::float3 const& v, float* data)
+        {
+            data[0] = v.x; data[1] = v.y; data[2] = v.z; data[3] = v.w;
+        }
+
+        RadeonRays::float3 ReadFloat3(float const* data)
+        {
+            return RadeonRays::float3(data[0], data[1], data[2], data[3]);
+        }
+
+        // Collects scene objects and converts them into records
+        class SceneSerializer
+        {
+        public:
+            SceneSerializer(ImageIo const& io, std::string const& basepath)
+                : m_io(io), m_basepath(basepath)
+            {
+            }
+
+            StringRef AddString(std::string const& str)
+            {
+                StringRef ref = { static_cast<std::uint32_t>(strings.size()), static_cast<std::uint32_t>(str.size()) };
+                strings.insert(strings.end(), str.cbegin(), str.cend());
+                return ref;
+            }
+
+            std::int32_t AddTexture(Texture::Ptr texture)
+            {
+                if (!texture)
+                {
+                    return -1;
+                }
+
+                auto iter = m_textures.find(texture);
+                if (iter != m_textures.cend())
+                {
+                    return iter->second;
+                }
+
+                auto name = texture->GetName();
+
+                // Textures created in memory are written next to the scene
+                if (name.empty())
+                {
+                    std::ostringstream oss;
+                    oss << reinterpret_cast<std::uint64_t>(texture.get()) << ".exr";
+                    name = oss.str();
+                    m_io.SaveImage(m_basepath + name, texture);
+                }
+
+                TextureRecord record = {};
+                record.name = AddString(name);
+                textures.push_back(record);
+
+                auto idx = static_cast<std::int32_t>(textures.size() - 1);
+                m_textures[texture] = idx;
+                return idx;
+            }
+
+            // Input maps are written in post order, so arguments always precede their users
+            std::int32_t AddInputMap(InputMap::Ptr input_map)
+            {
+                if (!input_map)
+                {
+                    return -1;
+                }
+
+                auto iter = m_input_maps.find(input_map);
+                if (iter != m_input_maps.cend())
+                {
+                    return iter->second;
+                }
+
+                InputMapRecord record = {};
+                record.type = static_cast<std::uint32_t>(input_map->m_type);
+                record.name = AddString(input_map->GetName());
+                record.args[0] = record.args[1] = record.args[2] = -1;
+
+                switch (input_map->m_type)
+                {
+                    case InputMap::InputMapType::kConstantFloat:
                     {
-                        material = iter->second;
+                        auto i = static_cast<InputMap_ConstantFloat*>(input_map.get());
+                        record.values[0] = i->GetValue();
+                        break;
                     }
-                    else
+                    case InputMap::InputMapType::kConstantFloat3:
                     {
-                        material = new SingleBxdf(SingleBxdf::BxdfType::kLambert);
-                        material->SetInputValue("albedo", albedo);
-                        c2mats[albedo] = material;
-                        scene->AttachAutoreleaseObject(material);
-                    }*/
+                        auto i = static_cast<InputMap_ConstantFloat3*>(input_map.get());
+                        WriteFloat3(i->GetValue(), record.values);
+                        break;
+                    }
+                    case InputMap::InputMapType::kSampler:
+                    case InputMap::InputMapType::kSamplerBumpmap:
+                    {
+                        auto i = static_cast<InputMap_Sampler*>(input_map.get());
+                        record.args[0] = AddTexture(i->GetTexture());
+                        break;
+                    }
+                    case InputMap::InputMapType::kAdd:
+                    case InputMap::InputMapType::kSub:
+                    case InputMap::InputMapType::kMul:
+                    case InputMap::InputMapType::kDiv:
+                    case InputMap::InputMapType::kMin:
+                    case InputMap::InputMapType::kMax:
+                    case InputMap::InputMapType::kDot3:
+                    case InputMap::InputMapType::kDot4:
+                    case InputMap::InputMapType::kCross3:
+                    case InputMap::InputMapType::kCross4:
+                    case InputMap::InputMapType::kPow:
+                    case InputMap::InputMapType::kMod:
+                    {
+                        // It's safe since all this types differs only in id value
+                        auto i = static_cast<InputMap_Add*>(input_map.get());
+                        record.args[0] = AddInputMap(i->GetA());
+                        record.args[1] = AddInputMap(i->GetB());
+                        break;
+                    }
+                    case InputMap::InputMapType::kSin:
+                    case InputMap::InputMapType::kCos:
+                    case InputMap::InputMapType::kTan:
+                    case InputMap::InputMapType::kAsin:
+                    case InputMap::InputMapType::kAcos:
+                    case InputMap::InputMapType::kAtan:
+                    case InputMap::InputMapType::kLength3:
+                    case InputMap::InputMapType::kNormalize3:
+                    case InputMap::InputMapType::kFloor:
+                    case InputMap::InputMapType::kAbs:
+                    {
+                        // It's safe since all this types differs only in id value
+                        auto i = static_cast<InputMap_Sin*>(input_map.get());
+                        record.args[0] = AddInputMap(i->GetArg());
+                        break;
+                    }
+                    case InputMap::InputMapType::kLerp:
+                    {
+                        auto i = static_cast<InputMap_Lerp*>(input_map.get());
+                        record.args[0] = AddInputMap(i->GetA());
+                        record.args[1] = AddInputMap(i->GetB());
+                        record.args[2] = AddInputMap(i->GetControl());
+                        break;
+                    }
+                    case InputMap::InputMapType::kSelect:
+                    {
+                        auto i = static_cast<InputMap_Select*>(input_map.get());
+                        record.args[0] = AddInputMap(i->GetArg());
+                        record.mask[0] = static_cast<std::uint32_t>(i->GetSelection());
+                        break;
+                    }
+                    case InputMap::InputMapType::kShuffle:
+                    {
+                        auto i = static_cast<InputMap_Shuffle*>(input_map.get());
+                        record.args[0] = AddInputMap(i->GetArg());
+                        auto mask = i->GetMask();
+                        std::copy(mask.cbegin(), mask.cend(), record.mask);
+                        break;
+                    }
+                    case InputMap::InputMapType::kShuffle2:
+                    {
+                        auto i = static_cast<InputMap_Shuffle2*>(input_map.get());
+                        record.args[0] = AddInputMap(i->GetA());
+                        record.args[1] = AddInputMap(i->GetB());
+                        auto mask = i->GetMask();
+                        std::copy(mask.cbegin(), mask.cend(), record.mask);
+                        break;
+                    }
+                    case InputMap::InputMapType::kMatMul:
+                    {
+                        auto i = static_cast<InputMap_MatMul*>(input_map.get());
+                        record.args[0] = AddInputMap(i->GetArg());
+                        WriteMatrix(i->GetMatrix(), record.values);
+                        break;
+                    }
+                    case InputMap::InputMapType::kRemap:
+                    {
+                        auto i = static_cast<InputMap_Remap*>(input_map.get());
+                        record.args[0] = AddInputMap(i->GetSourceRange());
+                        record.args[1] = AddInputMap(i->GetDestinationRange());
+                        record.args[2] = AddInputMap(i->GetData());
+                        break;
+                    }
                 }
-                else
+
+                input_maps.push_back(record);
+
+                auto idx = static_cast<std::int32_t>(input_maps.size() - 1);
+                m_input_maps[input_map] = idx;
+                return idx;
+            }
+
+            std::int32_t AddMaterial(Material::Ptr material)
+            {
+                if (!material)
                 {
-                    std::uint32_t size = 0;
-                    in.read(reinterpret_cast<char*>(&size), sizeof(size));
+                    return -1;
+                }
 
-                    std::vector<char> buff(size);
-                    in.read(&buff[0], sizeof(char) * size);
+                auto iter = m_materials.find(material);
+                if (iter != m_materials.cend())
+                {
+                    return iter->second;
+                }
+
+                auto uberv2_material = std::dynamic_pointer_cast<UberV2Material>(material);
 
-                    //std::string name(buff.cbegin(), buff.cend());
+                if (!uberv2_material)
+                {
+                    throw std::runtime_error("Only UberV2 materials supported");
+                }
 
-                    //auto iter = mats.find(name);
+                MaterialRecord record = {};
+                record.name = AddString(material->GetName());
+                record.layers = uberv2_material->GetLayers();
+                record.flags = (material->IsThin() ? kMaterialThin : 0u) |
+                    (uberv2_material->isDoubleSided() ? kMaterialDoubleSided : 0u) |
+                    (uberv2_material->IsLinkRefractionIOR() ? kMaterialLinkRefractionIor : 0u) |
+                    (uberv2_material->IsMultiscatter() ? kMaterialMultiscatter : 0u);
+                record.first_input = static_cast<std::uint32_t>(material_inputs.size());
 
-                    //if (iter != mats.cend())
-                    //{
-                    //    material = iter->second;
-                    //}
-                    //else
-                    //{
-                    //    LogInfo("Loading texture ", name, "\n");
-                    //    auto texture = image_io->LoadImage(basepath + name);
-                    //    //material = new SingleBxdf(SingleBxdf::BxdfType::kLambert);
-                    //    //material->SetInputValue("albedo", texture);
-                    //    //mats[name] = material;
-                    //    //scene->AttachAutoreleaseObject(texture);
-                    //    //scene->AttachAutoreleaseObject(material);
-                    //}
+                for (auto i = 0u; i < material->GetNumInputs(); ++i)
+                {
+                    auto input = material->GetInput(i);
 
+                    if (input.value.type != Material::InputType::kInputMap || !input.value.input_map_value)
+                    {
+                        continue;
+                    }
+
+                    MaterialInputRecord input_record = {};
+                    input_record.name = AddString(input.info.name);
+                    input_record.input_map = AddInputMap(input.value.input_map_value);
+                    material_inputs.push_back(input_record);
                 }
 
-                mesh->SetMaterial(nullptr);
+                record.num_inputs = static_cast<std::uint32_t>(material_inputs.size()) - record.first_input;
+                materials.push_back(record);
+
+                auto idx = static_cast<std::int32_t>(materials.size() - 1);
+                m_materials[material] = idx;
+                return idx;
             }
 
-            scene->AttachShape(mesh);
-        }
+            ShapeRecord MakeShapeRecord(Shape const& shape, bool attached)
+            {
+                ShapeRecord record = {};
+                record.name = AddString(shape.GetName());
+                record.material = AddMaterial(shape.GetMaterial());
+                record.base_mesh = -1;
+                record.group_id = shape.GetGroupId();
+                record.visibility_mask = shape.GetVisibilityMask();
+                record.flags = attached ? kShapeAttached : 0u;
+                WriteMatrix(shape.GetTransform(), record.transform);
+                return record;
+            }
 
-        auto  ibl_texture = image_io->LoadImage("../Resources/Textures/Canopus_Ground_4k.exr");
+            std::vector<char> strings;
+            std::vector<TextureRecord> textures;
+            std::vector<InputMapRecord> input_maps;
+            std::vector<MaterialRecord> materials;
+            std::vector<MaterialInputRecord> material_inputs;
 
-        auto ibl = ImageBasedLight::Create();
-        ibl->SetTexture(ibl_texture);
-        ibl->SetMultiplier(1.f);
+        private:
+            ImageIo const& m_io;
+            std::string m_basepath;
+            std::map<Texture::Ptr, std::int32_t> m_textures;
+            std::map<InputMap::Ptr, std::int32_t> m_input_maps;
+            std::map<Material::Ptr, std::int32_t> m_materials;
+        };
 
-        // TODO: temporary code to add directional light
-        auto light = DirectionalLight::Create();
-        light->SetDirection(RadeonRays::normalize(RadeonRays::float3(-1.1f, -0.6f, -0.4f)));
-        light->SetEmittedRadiance(7.f * RadeonRays::float3(1.f, 0.95f, 0.92f));
+        InputMap::Ptr CreateInputMap(InputMapRecord const& record, std::vector<InputMap::Ptr> const& input_maps,
+            std::vector<Texture::Ptr> const& textures)
+        {
+            // Arguments must precede input map
+            auto arg = [&](int i)
+            {
+                auto idx = record.args[i];
+                if (idx < 0 || static_cast<std::size_t>(idx) >= input_maps.size())
+                {
+                    throw std::runtime_error("Binary scene is corrupted");
+                }
+                return input_maps[idx];
+            };
 
-        auto light1 = DirectionalLight::Create();
-        light1->SetDirection(RadeonRays::float3(0.3f, -1.f, -0.5f));
-        light1->SetEmittedRadiance(RadeonRays::float3(1.f, 0.8f, 0.65f));
+            auto texture = [&]()
+            {
+                auto idx = record.args[0];
+                return (idx < 0 || static_cast<std::size_t>(idx) >= textures.size()) ? nullptr : textures[idx];
+            };
 
-        scene->AttachLight(light);
-        //scene->AttachLight(light1);
-        scene->AttachLight(ibl);
+            std::array<std::uint32_t, 4> mask = { { record.mask[0], record.mask[1], record.mask[2], record.mask[3] } };
 
-        return scene;
+            switch (static_cast<InputMap::InputMapType>(record.type))
+            {
+                case InputMap::InputMapType::kConstantFloat:
+                    return InputMap_ConstantFloat::Create(record.values[0]);
+                case InputMap::InputMapType::kConstantFloat3:
+                    return InputMap_ConstantFloat3::Create(ReadFloat3(record.values));
+                case InputMap::InputMapType::kSampler:
+                    return InputMap_Sampler::Create(texture());
+                case InputMap::InputMapType::kSamplerBumpmap:
+                    return InputMap_SamplerBumpMap::Create(texture());
+                case InputMap::InputMapType::kAdd: return InputMap_Add::Create(arg(0), arg(1));
+                case InputMap::InputMapType::kSub: return InputMap_Sub::Create(arg(0), arg(1));
+                case InputMap::InputMapType::kMul: return InputMap_Mul::Create(arg(0), arg(1));
+                case InputMap::InputMapType::kDiv: return InputMap_Div::Create(arg(0), arg(1));
+                case InputMap::InputMapType::kMin: return InputMap_Min::Create(arg(0), arg(1));
+                case InputMap::InputMapType::kMax: return InputMap_Max::Create(arg(0), arg(1));
+                case InputMap::InputMapType::kDot3: return InputMap_Dot3::Create(arg(0), arg(1));
+                case InputMap::InputMapType::kDot4: return InputMap_Dot4::Create(arg(0), arg(1));
+                case InputMap::InputMapType::kCross3: return InputMap_Cross3::Create(arg(0), arg(1));
+                case InputMap::InputMapType::kCross4: return InputMap_Cross4::Create(arg(0), arg(1));
+                case InputMap::InputMapType::kPow: return InputMap_Pow::Create(arg(0), arg(1));
+                case InputMap::InputMapType::kMod: return InputMap_Mod::Create(arg(0), arg(1));
+                case InputMap::InputMapType::kSin: return InputMap_Sin::Create(arg(0));
+                case InputMap::InputMapType::kCos: return InputMap_Cos::Create(arg(0));
+                case InputMap::InputMapType::kTan: return InputMap_Tan::Create(arg(0));
+                case InputMap::InputMapType::kAsin: return InputMap_Asin::Create(arg(0));
+                case InputMap::InputMapType::kAcos: return InputMap_Acos::Create(arg(0));
+                case InputMap::InputMapType::kAtan: return InputMap_Atan::Create(arg(0));
+                case InputMap::InputMapType::kLength3: return InputMap_Length3::Create(arg(0));
+                case InputMap::InputMapType::kNormalize3: return InputMap_Normalize3::Create(arg(0));
+                case InputMap::InputMapType::kFloor: return InputMap_Floor::Create(arg(0));
+                case InputMap::InputMapType::kAbs: return InputMap_Abs::Create(arg(0));
+                case InputMap::InputMapType::kLerp:
+                    return InputMap_Lerp::Create(arg(0), arg(1), arg(2));
+                case InputMap::InputMapType::kSelect:
+                    return InputMap_Select::Create(arg(0), static_cast<InputMap_Select::Selection>(record.mask[0]));
+                case InputMap::InputMapType::kShuffle:
+                    return InputMap_Shuffle::Create(arg(0), mask);
+                case InputMap::InputMapType::kShuffle2:
+                    return InputMap_Shuffle2::Create(arg(0), arg(1), mask);
+                case InputMap::InputMapType::kMatMul:
+                    return InputMap_MatMul::Create(arg(0), ReadMatrix(record.values));
+                case InputMap::InputMapType::kRemap:
+                    return InputMap_Remap::Create(arg(0), arg(1), arg(2));
+            }
+
+            throw std::runtime_error("Binary scene contains unknown input map type");
+        }
+
+        // Copies array straight from the mapping into a vector adopted by mesh
+        template <typename T>
+        std::vector<T> ReadMeshArray(SceneReader const& reader, std::uint64_t offset, std::uint32_t count)
+        {
+            auto data = reader.GetArray<T>(offset, count);
+            return data ? std::vector<T>(data, data + count) : std::vector<T>();
+        }
     }
 
-    void SceneBinaryIo::SaveScene(Scene1 const& scene, std::string const& filename, std::string const& basepath) const
+    Scene1::Ptr SceneBinaryIo::LoadScene(std::string const& filename, std::string const& basepath) const
     {
-        std::string full_path = filename;
+        SceneReader reader(filename);
 
-        std::ofstream out(full_path, std::ios::binary | std::ios::out);
+        auto scene = Scene1::Create();
+
+        // Textures, decoded concurrently
+        std::uint32_t num_textures = 0;
+        auto texture_records = reader.GetRecords<TextureRecord>(kTexturesSection, num_textures);
 
-        if (!out)
+        std::vector<std::string> texture_names(num_textures);
+        for (auto i = 0u; i < num_textures; ++i)
         {
-            throw std::runtime_error("Cannot open file for writing");
+            texture_names[i] = reader.GetString(texture_records[i].name);
         }
+        PrefetchTextures(basepath, texture_names);
 
-        auto default_material = UberV2Material::Create();
+        std::vector<Texture::Ptr> textures(num_textures);
+        for (auto i = 0u; i < num_textures; ++i)
+        {
+            textures[i] = LoadTexture(*scene, basepath, texture_names[i]);
+        }
 
-        auto num_shapes = (std::uint32_t)scene.GetNumShapes();
-        out.write((char*)&num_shapes, sizeof(std::uint32_t));
+        // Input maps
+        std::uint32_t num_input_maps = 0;
+        auto input_map_records = reader.GetRecords<InputMapRecord>(kInputMapsSection, num_input_maps);
 
-        auto shape_iter = scene.CreateShapeIterator();
+        std::vector<InputMap::Ptr> input_maps;
+        input_maps.reserve(num_input_maps);
+        for (auto i = 0u; i < num_input_maps; ++i)
+        {
+            auto input_map = CreateInputMap(input_map_records[i], input_maps, textures);
+            input_map->SetName(reader.GetString(input_map_records[i].name));
+            input_maps.push_back(input_map);
+        }
 
-        for (; shape_iter->IsValid(); shape_iter->Next())
+        // Materials
+        std::uint32_t num_materials = 0;
+        auto material_records = reader.GetRecords<MaterialRecord>(kMaterialsSection, num_materials);
+        std::uint32_t num_material_inputs = 0;
+        auto material_input_records = reader.GetRecords<MaterialInputRecord>(kMaterialInputsSection, num_material_inputs);
+
+        std::vector<Material::Ptr> materials(num_materials);
+        for (auto i = 0u; i < num_materials; ++i)
+        {
+            auto const& record = material_records[i];
+
+            auto material = UberV2Material::Create();
+            material->SetName(reader.GetString(record.name));
+            material->SetLayers(record.layers);
+            material->SetThin((record.flags & kMaterialThin) != 0);
+            material->SetDoubleSided((record.flags & kMaterialDoubleSided) != 0);
+            material->LinkRefractionIOR((record.flags & kMaterialLinkRefractionIor) != 0);
+            material->SetMultiscatter((record.flags & kMaterialMultiscatter) != 0);
+
+            if (record.first_input > num_material_inputs || record.num_inputs > num_material_inputs - record.first_input)
+            {
+                throw std::runtime_error("Binary scene is corrupted");
+            }
+
+            for (auto j = record.first_input; j < record.first_input + record.num_inputs; ++j)
+            {
+                auto idx = material_input_records[j].input_map;
+
+                if (idx < 0 || static_cast<std::uint32_t>(idx) >= num_input_maps)
+                {
+                    throw std::runtime_error("Binary scene is corrupted");
+                }
+
+                material->SetInputValue(reader.GetString(material_input_records[j].name), input_maps[idx]);
+            }
+
+            materials[i] = material;
+        }
+
+        auto get_material = [&](std::int32_t idx) -> Material::Ptr
+        {
+            return (idx < 0 || static_cast<std::uint32_t>(idx) >= num_materials) ? nullptr : materials[idx];
+        };
+
+        auto setup_shape = [&](Shape& shape, ShapeRecord const& record)
+        {
+            shape.SetName(reader.GetString(record.name));
+            shape.SetMaterial(get_material(record.material));
+            shape.SetGroupId(record.group_id);
+            shape.SetVisibilityMask(record.visibility_mask);
+            shape.SetTransform(ReadMatrix(record.transform));
+        };
+
+        // Shapes, meshes go before instances
+        std::vector<Shape::Ptr> shapes;
+
+        std::uint32_t num_meshes = 0;
+        auto mesh_records = reader.GetRecords<ShapeRecord>(kMeshesSection, num_meshes);
+
+        LogInfo("Number of objects: ", num_meshes, "\n");
+
+        std::vector<Mesh::Ptr> meshes(num_meshes);
+        for (auto i = 0u; i < num_meshes; ++i)
+        {
+            auto const& record = mesh_records[i];
+
+            auto mesh = Mesh::Create();
+            mesh->SetIndices(ReadMeshArray<std::uint32_t>(reader, record.indices, record.num_indices));
+            mesh->SetVertices(ReadMeshArray<RadeonRays::float3>(reader, record.vertices, record.num_vertices));
+            mesh->SetNormals(ReadMeshArray<RadeonRays::float3>(reader, record.normals, record.num_normals));
+            mesh->SetUVs(ReadMeshArray<RadeonRays::float2>(reader, record.uvs, record.num_uvs));
+            setup_shape(*mesh, record);
+
+            if (record.flags & kShapeAttached)
+            {
+                scene->AttachShape(mesh);
+            }
+
+            meshes[i] = mesh;
+            shapes.push_back(mesh);
+        }
+
+        std::uint32_t num_instances = 0;
+        auto instance_records = reader.GetRecords<ShapeRecord>(kInstancesSection, num_instances);
+
+        for (auto i = 0u; i < num_instances; ++i)
         {
-            auto mesh = shape_iter->ItemAs<Mesh>();
-            auto num_indices = (std::uint32_t)mesh->GetNumIndices();
-            out.write((char*)&num_indices, sizeof(std::uint32_t));
+            auto const& record = instance_records[i];
 
-            auto num_vertices = (std::uint32_t)mesh->GetNumVertices();
-            out.write((char*)&num_vertices, sizeof(std::uint32_t));
+            if (record.base_mesh < 0 || static_cast<std::uint32_t>(record.base_mesh) >= num_meshes)
+            {
+                throw std::runtime_error("Binary scene is corrupted");
+            }
 
-            auto num_normals = (std::uint32_t)mesh->GetNumNormals();
-            out.write((char*)&num_normals, sizeof(std::uint32_t));
+            auto instance = Instance::Create(meshes[record.base_mesh]);
+            setup_shape(*instance, record);
+            scene->AttachShape(instance);
+            shapes.push_back(instance);
+        }
 
-            auto num_uvs = (std::uint32_t)mesh->GetNumUVs();
-            out.write((char*)&num_uvs, sizeof(std::uint32_t));
+        // Lights
+        std::uint32_t num_lights = 0;
+        auto light_records = reader.GetRecords<LightRecord>(kLightsSection, num_lights);
 
-            out.write((char const*)mesh->GetIndices(), mesh->GetNumIndices() * sizeof(std::uint32_t));
-            out.write((char const*)mesh->GetVertices(), mesh->GetNumVertices() * sizeof(RadeonRays::float3));
-            out.write((char const*)mesh->GetNormals(), mesh->GetNumNormals() * sizeof(RadeonRays::float3));
-            out.write((char const*)mesh->GetUVs(), mesh->GetNumUVs() * sizeof(RadeonRays::float2));
+        auto get_texture = [&](std::int32_t idx) -> Texture::Ptr
+        {
+            return (idx < 0 || static_cast<std::uint32_t>(idx) >= num_textures) ? nullptr : textures[idx];
+        };
 
-            auto material = mesh->GetMaterial();
+        auto get_shape = [&](std::int32_t idx) -> Shape::Ptr
+        {
+            if (idx < 0 || static_cast<std::size_t>(idx) >= shapes.size())
+            {
+                throw std::runtime_error("Binary scene is corrupted");
+            }
+            return shapes[idx];
+        };
+
+        for (auto i = 0u; i < num_lights; ++i)
+        {
+            auto const& record = light_records[i];
 
-            /*if (!material)
+            Light::Ptr light;
+
+            switch (record.type)
             {
-                material = default_material;
+                case kPointLight:
+                    light = PointLight::Create();
+                    break;
+                case kDirectionalLight:
+                    light = DirectionalLight::Create();
+                    break;
+                case kSpotLight:
+                {
+                    auto spot = SpotLight::Create();
+                    spot->SetConeShape(RadeonRays::float2(record.cone[0], record.cone[1]));
+                    light = spot;
+                    break;
+                }
+                case kImageBasedLight:
+                {
+                    auto ibl = ImageBasedLight::Create();
+                    ibl->SetTexture(get_texture(record.textures[0]));
+                    ibl->SetReflectionTexture(get_texture(record.textures[1]));
+                    ibl->SetRefractionTexture(get_texture(record.textures[2]));
+                    ibl->SetTransparencyTexture(get_texture(record.textures[3]));
+                    ibl->SetBackgroundTexture(get_texture(record.textures[4]));
+                    ibl->SetMultiplier(record.multiplier);
+                    ibl->SetMirrorX(record.mirror_x != 0);
+                    light = ibl;
+                    break;
+                }
+                case kAreaLight:
+                    light = AreaLight::Create(get_shape(record.shape), record.primitive);
+                    break;
+                case kMeshLight:
+                    light = MeshLight::Create(get_shape(record.shape));
+                    break;
+                default:
+                    throw std::runtime_error("Binary scene contains unknown light type");
             }
 
-            auto diffuse = std::dynamic_pointer_cast<SingleBxdf>(material);
+            light->SetName(reader.GetString(record.name));
+            light->SetPosition(ReadFloat3(record.position));
+            light->SetDirection(ReadFloat3(record.direction));
+            light->SetEmittedRadiance(ReadFloat3(record.radiance));
 
-            if (!diffuse)
+            scene->AttachLight(light);
+        }
+
+        return scene;
+    }
+
+    void SceneBinaryIo::SaveScene(Scene1 const& scene, std::string const& filename, std::string const& basepath) const
+    {
+        auto image_io(ImageIo::CreateImageIo());
+        SceneSerializer serializer(*image_io, basepath);
+
+        // Split shapes into meshes and instances. Base meshes of instances
+        // are stored even if they are not attached to the scene.
+        std::vector<Mesh::Ptr> meshes;
+        std::vector<Instance::Ptr> instances;
+        std::map<Shape::Ptr, std::int32_t> shape_indices;
+
+        auto shape_iter = scene.CreateShapeIterator();
+        for (; shape_iter->IsValid(); shape_iter->Next())
+        {
+            auto shape = shape_iter->ItemAs<Shape>();
+
+            if (auto mesh = std::dynamic_pointer_cast<Mesh>(shape))
             {
-                diffuse = std::dynamic_pointer_cast<SingleBxdf>(material->GetInputValue("base_material").mat_value);
+                shape_indices[mesh] = static_cast<std::int32_t>(meshes.size());
+                meshes.push_back(mesh);
             }
+            else if (auto instance = std::dynamic_pointer_cast<Instance>(shape))
+            {
+                instances.push_back(instance);
+            }
+        }
 
-            if (!diffuse)
+        auto num_attached_meshes = meshes.size();
+
+        for (auto const& instance : instances)
+        {
+            auto base_mesh = std::dynamic_pointer_cast<Mesh>(instance->GetBaseShape());
+
+            if (!base_mesh)
             {
-                throw std::runtime_error("Material not supported");
+                throw std::runtime_error("Instances of non-mesh shapes are not supported");
             }
-            diffuse->GetInputValue("albedo");
-            */
 
-            auto albedo = RadeonRays::float3(1.0f, 1.0f, 1.0f);
+            if (shape_indices.emplace(base_mesh, static_cast<std::int32_t>(meshes.size())).second)
+            {
+                meshes.push_back(base_mesh);
+            }
+        }
+
+        std::vector<ShapeRecord> mesh_records;
+        for (auto i = 0u; i < meshes.size(); ++i)
+        {
+            auto const& mesh = meshes[i];
+            auto record = serializer.MakeShapeRecord(*mesh, i < num_attached_meshes);
+            record.num_indices = static_cast<std::uint32_t>(mesh->GetNumIndices());
+            record.num_vertices = static_cast<std::uint32_t>(mesh->GetNumVertices());
+            record.num_normals = static_cast<std::uint32_t>(mesh->GetNumNormals());
+            record.num_uvs = static_cast<std::uint32_t>(mesh->GetNumUVs());
+            mesh_records.push_back(record);
+        }
+
+        std::vector<ShapeRecord> instance_records;
+        for (auto const& instance : instances)
+        {
+            auto record = serializer.MakeShapeRecord(*instance, true);
+            record.base_mesh = shape_indices[instance->GetBaseShape()];
+            shape_indices[instance] = static_cast<std::int32_t>(meshes.size() + instance_records.size());
+            instance_records.push_back(record);
+        }
+
+        std::vector<LightRecord> light_records;
+
+        auto light_iter = scene.CreateLightIterator();
+        for (; light_iter->IsValid(); light_iter->Next())
+        {
+            auto light = light_iter->ItemAs<Light>();
+
+            LightRecord record = {};
+            record.name = serializer.AddString(light->GetName());
+            record.shape = -1;
+            std::fill(std::begin(record.textures), std::end(record.textures), -1);
+            WriteFloat3(light->GetPosition(), record.position);
+            WriteFloat3(light->GetDirection(), record.direction);
+            WriteFloat3(light->GetEmittedRadiance(), record.radiance);
+
+            auto get_shape_index = [&](Shape::Ptr shape)
+            {
+                auto iter = shape_indices.find(shape);
+                if (iter == shape_indices.cend())
+                {
+                    throw std::runtime_error("Light references a shape which is not in the scene");
+                }
+                return iter->second;
+            };
+
+            if (std::dynamic_pointer_cast<PointLight>(light))
+            {
+                record.type = kPointLight;
+            }
+            else if (std::dynamic_pointer_cast<DirectionalLight>(light))
+            {
+                record.type = kDirectionalLight;
+            }
+            else if (auto spot = std::dynamic_pointer_cast<SpotLight>(light))
+            {
+                record.type = kSpotLight;
+                auto cone = spot->GetConeShape();
+                record.cone[0] = cone.x;
+                record.cone[1] = cone.y;
+            }
+            else if (auto ibl = std::dynamic_pointer_cast<ImageBasedLight>(light))
+            {
+                record.type = kImageBasedLight;
+                record.textures[0] = serializer.AddTexture(ibl->GetTexture());
+                record.textures[1] = serializer.AddTexture(ibl->GetReflectionTexture());
+                record.textures[2] = serializer.AddTexture(ibl->GetRefractionTexture());
+                record.textures[3] = serializer.AddTexture(ibl->GetTransparencyTexture());
+                record.textures[4] = serializer.AddTexture(ibl->GetBackgroundTexture());
+                record.multiplier = ibl->GetMultiplier();
+                record.mirror_x = ibl->GetMirrorX() ? 1u : 0u;
+            }
+            else if (auto area = std::dynamic_pointer_cast<AreaLight>(light))
+            {
+                record.type = kAreaLight;
+                record.shape = get_shape_index(area->GetShape());
+                record.primitive = static_cast<std::uint32_t>(area->GetPrimitiveIdx());
+            }
+            else if (auto mesh_light = std::dynamic_pointer_cast<MeshLight>(light))
+            {
+                record.type = kMeshLight;
+                record.shape = get_shape_index(mesh_light->GetShape());
+            }
+            else
+            {
+                throw std::runtime_error("Light type is not supported");
+            }
+
+            light_records.push_back(record);
+        }
+
+        SceneWriter writer(filename);
 
-            std::uint32_t flag = 0;
-            out.write(reinterpret_cast<char const*>(&flag), sizeof(flag));
-            out.write(reinterpret_cast<char const*>(&albedo.x), sizeof(RadeonRays::float3));
+        // Header is patched when everything else is written
+        FileHeader header = {};
+        writer.Write(&header, sizeof(header));
+
+        writer.AddSection(kStringsSection, serializer.strings);
+        writer.AddSection(kTexturesSection, serializer.textures);
+        writer.AddSection(kInputMapsSection, serializer.input_maps);
+        writer.AddSection(kMaterialsSection, serializer.materials);
+        writer.AddSection(kMaterialInputsSection, serializer.material_inputs);
+        writer.AddSection(kInstancesSection, instance_records);
+        writer.AddSection(kLightsSection, light_records);
+
+        // Mesh arrays follow mesh records, each array is aligned
+        auto aligned = [](std::uint64_t size)
+        {
+            return (size + kAlignment - 1) / kAlignment * kAlignment;
+        };
+
+        auto position = aligned(aligned(writer.GetPosition()) + mesh_records.size() * sizeof(ShapeRecord));
+        for (auto& record : mesh_records)
+        {
+            record.indices = position;
+            position = aligned(position + record.num_indices * sizeof(std::uint32_t));
+            record.vertices = position;
+            position = aligned(position + record.num_vertices * sizeof(RadeonRays::float3));
+            record.normals = position;
+            position = aligned(position + record.num_normals * sizeof(RadeonRays::float3));
+            record.uvs = position;
+            position = aligned(position + record.num_uvs * sizeof(RadeonRays::float2));
         }
+
+        writer.AddSection(kMeshesSection, mesh_records);
+
+        for (auto const& mesh : meshes)
+        {
+            writer.Align();
+            writer.Write(mesh->GetIndices(), mesh->GetNumIndices() * sizeof(std::uint32_t));
+            writer.Align();
+            writer.Write(mesh->GetVertices(), mesh->GetNumVertices() * sizeof(RadeonRays::float3));
+            writer.Align();
+            writer.Write(mesh->GetNormals(), mesh->GetNumNormals() * sizeof(RadeonRays::float3));
+            writer.Align();
+            writer.Write(mesh->GetUVs(), mesh->GetNumUVs() * sizeof(RadeonRays::float2));
+        }
+
+        writer.Finish();
     }
 }
@@ -1,24 +1,3 @@
-/**********************************************************************
-Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
-
-Permission is hereby granted, free of charge, to any person obtaining a copy
-of this software and associated documentation files (the "Software"), to deal
-in the Software without restriction, including without limitation the rights
-to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
-copies of the Software, and to permit persons to whom the Software is
-furnished to do so, subject to the following conditions:
-
-The above copyright notice and this permission notice shall be included in
-all copies or substantial portions of the Software.
-
-THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
-IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
-FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
-AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
-LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
-OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
-THE SOFTWARE.
-********************************************************************/
 #include "scene_io.h"
 #include <vector>
 #include <memory>
@@ -28,14 +7,28 @@ THE SOFTWARE.
 
 namespace Baikal
 {
-    // Create fake test IO
+    /**
+    \brief Binary scene cache
+
+    Stores meshes, instances, materials, input maps, texture references and lights
+    in a versioned binary file. File starts with a header followed by 64-byte aligned
+    sections and a section table. Loader maps the file into memory, so mesh arrays are
+    copied straight from the mapping into meshes without intermediate buffers.
+
+    Textures are stored as references (file names relative to base path). Textures
+    without names are written next to the scene file.
+    */
     class SceneBinaryIo : public SceneIo::Loader
     {
     public:
+        // Current version of the format, files of newer versions are rejected
+        static std::uint32_t constexpr kVersion = 1;
+
         SceneBinaryIo() : SceneIo::Loader("bin", this)
         {}
-        // Load scene (this class uses filename to determine what scene to generate)
+        // Load scene from binary cache
         Scene1::Ptr LoadScene(std::string const& filename, std::string const& basepath) const override;
+        // Save scene into binary cache
         void SaveScene(Scene1 const& scene, std::string const& filename, std::string const& basepath) const override;
     };
 }
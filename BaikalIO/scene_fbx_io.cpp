@@ -79,11 +79,11 @@ namespace Baikal
             {
                 if ((filepath.find(":") != std::string::npos) || (filepath.at(0) == '/'))
                 {
-                    return LoadTexture(io, scene, "", filepath);
+                    return LoadTexture(scene, "", filepath);
                 }
                 else
                 {
-                    return LoadTexture(io, scene, basepath, filepath);
+                    return LoadTexture(scene, basepath, filepath);
                 }
             }
             catch (std::exception& e)
@@ -1,5 +1,6 @@
 #include "scene_io.h"
 #include "image_io.h"
+#include "texture_cache.h"
 #include "SceneGraph/scene1.h"
 #include "SceneGraph/shape.h"
 #include "SceneGraph/material.h"
@@ -10,6 +11,7 @@
 #include <string>
 #include <map>
 #include <set>
+#include <algorithm>
 #include <cassert>
 
 #include "Utils/log.h"
@@ -48,7 +50,7 @@ namespace Baikal
 
     void SceneIo::SaveScene(Scene1 const& scene, std::string const& filename, std::string const& basepath)
     {
-        auto ext = filename.substr(filename.rfind("."));
+        auto ext = filename.substr(filename.rfind(".") + 1);
 
         SceneIo *instance = GetInstance();
         auto loader_it = instance->m_loaders.find(ext);
@@ -60,31 +62,38 @@ namespace Baikal
         return loader_it->second->SaveScene(scene, filename, basepath);
     }
 
-    Texture::Ptr SceneIo::Loader::LoadTexture(ImageIo const& io, Scene1& scene, std::string const& basepath, std::string const& name) const
+    static std::string ResolveTexturePath(std::string const& basepath, std::string const& name)
     {
-        std::string fname = basepath + name;
-        std::replace(fname.begin(), fname.end(), '\\', '/');
-
-        auto iter = m_texture_cache.find(name);
+        std::string path = basepath + name;
+        std::replace(path.begin(), path.end(), '\\', '/');
+        return path;
+    }
 
-        if (iter != m_texture_cache.cend())
+    Texture::Ptr SceneIo::Loader::LoadTexture(Scene1& scene, std::string const& basepath, std::string const& name) const
+    {
+        try
         {
-            return iter->second;
+            LogInfo("Loading ", name, "\n");
+            auto texture = TextureCache::GetDefault().Load(ResolveTexturePath(basepath, name), true);
+            texture->SetName(name);
+            return texture;
         }
-        else
+        catch (std::runtime_error&)
         {
-            try
-            {
-                LogInfo("Loading ", name, "\n");
-                auto texture = io.LoadImage(fname);
-                texture->SetName(name);
-                m_texture_cache[name] = texture;
-                return texture;
-            }
-            catch (std::runtime_error&)
+            LogInfo("Missing texture: ", name, "\n");
+            return nullptr;
+        }
+    }
+
+    void SceneIo::Loader::PrefetchTextures(std::string const& basepath, std::vector<std::string> const& names) const
+    {
+        auto& cache = TextureCache::GetDefault();
+
+        for (auto const& name : names)
+        {
+            if (!name.empty())
             {
-                LogInfo("Missing texture: ", name, "\n");
-                return nullptr;
+                cache.LoadAsync(ResolveTexturePath(basepath, name), true);
             }
         }
     }
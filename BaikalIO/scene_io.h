@@ -31,6 +31,7 @@
 #include <string>
 #include <memory>
 #include <map>
+#include <vector>
 #include "SceneGraph/texture.h"
 #include "SceneGraph/scene1.h"
 
@@ -76,14 +77,16 @@ namespace Baikal
             virtual ~Loader();
 
         protected:
-            Texture::Ptr LoadTexture(ImageIo const& io, Scene1& scene, std::string const& basepath, std::string const& name) const;
+            // Load mipmapped texture through TextureCache, returns nullptr if texture can't be loaded
+            Texture::Ptr LoadTexture(Scene1& scene, std::string const& basepath, std::string const& name) const;
+            // Start decoding of textures in background, following LoadTexture calls wait for them
+            void PrefetchTextures(std::string const& basepath, std::vector<std::string> const& names) const;
 
         private:
             Loader(const Loader &) = delete;
             Loader& operator= (const Loader &) = delete;
 
             std::string m_ext;
-            mutable std::map<std::string, Texture::Ptr> m_texture_cache;
         };
 
         // Registers extension handler
@@ -21,7 +21,6 @@ THE SOFTWARE.
 ********************************************************************/
 
 #include "scene_io.h"
-#include "image_io.h"
 #include "SceneGraph/scene1.h"
 #include "SceneGraph/shape.h"
 #include "SceneGraph/material.h"
@@ -35,10 +34,13 @@ THE SOFTWARE.
 #include <string>
 #include <map>
 #include <set>
+#include <unordered_map>
+#include <algorithm>
 #include <cassert>
 
 #include "Utils/tiny_obj_loader.h"
 #include "Utils/log.h"
+#include "Utils/thread_pool.h"
 
 namespace Baikal
 {
@@ -58,7 +60,7 @@ namespace Baikal
         }
 
     private:
-        Material::Ptr TranslateMaterialUberV2(ImageIo const& image_io, tinyobj::material_t const& mat, std::string const& basepath, Scene1& scene) const;
+        Material::Ptr TranslateMaterialUberV2(tinyobj::material_t const& mat, std::string const& basepath, Scene1& scene) const;
 
         mutable std::map<std::string, Material::Ptr> m_material_cache;
     };
@@ -66,13 +68,160 @@ namespace Baikal
     // Create static object to register loader. This object will be used as loader
     static SceneIoObj obj_loader;
 
+    namespace
+    {
+        // Part of OBJ shape using single material
+        struct MeshData
+        {
+            int material;
+            std::vector<RadeonRays::float3> vertices;
+            std::vector<RadeonRays::float3> normals;
+            std::vector<RadeonRays::float2> uvs;
+            std::vector<std::uint32_t> indices;
+        };
+
+        // Split the shape into parts with one material each, parts are ordered by material id.
+        // Faces are bucketed by material in one pass and vertices are remapped through
+        // a flat table, so the cost is linear in the number of faces and vertices.
+        std::vector<MeshData> SplitByMaterial(tinyobj::shape_t const& shape)
+        {
+            auto const& mesh = shape.mesh;
+            auto const num_faces = mesh.material_ids.size();
+            auto const num_vertices = mesh.positions.size() / 3;
+
+            // Assign bucket to each face
+            std::unordered_map<int, std::uint32_t> buckets;
+            std::vector<int> materials;
+            std::vector<std::uint32_t> face_bucket(num_faces);
+            std::vector<std::uint32_t> bucket_size;
+
+            for (std::size_t i = 0; i < num_faces; ++i)
+            {
+                auto result = buckets.emplace(mesh.material_ids[i], static_cast<std::uint32_t>(materials.size()));
+                if (result.second)
+                {
+                    materials.push_back(mesh.material_ids[i]);
+                    bucket_size.push_back(0);
+                }
+
+                face_bucket[i] = result.first->second;
+                ++bucket_size[face_bucket[i]];
+            }
+
+            // Order buckets by material id
+            std::vector<std::uint32_t> order(materials.size());
+            for (std::uint32_t i = 0; i < order.size(); ++i)
+            {
+                order[i] = i;
+            }
+            std::sort(order.begin(), order.end(), [&materials](std::uint32_t a, std::uint32_t b)
+            {
+                return materials[a] < materials[b];
+            });
+
+            // Counting sort of faces by bucket
+            std::vector<std::size_t> bucket_start(materials.size());
+            std::size_t offset = 0;
+            for (auto bucket : order)
+            {
+                bucket_start[bucket] = offset;
+                offset += bucket_size[bucket];
+            }
+
+            std::vector<std::uint32_t> faces(num_faces);
+            {
+                auto next = bucket_start;
+                for (std::size_t i = 0; i < num_faces; ++i)
+                {
+                    faces[next[face_bucket[i]]++] = static_cast<std::uint32_t>(i);
+                }
+            }
+
+            std::uint32_t const kInvalidIndex = ~0u;
+            std::vector<std::uint32_t> remap(num_vertices, kInvalidIndex);
+            bool const has_uvs = !mesh.texcoords.empty();
+
+            std::vector<MeshData> result;
+            result.reserve(materials.size());
+
+            for (auto bucket : order)
+            {
+                MeshData data;
+                data.material = materials[bucket];
+                data.indices.reserve(bucket_size[bucket] * 3);
+
+                auto begin = faces.cbegin() + bucket_start[bucket];
+                auto end = begin + bucket_size[bucket];
+
+                for (auto face = begin; face != end; ++face)
+                {
+                    const int num_face_vertices = mesh.num_vertices[*face];
+                    assert(num_face_vertices == 3 && "expected triangles");
+
+                    for (int j = 0; j < num_face_vertices; ++j)
+                    {
+                        const unsigned int old_index = mesh.indices[num_face_vertices * *face + j];
+
+                        // Collect vertex/normal/texcoord data. Avoid inserting the same data twice.
+                        if (remap[old_index] == kInvalidIndex)
+                        {
+                            remap[old_index] = static_cast<std::uint32_t>(data.vertices.size());
+
+                            data.vertices.emplace_back(
+                                mesh.positions[3 * old_index],
+                                mesh.positions[3 * old_index + 1],
+                                mesh.positions[3 * old_index + 2]);
+                            data.normals.emplace_back(
+                                mesh.normals[3 * old_index],
+                                mesh.normals[3 * old_index + 1],
+                                mesh.normals[3 * old_index + 2]);
+
+                            // If we do not have UVs, generate zeroes
+                            if (has_uvs)
+                            {
+                                data.uvs.emplace_back(
+                                    mesh.texcoords[2 * old_index],
+                                    mesh.texcoords[2 * old_index + 1]);
+                            }
+                            else
+                            {
+                                data.uvs.emplace_back(0.f, 0.f);
+                            }
+                        }
+
+                        data.indices.push_back(remap[old_index]);
+                    }
+                }
+
+                // Reset only entries touched by this bucket
+                for (auto face = begin; face != end; ++face)
+                {
+                    for (int j = 0; j < 3; ++j)
+                    {
+                        remap[mesh.indices[3 * *face + j]] = kInvalidIndex;
+                    }
+                }
+
+                result.push_back(std::move(data));
+            }
+
+            return result;
+        }
+
+        // Texture names referenced by OBJ material
+        void CollectTextureNames(tinyobj::material_t const& mat, std::vector<std::string>& names)
+        {
+            names.push_back(mat.diffuse_texname);
+            names.push_back(mat.specular_texname);
+            names.push_back(mat.bump_texname);
+        }
+    }
+
 
     Scene1::Ptr SceneIoObj::LoadScene(std::string const& filename, std::string const& basepath) const
     {
         using namespace tinyobj;
 
-        auto image_io(ImageIo::CreateImageIo());
-
         // Loader data
         std::vector<shape_t> objshapes;
         std::vector<material_t> objmaterials;
@@ -90,6 +239,24 @@ namespace Baikal
         // Allocate scene
         auto scene = Scene1::Create();
 
+        // Start decoding all referenced textures
+        std::vector<std::string> texture_names;
+        for (auto const& mat : objmaterials)
+        {
+            CollectTextureNames(mat, texture_names);
+        }
+        PrefetchTextures(basepath, texture_names);
+
+        ThreadPool pool;
+
+        // Split shapes by material on pool threads
+        std::vector<std::future<std::vector<MeshData>>> shape_tasks;
+        shape_tasks.reserve(objshapes.size());
+        for (auto const& shape : objshapes)
+        {
+            shape_tasks.push_back(pool.Submit([&shape]() { return SplitByMaterial(shape); }));
+        }
+
         // Enumerate and translate materials
         // Keep track of emissive subset
         std::set<Material::Ptr> emissives;
@@ -97,7 +264,7 @@ namespace Baikal
         for (int i = 0; i < (int)objmaterials.size(); ++i)
         {
             // Translate material
-            materials[i] = TranslateMaterialUberV2(*image_io, objmaterials[i], basepath, *scene);
+            materials[i] = TranslateMaterialUberV2(objmaterials[i], basepath, *scene);
 
             // Add to emissive subset if needed
             if (materials[i]->HasEmission())
@@ -106,86 +273,22 @@ namespace Baikal
             }
         }
 
-        // Enumerate all shapes in the scene
-        for (int s = 0; s < (int)objshapes.size(); ++s)
+        // Create meshes in shape order, so the scene does not depend on task scheduling
+        for (auto& task : shape_tasks)
         {
-            const auto& shape = objshapes[s];
-
-            // Find all materials used by this shape.
-            std::set<int> used_materials(std::begin(shape.mesh.material_ids), std::end(shape.mesh.material_ids));
-
-            // Split the mesh into multiple meshes, each with only one material.
-            for (int used_material : used_materials)
+            for (auto& data : task.get())
             {
-                // Map from old index to new index.
-                std::map<unsigned int, unsigned int> used_indices;
-
-                // Remapped indices.
-                std::vector<unsigned int> indices;
-
-                // Collected vertex/normal/texcoord data.
-                std::vector<float> vertices, normals, texcoords;
-
-                // Go through each face in the mesh.
-                for (size_t i = 0; i < shape.mesh.material_ids.size(); ++i)
-                {
-                    // Skip faces which don't use the current material.
-                    if (shape.mesh.material_ids[i] != used_material) continue;
-
-                    const int num_face_vertices = shape.mesh.num_vertices[i];
-                    assert(num_face_vertices == 3 && "expected triangles");
-                    // For each vertex index of this face.
-                    for (int j = 0; j < num_face_vertices; ++j)
-                    {
-                        const unsigned int old_index = shape.mesh.indices[num_face_vertices * i + j];
-                        // Collect vertex/normal/texcoord data. Avoid inserting the same data twice.
-                        auto result = used_indices.emplace(old_index, (unsigned int)(vertices.size() / 3));
-                        if (result.second) // Did insert?
-                        {
-                            // Push the new data.
-                            for (int k = 0; k < 3; ++k)
-                                vertices.push_back(shape.mesh.positions[3 * old_index + k]);
-                            for (int k = 0; k < 3; ++k)
-                                normals.push_back(shape.mesh.normals[3 * old_index + k]);
-                            if (!shape.mesh.texcoords.empty())
-                                for (int k = 0; k < 2; ++k)
-                                    texcoords.push_back(shape.mesh.texcoords[2 * old_index + k]);
-                        }
-                        const unsigned int new_index = result.first->second;
-                        indices.push_back(new_index);
-                    }
-                }
-
                 // Create empty mesh
                 auto mesh = Mesh::Create();
 
                 // Set vertex and index data
-                auto num_vertices = vertices.size() / 3;
-                mesh->SetVertices(&vertices[0], num_vertices);
-
-                auto num_normals = normals.size() / 3;
-                mesh->SetNormals(&normals[0], num_normals);
-
-                auto num_uvs = texcoords.size() / 2;
-
-                // If we do not have UVs, generate zeroes
-                if (num_uvs)
-                {
-                    mesh->SetUVs(&texcoords[0], num_uvs);
-                }
-                else
-                {
-                    std::vector<RadeonRays::float2> zero(num_vertices);
-                    std::fill(zero.begin(), zero.end(), RadeonRays::float2(0, 0));
-                    mesh->SetUVs(&zero[0], num_vertices);
-                }
-
-                // Set indices
-                auto num_indices = indices.size();
-                mesh->SetIndices(reinterpret_cast<std::uint32_t const*>(&indices[0]), num_indices);
+                mesh->SetVertices(std::move(data.vertices));
+                mesh->SetNormals(std::move(data.normals));
+                mesh->SetUVs(std::move(data.uvs));
+                mesh->SetIndices(std::move(data.indices));
 
                 // Set material
-
+                auto used_material = data.material;
                 if (used_material >= 0)
                 {
                     mesh->SetMaterial(materials[used_material]);
@@ -194,15 +297,11 @@ namespace Baikal
                 // Attach to the scene
                 scene->AttachShape(mesh);
 
-                // If the mesh has emissive material we need to add area light for it
+                // If the mesh has emissive material we need to add mesh light for it
                 if (used_material >= 0 && emissives.find(materials[used_material]) != emissives.cend())
                 {
-                    // Add area light for each polygon of emissive mesh
-                    for (std::size_t l = 0; l < mesh->GetNumIndices() / 3; ++l)
-                    {
-                        auto light = AreaLight::Create(mesh, l);
-                        scene->AttachLight(light);
-                    }
+                    auto light = MeshLight::Create(mesh);
+                    scene->AttachLight(light);
                 }
             }
         }
@@ -216,7 +315,7 @@ namespace Baikal
 
         return scene;
     }
-    Material::Ptr SceneIoObj::TranslateMaterialUberV2(ImageIo const& image_io, tinyobj::material_t const& mat, std::string const& basepath, Scene1& scene) const
+    Material::Ptr SceneIoObj::TranslateMaterialUberV2(tinyobj::material_t const& mat, std::string const& basepath, Scene1& scene) const
     {
         auto iter = m_material_cache.find(mat.name);
 
@@ -263,7 +362,7 @@ namespace Baikal
             material_layers |= UberV2Material::Layers::kEmissionLayer;
             if (!mat.diffuse_texname.empty())
             {
-                auto texture = LoadTexture(image_io, scene, basepath, mat.diffuse_texname);
+                auto texture = LoadTexture(scene, basepath, mat.diffuse_texname);
                 uberv2_set_texture(material, "uberv2.emission.color", texture, apply_gamma);
             }
             else
@@ -299,7 +398,7 @@ namespace Baikal
 
             if (!mat.specular_texname.empty())
             {
-                auto texture = LoadTexture(image_io, scene, basepath, mat.specular_texname);
+                auto texture = LoadTexture(scene, basepath, mat.specular_texname);
                 uberv2_set_texture(material, "uberv2.reflection.color", texture, apply_gamma);
             }
             else
@@ -313,7 +412,7 @@ namespace Baikal
         {
             material_layers |= UberV2Material::Layers::kShadingNormalLayer;
 
-            auto texture = LoadTexture(image_io, scene, basepath, mat.bump_texname);
+            auto texture = LoadTexture(scene, basepath, mat.bump_texname);
             uberv2_set_bump_texture(material, texture);
         }
 
@@ -323,7 +422,7 @@ namespace Baikal
 
             if (!mat.diffuse_texname.empty())
             {
-                auto texture = LoadTexture(image_io, scene, basepath, mat.diffuse_texname);
+                auto texture = LoadTexture(scene, basepath, mat.diffuse_texname);
                 uberv2_set_texture(material, "uberv2.diffuse.color", texture, apply_gamma);
             }
             else
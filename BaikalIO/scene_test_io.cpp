@@ -1,5 +1,6 @@
 #include "scene_io.h"
 #include "image_io.h"
+#include "texture_encoder.h"
 #include "SceneGraph/scene1.h"
 #include "SceneGraph/shape.h"
 #include "SceneGraph/material.h"
@@ -663,6 +664,62 @@ namespace Baikal
             ibl->SetMultiplier(1.f);
             scene->AttachLight(ibl);
         }
+        // Texture filtering benchmark: large plane with densely tiled texture
+        // seen at grazing angles, the same scene with and without mip chain,
+        // with block compressed and with virtual (streamed) texture
+        else if (fname == "textured_plane" || fname == "textured_plane+mipmaps" || fname == "textured_plane+bc" ||
+            fname == "textured_plane+virtual")
+        {
+            auto plane = CreateQuad(
+            {
+                RadeonRays::float3(-500, 0, -500),
+                RadeonRays::float3(500, 0, -500),
+                RadeonRays::float3(500, 0, 500),
+                RadeonRays::float3(-500, 0, 500),
+            }
+            , false);
+
+            float2 uvs[] =
+            {
+                float2(0, 0),
+                float2(250, 0),
+                float2(250, 250),
+                float2(0, 250)
+            };
+            plane->SetUVs(uvs, 4);
+            scene->AttachShape(plane);
+
+            auto texture = image_io->LoadImage("../Resources/Textures/test_albedo1.jpg");
+            if (fname == "textured_plane+mipmaps")
+            {
+                texture->GenerateMipmaps();
+            }
+            else if (fname == "textured_plane+bc")
+            {
+                texture->GenerateMipmaps();
+                texture = TextureEncoder::Encode(*texture, TextureEncoder::SelectFormat(*texture));
+            }
+            else if (fname == "textured_plane+virtual")
+            {
+                texture->GenerateMipmaps();
+                texture = Texture::CreateVirtual(texture);
+            }
+
+            auto gamma = InputMap_ConstantFloat::Create(2.2f);
+            auto diffuse_color = InputMap_Pow::Create(InputMap_Sampler::Create(texture), gamma);
+
+            auto mat = UberV2Material::Create();
+            mat->SetLayers(UberV2Material::Layers::kDiffuseLayer);
+            mat->SetInputValue("uberv2.diffuse.color", diffuse_color);
+            plane->SetMaterial(mat);
+
+            auto ibl_texture = image_io->LoadImage("../Resources/Textures/studio015.hdr");
+
+            auto ibl = ImageBasedLight::Create();
+            ibl->SetTexture(ibl_texture);
+            ibl->SetMultiplier(1.f);
+            scene->AttachLight(ibl);
+        }
 
 
         return scene;
@@ -0,0 +1,304 @@
+/**********************************************************************
+ Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ********************************************************************/
+#include "texture_cache.h"
+#include "image_io.h"
+
+#include "Utils/log.h"
+#include "Utils/mkpath.h"
+#include "Utils/sha256.h"
+#include "Utils/thread_pool.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+namespace Baikal
+{
+    namespace
+    {
+        // Bump when layout of cached payloads changes
+        std::uint32_t const kDiskCacheVersion = 1;
+        char const kDiskCacheMagic[8] = { 'B', 'A', 'I', 'K', 'A', 'L', 'T', 'X' };
+
+        // Header of on-disk cache entry, followed by texture data
+        struct DiskCacheHeader
+        {
+            char magic[8];
+            std::uint32_t version;
+            std::uint32_t format;
+            std::int32_t width;
+            std::int32_t height;
+            std::int32_t depth;
+            std::uint32_t mip_count;
+            std::uint64_t data_size;
+        };
+
+        // Resolve canonical path and modification time of the file, returns false if file doesn't exist
+        bool GetFileInfo(std::string const& filename, std::string& path, std::int64_t& mtime)
+        {
+#ifdef WIN32
+            char* full_path = _fullpath(nullptr, filename.c_str(), 0);
+            if (!full_path)
+            {
+                return false;
+            }
+
+            path = full_path;
+            std::free(full_path);
+
+            struct _stat64 info;
+            if (_stat64(path.c_str(), &info) != 0)
+            {
+                return false;
+            }
+#else
+            char* full_path = realpath(filename.c_str(), nullptr);
+            if (!full_path)
+            {
+                return false;
+            }
+
+            path = full_path;
+            std::free(full_path);
+
+            struct stat info;
+            if (stat(path.c_str(), &info) != 0)
+            {
+                return false;
+            }
+#endif
+            mtime = static_cast<std::int64_t>(info.st_mtime);
+            return true;
+        }
+
+        std::string GetDiskCacheEntryName(std::string const& cache_path, std::string const& path, std::int64_t mtime, bool generate_mipmaps)
+        {
+            Sha256 hash;
+            hash.Update(path);
+            hash.Update(&mtime, sizeof(mtime));
+            hash.Update(&generate_mipmaps, sizeof(generate_mipmaps));
+            hash.Update(&kDiskCacheVersion, sizeof(kDiskCacheVersion));
+            return cache_path + "/" + hash.GetHexDigest() + ".tex";
+        }
+
+        Texture::Ptr LoadDiskCacheEntry(std::string const& name)
+        {
+            std::ifstream in(name, std::ios::in | std::ios::binary);
+            if (!in)
+            {
+                return nullptr;
+            }
+
+            DiskCacheHeader header;
+            if (!in.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+                std::memcmp(header.magic, kDiskCacheMagic, sizeof(kDiskCacheMagic)) != 0 ||
+                header.version != kDiskCacheVersion ||
+                header.mip_count == 0 || header.mip_count > Texture::kMaxMipLevels)
+            {
+                return nullptr;
+            }
+
+            std::unique_ptr<char[]> data(new char[header.data_size]);
+            if (!in.read(data.get(), header.data_size))
+            {
+                return nullptr;
+            }
+
+            auto texture = Texture::Create(data.release(),
+                RadeonRays::int3(header.width, header.height, header.depth),
+                static_cast<Texture::Format>(header.format), header.mip_count);
+
+            // Entry written for different layout
+            if (texture->GetMipChainSizeInBytes() != header.data_size)
+            {
+                return nullptr;
+            }
+
+            return texture;
+        }
+
+        // Writes entry into temporary file and renames it, so readers never observe partially written entry
+        void SaveDiskCacheEntry(std::string const& name, Texture const& texture)
+        {
+            DiskCacheHeader header;
+            std::memcpy(header.magic, kDiskCacheMagic, sizeof(kDiskCacheMagic));
+            header.version = kDiskCacheVersion;
+            header.format = static_cast<std::uint32_t>(texture.GetFormat());
+            header.width = texture.GetSize().x;
+            header.height = texture.GetSize().y;
+            header.depth = texture.GetSize().z;
+            header.mip_count = texture.GetMipLevelCount();
+            header.data_size = texture.GetMipChainSizeInBytes();
+
+            std::random_device random;
+            std::ostringstream tmp_name;
+            tmp_name << name << ".tmp" << std::hash<std::thread::id>()(std::this_thread::get_id()) << "_" << random();
+
+            {
+                std::ofstream out(tmp_name.str(), std::ios::out | std::ios::binary);
+                if (!out)
+                {
+                    return;
+                }
+
+                out.write(reinterpret_cast<char const*>(&header), sizeof(header));
+                out.write(texture.GetData(), header.data_size);
+                if (!out)
+                {
+                    out.close();
+                    std::remove(tmp_name.str().c_str());
+                    return;
+                }
+            }
+
+            // On Windows rename fails if entry already exists.
+            // Existing entry has the same content, so just drop ours.
+            if (std::rename(tmp_name.str().c_str(), name.c_str()) != 0)
+            {
+                std::remove(tmp_name.str().c_str());
+            }
+        }
+    }
+
+    TextureCache& TextureCache::GetDefault()
+    {
+        static TextureCache cache(ImageIo::CreateImageIo());
+        return cache;
+    }
+
+    TextureCache::TextureCache(std::unique_ptr<ImageIo> io, std::size_t num_threads)
+        : m_io(std::move(io))
+        , m_pool(new ThreadPool(num_threads))
+    {
+    }
+
+    TextureCache::~TextureCache() = default;
+
+    void TextureCache::SetDiskCachePath(std::string const& path)
+    {
+        if (!path.empty())
+        {
+            mkpath(path);
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_disk_cache_path = path;
+    }
+
+    Texture::Ptr TextureCache::Decode(std::string const& filename, std::string const& path, std::string const& disk_cache_entry, bool generate_mipmaps) const
+    {
+        if (!disk_cache_entry.empty())
+        {
+            auto texture = LoadDiskCacheEntry(disk_cache_entry);
+            if (texture)
+            {
+                texture->SetName(filename);
+                return texture;
+            }
+        }
+
+        auto texture = m_io->LoadImage(path);
+        texture->SetName(filename);
+
+        if (generate_mipmaps)
+        {
+            texture->GenerateMipmaps();
+        }
+
+        if (!disk_cache_entry.empty() && !texture->IsVirtual())
+        {
+            SaveDiskCacheEntry(disk_cache_entry, *texture);
+        }
+
+        return texture;
+    }
+
+    std::shared_future<Texture::Ptr> TextureCache::LoadAsync(std::string const& filename, bool generate_mipmaps)
+    {
+        std::string path;
+        std::int64_t mtime = 0;
+
+        if (!GetFileInfo(filename, path, mtime))
+        {
+            std::promise<Texture::Ptr> missing;
+            missing.set_exception(std::make_exception_ptr(std::runtime_error("Can't load " + filename + " image")));
+            return missing.get_future().share();
+        }
+
+        // Mipmapped and plain versions of the same file are separate entries
+        auto key = generate_mipmaps ? path + "#mipmaps" : path;
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        auto iter = m_entries.find(key);
+        if (iter != m_entries.cend() && iter->second.mtime == mtime)
+        {
+            return iter->second.texture;
+        }
+
+        std::string disk_cache_entry;
+        if (!m_disk_cache_path.empty())
+        {
+            disk_cache_entry = GetDiskCacheEntryName(m_disk_cache_path, path, mtime, generate_mipmaps);
+        }
+
+        auto texture = m_pool->Submit([this, filename, path, disk_cache_entry, generate_mipmaps]()
+        {
+            return Decode(filename, path, disk_cache_entry, generate_mipmaps);
+        }).share();
+
+        m_entries[key] = Entry{ mtime, texture };
+        return texture;
+    }
+
+    std::vector<std::shared_future<Texture::Ptr>> TextureCache::LoadAsync(std::vector<std::string> const& filenames, bool generate_mipmaps)
+    {
+        std::vector<std::shared_future<Texture::Ptr>> textures;
+        textures.reserve(filenames.size());
+
+        for (auto const& filename : filenames)
+        {
+            textures.push_back(LoadAsync(filename, generate_mipmaps));
+        }
+
+        return textures;
+    }
+
+    Texture::Ptr TextureCache::Load(std::string const& filename, bool generate_mipmaps)
+    {
+        return LoadAsync(filename, generate_mipmaps).get();
+    }
+
+    void TextureCache::Clear()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_entries.clear();
+    }
+}
@@ -0,0 +1,122 @@
+/**********************************************************************
+ Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ********************************************************************/
+
+/**
+ \file texture_cache.h
+ \author Dmitry Kozlov
+ \version 1.0
+ \brief Shared cache of decoded images.
+ */
+#pragma once
+
+#include "SceneGraph/texture.h"
+
+#include <cstdint>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#ifdef WIN32
+#ifdef BAIKAL_EXPORT_API
+#define BAIKAL_API_ENTRY __declspec(dllexport)
+#else
+#define BAIKAL_API_ENTRY __declspec(dllimport)
+#endif
+#else
+#define BAIKAL_API_ENTRY __attribute__((visibility ("default")))
+#endif
+
+namespace Baikal
+{
+    class ImageIo;
+    class ThreadPool;
+
+    /**
+     \brief Cache of decoded images on top of ImageIo.
+
+     Images are identified by canonical path and modification time, so the same file
+     requested through different relative paths is decoded once and is decoded again
+     after it changes on disk. Decoding is done on a worker pool, several files are
+     decoded concurrently.
+
+     Optionally decoded payloads are kept in a directory on disk, next import of an
+     unchanged file reads them back without decoding and conversion.
+
+     Returned textures are shared between all callers, their data should not be modified.
+     */
+    class BAIKAL_API_ENTRY TextureCache
+    {
+    public:
+        // Process-wide cache which uses default image IO
+        static TextureCache& GetDefault();
+
+        /**
+         \brief Create cache.
+
+         \param io Image IO used to decode files.
+         \param num_threads Number of decoding threads, 0 means number of hardware threads.
+         */
+        explicit TextureCache(std::unique_ptr<ImageIo> io, std::size_t num_threads = 0);
+        ~TextureCache();
+
+        // Set directory for decoded payloads, empty path disables on-disk cache
+        void SetDiskCachePath(std::string const& path);
+
+        /**
+         \brief Request texture decoding unless it is cached already.
+
+         \param filename Image file name.
+         \param generate_mipmaps Generate full mip chain for the texture.
+         \return Future for the texture, it throws std::runtime_error if file can't be loaded.
+         */
+        std::shared_future<Texture::Ptr> LoadAsync(std::string const& filename, bool generate_mipmaps = false);
+        // Request decoding of several files, futures are in the same order as file names
+        std::vector<std::shared_future<Texture::Ptr>> LoadAsync(std::vector<std::string> const& filenames, bool generate_mipmaps = false);
+        // Load texture and wait for it, throws std::runtime_error if file can't be loaded
+        Texture::Ptr Load(std::string const& filename, bool generate_mipmaps = false);
+
+        // Drop all cached textures, textures returned before stay valid
+        void Clear();
+
+        // Disallow copying
+        TextureCache(TextureCache const&) = delete;
+        TextureCache& operator = (TextureCache const&) = delete;
+
+    private:
+        struct Entry
+        {
+            std::int64_t mtime;
+            std::shared_future<Texture::Ptr> texture;
+        };
+
+        Texture::Ptr Decode(std::string const& filename, std::string const& path, std::string const& disk_cache_entry, bool generate_mipmaps) const;
+
+        std::unique_ptr<ImageIo> m_io;
+        std::unique_ptr<ThreadPool> m_pool;
+        std::map<std::string, Entry> m_entries;
+        std::string m_disk_cache_path;
+        std::mutex m_mutex;
+    };
+}
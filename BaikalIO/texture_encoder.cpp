@@ -0,0 +1,585 @@
+/**********************************************************************
+ Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ********************************************************************/
+#include "texture_encoder.h"
+
+#include "Utils/thread_pool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <future>
+#include <limits>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace Baikal
+{
+    namespace
+    {
+        // RGBA texel as seen by kernels
+        struct Texel
+        {
+            float v[4];
+        };
+
+        float HalfToFloat(std::uint16_t value)
+        {
+            std::uint32_t sign = static_cast<std::uint32_t>(value & 0x8000u) << 16;
+            std::uint32_t exponent = (value >> 10) & 0x1Fu;
+            std::uint32_t mantissa = value & 0x3FFu;
+            std::uint32_t bits = sign;
+
+            if (exponent == 0)
+            {
+                // Zero or denormal
+                float result = std::ldexp(static_cast<float>(mantissa), -24);
+                return sign ? -result : result;
+            }
+            else if (exponent == 31)
+            {
+                bits |= 0x7F800000u | (mantissa << 13);
+            }
+            else
+            {
+                bits |= ((exponent + 112) << 23) | (mantissa << 13);
+            }
+
+            float result;
+            std::memcpy(&result, &bits, sizeof(float));
+            return result;
+        }
+
+        std::uint16_t FloatToHalf(float value)
+        {
+            std::uint32_t bits;
+            std::memcpy(&bits, &value, sizeof(float));
+
+            auto sign = static_cast<std::uint16_t>((bits >> 16) & 0x8000u);
+            std::uint32_t float_exponent = (bits >> 23) & 0xFFu;
+            std::uint32_t mantissa = bits & 0x7FFFFFu;
+            int exponent = static_cast<int>(float_exponent) - 127 + 15;
+
+            if (float_exponent == 0xFF)
+            {
+                // Inf or NaN
+                return sign | 0x7C00u | (mantissa ? 0x200u : 0u);
+            }
+
+            if (exponent >= 31)
+            {
+                return sign | 0x7C00u;
+            }
+
+            if (exponent <= 0)
+            {
+                if (exponent < -10)
+                {
+                    return sign;
+                }
+
+                // Denormal, round to nearest
+                mantissa |= 0x800000u;
+                int shift = 14 - exponent;
+                std::uint32_t result = mantissa >> shift;
+                if ((mantissa >> (shift - 1)) & 1u)
+                {
+                    ++result;
+                }
+                return static_cast<std::uint16_t>(sign | result);
+            }
+
+            // Round to nearest, carry into exponent is correct
+            std::uint32_t result = sign | (static_cast<std::uint32_t>(exponent) << 10) | (mantissa >> 13);
+            if (mantissa & 0x1000u)
+            {
+                ++result;
+            }
+            return static_cast<std::uint16_t>(result);
+        }
+
+        inline std::uint8_t ToUnorm8(float value)
+        {
+            return static_cast<std::uint8_t>(std::min(std::max(value, 0.f), 1.f) * 255.f + 0.5f);
+        }
+
+        float ReadComponent(Texture::Format format, char const* data, std::size_t index)
+        {
+            switch (format)
+            {
+            case Texture::Format::kRgba8:
+            case Texture::Format::kR8:
+            case Texture::Format::kRg8:
+                return reinterpret_cast<std::uint8_t const*>(data)[index] / 255.f;
+            case Texture::Format::kRgba16:
+            case Texture::Format::kR16:
+            case Texture::Format::kRg16:
+                return HalfToFloat(reinterpret_cast<std::uint16_t const*>(data)[index]);
+            case Texture::Format::kRgba32:
+            case Texture::Format::kR32:
+            case Texture::Format::kRg32:
+                return reinterpret_cast<float const*>(data)[index];
+            default:
+                throw std::runtime_error("TextureEncoder: block compressed source textures are not supported");
+            }
+        }
+
+        void WriteComponent(Texture::Format format, float value, char* data, std::size_t index)
+        {
+            switch (format)
+            {
+            case Texture::Format::kRgba8:
+            case Texture::Format::kR8:
+            case Texture::Format::kRg8:
+                reinterpret_cast<std::uint8_t*>(data)[index] = ToUnorm8(value);
+                break;
+            case Texture::Format::kRgba16:
+            case Texture::Format::kR16:
+            case Texture::Format::kRg16:
+                reinterpret_cast<std::uint16_t*>(data)[index] = FloatToHalf(value);
+                break;
+            default:
+                reinterpret_cast<float*>(data)[index] = value;
+                break;
+            }
+        }
+
+        // Read texel of uncompressed data, single channel formats are
+        // expanded to (r, r, r, r) and two channel formats to (r, g, 0, 0)
+        Texel ReadTexel(Texture::Format format, char const* data, std::size_t index)
+        {
+            auto channels = Texture::GetChannelCount(format);
+            float c[4] = { 0.f, 0.f, 0.f, 0.f };
+
+            for (auto i = 0u; i < channels; ++i)
+            {
+                c[i] = ReadComponent(format, data, index * channels + i);
+            }
+
+            switch (channels)
+            {
+            case 1:
+                return Texel{ { c[0], c[0], c[0], c[0] } };
+            case 2:
+                return Texel{ { c[0], c[1], 0.f, 0.f } };
+            default:
+                return Texel{ { c[0], c[1], c[2], c[3] } };
+            }
+        }
+
+        void WriteTexel(Texture::Format format, Texel const& texel, char* data, std::size_t index)
+        {
+            auto channels = Texture::GetChannelCount(format);
+
+            for (auto i = 0u; i < channels; ++i)
+            {
+                WriteComponent(format, texel.v[i], data, index * channels + i);
+            }
+        }
+
+        std::uint16_t PackRgb565(float const* color)
+        {
+            auto r = static_cast<std::uint16_t>(std::min(std::max(color[0], 0.f), 1.f) * 31.f + 0.5f);
+            auto g = static_cast<std::uint16_t>(std::min(std::max(color[1], 0.f), 1.f) * 63.f + 0.5f);
+            auto b = static_cast<std::uint16_t>(std::min(std::max(color[2], 0.f), 1.f) * 31.f + 0.5f);
+            return static_cast<std::uint16_t>((r << 11) | (g << 5) | b);
+        }
+
+        void UnpackRgb565(std::uint16_t value, float* color)
+        {
+            color[0] = ((value >> 11) & 0x1F) / 31.f;
+            color[1] = ((value >> 5) & 0x3F) / 63.f;
+            color[2] = (value & 0x1F) / 31.f;
+        }
+
+        // Encodes BC1 color block in four color mode. Endpoints are found
+        // along the principal axis of block colors.
+        void EncodeBc1Block(Texel const* texels, std::uint8_t* block)
+        {
+            float mean[3] = { 0.f, 0.f, 0.f };
+            for (auto i = 0; i < 16; ++i)
+            {
+                for (auto c = 0; c < 3; ++c)
+                {
+                    mean[c] += std::min(std::max(texels[i].v[c], 0.f), 1.f) / 16.f;
+                }
+            }
+
+            // Covariance matrix: xx, xy, xz, yy, yz, zz
+            float cov[6] = { 0.f, 0.f, 0.f, 0.f, 0.f, 0.f };
+            for (auto i = 0; i < 16; ++i)
+            {
+                float d[3];
+                for (auto c = 0; c < 3; ++c)
+                {
+                    d[c] = std::min(std::max(texels[i].v[c], 0.f), 1.f) - mean[c];
+                }
+
+                cov[0] += d[0] * d[0]; cov[1] += d[0] * d[1]; cov[2] += d[0] * d[2];
+                cov[3] += d[1] * d[1]; cov[4] += d[1] * d[2]; cov[5] += d[2] * d[2];
+            }
+
+            // Power iteration for the principal axis
+            float axis[3] = { 1.f, 1.f, 1.f };
+            for (auto iter = 0; iter < 8; ++iter)
+            {
+                float a[3] = {
+                    cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2],
+                    cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2],
+                    cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2]
+                };
+
+                float norm = std::max(std::max(std::abs(a[0]), std::abs(a[1])), std::abs(a[2]));
+                if (norm < 1e-8f)
+                {
+                    break;
+                }
+
+                for (auto c = 0; c < 3; ++c)
+                {
+                    axis[c] = a[c] / norm;
+                }
+            }
+
+            float axis_length2 = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+            float min_t = 0.f;
+            float max_t = 0.f;
+            for (auto i = 0; i < 16; ++i)
+            {
+                float t = 0.f;
+                for (auto c = 0; c < 3; ++c)
+                {
+                    t += (std::min(std::max(texels[i].v[c], 0.f), 1.f) - mean[c]) * axis[c];
+                }
+
+                min_t = std::min(min_t, t);
+                max_t = std::max(max_t, t);
+            }
+
+            float e0[3], e1[3];
+            for (auto c = 0; c < 3; ++c)
+            {
+                e0[c] = mean[c] + axis[c] * max_t / axis_length2;
+                e1[c] = mean[c] + axis[c] * min_t / axis_length2;
+            }
+
+            auto c0 = PackRgb565(e0);
+            auto c1 = PackRgb565(e1);
+            if (c0 < c1)
+            {
+                std::swap(c0, c1);
+            }
+
+            std::uint32_t indices = 0;
+            if (c0 != c1)
+            {
+                float palette[4][3];
+                UnpackRgb565(c0, palette[0]);
+                UnpackRgb565(c1, palette[1]);
+                for (auto c = 0; c < 3; ++c)
+                {
+                    palette[2][c] = (2.f * palette[0][c] + palette[1][c]) / 3.f;
+                    palette[3][c] = (palette[0][c] + 2.f * palette[1][c]) / 3.f;
+                }
+
+                for (auto i = 0; i < 16; ++i)
+                {
+                    std::uint32_t best = 0;
+                    float best_distance = std::numeric_limits<float>::max();
+                    for (auto p = 0u; p < 4; ++p)
+                    {
+                        float distance = 0.f;
+                        for (auto c = 0; c < 3; ++c)
+                        {
+                            float d = texels[i].v[c] - palette[p][c];
+                            distance += d * d;
+                        }
+
+                        if (distance < best_distance)
+                        {
+                            best_distance = distance;
+                            best = p;
+                        }
+                    }
+
+                    indices |= best << (2 * i);
+                }
+            }
+
+            block[0] = static_cast<std::uint8_t>(c0 & 0xFF);
+            block[1] = static_cast<std::uint8_t>(c0 >> 8);
+            block[2] = static_cast<std::uint8_t>(c1 & 0xFF);
+            block[3] = static_cast<std::uint8_t>(c1 >> 8);
+            for (auto i = 0; i < 4; ++i)
+            {
+                block[4 + i] = static_cast<std::uint8_t>((indices >> (8 * i)) & 0xFF);
+            }
+        }
+
+        // Encodes BC4 block in eight value mode using block range as endpoints
+        void EncodeBc4Block(float const* values, std::uint8_t* block)
+        {
+            auto range = std::minmax_element(values, values + 16);
+            auto r0 = ToUnorm8(*range.second);
+            auto r1 = ToUnorm8(*range.first);
+
+            block[0] = r0;
+            block[1] = r1;
+
+            std::uint64_t indices = 0;
+            if (r0 > r1)
+            {
+                float palette[8] = { static_cast<float>(r0), static_cast<float>(r1) };
+                for (auto k = 2; k < 8; ++k)
+                {
+                    palette[k] = ((8 - k) * r0 + (k - 1) * r1) / 7.f;
+                }
+
+                for (auto i = 0; i < 16; ++i)
+                {
+                    float value = std::min(std::max(values[i], 0.f), 1.f) * 255.f;
+                    std::uint64_t best = 0;
+                    for (auto k = 1u; k < 8; ++k)
+                    {
+                        if (std::abs(value - palette[k]) < std::abs(value - palette[best]))
+                        {
+                            best = k;
+                        }
+                    }
+
+                    indices |= best << (3 * i);
+                }
+            }
+
+            for (auto i = 0; i < 6; ++i)
+            {
+                block[2 + i] = static_cast<std::uint8_t>((indices >> (8 * i)) & 0xFF);
+            }
+        }
+
+        // Encodes 4x4 texels into block of compressed format
+        void EncodeBlock(Texture::Format format, Texel const* texels, std::uint8_t* block)
+        {
+            float values[16];
+
+            switch (format)
+            {
+            case Texture::Format::kBc1:
+                EncodeBc1Block(texels, block);
+                break;
+            case Texture::Format::kBc3:
+                for (auto i = 0; i < 16; ++i)
+                {
+                    values[i] = texels[i].v[3];
+                }
+                EncodeBc4Block(values, block);
+                EncodeBc1Block(texels, block + 8);
+                break;
+            case Texture::Format::kBc4:
+                for (auto i = 0; i < 16; ++i)
+                {
+                    values[i] = texels[i].v[0];
+                }
+                EncodeBc4Block(values, block);
+                break;
+            case Texture::Format::kBc5:
+                for (auto c = 0; c < 2; ++c)
+                {
+                    for (auto i = 0; i < 16; ++i)
+                    {
+                        values[i] = texels[i].v[c];
+                    }
+                    EncodeBc4Block(values, block + 8 * c);
+                }
+                break;
+            default:
+                break;
+            }
+        }
+
+        // Converts rows [y_begin, y_end) of the level, for block compressed formats rows are rows of blocks
+        void EncodeRows(Texture::Format src_format, char const* src, RadeonRays::int3 size,
+            Texture::Format dst_format, char* dst, int y_begin, int y_end)
+        {
+            if (!Texture::IsBlockCompressed(dst_format))
+            {
+                for (auto y = y_begin; y < y_end; ++y)
+                {
+                    for (auto x = 0; x < size.x; ++x)
+                    {
+                        std::size_t index = static_cast<std::size_t>(y) * size.x + x;
+                        WriteTexel(dst_format, ReadTexel(src_format, src, index), dst, index);
+                    }
+                }
+
+                return;
+            }
+
+            auto blocks_x = (size.x + 3) / 4;
+            auto block_size = Texture::GetImageSizeInBytes(dst_format, RadeonRays::int3(4, 4, 1));
+
+            for (auto by = y_begin; by < y_end; ++by)
+            {
+                for (auto bx = 0; bx < blocks_x; ++bx)
+                {
+                    // Edge texels are replicated for partial blocks
+                    Texel texels[16];
+                    for (auto i = 0; i < 16; ++i)
+                    {
+                        auto x = std::min(4 * bx + (i & 3), size.x - 1);
+                        auto y = std::min(4 * by + (i >> 2), size.y - 1);
+                        texels[i] = ReadTexel(src_format, src, static_cast<std::size_t>(y) * size.x + x);
+                    }
+
+                    auto block = reinterpret_cast<std::uint8_t*>(dst) + block_size * (static_cast<std::size_t>(by) * blocks_x + bx);
+                    EncodeBlock(dst_format, texels, block);
+                }
+            }
+        }
+
+        void EncodeLevel(ThreadPool* pool, Texture::Format src_format, char const* src, RadeonRays::int3 size,
+            Texture::Format dst_format, char* dst)
+        {
+            int num_rows = Texture::IsBlockCompressed(dst_format) ? (size.y + 3) / 4 : size.y * size.z;
+
+            if (!pool)
+            {
+                EncodeRows(src_format, src, size, dst_format, dst, 0, num_rows);
+                return;
+            }
+
+            // Split level into row ranges, several per thread to balance the load
+            int num_tasks = std::min(num_rows, static_cast<int>(4 * std::max(1u, std::thread::hardware_concurrency())));
+            int rows_per_task = (num_rows + num_tasks - 1) / num_tasks;
+
+            std::vector<std::future<void>> tasks;
+            for (auto y = 0; y < num_rows; y += rows_per_task)
+            {
+                auto y_end = std::min(y + rows_per_task, num_rows);
+                tasks.push_back(pool->Submit([=]()
+                {
+                    EncodeRows(src_format, src, size, dst_format, dst, y, y_end);
+                }));
+            }
+
+            for (auto& task : tasks)
+            {
+                task.get();
+            }
+        }
+    }
+
+    Texture::Format TextureEncoder::SelectFormat(Texture const& texture, bool allow_block_compression)
+    {
+        auto format = texture.GetFormat();
+
+        if (texture.IsVirtual() ||
+            (format != Texture::Format::kRgba8 &&
+            format != Texture::Format::kRgba16 &&
+            format != Texture::Format::kRgba32))
+        {
+            return format;
+        }
+
+        auto size = texture.GetSize();
+        auto data = texture.GetData();
+        std::size_t num_texels = static_cast<std::size_t>(size.x) * size.y * size.z;
+
+        auto first = ReadTexel(format, data, 0);
+        bool grayscale = true;
+        bool alpha_constant = true;
+        bool alpha_is_red = true;
+
+        for (std::size_t i = 0; i < num_texels && (grayscale || alpha_constant); ++i)
+        {
+            auto texel = ReadTexel(format, data, i);
+            grayscale = grayscale && texel.v[0] == texel.v[1] && texel.v[0] == texel.v[2];
+            alpha_constant = alpha_constant && texel.v[3] == first.v[3];
+            alpha_is_red = alpha_is_red && texel.v[3] == texel.v[0];
+        }
+
+        bool can_compress = allow_block_compression && format == Texture::Format::kRgba8 && size.z == 1;
+
+        if (grayscale && (alpha_constant || alpha_is_red))
+        {
+            switch (format)
+            {
+            case Texture::Format::kRgba8:
+                return can_compress ? Texture::Format::kBc4 : Texture::Format::kR8;
+            case Texture::Format::kRgba16:
+                return Texture::Format::kR16;
+            default:
+                return Texture::Format::kR32;
+            }
+        }
+
+        if (!can_compress)
+        {
+            return format;
+        }
+
+        return alpha_constant ? Texture::Format::kBc1 : Texture::Format::kBc3;
+    }
+
+    Texture::Ptr TextureEncoder::Encode(Texture const& texture, Texture::Format format, ThreadPool* pool)
+    {
+        auto src_format = texture.GetFormat();
+
+        if (texture.IsVirtual())
+        {
+            throw std::runtime_error("TextureEncoder: virtual textures are not supported");
+        }
+
+        if (Texture::IsBlockCompressed(src_format))
+        {
+            throw std::runtime_error("TextureEncoder: block compressed source textures are not supported");
+        }
+
+        if (Texture::IsBlockCompressed(format) && texture.GetSize().z > 1)
+        {
+            throw std::runtime_error("TextureEncoder: block compression of 3D textures is not supported");
+        }
+
+        auto mip_count = texture.GetMipLevelCount();
+
+        std::size_t size_in_bytes = 0;
+        for (auto level = 0u; level < mip_count; ++level)
+        {
+            size_in_bytes += Texture::GetImageSizeInBytes(format, texture.GetMipLevelSize(level));
+        }
+
+        std::unique_ptr<char[]> data(new char[size_in_bytes]);
+
+        std::size_t offset = 0;
+        for (auto level = 0u; level < mip_count; ++level)
+        {
+            auto level_size = texture.GetMipLevelSize(level);
+            EncodeLevel(pool, src_format, texture.GetData() + texture.GetMipLevelOffset(level), level_size,
+                format, data.get() + offset);
+            offset += Texture::GetImageSizeInBytes(format, level_size);
+        }
+
+        auto result = Texture::Create(data.release(), texture.GetSize(), format, mip_count);
+        result->SetName(texture.GetName());
+        return result;
+    }
+}
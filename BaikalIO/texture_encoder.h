@@ -0,0 +1,82 @@
+/**********************************************************************
+ Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ********************************************************************/
+
+/**
+ \file texture_encoder.h
+ \author Dmitry Kozlov
+ \version 1.0
+ \brief Conversion of textures into compact formats.
+ */
+#pragma once
+
+#include "SceneGraph/texture.h"
+
+#ifdef WIN32
+#ifdef BAIKAL_EXPORT_API
+#define BAIKAL_API_ENTRY __declspec(dllexport)
+#else
+#define BAIKAL_API_ENTRY __declspec(dllimport)
+#endif
+#else
+#define BAIKAL_API_ENTRY __attribute__((visibility ("default")))
+#endif
+
+namespace Baikal
+{
+    class ThreadPool;
+
+    /**
+     \brief Texture encoder.
+
+     Converts textures into single and two channel or block compressed (BC1, BC3, BC4, BC5)
+     formats to reduce GPU memory footprint. Encoding is done on CPU, each mip level
+     of the source texture is encoded separately.
+     */
+    class BAIKAL_API_ENTRY TextureEncoder
+    {
+    public:
+        /**
+         \brief Select the most compact format which represents texture content.
+
+         Grayscale textures are stored in single channel formats and alpha is
+         dropped if it is constant. Only 8 bit textures are block compressed,
+         HDR textures keep their precision.
+
+         \param texture Texture to analyze.
+         \param allow_block_compression Allow lossy block compressed formats.
+         \return Format for the texture, source format if no better format was found.
+         */
+        static Texture::Format SelectFormat(Texture const& texture, bool allow_block_compression = true);
+
+        /**
+         \brief Convert texture to the given format.
+
+         Source texture should be in uncompressed format, its mip chain is converted as well.
+
+         \param texture Texture to convert.
+         \param format Target format.
+         \param pool Optional thread pool to encode rows of each level on.
+         \return New texture in target format.
+         */
+        static Texture::Ptr Encode(Texture const& texture, Texture::Format format, ThreadPool* pool = nullptr);
+    };
+}
@@ -0,0 +1,165 @@
+/**********************************************************************
+ Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ********************************************************************/
+#include "volume_io.h"
+
+#include <cstdint>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+namespace Baikal
+{
+    namespace
+    {
+        // "BVOL"
+        std::uint32_t constexpr kVolumeMagic = 0x4c4f5642;
+        std::uint32_t constexpr kVolumeVersion = 1;
+
+        struct VolumeFileHeader
+        {
+            std::uint32_t magic;
+            std::uint32_t version;
+            std::int32_t resolution[3];
+            std::uint32_t brick_size;
+            float bbox_min[3];
+            float bbox_max[3];
+            std::uint32_t num_bricks;
+            std::uint32_t num_stored_bricks;
+        };
+
+        template <typename T>
+        void Read(std::ifstream& in, T* data, std::size_t count, std::string const& filename)
+        {
+            if (!in.read(reinterpret_cast<char*>(data), sizeof(T) * count))
+            {
+                throw std::runtime_error("VolumeIo: unexpected end of " + filename);
+            }
+        }
+    }
+
+    class VolumeIoBinary : public VolumeIo
+    {
+    public:
+        VolumeGrid::Ptr LoadVolume(std::string const& filename) const override
+        {
+            std::ifstream in(filename, std::ios::binary);
+
+            if (!in)
+            {
+                throw std::runtime_error("VolumeIo: can't open " + filename);
+            }
+
+            VolumeFileHeader header;
+            Read(in, &header, 1, filename);
+
+            if (header.magic != kVolumeMagic)
+            {
+                throw std::runtime_error("VolumeIo: " + filename + " is not a volume file");
+            }
+
+            if (header.version > kVolumeVersion)
+            {
+                throw std::runtime_error("VolumeIo: " + filename + " has unsupported version");
+            }
+
+            if (header.brick_size != VolumeGrid::kBrickSize)
+            {
+                throw std::runtime_error("VolumeIo: " + filename + " has unsupported brick size");
+            }
+
+            std::vector<std::int32_t> brick_table(header.num_bricks);
+            std::vector<float> bricks(static_cast<std::size_t>(header.num_stored_bricks) * VolumeGrid::kBrickVoxels);
+            Read(in, brick_table.data(), brick_table.size(), filename);
+            Read(in, bricks.data(), bricks.size(), filename);
+
+            // Grid validates brick table against resolution
+            return VolumeGrid::Create(
+                RadeonRays::int3(header.resolution[0], header.resolution[1], header.resolution[2]),
+                std::move(brick_table), std::move(bricks),
+                RadeonRays::float3(header.bbox_min[0], header.bbox_min[1], header.bbox_min[2]),
+                RadeonRays::float3(header.bbox_max[0], header.bbox_max[1], header.bbox_max[2]));
+        }
+
+        VolumeGrid::Ptr LoadRawVolume(std::string const& filename, RadeonRays::int3 resolution,
+                                      RadeonRays::float3 const& bbox_min, RadeonRays::float3 const& bbox_max) const override
+        {
+            if (resolution.x <= 0 || resolution.y <= 0 || resolution.z <= 0)
+            {
+                throw std::runtime_error("VolumeIo: invalid resolution of " + filename);
+            }
+
+            std::ifstream in(filename, std::ios::binary);
+
+            if (!in)
+            {
+                throw std::runtime_error("VolumeIo: can't open " + filename);
+            }
+
+            std::vector<float> density(static_cast<std::size_t>(resolution.x) * resolution.y * resolution.z);
+            Read(in, density.data(), density.size(), filename);
+
+            return VolumeGrid::Create(resolution, density.data(), bbox_min, bbox_max);
+        }
+
+        void SaveVolume(std::string const& filename, VolumeGrid const& grid) const override
+        {
+            std::ofstream out(filename, std::ios::binary);
+
+            if (!out)
+            {
+                throw std::runtime_error("VolumeIo: can't create " + filename);
+            }
+
+            auto resolution = grid.GetResolution();
+            auto bbox_min = grid.GetBboxMin();
+            auto bbox_max = grid.GetBboxMax();
+            auto const& brick_table = grid.GetBrickTable();
+            auto const& bricks = grid.GetBricks();
+
+            VolumeFileHeader header =
+            {
+                kVolumeMagic,
+                kVolumeVersion,
+                { resolution.x, resolution.y, resolution.z },
+                VolumeGrid::kBrickSize,
+                { bbox_min.x, bbox_min.y, bbox_min.z },
+                { bbox_max.x, bbox_max.y, bbox_max.z },
+                static_cast<std::uint32_t>(brick_table.size()),
+                static_cast<std::uint32_t>(grid.GetStoredBrickCount())
+            };
+
+            out.write(reinterpret_cast<char const*>(&header), sizeof(header));
+            out.write(reinterpret_cast<char const*>(brick_table.data()), sizeof(std::int32_t) * brick_table.size());
+            out.write(reinterpret_cast<char const*>(bricks.data()), sizeof(float) * bricks.size());
+
+            if (!out)
+            {
+                throw std::runtime_error("VolumeIo: failed to write " + filename);
+            }
+        }
+    };
+
+    std::unique_ptr<VolumeIo> VolumeIo::CreateVolumeIo()
+    {
+        return std::make_unique<VolumeIoBinary>();
+    }
+}
@@ -0,0 +1,76 @@
+/**********************************************************************
+ Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ********************************************************************/
+
+/**
+ \file volume_io.h
+ \version 1.0
+ \brief Loading and saving of volume density grids.
+ */
+#pragma once
+
+#include "SceneGraph/volume_grid.h"
+
+#include <string>
+#include <memory>
+
+#ifdef WIN32
+#ifdef BAIKAL_EXPORT_API
+#define BAIKAL_API_ENTRY __declspec(dllexport)
+#else
+#define BAIKAL_API_ENTRY __declspec(dllimport)
+#endif
+#else
+#define BAIKAL_API_ENTRY __attribute__((visibility ("default")))
+#endif
+
+namespace Baikal
+{
+    /**
+     \brief Interface for volume grid loading and writing.
+
+     Sparse grids are stored in .bvol files which mirror VolumeGrid layout:
+     header with resolution, bounds, brick size and number of stored bricks
+     followed by brick table and voxels of stored bricks, so loading does not
+     touch empty space. Dense grids can be imported from raw arrays of 32-bit floats.
+     */
+    class BAIKAL_API_ENTRY VolumeIo
+    {
+    public:
+        // Create default volume IO
+        static std::unique_ptr<VolumeIo> CreateVolumeIo();
+
+        VolumeIo() = default;
+        virtual ~VolumeIo() = default;
+
+        // Load sparse grid from .bvol file
+        virtual VolumeGrid::Ptr LoadVolume(std::string const& filename) const = 0;
+        // Load dense grid of resolution.x * resolution.y * resolution.z floats (x changes fastest)
+        virtual VolumeGrid::Ptr LoadRawVolume(std::string const& filename, RadeonRays::int3 resolution,
+                                              RadeonRays::float3 const& bbox_min, RadeonRays::float3 const& bbox_max) const = 0;
+        // Save grid into .bvol file
+        virtual void SaveVolume(std::string const& filename, VolumeGrid const& grid) const = 0;
+
+        // Disallow copying
+        VolumeIo(VolumeIo const&) = delete;
+        VolumeIo& operator = (VolumeIo const&) = delete;
+    };
+}
@@ -176,6 +176,7 @@ namespace Baikal
         Baikal::DirectionalLight* directl = dynamic_cast<Baikal::DirectionalLight*>(l.get());
         Baikal::SpotLight* spotl = dynamic_cast<Baikal::SpotLight*>(l.get());
         Baikal::AreaLight* areal = dynamic_cast<Baikal::AreaLight*>(l.get());
+        Baikal::MeshLight* meshl = dynamic_cast<Baikal::MeshLight*>(l.get());
 
         tinyxml2::XMLDocument doc;
 
@@ -187,9 +188,9 @@ namespace Baikal
             doc.InsertFirstChild(root);
         }
 
-        if (areal)
+        if (areal || meshl)
         {
-            //area lights are created when materials load, so ignore it;
+            //area and mesh lights are created when materials load, so ignore it;
             return;
         }
 
@@ -519,12 +519,18 @@ namespace Baikal
             }
 
             auto& scene = controller->GetCachedScene(m_scene);
-            renderer->Render(scene);
-            ++new_samples_count;
+
+            // Render until the next output update, stop early on clear or stop request
+            auto progress = renderer->RenderProgressive(scene, 0, std::chrono::seconds(1),
+                [&cd](Renderer::Progress const&)
+                {
+                    return !cd.stop.load() && cd.clear.load() == 0;
+                });
+            new_samples_count += progress.num_iterations;
 
             auto now = std::chrono::high_resolution_clock::now();
 
-            update = update || (std::chrono::duration_cast<std::chrono::seconds>(now - updatetime).count() > 1);
+            update = update || (std::chrono::duration_cast<std::chrono::seconds>(now - updatetime).count() >= 1);
 
             if (update)
             {
@@ -535,8 +541,6 @@ namespace Baikal
                 new_samples_count = 0;
                 cd.newdata.store(1);
             }
-
-            m_cfgs[cd.idx].context.Finish(0);
         }
     }
 
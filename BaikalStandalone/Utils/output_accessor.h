@@ -93,6 +93,8 @@ namespace Baikal
                     return "opacity";
                 case Renderer::OutputType::kVisibility:
                     return "visibility";
+                case Renderer::OutputType::kConvergenceError:
+                    return "convergence_error";
                 case Baikal::Renderer::OutputType::kMaxMultiPassOutput:
                     return "max_multi_pass_output";
                 case Baikal::Renderer::OutputType::kMeshID:
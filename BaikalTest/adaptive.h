@@ -0,0 +1,140 @@
+/**********************************************************************
+ Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ********************************************************************/
+#pragma once
+
+#include "basic.h"
+#include "Renderers/adaptive_renderer.h"
+
+class AdaptiveTest : public BasicTest
+{
+public:
+    static std::uint32_t constexpr kMaxIterations = 1024;
+    static std::uint32_t constexpr kMinSamples = 16;
+
+    virtual void SetUp()
+    {
+        BasicTest::SetUp();
+
+        if (HasFatalFailure())
+        {
+            return;
+        }
+
+        ASSERT_NO_THROW(m_renderer = m_factory->CreateRenderer(Baikal::ClwRenderFactory::RendererType::kAdaptivePathTracer));
+        ASSERT_NO_THROW(m_renderer->SetOutput(Baikal::Renderer::OutputType::kColor, m_output.get()));
+        ASSERT_NO_THROW(m_renderer->SetRandomSeed(0));
+
+        m_adaptive_renderer = dynamic_cast<Baikal::AdaptiveRenderer*>(m_renderer.get());
+        ASSERT_NE(m_adaptive_renderer, nullptr);
+    }
+
+    // Render until every pixel is below threshold and report samples saved
+    // compared to uniform sampling with the same number of iterations
+    void RenderUntilConverged(float threshold)
+    {
+        auto error_output = m_factory->CreateOutput(m_output->width(), m_output->height());
+        m_renderer->SetOutput(Baikal::Renderer::OutputType::kConvergenceError, error_output.get());
+
+        m_adaptive_renderer->SetConvergenceThreshold(threshold);
+        m_adaptive_renderer->SetMinSamples(kMinSamples);
+
+        ClearOutput(error_output.get());
+        ASSERT_NO_THROW(m_controller->CompileScene(m_scene));
+
+        auto& scene = m_controller->GetCachedScene(m_scene);
+
+        Baikal::Renderer::Progress progress;
+        ASSERT_NO_THROW(progress = m_renderer->RenderProgressive(scene, kMaxIterations));
+
+        auto stats = m_adaptive_renderer->GetConvergenceStats();
+        auto saved = stats.num_uniform_samples - stats.num_samples;
+
+        std::cout << test_name() << ": " << progress.num_iterations << " iterations, "
+            << stats.num_converged << " of " << stats.num_pixels << " pixels converged, "
+            << stats.num_samples << " rays traced, " << saved << " rays saved ("
+            << 100.0 * saved / stats.num_uniform_samples << "%)" << std::endl;
+
+        ASSERT_EQ(stats.num_pixels, m_output->width() * m_output->height());
+        ASSERT_EQ(stats.num_uniform_samples, stats.num_pixels * progress.num_iterations);
+        ASSERT_LE(stats.num_samples, stats.num_uniform_samples);
+
+        // Each pixel takes at least min samples
+        ASSERT_GE(stats.num_samples, stats.num_pixels * kMinSamples);
+
+        if (progress.converged)
+        {
+            ASSERT_EQ(stats.num_converged, stats.num_pixels);
+            ASSERT_LT(progress.num_iterations, std::uint32_t(kMaxIterations));
+        }
+
+        // Error AOV matches converged pixel count
+        std::vector<RadeonRays::float3> error(stats.num_pixels);
+        error_output->GetData(&error[0]);
+
+        auto num_below_threshold = std::count_if(error.cbegin(), error.cend(),
+            [threshold](RadeonRays::float3 const& e) { return e.x <= threshold; });
+
+        ASSERT_EQ(static_cast<std::uint64_t>(num_below_threshold), stats.num_converged);
+
+        m_renderer->SetOutput(Baikal::Renderer::OutputType::kConvergenceError, nullptr);
+    }
+
+    Baikal::AdaptiveRenderer* m_adaptive_renderer;
+};
+
+TEST_F(AdaptiveTest, Adaptive_Convergence)
+{
+    RenderUntilConverged(0.05f);
+}
+
+TEST_F(AdaptiveTest, Adaptive_ConvergenceStrictThreshold)
+{
+    RenderUntilConverged(0.01f);
+}
+
+TEST_F(AdaptiveTest, Adaptive_CornellBox)
+{
+    m_camera = Baikal::PerspectiveCamera::Create(
+        RadeonRays::float3(0.f, 1.f, 3.f),
+        RadeonRays::float3(0.f, 1.f, 0.f),
+        RadeonRays::float3(0.f, 1.f, 0.f));
+
+    try
+    {
+        m_scene = Baikal::SceneIo::LoadScene("../Resources/TestData/CornellBox/orig.objm",
+            "../Resources/TestData/CornellBox/");
+    }
+    catch (std::exception&)
+    {
+        std::cout << "There's no CornellBox test set" << std::endl;
+        return;
+    }
+
+    m_camera->SetSensorSize(RadeonRays::float2(0.036f, 0.036f));
+    m_camera->SetDepthRange(RadeonRays::float2(0.0f, 100000.f));
+    m_camera->SetFocalLength(0.035f);
+    m_camera->SetFocusDistance(1.f);
+    m_camera->SetAperture(0.f);
+    m_scene->SetCamera(m_camera);
+
+    RenderUntilConverged(0.05f);
+}
@@ -23,6 +23,7 @@
 
 #include "basic.h"
 #include "SceneGraph/light.h"
+#include "Output/clw_output_readback.h"
 
 class AovTest : public BasicTest
 {   };
@@ -499,3 +500,171 @@ TEST_F(AovTest, Aov_Opacity)
     SaveOutput(oss.str(), output_ws.get());
     ASSERT_TRUE(CompareToReference(oss.str()));
 }
+
+// Packed AOVs hold the same values as normalized float AOVs at lower precision
+TEST_F(AovTest, Aov_PackedFormats)
+{
+    using OutputType = Baikal::Renderer::OutputType;
+    using Format = Baikal::Output::Format;
+
+    struct PackedAov
+    {
+        OutputType type;
+        Format format;
+        float tolerance;
+    };
+
+    std::vector<PackedAov> const aovs =
+    {
+        { OutputType::kDepth, Format::kR32F, 1e-4f },
+        { OutputType::kUv, Format::kRG16F, 2e-3f },
+        { OutputType::kWorldShadingNormal, Format::kRGBA16F, 2e-3f },
+        { OutputType::kShapeId, Format::kR32UI, 0.f }
+    };
+
+    ASSERT_NO_THROW(m_controller->CompileScene(m_scene));
+    auto& scene = m_controller->GetCachedScene(m_scene);
+
+    auto num_pixels = m_output->width() * m_output->height();
+
+    for (auto const& aov : aovs)
+    {
+        std::vector<RadeonRays::float3> expected(num_pixels);
+        std::vector<RadeonRays::float3> actual(num_pixels);
+
+        auto float_output = m_factory->CreateOutput(m_output->width(), m_output->height());
+        auto packed_output = m_factory->CreateOutput(m_output->width(), m_output->height(), aov.format);
+
+        for (auto output : { float_output.get(), packed_output.get() })
+        {
+            ASSERT_NO_THROW(m_renderer->SetOutput(aov.type, output));
+            ClearOutput(output);
+
+            for (auto i = 0u; i < kNumIterations; ++i)
+            {
+                ASSERT_NO_THROW(m_renderer->Render(scene));
+            }
+        }
+
+        m_renderer->SetOutput(aov.type, nullptr);
+
+        float_output->GetData(expected.data());
+        packed_output->GetData(actual.data());
+
+        std::cout << "Output " << static_cast<int>(aov.type) << ": "
+            << Baikal::Output::GetPixelSize(aov.format) * num_pixels << " bytes packed, "
+            << Baikal::Output::GetPixelSize(Format::kRGBA32F) * num_pixels << " bytes float" << std::endl;
+
+        for (auto i = 0u; i < num_pixels; ++i)
+        {
+            // Ids are written as is, everything else is averaged
+            auto value = expected[i];
+            if (aov.type != OutputType::kShapeId)
+            {
+                if (value.w == 0.f)
+                {
+                    continue;
+                }
+                value *= 1.f / value.w;
+            }
+
+            for (auto c = 0; c < 3; ++c)
+            {
+                auto tolerance = aov.tolerance * std::max(1.f, std::abs(value[c]));
+                ASSERT_NEAR(value[c], actual[i][c], tolerance) << "at pixel " << i;
+            }
+            ASSERT_EQ(actual[i].w, 1.f);
+        }
+    }
+
+    // Multi-pass outputs and non-id AOVs can't be packed into integers
+    auto output = m_factory->CreateOutput(m_output->width(), m_output->height(), Format::kR32UI);
+    ASSERT_THROW(m_renderer->SetOutput(OutputType::kColor, output.get()), std::runtime_error);
+    ASSERT_THROW(m_renderer->SetOutput(OutputType::kDepth, output.get()), std::runtime_error);
+}
+
+TEST_F(AovTest, Aov_AsyncReadback)
+{
+    using OutputType = Baikal::Renderer::OutputType;
+    using Settings = Baikal::ClwOutputReadback::Settings;
+
+    auto factory = static_cast<Baikal::ClwRenderFactory*>(m_factory.get());
+    std::unique_ptr<Baikal::ClwOutputReadback> readback;
+    ASSERT_NO_THROW(readback = factory->CreateOutputReadback(2));
+
+    auto depth_output = m_factory->CreateOutput(m_output->width(), m_output->height(), Baikal::Output::Format::kR32F);
+    ASSERT_NO_THROW(m_renderer->SetOutput(OutputType::kDepth, depth_output.get()));
+    ClearOutput(depth_output.get());
+
+    ASSERT_NO_THROW(m_controller->CompileScene(m_scene));
+    auto& scene = m_controller->GetCachedScene(m_scene);
+
+    for (auto i = 0u; i < kNumIterations; ++i)
+    {
+        ASSERT_NO_THROW(m_renderer->Render(scene));
+    }
+
+    m_renderer->SetOutput(OutputType::kDepth, nullptr);
+
+    auto width = m_output->width();
+    auto height = m_output->height();
+
+    std::vector<RadeonRays::float3> color(width * height);
+    std::vector<RadeonRays::float3> depth(width * height);
+    m_output->GetData(color.data());
+    depth_output->GetData(depth.data());
+
+    Settings color_settings;
+    color_settings.channels = 3;
+    color_settings.gamma = 2.2f;
+    color_settings.flip_y = true;
+
+    Settings depth_settings;
+    depth_settings.channels = 1;
+
+    auto color_request = readback->Read(*static_cast<Baikal::ClwOutput*>(m_output.get()), color_settings);
+    auto depth_request = readback->Read(*static_cast<Baikal::ClwOutput*>(depth_output.get()), depth_settings);
+
+    ASSERT_EQ(color_request.width(), width);
+    ASSERT_EQ(color_request.height(), height);
+    ASSERT_EQ(color_request.channels(), 3u);
+
+    float const* color_data = nullptr;
+    float const* depth_data = nullptr;
+    ASSERT_NO_THROW(color_data = color_request.Get());
+    ASSERT_NO_THROW(depth_data = depth_request.Get());
+    ASSERT_TRUE(color_request.IsReady());
+
+    for (auto y = 0u; y < height; ++y)
+    {
+        for (auto x = 0u; x < width; ++x)
+        {
+            auto value = color[(height - 1 - y) * width + x];
+            auto resolved = color_data + (y * width + x) * 3;
+
+            if (value.w == 0.f)
+            {
+                continue;
+            }
+
+            value *= 1.f / value.w;
+
+            for (auto c = 0; c < 3; ++c)
+            {
+                auto expected = std::pow(std::max(value[c], 0.f), 1.f / 2.2f);
+                ASSERT_NEAR(expected, resolved[c], 1e-3f * std::max(1.f, expected)) << "at pixel " << x << ", " << y;
+            }
+        }
+    }
+
+    for (auto i = 0u; i < width * height; ++i)
+    {
+        ASSERT_NEAR(depth[i].x, depth_data[i], 1e-5f * std::max(1.f, std::abs(depth[i].x)));
+    }
+
+    // Staging buffer of the first request is reused by the third one
+    auto request = readback->Read(*static_cast<Baikal::ClwOutput*>(m_output.get()));
+    ASSERT_THROW(color_request.Get(), std::runtime_error);
+    ASSERT_NO_THROW(depth_request.Get());
+    ASSERT_NO_THROW(request.Get());
+}
@@ -37,6 +37,9 @@ THE SOFTWARE.
 #include <memory>
 #include <algorithm>
 #include <cstdlib>
+#include <chrono>
+#include <cmath>
+#include <cstring>
 #include <sstream>
 #include <iostream>
 
@@ -117,7 +120,7 @@ public:
         auto device = platform.GetDevice(device_index);
         auto context = CLWContext::Create(device);
 
-        ASSERT_NO_THROW(m_factory = std::make_unique<Baikal::ClwRenderFactory>(context, "cache"));
+        ASSERT_NO_THROW(m_factory = std::make_unique<Baikal::ClwRenderFactory>(context, "cache", GetMaterialCompilationMode()));
         ASSERT_NO_THROW(m_renderer = m_factory->CreateRenderer(Baikal::ClwRenderFactory::RendererType::kUnidirectionalPathTracer));
         ASSERT_NO_THROW(m_controller = m_factory->CreateSceneController());
         ASSERT_NO_THROW(m_output = m_factory->CreateOutput(kOutputWidth, kOutputHeight));
@@ -144,6 +147,11 @@ public:
         ASSERT_NO_THROW(m_renderer->Clear(RadeonRays::float3(), *m_output));
     }
 
+    virtual Baikal::MaterialCompilationMode GetMaterialCompilationMode() const
+    {
+        return Baikal::MaterialCompilationMode::kCodegen;
+    }
+
     virtual void LoadTestScene()
     {
         m_scene = Baikal::SceneIo::LoadScene("sphere+ibl.test", "");
@@ -252,7 +260,8 @@ public:
         }
     }
 
-    bool CompareToReference(std::string const& file_name)
+    // If reference_file_name is empty, reference with the same file name is used
+    bool CompareToReference(std::string const& file_name, std::string const& reference_file_name = "")
     {
         if (m_generate)
             return true;
@@ -260,7 +269,7 @@ public:
         std::string path_to_output = m_output_path;
         path_to_output.append(file_name);
         std::string path_to_reference = m_reference_path;
-        path_to_reference.append(file_name);
+        path_to_reference.append(reference_file_name.empty() ? file_name : reference_file_name);
 
         std::vector<char> output_data;
         std::vector<char> reference_data;
@@ -281,6 +290,62 @@ public:
         return difference <= m_tolerance;
     }
 
+    // Renders num_iterations into cleared output and reads back the image divided by sample counts.
+    // Warm up iterations are not accumulated, so kernel compilation is not measured.
+    // Returns samples per second of the measured iterations.
+    double RenderNormalizedImage(Baikal::ClwScene const& scene, std::uint32_t num_iterations,
+        std::vector<RadeonRays::float3>& image, std::uint32_t num_warmup_iterations = 0)
+    {
+        for (auto i = 0u; i < num_warmup_iterations; ++i)
+        {
+            m_renderer->Render(scene);
+        }
+        ClearOutput();
+
+        image.resize(m_output->width() * m_output->height());
+
+        auto start = std::chrono::high_resolution_clock::now();
+        for (auto i = 0u; i < num_iterations; ++i)
+        {
+            m_renderer->Render(scene);
+        }
+        // Reading the output waits for rendering to finish
+        m_output->GetData(&image[0]);
+        auto seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+        for (auto& v : image)
+        {
+            v *= v.w > 0.f ? (1.f / v.w) : 0.f;
+        }
+
+        return seconds > 0.0 ? num_iterations * image.size() / seconds : 0.0;
+    }
+
+    // Root mean square error over color channels
+    static double ComputeRmse(std::vector<RadeonRays::float3> const& image, std::vector<RadeonRays::float3> const& reference)
+    {
+        double sum = 0.0;
+        for (auto i = 0u; i < image.size(); ++i)
+        {
+            auto d = image[i] - reference[i];
+            sum += d.x * d.x + d.y * d.y + d.z * d.z;
+        }
+        return std::sqrt(sum / (3.0 * image.size()));
+    }
+
+    // Error relative to mean reference value, so thresholds don't depend on scene brightness
+    static double ComputeRelativeRmse(std::vector<RadeonRays::float3> const& image, std::vector<RadeonRays::float3> const& reference)
+    {
+        double mean = 0.0;
+        for (auto const& v : reference)
+        {
+            mean += v.x + v.y + v.z;
+        }
+        mean /= 3.0 * reference.size();
+
+        return mean > 0.0 ? ComputeRmse(image, reference) / mean : 0.0;
+    }
+
 
 
     std::string test_name() const
@@ -341,6 +406,110 @@ TEST_F(BasicTest, RenderTestScene)
     ASSERT_TRUE(CompareToReference(test_name() + ".png"));
 }
 
+// Progressive rendering produces the same image as iteration by iteration rendering
+// and stops when iteration budget, time budget or callback says so
+TEST_F(BasicTest, RenderProgressive)
+{
+    ASSERT_NO_THROW(m_controller->CompileScene(m_scene));
+    auto& scene = m_controller->GetCachedScene(m_scene);
 
+    std::vector<RadeonRays::float3> reference(kOutputWidth * kOutputHeight);
+    std::vector<RadeonRays::float3> image(kOutputWidth * kOutputHeight);
 
+    // Client style loop with host synchronization each iteration
+    ClearOutput();
+    m_renderer->SetRandomSeed(0);
+    auto start = std::chrono::high_resolution_clock::now();
+    for (auto i = 0u; i < kNumIterations; ++i)
+    {
+        ASSERT_NO_THROW(m_renderer->Render(scene));
+        m_output->GetData(&reference[0]);
+    }
+    auto loop_time = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+    ClearOutput();
+    m_renderer->SetRandomSeed(0);
+
+    std::uint32_t num_callbacks = 0;
+    std::uint32_t last_iterations = 0;
+    Baikal::Renderer::Progress progress;
+    ASSERT_NO_THROW(progress = m_renderer->RenderProgressive(scene, kNumIterations, std::chrono::duration<double>::zero(),
+        [&num_callbacks, &last_iterations](Baikal::Renderer::Progress const& p)
+        {
+            EXPECT_GT(p.num_iterations, last_iterations);
+            last_iterations = p.num_iterations;
+            ++num_callbacks;
+            return true;
+        }));
+    m_output->GetData(&image[0]);
+
+    std::cout << "Iteration loop: " << loop_time << " s, progressive: " << progress.elapsed.count() << " s in "
+        << num_callbacks << " batches" << std::endl;
+
+    auto const num_iterations = kNumIterations;
+    ASSERT_EQ(progress.num_iterations, num_iterations);
+    ASSERT_EQ(progress.num_accumulated, num_iterations);
+    ASSERT_LE(num_callbacks, num_iterations);
+    ASSERT_EQ(std::memcmp(&image[0], &reference[0], image.size() * sizeof(RadeonRays::float3)), 0);
+
+    // Time budget, elapsed time is not checked against the budget since it depends on machine load
+    auto const time_budget = std::chrono::duration<double>(0.5);
+    Baikal::Renderer::Progress last_progress = {};
+    ClearOutput();
+    ASSERT_NO_THROW(progress = m_renderer->RenderProgressive(scene, 0, time_budget,
+        [&last_progress](Baikal::Renderer::Progress const& p)
+        {
+            EXPECT_GE(p.elapsed.count(), last_progress.elapsed.count());
+            last_progress = p;
+            return true;
+        }));
+    ASSERT_GT(progress.num_iterations, 0u);
+    ASSERT_EQ(progress.num_accumulated, progress.num_iterations);
+    ASSERT_EQ(progress.num_iterations, last_progress.num_iterations);
+
+    // Iteration budget is reached first
+    ClearOutput();
+    ASSERT_NO_THROW(progress = m_renderer->RenderProgressive(scene, num_iterations, std::chrono::duration<double>(3600.0)));
+    ASSERT_EQ(progress.num_iterations, num_iterations);
+
+    // Cancellation
+    ASSERT_NO_THROW(progress = m_renderer->RenderProgressive(scene, 0, std::chrono::duration<double>::zero(),
+        [](Baikal::Renderer::Progress const&) { return false; }));
+    ASSERT_EQ(progress.num_iterations, 1u);
 
+    // No budget at all
+    ASSERT_THROW(m_renderer->RenderProgressive(scene, 0), std::runtime_error);
+}
+
+// Profiling collects per-kernel timings and ray counts only when enabled
+TEST_F(BasicTest, RenderStatistics)
+{
+    ASSERT_NO_THROW(m_controller->CompileScene(m_scene));
+    auto& scene = m_controller->GetCachedScene(m_scene);
+
+    Baikal::RenderStatistics stats;
+    ASSERT_NO_THROW(m_renderer->Render(scene));
+    ASSERT_TRUE(m_renderer->GetStatistics(stats));
+    ASSERT_EQ(stats.num_frames, 0u);
+    ASSERT_TRUE(stats.kernels.empty());
+
+    auto const num_iterations = kNumIterations;
+
+    m_renderer->SetProfilingEnabled(true);
+    for (auto i = 0u; i < num_iterations; ++i)
+    {
+        ASSERT_NO_THROW(m_renderer->Render(scene));
+    }
+    m_renderer->SetProfilingEnabled(false);
+
+    ASSERT_TRUE(m_renderer->GetStatistics(stats));
+    ASSERT_EQ(stats.num_frames, num_iterations);
+    ASSERT_FALSE(stats.kernels.empty());
+    ASSERT_FALSE(stats.passes.empty());
+    ASSERT_EQ(stats.passes[0].num_rays, std::uint64_t(kOutputWidth) * kOutputHeight * kNumIterations);
+
+    for (auto const& kernel : stats.kernels)
+    {
+        std::cout << kernel.name << ": " << kernel.num_launches << " launches, " << kernel.time_ms << " ms" << std::endl;
+    }
+}
@@ -629,3 +629,145 @@ TEST_F(InputMapsTest, InputMap_Normal)
 
     RunAndSave(material, "quad");
 }
+
+// Same input maps evaluated by bytecode interpreter,
+// results are compared against references of generated code tests.
+class InputMapsInterpreterTest : public InputMapsTest
+{
+protected:
+    Baikal::MaterialCompilationMode GetMaterialCompilationMode() const override
+    {
+        return Baikal::MaterialCompilationMode::kInterpreter;
+    }
+
+    void RunAndCompare(Baikal::UberV2Material::Ptr material, std::string const& reference_test_name, std::string object_name = "sphere")
+    {
+        ClearOutput();
+
+        ApplyMaterialToObject(object_name, material);
+        ApplyMaterialToObject("sphere", material);
+
+        ASSERT_NO_THROW(m_controller->CompileScene(m_scene));
+
+        auto& scene = m_controller->GetCachedScene(m_scene);
+
+        for (auto i = 0u; i < kNumIterations; ++i)
+        {
+            ASSERT_NO_THROW(m_renderer->Render(scene));
+        }
+
+        {
+            std::ostringstream oss;
+            oss << test_name() << ".png";
+            SaveOutput(oss.str());
+            ASSERT_TRUE(CompareToReference(oss.str(), reference_test_name + ".png"));
+        }
+    }
+};
+
+TEST_F(InputMapsInterpreterTest, InputMap_Interpreter_ConstFloat4)
+{
+    auto material = Baikal::UberV2Material::Create();
+    auto diffuse_color = Baikal::InputMap_ConstantFloat3::Create(float3(0.0f, 0.0f, 0.0f, 0.0f));
+    material->SetInputValue("uberv2.diffuse.color", diffuse_color);
+    material->SetLayers(Baikal::UberV2Material::Layers::kDiffuseLayer);
+
+    std::vector<float3> colors =
+    {
+        float3(1.0f, 0.0f, 0.0f),
+        float3(0.0f, 1.0f, 0.0f),
+        float3(0.0f, 0.0f, 1.0f)
+    };
+
+    for (auto& c : colors)
+    {
+        diffuse_color->SetValue(c);
+        ClearOutput();
+
+        ApplyMaterialToObject("sphere", material);
+
+        ASSERT_NO_THROW(m_controller->CompileScene(m_scene));
+
+        auto& scene = m_controller->GetCachedScene(m_scene);
+
+        for (auto i = 0u; i < kNumIterations; ++i)
+        {
+            ASSERT_NO_THROW(m_renderer->Render(scene));
+        }
+
+        {
+            std::ostringstream oss;
+            oss << "_" << c.x << "_" << c.y << "_" << c.z << ".png";
+            SaveOutput(test_name() + oss.str());
+            ASSERT_TRUE(CompareToReference(test_name() + oss.str(), "InputMap_ConstFloat4" + oss.str()));
+        }
+    }
+}
+
+TEST_F(InputMapsInterpreterTest, InputMap_Interpreter_Lerp)
+{
+    auto image_io(Baikal::ImageIo::CreateImageIo());
+    auto texture1 = image_io->LoadImage("../Resources/Textures/test_albedo1.jpg");
+    auto texture2 = image_io->LoadImage("../Resources/Textures/test_albedo3.jpg");
+
+    auto material = Baikal::UberV2Material::Create();
+    auto color1 = Baikal::InputMap_Sampler::Create(texture1);
+    auto color2 = Baikal::InputMap_ConstantFloat3::Create(float3(1.0f, 0.0f, 0.0f));
+    auto control = Baikal::InputMap_Sampler::Create(texture2);
+    auto diffuse_color = Baikal::InputMap_Lerp::Create(color1, color2, control);
+
+    material->SetInputValue("uberv2.diffuse.color", diffuse_color);
+    material->SetLayers(Baikal::UberV2Material::Layers::kDiffuseLayer);
+
+    RunAndCompare(material, "InputMap_Lerp", "quad");
+}
+
+TEST_F(InputMapsInterpreterTest, InputMap_Interpreter_Shuffle2)
+{
+    auto material = Baikal::UberV2Material::Create();
+    auto color1 = Baikal::InputMap_ConstantFloat3::Create(float3(1.0f, 0.0f, 0.0f));
+    auto color2 = Baikal::InputMap_ConstantFloat3::Create(float3(0.0f, 1.0f, 0.0f));
+    auto diffuse_color = Baikal::InputMap_Shuffle2::Create(color1, color2, {{0, 5, 1, 6}});
+
+    material->SetInputValue("uberv2.diffuse.color", diffuse_color);
+    material->SetLayers(Baikal::UberV2Material::Layers::kDiffuseLayer);
+
+    RunAndCompare(material, "InputMap_Shuffle2");
+}
+
+TEST_F(InputMapsInterpreterTest, InputMap_Interpreter_MatMul)
+{
+    auto material = Baikal::UberV2Material::Create();
+    auto color1 = Baikal::InputMap_ConstantFloat3::Create(float3(1.0f, 0.0f, 0.0f));
+    RadeonRays::matrix mat(
+        0.0f, 0.0f, 0.0f, 0.0f,
+        0.0f, 0.0f, 0.0f, 0.0f,
+        1.0f, 0.0f, 0.0f, 0.0f,
+        0.0f, 0.0f, 0.0f, 0.0f
+    );
+
+    auto diffuse_color = Baikal::InputMap_MatMul::Create(color1, mat);
+
+    material->SetInputValue("uberv2.diffuse.color", diffuse_color);
+    material->SetLayers(Baikal::UberV2Material::Layers::kDiffuseLayer);
+
+    RunAndCompare(material, "InputMap_MatMul");
+}
+
+TEST_F(InputMapsInterpreterTest, InputMap_Interpreter_Bump)
+{
+    auto image_io(Baikal::ImageIo::CreateImageIo());
+    auto bump_texture= image_io->LoadImage("../Resources/Textures/test_bump.jpg");
+
+    auto material = Baikal::UberV2Material::Create();
+    auto bump_sampler = Baikal::InputMap_SamplerBumpMap::Create(bump_texture);
+    auto remap = Baikal::InputMap_Remap::Create(
+        Baikal::InputMap_ConstantFloat3::Create(float3(0.0f, 1.0f, 0.0f)),
+        Baikal::InputMap_ConstantFloat3::Create(float3(-1.0f, 1.0f, 0.0f)),
+        bump_sampler);
+    material->SetInputValue("uberv2.shading_normal", remap);
+    material->SetLayers(Baikal::UberV2Material::Layers::kDiffuseLayer |
+        Baikal::UberV2Material::Layers::kShadingNormalLayer);
+
+    RunAndCompare(material, "InputMap_Bump", "quad");
+}
@@ -22,6 +22,9 @@ THE SOFTWARE.
 #include "gtest/gtest.h"
 
 #include "Utils/distribution1d.h"
+#include "Utils/distribution2d.h"
+#include "Utils/light_bvh.h"
+#include "Utils/thread_pool.h"
 #include "math/mathutils.h"
 
 class InternalTest : public ::testing::Test
@@ -47,3 +50,115 @@ TEST_F(InternalTest, Distribuiton1D)
 
     cnts[0] += cnts[1];
 }
+
+TEST_F(InternalTest, Distribution2D)
+{
+    std::uint32_t const kWidth = 64;
+    std::uint32_t const kHeight = 32;
+    std::uint32_t const kNumSamples = 100000;
+
+    // Dim background with a single bright cell and a black row
+    std::vector<float> vals(kWidth * kHeight, 1.f);
+    std::fill(vals.begin() + 3 * kWidth, vals.begin() + 4 * kWidth, 0.f);
+    vals[10 * kWidth + 20] = 10000.f;
+
+    Baikal::ThreadPool pool(4);
+    Baikal::Distribution2D dist(vals.data(), kWidth, kHeight, &pool);
+
+    std::uint32_t bright_cnt = 0;
+    for (auto i = 0u; i < kNumSamples; ++i)
+    {
+        float x = 0.f, y = 0.f, pdf = 0.f;
+        dist.Sample2D(RadeonRays::rand_float(), RadeonRays::rand_float(), x, y, pdf);
+
+        ASSERT_GE(x, 0.f);
+        ASSERT_LE(x, 1.f);
+        ASSERT_GE(y, 0.f);
+        ASSERT_LE(y, 1.f);
+        ASSERT_GT(pdf, 0.f);
+        ASSERT_NEAR(pdf, dist.pdf(x, y), pdf * 1e-3f);
+
+        auto row = std::min(static_cast<std::uint32_t>(y * kHeight), kHeight - 1);
+        auto column = std::min(static_cast<std::uint32_t>(x * kWidth), kWidth - 1);
+        ASSERT_NE(row, 3u);
+
+        if (row == 10 && column == 20)
+        {
+            ++bright_cnt;
+        }
+    }
+
+    // Bright cell holds ~83% of the integral
+    auto expected = 10000.f / (10000.f + kWidth * (kHeight - 1) - 1.f);
+    ASSERT_NEAR(static_cast<float>(bright_cnt) / kNumSamples, expected, 0.01f);
+
+    // PDF integrates to one
+    double integral = 0.0;
+    for (auto y = 0u; y < kHeight; ++y)
+    {
+        for (auto x = 0u; x < kWidth; ++x)
+        {
+            integral += dist.pdf((x + 0.5f) / kWidth, (y + 0.5f) / kHeight) / (kWidth * kHeight);
+        }
+    }
+    ASSERT_NEAR(integral, 1.0, 1e-3);
+}
+
+TEST_F(InternalTest, LightBvh)
+{
+    std::uint32_t const kNumEmitters = 1000;
+    std::uint32_t const kNumPoints = 32;
+
+    // Emitting triangles and omnidirectional points scattered in a box
+    std::vector<Baikal::LightBvh::Emitter> emitters(kNumEmitters);
+    for (auto i = 0u; i < kNumEmitters; ++i)
+    {
+        auto& emitter = emitters[i];
+        auto p = RadeonRays::float3(RadeonRays::rand_float(), RadeonRays::rand_float(), RadeonRays::rand_float()) * 10.f;
+        emitter.bounds = RadeonRays::bbox(p, p + RadeonRays::float3(0.1f, 0.1f, 0.f));
+        emitter.axis = RadeonRays::float3(RadeonRays::rand_float() - 0.5f, RadeonRays::rand_float() - 0.5f, RadeonRays::rand_float() - 0.5f);
+        emitter.axis.normalize();
+        emitter.cos_theta_o = (i % 4 == 0) ? -1.f : 1.f;
+        emitter.cos_theta_e = 0.f;
+        emitter.power = 0.1f + RadeonRays::rand_float();
+        emitter.light_idx = static_cast<int>(i);
+    }
+
+    Baikal::LightBvh bvh;
+    bvh.Build(emitters);
+
+    ASSERT_EQ(bvh.GetNodes().size(), 2 * kNumEmitters - 1);
+
+    for (auto i = 0u; i < kNumPoints; ++i)
+    {
+        auto p = RadeonRays::float3(RadeonRays::rand_float(), RadeonRays::rand_float(), RadeonRays::rand_float()) * 12.f - RadeonRays::float3(1.f, 1.f, 1.f);
+
+        // PDF over all lights sums to at most one, the rest is probability
+        // of reaching subtree which doesn't contribute to p
+        double sum = 0.0;
+        for (auto leaf : bvh.GetLeafIndices())
+        {
+            sum += bvh.GetPdf(leaf, p);
+        }
+        ASSERT_LE(sum, 1.0 + 1e-3);
+        ASSERT_GT(sum, 0.5);
+
+        // Sampled light has the same pdf
+        std::uint32_t const kNumSamples = 1000;
+        std::uint32_t num_sampled = 0;
+        for (auto j = 0u; j < kNumSamples; ++j)
+        {
+            float pdf = 0.f;
+            auto light_idx = bvh.Sample(p, RadeonRays::rand_float(), pdf);
+            if (light_idx == -1)
+            {
+                continue;
+            }
+
+            ASSERT_GT(pdf, 0.f);
+            ASSERT_NEAR(pdf, bvh.GetPdf(bvh.GetLeafIndices()[light_idx], p), pdf * 1e-3f);
+            ++num_sampled;
+        }
+        ASSERT_NEAR(static_cast<double>(num_sampled) / kNumSamples, sum, 0.05);
+    }
+}
@@ -599,6 +599,68 @@ TEST_F(LightTest, Light_DirectionalAndEmissiveSphere)
     }
 }
 
+TEST_F(LightTest, Light_EmissiveSphereMeshLight)
+{
+    std::uint32_t const kIterations = 8 * kNumIterations;
+
+    m_camera->LookAt(
+        RadeonRays::float3(0.f, 2.f, -10.f),
+        RadeonRays::float3(0.f, 2.f, 0.f),
+        RadeonRays::float3(0.f, 1.f, 0.f));
+
+    auto emission = Baikal::UberV2Material::Create();
+    emission->SetLayers(Baikal::UberV2Material::Layers::kEmissionLayer);
+    emission->SetInputValue("uberv2.emission.color",
+        Baikal::InputMap_ConstantFloat3::Create(float3(2.f, 2.f, 2.f)));
+
+    // Renders emissive sphere lit either by single mesh light or by area light per triangle
+    auto render = [&](bool use_mesh_light, std::vector<RadeonRays::float3>& image)
+    {
+        m_scene = Baikal::SceneIo::LoadScene("sphere+plane.test", "");
+        m_scene->SetCamera(m_camera);
+
+        auto iter = m_scene->CreateShapeIterator();
+
+        for (; iter->IsValid(); iter->Next())
+        {
+            auto mesh = iter->ItemAs<Baikal::Mesh>();
+            if (mesh->GetName() == "sphere")
+            {
+                mesh->SetMaterial(emission);
+
+                if (use_mesh_light)
+                {
+                    m_scene->AttachLight(Baikal::MeshLight::Create(mesh));
+                }
+                else
+                {
+                    for (auto i = 0u; i < mesh->GetNumIndices() / 3; ++i)
+                    {
+                        m_scene->AttachLight(Baikal::AreaLight::Create(mesh, i));
+                    }
+                }
+            }
+        }
+
+        m_controller->CompileScene(m_scene);
+        RenderNormalizedImage(m_controller->GetCachedScene(m_scene), kIterations, image);
+    };
+
+    std::vector<RadeonRays::float3> reference;
+    std::vector<RadeonRays::float3> image;
+    ASSERT_NO_THROW(render(false, reference));
+    ASSERT_NO_THROW(render(true, image));
+    ASSERT_EQ(m_scene->GetNumLights(), 1u);
+
+    std::ostringstream oss;
+    oss << test_name() << ".png";
+    SaveOutput(oss.str());
+
+    auto relative_rmse = ComputeRelativeRmse(image, reference);
+    std::cout << "Relative RMSE to area lights: " << relative_rmse << std::endl;
+    ASSERT_LT(relative_rmse, 0.2);
+}
+
 TEST_F(LightTest, Light_ImageBasedLight)
 {
     m_camera->LookAt(
@@ -1082,3 +1144,56 @@ TEST_F(LightTest, Light_IblDifferentOverrides)
     }
 
 }
+
+// Renders scene lit by environment map with a small bright sun and checks
+// that the image is close to converged one after few iterations
+TEST_F(LightTest, Light_ImageBasedLightImportanceSampling)
+{
+    std::uint32_t const kWidth = 512;
+    std::uint32_t const kHeight = 256;
+    std::uint32_t const kReferenceIterations = 1024;
+
+    m_camera->LookAt(
+        RadeonRays::float3(0.f, 2.f, -10.f),
+        RadeonRays::float3(0.f, 2.f, 0.f),
+        RadeonRays::float3(0.f, 1.f, 0.f));
+
+    LoadTestScene();
+    m_scene->SetCamera(m_camera);
+
+    // Dim sky with sun disk covering few texels
+    auto data = new char[kWidth * kHeight * sizeof(RadeonRays::float3)];
+    auto texels = reinterpret_cast<RadeonRays::float3*>(data);
+    for (auto y = 0u; y < kHeight; ++y)
+    {
+        for (auto x = 0u; x < kWidth; ++x)
+        {
+            auto dx = static_cast<float>(x) - kWidth / 8.f;
+            auto dy = static_cast<float>(y) - kHeight / 4.f;
+            auto sun = dx * dx + dy * dy < 4.f;
+            texels[y * kWidth + x] = sun ? RadeonRays::float3(5000.f, 5000.f, 4500.f, 1.f) : RadeonRays::float3(0.2f, 0.25f, 0.3f, 1.f);
+        }
+    }
+
+    auto light_texture = Baikal::Texture::Create(data, RadeonRays::int3(kWidth, kHeight, 1), Baikal::Texture::Format::kRgba32);
+    auto light = Baikal::ImageBasedLight::Create();
+    light->SetTexture(light_texture);
+    light->SetMultiplier(1.f);
+    m_scene->AttachLight(light);
+
+    ASSERT_NO_THROW(m_controller->CompileScene(m_scene));
+    auto& scene = m_controller->GetCachedScene(m_scene);
+
+    std::vector<RadeonRays::float3> reference;
+    std::vector<RadeonRays::float3> image;
+    ASSERT_NO_THROW(RenderNormalizedImage(scene, kReferenceIterations, reference));
+    ASSERT_NO_THROW(RenderNormalizedImage(scene, kNumIterations, image));
+
+    std::ostringstream oss;
+    oss << test_name() << ".png";
+    SaveOutput(oss.str());
+
+    auto relative_rmse = ComputeRelativeRmse(image, reference);
+    std::cout << "Relative RMSE after " << kNumIterations << " iterations: " << relative_rmse << std::endl;
+    ASSERT_LT(relative_rmse, 0.25);
+}
@@ -33,6 +33,12 @@ THE SOFTWARE.
 
 #include "uberv2.h"
 #include "input_maps.h"
+#include "scene_controller.h"
+#include "texture.h"
+#include "scene_cache.h"
+#include "adaptive.h"
+#include "multi_device.h"
+#include "ml_denoiser.h"
 
 int g_argc;
 char** g_argv;
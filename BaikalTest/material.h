@@ -26,6 +26,7 @@ THE SOFTWARE.
 #include "SceneGraph/shape.h"
 #include "SceneGraph/material.h"
 #include "image_io.h"
+#include "volume_io.h"
 
 #define _USE_MATH_DEFINES
 #include <math.h>
@@ -953,3 +954,171 @@ TEST_F(MaterialTest, Material_PhaseFunction)
     }
 }
 
+
+// Absorbing density grid filled with ones renders the same as homogeneous volume
+TEST_F(MaterialTest, Material_VolumeHeterogeneousConstant)
+{
+    using namespace Baikal;
+
+    m_camera->LookAt(
+        RadeonRays::float3(0.f, 2.f, -10.f),
+        RadeonRays::float3(0.f, 2.f, 0.f),
+        RadeonRays::float3(0.f, 1.f, 0.f));
+
+    auto material = UberV2Material::Create();
+    material->SetLayers(UberV2Material::Layers::kTransparencyLayer);
+
+    auto volume = VolumeMaterial::Create();
+    volume->SetInputValue("absorption", RadeonRays::float4(.5f, .5f, .5f, .0f));
+    volume->SetInputValue("scattering", RadeonRays::float4(.0f, .0f, .0f, .0f));
+    volume->SetInputValue("emission", RadeonRays::float4(.0f, .0f, .0f, .0f));
+    volume->SetInputValue("g", RadeonRays::float4(.0f, .0f, .0f, .0f));
+
+    for (auto iter = m_scene->CreateShapeIterator();
+        iter->IsValid();
+        iter->Next())
+    {
+        auto mesh = iter->ItemAs<Mesh>();
+        if (mesh->GetName() == "sphere")
+        {
+            mesh->SetMaterial(material);
+            mesh->SetVolumeMaterial(volume);
+        }
+    }
+
+    auto render = [this](std::vector<RadeonRays::float3>& image)
+    {
+        ClearOutput();
+
+        ASSERT_NO_THROW(m_controller->CompileScene(m_scene));
+        auto& scene = m_controller->GetCachedScene(m_scene);
+
+        for (auto i = 0u; i < 4 * kNumIterations; ++i)
+        {
+            ASSERT_NO_THROW(m_renderer->Render(scene));
+        }
+
+        image.resize(m_output->width() * m_output->height());
+        m_output->GetData(image.data());
+    };
+
+    std::vector<RadeonRays::float3> homogeneous;
+    render(homogeneous);
+
+    // Grid is larger than the sphere, so density is 1 everywhere inside of it
+    RadeonRays::int3 resolution(16, 16, 16);
+    std::vector<float> density(resolution.x * resolution.y * resolution.z, 1.f);
+    auto grid = VolumeGrid::Create(resolution, density.data(),
+        RadeonRays::float3(-10.f, -10.f, -10.f), RadeonRays::float3(10.f, 10.f, 10.f));
+    ASSERT_EQ(grid->GetStoredBrickCount(), 8u);
+    ASSERT_EQ(grid->GetMaxDensity(), 1.f);
+
+    volume->SetDensityGrid(grid);
+
+    std::vector<RadeonRays::float3> heterogeneous;
+    render(heterogeneous);
+
+    // Images are noisy, compare averages
+    RadeonRays::float3 homogeneous_sum;
+    RadeonRays::float3 heterogeneous_sum;
+    for (auto i = 0u; i < homogeneous.size(); ++i)
+    {
+        homogeneous_sum += homogeneous[i] * (1.f / homogeneous[i].w);
+        heterogeneous_sum += heterogeneous[i] * (1.f / heterogeneous[i].w);
+    }
+
+    for (auto c = 0; c < 3; ++c)
+    {
+        ASSERT_NEAR(heterogeneous_sum[c], homogeneous_sum[c], 0.05f * homogeneous_sum[c]);
+    }
+}
+
+TEST_F(MaterialTest, Material_VolumeHeterogeneous)
+{
+    using namespace Baikal;
+
+    m_camera->LookAt(
+        RadeonRays::float3(0.f, 2.f, -10.f),
+        RadeonRays::float3(0.f, 2.f, 0.f),
+        RadeonRays::float3(0.f, 1.f, 0.f));
+
+    // Smoke-like puffs inside of mostly empty grid
+    RadeonRays::int3 resolution(64, 64, 64);
+    std::vector<float> density(resolution.x * resolution.y * resolution.z, 0.f);
+    RadeonRays::float3 const puffs[] =
+    {
+        RadeonRays::float3(0.3f, 0.3f, 0.5f, 0.15f),
+        RadeonRays::float3(0.6f, 0.5f, 0.4f, 0.2f),
+        RadeonRays::float3(0.45f, 0.75f, 0.6f, 0.1f)
+    };
+
+    for (auto z = 0; z < resolution.z; ++z)
+    {
+        for (auto y = 0; y < resolution.y; ++y)
+        {
+            for (auto x = 0; x < resolution.x; ++x)
+            {
+                RadeonRays::float3 p((x + .5f) / resolution.x, (y + .5f) / resolution.y, (z + .5f) / resolution.z);
+
+                float value = 0.f;
+                for (auto const& puff : puffs)
+                {
+                    auto d = RadeonRays::float3(p.x - puff.x, p.y - puff.y, p.z - puff.z).sqnorm();
+                    value += std::max(0.f, 1.f - d / (puff.w * puff.w));
+                }
+
+                density[(z * resolution.y + y) * resolution.x + x] = 4.f * value;
+            }
+        }
+    }
+
+    auto grid = VolumeGrid::Create(resolution, density.data(),
+        RadeonRays::float3(-2.f, 0.f, -2.f), RadeonRays::float3(2.f, 4.f, 2.f));
+    ASSERT_LT(grid->GetStoredBrickCount(), grid->GetBrickTable().size());
+
+    // Grid survives save and load
+    auto volume_io = VolumeIo::CreateVolumeIo();
+    auto file_name = m_output_path + test_name() + ".bvol";
+    ASSERT_NO_THROW(volume_io->SaveVolume(file_name, *grid));
+
+    VolumeGrid::Ptr loaded;
+    ASSERT_NO_THROW(loaded = volume_io->LoadVolume(file_name));
+    ASSERT_EQ(loaded->GetBrickTable(), grid->GetBrickTable());
+    ASSERT_EQ(loaded->GetBricks(), grid->GetBricks());
+    ASSERT_EQ(loaded->GetMajorants(), grid->GetMajorants());
+
+    auto material = UberV2Material::Create();
+    material->SetLayers(UberV2Material::Layers::kTransparencyLayer);
+
+    auto volume = VolumeMaterial::Create();
+    volume->SetInputValue("absorption", RadeonRays::float4(.2f, .2f, .2f, .0f));
+    volume->SetInputValue("scattering", RadeonRays::float4(.8f, .8f, .8f, .0f));
+    volume->SetInputValue("emission", RadeonRays::float4(.0f, .0f, .0f, .0f));
+    volume->SetInputValue("g", RadeonRays::float4(.0f, .0f, .0f, .0f));
+    volume->SetDensityGrid(loaded);
+
+    for (auto iter = m_scene->CreateShapeIterator();
+        iter->IsValid();
+        iter->Next())
+    {
+        auto mesh = iter->ItemAs<Mesh>();
+        if (mesh->GetName() == "sphere")
+        {
+            mesh->SetMaterial(material);
+            mesh->SetVolumeMaterial(volume);
+        }
+    }
+
+    ClearOutput();
+
+    ASSERT_NO_THROW(m_controller->CompileScene(m_scene));
+    auto& scene = m_controller->GetCachedScene(m_scene);
+
+    for (auto i = 0u; i < kNumIterations; ++i)
+    {
+        ASSERT_NO_THROW(m_renderer->Render(scene));
+    }
+
+    SaveOutput(test_name() + ".png");
+    ASSERT_TRUE(CompareToReference(test_name() + ".png"));
+}
@@ -0,0 +1,203 @@
+/**********************************************************************
+ Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ********************************************************************/
+#pragma once
+
+#include "basic.h"
+#include "PostEffects/ML/inference_impl.h"
+#include "PostEffects/post_effect.h"
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <thread>
+
+// Tests run with CPU stand-in model from Tools/ModelRunnerStub and are
+// skipped if model runner library can not be loaded
+class MLDenoiserTest : public BasicTest
+{
+public:
+    static std::uint32_t constexpr kNumFrames = 32;
+
+    using Inference = Baikal::PostEffects::InferenceImpl;
+    using Tensor = Baikal::PostEffects::Tensor;
+
+    std::unique_ptr<Inference> CreateInference(std::size_t width,
+                                               std::size_t height,
+                                               std::size_t channels,
+                                               std::size_t tile_size,
+                                               std::size_t tile_overlap)
+    {
+        try
+        {
+            return std::make_unique<Inference>("", 0.f, "", width, height, channels, tile_size, tile_overlap);
+        }
+        catch (std::runtime_error& e)
+        {
+            std::cout << "Model runner is not available: " << e.what() << std::endl;
+            return nullptr;
+        }
+    }
+
+    // Infer single tensor and wait for the result
+    static std::vector<float> Infer(Inference& inference, std::vector<float> const& input)
+    {
+        auto tensor = inference.GetInputTensor();
+        std::copy(input.cbegin(), input.cend(), tensor.data());
+        inference.PushInput(std::move(tensor));
+
+        for (;;)
+        {
+            auto output = inference.PopOutput();
+            if (!output.empty())
+            {
+                return std::vector<float>(output.data(), output.data() + output.size());
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+};
+
+// Tiles blended with enough overlap give the same image as whole frame inference
+TEST_F(MLDenoiserTest, MLDenoiser_TiledInference)
+{
+    std::size_t const width = 200;
+    std::size_t const height = 150;
+    std::size_t const channels = 9;
+
+    auto whole = CreateInference(width, height, channels, 0, 0);
+    if (!whole)
+    {
+        return;
+    }
+    // Partial tiles on the right and bottom
+    auto tiled = CreateInference(width, height, channels, 64, 8);
+
+    std::mt19937 rng(0);
+    std::uniform_real_distribution<float> dist(0.f, 1.f);
+    std::vector<float> input(width * height * channels);
+    std::generate(input.begin(), input.end(), [&]() { return dist(rng); });
+
+    auto expected = Infer(*whole, input);
+    auto actual = Infer(*tiled, input);
+
+    ASSERT_EQ(expected.size(), actual.size());
+    for (std::size_t i = 0; i < expected.size(); ++i)
+    {
+        ASSERT_NEAR(expected[i], actual[i], 1e-5f) << "at pixel " << i / 3;
+    }
+}
+
+// Input tensors come from a fixed pool and return there once released
+TEST_F(MLDenoiserTest, MLDenoiser_TensorPool)
+{
+    auto inference = CreateInference(64, 64, 9, 0, 0);
+    if (!inference)
+    {
+        return;
+    }
+
+    std::vector<Tensor> tensors;
+    for (std::size_t i = 0; i < Inference::kNumInputTensors; ++i)
+    {
+        tensors.push_back(inference->GetInputTensor());
+        ASSERT_FALSE(tensors.back().empty());
+    }
+
+    ASSERT_TRUE(inference->GetInputTensor().empty());
+
+    auto data = tensors.back().data();
+    tensors.pop_back();
+
+    auto tensor = inference->GetInputTensor();
+    ASSERT_EQ(tensor.data(), data);
+}
+
+// Denoiser pipeline throughput with whole frame and tiled inference
+TEST_F(MLDenoiserTest, MLDenoiser_Throughput)
+{
+    if (!CreateInference(kOutputWidth, kOutputHeight, 9, 0, 0))
+    {
+        return;
+    }
+
+    using OutputType = Baikal::Renderer::OutputType;
+
+    std::vector<std::unique_ptr<Baikal::Output>> outputs;
+    Baikal::PostEffect::InputSet input_set;
+    input_set[OutputType::kColor] = m_output.get();
+
+    for (auto type : { OutputType::kAlbedo, OutputType::kDepth, OutputType::kViewShadingNormal })
+    {
+        outputs.push_back(m_factory->CreateOutput(kOutputWidth, kOutputHeight));
+        ASSERT_NO_THROW(m_renderer->SetOutput(type, outputs.back().get()));
+        input_set[type] = outputs.back().get();
+    }
+
+    auto denoised_output = m_factory->CreateOutput(kOutputWidth, kOutputHeight);
+
+    ASSERT_NO_THROW(m_controller->CompileScene(m_scene));
+    auto& scene = m_controller->GetCachedScene(m_scene);
+
+    for (auto tile_size : { 0u, 128u })
+    {
+        auto denoiser = m_factory->CreatePostEffect(Baikal::PostEffectType::kMLDenoiser);
+        denoiser->SetParameter("start_spp", 1u);
+        denoiser->SetParameter("tile_size", tile_size);
+        denoiser->SetParameter("tile_overlap", 16u);
+
+        ClearOutput();
+        for (auto& output : outputs)
+        {
+            ClearOutput(output.get());
+        }
+
+        auto start = std::chrono::high_resolution_clock::now();
+
+        for (auto i = 0u; i < kNumFrames; ++i)
+        {
+            ASSERT_NO_THROW(m_renderer->Render(scene));
+            ASSERT_NO_THROW(denoiser->Apply(input_set, *denoised_output));
+        }
+
+        auto elapsed = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+        std::cout << "Tile size " << tile_size << ": " << kNumFrames / elapsed << " frames/s" << std::endl;
+
+        // Denoised image has alpha of 1 while accumulated color holds sample count
+        std::vector<RadeonRays::float3> image(kOutputWidth * kOutputHeight);
+        for (auto i = 0u; i < kNumFrames; ++i)
+        {
+            ASSERT_NO_THROW(denoiser->Apply(input_set, *denoised_output));
+            denoised_output->GetData(&image[0]);
+            if (image[0].w == 1.f)
+            {
+                break;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+
+        for (auto const& v : image)
+        {
+            ASSERT_EQ(v.w, 1.f);
+        }
+    }
+}
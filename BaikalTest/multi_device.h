@@ -0,0 +1,129 @@
+/**********************************************************************
+ Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ********************************************************************/
+#pragma once
+
+#include "basic.h"
+#include "Renderers/multi_device_renderer.h"
+
+#include <numeric>
+
+class MultiDeviceTest : public BasicTest
+{
+public:
+    static std::uint32_t constexpr kNumFrames = 4;
+    static std::uint32_t constexpr kSamplesPerTile = 2;
+
+    // Contexts on the device used by the test, several contexts
+    // on one device behave as separate devices for the renderer
+    std::vector<CLWContext> CreateContexts(std::size_t num_contexts)
+    {
+        std::vector<CLWPlatform> platforms;
+        CLWPlatform::CreateAllPlatforms(platforms);
+
+        auto device = platforms[0].GetDevice(0);
+
+        for (auto& platform : platforms)
+        {
+            for (auto i = 0u; i < platform.GetDeviceCount(); ++i)
+            {
+                if (platform.GetDevice(i).GetType() == CL_DEVICE_TYPE_GPU)
+                {
+                    device = platform.GetDevice(i);
+                    break;
+                }
+            }
+        }
+
+        std::vector<CLWContext> contexts;
+        for (std::size_t i = 0; i < num_contexts; ++i)
+        {
+            contexts.push_back(CLWContext::Create(device));
+        }
+
+        return contexts;
+    }
+
+    // Render frames and return accumulated image
+    std::vector<RadeonRays::float3> RenderFrames(std::size_t num_contexts, RadeonRays::int2 const& tile_size)
+    {
+        Baikal::MultiDeviceRenderer renderer(CreateContexts(num_contexts));
+        auto output = renderer.CreateOutput(kOutputWidth, kOutputHeight);
+
+        renderer.SetOutput(output.get());
+        renderer.SetTileSize(tile_size);
+        renderer.SetSamplesPerTile(kSamplesPerTile);
+        renderer.SetRandomSeed(0);
+        renderer.CompileScene(m_scene);
+        renderer.Clear(RadeonRays::float3());
+
+        auto num_tiles = ((kOutputWidth + tile_size.x - 1) / tile_size.x) * ((kOutputHeight + tile_size.y - 1) / tile_size.y);
+
+        for (auto i = 0u; i < kNumFrames; ++i)
+        {
+            auto stats = renderer.Render();
+
+            EXPECT_EQ(stats.num_tiles.size(), num_contexts);
+            EXPECT_EQ(std::accumulate(stats.num_tiles.cbegin(), stats.num_tiles.cend(), 0u), num_tiles);
+        }
+
+        std::vector<RadeonRays::float3> image(kOutputWidth * kOutputHeight);
+        output->GetData(&image[0]);
+        return image;
+    }
+
+    static float AverageLuminance(std::vector<RadeonRays::float3> const& image)
+    {
+        double sum = 0.0;
+        for (auto const& v : image)
+        {
+            sum += (0.2126f * v.x + 0.7152f * v.y + 0.0722f * v.z) / v.w;
+        }
+        return static_cast<float>(sum / image.size());
+    }
+};
+
+// Every pixel gets exactly the same number of samples, whichever device renders its tile
+TEST_F(MultiDeviceTest, MultiDevice_TileCoverage)
+{
+    // Tile size not dividing output size to cover partial tiles
+    auto image = RenderFrames(3, RadeonRays::int2(96, 80));
+
+    for (auto const& v : image)
+    {
+        ASSERT_EQ(v.w, static_cast<float>(kNumFrames * kSamplesPerTile));
+    }
+}
+
+// Splitting work between devices doesn't change the result beyond noise
+TEST_F(MultiDeviceTest, MultiDevice_MatchesSingleDevice)
+{
+    auto single = RenderFrames(1, RadeonRays::int2(64, 64));
+    auto multi = RenderFrames(2, RadeonRays::int2(64, 64));
+
+    auto single_luminance = AverageLuminance(single);
+    auto multi_luminance = AverageLuminance(multi);
+
+    std::cout << "Average luminance: single device " << single_luminance
+        << ", two devices " << multi_luminance << std::endl;
+
+    ASSERT_NEAR(single_luminance, multi_luminance, 0.02f * single_luminance);
+}
@@ -0,0 +1,162 @@
+/**********************************************************************
+Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#pragma once
+
+#include "basic.h"
+#include "SceneGraph/iterator.h"
+#include "SceneGraph/shape.h"
+
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+class SceneCacheTest : public BasicTest
+{
+protected:
+    static std::vector<char> ReadFile(std::string const& file_name)
+    {
+        std::ifstream in(file_name, std::ios::binary);
+        return std::vector<char>(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+
+    static std::vector<Baikal::Mesh::Ptr> GetMeshes(Baikal::Scene1 const& scene)
+    {
+        std::vector<Baikal::Mesh::Ptr> meshes;
+
+        auto shape_iter = scene.CreateShapeIterator();
+        for (; shape_iter->IsValid(); shape_iter->Next())
+        {
+            auto mesh = std::dynamic_pointer_cast<Baikal::Mesh>(shape_iter->ItemAs<Baikal::Shape>());
+            if (mesh)
+            {
+                meshes.push_back(mesh);
+            }
+        }
+
+        return meshes;
+    }
+
+    static void CompareMeshes(Baikal::Mesh const& mesh, Baikal::Mesh const& reference)
+    {
+        ASSERT_EQ(mesh.GetName(), reference.GetName());
+        ASSERT_EQ(mesh.GetNumIndices(), reference.GetNumIndices());
+        ASSERT_EQ(mesh.GetNumVertices(), reference.GetNumVertices());
+        ASSERT_EQ(mesh.GetNumNormals(), reference.GetNumNormals());
+        ASSERT_EQ(mesh.GetNumUVs(), reference.GetNumUVs());
+
+        ASSERT_EQ(std::memcmp(mesh.GetIndices(), reference.GetIndices(), mesh.GetNumIndices() * sizeof(std::uint32_t)), 0);
+        ASSERT_EQ(std::memcmp(mesh.GetVertices(), reference.GetVertices(), mesh.GetNumVertices() * sizeof(RadeonRays::float3)), 0);
+        ASSERT_EQ(std::memcmp(mesh.GetNormals(), reference.GetNormals(), mesh.GetNumNormals() * sizeof(RadeonRays::float3)), 0);
+        ASSERT_EQ(std::memcmp(mesh.GetUVs(), reference.GetUVs(), mesh.GetNumUVs() * sizeof(RadeonRays::float2)), 0);
+
+        auto transform = mesh.GetTransform();
+        auto reference_transform = reference.GetTransform();
+        ASSERT_EQ(std::memcmp(&transform.m[0][0], &reference_transform.m[0][0], sizeof(float) * 16), 0);
+
+        ASSERT_EQ(!mesh.GetMaterial(), !reference.GetMaterial());
+    }
+};
+
+// Saves test scene into binary cache and loads it back. Geometry has to match bit by bit
+// and saving reloaded scene has to produce identical file, which covers materials,
+// input maps, texture references and lights.
+TEST_F(SceneCacheTest, SceneCache_BinaryRoundTrip)
+{
+    auto reference = Baikal::SceneIo::LoadScene("uberv2_test_spheres.test", "");
+
+    auto file_name = m_output_path + test_name() + ".bin";
+    ASSERT_NO_THROW(Baikal::SceneIo::SaveScene(*reference, file_name, m_output_path));
+
+    Baikal::Scene1::Ptr scene;
+    ASSERT_NO_THROW(scene = Baikal::SceneIo::LoadScene(file_name, m_output_path));
+
+    ASSERT_EQ(scene->GetNumShapes(), reference->GetNumShapes());
+    ASSERT_EQ(scene->GetNumLights(), reference->GetNumLights());
+
+    auto meshes = GetMeshes(*scene);
+    auto reference_meshes = GetMeshes(*reference);
+    ASSERT_EQ(meshes.size(), reference_meshes.size());
+
+    for (auto i = 0u; i < meshes.size(); ++i)
+    {
+        CompareMeshes(*meshes[i], *reference_meshes[i]);
+    }
+
+    auto resaved_file_name = m_output_path + test_name() + "_resaved.bin";
+    ASSERT_NO_THROW(Baikal::SceneIo::SaveScene(*scene, resaved_file_name, m_output_path));
+    ASSERT_EQ(ReadFile(file_name), ReadFile(resaved_file_name));
+}
+
+// Files which are not binary scene caches are rejected
+TEST_F(SceneCacheTest, SceneCache_BinaryRejectsInvalidFile)
+{
+    auto file_name = m_output_path + test_name() + ".bin";
+    {
+        std::ofstream out(file_name, std::ios::binary);
+        std::vector<char> garbage(256, 'x');
+        out.write(garbage.data(), garbage.size());
+    }
+
+    ASSERT_THROW(Baikal::SceneIo::LoadScene(file_name, m_output_path), std::runtime_error);
+}
+
+// Compares loading time of OBJ scene and its binary cache
+TEST_F(SceneCacheTest, SceneCache_BinaryCacheBenchmark)
+{
+    std::string const base_path = "../Resources/TestData/Sponza/";
+
+    Baikal::Scene1::Ptr reference;
+    auto start = std::chrono::high_resolution_clock::now();
+    try
+    {
+        reference = Baikal::SceneIo::LoadScene(base_path + "sponza.obj", base_path);
+    }
+    catch (std::exception&)
+    {
+        std::cout << "There's no Sponza test set" << std::endl;
+        return;
+    }
+    auto obj_time = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+    auto file_name = m_output_path + test_name() + ".bin";
+    ASSERT_NO_THROW(Baikal::SceneIo::SaveScene(*reference, file_name, base_path));
+
+    Baikal::Scene1::Ptr scene;
+    start = std::chrono::high_resolution_clock::now();
+    ASSERT_NO_THROW(scene = Baikal::SceneIo::LoadScene(file_name, base_path));
+    auto binary_time = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+    std::cout << "OBJ: " << obj_time << " s, binary cache: " << binary_time << " s, speedup: "
+        << (binary_time > 0.0 ? obj_time / binary_time : 0.0) << "x" << std::endl;
+
+    auto meshes = GetMeshes(*scene);
+    auto reference_meshes = GetMeshes(*reference);
+    ASSERT_EQ(meshes.size(), reference_meshes.size());
+
+    for (auto i = 0u; i < meshes.size(); ++i)
+    {
+        CompareMeshes(*meshes[i], *reference_meshes[i]);
+    }
+
+    ASSERT_LT(binary_time, obj_time);
+}
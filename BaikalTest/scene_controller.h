@@ -0,0 +1,394 @@
+/**********************************************************************
+Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#pragma once
+
+#include "basic.h"
+
+class SceneControllerTest : public BasicTest
+{
+public:
+    void LoadTestScene() override
+    {
+        m_scene = Baikal::SceneIo::LoadScene("sphere+plane+ibl.test", "");
+    }
+
+    Baikal::Mesh::Ptr FindMesh(std::string const& name) const
+    {
+        for (auto iter = m_scene->CreateShapeIterator(); iter->IsValid(); iter->Next())
+        {
+            auto mesh = std::dynamic_pointer_cast<Baikal::Mesh>(iter->ItemAs<Baikal::Shape>());
+            if (mesh && mesh->GetName() == name)
+            {
+                return mesh;
+            }
+        }
+
+        return nullptr;
+    }
+
+    // Bytes uploaded by the scene controller while profiling is enabled
+    std::uint64_t GetNumBytesUploaded() const
+    {
+        Baikal::RenderStatistics stats;
+        m_renderer->GetStatistics(stats);
+        return stats.bytes_uploaded;
+    }
+
+    // Size of mesh geometry in ClwScene layout
+    static std::size_t GetGeometrySize(Baikal::Mesh const& mesh)
+    {
+#ifdef BAIKAL_COMPACT_GEOMETRY
+        // Meshes with 65536 vertices or more keep 32-bit indices
+        auto index_size = mesh.GetNumVertices() <= 0x10000 ? sizeof(Baikal::ClwGeometryIndex) : sizeof(std::uint32_t);
+#else
+        auto index_size = sizeof(Baikal::ClwGeometryIndex);
+#endif
+        return mesh.GetNumVertices() * sizeof(Baikal::ClwGeometryPosition) +
+               mesh.GetNumNormals() * sizeof(Baikal::ClwGeometryNormal) +
+               mesh.GetNumUVs() * sizeof(Baikal::ClwGeometryUV) +
+               mesh.GetNumIndices() * index_size;
+    }
+};
+
+TEST_F(SceneControllerTest, SceneController_PartialGeometryUpload)
+{
+    ASSERT_NO_THROW(m_controller->CompileScene(m_scene));
+
+    auto quad = FindMesh("quad");
+    auto sphere = FindMesh("sphere");
+    ASSERT_TRUE(quad != nullptr);
+    ASSERT_TRUE(sphere != nullptr);
+
+    {
+        auto& scene = m_controller->GetCachedScene(m_scene);
+        ASSERT_EQ(scene.geometry_bytes_uploaded, GetGeometrySize(*quad) + GetGeometrySize(*sphere));
+    }
+
+    // Lift the quad a bit, the sphere should stay in place
+    std::vector<RadeonRays::float3> vertices(quad->GetVertices(), quad->GetVertices() + quad->GetNumVertices());
+    for (auto& v : vertices)
+    {
+        v.y -= 0.5f;
+    }
+    quad->SetVertices(&vertices[0], vertices.size());
+
+    ASSERT_NO_THROW(m_controller->CompileScene(m_scene));
+
+    {
+        auto& scene = m_controller->GetCachedScene(m_scene);
+        ASSERT_EQ(scene.geometry_bytes_uploaded, GetGeometrySize(*quad));
+    }
+
+    // Transform change should not upload any geometry
+    sphere->SetTransform(RadeonRays::translation(RadeonRays::float3(0.f, 0.1f, 0.f)));
+
+    ASSERT_NO_THROW(m_controller->CompileScene(m_scene));
+
+    auto& scene = m_controller->GetCachedScene(m_scene);
+    ASSERT_EQ(scene.geometry_bytes_uploaded, 0u);
+
+    ClearOutput();
+
+    for (auto i = 0u; i < kNumIterations; ++i)
+    {
+        ASSERT_NO_THROW(m_renderer->Render(scene));
+    }
+
+    SaveOutput(test_name() + ".png");
+    ASSERT_TRUE(CompareToReference(test_name() + ".png"));
+}
+
+TEST_F(SceneControllerTest, SceneController_AddMeshUpload)
+{
+    ASSERT_NO_THROW(m_controller->CompileScene(m_scene));
+
+    auto sphere = FindMesh("sphere");
+    ASSERT_TRUE(sphere != nullptr);
+
+    // Attach a copy of the sphere, only the new mesh should be uploaded
+    auto mesh = Baikal::Mesh::Create();
+    mesh->SetVertices(sphere->GetVertices(), sphere->GetNumVertices());
+    mesh->SetNormals(sphere->GetNormals(), sphere->GetNumNormals());
+    mesh->SetUVs(sphere->GetUVs(), sphere->GetNumUVs());
+    mesh->SetIndices(sphere->GetIndices(), sphere->GetNumIndices());
+    mesh->SetTransform(RadeonRays::translation(RadeonRays::float3(3.f, 0.f, 0.f)));
+    mesh->SetMaterial(sphere->GetMaterial());
+    m_scene->AttachShape(mesh);
+
+    ASSERT_NO_THROW(m_controller->CompileScene(m_scene));
+
+    auto& scene = m_controller->GetCachedScene(m_scene);
+    ASSERT_EQ(scene.geometry_bytes_uploaded, GetGeometrySize(*mesh));
+
+    ClearOutput();
+
+    for (auto i = 0u; i < kNumIterations; ++i)
+    {
+        ASSERT_NO_THROW(m_renderer->Render(scene));
+    }
+
+    SaveOutput(test_name() + ".png");
+    ASSERT_TRUE(CompareToReference(test_name() + ".png"));
+}
+
+// Checks that shapes keep their indices until the shape list changes
+// and base shapes of instances are registered even if they are not in the scene
+TEST_F(SceneControllerTest, SceneController_ShapeRegistry)
+{
+    auto sphere = FindMesh("sphere");
+    ASSERT_TRUE(sphere != nullptr);
+
+    auto instance = Baikal::Instance::Create(sphere);
+    instance->SetMaterial(sphere->GetMaterial());
+    instance->SetTransform(RadeonRays::translation(RadeonRays::float3(3.f, 0.f, 0.f)));
+    m_scene->AttachShape(instance);
+
+    ASSERT_NO_THROW(m_controller->CompileScene(m_scene));
+
+    auto check_registry = [this](Baikal::ClwShapeRegistry const& registry)
+    {
+        std::set<int> indices;
+        for (auto iter = m_scene->CreateShapeIterator(); iter->IsValid(); iter->Next())
+        {
+            auto idx = registry.GetIndex(*iter->ItemAs<Baikal::Shape>());
+            ASSERT_GE(idx, 0);
+            ASSERT_LT(idx, static_cast<int>(registry.GetNumShapes()));
+            ASSERT_TRUE(indices.insert(idx).second);
+        }
+    };
+
+    {
+        auto& scene = m_controller->GetCachedScene(m_scene);
+        check_registry(scene.shape_registry);
+        ASSERT_EQ(scene.shape_registry.num_excluded_meshes, 0u);
+    }
+
+    auto generation = m_controller->GetCachedScene(m_scene).shape_registry.generation;
+    auto instance_idx = m_controller->GetCachedScene(m_scene).shape_registry.GetIndex(*instance);
+
+    // Transform change keeps the registry
+    instance->SetTransform(RadeonRays::translation(RadeonRays::float3(2.f, 0.f, 0.f)));
+    ASSERT_NO_THROW(m_controller->CompileScene(m_scene));
+    ASSERT_EQ(m_controller->GetCachedScene(m_scene).shape_registry.generation, generation);
+    ASSERT_EQ(m_controller->GetCachedScene(m_scene).shape_registry.GetIndex(*instance), instance_idx);
+
+    // New base shape is not in the scene, it is registered as excluded mesh
+    auto mesh = Baikal::Mesh::Create();
+    mesh->SetVertices(sphere->GetVertices(), sphere->GetNumVertices());
+    mesh->SetNormals(sphere->GetNormals(), sphere->GetNumNormals());
+    mesh->SetUVs(sphere->GetUVs(), sphere->GetNumUVs());
+    mesh->SetIndices(sphere->GetIndices(), sphere->GetNumIndices());
+    instance->SetBaseShape(mesh);
+
+    ASSERT_NO_THROW(m_controller->CompileScene(m_scene));
+
+    auto& scene = m_controller->GetCachedScene(m_scene);
+    check_registry(scene.shape_registry);
+    ASSERT_NE(scene.shape_registry.generation, generation);
+    ASSERT_EQ(scene.shape_registry.num_excluded_meshes, 1u);
+    ASSERT_GE(scene.shape_registry.GetIndex(*mesh), 0);
+    ASSERT_GE(scene.shapes.GetElementCount(), scene.shape_registry.GetNumShapes());
+}
+
+// Checks that a texture edited after the first compile gets uploaded
+TEST_F(SceneControllerTest, SceneController_TextureEdit)
+{
+    Baikal::Texture::Ptr texture;
+    for (auto iter = m_scene->CreateLightIterator(); iter->IsValid(); iter->Next())
+    {
+        auto ibl = std::dynamic_pointer_cast<Baikal::ImageBasedLight>(iter->ItemAs<Baikal::Light>());
+        if (ibl)
+        {
+            texture = ibl->GetTexture();
+        }
+    }
+    ASSERT_TRUE(texture != nullptr);
+    ASSERT_TRUE(texture->GetData() != nullptr);
+
+    ASSERT_NO_THROW(m_controller->CompileScene(m_scene));
+
+    m_renderer->SetProfilingEnabled(true);
+
+    for (auto i = 0u; i < 2u; ++i)
+    {
+        auto num_bytes = texture->GetSizeInBytes();
+        auto data = new char[num_bytes];
+        std::transform(texture->GetData(), texture->GetData() + num_bytes, data, [](char c) { return static_cast<char>(~c); });
+        texture->SetData(data, texture->GetSize(), texture->GetFormat());
+
+        auto num_bytes_uploaded = GetNumBytesUploaded();
+        ASSERT_NO_THROW(m_controller->CompileScene(m_scene));
+        ASSERT_GE(GetNumBytesUploaded() - num_bytes_uploaded, num_bytes);
+    }
+
+    m_renderer->SetProfilingEnabled(false);
+}
+
+// Checks that a shape compiled along with other scene changes keeps reporting its edits
+TEST_F(SceneControllerTest, SceneController_ShapeEdit)
+{
+    auto sphere = FindMesh("sphere");
+    ASSERT_TRUE(sphere != nullptr);
+
+    ASSERT_NO_THROW(m_controller->CompileScene(m_scene));
+
+    // Attached light forces full update, the sphere goes through shape properties update
+    auto light = Baikal::PointLight::Create();
+    light->SetPosition(RadeonRays::float3(0.f, 5.f, 0.f));
+    light->SetEmittedRadiance(RadeonRays::float3(1.f, 1.f, 1.f));
+    m_scene->AttachLight(light);
+    sphere->SetTransform(RadeonRays::translation(RadeonRays::float3(0.f, 0.1f, 0.f)));
+
+    ASSERT_NO_THROW(m_controller->CompileScene(m_scene));
+
+    m_renderer->SetProfilingEnabled(true);
+
+    sphere->SetTransform(RadeonRays::translation(RadeonRays::float3(0.f, 0.2f, 0.f)));
+
+    auto num_bytes_uploaded = GetNumBytesUploaded();
+    ASSERT_NO_THROW(m_controller->CompileScene(m_scene));
+
+    m_renderer->SetProfilingEnabled(false);
+
+    auto& scene = m_controller->GetCachedScene(m_scene);
+    ASSERT_GT(GetNumBytesUploaded(), num_bytes_uploaded);
+    ASSERT_EQ(scene.geometry_bytes_uploaded, 0u);
+}
+
+// Measures CompileScene latency versus scene size, when nothing has changed
+// since the last compile and when a single shape has been moved.
+TEST_F(SceneControllerTest, SceneController_CompileLatencyBenchmark)
+{
+    auto sphere = FindMesh("sphere");
+    ASSERT_TRUE(sphere != nullptr);
+
+    auto const num_unchanged_compiles = 100u;
+    auto const num_changed_compiles = 10u;
+
+    for (auto num_instances : { 1000u, 10000u, 100000u })
+    {
+        auto scene = Baikal::Scene1::Create();
+        scene->SetCamera(m_camera);
+
+        for (auto light_iter = m_scene->CreateLightIterator(); light_iter->IsValid(); light_iter->Next())
+        {
+            scene->AttachLight(light_iter->ItemAs<Baikal::Light>());
+        }
+
+        std::vector<Baikal::Instance::Ptr> instances;
+        instances.reserve(num_instances);
+
+        for (auto i = 0u; i < num_instances; ++i)
+        {
+            auto instance = Baikal::Instance::Create(sphere);
+            instance->SetMaterial(sphere->GetMaterial());
+            instance->SetTransform(RadeonRays::translation(
+                RadeonRays::float3(static_cast<float>(i % 100), 0.f, static_cast<float>(i / 100))));
+            scene->AttachShape(instance);
+            instances.push_back(instance);
+        }
+
+        ASSERT_NO_THROW(m_controller->CompileScene(scene));
+
+        m_renderer->SetProfilingEnabled(true);
+
+        auto num_bytes_uploaded = GetNumBytesUploaded();
+        auto start = std::chrono::high_resolution_clock::now();
+        for (auto i = 0u; i < num_unchanged_compiles; ++i)
+        {
+            m_controller->CompileScene(scene);
+        }
+        auto unchanged_time = std::chrono::duration<double>(
+            std::chrono::high_resolution_clock::now() - start).count() / num_unchanged_compiles;
+
+        // Unchanged scene should not be uploaded at all
+        ASSERT_EQ(GetNumBytesUploaded(), num_bytes_uploaded);
+
+        start = std::chrono::high_resolution_clock::now();
+        for (auto i = 0u; i < num_changed_compiles; ++i)
+        {
+            auto& instance = instances[(i * 7919u) % num_instances];
+            instance->SetTransform(instance->GetTransform() * RadeonRays::translation(RadeonRays::float3(0.f, 0.1f, 0.f)));
+            m_controller->CompileScene(scene);
+
+            // Moving a shape doesn't touch geometry
+            ASSERT_EQ(m_controller->GetCachedScene(scene).geometry_bytes_uploaded, 0u);
+        }
+        auto changed_time = std::chrono::duration<double>(
+            std::chrono::high_resolution_clock::now() - start).count() / num_changed_compiles;
+
+        m_renderer->SetProfilingEnabled(false);
+        ASSERT_GT(GetNumBytesUploaded(), num_bytes_uploaded);
+
+        std::cout << num_instances << " shapes: unchanged " << unchanged_time * 1e3 << " ms, single change "
+            << changed_time * 1e3 << " ms" << std::endl;
+    }
+}
+
+// Reports geometry footprint and rendering speed for current geometry layout
+// (see BAIKAL_COMPACT_GEOMETRY)
+TEST_F(SceneControllerTest, SceneController_GeometryFootprint)
+{
+    ASSERT_NO_THROW(m_controller->CompileScene(m_scene));
+
+    std::size_t num_triangles = 0;
+    std::size_t uncompressed_size = 0;
+    for (auto iter = m_scene->CreateShapeIterator(); iter->IsValid(); iter->Next())
+    {
+        auto mesh = std::dynamic_pointer_cast<Baikal::Mesh>(iter->ItemAs<Baikal::Shape>());
+        if (mesh)
+        {
+            num_triangles += mesh->GetNumIndices() / 3;
+            uncompressed_size += mesh->GetNumVertices() * (2 * sizeof(RadeonRays::float3) + sizeof(RadeonRays::float2)) +
+                                 mesh->GetNumIndices() * sizeof(int);
+        }
+    }
+    ASSERT_GT(num_triangles, 0u);
+
+    auto& scene = m_controller->GetCachedScene(m_scene);
+    auto geometry_size = scene.num_vertices_allocated *
+        (sizeof(Baikal::ClwGeometryPosition) + sizeof(Baikal::ClwGeometryNormal) + sizeof(Baikal::ClwGeometryUV)) +
+        scene.num_indices_allocated * sizeof(Baikal::ClwGeometryIndex);
+
+    ClearOutput();
+
+    auto start = std::chrono::high_resolution_clock::now();
+    for (auto i = 0u; i < kNumIterations; ++i)
+    {
+        ASSERT_NO_THROW(m_renderer->Render(scene));
+    }
+
+    // Reading the output waits for rendering to finish
+    std::vector<RadeonRays::float3> data(kOutputWidth * kOutputHeight);
+    m_output->GetData(&data[0]);
+    auto time = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+    std::cout << "Geometry: " << static_cast<double>(geometry_size) / num_triangles << " bytes per triangle ("
+        << static_cast<double>(uncompressed_size) / num_triangles << " uncompressed), "
+        << kOutputWidth * kOutputHeight * kNumIterations / time * 1e-6 << " Mrays/s (primary)" << std::endl;
+
+#ifdef BAIKAL_COMPACT_GEOMETRY
+    ASSERT_LT(geometry_size, uncompressed_size);
+#else
+    ASSERT_EQ(geometry_size, uncompressed_size);
+#endif
+}
@@ -22,6 +22,7 @@
 #pragma once
 
 #include "basic.h"
+#include "Renderers/monte_carlo_renderer.h"
 
 class TestScenesTest : public BasicTest
 {
@@ -188,4 +189,70 @@ TEST_F(TestScenesTest, TestScenes_San_Miguel)
     AttachLight(30.f);
 
     DrawScene();
-}
\ No newline at end of file
+}
+
+// Compares samples per second with and without restarting terminated paths between bounces.
+// Interior scenes keep most of the paths alive for several bounces, yet terminate them at
+// different bounces, which leaves the batch sparse without regeneration.
+TEST_F(TestScenesTest, TestScenes_Classroom_PathRegenerationBenchmark)
+{
+    m_camera = Baikal::PerspectiveCamera::Create(
+        RadeonRays::float3(.0f, 1.f, 3.f),
+        RadeonRays::float3(.244f, 1.021f, 2.030f),
+        RadeonRays::float3(0.f, 1.f, 0.f));
+
+    if (!PrepeareScene(
+        "../Resources/TestData/Classroom/classroom.obj",
+        "../Resources/TestData/Classroom/"))
+    {
+        std::cout << "There's no Classroom test set" << std::endl;
+        return;
+    }
+
+    AttachLight(30.f);
+
+    auto renderer = dynamic_cast<Baikal::MonteCarloRenderer*>(m_renderer.get());
+    ASSERT_NE(renderer, nullptr);
+
+    ASSERT_NO_THROW(m_controller->CompileScene(m_scene));
+
+    auto& scene = m_controller->GetCachedScene(m_scene);
+    std::vector<RadeonRays::float3> image(m_output->width() * m_output->height());
+
+    for (auto regenerate : { false, true })
+    {
+        renderer->SetPathRegeneration(regenerate);
+
+        // Warm up, so kernel compilation is not measured
+        ASSERT_NO_THROW(m_renderer->Render(scene));
+        ClearOutput();
+
+        auto start = std::chrono::high_resolution_clock::now();
+        for (auto i = 0u; i < kNumIterations; ++i)
+        {
+            ASSERT_NO_THROW(m_renderer->Render(scene));
+        }
+        // Reading the output waits for rendering to finish
+        m_output->GetData(&image[0]);
+        auto end = std::chrono::high_resolution_clock::now();
+
+        // Regenerated paths add samples to their pixels, w counts all of them
+        double num_samples = 0.0;
+        for (auto const& v : image)
+        {
+            num_samples += v.w;
+        }
+
+        ASSERT_GE(num_samples, static_cast<double>(kNumIterations) * image.size());
+
+        double seconds = std::chrono::duration_cast<std::chrono::duration<double>>(end - start).count();
+        double samples_per_second = seconds > 0.0 ? num_samples / seconds : 0.0;
+        std::cout << (regenerate ? "With" : "Without") << " path regeneration: " << samples_per_second / 1e6 << " Msamples/s" << std::endl;
+
+        std::ostringstream oss;
+        oss << test_name() << (regenerate ? "_regenerated" : "_plain") << ".png";
+        SaveOutput(oss.str());
+    }
+
+    renderer->SetPathRegeneration(false);
+}
@@ -0,0 +1,264 @@
+/**********************************************************************
+Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#pragma once
+
+#include "basic.h"
+#include "image_io.h"
+#include "texture_cache.h"
+#include "texture_encoder.h"
+#include "Controllers/clw_virtual_texture_cache.h"
+
+#include <chrono>
+#include <cstring>
+
+class TextureTest : public BasicTest
+{
+public:
+    static std::uint32_t constexpr kReferenceIterations = 1024;
+
+    virtual void LoadTestScene() override
+    {
+        m_scene = Baikal::SceneIo::LoadScene("textured_plane.test", "");
+    }
+
+    virtual void SetupCamera() override
+    {
+        BasicTest::SetupCamera();
+        m_camera->LookAt(
+            RadeonRays::float3(0.f, 1.5f, -10.f),
+            RadeonRays::float3(0.f, 0.f, 50.f),
+            RadeonRays::float3(0.f, 1.f, 0.f));
+    }
+
+    // Renders test scene and returns normalized image along with samples per second.
+    // Warm up iterations are not accumulated into the image.
+    void RenderScene(std::string const& scene_name, std::uint32_t num_iterations, std::vector<RadeonRays::float3>& image, double& samples_per_second,
+        std::uint32_t num_warmup_iterations = 1)
+    {
+        m_scene = Baikal::SceneIo::LoadScene(scene_name + ".test", "");
+        SetupCamera();
+
+        ASSERT_NO_THROW(m_controller->CompileScene(m_scene));
+        auto& scene = m_controller->GetCachedScene(m_scene);
+
+        ASSERT_NO_THROW(samples_per_second = RenderNormalizedImage(scene, num_iterations, image, num_warmup_iterations));
+    }
+};
+
+TEST_F(TextureTest, Texture_GenerateMipmaps)
+{
+    auto image_io(Baikal::ImageIo::CreateImageIo());
+    auto texture = image_io->LoadImage("../Resources/Textures/test_albedo1.jpg");
+    auto size = texture->GetSize();
+    auto level0_size = texture->GetSizeInBytes();
+
+    ASSERT_EQ(texture->GetMipLevelCount(), 1u);
+    ASSERT_NO_THROW(texture->GenerateMipmaps());
+
+    // Assertion macros bind arguments by reference, so copy the constant to avoid its ODR-use
+    auto const max_levels = Baikal::Texture::kMaxMipLevels;
+    auto mip_count = texture->GetMipLevelCount();
+    ASSERT_GT(mip_count, 1u);
+    ASSERT_LE(mip_count, max_levels);
+    ASSERT_EQ(texture->GetSizeInBytes(), level0_size);
+    ASSERT_EQ(texture->GetMipLevelOffset(1), level0_size);
+
+    for (auto i = 1u; i < mip_count; ++i)
+    {
+        auto level_size = texture->GetMipLevelSize(i);
+        ASSERT_EQ(level_size.x, std::max(size.x >> i, 1));
+        ASSERT_EQ(level_size.y, std::max(size.y >> i, 1));
+    }
+
+    auto last_level = texture->GetMipLevelSize(mip_count - 1);
+    ASSERT_TRUE((last_level.x == 1 && last_level.y == 1) || mip_count == max_levels);
+}
+
+// Compares samples per second and convergence of single level and mipmapped textures.
+// Both versions are compared to converged single level image, filtering should reduce aliasing noise.
+TEST_F(TextureTest, Texture_MipmapBenchmark)
+{
+    std::vector<RadeonRays::float3> reference;
+    std::vector<RadeonRays::float3> image;
+    double samples_per_second = 0.0;
+    double rmse[2] = { 0.0, 0.0 };
+
+    RenderScene("textured_plane", kReferenceIterations, reference, samples_per_second);
+
+    for (auto mipmaps : { false, true })
+    {
+        std::string scene_name = mipmaps ? "textured_plane+mipmaps" : "textured_plane";
+        RenderScene(scene_name, kNumIterations, image, samples_per_second);
+        rmse[mipmaps ? 1 : 0] = ComputeRmse(image, reference);
+
+        std::cout << scene_name << ": " << samples_per_second / 1e6 << " Msamples/s, RMSE after "
+            << kNumIterations << " iterations: " << rmse[mipmaps ? 1 : 0] << std::endl;
+
+        SaveOutput(test_name() + "_" + scene_name + ".png");
+    }
+
+    ASSERT_LE(rmse[1], rmse[0]);
+}
+
+// Reports memory used by test textures before and after conversion to compact formats
+TEST_F(TextureTest, Texture_CompressionMemoryUsage)
+{
+    auto image_io(Baikal::ImageIo::CreateImageIo());
+
+    std::size_t total_before = 0;
+    std::size_t total_after = 0;
+
+    for (auto const& name : { "test_albedo1.jpg", "test_albedo2.jpg", "test_albedo3.jpg", "test_bump.jpg", "test_normal.jpg" })
+    {
+        auto texture = image_io->LoadImage(std::string("../Resources/Textures/") + name);
+        texture->GenerateMipmaps();
+
+        auto format = Baikal::TextureEncoder::SelectFormat(*texture);
+        Baikal::Texture::Ptr encoded;
+        ASSERT_NO_THROW(encoded = Baikal::TextureEncoder::Encode(*texture, format));
+
+        ASSERT_EQ(encoded->GetMipLevelCount(), texture->GetMipLevelCount());
+        ASSERT_LE(encoded->GetMipChainSizeInBytes(), texture->GetMipChainSizeInBytes());
+
+        total_before += texture->GetMipChainSizeInBytes();
+        total_after += encoded->GetMipChainSizeInBytes();
+
+        std::cout << name << ": " << texture->GetMipChainSizeInBytes() / 1024 << " KB -> "
+            << encoded->GetMipChainSizeInBytes() / 1024 << " KB (format " << static_cast<int>(format) << ")" << std::endl;
+    }
+
+    std::cout << "Total: " << total_before / 1024 << " KB -> " << total_after / 1024 << " KB" << std::endl;
+    ASSERT_LE(total_after * 4, total_before);
+}
+
+// Compares block compressed texture against uncompressed one
+TEST_F(TextureTest, Texture_CompressionQuality)
+{
+    std::vector<RadeonRays::float3> reference;
+    std::vector<RadeonRays::float3> image;
+    double samples_per_second = 0.0;
+
+    RenderScene("textured_plane+mipmaps", kNumIterations, reference, samples_per_second);
+    RenderScene("textured_plane+bc", kNumIterations, image, samples_per_second);
+
+    auto rmse = ComputeRmse(image, reference);
+    std::cout << "textured_plane+bc: " << samples_per_second / 1e6 << " Msamples/s, RMSE to uncompressed: " << rmse << std::endl;
+    SaveOutput(test_name() + ".png");
+
+    ASSERT_LT(rmse, 0.05);
+}
+
+// Streams virtual texture through a cache smaller than its mip chain and
+// compares the result against the resident mipmapped texture
+TEST_F(TextureTest, Texture_VirtualStreaming)
+{
+    std::size_t const kCacheSize = 4 * 1024 * 1024;
+
+    std::vector<RadeonRays::float3> reference;
+    std::vector<RadeonRays::float3> image;
+    double samples_per_second = 0.0;
+
+    RenderScene("textured_plane+mipmaps", kNumIterations, reference, samples_per_second);
+
+    auto controller = dynamic_cast<Baikal::ClwSceneController*>(m_controller.get());
+    ASSERT_NE(controller, nullptr);
+    auto old_cache_size = controller->GetVirtualTextureCacheSize();
+    controller->SetVirtualTextureCacheSize(kCacheSize);
+
+    // Warm up iterations request visible tiles, so they are resident when measuring
+    RenderScene("textured_plane+virtual", kNumIterations, image, samples_per_second, kNumIterations);
+
+    auto& scene = m_controller->GetCachedScene(m_scene);
+    ASSERT_NE(scene.virtual_textures, nullptr);
+    auto const& cache = *scene.virtual_textures;
+
+    auto rmse = ComputeRmse(image, reference);
+    std::cout << "textured_plane+virtual: " << samples_per_second / 1e6 << " Msamples/s, RMSE to resident: " << rmse
+        << ", resident tiles: " << cache.GetNumResidentTiles() << "/" << cache.GetCapacityInTiles()
+        << ", uploaded: " << cache.GetNumBytesUploaded() / 1024 << " KB" << std::endl;
+    SaveOutput(test_name() + ".png");
+
+    controller->SetVirtualTextureCacheSize(old_cache_size);
+
+    ASSERT_LE(cache.GetNumResidentTiles(), cache.GetCapacityInTiles());
+    ASSERT_GT(cache.GetNumBytesUploaded(), 0u);
+    ASSERT_LT(rmse, 0.05);
+}
+
+// Same file requested through different paths is decoded once
+TEST_F(TextureTest, TextureCache_Deduplication)
+{
+    Baikal::TextureCache cache(Baikal::ImageIo::CreateImageIo());
+
+    auto textures = cache.LoadAsync({
+        "../Resources/Textures/test_albedo1.jpg",
+        "../Resources/Textures/test_albedo2.jpg",
+        "../Resources/Textures/../Textures/test_albedo1.jpg" });
+
+    ASSERT_EQ(textures.size(), 3u);
+    ASSERT_NE(textures[0].get(), nullptr);
+    ASSERT_NE(textures[0].get(), textures[1].get());
+    ASSERT_EQ(textures[0].get(), textures[2].get());
+    ASSERT_EQ(cache.Load("../Resources/Textures/test_albedo1.jpg"), textures[0].get());
+
+    // Mipmapped version is a separate entry
+    auto mipmapped = cache.Load("../Resources/Textures/test_albedo1.jpg", true);
+    ASSERT_NE(mipmapped, textures[0].get());
+    ASSERT_GT(mipmapped->GetMipLevelCount(), 1u);
+
+    ASSERT_THROW(cache.Load("../Resources/Textures/missing.jpg"), std::runtime_error);
+}
+
+// Decoded payloads read back from disk match decoded image
+TEST_F(TextureTest, TextureCache_DiskCache)
+{
+    auto const cache_path = m_output_path + test_name();
+    auto const file_name = "../Resources/Textures/test_albedo1.jpg";
+
+    Baikal::Texture::Ptr reference;
+    double decode_time = 0.0;
+    {
+        Baikal::TextureCache cache(Baikal::ImageIo::CreateImageIo());
+        cache.SetDiskCachePath(cache_path);
+
+        auto start = std::chrono::high_resolution_clock::now();
+        reference = cache.Load(file_name, true);
+        decode_time = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+    }
+
+    Baikal::TextureCache cache(Baikal::ImageIo::CreateImageIo());
+    cache.SetDiskCachePath(cache_path);
+
+    auto start = std::chrono::high_resolution_clock::now();
+    auto texture = cache.Load(file_name, true);
+    auto cached_time = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+    std::cout << "Decode: " << decode_time * 1000.0 << " ms, disk cache: " << cached_time * 1000.0 << " ms" << std::endl;
+
+    ASSERT_NE(texture, reference);
+    ASSERT_EQ(texture->GetFormat(), reference->GetFormat());
+    ASSERT_EQ(texture->GetSize().x, reference->GetSize().x);
+    ASSERT_EQ(texture->GetSize().y, reference->GetSize().y);
+    ASSERT_EQ(texture->GetMipLevelCount(), reference->GetMipLevelCount());
+    ASSERT_EQ(texture->GetMipChainSizeInBytes(), reference->GetMipChainSizeInBytes());
+    ASSERT_EQ(std::memcmp(texture->GetData(), reference->GetData(), texture->GetMipChainSizeInBytes()), 0);
+}
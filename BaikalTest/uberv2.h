@@ -25,6 +25,7 @@ THE SOFTWARE.
 #include "SceneGraph/light.h"
 #include "SceneGraph/shape.h"
 #include "SceneGraph/material.h"
+#include "Renderers/monte_carlo_renderer.h"
 #include "image_io.h"
 
 #define _USE_MATH_DEFINES
@@ -70,3 +71,77 @@ TEST_F(UberV2Test, UberV2_Basic)
         ASSERT_TRUE(CompareToReference(oss.str()));
     }
 }
+
+// Compares samples per second of shading with and without sorting hits by material.
+// Sorting only changes the order hits are shaded in, so both images converge to the same result.
+TEST_F(UberV2Test, UberV2_MaterialSortingBenchmark)
+{
+    auto renderer = dynamic_cast<Baikal::MonteCarloRenderer*>(m_renderer.get());
+    ASSERT_NE(renderer, nullptr);
+
+    m_camera->LookAt(
+        RadeonRays::float3(0.f, 0.f, 10.f),
+        RadeonRays::float3(0.f, 0.f, 9.f),
+        RadeonRays::float3(0.f, 1.f, 0.f));
+
+    ASSERT_NO_THROW(m_controller->CompileScene(m_scene));
+
+    auto& scene = m_controller->GetCachedScene(m_scene);
+    auto const num_iterations = 4 * kNumIterations;
+
+    std::vector<RadeonRays::float3> images[2];
+
+    for (auto sorted : { false, true })
+    {
+        auto& image = images[sorted ? 1 : 0];
+        renderer->SetMaterialSorting(sorted);
+
+        double samples_per_second = 0.0;
+        ASSERT_NO_THROW(samples_per_second = RenderNormalizedImage(scene, num_iterations, image, 1));
+        std::cout << (sorted ? "Sorted" : "Unsorted") << " shading: " << samples_per_second / 1e6 << " Msamples/s" << std::endl;
+
+        std::ostringstream oss;
+        oss << test_name() << (sorted ? "_sorted" : "_unsorted") << ".png";
+        SaveOutput(oss.str());
+    }
+
+    renderer->SetMaterialSorting(false);
+
+    auto relative_rmse = ComputeRelativeRmse(images[1], images[0]);
+    std::cout << "Relative RMSE to unsorted shading: " << relative_rmse << std::endl;
+    ASSERT_LT(relative_rmse, 0.15);
+}
+
+// Same scene rendered with interpreted UberV2 materials
+class UberV2InterpreterTest : public UberV2Test
+{
+protected:
+    Baikal::MaterialCompilationMode GetMaterialCompilationMode() const override
+    {
+        return Baikal::MaterialCompilationMode::kInterpreter;
+    }
+};
+
+TEST_F(UberV2InterpreterTest, UberV2_Interpreter_Basic)
+{
+    m_camera->LookAt(
+        RadeonRays::float3(0.f, 0.f, 10.f),
+        RadeonRays::float3(0.f, 0.f, 9.f),
+        RadeonRays::float3(0.f, 1.f, 0.f));
+
+    ASSERT_NO_THROW(m_controller->CompileScene(m_scene));
+
+    auto& scene = m_controller->GetCachedScene(m_scene);
+
+    for (auto i = 0u; i < kNumIterations; ++i)
+    {
+        ASSERT_NO_THROW(m_renderer->Render(scene));
+    }
+
+    {
+        std::ostringstream oss;
+        oss << test_name() << ".png";
+        SaveOutput(oss.str());
+        ASSERT_TRUE(CompareToReference(oss.str(), "UberV2_Basic.png"));
+    }
+}
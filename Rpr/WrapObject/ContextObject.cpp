@@ -36,6 +36,7 @@ THE SOFTWARE.
 #include "SceneGraph/light.h"
 
 #include "RenderFactory/render_factory.h"
+#include "RenderFactory/clw_render_factory.h"
 
 namespace
 {
@@ -94,6 +95,7 @@ namespace
     { RPR_CONTEXT_GPU7_NAME,{ "gpu7name", "Name of the GPU index 7 in context. Constant value.", RPR_PARAMETER_TYPE_STRING } },
     { RPR_CONTEXT_CPU_NAME,{ "cpuname", "Name of the CPU in context. Constant value.", RPR_PARAMETER_TYPE_STRING } },
     { RPR_CONTEXT_RANDOM_SEED,{ "randseed", "Random seed", RPR_PARAMETER_TYPE_UINT } },
+    { RPR_CONTEXT_ITERATIONS,{ "iterations", "Number of iterations rendered by single render call", RPR_PARAMETER_TYPE_UINT } },
     };
 
     std::map<uint32_t, Baikal::Renderer::OutputType> kOutputTypeMap = { {RPR_AOV_COLOR, Baikal::Renderer::OutputType::kColor},
@@ -111,6 +113,7 @@ namespace
 
 ContextObject::ContextObject(rpr_creation_flags creation_flags)
     : m_current_scene(nullptr)
+    , m_iterations(1)
 {
     rpr_int result = RPR_SUCCESS;
 
@@ -153,6 +156,65 @@ void ContextObject::GetRenderStatistics(void * out_data, size_t * out_size_ret)
     }
 }
 
+void ContextObject::GetRenderStatistics(Baikal::RenderStatistics& stats) const
+{
+    stats = Baikal::RenderStatistics();
+
+    for (const auto& cfg : m_cfgs)
+    {
+        Baikal::RenderStatistics cfg_stats;
+        if (!cfg.renderer->GetStatistics(cfg_stats))
+        {
+            continue;
+        }
+
+        //devices render the same frames
+        stats.num_frames = std::max(stats.num_frames, cfg_stats.num_frames);
+        stats.time_ms += cfg_stats.time_ms;
+        stats.bytes_uploaded += cfg_stats.bytes_uploaded;
+
+        for (const auto& kernel : cfg_stats.kernels)
+        {
+            auto it = std::find_if(stats.kernels.begin(), stats.kernels.end(),
+                [&kernel](Baikal::RenderStatistics::Kernel const& k) { return k.name == kernel.name; });
+
+            if (it == stats.kernels.end())
+            {
+                stats.kernels.push_back(kernel);
+            }
+            else
+            {
+                it->num_launches += kernel.num_launches;
+                it->time_ms += kernel.time_ms;
+            }
+        }
+
+        if (stats.passes.size() < cfg_stats.passes.size())
+        {
+            stats.passes.resize(cfg_stats.passes.size());
+        }
+
+        for (size_t i = 0; i < cfg_stats.passes.size(); ++i)
+        {
+            stats.passes[i].num_rays += cfg_stats.passes[i].num_rays;
+            stats.passes[i].time_ms += cfg_stats.passes[i].time_ms;
+        }
+
+        stats.compilations.insert(stats.compilations.end(), cfg_stats.compilations.begin(), cfg_stats.compilations.end());
+    }
+
+    std::sort(stats.kernels.begin(), stats.kernels.end(),
+        [](Baikal::RenderStatistics::Kernel const& lhs, Baikal::RenderStatistics::Kernel const& rhs) { return lhs.time_ms > rhs.time_ms; });
+}
+
+void ContextObject::SetProfilingEnabled(bool enable)
+{
+    for (auto& cfg : m_cfgs)
+    {
+        cfg.renderer->SetProfilingEnabled(enable);
+    }
+}
+
 void ContextObject::SetAOV(rpr_int in_aov, FramebufferObject* buffer)
 {
     FramebufferObject* old_buf = GetAOV(in_aov);
@@ -209,7 +271,15 @@ void ContextObject::Render()
     for (auto& c : m_cfgs)
     {
         auto& scene = c.controller->GetCachedScene(m_current_scene->GetScene());
-        c.renderer->Render(scene);
+        if (m_iterations > 1)
+        {
+            // Enqueue all iterations without waiting for device in between
+            c.renderer->RenderProgressive(scene, m_iterations);
+        }
+        else
+        {
+            c.renderer->Render(scene);
+        }
     }
     PostRender();
 }
@@ -303,6 +373,7 @@ FramebufferObject* ContextObject::CreateFrameBuffer(rpr_framebuffer_format const
     auto& c = m_cfgs[0];
     Baikal::Output* out = c.factory->CreateOutput(in_fb_desc->fb_width, in_fb_desc->fb_height).release();
     FramebufferObject* result = new FramebufferObject(out);
+    result->SetReadback(static_cast<Baikal::ClwRenderFactory*>(c.factory.get())->CreateOutputReadback());
     return result;
 }
 
@@ -320,6 +391,7 @@ FramebufferObject* ContextObject::CreateFrameBufferFromGLTexture(rpr_GLenum targ
     std::uint32_t h = static_cast<std::uint32_t>(result->Height());
     Baikal::Output* out = c.factory->CreateOutput(w, h).release();
     result->SetOutput(out);
+    result->SetReadback(static_cast<Baikal::ClwRenderFactory*>(c.factory.get())->CreateOutputReadback());
     return result;
 }
 
@@ -345,6 +417,9 @@ void ContextObject::SetParameter(const std::string& input, rpr_uint value)
             c.renderer->SetRandomSeed(value);
         }
         break;
+    case RPR_CONTEXT_ITERATIONS:
+        m_iterations = std::max(value, 1u);
+        break;
     default:
         throw Exception(RPR_ERROR_UNIMPLEMENTED, "ContextObject: requested parameter is not implemented");
     }
@@ -52,6 +52,9 @@ public:
     
     //context info
     void GetRenderStatistics(void * out_data, size_t * out_size_ret) const;
+    //profiling statistics summed over devices, empty unless profiling is enabled
+    void GetRenderStatistics(Baikal::RenderStatistics& stats) const;
+    void SetProfilingEnabled(bool enable);
     void SetParameter(const std::string& input, rpr_uint value);
     void SetParameter(const std::string& input, float x, float y = 0.f, float z = 0.f, float w = 0.f);
     void SetParameter(const std::string& input, const std::string& value);
@@ -92,4 +95,6 @@ private:
     //know framefubbers used as AOV outputs
     std::set<FramebufferObject*> m_output_framebuffers;
     SceneObject* m_current_scene;
+    //number of iterations rendered by Render() call
+    rpr_uint m_iterations;
 };
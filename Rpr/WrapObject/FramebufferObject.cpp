@@ -119,24 +119,13 @@ void FramebufferObject::SaveToFile(const char* path)
 
     std::size_t width = Width();
     size_t height = Height();
-    std::vector<RadeonRays::float3> tempbuf(width * height);
-    GetData(tempbuf.data());
-    std::vector<RadeonRays::float3> data(tempbuf);
 
-    //convert pixels
-    for (std::size_t y = 0; y < height; ++y)
-    {
-        for (std::size_t x = 0; x < width; ++x)
-        {
-
-            RadeonRays::float3 val = data[(height - 1 - y) * width + x];
-            tempbuf[y * width + x] = (1.f / val.w) * val;
-
-            tempbuf[y * width + x].x = std::pow(tempbuf[y * width + x].x, 1.f / 2.2f);
-            tempbuf[y * width + x].y = std::pow(tempbuf[y * width + x].y, 1.f / 2.2f);
-            tempbuf[y * width + x].z = std::pow(tempbuf[y * width + x].z, 1.f / 2.2f);
-        }
-    }
+    //normalize, apply gamma and flip rows on device
+    Baikal::ClwOutputReadback::Settings settings;
+    settings.channels = 3;
+    settings.gamma = 2.2f;
+    settings.flip_y = true;
+    auto request = m_readback->Read(*static_cast<Baikal::ClwOutput*>(m_output), settings);
 
     //save results to file
     ImageOutput* out = ImageOutput::create(path);
@@ -147,7 +136,7 @@ void FramebufferObject::SaveToFile(const char* path)
 
     ImageSpec spec(static_cast<int>(width), static_cast<int>(height), 3, TypeDesc::FLOAT);
     out->open(path, spec);
-    out->write_image(TypeDesc::FLOAT, &tempbuf[0], sizeof(RadeonRays::float3));
+    out->write_image(TypeDesc::FLOAT, request.Get());
     out->close();
     delete out;
 }
@@ -23,9 +23,12 @@ THE SOFTWARE.
 
 #include "WrapObject.h"
 #include "Output/clwoutput.h"
+#include "Output/clw_output_readback.h"
 #include "Renderers/renderer.h"
 #include "RadeonProRender_GL.h"
 
+#include <memory>
+
 //this class represent rpr_context
 class FramebufferObject
     : public WrapObject
@@ -42,6 +45,12 @@ public:
         m_output = out;
     }
 
+    //readback used to resolve output on device when saving
+    void SetReadback(std::unique_ptr<Baikal::ClwOutputReadback> readback)
+    {
+        m_readback = std::move(readback);
+    }
+
     std::size_t Width();
     std::size_t Height();
     void GetData(void* out_data);
@@ -59,4 +68,5 @@ private:
     CLWImage2D m_cl_interop_image;
     CLWContext m_context;
     CLWKernel m_copy_cernel;
+    std::unique_ptr<Baikal::ClwOutputReadback> m_readback;
 };
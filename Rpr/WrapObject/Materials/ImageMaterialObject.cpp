@@ -65,6 +65,18 @@ ImageMaterialObject::ImageMaterialObject(rpr_image_format const in_format, rpr_i
         throw Exception(RPR_ERROR_INVALID_PARAMETER, "TextureObject: invalid format type.");
     }
     pixel_bytes *= component_bytes;
+
+    //two component images are stored as is
+    if (in_format.num_components == 2)
+    {
+        data_format = component_bytes == 1 ? Texture::Format::kRg8 :
+            (component_bytes == 2 ? Texture::Format::kRg16 : Texture::Format::kRg32);
+        char* data = new char[pixel_bytes * pixels_count];
+        memcpy(data, in_data, pixel_bytes * pixels_count);
+        m_tex = Texture::Create(data, tex_size, data_format);
+        return;
+    }
+
     int data_size = 4 * component_bytes * pixels_count;//4 component baikal texture
     char* data = new char[data_size];
     if (in_format.num_components == 4)
@@ -67,10 +67,10 @@ void TextureMaterialObject::CopyData(MaterialObject* in)
     const char* data = tex->GetData();
     auto size = tex->GetSize();
     auto format = tex->GetFormat();
-    char* tex_data = new char[tex->GetSizeInBytes()];
-    memcpy(tex_data, data, tex->GetSizeInBytes());
+    char* tex_data = new char[tex->GetMipChainSizeInBytes()];
+    memcpy(tex_data, data, tex->GetMipChainSizeInBytes());
 
-    m_tex->SetData(tex_data, size, format);
+    m_tex->SetData(tex_data, size, format, tex->GetMipLevelCount());
 }
 
 rpr_image_desc TextureMaterialObject::GetImageDesc() const
@@ -89,19 +89,24 @@ rpr_image_format TextureMaterialObject::GetImageFormat() const
     switch (m_tex->GetFormat())
     {
     case Baikal::Texture::Format::kRgba8:
+    case Baikal::Texture::Format::kR8:
+    case Baikal::Texture::Format::kRg8:
         type = RPR_COMPONENT_TYPE_UINT8;
         break;
     case Baikal::Texture::Format::kRgba16:
+    case Baikal::Texture::Format::kR16:
+    case Baikal::Texture::Format::kRg16:
         type = RPR_COMPONENT_TYPE_FLOAT16;
         break;
     case Baikal::Texture::Format::kRgba32:
+    case Baikal::Texture::Format::kR32:
+    case Baikal::Texture::Format::kRg32:
         type = RPR_COMPONENT_TYPE_FLOAT32;
         break;
     default:
         throw Exception(RPR_ERROR_INTERNAL_ERROR, "MaterialObject: invalid image format.");
     }
-    //only 4component textures used
-    return{ 4, type };
+    return{ Baikal::Texture::GetChannelCount(m_tex->GetFormat()), type };
 }
 
 Baikal::Texture::Ptr TextureMaterialObject::GetTexture() 
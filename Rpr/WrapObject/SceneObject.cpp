@@ -31,6 +31,7 @@ THE SOFTWARE.
 #include "SceneGraph/iterator.h"
 
 #include <assert.h>
+#include <set>
 
 SceneObject::SceneObject()
     : m_scene(nullptr)
@@ -139,15 +140,14 @@ RadeonRays::bbox SceneObject::GetBBox()
 
 void SceneObject::AddEmissive()
 {
-    //TODO: check scene isn't changed
-    //recreate amissives if scene is dirty
+    //update emissives only if scene is dirty
     if (!m_scene->GetDirtyFlags())
     {
         return;
     }
-    RemoveEmissive();
 
-    //handle emissive materials
+    //find meshes with emissive materials
+    std::set<Baikal::Mesh::Ptr> emissive_meshes;
     for (std::unique_ptr<Baikal::Iterator> it_shape(m_scene->CreateShapeIterator()); it_shape->IsValid(); it_shape->Next())
     {
         auto shape = it_shape->ItemAs<Baikal::Shape>();
@@ -162,29 +162,43 @@ void SceneObject::AddEmissive()
         assert(mesh);
 
         auto mat = mesh->GetMaterial();
-        if (!mat)
+        if (mat && mat->HasEmission())
         {
-            continue;
+            emissive_meshes.insert(mesh);
         }
-        //fine shapes with emissive material
-        if (mat->HasEmission())
+    }
+
+    //remove lights of meshes which are not emissive anymore
+    for (auto it = m_emmisive_lights.begin(); it != m_emmisive_lights.end();)
+    {
+        if (emissive_meshes.find(it->first) == emissive_meshes.end())
+        {
+            m_scene->DetachLight(it->second);
+            it = m_emmisive_lights.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+
+    //add single light for each new emissive mesh, existing ones are kept
+    for (auto& mesh : emissive_meshes)
+    {
+        if (m_emmisive_lights.find(mesh) == m_emmisive_lights.end())
         {
-            // Add area light for each polygon of emissive mesh
-            for (std::size_t l = 0; l < mesh->GetNumIndices() / 3; ++l)
-            {
-                auto light = Baikal::AreaLight::Create(mesh, l);
-                m_scene->AttachLight(light);
-                m_emmisive_lights.push_back(light);
-            }
+            auto light = Baikal::MeshLight::Create(mesh);
+            m_scene->AttachLight(light);
+            m_emmisive_lights[mesh] = light;
         }
     }
 }
 
 void SceneObject::RemoveEmissive()
 {
-    for (auto light : m_emmisive_lights)
+    for (auto& light : m_emmisive_lights)
     {
-        m_scene->DetachLight(light);
+        m_scene->DetachLight(light.second);
     }
     
     m_emmisive_lights.clear();
@@ -0,0 +1,145 @@
+/**********************************************************************
+ Copyright (c) 2018 Advanced Micro Devices, Inc. All rights reserved.
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ********************************************************************/
+
+#include "scene_io.h"
+#include "SceneGraph/scene1.h"
+#include "SceneGraph/shape.h"
+#include "SceneGraph/iterator.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#ifdef WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+namespace
+{
+    char const* kHelpMessage =
+        "LoaderBenchmark -f <scene file> [-p <resource base path>] [-n <number of runs>]";
+}
+
+static char* GetCmdOption(char** begin, char** end, const std::string& option)
+{
+    char** itr = std::find(begin, end, option);
+    if (itr != end && ++itr != end)
+    {
+        return *itr;
+    }
+    return 0;
+}
+
+// Peak resident set size of the process in bytes
+static std::size_t GetPeakRss()
+{
+#ifdef WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+    {
+        return counters.PeakWorkingSetSize;
+    }
+    return 0;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+    {
+        return 0;
+    }
+#ifdef __APPLE__
+    // Reported in bytes on macOS
+    return static_cast<std::size_t>(usage.ru_maxrss);
+#else
+    // Reported in kilobytes on Linux
+    return static_cast<std::size_t>(usage.ru_maxrss) * 1024u;
+#endif
+#endif
+}
+
+static std::size_t CountTriangles(Baikal::Scene1 const& scene)
+{
+    std::size_t num_triangles = 0;
+
+    auto shape_iter = scene.CreateShapeIterator();
+    for (; shape_iter->IsValid(); shape_iter->Next())
+    {
+        auto mesh = std::dynamic_pointer_cast<Baikal::Mesh>(shape_iter->ItemAs<Baikal::Shape>());
+        if (mesh)
+        {
+            num_triangles += mesh->GetNumIndices() / 3;
+        }
+    }
+
+    return num_triangles;
+}
+
+void Process(int argc, char** argv)
+{
+    char* file_name = GetCmdOption(argv, argv + argc, "-f");
+
+    if (!file_name)
+    {
+        std::cout << kHelpMessage << std::endl;
+        return;
+    }
+
+    char* base_path = GetCmdOption(argv, argv + argc, "-p");
+    char* num_runs_str = GetCmdOption(argv, argv + argc, "-n");
+    int num_runs = num_runs_str ? std::max(1, std::atoi(num_runs_str)) : 1;
+
+    for (int i = 0; i < num_runs; ++i)
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+        auto scene = Baikal::SceneIo::LoadScene(file_name, base_path ? base_path : "");
+        auto time = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+        auto num_triangles = CountTriangles(*scene);
+
+        std::cout << "Run " << i << ": " << time << " s, "
+            << scene->GetNumShapes() << " shapes, "
+            << num_triangles << " triangles, "
+            << (time > 0.0 ? num_triangles / time : 0.0) << " triangles/s" << std::endl;
+    }
+
+    std::cout << "Peak RSS: " << GetPeakRss() / (1024.0 * 1024.0) << " MB" << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+    try
+    {
+        Process(argc, argv);
+    }
+    catch (std::exception& ex)
+    {
+        std::cerr << "Caught exception: " << ex.what() << std::endl;
+        return -1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,102 @@
+/**********************************************************************
+Copyright (c) 2018 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+
+#include "PostEffects/ML/model.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace
+{
+    // Box filter of the first three channels standing in for a denoising network.
+    // It does the same amount of memory traffic per pixel as a small network would
+    // and is local, so tiled inference gives the same result as whole frame inference
+    // as long as tile overlap is at least twice the radius.
+    class BoxFilterModel : public ML::Model
+    {
+    public:
+        static std::size_t constexpr kRadius = 2;
+        static std::size_t constexpr kOutputChannels = 3;
+
+        void infer(ValueType const* input,
+                   std::size_t width,
+                   std::size_t height,
+                   std::size_t channels,
+                   ValueType* output) const override
+        {
+            std::vector<ValueType> temp(width * height * kOutputChannels);
+
+            // Horizontal pass, averaging over pixels inside the image only
+            for (std::size_t y = 0; y < height; ++y)
+            {
+                for (std::size_t x = 0; x < width; ++x)
+                {
+                    auto begin = x > kRadius ? x - kRadius : 0;
+                    auto end = std::min(x + kRadius + 1, width);
+                    auto dst = &temp[(y * width + x) * kOutputChannels];
+
+                    for (std::size_t c = 0; c < kOutputChannels; ++c)
+                    {
+                        ValueType sum = 0;
+                        for (auto i = begin; i < end; ++i)
+                        {
+                            sum += input[(y * width + i) * channels + c];
+                        }
+                        dst[c] = sum / (end - begin);
+                    }
+                }
+            }
+
+            // Vertical pass
+            for (std::size_t y = 0; y < height; ++y)
+            {
+                auto begin = y > kRadius ? y - kRadius : 0;
+                auto end = std::min(y + kRadius + 1, height);
+
+                for (std::size_t x = 0; x < width; ++x)
+                {
+                    auto dst = &output[(y * width + x) * kOutputChannels];
+
+                    for (std::size_t c = 0; c < kOutputChannels; ++c)
+                    {
+                        ValueType sum = 0;
+                        for (auto i = begin; i < end; ++i)
+                        {
+                            sum += temp[(i * width + x) * kOutputChannels + c];
+                        }
+                        dst[c] = sum / (end - begin);
+                    }
+                }
+            }
+        }
+    };
+}
+
+extern "C"
+{
+    ML::Model* LoadModel(char const* /* model_path */,
+                         float /* gpu_memory_fraction */,
+                         char const* /* visible_devices */)
+    {
+        return new BoxFilterModel();
+    }
+}
@@ -0,0 +1,238 @@
+/**********************************************************************
+ Copyright (c) 2018 Advanced Micro Devices, Inc. All rights reserved.
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ********************************************************************/
+
+#include "Renderers/multi_device_renderer.h"
+#include "Output/output.h"
+#include "SceneGraph/camera.h"
+#include "SceneGraph/scene1.h"
+#include "scene_io.h"
+
+#include "CLW.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace
+{
+    char const* kHelpMessage =
+        "MultiDeviceBenchmark [-f <scene file>] [-p <resource base path>] [-type all|gpu|cpu] [-replicate <contexts per device>]"
+        " [-w <width>] [-h <height>] [-n <frames>] [-t <tile size>] [-s <samples per tile>]";
+
+    struct Options
+    {
+        std::string file_name = "sphere+ibl.test";
+        std::string base_path;
+        std::uint32_t width = 1920;
+        std::uint32_t height = 1080;
+        std::uint32_t num_frames = 16;
+        int tile_size = 256;
+        std::uint32_t samples_per_tile = 8;
+    };
+
+    struct Result
+    {
+        double samples_per_second;
+        std::vector<std::uint32_t> num_tiles;
+    };
+}
+
+static char* GetCmdOption(char** begin, char** end, const std::string& option)
+{
+    char** itr = std::find(begin, end, option);
+    if (itr != end && ++itr != end)
+    {
+        return *itr;
+    }
+    return 0;
+}
+
+static bool CmdOptionExists(char** begin, char** end, const std::string& option)
+{
+    return std::find(begin, end, option) != end;
+}
+
+static std::vector<CLWContext> CreateContexts(std::string const& type, int num_replicas, std::vector<std::string>& names)
+{
+    std::vector<CLWPlatform> platforms;
+    CLWPlatform::CreateAllPlatforms(platforms);
+
+    std::vector<CLWContext> contexts;
+
+    for (auto& platform : platforms)
+    {
+        for (auto i = 0u; i < platform.GetDeviceCount(); ++i)
+        {
+            auto device = platform.GetDevice(i);
+
+            if ((type == "gpu" && device.GetType() != CL_DEVICE_TYPE_GPU) ||
+                (type == "cpu" && device.GetType() != CL_DEVICE_TYPE_CPU))
+            {
+                continue;
+            }
+
+            for (auto r = 0; r < num_replicas; ++r)
+            {
+                contexts.push_back(CLWContext::Create(device));
+                names.push_back(device.GetName());
+            }
+        }
+    }
+
+    if (contexts.empty())
+    {
+        throw std::runtime_error("No OpenCL devices of requested type found");
+    }
+
+    return contexts;
+}
+
+static Result Run(std::vector<CLWContext> const& contexts, Baikal::Scene1::Ptr scene, Options const& options)
+{
+    Baikal::MultiDeviceRenderer renderer(contexts);
+    auto output = renderer.CreateOutput(options.width, options.height);
+
+    renderer.SetOutput(output.get());
+    renderer.SetTileSize(RadeonRays::int2(options.tile_size, options.tile_size));
+    renderer.SetSamplesPerTile(options.samples_per_tile);
+    renderer.SetRandomSeed(0);
+    renderer.CompileScene(scene);
+    renderer.Clear(RadeonRays::float3());
+
+    // Warm up: kernel compilation and first scene upload
+    renderer.Render();
+
+    Result result = { 0.0, std::vector<std::uint32_t>(contexts.size(), 0u) };
+    double time = 0.0;
+
+    for (auto i = 0u; i < options.num_frames; ++i)
+    {
+        auto stats = renderer.Render();
+        time += stats.elapsed.count();
+
+        for (std::size_t d = 0; d < contexts.size(); ++d)
+        {
+            result.num_tiles[d] += stats.num_tiles[d];
+        }
+    }
+
+    auto num_samples = static_cast<double>(options.width) * options.height * options.samples_per_tile * options.num_frames;
+    result.samples_per_second = time > 0.0 ? num_samples / time : 0.0;
+    return result;
+}
+
+static void PrintTiles(std::vector<std::uint32_t> const& num_tiles)
+{
+    std::cout << " tiles:";
+    for (auto n : num_tiles)
+    {
+        std::cout << " " << n;
+    }
+}
+
+void Process(int argc, char** argv)
+{
+    if (CmdOptionExists(argv, argv + argc, "-help"))
+    {
+        std::cout << kHelpMessage << std::endl;
+        return;
+    }
+
+    Options options;
+
+    if (char* file_name = GetCmdOption(argv, argv + argc, "-f")) options.file_name = file_name;
+    if (char* base_path = GetCmdOption(argv, argv + argc, "-p")) options.base_path = base_path;
+    if (char* width = GetCmdOption(argv, argv + argc, "-w")) options.width = std::max(1, std::atoi(width));
+    if (char* height = GetCmdOption(argv, argv + argc, "-h")) options.height = std::max(1, std::atoi(height));
+    if (char* num_frames = GetCmdOption(argv, argv + argc, "-n")) options.num_frames = std::max(1, std::atoi(num_frames));
+    if (char* tile_size = GetCmdOption(argv, argv + argc, "-t")) options.tile_size = std::max(16, std::atoi(tile_size));
+    if (char* samples = GetCmdOption(argv, argv + argc, "-s")) options.samples_per_tile = std::max(1, std::atoi(samples));
+
+    char* type_str = GetCmdOption(argv, argv + argc, "-type");
+    char* replicate_str = GetCmdOption(argv, argv + argc, "-replicate");
+
+    std::vector<std::string> names;
+    auto contexts = CreateContexts(type_str ? type_str : "all", replicate_str ? std::max(1, std::atoi(replicate_str)) : 1, names);
+
+    auto scene = Baikal::SceneIo::LoadScene(options.file_name, options.base_path);
+
+    if (!scene->GetCamera())
+    {
+        auto camera = Baikal::PerspectiveCamera::Create(
+            RadeonRays::float3(0.f, 0.f, -6.f),
+            RadeonRays::float3(0.f, 0.f, 0.f),
+            RadeonRays::float3(0.f, 1.f, 0.f));
+
+        camera->SetSensorSize(RadeonRays::float2(0.036f, 0.036f * options.height / options.width));
+        camera->SetDepthRange(RadeonRays::float2(0.0f, 100000.f));
+        camera->SetFocalLength(0.035f);
+        camera->SetFocusDistance(1.f);
+        camera->SetAperture(0.f);
+        scene->SetCamera(camera);
+    }
+
+    std::cout << std::fixed << std::setprecision(2);
+
+    // Single device throughput is the baseline for heterogeneous efficiency
+    std::vector<double> single(contexts.size());
+
+    for (std::size_t i = 0; i < contexts.size(); ++i)
+    {
+        single[i] = Run({ contexts[i] }, scene, options).samples_per_second;
+        std::cout << "Device " << i << " (" << names[i] << "): " << single[i] * 1e-6 << " Msamples/s" << std::endl;
+    }
+
+    for (std::size_t n = 1; n <= contexts.size(); ++n)
+    {
+        std::vector<CLWContext> used(contexts.begin(), contexts.begin() + n);
+        auto result = Run(used, scene, options);
+
+        double ideal = 0.0;
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            ideal += single[i];
+        }
+
+        std::cout << n << " device(s): " << result.samples_per_second * 1e-6 << " Msamples/s, efficiency "
+            << (ideal > 0.0 ? result.samples_per_second / ideal : 0.0) << ",";
+        PrintTiles(result.num_tiles);
+        std::cout << std::endl;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    try
+    {
+        Process(argc, argv);
+    }
+    catch (std::exception& ex)
+    {
+        std::cerr << "Caught exception: " << ex.what() << std::endl;
+        return -1;
+    }
+
+    return 0;
+}